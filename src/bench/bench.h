@@ -0,0 +1,241 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup Benchmarks
+\brief Minimal benchmark registry and runner in the Google Benchmark style.
+
+A benchmark is a function taking a State, which runs the measured code
+while state.keep_running() returns true:
+
+	static void
+	bench_fft(sirf::bench::State& state)
+	{
+		... set up using state.range(0), state.range(1) ...
+		while (state.keep_running())
+			... measured code ...
+		state.set_bytes_processed(state.iterations()*bytes);
+	}
+	SIRF_BENCHMARK(bench_fft)->args({ 128, 8 })->args({ 256, 8 });
+
+Each set of arguments is a separate case, named function/arg0/arg1...
+The runner output in JSON follows the Google Benchmark format, so that the
+results of two SIRF versions can be compared by the tools written for it.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#ifndef SIRF_BENCH
+#define SIRF_BENCH
+
+#include <chrono>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#define SIRF_BENCHMARK_CONCAT_(X, Y) X ## Y
+#define SIRF_BENCHMARK_NAME_(X, Y) SIRF_BENCHMARK_CONCAT_(X, Y)
+#define SIRF_BENCHMARK(F) \
+	static sirf::bench::Benchmark* SIRF_BENCHMARK_NAME_(sirf_bench_, __LINE__) = \
+		sirf::bench::Benchmark::add(#F, F)
+
+namespace sirf {
+namespace bench {
+
+	/*!
+	\ingroup Benchmarks
+	\brief Timing loop state of a running benchmark case.
+	*/
+	class State {
+	public:
+		typedef std::chrono::steady_clock clock;
+
+		State(const std::vector<int>& args, size_t max_iterations) :
+			args_(args), max_iterations_(max_iterations), iterations_(0),
+			started_(false), paused_(false), bytes_(0), items_(0), ns_(0),
+			cpu_(0) {}
+
+		// true while the measured code is to be run once more
+		bool keep_running()
+		{
+			if (!skipped_.empty())
+				return false;
+			if (!started_) {
+				started_ = true;
+				start_timing_();
+			}
+			if (iterations_ < max_iterations_) {
+				iterations_++;
+				return true;
+			}
+			stop_timing_();
+			return false;
+		}
+		int range(size_t i) const
+		{
+			return i < args_.size() ? args_[i] : 0;
+		}
+		size_t iterations() const
+		{
+			return iterations_;
+		}
+		// excludes the code between the two calls from the timing
+		void pause_timing()
+		{
+			if (!paused_) {
+				stop_timing_();
+				paused_ = true;
+			}
+		}
+		void resume_timing()
+		{
+			if (paused_) {
+				paused_ = false;
+				start_timing_();
+			}
+		}
+		void set_bytes_processed(size_t n)
+		{
+			bytes_ = n;
+		}
+		void set_items_processed(size_t n)
+		{
+			items_ = n;
+		}
+		void set_label(const std::string& label)
+		{
+			label_ = label;
+		}
+		// marks the case as not runnable, e.g. for want of a server
+		void skip(const std::string& reason)
+		{
+			skipped_ = reason;
+		}
+
+		// wall clock and processor (all threads) time of the timed code
+		double seconds() const
+		{
+			return ns_*1e-9;
+		}
+		double cpu_seconds() const
+		{
+			return cpu_ / CLOCKS_PER_SEC;
+		}
+		size_t bytes_processed() const
+		{
+			return bytes_;
+		}
+		size_t items_processed() const
+		{
+			return items_;
+		}
+		const std::string& label() const
+		{
+			return label_;
+		}
+		const std::string& skipped() const
+		{
+			return skipped_;
+		}
+
+	private:
+		std::vector<int> args_;
+		size_t max_iterations_;
+		size_t iterations_;
+		bool started_;
+		bool paused_;
+		size_t bytes_;
+		size_t items_;
+		std::string label_;
+		std::string skipped_;
+		clock::time_point start_;
+		std::clock_t cpu_start_;
+		double ns_;
+		double cpu_;
+
+		void start_timing_()
+		{
+			cpu_start_ = std::clock();
+			start_ = clock::now();
+		}
+		void stop_timing_()
+		{
+			if (paused_)
+				return;
+			ns_ += (double)std::chrono::duration_cast<std::chrono::nanoseconds>
+				(clock::now() - start_).count();
+			cpu_ += (double)(std::clock() - cpu_start_);
+		}
+	};
+
+	typedef void(*Function)(State&);
+
+	/*!
+	\ingroup Benchmarks
+	\brief A registered benchmark function and its argument sets.
+	*/
+	class Benchmark {
+	public:
+		Benchmark(const char* name, Function f) : name_(name), f_(f) {}
+		// registered benchmarks live as long as the program
+		static Benchmark* add(const char* name, Function f)
+		{
+			Benchmark* b = new Benchmark(name, f);
+			registry().push_back(b);
+			return b;
+		}
+		Benchmark* args(const std::vector<int>& a)
+		{
+			args_.push_back(a);
+			return this;
+		}
+		const std::string& name() const
+		{
+			return name_;
+		}
+		Function function() const
+		{
+			return f_;
+		}
+		const std::vector<std::vector<int> >& arg_sets() const
+		{
+			return args_;
+		}
+		static std::vector<Benchmark*>& registry()
+		{
+			static std::vector<Benchmark*> r;
+			return r;
+		}
+
+	private:
+		std::string name_;
+		Function f_;
+		std::vector<std::vector<int> > args_;
+	};
+
+	// runs the registered cases as directed by the command line arguments
+	int run(int argc, char** argv);
+
+}
+}
+
+#endif
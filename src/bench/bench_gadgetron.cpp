@@ -0,0 +1,412 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup Benchmarks
+\brief MR benchmarks: data container algebra, acquisition model, FFT,
+sorting, coil sensitivities, file I/O and Gadgetron round trip.
+
+The data are a single fully sampled Cartesian 2D slice of random k-space
+with twofold readout oversampling, the first two arguments of each case
+being the image size and the number of coils. The Gadgetron round trip
+needs a server, given as host:port by the environment variable
+SIRF_BENCH_GADGETRON, and is reported as an error otherwise.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <complex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <ismrmrd/ismrmrd.h>
+
+#include "bench.h"
+#include "gadgetron_data_containers.h"
+#include "gadgetron_x.h"
+#include "ismrmrd_fftw.h"
+
+using namespace gadgetron;
+using namespace sirf;
+using sirf::bench::State;
+
+namespace {
+
+	volatile float sink_ = 0;
+
+	// the ISMRMRD header of a 2D Cartesian slice of nx by nx pixels
+	AcquisitionsInfo
+	info_(int nx, int nc)
+	{
+		std::ostringstream xml;
+		xml << "<?xml version=\"1.0\"?>\n"
+			<< "<ismrmrdHeader xmlns=\"http://www.ismrm.org/ISMRMRD\">\n"
+			<< "<acquisitionSystemInformation><receiverChannels>" << nc
+			<< "</receiverChannels></acquisitionSystemInformation>\n"
+			<< "<experimentalConditions><H1resonanceFrequency_Hz>63500000"
+			<< "</H1resonanceFrequency_Hz></experimentalConditions>\n"
+			<< "<encoding>\n"
+			<< "<encodedSpace><matrixSize><x>" << 2 * nx << "</x><y>" << nx
+			<< "</y><z>1</z></matrixSize><fieldOfView_mm><x>512</x><y>256</y>"
+			<< "<z>5</z></fieldOfView_mm></encodedSpace>\n"
+			<< "<reconSpace><matrixSize><x>" << nx << "</x><y>" << nx
+			<< "</y><z>1</z></matrixSize><fieldOfView_mm><x>256</x><y>256</y>"
+			<< "<z>5</z></fieldOfView_mm></reconSpace>\n"
+			<< "<encodingLimits><kspace_encoding_step_1><minimum>0</minimum>"
+			<< "<maximum>" << nx - 1 << "</maximum><center>" << nx / 2
+			<< "</center></kspace_encoding_step_1></encodingLimits>\n"
+			<< "<trajectory>cartesian</trajectory>\n"
+			<< "</encoding>\n"
+			<< "</ismrmrdHeader>\n";
+		return AcquisitionsInfo(xml.str());
+	}
+
+	void
+	random_(complex_float_t* z, size_t n, unsigned int seed)
+	{
+		std::mt19937 gen(seed);
+		std::normal_distribution<float> dist;
+		for (size_t i = 0; i < n; i++)
+			z[i] = complex_float_t(dist(gen), dist(gen));
+	}
+
+	// the readouts of a slice in the order of the phase encoding steps
+	std::vector<ISMRMRD::Acquisition>
+	readouts_(int nx, int nc)
+	{
+		std::vector<ISMRMRD::Acquisition> acqs(nx);
+		for (int y = 0; y < nx; y++) {
+			ISMRMRD::Acquisition& acq = acqs[y];
+			acq.resize(2 * nx, nc, 0);
+			acq.center_sample() = nx;
+			acq.idx().kspace_encode_step_1 = y;
+			acq.scan_counter() = y;
+			if (y == 0)
+				acq.setFlag(ISMRMRD::ISMRMRD_ACQ_FIRST_IN_SLICE);
+			if (y == nx - 1)
+				acq.setFlag(ISMRMRD::ISMRMRD_ACQ_LAST_IN_SLICE);
+			random_(acq.getDataPtr(), acq.getNumberOfDataElements(), y);
+		}
+		return acqs;
+	}
+
+	// storage: 0 for AcquisitionsVector, 1 for AcquisitionsBlock
+	shared_ptr<MRAcquisitionData>
+	acquisitions_(int nx, int nc, int storage = 0)
+	{
+		AcquisitionsInfo info = info_(nx, nc);
+		shared_ptr<MRAcquisitionData> sptr_ac;
+		if (storage == 1)
+			sptr_ac.reset(new AcquisitionsBlock(info));
+		else
+			sptr_ac.reset(new AcquisitionsVector(info));
+		std::vector<ISMRMRD::Acquisition> acqs = readouts_(nx, nc);
+		sptr_ac->append_acquisitions(acqs);
+		return sptr_ac;
+	}
+
+	size_t
+	acquisitions_bytes_(int nx, int nc)
+	{
+		return (size_t)nx * 2 * nx * nc * sizeof(complex_float_t);
+	}
+
+	shared_ptr<MRImageData>
+	images_(int nx, unsigned int seed)
+	{
+		ISMRMRD::Image<complex_float_t>* ptr_im =
+			new ISMRMRD::Image<complex_float_t>(nx, nx, 1, 1);
+		random_(ptr_im->getDataPtr(), ptr_im->getNumberOfDataElements(), seed);
+		shared_ptr<MRImageData> sptr_ic(new ImagesVector);
+		sptr_ic->append(ISMRMRD::ISMRMRD_CXFLOAT, ptr_im);
+		return sptr_ic;
+	}
+
+	std::string
+	label_(int nx, int nc)
+	{
+		std::ostringstream s;
+		s << nx << 'x' << nx << ", " << nc << " coils";
+		return s.str();
+	}
+
+	enum Operation { AXPBY, DOT, NORM };
+
+	// the numbers of arrays read and written by each operation
+	const int arrays_[] = { 3, 2, 1 };
+
+}
+
+static void
+MRAcquisitionData_algebra_(State& state, Operation op)
+{
+	int nx = state.range(0);
+	int nc = state.range(1);
+	shared_ptr<MRAcquisitionData> sptr_x = acquisitions_(nx, nc, state.range(2));
+	shared_ptr<MRAcquisitionData> sptr_y = acquisitions_(nx, nc, state.range(2));
+	float s = 0;
+	while (state.keep_running()) {
+		switch (op) {
+		case AXPBY: {
+			// axpby appends to the target, so it is created anew
+			shared_ptr<MRAcquisitionData> sptr_z(sptr_x->
+				same_acquisitions_container(sptr_x->acquisitions_info()));
+			sptr_z->axpby(2.0f, *sptr_x, 3.0f, *sptr_y);
+			break;
+		}
+		case DOT:
+			s += std::abs(sptr_x->dot(*sptr_y));
+			break;
+		case NORM:
+			s += sptr_x->norm();
+			break;
+		}
+	}
+	sink_ = s;
+	state.set_bytes_processed
+		(state.iterations()*arrays_[op] * acquisitions_bytes_(nx, nc));
+	state.set_label(label_(nx, nc));
+}
+static void
+MRAcquisitionData_axpby(State& state)
+{
+	MRAcquisitionData_algebra_(state, AXPBY);
+}
+static void
+MRAcquisitionData_dot(State& state)
+{
+	MRAcquisitionData_algebra_(state, DOT);
+}
+static void
+MRAcquisitionData_norm(State& state)
+{
+	MRAcquisitionData_algebra_(state, NORM);
+}
+// the third argument selects the storage: 0 vector, 1 block
+SIRF_BENCHMARK(MRAcquisitionData_axpby)
+	->args({ 256, 8, 0 })->args({ 256, 8, 1 })->args({ 256, 32, 1 });
+SIRF_BENCHMARK(MRAcquisitionData_dot)
+	->args({ 256, 8, 0 })->args({ 256, 8, 1 })->args({ 256, 32, 1 });
+SIRF_BENCHMARK(MRAcquisitionData_norm)
+	->args({ 256, 8, 0 })->args({ 256, 8, 1 })->args({ 256, 32, 1 });
+
+static void
+MRImageData_algebra_(State& state, Operation op)
+{
+	int nx = state.range(0);
+	shared_ptr<MRImageData> sptr_x = images_(nx, 1);
+	shared_ptr<MRImageData> sptr_y = images_(nx, 2);
+	float s = 0;
+	while (state.keep_running()) {
+		switch (op) {
+		case AXPBY: {
+			shared_ptr<MRImageData> sptr_z = sptr_x->new_images_container();
+			sptr_z->axpby(2.0f, *sptr_x, 3.0f, *sptr_y);
+			break;
+		}
+		case DOT:
+			s += std::abs(sptr_x->dot(*sptr_y));
+			break;
+		case NORM:
+			s += sptr_x->norm();
+			break;
+		}
+	}
+	sink_ = s;
+	state.set_bytes_processed(state.iterations()*arrays_[op] *
+		(size_t)nx*nx*sizeof(complex_float_t));
+}
+static void
+MRImageData_axpby(State& state)
+{
+	MRImageData_algebra_(state, AXPBY);
+}
+static void
+MRImageData_dot(State& state)
+{
+	MRImageData_algebra_(state, DOT);
+}
+static void
+MRImageData_norm(State& state)
+{
+	MRImageData_algebra_(state, NORM);
+}
+SIRF_BENCHMARK(MRImageData_axpby)->args({ 256 })->args({ 512 });
+SIRF_BENCHMARK(MRImageData_dot)->args({ 256 })->args({ 512 });
+SIRF_BENCHMARK(MRImageData_norm)->args({ 256 })->args({ 512 });
+
+static void
+fft2c_ifft2c(State& state)
+{
+	int nx = state.range(0);
+	int nc = state.range(1);
+	std::vector<complex_float_t> z((size_t)2 * nx*nx*nc);
+	random_(&z[0], z.size(), 0);
+	while (state.keep_running()) {
+		ISMRMRD::fft2c(&z[0], 2 * nx, nx, nc, 1);
+		ISMRMRD::ifft2c(&z[0], 2 * nx, nx, nc, 1);
+	}
+	state.set_items_processed(state.iterations() * 2 * nc);
+	state.set_label(label_(nx, nc));
+}
+SIRF_BENCHMARK(fft2c_ifft2c)->args({ 128, 8 })->args({ 256, 8 })->args({ 256, 32 });
+
+static void
+MRAcquisitionData_order(State& state)
+{
+	int nx = state.range(0);
+	int nc = state.range(1);
+	int ns = state.range(2);
+	AcquisitionsVector ac(info_(nx, nc));
+	std::vector<ISMRMRD::Acquisition> slice = readouts_(nx, nc);
+	std::vector<ISMRMRD::Acquisition> acqs;
+	for (int s = 0; s < ns; s++)
+		for (int y = 0; y < nx; y++) {
+			acqs.push_back(slice[y]);
+			acqs.back().idx().slice = s;
+		}
+	std::shuffle(acqs.begin(), acqs.end(), std::mt19937(0));
+	ac.append_acquisitions(acqs);
+	while (state.keep_running())
+		ac.order();
+	state.set_items_processed(state.iterations()*acqs.size());
+}
+// the third argument is the number of slices
+SIRF_BENCHMARK(MRAcquisitionData_order)->args({ 256, 2, 16 })->args({ 256, 2, 128 });
+
+static void
+CoilSensitivitiesAsImages_compute(State& state)
+{
+	int nx = state.range(0);
+	int nc = state.range(1);
+	shared_ptr<MRAcquisitionData> sptr_ac = acquisitions_(nx, nc);
+	while (state.keep_running()) {
+		CoilSensitivitiesAsImages csms;
+		csms.compute(*sptr_ac);
+	}
+	state.set_bytes_processed(state.iterations()*acquisitions_bytes_(nx, nc));
+	state.set_label(label_(nx, nc));
+}
+SIRF_BENCHMARK(CoilSensitivitiesAsImages_compute)
+	->args({ 128, 8 })->args({ 256, 8 })->args({ 256, 32 });
+
+static void
+MRAcquisitionModel_fwd_bwd_(State& state, bool forward)
+{
+	int nx = state.range(0);
+	int nc = state.range(1);
+	shared_ptr<MRAcquisitionData> sptr_ac = acquisitions_(nx, nc);
+	shared_ptr<MRImageData> sptr_ic = images_(nx, 1);
+	CoilSensitivitiesAsImages csms;
+	csms.compute(*sptr_ac);
+	MRAcquisitionModel am;
+	am.set_up(sptr_ac, sptr_ic);
+	am.set_resident(state.range(2) != 0);
+	while (state.keep_running()) {
+		if (forward) {
+			AcquisitionsVector ac(sptr_ac->acquisitions_info());
+			am.fwd(*sptr_ic, csms, ac);
+		}
+		else {
+			ImagesVector ic;
+			am.bwd(ic, csms, *sptr_ac);
+		}
+	}
+	state.set_bytes_processed(state.iterations()*acquisitions_bytes_(nx, nc));
+	state.set_label(label_(nx, nc));
+}
+static void
+MRAcquisitionModel_fwd(State& state)
+{
+	MRAcquisitionModel_fwd_bwd_(state, true);
+}
+static void
+MRAcquisitionModel_bwd(State& state)
+{
+	MRAcquisitionModel_fwd_bwd_(state, false);
+}
+// the third argument switches the resident mode on
+SIRF_BENCHMARK(MRAcquisitionModel_fwd)
+	->args({ 256, 8, 0 })->args({ 256, 8, 1 })->args({ 256, 32, 1 });
+SIRF_BENCHMARK(MRAcquisitionModel_bwd)
+	->args({ 256, 8, 0 })->args({ 256, 8, 1 })->args({ 256, 32, 1 });
+
+static void
+AcquisitionsFile_append(State& state)
+{
+	int nx = state.range(0);
+	int nc = state.range(1);
+	AcquisitionsInfo info = info_(nx, nc);
+	std::vector<ISMRMRD::Acquisition> acqs = readouts_(nx, nc);
+	while (state.keep_running()) {
+		AcquisitionsFile af(info);
+		af.append_acquisitions(acqs);
+		af.flush();
+	}
+	state.set_bytes_processed(state.iterations()*acquisitions_bytes_(nx, nc));
+	state.set_label(label_(nx, nc));
+}
+static void
+AcquisitionsFile_read(State& state)
+{
+	int nx = state.range(0);
+	int nc = state.range(1);
+	AcquisitionsFile af(info_(nx, nc));
+	std::vector<ISMRMRD::Acquisition> acqs = readouts_(nx, nc);
+	af.append_acquisitions(acqs);
+	af.flush();
+	while (state.keep_running())
+		af.get_acquisitions(0, af.number(), acqs);
+	state.set_bytes_processed(state.iterations()*acquisitions_bytes_(nx, nc));
+	state.set_label(label_(nx, nc));
+}
+SIRF_BENCHMARK(AcquisitionsFile_append)->args({ 256, 8 })->args({ 256, 32 });
+SIRF_BENCHMARK(AcquisitionsFile_read)->args({ 256, 8 })->args({ 256, 32 });
+
+static void
+Gadgetron_round_trip(State& state)
+{
+	const char* server = getenv("SIRF_BENCH_GADGETRON");
+	std::string s = server ? server : "";
+	size_t colon = s.find(':');
+	if (colon == std::string::npos) {
+		state.skip("SIRF_BENCH_GADGETRON (host:port) not set");
+		return;
+	}
+	int nx = state.range(0);
+	int nc = state.range(1);
+	shared_ptr<MRAcquisitionData> sptr_ac = acquisitions_(nx, nc);
+	AcquisitionsProcessor proc;
+	proc.set_local_processing(false);
+	proc.add_server(s.substr(0, colon), s.substr(colon + 1));
+	while (state.keep_running())
+		proc.process(*sptr_ac);
+	// the acquisitions go to the server and come back
+	state.set_bytes_processed(state.iterations() * 2 * acquisitions_bytes_(nx, nc));
+	state.set_label(label_(nx, nc));
+}
+SIRF_BENCHMARK(Gadgetron_round_trip)->args({ 256, 8 })->args({ 256, 32 });
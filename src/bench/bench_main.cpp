@@ -0,0 +1,378 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup Benchmarks
+\brief Runner of the SIRF benchmark suite.
+
+Usage:
+
+	sirf_bench [--benchmark_filter=REGEX] [--benchmark_min_time=SECONDS]
+		[--benchmark_repetitions=N] [--benchmark_format=console|json]
+		[--benchmark_out=FILE] [--benchmark_list_tests]
+
+Every case is run with the number of iterations doubled until it takes
+at least the minimal time (0.5 seconds by default), and this is repeated
+the given number of times. The results are printed as a table or in JSON,
+and are written in JSON to FILE if given.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+
+#ifndef SIRF_VERSION
+#define SIRF_VERSION "unknown"
+#endif
+
+// a case is never run with more iterations than this
+#define BENCH_MAX_ITERATIONS 1000000000
+
+using namespace sirf::bench;
+
+namespace {
+
+	struct Run {
+		std::string name;
+		std::string aggregate;
+		int repetition;
+		size_t iterations;
+		double real_ns;
+		double cpu_ns;
+		double bytes_per_second;
+		double items_per_second;
+		std::string label;
+		std::string error;
+	};
+
+	std::string
+	escape_(const std::string& s)
+	{
+		std::string e;
+		for (size_t i = 0; i < s.size(); i++) {
+			char c = s[i];
+			if (c == '"' || c == '\\')
+				e += '\\';
+			if (c == '\n')
+				e += "\\n";
+			else
+				e += c;
+		}
+		return e;
+	}
+
+	std::string
+	case_name_(const Benchmark& b, const std::vector<int>& args)
+	{
+		std::ostringstream name;
+		name << b.name();
+		for (size_t i = 0; i < args.size(); i++)
+			name << '/' << args[i];
+		return name.str();
+	}
+
+	// runs one repetition of a case, doubling the iterations up to min_time
+	Run
+	run_case_(const Benchmark& b, const std::vector<int>& args,
+		double min_time, int repetition)
+	{
+		Run r;
+		r.name = case_name_(b, args);
+		r.repetition = repetition;
+		r.iterations = 0;
+		r.real_ns = r.cpu_ns = 0;
+		r.bytes_per_second = r.items_per_second = 0;
+		size_t n = 1;
+		for (;;) {
+			State state(args, n);
+			try {
+				b.function()(state);
+			}
+			catch (const std::exception& e) {
+				r.error = e.what();
+				return r;
+			}
+			catch (...) {
+				r.error = "unknown exception";
+				return r;
+			}
+			if (!state.skipped().empty()) {
+				r.error = state.skipped();
+				return r;
+			}
+			double t = state.seconds();
+			if (t >= min_time || n >= BENCH_MAX_ITERATIONS ||
+				state.iterations() < n) {
+				size_t it = std::max((size_t)1, state.iterations());
+				r.iterations = state.iterations();
+				r.real_ns = t*1e9 / it;
+				r.cpu_ns = state.cpu_seconds()*1e9 / it;
+				if (t > 0) {
+					r.bytes_per_second = state.bytes_processed() / t;
+					r.items_per_second = state.items_processed() / t;
+				}
+				r.label = state.label();
+				return r;
+			}
+			// aim a little beyond min_time from the time measured so far
+			double m = t > 0 ? 1.4*min_time / t : 10.0;
+			n = (size_t)std::min((double)BENCH_MAX_ITERATIONS,
+				std::max(n*2.0, std::min(n*m, n*10.0)));
+		}
+	}
+
+	Run
+	aggregate_(const std::vector<Run>& runs, const std::string& what)
+	{
+		Run a = runs[0];
+		a.aggregate = what;
+		a.repetition = 0;
+		size_t n = runs.size();
+		std::vector<double> v[4];
+		for (size_t i = 0; i < n; i++) {
+			v[0].push_back(runs[i].real_ns);
+			v[1].push_back(runs[i].cpu_ns);
+			v[2].push_back(runs[i].bytes_per_second);
+			v[3].push_back(runs[i].items_per_second);
+		}
+		double r[4];
+		for (int k = 0; k < 4; k++) {
+			std::vector<double>& x = v[k];
+			double mean = 0;
+			for (size_t i = 0; i < n; i++)
+				mean += x[i];
+			mean /= n;
+			if (what == "mean")
+				r[k] = mean;
+			else if (what == "median") {
+				std::sort(x.begin(), x.end());
+				r[k] = n % 2 ? x[n / 2] : 0.5*(x[n / 2 - 1] + x[n / 2]);
+			}
+			else {
+				double s = 0;
+				for (size_t i = 0; i < n; i++)
+					s += (x[i] - mean)*(x[i] - mean);
+				r[k] = n > 1 ? std::sqrt(s / (n - 1)) : 0;
+			}
+		}
+		a.real_ns = r[0];
+		a.cpu_ns = r[1];
+		a.bytes_per_second = r[2];
+		a.items_per_second = r[3];
+		return a;
+	}
+
+	void
+	print_json_(std::ostream& out, const std::vector<Run>& runs, int repetitions)
+	{
+		char date[64];
+		std::time_t now = std::time(0);
+		std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+		const char* host = getenv("HOSTNAME");
+		if (!host)
+			host = getenv("COMPUTERNAME");
+		out << "{\n  \"context\": {\n";
+		out << "    \"date\": \"" << date << "\",\n";
+		out << "    \"host_name\": \"" << escape_(host ? host : "") << "\",\n";
+		out << "    \"executable\": \"sirf_bench\",\n";
+		out << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n";
+		out << "    \"sirf_version\": \"" << SIRF_VERSION << "\",\n";
+#ifdef NDEBUG
+		out << "    \"library_build_type\": \"release\"\n";
+#else
+		out << "    \"library_build_type\": \"debug\"\n";
+#endif
+		out << "  },\n  \"benchmarks\": [";
+		for (size_t i = 0; i < runs.size(); i++) {
+			const Run& r = runs[i];
+			out << (i ? ",\n" : "\n") << "    {\n";
+			out << "      \"name\": \"" << r.name
+				<< (r.aggregate.empty() ? "" : "_") << r.aggregate << "\",\n";
+			out << "      \"run_name\": \"" << r.name << "\",\n";
+			if (r.aggregate.empty()) {
+				out << "      \"run_type\": \"iteration\",\n";
+				out << "      \"repetitions\": " << repetitions << ",\n";
+				out << "      \"repetition_index\": " << r.repetition << ",\n";
+			}
+			else {
+				out << "      \"run_type\": \"aggregate\",\n";
+				out << "      \"repetitions\": " << repetitions << ",\n";
+				out << "      \"aggregate_name\": \"" << r.aggregate << "\",\n";
+			}
+			out << "      \"threads\": 1,\n";
+			if (!r.error.empty()) {
+				out << "      \"error_occurred\": true,\n";
+				out << "      \"error_message\": \"" << escape_(r.error) << "\"\n";
+				out << "    }";
+				continue;
+			}
+			out << "      \"iterations\": " << r.iterations << ",\n";
+			out << "      \"real_time\": " << r.real_ns << ",\n";
+			out << "      \"cpu_time\": " << r.cpu_ns << ",\n";
+			out << "      \"time_unit\": \"ns\"";
+			if (r.bytes_per_second > 0)
+				out << ",\n      \"bytes_per_second\": " << r.bytes_per_second;
+			if (r.items_per_second > 0)
+				out << ",\n      \"items_per_second\": " << r.items_per_second;
+			if (!r.label.empty())
+				out << ",\n      \"label\": \"" << escape_(r.label) << "\"";
+			out << "\n    }";
+		}
+		out << "\n  ]\n}\n";
+	}
+
+	void
+	print_run_(const Run& r)
+	{
+		std::string name = r.name;
+		if (!r.aggregate.empty())
+			name += "_" + r.aggregate;
+		if (!r.error.empty()) {
+			std::printf("%-48s ERROR: %s\n", name.c_str(), r.error.c_str());
+			return;
+		}
+		std::printf("%-48s %14.0f ns %14.0f ns %10lu", name.c_str(),
+			r.real_ns, r.cpu_ns, (unsigned long)r.iterations);
+		if (r.bytes_per_second > 0)
+			std::printf(" %10.1f MB/s", r.bytes_per_second*1e-6);
+		if (!r.label.empty())
+			std::printf(" %s", r.label.c_str());
+		std::printf("\n");
+		std::fflush(stdout);
+	}
+
+	bool
+	option_(const char* arg, const char* name, std::string& value)
+	{
+		size_t n = strlen(name);
+		if (strncmp(arg, name, n) != 0 || arg[n] != '=')
+			return false;
+		value = arg + n + 1;
+		return true;
+	}
+
+}
+
+int
+sirf::bench::run(int argc, char** argv)
+{
+	std::string filter = ".";
+	std::string format = "console";
+	std::string out_file;
+	double min_time = 0.5;
+	int repetitions = 1;
+	bool list = false;
+	for (int i = 1; i < argc; i++) {
+		std::string value;
+		if (option_(argv[i], "--benchmark_filter", value))
+			filter = value;
+		else if (option_(argv[i], "--benchmark_min_time", value))
+			min_time = atof(value.c_str());
+		else if (option_(argv[i], "--benchmark_repetitions", value))
+			repetitions = std::max(1, atoi(value.c_str()));
+		else if (option_(argv[i], "--benchmark_format", value))
+			format = value;
+		else if (option_(argv[i], "--benchmark_out", value))
+			out_file = value;
+		else if (strcmp(argv[i], "--benchmark_list_tests") == 0)
+			list = true;
+		else {
+			std::cerr << "unknown option " << argv[i] << '\n';
+			return 1;
+		}
+	}
+	std::regex re(filter);
+	bool console = format != "json";
+	if (console && !list)
+		std::printf("%-48s %17s %17s %10s\n",
+			"Benchmark", "Time", "CPU", "Iterations");
+
+	std::vector<Run> runs;
+	const std::vector<Benchmark*>& registry = Benchmark::registry();
+	for (size_t i = 0; i < registry.size(); i++) {
+		const Benchmark& b = *registry[i];
+		std::vector<std::vector<int> > arg_sets = b.arg_sets();
+		if (arg_sets.empty())
+			arg_sets.push_back(std::vector<int>());
+		for (size_t j = 0; j < arg_sets.size(); j++) {
+			std::string name = case_name_(b, arg_sets[j]);
+			if (!std::regex_search(name, re))
+				continue;
+			if (list) {
+				std::cout << name << '\n';
+				continue;
+			}
+			std::vector<Run> reps;
+			for (int k = 0; k < repetitions; k++) {
+				reps.push_back(run_case_(b, arg_sets[j], min_time, k));
+				if (console)
+					print_run_(reps.back());
+				if (!reps.back().error.empty())
+					break;
+			}
+			runs.insert(runs.end(), reps.begin(), reps.end());
+			if (reps.size() > 1) {
+				const char* what[] = { "mean", "median", "stddev" };
+				for (int k = 0; k < 3; k++) {
+					runs.push_back(aggregate_(reps, what[k]));
+					if (console)
+						print_run_(runs.back());
+				}
+			}
+		}
+	}
+	if (list)
+		return 0;
+	if (!console)
+		print_json_(std::cout, runs, repetitions);
+	if (!out_file.empty()) {
+		std::ofstream out(out_file.c_str());
+		if (!out) {
+			std::cerr << "cannot write " << out_file << '\n';
+			return 1;
+		}
+		print_json_(out, runs, repetitions);
+	}
+	return 0;
+}
+
+int
+main(int argc, char** argv)
+{
+	return run(argc, argv);
+}
@@ -0,0 +1,235 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup Benchmarks
+\brief PET benchmarks: data container algebra and projections.
+
+The acquisition data are Siemens mMR sinograms in memory, the arguments of
+each case being the span and the view mashing factor; the images are of
+the size STIR derives from the sinograms.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "stir/common.h"
+#include "stir/ExamInfo.h"
+
+#include "bench.h"
+#include "stir_x.h"
+
+using namespace stir;
+using namespace sirf;
+using sirf::bench::State;
+
+namespace {
+
+	shared_ptr<PETAcquisitionData>
+	acquisitions_(State& state, float value)
+	{
+		shared_ptr<ExamInfo> sptr_ei(new ExamInfo);
+		shared_ptr<PETAcquisitionData> sptr_ad(new PETAcquisitionDataInMemory
+			(sptr_ei, "Siemens_mMR", state.range(0), -1, state.range(1)));
+		sptr_ad->fill(value);
+		return sptr_ad;
+	}
+
+	size_t
+	acquisitions_size_(PETAcquisitionData& ad)
+	{
+		return (size_t)ad.get_num_sinograms()*ad.get_num_views()*
+			ad.get_num_tangential_poss();
+	}
+
+	shared_ptr<PETImageData>
+	image_(PETAcquisitionData& ad, float value)
+	{
+		shared_ptr<PETImageData> sptr_id(new PETImageData(ad));
+		sptr_id->fill(value);
+		return sptr_id;
+	}
+
+	size_t
+	image_size_(PETImageData& id)
+	{
+		int dim[3];
+		id.get_dimensions(dim);
+		return (size_t)dim[0] * dim[1] * dim[2];
+	}
+
+	std::string
+	label_(size_t n)
+	{
+		std::ostringstream s;
+		s << n << " floats";
+		return s.str();
+	}
+
+	// keeps the results of dot and norm from being optimised away
+	volatile float sink_ = 0;
+
+	// shared by the algebra benchmarks: x, y and z of the same kind
+	enum Operation { AXPBY, DOT, NORM, MULTIPLY };
+
+	void
+	algebra_(State& state, aDataContainer<float>& x, aDataContainer<float>& y,
+		aDataContainer<float>& z, size_t n, Operation op)
+	{
+		// the numbers of arrays read and written by each operation
+		static const int arrays[] = { 3, 2, 1, 3 };
+		float s = 0;
+		while (state.keep_running()) {
+			switch (op) {
+			case AXPBY:
+				z.axpby(2.0f, x, 3.0f, y);
+				break;
+			case DOT:
+				s += x.dot(y);
+				break;
+			case NORM:
+				s += x.norm();
+				break;
+			case MULTIPLY:
+				z.multiply(x, y);
+				break;
+			}
+		}
+		state.set_bytes_processed
+			(state.iterations()*arrays[op] * n*sizeof(float));
+		state.set_label(label_(n));
+		sink_ = s;
+	}
+
+	void
+	acquisitions_algebra_(State& state, Operation op)
+	{
+		shared_ptr<PETAcquisitionData> sptr_x = acquisitions_(state, 1.0f);
+		shared_ptr<PETAcquisitionData> sptr_y = acquisitions_(state, 2.0f);
+		shared_ptr<PETAcquisitionData> sptr_z = sptr_x->new_acquisition_data();
+		algebra_(state, *sptr_x, *sptr_y, *sptr_z,
+			acquisitions_size_(*sptr_x), op);
+	}
+
+	void
+	image_algebra_(State& state, Operation op)
+	{
+		shared_ptr<PETAcquisitionData> sptr_ad = acquisitions_(state, 0.0f);
+		shared_ptr<PETImageData> sptr_x = image_(*sptr_ad, 1.0f);
+		shared_ptr<PETImageData> sptr_y = image_(*sptr_ad, 2.0f);
+		shared_ptr<PETImageData> sptr_z = sptr_x->new_image_data();
+		algebra_(state, *sptr_x, *sptr_y, *sptr_z, image_size_(*sptr_x), op);
+	}
+
+	shared_ptr<PETAcquisitionModel>
+	model_(shared_ptr<PETAcquisitionData> sptr_ad,
+		shared_ptr<PETImageData> sptr_id)
+	{
+		shared_ptr<RayTracingMatrix> sptr_matrix(new RayTracingMatrix);
+		sptr_matrix->set_num_tangential_LORs(2);
+		shared_ptr<AcqModUsingMatrix3DF> sptr_am(new AcqModUsingMatrix3DF);
+		sptr_am->set_matrix(sptr_matrix);
+		if (sptr_am->set_up(sptr_ad, sptr_id) != Succeeded::yes)
+			throw std::runtime_error("acquisition model set up failed");
+		return sptr_am;
+	}
+
+}
+
+static void
+PETAcquisitionData_axpby(State& state)
+{
+	acquisitions_algebra_(state, AXPBY);
+}
+static void
+PETAcquisitionData_dot(State& state)
+{
+	acquisitions_algebra_(state, DOT);
+}
+static void
+PETAcquisitionData_norm(State& state)
+{
+	acquisitions_algebra_(state, NORM);
+}
+static void
+PETAcquisitionData_multiply(State& state)
+{
+	acquisitions_algebra_(state, MULTIPLY);
+}
+SIRF_BENCHMARK(PETAcquisitionData_axpby)->args({ 11, 4 })->args({ 11, 1 });
+SIRF_BENCHMARK(PETAcquisitionData_dot)->args({ 11, 4 })->args({ 11, 1 });
+SIRF_BENCHMARK(PETAcquisitionData_norm)->args({ 11, 4 })->args({ 11, 1 });
+SIRF_BENCHMARK(PETAcquisitionData_multiply)->args({ 11, 4 })->args({ 11, 1 });
+
+static void
+PETImageData_axpby(State& state)
+{
+	image_algebra_(state, AXPBY);
+}
+static void
+PETImageData_dot(State& state)
+{
+	image_algebra_(state, DOT);
+}
+static void
+PETImageData_norm(State& state)
+{
+	image_algebra_(state, NORM);
+}
+static void
+PETImageData_multiply(State& state)
+{
+	image_algebra_(state, MULTIPLY);
+}
+SIRF_BENCHMARK(PETImageData_axpby)->args({ 11, 4 });
+SIRF_BENCHMARK(PETImageData_dot)->args({ 11, 4 });
+SIRF_BENCHMARK(PETImageData_norm)->args({ 11, 4 });
+SIRF_BENCHMARK(PETImageData_multiply)->args({ 11, 4 });
+
+static void
+PETAcquisitionModel_forward(State& state)
+{
+	shared_ptr<PETAcquisitionData> sptr_ad = acquisitions_(state, 0.0f);
+	shared_ptr<PETImageData> sptr_id = image_(*sptr_ad, 1.0f);
+	shared_ptr<PETAcquisitionModel> sptr_am = model_(sptr_ad, sptr_id);
+	while (state.keep_running())
+		sptr_am->forward(*sptr_ad, *sptr_id, 0, 1, true);
+	state.set_items_processed(state.iterations()*acquisitions_size_(*sptr_ad));
+	state.set_label(label_(acquisitions_size_(*sptr_ad)));
+}
+static void
+PETAcquisitionModel_backward(State& state)
+{
+	shared_ptr<PETAcquisitionData> sptr_ad = acquisitions_(state, 1.0f);
+	shared_ptr<PETImageData> sptr_id = image_(*sptr_ad, 0.0f);
+	shared_ptr<PETAcquisitionModel> sptr_am = model_(sptr_ad, sptr_id);
+	while (state.keep_running())
+		sptr_am->backward(*sptr_id, *sptr_ad, 0, 1);
+	state.set_items_processed(state.iterations()*acquisitions_size_(*sptr_ad));
+	state.set_label(label_(acquisitions_size_(*sptr_ad)));
+}
+// the projections of full mMR sinograms take minutes with ray tracing
+SIRF_BENCHMARK(PETAcquisitionModel_forward)->args({ 11, 8 })->args({ 11, 4 });
+SIRF_BENCHMARK(PETAcquisitionModel_backward)->args({ 11, 8 })->args({ 11, 4 });
@@ -1,6 +1,7 @@
 '''Utilities used by all engines
 '''
 import inspect
+import json
 import matplotlib as mpl
 import matplotlib.pyplot as plt
 import numpy
@@ -296,6 +297,46 @@ def runner(main_test, doc, version, author="", licence=None):
         print('all %d tests passed' % ntest)
 
 
+class Profiler(object):
+    '''
+    Timings, call counts and byte counts of the instrumented engine
+    operations (data container algebra, projections, FFTs, file and
+    Gadgetron traffic).
+    Counting is on by default; tracing additionally records every timed
+    call for viewing in chrome://tracing.
+    '''
+    def __init__(self, engine, prefix):
+        # engine is the SWIG module of an engine, prefix its C functions prefix
+        self.engine = engine
+        self.prefix = prefix
+    def _call(self, name, *args):
+        return getattr(self.engine, self.prefix + '_' + name)(*args)
+    def _text(self, format):
+        h = self._call('profiler', format)
+        check_status(h, inspect.stack()[1])
+        value = pyiutil.charDataFromHandle(h)
+        pyiutil.deleteDataHandle(h)
+        return value
+    def enable(self, on = True, trace = False):
+        try_calling(self._call('setProfiler', int(on), int(trace)))
+    def reset(self):
+        '''Zeroes the counters and discards the trace.'''
+        try_calling(self._call('resetProfiler'))
+    def report(self):
+        '''
+        Returns a dictionary of the used counters, each a dictionary with
+        keys 'calls', 'ms' and 'bytes'.
+        '''
+        return json.loads(self._text('json'))
+    def text(self):
+        '''Returns the counters as lines of name, calls, ms and bytes.'''
+        return self._text('text')
+    def write_trace(self, filename):
+        '''Writes the trace in the Chrome trace event format.'''
+        with open(filename, 'w') as f:
+            f.write(self._text('trace'))
+
+
 ###########################################################
 ############ Utilities for internal use only ##############
 class error(Exception):
@@ -327,6 +368,26 @@ def try_calling(returned_handle):
     pyiutil.deleteDataHandle(returned_handle)
 
 
+class _DataView(object):
+    '''
+    Presents a memory buffer owned by a SIRF object to NumPy via the array
+    interface. NumPy arrays created from it keep it, and hence the owner 
+    of the buffer, alive.
+    '''
+    def __init__(self, owner, address, shape, typestr):
+        self.owner = owner
+        self.__array_interface__ = {'version': 3, 'data': (address, False), \
+            'shape': tuple(int(n) for n in shape), 'typestr': typestr}
+
+
+def data_view(owner, address, shape, typestr):
+    '''
+    Returns NumPy ndarray sharing memory with the buffer at address owned
+    by owner; typestr is a NumPy array interface type string, e.g. '<f4'.
+    '''
+    return numpy.asarray(_DataView(owner, address, shape, typestr))
+
+
 def assert_validity(object, type):
     assert isinstance(object, type)
     assert object.handle is not None
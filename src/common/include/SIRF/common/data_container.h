@@ -45,6 +45,80 @@ public:
 	virtual void axpby(
 		T a, const aDataContainer<T>& x,
 		T b, const aDataContainer<T>& y) = 0;
+
+	// fused operations: the defaults below are written in terms of the
+	// methods above, derived classes override them to reduce the number
+	// of passes over the data
+
+	// *this := *this + a x (in place)
+	virtual void xapy(T a, const aDataContainer<T>& x)
+	{
+		axpby((T)1, *this, a, x);
+	}
+	// *this := b *this + a x (in place), x may be *this
+	virtual void scale_xapy(T b, T a, const aDataContainer<T>& x)
+	{
+		if (&x == this) {
+			xapy(a + b - (T)1, *this);
+			return;
+		}
+		xapy(b - (T)1, *this);
+		xapy(a, x);
+	}
+	// *this := a[0] x[0] + ... + a[n - 1] x[n - 1], any x[i] may be *this
+	virtual void linear_combination
+		(int n, const T* a, const aDataContainer<T>* const* x)
+	{
+		if (n < 1)
+			return;
+		T c = (T)0;
+		bool in_place = false;
+		for (int i = 0; i < n; i++)
+			if (x[i] == this) {
+				c += a[i];
+				in_place = true;
+			}
+		if (!in_place) {
+			if (n == 1) {
+				axpby(a[0], *x[0], (T)0, *x[0]);
+				return;
+			}
+			axpby(a[0], *x[0], a[1], *x[1]);
+			for (int i = 2; i < n; i++)
+				xapy(a[i], *x[i]);
+			return;
+		}
+		// the terms in *this are combined into c *this by the first pass,
+		// so that *this is never overwritten before it is read
+		int i = 0;
+		while (i < n && x[i] == this)
+			i++;
+		if (i == n) {
+			axpby(c, *this, (T)0, *this);
+			return;
+		}
+		axpby(c, *this, a[i], *x[i]);
+		for (i++; i < n; i++)
+			if (x[i] != this)
+				xapy(a[i], *x[i]);
+	}
+	// *this := a x + b y, returns the norm of the result
+	virtual float axpby_norm(
+		T a, const aDataContainer<T>& x,
+		T b, const aDataContainer<T>& y)
+	{
+		axpby(a, x, b, y);
+		return norm();
+	}
+	// *this := a x + b y, returns the dot product of the result with z
+	virtual T axpby_dot(
+		T a, const aDataContainer<T>& x,
+		T b, const aDataContainer<T>& y,
+		const aDataContainer<T>& z)
+	{
+		axpby(a, x, b, y);
+		return dot(z);
+	}
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,150 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup Common
+\brief Deferred linear combinations of data containers.
+
+The Python operators +, - and multiplication and division by scalars
+build DataContainerExpression objects instead of computing new containers,
+so that an expression like x + a*y - b*z is evaluated by one
+linear_combination pass into one new container when it is needed, and
+its dot products are computed without creating it at all. The Matlab
+operators still compute a new container each.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#ifndef SIRF_DATA_EXPRESSION
+#define SIRF_DATA_EXPRESSION
+
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "SIRF/common/data_container.h"
+
+/*!
+\ingroup Common
+\brief Linear combination a[0] x[0] + ... + a[n - 1] x[n - 1] of data
+containers whose evaluation is deferred.
+
+The expression keeps its containers alive, but not their values: it is
+to be evaluated before any of them is modified. Repeated containers are
+combined into one term.
+*/
+template <typename T>
+class DataContainerExpression {
+public:
+	// a x, where sptr_x is any shared pointer to the container x
+	template <class Ptr>
+	DataContainerExpression(T a, const Ptr& sptr_x)
+	{
+		Term t;
+		t.a = a;
+		t.x = sptr_x.get();
+		t.owner = std::shared_ptr<const void>(t.x, [sptr_x](const void*) {});
+		terms_.push_back(t);
+	}
+	// a e + b f
+	DataContainerExpression(T a, const DataContainerExpression& e,
+		T b, const DataContainerExpression& f)
+	{
+		append_(a, e);
+		append_(b, f);
+	}
+	int size() const
+	{
+		return (int)terms_.size();
+	}
+	// z := the value of the expression, in one pass; z may be one of
+	// the terms if its linear_combination allows it
+	void evaluate(aDataContainer<T>& z) const
+	{
+		std::vector<T> a;
+		std::vector<const aDataContainer<T>*> x;
+		arguments_(a, x);
+		z.linear_combination(size(), &a[0], &x[0]);
+	}
+	// a new container holding the value of the expression
+	aDataContainer<T>* evaluate() const
+	{
+		aDataContainer<T>* ptr_z = terms_[0].x->new_data_container();
+		evaluate(*ptr_z);
+		return ptr_z;
+	}
+	// the dot product with y, computed term by term without evaluation
+	T dot(const aDataContainer<T>& y) const
+	{
+		T s = (T)0;
+		for (size_t i = 0; i < terms_.size(); i++)
+			s += terms_[i].a * terms_[i].x->dot(y);
+		return s;
+	}
+	// the 2-norm, which for more than one term needs the value
+	float norm() const
+	{
+		if (size() == 1)
+			return (float)std::abs(terms_[0].a) * terms_[0].x->norm();
+		std::unique_ptr<aDataContainer<T> >
+			ptr_z(terms_[0].x->new_data_container());
+		if (size() == 2)
+			return ptr_z->axpby_norm
+			(terms_[0].a, *terms_[0].x, terms_[1].a, *terms_[1].x);
+		evaluate(*ptr_z);
+		return ptr_z->norm();
+	}
+
+private:
+	struct Term {
+		T a;
+		aDataContainer<T>* x;
+		std::shared_ptr<const void> owner;
+	};
+	std::vector<Term> terms_;
+
+	void append_(T a, const DataContainerExpression& e)
+	{
+		for (size_t i = 0; i < e.terms_.size(); i++) {
+			Term t = e.terms_[i];
+			t.a *= a;
+			size_t j = 0;
+			for (; j < terms_.size(); j++)
+				if (terms_[j].x == t.x)
+					break;
+			if (j < terms_.size())
+				terms_[j].a += t.a;
+			else
+				terms_.push_back(t);
+		}
+	}
+	void arguments_
+		(std::vector<T>& a, std::vector<const aDataContainer<T>*>& x) const
+	{
+		for (size_t i = 0; i < terms_.size(); i++) {
+			a.push_back(terms_[i].a);
+			x.push_back(terms_[i].x);
+		}
+	}
+};
+
+#endif
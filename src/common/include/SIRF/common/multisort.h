@@ -3,9 +3,12 @@
 
 #include <algorithm> // stable_sort
 #include <array> // array
+#include <cstdint> // uint64_t
 #include <numeric> // iota
 #include <vector> // vector
 
+#include "SIRF/common/thread_pool.h"
+
 namespace Multisort {
 
 	template<typename T, size_t N>
@@ -21,7 +24,7 @@ namespace Multisort {
 	}
 
 	template<typename T, size_t N>
-	void sort(std::vector<std::array<T, N> > v, int* index)
+	void sort(const std::vector<std::array<T, N> >& v, int* index)
 	{
 		int n = v.size();
 		std::iota(index, index + n, 0);
@@ -29,6 +32,74 @@ namespace Multisort {
 			(index, index + n, [&v](int i, int j){return less(v[i], v[j]); });
 	}
 
+	// runs f(0), ..., f(nthreads - 1) on the SIRF thread pool
+	template<class F>
+	void run_(int nthreads, F f)
+	{
+		sirf::parallel_for(nthreads, nthreads, f);
+	}
+
+	/*
+	Stable sort of packed composite keys: on return, keys[index[0]], ...,
+	keys[index[n - 1]] are in ascending order.
+	Least significant digit radix sort by 16-bit digits, skipping the digits
+	that are the same in all keys; the counting and scattering of each pass
+	are split between up to nthreads threads.
+	*/
+	inline void sort(const std::vector<uint64_t>& keys, int* index,
+		int nthreads = 1)
+	{
+		const size_t radix = 1 << 16;
+		const size_t min_chunk = 1 << 16;
+		int n = keys.size();
+		std::iota(index, index + n, 0);
+		if (n < 4096) {
+			std::stable_sort(index, index + n,
+				[&keys](int i, int j){ return keys[i] < keys[j]; });
+			return;
+		}
+		uint64_t any = 0;
+		uint64_t all = ~(uint64_t)0;
+		for (int i = 0; i < n; i++) {
+			any |= keys[i];
+			all &= keys[i];
+		}
+		uint64_t varying = any ^ all;
+		nthreads = std::max(1, std::min(nthreads, (int)(n / min_chunk) + 1));
+		std::vector<size_t> count(radix*nthreads);
+		std::vector<int> buff(n);
+		int* src = index;
+		int* dst = &buff[0];
+		for (int shift = 0; shift < 64; shift += 16) {
+			if (((varying >> shift) & (radix - 1)) == 0)
+				continue;
+			std::fill(count.begin(), count.end(), 0);
+			run_(nthreads, [&](int t) {
+				size_t* c = &count[t*radix];
+				int last = (int)(((size_t)n*(t + 1)) / nthreads);
+				for (int i = (int)(((size_t)n*t) / nthreads); i < last; i++)
+					c[(keys[src[i]] >> shift) & (radix - 1)]++;
+			});
+			// positions of each digit, threads in order so that it is stable
+			size_t s = 0;
+			for (size_t d = 0; d < radix; d++)
+				for (int t = 0; t < nthreads; t++) {
+					size_t c = count[t*radix + d];
+					count[t*radix + d] = s;
+					s += c;
+				}
+			run_(nthreads, [&](int t) {
+				size_t* c = &count[t*radix];
+				int last = (int)(((size_t)n*(t + 1)) / nthreads);
+				for (int i = (int)(((size_t)n*t) / nthreads); i < last; i++)
+					dst[c[(keys[src[i]] >> shift) & (radix - 1)]++] = src[i];
+			});
+			std::swap(src, dst);
+		}
+		if (src != index)
+			std::copy(src, src + n, index);
+	}
+
 } // namespace Multisort
 
 #endif
\ No newline at end of file
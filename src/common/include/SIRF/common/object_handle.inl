@@ -38,35 +38,34 @@ limitations under the License.
 
 A derived DataHandle type that stores a shared pointer, _data being 
 a pointer to it.
+The shared pointer is a member rather than a separately allocated object,
+so that wrapping an object takes one allocation from HandlePool.
 */
 template<class Base>
 class ObjectHandle : public DataHandle {
 public:
-	ObjectHandle(const ObjectHandle& obj) {
-		NEW(shared_ptr<Base>, ptr_sptr);
-		*ptr_sptr = *(shared_ptr<Base>*)obj.data();
-		_data = (void*)ptr_sptr;
+	ObjectHandle(const ObjectHandle& obj) : _sptr(obj._sptr) {
+		_data = (void*)&_sptr;
 		if (obj._status)
 			_status = new ExecutionStatus(*obj._status);
 		else
 			_status = 0;
 	}
 	ObjectHandle(const shared_ptr<Base>& sptr,
-		const ExecutionStatus* status = 0) {
-		NEW(shared_ptr<Base>, ptr_sptr);
-		*ptr_sptr = sptr;
-		_data = (void*)ptr_sptr;
+		const ExecutionStatus* status = 0) : _sptr(sptr) {
+		_data = (void*)&_sptr;
 		if (status)
 			_status = new ExecutionStatus(*status);
 		else
 			_status = 0;
 	}
 	virtual ~ObjectHandle() {
-		CAST_PTR(shared_ptr<Base>, ptr_sptr, _data);
 		delete _status;
 		_status = 0;
-		delete ptr_sptr;
+		_data = 0;
 	}
+private:
+	shared_ptr<Base> _sptr;
 };
 
 /*!
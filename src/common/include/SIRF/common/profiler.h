@@ -0,0 +1,271 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup Common
+\brief Registry of hot-path timers, call counts and byte counters.
+
+Instrumented call sites declare
+
+	SIRF_PROFILE("PETAcquisitionModel::forward");
+
+at the start of a scope, which counts the call and adds the time spent in
+the scope to the named counter, and
+
+	SIRF_PROFILE_BYTES("GadgetronClient::send", n);
+
+to add n bytes to the named counter. The counter is looked up once per call
+site; a timed call then costs two clock readings and a few atomic
+additions. With tracing on, timed calls are also recorded as Chrome trace
+events (up to SIRF_PROFILE_MAX_EVENTS), which can be viewed in
+chrome://tracing.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#ifndef SIRF_PROFILER
+#define SIRF_PROFILER
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define SIRF_PROFILE_MAX_EVENTS 1000000
+
+#define SIRF_PROFILE_CONCAT_(X, Y) X ## Y
+#define SIRF_PROFILE_NAME_(X, Y) SIRF_PROFILE_CONCAT_(X, Y)
+#define SIRF_PROFILE(NAME) \
+	static sirf::ProfileCounter& SIRF_PROFILE_NAME_(sirf_pc_, __LINE__) = \
+		sirf::Profiler::counter(NAME); \
+	sirf::ProfileTimer SIRF_PROFILE_NAME_(sirf_pt_, __LINE__) \
+		(SIRF_PROFILE_NAME_(sirf_pc_, __LINE__))
+#define SIRF_PROFILE_BYTES(NAME, N) \
+	do { \
+		static sirf::ProfileCounter& sirf_pc_bytes_ = \
+			sirf::Profiler::counter(NAME); \
+		sirf::Profiler::add_bytes(sirf_pc_bytes_, N); \
+	} while (0)
+
+namespace sirf {
+
+	struct ProfileCounter {
+		explicit ProfileCounter(const char* n) :
+			name(n), calls(0), ns(0), bytes(0) {}
+		std::string name;
+		std::atomic<unsigned long long> calls;
+		std::atomic<unsigned long long> ns;
+		std::atomic<unsigned long long> bytes;
+	};
+
+	class Profiler {
+	public:
+		typedef std::chrono::steady_clock clock;
+
+		static bool enabled()
+		{
+			return state_().enabled.load(std::memory_order_relaxed);
+		}
+		static bool tracing()
+		{
+			return state_().tracing.load(std::memory_order_relaxed);
+		}
+		static void set_enabled(bool on)
+		{
+			state_().enabled = on;
+		}
+		static void set_tracing(bool on)
+		{
+			state_().tracing = on;
+		}
+		static ProfileCounter& counter(const char* name)
+		{
+			State& s = state_();
+			std::lock_guard<std::mutex> lock(s.mutex);
+			std::shared_ptr<ProfileCounter>& c = s.counters[name];
+			if (!c)
+				c.reset(new ProfileCounter(name));
+			return *c;
+		}
+		static void add_bytes(ProfileCounter& c, size_t n)
+		{
+			if (!enabled())
+				return;
+			c.bytes += n;
+		}
+		static void add_call(ProfileCounter& c, clock::time_point start,
+			clock::time_point stop)
+		{
+			unsigned long long ns = (unsigned long long)
+				std::chrono::duration_cast<std::chrono::nanoseconds>
+				(stop - start).count();
+			c.calls++;
+			c.ns += ns;
+			if (tracing())
+				add_event_(c, start, ns);
+		}
+		// zeroes all counters and discards the trace events
+		static void reset()
+		{
+			State& s = state_();
+			std::lock_guard<std::mutex> lock(s.mutex);
+			std::map<std::string, std::shared_ptr<ProfileCounter> >::iterator i;
+			for (i = s.counters.begin(); i != s.counters.end(); ++i) {
+				i->second->calls = 0;
+				i->second->ns = 0;
+				i->second->bytes = 0;
+			}
+			s.events.clear();
+			s.dropped = 0;
+		}
+		// one line per used counter: name, calls, total ms, bytes
+		static std::string report()
+		{
+			State& s = state_();
+			std::lock_guard<std::mutex> lock(s.mutex);
+			std::ostringstream out;
+			std::map<std::string, std::shared_ptr<ProfileCounter> >::iterator i;
+			for (i = s.counters.begin(); i != s.counters.end(); ++i) {
+				const ProfileCounter& c = *i->second;
+				if (c.calls == 0 && c.bytes == 0)
+					continue;
+				out << i->first << ' ' << c.calls << ' '
+					<< c.ns*1e-6 << ' ' << c.bytes << '\n';
+			}
+			return out.str();
+		}
+		// the counters as a JSON object
+		static std::string report_json()
+		{
+			State& s = state_();
+			std::lock_guard<std::mutex> lock(s.mutex);
+			std::ostringstream out;
+			out << '{';
+			const char* sep = "";
+			std::map<std::string, std::shared_ptr<ProfileCounter> >::iterator i;
+			for (i = s.counters.begin(); i != s.counters.end(); ++i) {
+				const ProfileCounter& c = *i->second;
+				if (c.calls == 0 && c.bytes == 0)
+					continue;
+				out << sep << "\"" << i->first << "\": {\"calls\": " << c.calls
+					<< ", \"ms\": " << c.ns*1e-6 << ", \"bytes\": " << c.bytes
+					<< '}';
+				sep = ", ";
+			}
+			out << '}';
+			return out.str();
+		}
+		// the recorded calls in the Chrome trace event format
+		static std::string trace_json()
+		{
+			State& s = state_();
+			std::lock_guard<std::mutex> lock(s.mutex);
+			std::ostringstream out;
+			out << "{\"traceEvents\": [";
+			for (size_t i = 0; i < s.events.size(); i++) {
+				const Event& e = s.events[i];
+				if (i)
+					out << ",\n";
+				out << "{\"name\": \"" << e.name << "\", \"ph\": \"X\", "
+					<< "\"ts\": " << e.ts*1e-3 << ", \"dur\": " << e.dur*1e-3
+					<< ", \"pid\": 0, \"tid\": " << e.tid << '}';
+			}
+			out << "], \"droppedEvents\": " << s.dropped << '}';
+			return out.str();
+		}
+
+	private:
+		struct Event {
+			const char* name;
+			unsigned long long ts;
+			unsigned long long dur;
+			unsigned int tid;
+		};
+		struct State {
+			State() : enabled(true), tracing(false), dropped(0),
+				start(clock::now()) {}
+			std::atomic<bool> enabled;
+			std::atomic<bool> tracing;
+			std::mutex mutex;
+			std::map<std::string, std::shared_ptr<ProfileCounter> > counters;
+			std::vector<Event> events;
+			unsigned long long dropped;
+			clock::time_point start;
+		};
+		static State& state_()
+		{
+			static State s;
+			return s;
+		}
+		static void add_event_(ProfileCounter& c, clock::time_point start,
+			unsigned long long ns)
+		{
+			State& s = state_();
+			std::lock_guard<std::mutex> lock(s.mutex);
+			if (s.events.size() >= SIRF_PROFILE_MAX_EVENTS) {
+				s.dropped++;
+				return;
+			}
+			Event e;
+			e.name = c.name.c_str();
+			e.ts = (unsigned long long)
+				std::chrono::duration_cast<std::chrono::nanoseconds>
+				(start - s.start).count();
+			e.dur = ns;
+			e.tid = (unsigned int)
+				(std::hash<std::thread::id>()(std::this_thread::get_id()) % 100000);
+			s.events.push_back(e);
+		}
+	};
+
+	/*!
+	\ingroup Common
+	\brief Adds the time spent in its scope to a profile counter.
+	*/
+	class ProfileTimer {
+	public:
+		explicit ProfileTimer(ProfileCounter& c) :
+			counter_(c), on_(Profiler::enabled())
+		{
+			if (on_)
+				start_ = Profiler::clock::now();
+		}
+		~ProfileTimer()
+		{
+			if (on_)
+				Profiler::add_call(counter_, start_, Profiler::clock::now());
+		}
+	private:
+		ProfileCounter& counter_;
+		bool on_;
+		Profiler::clock::time_point start_;
+	};
+
+}
+
+#endif
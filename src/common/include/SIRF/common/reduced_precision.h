@@ -0,0 +1,187 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup Common
+\brief 16-bit storage formats of float data.
+
+Two formats are supported:
+- half, IEEE 754 binary16: 11 significant bits (3 decimal digits) and
+  magnitudes from 6e-8 (6e-5 normalised) to 65504;
+- bfloat16, the upper half of binary32: 8 significant bits and the range
+  of float.
+
+Conversion from float rounds to nearest even; values beyond the half range
+become infinities, NaNs stay NaNs. Bulk conversions use the F16C
+instructions if the compiler targets them (e.g. -mf16c or -march=native).
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#ifndef SIRF_REDUCED_PRECISION
+#define SIRF_REDUCED_PRECISION
+
+#include <stdint.h>
+#include <string.h>
+
+#include <stdexcept>
+#include <string>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+namespace sirf {
+
+	class ReducedPrecision {
+	public:
+		enum Format { HALF, BFLOAT16 };
+
+		static Format format(const std::string& name)
+		{
+			if (name == "half" || name == "float16")
+				return HALF;
+			if (name == "bfloat16")
+				return BFLOAT16;
+			throw std::invalid_argument
+				("unknown reduced precision format " + name);
+		}
+		static const char* name(Format f)
+		{
+			return f == HALF ? "half" : "bfloat16";
+		}
+
+		static uint16_t half_from_float(float x)
+		{
+			uint32_t u = bits_(x);
+			uint32_t sign = (u >> 16) & 0x8000u;
+			uint32_t a = u & 0x7fffffffu;
+			if (a >= 0x7f800000u) // infinity or NaN (kept quiet)
+				return (uint16_t)(sign | 0x7c00u | (a > 0x7f800000u ? 0x200u : 0));
+			if (a >= 0x477ff000u) // rounds beyond 65504
+				return (uint16_t)(sign | 0x7c00u);
+			if (a < 0x38800000u) { // subnormal half or zero
+				if (a < 0x33000000u) // below half the smallest subnormal
+					return (uint16_t)sign;
+				uint32_t e = a >> 23;
+				uint32_t m = (a & 0x7fffffu) | 0x800000u;
+				int shift = 126 - (int)e;
+				uint32_t h = m >> shift;
+				uint32_t rest = m & ((1u << shift) - 1);
+				uint32_t halfway = 1u << (shift - 1);
+				if (rest > halfway || (rest == halfway && (h & 1u)))
+					h++;
+				return (uint16_t)(sign | h);
+			}
+			// normalised: rebias the exponent by 127 - 15 and round the
+			// 13 bits dropped from the mantissa to nearest even
+			uint32_t h = (a - 0x38000000u) >> 13;
+			uint32_t rest = a & 0x1fffu;
+			if (rest > 0x1000u || (rest == 0x1000u && (h & 1u)))
+				h++;
+			return (uint16_t)(sign | h);
+		}
+		static float half_to_float(uint16_t h)
+		{
+			uint32_t sign = ((uint32_t)h & 0x8000u) << 16;
+			uint32_t e = (h >> 10) & 0x1fu;
+			uint32_t m = h & 0x3ffu;
+			if (e == 0x1fu)
+				return float_(sign | 0x7f800000u | (m << 13));
+			if (e)
+				return float_(sign | ((e + 112) << 23) | (m << 13));
+			if (!m)
+				return float_(sign);
+			// subnormal half: normalise the mantissa
+			e = 113;
+			while (!(m & 0x400u)) {
+				m <<= 1;
+				e--;
+			}
+			return float_(sign | (e << 23) | ((m & 0x3ffu) << 13));
+		}
+		static uint16_t bfloat16_from_float(float x)
+		{
+			uint32_t u = bits_(x);
+			if ((u & 0x7fffffffu) > 0x7f800000u)
+				return (uint16_t)((u >> 16) | 0x40u);
+			u += 0x7fffu + ((u >> 16) & 1u);
+			return (uint16_t)(u >> 16);
+		}
+		static float bfloat16_to_float(uint16_t b)
+		{
+			return float_((uint32_t)b << 16);
+		}
+
+		// y := x converted to the format f
+		static void encode(Format f, size_t n, const float* x, uint16_t* y)
+		{
+			size_t i = 0;
+			if (f == BFLOAT16) {
+				for (; i < n; i++)
+					y[i] = bfloat16_from_float(x[i]);
+				return;
+			}
+#if defined(__F16C__)
+			for (; i + 8 <= n; i += 8)
+				_mm_storeu_si128((__m128i*)(y + i), _mm256_cvtps_ph
+				(_mm256_loadu_ps(x + i), _MM_FROUND_TO_NEAREST_INT));
+#endif
+			for (; i < n; i++)
+				y[i] = half_from_float(x[i]);
+		}
+		// y := x in the format f converted to float
+		static void decode(Format f, size_t n, const uint16_t* x, float* y)
+		{
+			size_t i = 0;
+			if (f == BFLOAT16) {
+				for (; i < n; i++)
+					y[i] = bfloat16_to_float(x[i]);
+				return;
+			}
+#if defined(__F16C__)
+			for (; i + 8 <= n; i += 8)
+				_mm256_storeu_ps(y + i,
+				_mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(x + i))));
+#endif
+			for (; i < n; i++)
+				y[i] = half_to_float(x[i]);
+		}
+
+	private:
+		static uint32_t bits_(float x)
+		{
+			uint32_t u;
+			memcpy(&u, &x, sizeof(u));
+			return u;
+		}
+		static float float_(uint32_t u)
+		{
+			float x;
+			memcpy(&x, &u, sizeof(x));
+			return x;
+		}
+	};
+
+}
+
+#endif
@@ -0,0 +1,529 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup Common
+\brief Iterative solvers working on abstract data containers.
+
+The solvers are driven by run(n), which performs n iterations without
+leaving C++, calling an optional callback after each of them:
+- CGLS, conjugate gradients on the normal equations of min |A x - b|;
+- SteepestDescent, for a smooth objective function, with the exact step
+  where the objective provides it, given step size or backtracking
+  line search otherwise;
+- PDHG, primal-dual hybrid gradient (Condat-Vu variant) for
+  min 1/2 |A x - b|^2 + R(x), R being an optional smooth prior.
+
+All workspaces are allocated by the first run() and reused by all
+iterations, and are only updated by the in-place methods xapy and
+scale_xapy of aDataContainer, as some containers (MR data) can only be
+written by other methods when empty.
+
+The engines supply aLinearOperator and aObjective implementations wrapping
+their acquisition models, objective functions and priors.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#ifndef SIRF_SOLVERS
+#define SIRF_SOLVERS
+
+#include <cmath>
+#include <complex>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+
+#include "SIRF/common/data_container.h"
+
+namespace sirf {
+
+	/*!
+	\ingroup Common
+	\brief Linear operator between two data container spaces.
+	*/
+	template<typename T>
+	class aLinearOperator {
+	public:
+		virtual ~aLinearOperator() {}
+		// y := A x, y being a container of the range of A
+		virtual void apply(aDataContainer<T>& x, aDataContainer<T>& y) = 0;
+		// x := A* y, x being a container of the domain of A
+		virtual void apply_adjoint(aDataContainer<T>& y, aDataContainer<T>& x)
+			= 0;
+	};
+
+	/*!
+	\ingroup Common
+	\brief Smooth real-valued function to be minimised.
+	*/
+	template<typename T>
+	class aObjective {
+	public:
+		virtual ~aObjective() {}
+		virtual float value(aDataContainer<T>& x) = 0;
+		// g := the gradient at x
+		virtual void gradient(aDataContainer<T>& x, aDataContainer<T>& g) = 0;
+		/*
+		Returns the minimiser t of value(x - t d) if it can be computed in
+		closed form, d being the gradient computed by the last call to
+		gradient(x, d), and 0 otherwise.
+		*/
+		virtual float exact_step(aDataContainer<T>& x, aDataContainer<T>& d)
+		{
+			return 0;
+		}
+	};
+
+	/*!
+	\ingroup Common
+	\brief Base class of the iterative solvers.
+
+	The initial estimate is copied by set_initial_estimate(), and is
+	updated in place by run().
+	*/
+	template<typename T>
+	class aSolver {
+	public:
+		typedef std::unique_ptr<aDataContainer<T> > Container;
+		// called after each iteration with its number and the estimate
+		typedef std::function<void(int, aDataContainer<T>&)> Callback;
+
+		aSolver() : iteration_(0), ready_(false) {}
+		virtual ~aSolver() {}
+
+		void set_initial_estimate(const aDataContainer<T>& x)
+		{
+			sptr_x_ = copy(x);
+			restart();
+		}
+		aDataContainer<T>& current_estimate()
+		{
+			if (!sptr_x_)
+				throw std::runtime_error("initial estimate not set");
+			return *sptr_x_;
+		}
+		int iteration() const
+		{
+			return iteration_;
+		}
+		void set_callback(Callback f)
+		{
+			callback_ = f;
+		}
+		// the next run() starts afresh from the current estimate
+		void restart()
+		{
+			ready_ = false;
+		}
+		// performs n more iterations
+		void run(int n)
+		{
+			if (!sptr_x_)
+				throw std::runtime_error("initial estimate not set");
+			if (!ready_) {
+				set_up_();
+				ready_ = true;
+			}
+			for (int i = 0; i < n; i++) {
+				iterate_();
+				iteration_++;
+				if (callback_)
+					callback_(iteration_, *sptr_x_);
+			}
+		}
+
+		// a new container with the same data as x
+		static Container copy(const aDataContainer<T>& x)
+		{
+			aDataContainer<T>& y = const_cast<aDataContainer<T>&>(x);
+			Container sptr_c(y.new_data_container());
+			sptr_c->axpby((T)1, y, (T)0, y);
+			return sptr_c;
+		}
+		static float norm2(aDataContainer<T>& x)
+		{
+			float s = x.norm();
+			return s*s;
+		}
+
+	protected:
+		Container sptr_x_;
+		int iteration_;
+		bool ready_;
+		Callback callback_;
+
+		// allocates workspaces and computes the initial residuals
+		virtual void set_up_() = 0;
+		virtual void iterate_() = 0;
+	};
+
+	/*!
+	\ingroup Common
+	\brief Least squares objective 1/2 |A x - b|^2.
+	*/
+	template<typename T>
+	class LeastSquaresObjective : public aObjective<T> {
+	public:
+		LeastSquaresObjective() {}
+		LeastSquaresObjective(std::shared_ptr<aLinearOperator<T> > sptr_op,
+			const aDataContainer<T>& b) : sptr_op_(sptr_op)
+		{
+			set_data(b);
+		}
+		void set_operator(std::shared_ptr<aLinearOperator<T> > sptr_op)
+		{
+			sptr_op_ = sptr_op;
+		}
+		void set_data(const aDataContainer<T>& b)
+		{
+			sptr_b_ = aSolver<T>::copy(b);
+			sptr_r_ = aSolver<T>::copy(b);
+			sptr_w_.reset();
+		}
+		bool ready() const
+		{
+			return sptr_op_ && sptr_b_;
+		}
+		virtual float value(aDataContainer<T>& x)
+		{
+			residual_(x);
+			return 0.5f*aSolver<T>::norm2(*sptr_r_);
+		}
+		virtual void gradient(aDataContainer<T>& x, aDataContainer<T>& g)
+		{
+			residual_(x);
+			sptr_op_->apply_adjoint(*sptr_r_, g);
+		}
+		// t = Re <A d, A x - b> / |A d|^2, the residual kept from gradient()
+		virtual float exact_step(aDataContainer<T>& x, aDataContainer<T>& d)
+		{
+			if (!sptr_w_)
+				sptr_w_ = aSolver<T>::copy(*sptr_b_);
+			sptr_op_->apply(d, *sptr_w_);
+			float w2 = aSolver<T>::norm2(*sptr_w_);
+			if (w2 == 0)
+				return 0;
+			return std::real(sptr_w_->dot(*sptr_r_)) / w2;
+		}
+	private:
+		std::shared_ptr<aLinearOperator<T> > sptr_op_;
+		typename aSolver<T>::Container sptr_b_;
+		typename aSolver<T>::Container sptr_r_;
+		typename aSolver<T>::Container sptr_w_;
+
+		// r := A x - b
+		void residual_(aDataContainer<T>& x)
+		{
+			if (!ready())
+				throw std::runtime_error
+				("least squares operator or data not set");
+			sptr_op_->apply(x, *sptr_r_);
+			sptr_r_->xapy((T)-1, *sptr_b_);
+		}
+	};
+
+	/*!
+	\ingroup Common
+	\brief Conjugate gradients on the normal equations A* A x = A* b.
+	*/
+	template<typename T>
+	class CGLS : public aSolver<T> {
+	public:
+		CGLS() : gamma_(0) {}
+		void set_operator(std::shared_ptr<aLinearOperator<T> > sptr_op)
+		{
+			sptr_op_ = sptr_op;
+			this->restart();
+		}
+		void set_data(const aDataContainer<T>& b)
+		{
+			sptr_b_ = aSolver<T>::copy(b);
+			this->restart();
+		}
+		// |b - A x| at the current estimate
+		float residual_norm()
+		{
+			return sptr_r_ ? sptr_r_->norm() : 0.0f;
+		}
+	protected:
+		typedef typename aSolver<T>::Container Container;
+		std::shared_ptr<aLinearOperator<T> > sptr_op_;
+		Container sptr_b_;
+		Container sptr_r_; // b - A x
+		Container sptr_q_; // A p
+		Container sptr_s_; // A* r
+		Container sptr_p_; // search direction
+		float gamma_; // |s|^2
+
+		virtual void set_up_()
+		{
+			if (!sptr_op_ || !sptr_b_)
+				throw std::runtime_error("CGLS operator or data not set");
+			aDataContainer<T>& x = *this->sptr_x_;
+			if (!sptr_r_) {
+				sptr_r_ = aSolver<T>::copy(*sptr_b_);
+				sptr_q_ = aSolver<T>::copy(*sptr_b_);
+				sptr_s_ = aSolver<T>::copy(x);
+				sptr_p_ = aSolver<T>::copy(x);
+			}
+			sptr_op_->apply(x, *sptr_q_);
+			sptr_r_->scale_xapy((T)0, (T)1, *sptr_b_);
+			sptr_r_->xapy((T)-1, *sptr_q_);
+			sptr_op_->apply_adjoint(*sptr_r_, *sptr_s_);
+			sptr_p_->scale_xapy((T)0, (T)1, *sptr_s_);
+			gamma_ = aSolver<T>::norm2(*sptr_s_);
+		}
+		virtual void iterate_()
+		{
+			// converged: the residual is orthogonal to the range of A
+			if (gamma_ == 0)
+				return;
+			sptr_op_->apply(*sptr_p_, *sptr_q_);
+			float q2 = aSolver<T>::norm2(*sptr_q_);
+			if (q2 == 0)
+				return;
+			T alpha = (T)(gamma_ / q2);
+			this->sptr_x_->xapy(alpha, *sptr_p_);
+			sptr_r_->xapy(-alpha, *sptr_q_);
+			sptr_op_->apply_adjoint(*sptr_r_, *sptr_s_);
+			float gamma = aSolver<T>::norm2(*sptr_s_);
+			sptr_p_->scale_xapy((T)(gamma / gamma_), (T)1, *sptr_s_);
+			gamma_ = gamma;
+		}
+	};
+
+	/*!
+	\ingroup Common
+	\brief Steepest descent for a smooth objective.
+
+	The step is, in order of preference, the exact step if the objective
+	computes it, the step size if set (positive), or found by backtracking
+	from twice the last accepted step until the sufficient decrease
+	condition f(x - t g) <= f(x) - t/2 |g|^2 is met.
+	*/
+	template<typename T>
+	class SteepestDescent : public aSolver<T> {
+	public:
+		SteepestDescent() : step_size_(0), step_(0) {}
+		void set_objective(std::shared_ptr<aObjective<T> > sptr_obj)
+		{
+			sptr_obj_ = sptr_obj;
+			this->restart();
+		}
+		std::shared_ptr<aObjective<T> > objective()
+		{
+			return sptr_obj_;
+		}
+		void set_step_size(float t)
+		{
+			step_size_ = t;
+		}
+		// the step taken by the last iteration
+		float last_step() const
+		{
+			return step_;
+		}
+	protected:
+		typedef typename aSolver<T>::Container Container;
+		std::shared_ptr<aObjective<T> > sptr_obj_;
+		Container sptr_g_;
+		Container sptr_y_; // trial estimate of the line search
+		float step_size_;
+		float step_;
+
+		virtual void set_up_()
+		{
+			if (!sptr_obj_)
+				throw std::runtime_error("objective function not set");
+			if (!sptr_g_)
+				sptr_g_ = aSolver<T>::copy(*this->sptr_x_);
+			step_ = 0;
+		}
+		virtual void iterate_()
+		{
+			aDataContainer<T>& x = *this->sptr_x_;
+			aDataContainer<T>& g = *sptr_g_;
+			sptr_obj_->gradient(x, g);
+			float t = sptr_obj_->exact_step(x, g);
+			if (t <= 0)
+				t = step_size_;
+			if (t > 0) {
+				x.xapy((T)-t, g);
+				step_ = t;
+				return;
+			}
+			float g2 = aSolver<T>::norm2(g);
+			if (g2 == 0)
+				return;
+			if (!sptr_y_)
+				sptr_y_ = aSolver<T>::copy(x);
+			aDataContainer<T>& y = *sptr_y_;
+			float f = sptr_obj_->value(x);
+			t = step_ > 0 ? 2 * step_ : 1 / std::sqrt(g2);
+			for (int k = 0; k < 30; k++, t /= 2) {
+				y.scale_xapy((T)0, (T)1, x);
+				y.xapy((T)-t, g);
+				if (sptr_obj_->value(y) <= f - 0.5f*t*g2) {
+					// the trial becomes the estimate, no copying
+					this->sptr_x_.swap(sptr_y_);
+					step_ = t;
+					return;
+				}
+			}
+			step_ = 0;
+		}
+	};
+
+	/*!
+	\ingroup Common
+	\brief Primal-dual hybrid gradient for min 1/2 |A x - b|^2 + R(x).
+
+	Each iteration performs
+		x' = x - tau (A* y + grad R(x)),
+		y = (y + sigma (A (2 x' - x) - b)) / (1 + sigma),
+	which converges if tau (sigma |A|^2 + L/2) <= 1, L being the Lipschitz
+	constant of grad R. Step sizes not set (non-positive) are computed from
+	an estimate of |A| by the power method as sigma = 1/|A| and
+	tau = 1/|A| without a prior, 1/(2|A|) with one.
+	*/
+	template<typename T>
+	class PDHG : public aSolver<T> {
+	public:
+		PDHG() : sigma_(0), tau_(0), s_(0), t_(0) {}
+		void set_operator(std::shared_ptr<aLinearOperator<T> > sptr_op)
+		{
+			sptr_op_ = sptr_op;
+			this->restart();
+		}
+		void set_data(const aDataContainer<T>& b)
+		{
+			sptr_b_ = aSolver<T>::copy(b);
+			this->restart();
+		}
+		void set_prior(std::shared_ptr<aObjective<T> > sptr_prior)
+		{
+			sptr_prior_ = sptr_prior;
+			this->restart();
+		}
+		void set_sigma(float sigma)
+		{
+			sigma_ = sigma;
+			this->restart();
+		}
+		void set_tau(float tau)
+		{
+			tau_ = tau;
+			this->restart();
+		}
+		// the step sizes used by the last run()
+		float sigma() const
+		{
+			return s_;
+		}
+		float tau() const
+		{
+			return t_;
+		}
+	protected:
+		typedef typename aSolver<T>::Container Container;
+		std::shared_ptr<aLinearOperator<T> > sptr_op_;
+		std::shared_ptr<aObjective<T> > sptr_prior_;
+		Container sptr_b_;
+		Container sptr_y_; // dual variable
+		Container sptr_v_; // range workspace
+		Container sptr_u_; // domain workspace
+		Container sptr_g_; // prior gradient
+		Container sptr_x0_; // previous estimate, then extrapolation
+		float sigma_;
+		float tau_;
+		float s_; // step sizes in use
+		float t_;
+
+		virtual void set_up_()
+		{
+			if (!sptr_op_ || !sptr_b_)
+				throw std::runtime_error("PDHG operator or data not set");
+			aDataContainer<T>& x = *this->sptr_x_;
+			if (!sptr_y_) {
+				sptr_y_ = aSolver<T>::copy(*sptr_b_);
+				sptr_v_ = aSolver<T>::copy(*sptr_b_);
+				sptr_u_ = aSolver<T>::copy(x);
+				sptr_x0_ = aSolver<T>::copy(x);
+			}
+			sptr_y_->scale_xapy((T)0, (T)0, *sptr_b_);
+			s_ = sigma_;
+			t_ = tau_;
+			if (s_ <= 0 || t_ <= 0) {
+				float a = operator_norm_(20);
+				if (a <= 0)
+					a = 1;
+				if (s_ <= 0)
+					s_ = 1 / a;
+				if (t_ <= 0)
+					t_ = (sptr_prior_ ? 0.5f : 1.0f) / a;
+			}
+		}
+		virtual void iterate_()
+		{
+			aDataContainer<T>& x = *this->sptr_x_;
+			aDataContainer<T>& u = *sptr_u_;
+			aDataContainer<T>& v = *sptr_v_;
+			aDataContainer<T>& x0 = *sptr_x0_;
+			x0.scale_xapy((T)0, (T)1, x);
+			sptr_op_->apply_adjoint(*sptr_y_, u);
+			if (sptr_prior_) {
+				if (!sptr_g_)
+					sptr_g_ = aSolver<T>::copy(x);
+				sptr_prior_->gradient(x, *sptr_g_);
+				u.xapy((T)1, *sptr_g_);
+			}
+			x.xapy((T)-t_, u);
+			// x0 := 2 x - x0
+			x0.scale_xapy((T)-1, (T)2, x);
+			sptr_op_->apply(x0, v);
+			v.xapy((T)-1, *sptr_b_);
+			sptr_y_->scale_xapy((T)(1 / (1 + s_)), (T)(s_ / (1 + s_)), v);
+		}
+		// estimates |A| by power iterations on A* A
+		float operator_norm_(int iterations)
+		{
+			aDataContainer<T>& u = *sptr_u_;
+			aDataContainer<T>& v = *sptr_v_;
+			sptr_op_->apply_adjoint(*sptr_b_, u);
+			float a2 = 0;
+			for (int i = 0; i < iterations; i++) {
+				float n = u.norm();
+				if (n == 0)
+					return 0;
+				u.scale_xapy((T)(1 / n), (T)0, u);
+				sptr_op_->apply(u, v);
+				sptr_op_->apply_adjoint(v, u);
+				a2 = u.norm();
+			}
+			return std::sqrt(a2);
+		}
+	};
+
+}
+
+#endif
@@ -0,0 +1,370 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup Common
+\brief Memory budget of the data containers of the hybrid storage scheme.
+
+Containers stored by the hybrid scheme keep their data in SpillableBuffer
+objects, which are registered with StorageBudget. While the total size of
+the buffers resident in memory exceeds the budget, the least recently used
+buffers are spilled: their data is written to a scratch file, which is
+then memory-mapped in place of the memory, so that the data stays
+accessible at the same cost as data in a memory-mapped file.
+
+Spilling happens when a buffer is created or grown, and never to that
+buffer, so that a container larger than the budget stays in memory until
+it is the least recently used one.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#ifndef SIRF_STORAGE_BUDGET
+#define SIRF_STORAGE_BUDGET
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+
+#include <boost/align/aligned_alloc.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace sirf {
+
+	/*!
+	\ingroup Common
+	\brief Storage that can move its data from memory to a scratch file.
+	*/
+	class SpillableStorage {
+	public:
+		virtual ~SpillableStorage() {}
+		// moves the data to a scratch file, returns false if it cannot be
+		// moved; called by StorageBudget, which it must not call
+		virtual bool spill() = 0;
+	};
+
+	/*!
+	\ingroup Common
+	\brief Accounting of the spillable storage against the memory budget.
+	*/
+	class StorageBudget {
+	public:
+		// the memory budget in bytes, 0 (default) for none
+		static void set_limit(size_t bytes)
+		{
+			State& s = state_();
+			std::lock_guard<std::recursive_mutex> lock(s.mutex);
+			s.limit = bytes;
+			enforce_(0);
+		}
+		static size_t limit()
+		{
+			return state_().limit;
+		}
+		// the directory of the scratch files, empty for the current one
+		static void set_scratch_directory(const std::string& dir)
+		{
+			State& s = state_();
+			std::lock_guard<std::recursive_mutex> lock(s.mutex);
+			s.directory = dir;
+		}
+		static std::string scratch_directory()
+		{
+			State& s = state_();
+			std::lock_guard<std::recursive_mutex> lock(s.mutex);
+			return s.directory;
+		}
+		// the path of the scratch file name in the scratch directory
+		static std::string scratch_path(const std::string& name)
+		{
+			std::string dir = scratch_directory();
+			if (dir.empty())
+				return name;
+			char last = dir[dir.size() - 1];
+			if (last == '/' || last == '\\')
+				return dir + name;
+			return dir + "/" + name;
+		}
+		// bytes of the registered storage in memory and in scratch files
+		static size_t resident_bytes()
+		{
+			State& s = state_();
+			std::lock_guard<std::recursive_mutex> lock(s.mutex);
+			return s.resident;
+		}
+		static size_t spilled_bytes()
+		{
+			State& s = state_();
+			std::lock_guard<std::recursive_mutex> lock(s.mutex);
+			return s.spilled;
+		}
+
+		// registers p as resident storage of the given size, most recently
+		// used, or updates its record so, and spills the least recently
+		// used other storage while over budget
+		static void resize(SpillableStorage* p, size_t bytes)
+		{
+			State& s = state_();
+			std::lock_guard<std::recursive_mutex> lock(s.mutex);
+			erase_(p);
+			Entry e;
+			e.bytes = bytes;
+			e.spilled = false;
+			e.pos = s.lru.insert(s.lru.end(), p);
+			s.entries[p] = e;
+			s.resident += bytes;
+			enforce_(p);
+		}
+		// marks p as the most recently used storage
+		static void touch(const SpillableStorage* p)
+		{
+			State& s = state_();
+			std::lock_guard<std::recursive_mutex> lock(s.mutex);
+			std::map<SpillableStorage*, Entry>::iterator i =
+				s.entries.find(const_cast<SpillableStorage*>(p));
+			if (i != s.entries.end() && !i->second.spilled)
+				s.lru.splice(s.lru.end(), s.lru, i->second.pos);
+		}
+		static void remove(SpillableStorage* p)
+		{
+			State& s = state_();
+			std::lock_guard<std::recursive_mutex> lock(s.mutex);
+			erase_(p);
+		}
+
+	private:
+		struct Entry {
+			size_t bytes;
+			bool spilled;
+			std::list<SpillableStorage*>::iterator pos;
+		};
+		struct State {
+			State() : limit(0), resident(0), spilled(0) {}
+			std::recursive_mutex mutex;
+			size_t limit;
+			size_t resident;
+			size_t spilled;
+			std::string directory;
+			// resident storage, least recently used first
+			std::list<SpillableStorage*> lru;
+			std::map<SpillableStorage*, Entry> entries;
+		};
+		static State& state_()
+		{
+			static State s;
+			return s;
+		}
+		static void erase_(SpillableStorage* p)
+		{
+			State& s = state_();
+			std::map<SpillableStorage*, Entry>::iterator i = s.entries.find(p);
+			if (i == s.entries.end())
+				return;
+			if (i->second.spilled)
+				s.spilled -= i->second.bytes;
+			else {
+				s.resident -= i->second.bytes;
+				s.lru.erase(i->second.pos);
+			}
+			s.entries.erase(i);
+		}
+		// spills storage other than keep, least recently used first,
+		// until within the budget
+		static void enforce_(SpillableStorage* keep)
+		{
+			State& s = state_();
+			std::list<SpillableStorage*>::iterator i = s.lru.begin();
+			while (s.limit && s.resident > s.limit && i != s.lru.end()) {
+				SpillableStorage* p = *i;
+				if (p == keep || !p->spill()) {
+					++i;
+					continue;
+				}
+				Entry& e = s.entries[p];
+				i = s.lru.erase(i);
+				e.pos = s.lru.end();
+				e.spilled = true;
+				s.resident -= e.bytes;
+				s.spilled += e.bytes;
+			}
+		}
+	};
+
+	/*!
+	\ingroup Common
+	\brief Aligned memory buffer that can be spilled to a scratch file.
+
+	If managed, the buffer is accounted against the StorageBudget. When
+	spilled, the data moves to the memory-mapped scratch file, and the
+	callback set by the owner is given the new address; a pinned buffer
+	(e.g. one viewed by Python) is never spilled. Resizing brings the data
+	back into memory.
+	*/
+	class SpillableBuffer : public SpillableStorage {
+	public:
+		SpillableBuffer(bool managed = false) :
+			ptr_(0), size_(0), managed_(managed), pinned_(false)
+		{}
+		~SpillableBuffer()
+		{
+			if (managed_)
+				StorageBudget::remove(this);
+			free_();
+		}
+		void* data() const
+		{
+			return ptr_;
+		}
+		size_t size() const
+		{
+			return size_;
+		}
+		bool managed() const
+		{
+			return managed_;
+		}
+		bool spilled() const
+		{
+			return region_.get() != 0;
+		}
+		// called with the new address of the data when it is spilled
+		void set_move_callback(std::function<void(void*)> f)
+		{
+			moved_ = f;
+		}
+		// resizes to bytes in memory, keeping the data that fits, the rest
+		// is not initialised
+		void resize(size_t bytes)
+		{
+			void* ptr = 0;
+			if (bytes) {
+				ptr = boost::alignment::aligned_alloc(64, bytes);
+				if (!ptr)
+					throw std::bad_alloc();
+			}
+			if (ptr_)
+				memcpy(ptr, ptr_, std::min(bytes, size_));
+			free_();
+			ptr_ = ptr;
+			size_ = bytes;
+			if (managed_)
+				StorageBudget::resize(this, bytes);
+		}
+		// marks the data as recently used
+		void touch() const
+		{
+			if (managed_)
+				StorageBudget::touch(this);
+		}
+		// keeps the data where it is from now on
+		void pin()
+		{
+			pinned_ = true;
+		}
+		bool spill()
+		{
+			using namespace boost::interprocess;
+			if (pinned_ || !ptr_ || region_.get())
+				return false;
+			std::string filename = StorageBudget::scratch_path(scratch_name_());
+			try {
+				{
+					std::filebuf fb;
+					if (!fb.open(filename.c_str(),
+						std::ios::out | std::ios::trunc | std::ios::binary))
+						return false;
+					fb.pubseekoff(size_ - 1, std::ios::beg);
+					fb.sputc(0);
+				}
+				mapping_.reset(new file_mapping(filename.c_str(), read_write));
+				region_.reset(new mapped_region(*mapping_, read_write));
+				memcpy(region_->get_address(), ptr_, size_);
+				// written out now, the pages are re-read on access
+				region_->flush();
+				region_->advise(mapped_region::advice_dontneed);
+			}
+			catch (...) {
+				region_.reset();
+				mapping_.reset();
+				std::remove(filename.c_str());
+				return false;
+			}
+			boost::alignment::aligned_free(ptr_);
+			ptr_ = region_->get_address();
+			filename_ = filename;
+			if (moved_)
+				moved_(ptr_);
+			return true;
+		}
+
+	private:
+		void* ptr_;
+		size_t size_;
+		bool managed_;
+		bool pinned_;
+		std::string filename_;
+		std::shared_ptr<boost::interprocess::file_mapping> mapping_;
+		std::shared_ptr<boost::interprocess::mapped_region> region_;
+		std::function<void(void*)> moved_;
+
+		SpillableBuffer(const SpillableBuffer&);
+		SpillableBuffer& operator=(const SpillableBuffer&);
+
+		void free_()
+		{
+			if (region_.get()) {
+				region_.reset();
+				mapping_.reset();
+				std::remove(filename_.c_str());
+			}
+			else if (ptr_)
+				boost::alignment::aligned_free(ptr_);
+			ptr_ = 0;
+			size_ = 0;
+		}
+		static std::string scratch_name_()
+		{
+			static std::atomic<int> calls(0);
+			long long ms = (long long)std::chrono::duration_cast
+				<std::chrono::milliseconds>
+				(std::chrono::system_clock::now().time_since_epoch()).count();
+			char buff[48];
+			sprintf(buff, "tmp_spill_%d_%lld", ++calls, ms);
+			return std::string(buff);
+		}
+	};
+
+}
+
+#endif
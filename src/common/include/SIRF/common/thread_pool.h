@@ -0,0 +1,560 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup Common
+\brief Process-wide work-stealing thread pool.
+
+All parallel loops of the SIRF C++ layer run on one pool of threads:
+
+	sirf::parallel_for(n, nthreads, [&](int i) { ... });
+
+runs the calls f(0), ..., f(n - 1) on the calling thread and up to
+nthreads - 1 threads of the pool (nthreads < 1 meaning all of them).
+Loops may be nested: a thread waiting for a loop only waits for the calls
+already started by other threads, and every thread of the pool keeps its
+own queue of tasks, the idle threads stealing from the others.
+
+The pool is configured in one place, ThreadPool::configure(), by the
+number of threads (the calling thread included) and the placement of the
+pool threads on the processors:
+- NONE, the operating system decides;
+- COMPACT, the processors of one NUMA node are filled before the next;
+- SCATTER, the threads go round the NUMA nodes in turn.
+The default number of threads is taken from SIRF_NUM_THREADS, else from
+OMP_NUM_THREADS, else is the number of hardware threads, and the default
+placement from SIRF_THREAD_AFFINITY (none, compact or scatter). The OpenMP
+regions of the engines ask for num_threads() threads explicitly, so that
+OpenMP and the pool do not oversubscribe the processors.
+
+Placement is only implemented on Linux, where the NUMA nodes are read from
+/sys/devices/system/node.
+
+Tasks that block for long periods (network sessions, file readers) are not
+to be run on the pool; for them, run_concurrently() starts dedicated
+threads.
+
+The pool threads are started by the first parallel loop that needs them.
+A process forked after that has no pool threads, hence on Linux the child
+gets a new pool (of the same size and placement), whose threads are again
+started on demand, so that worker processes may be forked at any time.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#ifndef SIRF_THREAD_POOL
+#define SIRF_THREAD_POOL
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace sirf {
+
+	class ThreadPool {
+	public:
+		enum Affinity { NONE, COMPACT, SCATTER };
+
+		static ThreadPool& instance()
+		{
+			static ThreadPool pool;
+			return pool;
+		}
+
+		// the number of threads running parallel loops, the caller included
+		static int num_threads()
+		{
+			return instance().size_;
+		}
+		static Affinity affinity()
+		{
+			return instance().affinity_;
+		}
+		/*
+		Sets the number of threads (n < 1: the default) and their placement;
+		the loops running at the time finish on the old threads.
+		*/
+		static void configure(int n, Affinity affinity)
+		{
+			instance().configure_(n, affinity);
+		}
+		static void set_num_threads(int n)
+		{
+			configure(n, affinity());
+		}
+		static Affinity affinity(const std::string& name)
+		{
+			std::string s(name);
+			std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+			if (s == "none" || s.empty())
+				return NONE;
+			if (s == "compact")
+				return COMPACT;
+			if (s == "scatter")
+				return SCATTER;
+			throw std::invalid_argument("unknown thread affinity " + name);
+		}
+		static const char* affinity_name(Affinity a)
+		{
+			return a == COMPACT ? "compact" : a == SCATTER ? "scatter" : "none";
+		}
+		// numbers of the processors of each NUMA node
+		static const std::vector<std::vector<int> >& numa_nodes()
+		{
+			static std::vector<std::vector<int> > nodes = read_numa_nodes_();
+			return nodes;
+		}
+
+		/*
+		Runs f(0), ..., f(n - 1) on the calling thread and up to nthreads - 1
+		pool threads; the first exception thrown by any of the calls is
+		rethrown in the calling thread, the calls not yet started then
+		being skipped.
+		*/
+		template<class F>
+		void parallel_for(int n, int nthreads, F f)
+		{
+			std::shared_ptr<Workers> sptr_w = workers_();
+			int size = sptr_w->size() + 1;
+			if (nthreads < 1 || nthreads > size)
+				nthreads = size;
+			if (nthreads > n)
+				nthreads = n;
+			if (nthreads < 2) {
+				for (int i = 0; i < n; i++)
+					f(i);
+				return;
+			}
+			std::function<void(int)> g(f);
+			std::shared_ptr<Loop> sptr_loop(new Loop(n, &g));
+			for (int t = 1; t < nthreads; t++)
+				sptr_w->push([sptr_loop]() { sptr_loop->run(); });
+			sptr_loop->run();
+			sptr_loop->wait();
+			if (sptr_loop->error)
+				std::rethrow_exception(sptr_loop->error);
+		}
+
+		~ThreadPool()
+		{
+			if (sptr_workers_)
+				sptr_workers_->stop();
+		}
+
+	private:
+		typedef std::function<void()> Task;
+
+		// the state of a parallel loop shared by the threads running it
+		struct Loop {
+			Loop(int n_, const std::function<void(int)>* f_) :
+				n(n_), next(0), done(0), f(f_) {}
+			const int n;
+			std::atomic<int> next;
+			std::atomic<int> done;
+			// only called for a claimed index, hence while the caller waits
+			const std::function<void(int)>* f;
+			std::exception_ptr error;
+			std::mutex mutex;
+			std::condition_variable cv;
+
+			void run()
+			{
+				for (int i = next++; i < n; i = next++) {
+					try {
+						(*f)(i);
+					}
+					catch (...) {
+						{
+							std::lock_guard<std::mutex> lock(mutex);
+							if (!error)
+								error = std::current_exception();
+						}
+						// the calls not yet claimed are skipped
+						int first = next.exchange(n);
+						if (first < n)
+							finish_(n - first);
+					}
+					finish_(1);
+				}
+			}
+			void wait()
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				cv.wait(lock, [this]() { return done.load() >= n; });
+			}
+			void finish_(int k)
+			{
+				if ((done += k) >= n) {
+					std::lock_guard<std::mutex> lock(mutex);
+					cv.notify_all();
+				}
+			}
+		};
+
+		// the pool threads of one configuration, each with its own queue
+		class Workers {
+		public:
+			Workers(int n, Affinity affinity) :
+				queues_(n), pending_(0), next_queue_(0), stop_(false),
+				started_(false), affinity_(affinity)
+			{
+				for (int i = 0; i < n; i++)
+					queues_[i].reset(new Queue);
+			}
+			~Workers()
+			{
+				stop();
+			}
+			int size() const
+			{
+				return (int)queues_.size();
+			}
+			// pool threads push to their own queue, other threads in turn
+			void push(Task task)
+			{
+				start_();
+				int q = current_() == this ? index_() :
+					(int)(next_queue_++ % queues_.size());
+				{
+					std::lock_guard<std::mutex> lock(queues_[q]->mutex);
+					queues_[q]->tasks.push_back(task);
+				}
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					pending_++;
+				}
+				cv_.notify_one();
+			}
+			// the queued tasks are run before the threads exit
+			void stop()
+			{
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					stop_ = true;
+				}
+				cv_.notify_all();
+				std::lock_guard<std::mutex> lock(start_mutex_);
+				for (size_t t = 0; t < threads_.size(); t++)
+					if (threads_[t].joinable())
+						threads_[t].join();
+				threads_.clear();
+			}
+			bool owns_current_thread() const
+			{
+				return current_() == this;
+			}
+
+		private:
+			struct Queue {
+				std::mutex mutex;
+				std::deque<Task> tasks;
+			};
+			std::vector<std::unique_ptr<Queue> > queues_;
+			std::vector<std::thread> threads_;
+			std::atomic<int> pending_;
+			std::atomic<unsigned int> next_queue_;
+			std::atomic<bool> stop_;
+			std::atomic<bool> started_;
+			Affinity affinity_;
+			std::mutex mutex_;
+			std::mutex start_mutex_;
+			std::condition_variable cv_;
+
+			static const Workers*& current_()
+			{
+				static thread_local const Workers* w = 0;
+				return w;
+			}
+			static int& index_()
+			{
+				static thread_local int i = 0;
+				return i;
+			}
+			// the threads are started by the first loop that needs them
+			void start_()
+			{
+				if (started_)
+					return;
+				std::lock_guard<std::mutex> lock(start_mutex_);
+				if (started_ || stop_)
+					return;
+				for (int t = 0; t < size(); t++)
+					threads_.push_back(std::thread(&Workers::work_, this, t));
+				started_ = true;
+			}
+			// own queue last in first out, other queues first in first out
+			bool pop_(int w, Task& task)
+			{
+				int n = size();
+				for (int k = 0; k < n; k++) {
+					Queue& q = *queues_[(w + k) % n];
+					std::lock_guard<std::mutex> lock(q.mutex);
+					if (q.tasks.empty())
+						continue;
+					if (k == 0) {
+						task = q.tasks.back();
+						q.tasks.pop_back();
+					}
+					else {
+						task = q.tasks.front();
+						q.tasks.pop_front();
+					}
+					pending_--;
+					return true;
+				}
+				return false;
+			}
+			void work_(int w)
+			{
+				current_() = this;
+				index_() = w;
+				// the calling thread takes the first place
+				place_(w + 1, affinity_);
+				for (;;) {
+					Task task;
+					if (pop_(w, task)) {
+						task();
+						continue;
+					}
+					std::unique_lock<std::mutex> lock(mutex_);
+					cv_.wait(lock, [this]() { return stop_ || pending_ > 0; });
+					if (stop_ && pending_ <= 0)
+						return;
+				}
+			}
+		};
+
+		std::atomic<int> size_;
+		std::atomic<Affinity> affinity_;
+		std::shared_ptr<Workers> sptr_workers_;
+		std::mutex mutex_;
+
+		ThreadPool() : size_(default_size_()), affinity_(default_affinity_())
+		{
+			sptr_workers_.reset(new Workers(size_ - 1, affinity_));
+#ifdef __linux__
+			pthread_atfork(atfork_prepare_, atfork_parent_, atfork_child_);
+#endif
+		}
+
+		// mutex_ is held over fork, so that the child gets consistent state
+		static void atfork_prepare_()
+		{
+			instance().mutex_.lock();
+		}
+		static void atfork_parent_()
+		{
+			instance().mutex_.unlock();
+		}
+		// the threads of the workers do not exist in the child, and the
+		// workers cannot be stopped without them: they are abandoned
+		static void atfork_child_()
+		{
+			ThreadPool& pool = instance();
+			new std::shared_ptr<Workers>(pool.sptr_workers_);
+			pool.sptr_workers_.reset(new Workers(pool.size_ - 1, pool.affinity_));
+			pool.mutex_.unlock();
+		}
+
+		std::shared_ptr<Workers> workers_()
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			return sptr_workers_;
+		}
+		void configure_(int n, Affinity affinity)
+		{
+			if (n < 1)
+				n = default_size_();
+			std::shared_ptr<Workers> sptr_old;
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				if (sptr_workers_->owns_current_thread())
+					throw std::logic_error
+					("thread pool cannot be configured from its own threads");
+				if (n == size_ && affinity == affinity_)
+					return;
+				sptr_old = sptr_workers_;
+				sptr_workers_.reset(new Workers(n - 1, affinity));
+				size_ = n;
+				affinity_ = affinity;
+			}
+			sptr_old->stop();
+		}
+
+		static int default_size_()
+		{
+			const char* s = getenv("SIRF_NUM_THREADS");
+			if (!s || atoi(s) < 1)
+				s = getenv("OMP_NUM_THREADS");
+			int n = s ? atoi(s) : 0;
+			if (n < 1)
+				n = (int)std::thread::hardware_concurrency();
+			return std::max(1, n);
+		}
+		static Affinity default_affinity_()
+		{
+			const char* s = getenv("SIRF_THREAD_AFFINITY");
+			try {
+				return s ? affinity(s) : NONE;
+			}
+			catch (...) {
+				return NONE;
+			}
+		}
+
+		// parses processor lists like 0-3,8-11
+		static std::vector<int> parse_cpus_(const std::string& list)
+		{
+			std::vector<int> cpus;
+			std::istringstream in(list);
+			std::string range;
+			while (std::getline(in, range, ',')) {
+				size_t dash = range.find('-');
+				int first = atoi(range.c_str());
+				int last = dash == std::string::npos ?
+					first : atoi(range.c_str() + dash + 1);
+				for (int c = first; c <= last; c++)
+					cpus.push_back(c);
+			}
+			return cpus;
+		}
+		static std::vector<std::vector<int> > read_numa_nodes_()
+		{
+			std::vector<std::vector<int> > nodes;
+			for (int k = 0;; k++) {
+				std::ostringstream name;
+				name << "/sys/devices/system/node/node" << k << "/cpulist";
+				std::ifstream in(name.str().c_str());
+				std::string list;
+				if (!in || !std::getline(in, list))
+					break;
+				std::vector<int> cpus = parse_cpus_(list);
+				if (!cpus.empty())
+					nodes.push_back(cpus);
+			}
+			if (nodes.empty()) {
+				int n = std::max(1, (int)std::thread::hardware_concurrency());
+				nodes.push_back(std::vector<int>());
+				for (int c = 0; c < n; c++)
+					nodes[0].push_back(c);
+			}
+			return nodes;
+		}
+		// the processor of the thread in the t-th place
+		static int cpu_(int t, Affinity affinity)
+		{
+			const std::vector<std::vector<int> >& nodes = numa_nodes();
+			std::vector<int> order;
+			if (affinity == COMPACT)
+				for (size_t k = 0; k < nodes.size(); k++)
+					order.insert(order.end(), nodes[k].begin(), nodes[k].end());
+			else {
+				size_t m = 0;
+				for (size_t k = 0; k < nodes.size(); k++)
+					m = std::max(m, nodes[k].size());
+				for (size_t i = 0; i < m; i++)
+					for (size_t k = 0; k < nodes.size(); k++)
+						if (i < nodes[k].size())
+							order.push_back(nodes[k][i]);
+			}
+			return order[t % order.size()];
+		}
+		static void place_(int t, Affinity affinity)
+		{
+			if (affinity == NONE)
+				return;
+#ifdef __linux__
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(cpu_(t, affinity), &set);
+			pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+		}
+	};
+
+	// runs f(0), ..., f(n - 1) on the shared thread pool
+	template<class F>
+	void
+	parallel_for(int n, int nthreads, F f)
+	{
+		ThreadPool::instance().parallel_for(n, nthreads, f);
+	}
+
+	/*
+	Runs f(0), ..., f(n - 1) concurrently on dedicated threads, for tasks
+	that block (e.g. waiting for a server) and would hold up the pool.
+	*/
+	template<class F>
+	void
+	run_concurrently(int n, F f)
+	{
+		std::exception_ptr error;
+		std::mutex error_mutex;
+		std::vector<std::thread> threads;
+		for (int t = 1; t < n; t++)
+			threads.push_back(std::thread([&, t]() {
+				try {
+					f(t);
+				}
+				catch (...) {
+					std::lock_guard<std::mutex> lock(error_mutex);
+					if (!error)
+						error = std::current_exception();
+				}
+			}));
+		try {
+			if (n > 0)
+				f(0);
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lock(error_mutex);
+			if (!error)
+				error = std::current_exception();
+		}
+		for (size_t t = 0; t < threads.size(); t++)
+			threads[t].join();
+		if (error)
+			std::rethrow_exception(error);
+	}
+
+}
+
+#endif
@@ -0,0 +1,69 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup Common
+\brief Failure reporting shared by the C++ test executables.
+
+Each executable checks conditions with SIRFTest::check() and returns
+SIRFTest::report() from main(), i.e. 0 if all checks passed, 1 otherwise.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#ifndef SIRF_TEST
+#define SIRF_TEST
+
+#include <iostream>
+#include <string>
+
+namespace SIRFTest {
+
+	inline int& failed()
+	{
+		static int n = 0;
+		return n;
+	}
+
+	// reports and counts the failure if ok is false
+	inline void check(bool ok, const std::string& what)
+	{
+		if (!ok) {
+			std::cout << "+++ failed: " << what << '\n';
+			failed()++;
+		}
+	}
+
+	// prints the summary of the checks of the named tests
+	inline int report(const char* name)
+	{
+		if (failed()) {
+			std::cout << failed() << ' ' << name << " tests failed\n";
+			return 1;
+		}
+		std::cout << "all " << name << " tests passed\n";
+		return 0;
+	}
+
+}
+
+#endif
@@ -0,0 +1,92 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup Common
+\brief Tests of the radix sort of packed keys against std::stable_sort.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "SIRF/common/multisort.h"
+#include "sirf_test.h"
+
+// the radix sort gives the same permutation as a stable comparison sort
+static void
+check_sort(const std::vector<uint64_t>& keys, int nthreads, const char* what)
+{
+	int n = (int)keys.size();
+	std::vector<int> expected(n);
+	std::iota(expected.begin(), expected.end(), 0);
+	std::stable_sort(expected.begin(), expected.end(),
+		[&keys](int i, int j) { return keys[i] < keys[j]; });
+	std::vector<int> index(n + 1, -1);
+	Multisort::sort(keys, &index[0], nthreads);
+	bool ok = std::equal(expected.begin(), expected.end(), index.begin())
+		&& index[n] == -1;
+	SIRFTest::check(ok, std::string(what) + " (" + std::to_string(n) +
+		" keys, " + std::to_string(nthreads) + " threads)");
+}
+
+int main()
+{
+	sirf::ThreadPool::set_num_threads(4);
+	std::mt19937_64 gen(2017);
+	int sizes[] = { 0, 1, 100, 4095, 4096, 100000, 300001 };
+	int threads[] = { 1, 2, 4, 7 };
+	for (int n : sizes) {
+		std::vector<uint64_t> random(n);
+		std::vector<uint64_t> few(n);
+		std::vector<uint64_t> packed(n);
+		std::vector<uint64_t> equal(n, 0x8000000000000001ULL);
+		for (int i = 0; i < n; i++) {
+			random[i] = gen();
+			// many ties, so that stability matters
+			few[i] = gen() % 13;
+			// (repetition, position, slice) as packed by MRImageData::order,
+			// the middle digits varying, the others constant
+			uint32_t z = (uint32_t)(int)(gen() % 200 - 100) ^ 0x80000000u;
+			packed[i] = ((uint64_t)3 << 48) | ((uint64_t)z << 16) |
+				(uint64_t)(gen() % 4);
+		}
+		std::vector<uint64_t> sorted(random);
+		std::sort(sorted.begin(), sorted.end());
+		std::vector<uint64_t> reversed(sorted.rbegin(), sorted.rend());
+		for (int t : threads) {
+			check_sort(random, t, "random keys");
+			check_sort(few, t, "keys with many ties");
+			check_sort(packed, t, "packed keys");
+			check_sort(equal, t, "equal keys");
+			check_sort(sorted, t, "sorted keys");
+			check_sort(reversed, t, "reversed keys");
+		}
+	}
+	return SIRFTest::report("multisort");
+}
@@ -0,0 +1,216 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup Common
+\brief Tests of the SIRF thread pool: coverage of the loop indices, nested
+loops, exceptions, reconfiguration and (on Linux) loops in forked children.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "SIRF/common/thread_pool.h"
+#include "sirf_test.h"
+
+using namespace sirf;
+using SIRFTest::check;
+
+// every index is visited exactly once
+static bool
+covers(int n, int nthreads)
+{
+	std::vector<std::atomic<int> > calls(n);
+	for (int i = 0; i < n; i++)
+		calls[i] = 0;
+	parallel_for(n, nthreads, [&](int i) { calls[i]++; });
+	for (int i = 0; i < n; i++)
+		if (calls[i] != 1)
+			return false;
+	return true;
+}
+
+static void
+test_coverage()
+{
+	int sizes[] = { 0, 1, 2, 3, 7, 100, 10007 };
+	int threads[] = { 0, 1, 2, 3, 64 };
+	for (int n : sizes)
+		for (int t : threads)
+			check(covers(n, t), "each loop index visited once");
+}
+
+static void
+test_nesting()
+{
+	// three levels, each using all threads
+	std::atomic<long> sum(0);
+	parallel_for(8, 0, [&](int i) {
+		parallel_for(16, 0, [&](int j) {
+			parallel_for(32, 0, [&](int k) {
+				sum += i*16*32 + j*32 + k;
+			});
+		});
+	});
+	long n = 8*16*32;
+	check(sum == n*(n - 1)/2, "nested loops visit every index once");
+
+	// nested loops with blocking inner work
+	std::atomic<int> count(0);
+	parallel_for(ThreadPool::num_threads()*2, 0, [&](int) {
+		parallel_for(4, 0, [&](int) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			count++;
+		});
+	});
+	check(count == ThreadPool::num_threads()*8, "nested loops complete");
+}
+
+static void
+test_exceptions()
+{
+	// the exception reaches the caller, the loop is cut short
+	std::atomic<int> calls(0);
+	bool caught = false;
+	try {
+		parallel_for(100000, 0, [&](int i) {
+			calls++;
+			if (i == 17)
+				throw std::runtime_error("index 17");
+		});
+	}
+	catch (std::runtime_error& e) {
+		caught = std::string(e.what()) == "index 17";
+	}
+	check(caught, "exception rethrown in the calling thread");
+	check(calls < 100000, "calls not yet started are skipped");
+
+	// from an inner loop through the outer one
+	caught = false;
+	try {
+		parallel_for(8, 0, [&](int i) {
+			parallel_for(8, 0, [&](int j) {
+				if (i == 3 && j == 5)
+					throw std::logic_error("inner");
+			});
+		});
+	}
+	catch (std::logic_error&) {
+		caught = true;
+	}
+	check(caught, "exception of an inner loop reaches the outer caller");
+
+	// the pool is still usable
+	check(covers(1000, 0), "pool usable after exceptions");
+
+	// run_concurrently collects the exceptions of its threads
+	caught = false;
+	std::atomic<int> done(0);
+	try {
+		run_concurrently(4, [&](int t) {
+			if (t == 2)
+				throw std::runtime_error("thread 2");
+			done++;
+		});
+	}
+	catch (std::runtime_error&) {
+		caught = true;
+	}
+	check(caught && done == 3, "run_concurrently rethrows after joining");
+}
+
+static void
+test_configure()
+{
+	ThreadPool::set_num_threads(3);
+	check(ThreadPool::num_threads() == 3, "set_num_threads");
+	check(covers(1000, 0), "loops after resizing");
+	ThreadPool::configure(5, ThreadPool::SCATTER);
+	check(ThreadPool::num_threads() == 5 &&
+		ThreadPool::affinity() == ThreadPool::SCATTER, "configure");
+	check(covers(1000, 0), "loops after reconfiguring");
+	ThreadPool::configure(4, ThreadPool::NONE);
+
+	// the pool cannot be configured from its own threads
+	std::thread::id caller = std::this_thread::get_id();
+	std::atomic<int> tried(0);
+	std::atomic<int> refused(0);
+	parallel_for(16, 4, [&](int) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		if (std::this_thread::get_id() == caller)
+			return;
+		tried++;
+		try {
+			ThreadPool::set_num_threads(2);
+		}
+		catch (std::logic_error&) {
+			refused++;
+		}
+	});
+	check(tried > 0 && refused == tried && ThreadPool::num_threads() == 4,
+		"configuring from a pool thread is refused");
+}
+
+static void
+test_fork()
+{
+#ifdef __linux__
+	// the parent's pool threads have been started by the tests above
+	pid_t pid = fork();
+	if (pid == 0) {
+		bool ok = covers(1000, 0);
+		std::atomic<int> sum(0);
+		parallel_for(4, 0, [&](int i) {
+			parallel_for(4, 0, [&](int j) { sum += i*4 + j; });
+		});
+		_exit(ok && sum == 120 ? 0 : 1);
+	}
+	int status = 1;
+	check(pid > 0 && waitpid(pid, &status, 0) == pid &&
+		WIFEXITED(status) && WEXITSTATUS(status) == 0,
+		"loops in a forked child");
+	check(covers(1000, 0), "loops in the parent after fork");
+#endif
+}
+
+int main()
+{
+	ThreadPool::set_num_threads(4);
+	test_coverage();
+	test_nesting();
+	test_exceptions();
+	test_configure();
+	test_fork();
+	return SIRFTest::report("thread pool");
+}
@@ -31,6 +31,9 @@ limitations under the License.
 #define DATA_HANDLE_TYPES
 
 #include <stdlib.h>
+#include <string.h>
+#include <mutex>
+#include <new>
 #include <string>
 
 #include "localised_exception.h"
@@ -40,24 +43,82 @@ limitations under the License.
 #define THROW(msg) throw LocalisedException(msg, __FILE__, __LINE__)
 #define CATCH \
 	catch (LocalisedException& se) {\
-		ExecutionStatus status(se);\
 		DataHandle* handle = new DataHandle;\
-		handle->set(0, &status);\
+		handle->set_status(se.what(), se.file(), se.line());\
 		return (void*)handle;\
 				}\
 	catch (std::string msg) {\
-		ExecutionStatus status(msg.c_str(), __FILE__, __LINE__);\
 		DataHandle* handle = new DataHandle;\
-		handle->set(0, &status);\
+		handle->set_status(msg.c_str(), __FILE__, __LINE__);\
 		return (void*)handle;\
         }\
 	catch (...) {\
-		ExecutionStatus status("unhandled", __FILE__, __LINE__);\
 		DataHandle* handle = new DataHandle;\
-		handle->set(0, &status);\
+		handle->set_status("unhandled", __FILE__, __LINE__);\
 		return (void*)handle;\
 				}\
 
+/*!
+\ingroup C Interface to C++ Objects
+\brief Pool of memory blocks for DataHandle objects.
+
+Every C interface call returns a new handle that the wrapper deletes soon
+after, so handles are allocated from free lists of fixed size blocks rather
+than by the system allocator. Blocks are taken from the system in chunks
+that are never returned to it, hence a block may safely go to the free list
+of another library linking its own copy of the pool. Objects larger than
+a block are allocated by the system allocator.
+*/
+class HandlePool {
+public:
+	enum { BLOCK_SIZE = 64, CHUNK_BLOCKS = 256 };
+	static void* allocate(size_t size)
+	{
+		if (size > BLOCK_SIZE)
+			return ::operator new(size);
+		std::lock_guard<std::mutex> lock(mutex_());
+		Block*& head = free_();
+		if (!head) {
+			char* chunk = (char*)::operator new(BLOCK_SIZE*CHUNK_BLOCKS);
+			for (int i = 0; i < CHUNK_BLOCKS; i++) {
+				Block* b = (Block*)(chunk + i*BLOCK_SIZE);
+				b->next = head;
+				head = b;
+			}
+		}
+		Block* b = head;
+		head = b->next;
+		return (void*)b;
+	}
+	static void release(void* ptr, size_t size)
+	{
+		if (!ptr)
+			return;
+		if (size > BLOCK_SIZE) {
+			::operator delete(ptr);
+			return;
+		}
+		std::lock_guard<std::mutex> lock(mutex_());
+		Block* b = (Block*)ptr;
+		b->next = free_();
+		free_() = b;
+	}
+private:
+	struct Block {
+		Block* next;
+	};
+	static std::mutex& mutex_()
+	{
+		static std::mutex m;
+		return m;
+	}
+	static Block*& free_()
+	{
+		static Block* head = 0;
+		return head;
+	}
+};
+
 /*!
 \ingroup C Interface to C++ Objects
 \brief Execution status type.
@@ -116,16 +177,30 @@ A DataHandle object stores data address (void* _data) and the current
 execution status (ExecutionStatus _status).
 SIRF C interface functions work with pointers to DataHandle objects
 cast to void*.
+DataHandle objects and the objects of derived types are allocated from
+HandlePool, and scalar data is stored in the handle itself (see
+setDataHandle below).
+The shared handle returned by okHandle() is never deleted nor modified.
 */
 class DataHandle {
 public:
-	DataHandle() : _data(0), _status(0), _owns_data(0) {}
+	DataHandle() : _owns_data(0), _data(0), _status(0), _shared(0) {}
 	virtual ~DataHandle() {
 		if (_data && _owns_data)
 			free(_data);
 		delete _status;
 	}
+	static void* operator new(size_t size)
+	{
+		return HandlePool::allocate(size);
+	}
+	static void operator delete(void* ptr, size_t size)
+	{
+		HandlePool::release(ptr, size);
+	}
 	void set(void* data, const ExecutionStatus* status = 0, int grab = 0) {
+		if (_shared)
+			THROW("shared handle cannot be modified");
 		if (status) {
 			delete _status;
 			_status = new ExecutionStatus(*status);
@@ -137,18 +212,70 @@ public:
 	}
 	void set_status(const char* error, const char* file, int line)
 	{
+		if (_shared)
+			THROW("shared handle cannot be modified");
 		if (_status)
 			delete _status;
 		_status = new ExecutionStatus(error, file, line);
 	}
+	// stores a copy of x in the handle if it fits there
+	template<typename T>
+	bool set_local(T x)
+	{
+		if (sizeof(T) > sizeof(_local))
+			return false;
+		set(0);
+		memcpy((void*)&_local, (const void*)&x, sizeof(T));
+		_data = (void*)&_local;
+		return true;
+	}
 	void* data() const { return _data; }
 	const ExecutionStatus* status() const { return _status; }
+	bool shared() const { return _shared; }
 protected:
 	bool _owns_data; // can free _data
 	void* _data; // data address
 	ExecutionStatus* _status; // execution status
+private:
+	bool _shared; // the shared handle returned by okHandle()
+	union {
+		double d;
+		void* p;
+	} _local; // storage for scalar data
+	friend void* okHandle();
 };
 
+/*!
+\ingroup C Interface to C++ Objects
+\brief The shared handle returned by calls that succeed and return no data.
+
+Neither modified nor deleted by deleteDataHandle, hence such calls allocate
+nothing.
+*/
+inline void*
+okHandle()
+{
+	static DataHandle* handle = 0;
+	static std::once_flag done;
+	std::call_once(done, []() {
+		handle = new DataHandle;
+		handle->_shared = true;
+	});
+	return (void*)handle;
+}
+
+/*!
+\ingroup C Interface to C++ Objects
+\brief Deletes a handle unless it is the shared one.
+*/
+inline void
+deleteHandle(void* ptr)
+{
+	DataHandle* handle = (DataHandle*)ptr;
+	if (handle && !handle->shared())
+		delete handle;
+}
+
 #define GRAB 1
 
 /*!
@@ -156,13 +283,15 @@ protected:
 \brief Data wrapper.
 
 Wraps an object of type T into DataHandle.
-The data is owned by the DataHandle object and hence will be deleted by its 
-destructor.
+Scalars are stored in the DataHandle object itself, other data is owned by it
+and hence will be deleted by its destructor.
 */
 template <typename T>
 void
 setDataHandle(DataHandle* h, T x)
 {
+	if (h->set_local<T>(x))
+		return;
 	T* ptr = (T*)malloc(sizeof(T));
 	*ptr = x;
 	h->set((void*)ptr, 0, GRAB);
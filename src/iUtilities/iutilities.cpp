@@ -41,8 +41,7 @@ extern "C" {
 	}
 	void deleteDataHandle(void* ptr) // C destructor
 	{
-		if (ptr)
-			delete (DataHandle*)ptr;
+		deleteHandle(ptr);
 	}
 
 	void* charDataHandle(const char* s) 
@@ -159,4 +158,9 @@ extern "C" {
 		else
 			return 0;
 	}
+
+	// lets Matlab pass handles to MEX gateways, which take them as numbers
+	size_t handleAddress(const void* ptr) {
+		return (size_t)ptr;
+	}
 }
@@ -20,6 +20,8 @@ limitations under the License.
 #ifndef INTERFACE_UTILITIES
 #define INTERFACE_UTILITIES
 
+#include <stddef.h>
+
 #ifndef IUTILITIES_FOR_MATLAB
 extern "C" {
 #endif
@@ -46,6 +48,7 @@ extern "C" {
 	const char* executionError(const void* ptr);
 	const char* executionErrorFile(const void* ptr);
 	int executionErrorLine(const void* ptr);
+	size_t handleAddress(const void* ptr);
 #ifndef IUTILITIES_FOR_MATLAB
 }
 #endif
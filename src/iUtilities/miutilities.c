@@ -97,6 +97,9 @@ EXPORTED_FUNCTION 	const char* mExecutionErrorFile(const void* ptr) {
 EXPORTED_FUNCTION 	int mExecutionErrorLine(const void* ptr) {
 	return executionErrorLine(ptr);
 }
+EXPORTED_FUNCTION 	size_t mHandleAddress(const void* ptr) {
+	return handleAddress(ptr);
+}
 #ifndef IUTILITIES_FOR_MATLAB
 }
 #endif
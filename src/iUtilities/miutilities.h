@@ -18,6 +18,7 @@ limitations under the License.
 #define IUTILITIES_TO_MATLAB_INTERFACE
 
 #define IUTILITIES_FOR_MATLAB
+#include <stddef.h>
 #ifdef _WIN32
 #define EXPORTED_FUNCTION __declspec(dllexport)
 #else
@@ -50,6 +51,7 @@ EXPORTED_FUNCTION 	int mExecutionStatus(const void* ptr);
 EXPORTED_FUNCTION 	const char* mExecutionError(const void* ptr);
 EXPORTED_FUNCTION 	const char* mExecutionErrorFile(const void* ptr);
 EXPORTED_FUNCTION 	int mExecutionErrorLine(const void* ptr);
+EXPORTED_FUNCTION 	size_t mHandleAddress(const void* ptr);
 #ifndef IUTILITIES_FOR_MATLAB
 }
 #endif
@@ -0,0 +1,123 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup C Interface to C++ Objects
+\brief Table of numeric parameters set by integer ids.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#ifndef PARAMETER_TABLE_TYPES
+#define PARAMETER_TABLE_TYPES
+
+#include <ctype.h>
+#include <string>
+#include <vector>
+
+#include "data_handle.h"
+
+#define PARAMETER_INT 0
+#define PARAMETER_FLOAT 1
+
+/*!
+\ingroup C Interface to C++ Objects
+\brief Signature of the C interface functions setting parameters of a class.
+*/
+typedef void* (*ParameterSetter)(void* hs, const char* name, const void* hv);
+
+/*!
+\ingroup C Interface to C++ Objects
+\brief Numeric parameters indexed by integer ids.
+
+A numeric parameter is registered once by the setter of its class, its name
+and its type (PARAMETER_INT or PARAMETER_FLOAT), and is given an id.
+Setting it by the id calls the class setter directly with the value wrapped
+in a DataHandle on the stack, so that neither the class name is matched
+nor a DataHandle for the value is allocated.
+Ids are resolved at the first use by the wrappers, which are not expected
+to resolve them from several threads at once.
+*/
+class ParameterTable {
+public:
+	int id(ParameterSetter setter, const char* name, int type)
+	{
+		if (type != PARAMETER_INT && type != PARAMETER_FLOAT)
+			THROW("unknown parameter type");
+		for (size_t i = 0; i < entries_.size(); i++) {
+			const Entry& e = entries_[i];
+			if (e.setter == setter && e.type == type && same_(e.name, name))
+				return (int)i;
+		}
+		Entry e;
+		e.setter = setter;
+		e.name = name;
+		e.type = type;
+		entries_.push_back(e);
+		return (int)entries_.size() - 1;
+	}
+	// returns the handle returned by the class setter
+	void* set(void* hs, int id, double value) const
+	{
+		if (id < 0 || id >= (int)entries_.size())
+			THROW("unknown parameter id");
+		const Entry& e = entries_[id];
+		DataHandle hv;
+		int i = (int)value;
+		float f = (float)value;
+		if (e.type == PARAMETER_INT)
+			hv.set((void*)&i);
+		else
+			hv.set((void*)&f);
+		return e.setter(hs, e.name.c_str(), (const void*)&hv);
+	}
+	// sets n parameters, stopping at the first one that fails
+	void* set(void* hs, int n, const int* ids, const double* values) const
+	{
+		for (int k = 0; k < n; k++) {
+			void* h = set(hs, ids[k], values[k]);
+			const ExecutionStatus* status = ((DataHandle*)h)->status();
+			if (status)
+				return h;
+			deleteHandle(h);
+		}
+		return okHandle();
+	}
+private:
+	struct Entry {
+		ParameterSetter setter;
+		std::string name;
+		int type;
+	};
+	std::vector<Entry> entries_;
+
+	static bool same_(const std::string& s, const char* t)
+	{
+		size_t n = s.size();
+		for (size_t i = 0; i < n; i++, t++)
+			if (!*t || tolower((unsigned char)s[i]) != tolower((unsigned char)*t))
+				return false;
+		return *t == 0;
+	}
+};
+
+#endif
@@ -34,10 +34,15 @@ using boost::asio::ip::tcp;
 #include <ismrmrd/ismrmrd.h>
 #include <ismrmrd/dataset.h>
 
+#include "SIRF/common/data_expression.h"
+#include "SIRF/common/profiler.h"
+#include "SIRF/common/thread_pool.h"
 #include "cgadgetron_shared_ptr.h"
 #include "data_handle.h"
+#include "parameter_table.h"
 #include "gadgetron_data_containers.h"
 #include "gadgetron_client.h"
+#include "ismrmrd_hdf5.h"
 //#include "iutilities.h" // causes problems with Matlab (cf. the same message below)
 #include "cgadgetron_p.h"
 #include "gadgetron_x.h"
@@ -94,6 +99,45 @@ fileNotFound(const char* name, const char* file, int line)
 	return (void*)handle;
 }
 
+extern "C" void*
+cGT_setAcquisitionModelParameter(void* ptr_am, const char* name, const void* ptr);
+extern "C" void*
+cGT_setSolverParameter(void* ptr_s, const char* name, const void* ptr);
+
+static ParameterSetter
+parameter_setter_(const char* obj)
+{
+	if (boost::iequals(obj, "coil_sensitivity"))
+		return cGT_setCSParameter;
+	if (boost::iequals(obj, "coil_compression"))
+		return cGT_setCoilCompressionParameter;
+	if (boost::iequals(obj, "gadget_chain"))
+		return cGT_setGadgetChainParameter;
+	if (boost::iequals(obj, "acquisitions"))
+		return cGT_setAcquisitionsParameter;
+	if (boost::iequals(obj, "acquisition_model"))
+		return cGT_setAcquisitionModelParameter;
+	if (boost::iequals(obj, "solver"))
+		return cGT_setSolverParameter;
+	if (boost::iequals(obj, "storage_budget"))
+		return cGT_setStorageBudgetParameter;
+	if (boost::iequals(obj, "result_cache"))
+		return cGT_setResultCacheParameter;
+	return 0;
+}
+
+// numeric parameters set by ids
+static ParameterTable parameter_table_;
+
+// solvers are handled via their base class
+template<class Solver>
+void*
+cGT_newSolver()
+{
+	shared_ptr<aSolver<complex_float_t> > sptr(new Solver);
+	return newObjectHandle(sptr);
+}
+
 extern "C"
 void* cGT_newObject(const char* name)
 {
@@ -104,8 +148,16 @@ void* cGT_newObject(const char* name)
 			return newObjectHandle<GTConnector>();
 		if (boost::iequals(name, "CoilImages"))
 			return newObjectHandle<CoilImagesVector>();
+		if (boost::iequals(name, "CoilCompression"))
+			return newObjectHandle<MRCoilCompression>();
 		if (boost::iequals(name, "AcquisitionModel"))
 			return newObjectHandle<MRAcquisitionModel>();
+		if (boost::iequals(name, "CGLS"))
+			return cGT_newSolver<CGLS<complex_float_t> >();
+		if (boost::iequals(name, "SteepestDescent"))
+			return cGT_newSolver<SteepestDescent<complex_float_t> >();
+		if (boost::iequals(name, "PDHG"))
+			return cGT_newSolver<PDHG<complex_float_t> >();
 		NEW_GADGET_CHAIN(GadgetChain);
 		NEW_GADGET_CHAIN(AcquisitionsProcessor);
 		NEW_GADGET_CHAIN(ImagesReconstructor);
@@ -151,6 +203,14 @@ cGT_parameter(void* ptr, const char* obj, const char* name)
 			return cGT_acquisitionParameter(ptr, name);
 		if (boost::iequals(obj, "acquisitions"))
 			return cGT_acquisitionsParameter(ptr, name);
+		if (boost::iequals(obj, "coil_compression"))
+			return cGT_coilCompressionParameter(ptr, name);
+		if (boost::iequals(obj, "solver"))
+			return cGT_solverParameter(ptr, name);
+		if (boost::iequals(obj, "storage_budget"))
+			return cGT_storageBudgetParameter(name);
+		if (boost::iequals(obj, "result_cache"))
+			return cGT_resultCacheParameter(name);
 		if (boost::iequals(obj, "gadget_chain")) {
 			GadgetChain& gc = objectFromHandle<GadgetChain>(ptr);
 			shared_ptr<aGadget> sptr = gc.gadget_sptr(name);
@@ -181,9 +241,45 @@ void*
 cGT_setParameter(void* ptr, const char* obj, const char* par, const void* val)
 {
 	try {
-		if (boost::iequals(obj, "coil_sensitivity"))
-			return cGT_setCSParameter(ptr, par, val);
-		return unknownObject("object", obj, __FILE__, __LINE__);
+		ParameterSetter setter = parameter_setter_(obj);
+		if (!setter)
+			return unknownObject("object", obj, __FILE__, __LINE__);
+		return setter(ptr, par, val);
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_parameterId(const char* obj, const char* name, int type)
+{
+	try {
+		ParameterSetter setter = parameter_setter_(obj);
+		if (!setter)
+			return unknownObject("object", obj, __FILE__, __LINE__);
+		return dataHandle<int>(parameter_table_.id(setter, name, type));
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_setParameterById(void* ptr, int id, double value)
+{
+	try {
+		return parameter_table_.set(ptr, id, value);
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_setParameters(void* ptr, int n, size_t ptr_ids, size_t ptr_values)
+{
+	try {
+		const int* ids = (const int*)ptr_ids;
+		const double* values = (const double*)ptr_values;
+		return parameter_table_.set(ptr, n, ids, values);
 	}
 	CATCH;
 }
@@ -217,6 +313,166 @@ cGT_setCSParameter(void* ptr, const char* par, const void* val)
 	if (boost::iequals(par, "smoothness"))
 		csms.set_csm_smoothness(dataFromHandle<int>(val));
 	//csms.set_csm_smoothness(intDataFromHandle(val)); // causes problems with Matlab
+	else if (boost::iequals(par, "num_threads"))
+		csms.set_num_threads(dataFromHandle<int>(val));
+	else
+		return unknownObject("parameter", par, __FILE__, __LINE__);
+	return new DataHandle;
+}
+
+extern "C"
+void*
+cGT_setCoilCompressionParameter(void* ptr, const char* par, const void* val)
+{
+	CAST_PTR(DataHandle, h_cc, ptr);
+	MRCoilCompression& cc = objectFromHandle<MRCoilCompression>(h_cc);
+	if (boost::iequals(par, "num_virtual_coils"))
+		cc.set_num_virtual_coils(dataFromHandle<int>(val));
+	else if (boost::iequals(par, "energy_threshold"))
+		cc.set_energy_threshold(dataFromHandle<float>(val));
+	else
+		return unknownObject("parameter", par, __FILE__, __LINE__);
+	return new DataHandle;
+}
+
+extern "C"
+void*
+cGT_coilCompressionParameter(void* ptr, const char* name)
+{
+	try {
+		CAST_PTR(DataHandle, h_cc, ptr);
+		MRCoilCompression& cc = objectFromHandle<MRCoilCompression>(h_cc);
+		if (boost::iequals(name, "num_coils"))
+			return dataHandle(cc.num_coils());
+		if (boost::iequals(name, "num_virtual_coils"))
+			return dataHandle(cc.num_virtual_coils());
+		if (boost::iequals(name, "energy_threshold"))
+			return dataHandle(cc.energy_threshold());
+		return parameterNotFound(name, __FILE__, __LINE__);
+	}
+	CATCH;
+}
+
+// storage budget parameters are global: ptr is not used
+extern "C"
+void*
+cGT_setStorageBudgetParameter(void* ptr, const char* par, const void* val)
+{
+	if (boost::iequals(par, "limit")) {
+		int mb = dataFromHandle<int>(val);
+		StorageBudget::set_limit(mb > 0 ? (size_t)mb << 20 : 0);
+	}
+	else if (boost::iequals(par, "scratch_directory"))
+		StorageBudget::set_scratch_directory
+		(charDataFromDataHandle((const DataHandle*)val));
+	else
+		return unknownObject("parameter", par, __FILE__, __LINE__);
+	return new DataHandle;
+}
+
+extern "C"
+void*
+cGT_storageBudgetParameter(const char* name)
+{
+	try {
+		if (boost::iequals(name, "limit"))
+			return dataHandle<int>((int)(StorageBudget::limit() >> 20));
+		if (boost::iequals(name, "scratch_directory"))
+			return charDataHandleFromCharData
+				(StorageBudget::scratch_directory().c_str());
+		if (boost::iequals(name, "resident_bytes"))
+			return dataHandle<double>((double)StorageBudget::resident_bytes());
+		if (boost::iequals(name, "spilled_bytes"))
+			return dataHandle<double>((double)StorageBudget::spilled_bytes());
+		return parameterNotFound(name, __FILE__, __LINE__);
+	}
+	CATCH;
+}
+
+// result cache parameters are global: ptr is not used
+extern "C"
+void*
+cGT_setResultCacheParameter(void* ptr, const char* par, const void* val)
+{
+	if (boost::iequals(par, "enabled"))
+		GadgetronResultCache::set_enabled(dataFromHandle<int>(val) != 0);
+	else if (boost::iequals(par, "directory"))
+		GadgetronResultCache::set_directory
+		(charDataFromDataHandle((const DataHandle*)val));
+	else if (boost::iequals(par, "limit")) {
+		int mb = dataFromHandle<int>(val);
+		GadgetronResultCache::set_limit(mb > 0 ? (size_t)mb << 20 : 0);
+	}
+	else if (boost::iequals(par, "clear"))
+		GadgetronResultCache::clear();
+	else
+		return unknownObject("parameter", par, __FILE__, __LINE__);
+	return new DataHandle;
+}
+
+extern "C"
+void*
+cGT_resultCacheParameter(const char* name)
+{
+	try {
+		if (boost::iequals(name, "enabled"))
+			return dataHandle<int>(GadgetronResultCache::enabled());
+		if (boost::iequals(name, "directory"))
+			return charDataHandleFromCharData
+				(GadgetronResultCache::directory().c_str());
+		if (boost::iequals(name, "limit"))
+			return dataHandle<int>((int)(GadgetronResultCache::limit() >> 20));
+		return parameterNotFound(name, __FILE__, __LINE__);
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_setGadgetChainParameter(void* ptr, const char* par, const void* val)
+{
+	CAST_PTR(DataHandle, h_gc, ptr);
+	GadgetChain& gc = objectFromHandle<GadgetChain>(h_gc);
+	GadgetronConnectionOptions& options = gc.connection_options();
+	int value = dataFromHandle<int>(val);
+	if (boost::iequals(par, "send_buffer_size"))
+		options.send_buffer_size = value > 0 ? value : 0;
+	else if (boost::iequals(par, "tcp_nodelay"))
+		options.tcp_nodelay = value != 0;
+	else if (boost::iequals(par, "socket_send_buffer_size"))
+		options.socket_send_buffer_size = value;
+	else if (boost::iequals(par, "socket_receive_buffer_size"))
+		options.socket_receive_buffer_size = value;
+	else if (boost::iequals(par, "warm_sessions"))
+		options.warm_sessions = value != 0;
+	else if (boost::iequals(par, "deferred_probing"))
+		options.deferred_probing = value != 0;
+	else if (boost::iequals(par, "prefetch_depth"))
+		gc.set_prefetch_depth(value > 0 ? value : 0);
+	else if (boost::iequals(par, "local_processing"))
+		gc.set_local_processing(value != 0);
+	else
+		return unknownObject("parameter", par, __FILE__, __LINE__);
+	return new DataHandle;
+}
+
+extern "C"
+void*
+cGT_setAcquisitionsParameter(void* ptr, const char* par, const void* val)
+{
+	CAST_PTR(DataHandle, h_acqs, ptr);
+	MRAcquisitionData& acqs = objectFromHandle<MRAcquisitionData>(h_acqs);
+	// acquisitions kept in memory are not affected by these
+	AcquisitionsFile* ptr_af = dynamic_cast<AcquisitionsFile*>(&acqs);
+	int value = dataFromHandle<int>(val);
+	if (boost::iequals(par, "read_only")) {
+		if (ptr_af)
+			ptr_af->set_read_only(value != 0);
+	}
+	else if (boost::iequals(par, "cache_size")) {
+		if (ptr_af)
+			ptr_af->set_cache_size(value > 0 ? (size_t)value << 20 : 0);
+	}
 	else
 		return unknownObject("parameter", par, __FILE__, __LINE__);
 	return new DataHandle;
@@ -234,7 +490,7 @@ cGT_computeCoilImages(void* ptr_cis, void* ptr_acqs)
 		MRAcquisitionData& acqs =
 			objectFromHandle<MRAcquisitionData>(h_acqs);
 		cis.compute(acqs);
-		return (void*)new DataHandle;
+		return okHandle();
 	}
 	CATCH;
 }
@@ -251,7 +507,7 @@ cGT_computeCSMsFromCIs(void* ptr_csms, void* ptr_cis)
 		CoilImagesContainer& cis =
 			objectFromHandle<CoilImagesContainer>(h_cis);
 		csms.compute(cis);
-		return (void*)new DataHandle;
+		return okHandle();
 	}
 	CATCH;
 }
@@ -268,7 +524,55 @@ cGT_computeCoilSensitivities(void* ptr_csms, void* ptr_acqs)
 		MRAcquisitionData& acqs =
 			objectFromHandle<MRAcquisitionData>(h_acqs);
 		csms.compute(acqs);
-		return (void*)new DataHandle;
+		return okHandle();
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_computeCoilCompression(void* ptr_cc, void* ptr_acqs)
+{
+	try {
+		CAST_PTR(DataHandle, h_cc, ptr_cc);
+		CAST_PTR(DataHandle, h_acqs, ptr_acqs);
+		MRCoilCompression& cc = objectFromHandle<MRCoilCompression>(h_cc);
+		MRAcquisitionData& acqs =
+			objectFromHandle<MRAcquisitionData>(h_acqs);
+		cc.compute(acqs);
+		return okHandle();
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_compressAcquisitions(void* ptr_cc, void* ptr_acqs)
+{
+	try {
+		CAST_PTR(DataHandle, h_cc, ptr_cc);
+		CAST_PTR(DataHandle, h_acqs, ptr_acqs);
+		MRCoilCompression& cc = objectFromHandle<MRCoilCompression>(h_cc);
+		MRAcquisitionData& acqs =
+			objectFromHandle<MRAcquisitionData>(h_acqs);
+		shared_ptr<MRAcquisitionData> sptr_ac = cc.compress(acqs);
+		return newObjectHandle<MRAcquisitionData>(sptr_ac);
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_compressCoilSensitivities(void* ptr_cc, void* ptr_csms)
+{
+	try {
+		CAST_PTR(DataHandle, h_cc, ptr_cc);
+		CAST_PTR(DataHandle, h_csms, ptr_csms);
+		MRCoilCompression& cc = objectFromHandle<MRCoilCompression>(h_cc);
+		CoilSensitivitiesContainer& csms =
+			objectFromHandle<CoilSensitivitiesContainer>(h_csms);
+		shared_ptr<CoilSensitivitiesContainer> sptr_cc = cc.compress(csms);
+		return newObjectHandle<CoilSensitivitiesContainer>(sptr_cc);
 	}
 	CATCH;
 }
@@ -285,7 +589,7 @@ cGT_appendCSM
 		CoilSensitivitiesContainer& list =
 			objectFromHandle<CoilSensitivitiesContainer>(h_csms);
 		list.append_csm(nx, ny, nz, nc, re, im);
-		return (void*)new DataHandle;
+		return okHandle();
 	}
 	CATCH;
 }
@@ -356,7 +660,7 @@ cGT_setUpAcquisitionModel
 		shared_ptr<MRImageData> sptr_imgs =
 			objectSptrFromHandle<MRImageData>(h_imgs);
 		am.set_up(sptr_acqs, sptr_imgs);
-		return (void*)new DataHandle;
+		return okHandle();
 	}
 	CATCH;
 }
@@ -389,9 +693,164 @@ cGT_setAcquisitionModelParameter
 				objectSptrFromHandle<CoilSensitivitiesContainer>(handle);
 			am.setCSMs(sptr);
 		}
+		else if (boost::iequals(name, "fft_threads")) {
+			MRAcquisitionModel& am = objectFromHandle<MRAcquisitionModel>(h_am);
+			am.set_fft_threads(dataFromHandle<int>(ptr));
+		}
+		else if (boost::iequals(name, "num_threads")) {
+			MRAcquisitionModel& am = objectFromHandle<MRAcquisitionModel>(h_am);
+			am.set_num_threads(dataFromHandle<int>(ptr));
+		}
+		else if (boost::iequals(name, "resident")) {
+			MRAcquisitionModel& am = objectFromHandle<MRAcquisitionModel>(h_am);
+			am.set_resident(dataFromHandle<int>(ptr) != 0);
+		}
+		else if (boost::iequals(name, "density_compensation")) {
+			MRAcquisitionModel& am = objectFromHandle<MRAcquisitionModel>(h_am);
+			am.set_density_compensation(dataFromHandle<int>(ptr) != 0);
+		}
+		else
+			return unknownObject("parameter", name, __FILE__, __LINE__);
+		return okHandle();
+	}
+	CATCH;
+}
+
+// the least squares objective of a steepest descent solver, created on the
+// first setting of its acquisition model or data
+static LeastSquaresObjective<complex_float_t>&
+least_squares_(SteepestDescent<complex_float_t>& sd)
+{
+	shared_ptr<aObjective<complex_float_t> > sptr_obj = sd.objective();
+	LeastSquaresObjective<complex_float_t>* ls =
+		dynamic_cast<LeastSquaresObjective<complex_float_t>*>(sptr_obj.get());
+	if (ls)
+		return *ls;
+	shared_ptr<LeastSquaresObjective<complex_float_t> >
+		sptr_ls(new LeastSquaresObjective<complex_float_t>);
+	sd.set_objective(sptr_ls);
+	return *sptr_ls;
+}
+
+extern "C"
+void*
+cGT_setSolverParameter(void* ptr_s, const char* name, const void* ptr)
+{
+	try {
+		CAST_PTR(DataHandle, h_s, ptr_s);
+		aSolver<complex_float_t>& solver =
+			objectFromHandle<aSolver<complex_float_t> >(h_s);
+		CGLS<complex_float_t>* cgls =
+			dynamic_cast<CGLS<complex_float_t>*>(&solver);
+		SteepestDescent<complex_float_t>* sd =
+			dynamic_cast<SteepestDescent<complex_float_t>*>(&solver);
+		PDHG<complex_float_t>* pdhg =
+			dynamic_cast<PDHG<complex_float_t>*>(&solver);
+		if (boost::iequals(name, "initial_estimate")) {
+			CAST_PTR(DataHandle, handle, ptr);
+			solver.set_initial_estimate(objectFromHandle<MRImageData>(handle));
+		}
+		else if (boost::iequals(name, "acquisition_model")) {
+			CAST_PTR(DataHandle, handle, ptr);
+			shared_ptr<aLinearOperator<complex_float_t> > sptr_op
+				(new MRAcquisitionModelOperator
+				(objectSptrFromHandle<MRAcquisitionModel>(handle)));
+			if (cgls)
+				cgls->set_operator(sptr_op);
+			else if (pdhg)
+				pdhg->set_operator(sptr_op);
+			else
+				least_squares_(*sd).set_operator(sptr_op);
+		}
+		else if (boost::iequals(name, "acquisition_data")) {
+			CAST_PTR(DataHandle, handle, ptr);
+			MRAcquisitionData& ac = objectFromHandle<MRAcquisitionData>(handle);
+			if (cgls)
+				cgls->set_data(ac);
+			else if (pdhg)
+				pdhg->set_data(ac);
+			else
+				least_squares_(*sd).set_data(ac);
+		}
+		else if (sd && boost::iequals(name, "step_size"))
+			sd->set_step_size(dataFromHandle<float>(ptr));
+		else if (pdhg && boost::iequals(name, "sigma"))
+			pdhg->set_sigma(dataFromHandle<float>(ptr));
+		else if (pdhg && boost::iequals(name, "tau"))
+			pdhg->set_tau(dataFromHandle<float>(ptr));
 		else
 			return unknownObject("parameter", name, __FILE__, __LINE__);
-		return (void*)new DataHandle;
+		return okHandle();
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_solverParameter(void* ptr_s, const char* name)
+{
+	try {
+		CAST_PTR(DataHandle, h_s, ptr_s);
+		aSolver<complex_float_t>& solver =
+			objectFromHandle<aSolver<complex_float_t> >(h_s);
+		CGLS<complex_float_t>* cgls =
+			dynamic_cast<CGLS<complex_float_t>*>(&solver);
+		SteepestDescent<complex_float_t>* sd =
+			dynamic_cast<SteepestDescent<complex_float_t>*>(&solver);
+		PDHG<complex_float_t>* pdhg =
+			dynamic_cast<PDHG<complex_float_t>*>(&solver);
+		if (boost::iequals(name, "current_estimate")) {
+			MRImageData& x = (MRImageData&)solver.current_estimate();
+			shared_ptr<MRImageData> sptr = x.new_images_container();
+			sptr->axpby(complex_float_t(1), x, complex_float_t(0), x);
+			return newObjectHandle(sptr);
+		}
+		if (boost::iequals(name, "iteration"))
+			return dataHandle<int>(solver.iteration());
+		if (cgls && boost::iequals(name, "residual_norm"))
+			return dataHandle<float>(cgls->residual_norm());
+		if (sd && boost::iequals(name, "step_size"))
+			return dataHandle<float>(sd->last_step());
+		if (pdhg && boost::iequals(name, "sigma"))
+			return dataHandle<float>(pdhg->sigma());
+		if (pdhg && boost::iequals(name, "tau"))
+			return dataHandle<float>(pdhg->tau());
+		return parameterNotFound(name, __FILE__, __LINE__);
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_runSolver(void* ptr_s, int n_iter)
+{
+	try {
+		CAST_PTR(DataHandle, h_s, ptr_s);
+		aSolver<complex_float_t>& solver =
+			objectFromHandle<aSolver<complex_float_t> >(h_s);
+		// the solvers report errors via standard exceptions
+		try {
+			solver.run(n_iter);
+		}
+		catch (LocalisedException&) {
+			throw;
+		}
+		catch (std::exception& e) {
+			throw LocalisedException(e.what(), __FILE__, __LINE__);
+		}
+		return okHandle();
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_setFFTPlanning(const char* mode, const char* wisdom)
+{
+	try {
+		if (ISMRMRD::fft_set_planning(mode, wisdom))
+			return unknownObject("FFT planning mode", mode, __FILE__, __LINE__);
+		return okHandle();
 	}
 	CATCH;
 }
@@ -407,7 +866,7 @@ cGT_setCSMs(void* ptr_am, const void* ptr_csms)
 		shared_ptr<CoilSensitivitiesContainer> sptr_csms =
 			objectSptrFromHandle<CoilSensitivitiesContainer>(h_csms);
 		am.setCSMs(sptr_csms);
-		return (void*)new DataHandle;
+		return okHandle();
 	}
 	CATCH;
 }
@@ -450,9 +909,13 @@ cGT_setAcquisitionsStorageScheme(const char* scheme)
 	try{
 		if (scheme[0] == 'f' || strcmp(scheme, "default") == 0)
 			AcquisitionsFile::set_as_template();
+		else if (scheme[0] == 'b')
+			AcquisitionsBlock::set_as_template();
+		else if (scheme[0] == 'h')
+			AcquisitionsHybrid::set_as_template();
 		else
 			AcquisitionsVector::set_as_template();
-		return (void*)new DataHandle;
+		return okHandle();
 	}
 	CATCH;
 }
@@ -465,6 +928,29 @@ cGT_getAcquisitionsStorageScheme()
 		(MRAcquisitionData::storage_scheme().c_str());
 }
 
+extern "C"
+void*
+cGT_setISMRMRDCompression(int level)
+{
+	try {
+		ISMRMRDWriter::set_default_compression(level);
+		return okHandle();
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_setAcquisitionsCacheSize(int megabytes)
+{
+	try {
+		AcquisitionsFile::set_default_cache_size
+			(megabytes > 0 ? (size_t)megabytes << 20 : 0);
+		return okHandle();
+	}
+	CATCH;
+}
+
 extern "C"
 void*
 cGT_orderAcquisitions(void* ptr_acqs)
@@ -474,7 +960,21 @@ cGT_orderAcquisitions(void* ptr_acqs)
 		MRAcquisitionData& acqs =
 			objectFromHandle<MRAcquisitionData>(h_acqs);
 		acqs.order();
-		return (void*)new DataHandle;
+		return okHandle();
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_compactAcquisitions(void* ptr_acqs)
+{
+	try {
+		CAST_PTR(DataHandle, h_acqs, ptr_acqs);
+		MRAcquisitionData& acqs =
+			objectFromHandle<MRAcquisitionData>(h_acqs);
+		acqs.compact();
+		return okHandle();
 	}
 	CATCH;
 }
@@ -717,6 +1217,13 @@ cGT_acquisitionsParameter(void* ptr_acqs, const char* name)
 			objectFromHandle<MRAcquisitionData>(h_acqs);
 		if (boost::iequals(name, "undersampled"))
 			return dataHandle((int)acqs.undersampled());
+		AcquisitionsFile* ptr_af = dynamic_cast<AcquisitionsFile*>(&acqs);
+		if (boost::iequals(name, "read_only"))
+			return dataHandle((int)(ptr_af && ptr_af->read_only()));
+		if (boost::iequals(name, "cache_hits"))
+			return dataHandle(ptr_af ? (int)ptr_af->cache_hits() : 0);
+		if (boost::iequals(name, "cache_misses"))
+			return dataHandle(ptr_af ? (int)ptr_af->cache_misses() : 0);
 		return parameterNotFound(name, __FILE__, __LINE__);
 	}
 	CATCH;
@@ -825,6 +1332,21 @@ cGT_readImages(const char* file)
 	CATCH;
 }
 
+extern "C"
+void*
+cGT_imagesVolume(void* ptr_imgs)
+{
+	try {
+		CAST_PTR(DataHandle, h_imgs, ptr_imgs);
+		MRImageData& images = objectFromHandle<MRImageData>(h_imgs);
+		// the images are copied in sorted order
+		shared_ptr<MRImageData> sptr_img(new ImagesVolume(images));
+		sptr_img->set_ordered(images.ordered());
+		return newObjectHandle<MRImageData>(sptr_img);
+	}
+	CATCH;
+}
+
 extern "C"
 void*
 cGT_processImages(void* ptr_proc, void* ptr_input)
@@ -842,6 +1364,167 @@ cGT_processImages(void* ptr_proc, void* ptr_input)
 
 }
 
+extern "C"
+void*
+cGT_reconstructImagesAsync(void* ptr_recon, void* ptr_input)
+{
+	try {
+		shared_ptr<ImagesReconstructor>& sptr_recon =
+			objectSptrFromHandle<ImagesReconstructor>(ptr_recon);
+		shared_ptr<MRAcquisitionData>& sptr_input =
+			objectSptrFromHandle<MRAcquisitionData>(ptr_input);
+		return newObjectHandle<GadgetronJob>
+			(GadgetronJob::start(sptr_recon, sptr_input));
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_processAcquisitionsAsync(void* ptr_proc, void* ptr_input)
+{
+	try {
+		shared_ptr<AcquisitionsProcessor>& sptr_proc =
+			objectSptrFromHandle<AcquisitionsProcessor>(ptr_proc);
+		shared_ptr<MRAcquisitionData>& sptr_input =
+			objectSptrFromHandle<MRAcquisitionData>(ptr_input);
+		return newObjectHandle<GadgetronJob>
+			(GadgetronJob::start(sptr_proc, sptr_input));
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_processImagesAsync(void* ptr_proc, void* ptr_input)
+{
+	try {
+		shared_ptr<ImagesProcessor>& sptr_proc =
+			objectSptrFromHandle<ImagesProcessor>(ptr_proc);
+		shared_ptr<MRImageData>& sptr_input =
+			objectSptrFromHandle<MRImageData>(ptr_input);
+		return newObjectHandle<GadgetronJob>
+			(GadgetronJob::start(sptr_proc, sptr_input));
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_jobDone(void* ptr_job)
+{
+	try {
+		GadgetronJob& job = objectFromHandle<GadgetronJob>(ptr_job);
+		return dataHandle<int>(job.done());
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_waitForJob(void* ptr_job)
+{
+	try {
+		GadgetronJob& job = objectFromHandle<GadgetronJob>(ptr_job);
+		job.wait();
+		if (job.images().get())
+			return newObjectHandle<MRImageData>(job.images());
+		return newObjectHandle<MRAcquisitionData>(job.acquisitions());
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_cancelJob(void* ptr_job)
+{
+	try {
+		GadgetronJob& job = objectFromHandle<GadgetronJob>(ptr_job);
+		job.cancel();
+		return okHandle();
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_startStream(void* ptr_recon, void* ptr_acqs, int capacity)
+{
+	try {
+		shared_ptr<ImagesReconstructor>& sptr_recon =
+			objectSptrFromHandle<ImagesReconstructor>(ptr_recon);
+		MRAcquisitionData& acqs = objectFromHandle<MRAcquisitionData>(ptr_acqs);
+		return newObjectHandle<GadgetronStream>(GadgetronStream::start
+			(sptr_recon, acqs.acquisitions_info(), capacity));
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_feedStream(void* ptr_stream, void* ptr_acqs, int first)
+{
+	try {
+		GadgetronStream& stream = objectFromHandle<GadgetronStream>(ptr_stream);
+		MRAcquisitionData& acqs = objectFromHandle<MRAcquisitionData>(ptr_acqs);
+		return dataHandle<int>((int)stream.feed(acqs, first));
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_finishStream(void* ptr_stream)
+{
+	try {
+		GadgetronStream& stream = objectFromHandle<GadgetronStream>(ptr_stream);
+		stream.finish();
+		return okHandle();
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_streamedImage(void* ptr_stream, int timeout_ms)
+{
+	try {
+		GadgetronStream& stream = objectFromHandle<GadgetronStream>(ptr_stream);
+		// empty if no image has arrived in time
+		shared_ptr<MRImageData> sptr_img(new ImagesVector);
+		shared_ptr<ImageWrap> sptr_iw = stream.next_image(timeout_ms);
+		if (sptr_iw.get()) {
+			sptr_img->append(*sptr_iw);
+			sptr_img->count(sptr_iw->head().image_index);
+		}
+		return newObjectHandle<MRImageData>(sptr_img);
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_streamDone(void* ptr_stream)
+{
+	try {
+		GadgetronStream& stream = objectFromHandle<GadgetronStream>(ptr_stream);
+		return dataHandle<int>(stream.done());
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_cancelStream(void* ptr_stream)
+{
+	try {
+		GadgetronStream& stream = objectFromHandle<GadgetronStream>(ptr_stream);
+		stream.cancel();
+		return okHandle();
+	}
+	CATCH;
+}
+
 extern "C"
 void*
 cGT_selectImages(void* ptr_input, const char* attr, const char* target)
@@ -866,7 +1549,7 @@ cGT_writeImages(void* ptr_imgs, const char* out_file, const char* out_group)
 	}
 	CATCH;
 
-	return (void*)new DataHandle;
+	return okHandle();
 }
 
 extern "C"
@@ -875,7 +1558,8 @@ cGT_imageWrapFromContainer(void* ptr_imgs, unsigned int img_num)
 {
 	CAST_PTR(DataHandle, h_imgs, ptr_imgs);
 	MRImageData& images = objectFromHandle<MRImageData>(h_imgs);
-	return newObjectHandle<ImageWrap>(images.sptr_image_wrap(img_num));
+	// the image data may be modified via a view
+	return newObjectHandle<ImageWrap>(images.sptr_writable_image_wrap(img_num));
 }
 
 extern "C"
@@ -907,6 +1591,24 @@ cGT_getImageDataAsFloatArray(void* ptr_img, size_t ptr_data)
 	image.get_data(data);
 }
 
+extern "C"
+void*
+cGT_getImageDataView(void* ptr_img, size_t ptr_view)
+{
+	try {
+		size_t* view = (size_t*)ptr_view;
+		ImageWrap& image = objectFromHandle<ImageWrap>(ptr_img);
+		int dim[4];
+		image.get_dim(dim);
+		view[0] = (size_t)image.data_ptr();
+		view[1] = image.type();
+		for (int i = 0; i < 4; i++)
+			view[i + 2] = dim[i];
+		return okHandle();
+	}
+	CATCH;
+}
+
 extern "C"
 void
 cGT_getImageDataAsComplexArray(void* ptr_img, size_t ptr_re, size_t ptr_im)
@@ -962,7 +1664,7 @@ cGT_setComplexImagesData(void* ptr_imgs, size_t ptr_re, size_t ptr_im)
 		list.set_complex_images_data(re, im);
 	}
 	CATCH;
-	return (void*)new DataHandle;
+	return okHandle();
 }
 
 extern "C"
@@ -1042,6 +1744,78 @@ float br, float bi, const void* ptr_y
 	CATCH;
 }
 
+extern "C"
+void*
+cGT_axpbyAndNorm(
+float ar, float ai, const void* ptr_x,
+float br, float bi, const void* ptr_y,
+size_t ptr_norm
+){
+	try {
+		CAST_PTR(DataHandle, h_x, ptr_x);
+		CAST_PTR(DataHandle, h_y, ptr_y);
+		aDataContainer<complex_float_t>& x = 
+			objectFromHandle<aDataContainer<complex_float_t> >(h_x);
+		aDataContainer<complex_float_t>& y = 
+			objectFromHandle<aDataContainer<complex_float_t> >(h_y);
+		float* norm = (float*)ptr_norm;
+		shared_ptr<aDataContainer<complex_float_t> > 
+			sptr_z(x.new_data_container());
+		complex_float_t a(ar, ai);
+		complex_float_t b(br, bi);
+		*norm = sptr_z->axpby_norm(a, x, b, y);
+		return newObjectHandle<aDataContainer<complex_float_t> >(sptr_z);
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_axpbyAndDot(
+float ar, float ai, const void* ptr_x,
+float br, float bi, const void* ptr_y,
+const void* ptr_z, size_t ptr_dot
+){
+	try {
+		CAST_PTR(DataHandle, h_x, ptr_x);
+		CAST_PTR(DataHandle, h_y, ptr_y);
+		CAST_PTR(DataHandle, h_z, ptr_z);
+		aDataContainer<complex_float_t>& x = 
+			objectFromHandle<aDataContainer<complex_float_t> >(h_x);
+		aDataContainer<complex_float_t>& y = 
+			objectFromHandle<aDataContainer<complex_float_t> >(h_y);
+		aDataContainer<complex_float_t>& z = 
+			objectFromHandle<aDataContainer<complex_float_t> >(h_z);
+		float* dot = (float*)ptr_dot;
+		shared_ptr<aDataContainer<complex_float_t> > 
+			sptr_w(x.new_data_container());
+		complex_float_t a(ar, ai);
+		complex_float_t b(br, bi);
+		complex_float_t d = sptr_w->axpby_dot(a, x, b, y, z);
+		dot[0] = d.real();
+		dot[1] = d.imag();
+		return newObjectHandle<aDataContainer<complex_float_t> >(sptr_w);
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_xapy(void* ptr_y, float ar, float ai, const void* ptr_x)
+{
+	try {
+		CAST_PTR(DataHandle, h_y, ptr_y);
+		CAST_PTR(DataHandle, h_x, ptr_x);
+		aDataContainer<complex_float_t>& y = 
+			objectFromHandle<aDataContainer<complex_float_t> >(h_y);
+		aDataContainer<complex_float_t>& x = 
+			objectFromHandle<aDataContainer<complex_float_t> >(h_x);
+		y.xapy(complex_float_t(ar, ai), x);
+		return okHandle();
+	}
+	CATCH;
+}
+
 extern "C"
 void*
 cGT_multiply(const void* ptr_x, const void* ptr_y)
@@ -1080,6 +1854,81 @@ cGT_divide(const void* ptr_x, const void* ptr_y)
 	CATCH;
 }
 
+typedef DataContainerExpression<complex_float_t> Expression;
+
+extern "C"
+void*
+cGT_expression(float ar, float ai, const void* ptr_x)
+{
+	try {
+		CAST_PTR(DataHandle, h_x, ptr_x);
+		SPTR_FROM_HANDLE(aDataContainer<complex_float_t>, sptr_x, h_x);
+		complex_float_t a(ar, ai);
+		shared_ptr<Expression> sptr_e(new Expression(a, sptr_x));
+		return newObjectHandle<Expression>(sptr_e);
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_expressionAxpby(
+float ar, float ai, const void* ptr_e,
+float br, float bi, const void* ptr_f
+){
+	try {
+		CAST_PTR(DataHandle, h_e, ptr_e);
+		CAST_PTR(DataHandle, h_f, ptr_f);
+		Expression& e = objectFromHandle<Expression>(h_e);
+		Expression& f = objectFromHandle<Expression>(h_f);
+		complex_float_t a(ar, ai);
+		complex_float_t b(br, bi);
+		shared_ptr<Expression> sptr_g(new Expression(a, e, b, f));
+		return newObjectHandle<Expression>(sptr_g);
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_evaluateExpression(const void* ptr_e)
+{
+	try {
+		CAST_PTR(DataHandle, h_e, ptr_e);
+		Expression& e = objectFromHandle<Expression>(h_e);
+		shared_ptr<aDataContainer<complex_float_t> > sptr_z(e.evaluate());
+		return newObjectHandle<aDataContainer<complex_float_t> >(sptr_z);
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_expressionDot(const void* ptr_e, const void* ptr_y)
+{
+	try {
+		CAST_PTR(DataHandle, h_e, ptr_e);
+		CAST_PTR(DataHandle, h_y, ptr_y);
+		Expression& e = objectFromHandle<Expression>(h_e);
+		aDataContainer<complex_float_t>& y =
+			objectFromHandle<aDataContainer<complex_float_t> >(h_y);
+		return dataHandle(e.dot(y));
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_expressionNorm(const void* ptr_e)
+{
+	try {
+		CAST_PTR(DataHandle, h_e, ptr_e);
+		Expression& e = objectFromHandle<Expression>(h_e);
+		return dataHandle(e.norm());
+	}
+	CATCH;
+}
+
 extern "C"
 void*
 cGT_setConnectionTimeout(void* ptr_con, unsigned int timeout_ms)
@@ -1092,7 +1941,7 @@ cGT_setConnectionTimeout(void* ptr_con, unsigned int timeout_ms)
 	}
 	CATCH;
 
-	return (void*)new DataHandle;
+	return okHandle();
 }
 
 extern "C"
@@ -1108,7 +1957,7 @@ cGT_addReader(void* ptr_gc, const char* id, const void* ptr_r)
 	}
 	CATCH;
 
-	return (void*)new DataHandle;
+	return okHandle();
 }
 
 extern "C"
@@ -1124,7 +1973,7 @@ cGT_addWriter(void* ptr_gc, const char* id, const void* ptr_w)
 	}
 	CATCH;
 
-	return (void*)new DataHandle;
+	return okHandle();
 }
 
 extern "C"
@@ -1140,7 +1989,21 @@ cGT_addGadget(void* ptr_gc, const char* id, const void* ptr_g)
 	}
 	CATCH;
 
-	return (void*)new DataHandle;
+	return okHandle();
+}
+
+extern "C"
+void*
+cGT_addServer(void* ptr_gc, const char* host, const char* port)
+{
+	try {
+		CAST_PTR(DataHandle, h_gc, ptr_gc);
+		GadgetChain& gc = objectFromHandle<GadgetChain>(h_gc);
+		gc.add_server(host, port);
+	}
+	CATCH;
+
+	return okHandle();
 }
 
 extern "C"
@@ -1155,7 +2018,7 @@ cGT_setGadgetProperty(void* ptr_g, const char* prop, const char* value)
 	}
 	CATCH;
 
-	return (void*)new DataHandle;
+	return okHandle();
 }
 
 extern "C"
@@ -1196,7 +2059,7 @@ cGT_setGadgetProperties(void* ptr_g, const char* props)
 	}
 	CATCH;
 
-	return (void*)new DataHandle;
+	return okHandle();
 }
 
 extern "C"
@@ -1215,7 +2078,7 @@ cGT_configGadgetChain(void* ptr_con, void* ptr_gc)
 	}
 	CATCH;
 
-	return (void*)new DataHandle;
+	return okHandle();
 }
 
 extern "C"
@@ -1235,7 +2098,7 @@ cGT_registerImagesReceiver(void* ptr_con, void* ptr_img)
 	}
 	CATCH;
 
-	return (void*)new DataHandle;
+	return okHandle();
 }
 
 extern "C"
@@ -1250,7 +2113,7 @@ cGT_connect(void* ptr_con, const char* host, const char* port)
 	}
 	CATCH;
 
-	return (void*)new DataHandle;
+	return okHandle();
 }
 
 extern "C"
@@ -1265,7 +2128,7 @@ cGT_sendConfigScript(void* ptr_con, const char* config)
 	}
 	CATCH;
 
-	return (void*)new DataHandle;
+	return okHandle();
 }
 
 extern "C"
@@ -1280,7 +2143,7 @@ cGT_sendConfigFile(void* ptr_con, const char* file)
 	}
 	CATCH;
 
-	return (void*)new DataHandle;
+	return okHandle();
 }
 
 extern "C"
@@ -1298,7 +2161,7 @@ cGT_sendParameters(void* ptr_con, const void* ptr_par)
 	}
 	CATCH;
 
-	return (void*)new DataHandle;
+	return okHandle();
 }
 
 extern "C"
@@ -1313,7 +2176,7 @@ cGT_sendParametersString(void* ptr_con, const char* par)
 	}
 	CATCH;
 
-	return (void*)new DataHandle;
+	return okHandle();
 }
 
 extern "C"
@@ -1351,7 +2214,7 @@ cGT_sendAcquisitions(void* ptr_con, void* ptr_dat)
 	}
 	CATCH;
 
-	return (void*)new DataHandle;
+	return okHandle();
 }
 
 extern "C"
@@ -1372,7 +2235,7 @@ cGT_sendImages(void* ptr_con, void* ptr_img)
 	}
 	CATCH;
 
-	return (void*)new DataHandle;
+	return okHandle();
 }
 
 extern "C"
@@ -1388,6 +2251,98 @@ cGT_disconnect(void* ptr_con)
 	}
 	CATCH;
 
-	return (void*)new DataHandle;
+	return okHandle();
 }
 
+
+extern "C"
+void*
+cGT_profiler(const char* format)
+{
+	try {
+		std::string s;
+		if (boost::iequals(format, "text"))
+			s = sirf::Profiler::report();
+		else if (boost::iequals(format, "json"))
+			s = sirf::Profiler::report_json();
+		else if (boost::iequals(format, "trace"))
+			s = sirf::Profiler::trace_json();
+		else
+			return unknownObject("profiler format", format, __FILE__, __LINE__);
+		return charDataHandleFromCharData(s.c_str());
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_setProfiler(int enabled, int tracing)
+{
+	try {
+		sirf::Profiler::set_enabled(enabled != 0);
+		sirf::Profiler::set_tracing(tracing != 0);
+		return okHandle();
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_resetProfiler()
+{
+	try {
+		sirf::Profiler::reset();
+		return okHandle();
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_setThreadPool(int num_threads, const char* affinity)
+{
+	try {
+		sirf::ThreadPool::Affinity a;
+		if (boost::iequals(affinity, "none"))
+			a = sirf::ThreadPool::NONE;
+		else if (boost::iequals(affinity, "compact"))
+			a = sirf::ThreadPool::COMPACT;
+		else if (boost::iequals(affinity, "scatter"))
+			a = sirf::ThreadPool::SCATTER;
+		else
+			return unknownObject("thread affinity", affinity, __FILE__, __LINE__);
+		sirf::ThreadPool::configure(num_threads, a);
+		return okHandle();
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cGT_threadPoolSize()
+{
+	try {
+		return dataHandle<int>(sirf::ThreadPool::num_threads());
+	}
+	CATCH;
+}
+
+/*
+Pays the one-off costs of the first use of the module and leaves no
+background sessions or heartbeats behind, so that worker processes can be
+forked afterwards; the thread pool threads are started on demand in each
+process.
+*/
+extern "C"
+void*
+cGT_warmUp()
+{
+	try {
+		AcquisitionsFile::init();
+		xGadgetronKernels::vectorised();
+		sirf::ThreadPool::numa_nodes();
+		GadgetronSessionPool::instance().clear();
+		return okHandle();
+	}
+	CATCH;
+}
@@ -35,6 +35,10 @@ extern "C" {
 	void* cGT_parameter(void* ptr, const char* obj, const char* name);
 	void* cGT_setParameter
 		(void* ptr, const char* obj, const char* par, const void* val);
+	void* cGT_parameterId(const char* obj, const char* name, int type);
+	void* cGT_setParameterById(void* ptr, int id, double value);
+	void* cGT_setParameters
+		(void* ptr, int n, PTR_INT ptr_ids, PTR_DOUBLE ptr_values);
 
 	// coil data methods
 	void*	cGT_computeCoilImages(void* ptr_cis, void* ptr_acqs);
@@ -50,6 +54,11 @@ extern "C" {
 		(void* ptr_csms, int csm_num, PTR_FLOAT ptr_re, PTR_FLOAT ptr_im);
 	void cGT_getCoilDataAbs(void* ptr_csms, int csm_num, PTR_FLOAT ptr);
 
+	// coil compression methods
+	void* cGT_computeCoilCompression(void* ptr_cc, void* ptr_acqs);
+	void* cGT_compressAcquisitions(void* ptr_cc, void* ptr_acqs);
+	void* cGT_compressCoilSensitivities(void* ptr_cc, void* ptr_csms);
+
 	// acquisition model methods
 	void* cGT_AcquisitionModel(const void* ptr_acqs, const void* ptr_imgs);
 	void* cGT_setUpAcquisitionModel
@@ -57,18 +66,22 @@ extern "C" {
 	void* cGT_setAcquisitionModelParameter
 		(void* ptr_am, const char* name, const void* ptr);
 	void* cGT_setCSMs(void* ptr_am, const void* ptr_csms);
+	void* cGT_setFFTPlanning(const char* mode, const char* wisdom);
 	void* cGT_AcquisitionModelForward(void* ptr_am, const void* ptr_imgs);
 	void* cGT_AcquisitionModelBackward(void* ptr_am, const void* ptr_acqs);
 
 	// acquisition data methods
 	void* cGT_setAcquisitionsStorageScheme(const char* scheme);
 	void* cGT_getAcquisitionsStorageScheme();
+	void* cGT_setAcquisitionsCacheSize(int megabytes);
+	void* cGT_setISMRMRDCompression(int level);
 	void* cGT_ISMRMRDAcquisitionsFromFile(const char* file);
 	void* cGT_ISMRMRDAcquisitionsFile(const char* file);
 	void* cGT_processAcquisitions(void* ptr_proc, void* ptr_input);
 	void* cGT_acquisitionFromContainer(void* ptr_acqs, unsigned int acq_num);
 	void* cGT_cloneAcquisitions(void* ptr_input);
 	void* cGT_orderAcquisitions(void* ptr_acqs);
+	void* cGT_compactAcquisitions(void* ptr_acqs);
 	void* cGT_getAcquisitionsDimensions(void* ptr_acqs, PTR_INT ptr_dim);
 	void* cGT_getAcquisitionsFlags
 		(void* ptr_acqs, unsigned int n, PTR_INT ptr_f);
@@ -83,6 +96,7 @@ extern "C" {
 	void* cGT_reconstructImages(void* ptr_recon, void* ptr_input);
 	void* cGT_reconstructedImages(void* ptr_recon);
 	void*	cGT_readImages(const char* file);
+	void* cGT_imagesVolume(void* ptr_imgs);
 	void* cGT_processImages(void* ptr_proc, void* ptr_input);
 	void* cGT_selectImages
 		(void* ptr_input, const char* attr, const char* target);
@@ -93,6 +107,7 @@ extern "C" {
 	void cGT_getImageDim(void* ptr_img, PTR_INT ptr_dim);
 	void* cGT_imageType(const void* ptr_img);
 	void cGT_getImageDataAsFloatArray(void* ptr_img, PTR_FLOAT ptr_data);
+	void* cGT_getImageDataView(void* ptr_img, PTR_INT ptr_view);
 	void cGT_getImageDataAsComplexArray
 		(void* ptr_imgs, PTR_FLOAT ptr_re, PTR_FLOAT ptr_im);
 	void cGT_getImageDimensions(void* ptr_imgs, int img_num, PTR_INT ptr_dim);
@@ -102,6 +117,22 @@ extern "C" {
 	void* cGT_setComplexImagesData
 		(void* ptr_imgs, PTR_FLOAT ptr_re, PTR_FLOAT ptr_im);
 
+	// gadget chain jobs
+	void* cGT_reconstructImagesAsync(void* ptr_recon, void* ptr_input);
+	void* cGT_processAcquisitionsAsync(void* ptr_proc, void* ptr_input);
+	void* cGT_processImagesAsync(void* ptr_proc, void* ptr_input);
+	void* cGT_jobDone(void* ptr_job);
+	void* cGT_waitForJob(void* ptr_job);
+	void* cGT_cancelJob(void* ptr_job);
+
+	// streaming reconstruction
+	void* cGT_startStream(void* ptr_recon, void* ptr_acqs, int capacity);
+	void* cGT_feedStream(void* ptr_stream, void* ptr_acqs, int first);
+	void* cGT_finishStream(void* ptr_stream);
+	void* cGT_streamedImage(void* ptr_stream, int timeout_ms);
+	void* cGT_streamDone(void* ptr_stream);
+	void* cGT_cancelStream(void* ptr_stream);
+
 	// Data container methods
 	void* cGT_dataItems(const void* ptr_x);
 	void* cGT_norm(const void* ptr_x);
@@ -109,13 +140,32 @@ extern "C" {
 	void* cGT_axpby(
 		float ar, float ai, const void* ptr_x,
 		float br, float bi, const void* ptr_y);
+	void* cGT_axpbyAndNorm(
+		float ar, float ai, const void* ptr_x,
+		float br, float bi, const void* ptr_y,
+		PTR_FLOAT ptr_norm);
+	void* cGT_axpbyAndDot(
+		float ar, float ai, const void* ptr_x,
+		float br, float bi, const void* ptr_y,
+		const void* ptr_z, PTR_FLOAT ptr_dot);
+	void* cGT_xapy(void* ptr_y, float ar, float ai, const void* ptr_x);
 	void* cGT_multiply(const void* ptr_x, const void* ptr_y);
 	void* cGT_divide(const void* ptr_x, const void* ptr_y);
 
+	// Deferred data container expression methods
+	void* cGT_expression(float ar, float ai, const void* ptr_x);
+	void* cGT_expressionAxpby(
+		float ar, float ai, const void* ptr_e,
+		float br, float bi, const void* ptr_f);
+	void* cGT_evaluateExpression(const void* ptr_e);
+	void* cGT_expressionDot(const void* ptr_e, const void* ptr_y);
+	void* cGT_expressionNorm(const void* ptr_e);
+
 	// gadget chain methods
 	void* cGT_addReader(void* ptr_gc, const char* id, const void* ptr_r);
 	void* cGT_addWriter(void* ptr_gc, const char* id, const void* ptr_r);
 	void* cGT_addGadget(void* ptr_gc, const char* id, const void* ptr_r);
+	void* cGT_addServer(void* ptr_gc, const char* host, const char* port);
 	void* cGT_setGadgetProperty(void* ptr_g, const char* prop, const char* val);
 	void* cGT_setGadgetProperties(void* ptr_g, const char* props);
 	void* cGT_configGadgetChain(void* ptr_con, void* ptr_gc);
@@ -132,6 +182,21 @@ extern "C" {
 	void* cGT_sendImages(void* ptr_con, void* ptr_img);
 	void* cGT_disconnect(void* ptr_con);
 
+	// profiler methods
+	void* cGT_profiler(const char* format);
+	void* cGT_setProfiler(int enabled, int tracing);
+	void* cGT_resetProfiler();
+
+	// thread pool methods
+	void* cGT_setThreadPool(int num_threads, const char* affinity);
+	void* cGT_threadPoolSize();
+
+	// start-up methods
+	void* cGT_warmUp();
+
+	// solver methods
+	void* cGT_runSolver(void* ptr_s, int n_iter);
+
 #ifndef CGADGETRON_FOR_MATLAB
 }
 #endif
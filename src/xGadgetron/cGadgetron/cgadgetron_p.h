@@ -34,6 +34,38 @@ namespace sirf {
 
 	extern "C"
 		void* cGT_setCSParameter(void* ptr, const char* par, const void* val);
+
+	extern "C"
+		void* cGT_coilCompressionParameter(void* ptr, const char* name);
+
+	extern "C"
+		void* cGT_setCoilCompressionParameter
+		(void* ptr, const char* par, const void* val);
+
+	extern "C"
+		void* cGT_setGadgetChainParameter
+		(void* ptr, const char* par, const void* val);
+
+	extern "C"
+		void* cGT_setAcquisitionsParameter
+		(void* ptr, const char* par, const void* val);
+
+	extern "C"
+		void* cGT_solverParameter(void* ptr_s, const char* name);
+
+	extern "C"
+		void* cGT_setStorageBudgetParameter
+		(void* ptr, const char* par, const void* val);
+
+	extern "C"
+		void* cGT_storageBudgetParameter(const char* name);
+
+	extern "C"
+		void* cGT_setResultCacheParameter
+		(void* ptr, const char* par, const void* val);
+
+	extern "C"
+		void* cGT_resultCacheParameter(const char* name);
 }
 
 #endif
@@ -0,0 +1,208 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup Gadgets Library
+\brief Implementation file for the in-process versions of the standard
+       image gadgets.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#include <cmath>
+#include <cstdlib>
+
+#include "data_handle.h"
+#include "gadget_lib.h"
+#include "ismrmrd_fftw.h"
+
+using namespace gadgetron;
+using namespace sirf;
+
+#define EXTRACT_MAGNITUDE 1
+#define EXTRACT_REAL 2
+#define EXTRACT_IMAG 4
+#define EXTRACT_PHASE 8
+
+/*
+Creates an image of data type of T with the dimensions, header and
+attributes of iw and image type imtype.
+*/
+template<typename T>
+static ISMRMRD::Image<T>*
+new_image_like_(ImageWrap& iw, uint16_t imtype)
+{
+	int dim[4];
+	iw.get_dim(dim);
+	ISMRMRD::Image<T>* ptr =
+		new ISMRMRD::Image<T>(dim[0], dim[1], dim[2], dim[3]);
+	ISMRMRD::ImageHeader head = iw.head();
+	head.data_type = ptr->getDataType();
+	head.image_type = imtype;
+	ptr->setHead(head);
+	ptr->setAttributeString(iw.attributes());
+	return ptr;
+}
+
+static float
+complex_part_(complex_float_t z, uint16_t imtype)
+{
+	switch (imtype) {
+	case ISMRMRD::ISMRMRD_IMTYPE_MAGNITUDE:
+		return std::abs(z);
+	case ISMRMRD::ISMRMRD_IMTYPE_REAL:
+		return std::real(z);
+	case ISMRMRD::ISMRMRD_IMTYPE_IMAG:
+		return std::imag(z);
+	default:
+		return std::arg(z);
+	}
+}
+
+static void
+append_part_(ImageWrap& iw, uint16_t imtype,
+	std::vector<shared_ptr<ImageWrap> >& out)
+{
+	int dim[4];
+	size_t n = iw.get_dim(dim);
+	const complex_float_t* src = (const complex_float_t*)iw.data_ptr();
+	ISMRMRD::Image<float>* ptr = new_image_like_<float>(iw, imtype);
+	shared_ptr<ImageWrap> sptr_iw(new ImageWrap(ISMRMRD::ISMRMRD_FLOAT, ptr));
+	float* dst = ptr->getDataPtr();
+	for (size_t i = 0; i < n; i++)
+		dst[i] = complex_part_(src[i], imtype);
+	out.push_back(sptr_iw);
+}
+
+bool
+RemoveROOversamplingGadget::local_setup(const std::string& header)
+{
+	ISMRMRD::IsmrmrdHeader h;
+	ISMRMRD::deserialize(header.c_str(), h);
+	if (h.encoding.size() < 1)
+		return false;
+	const ISMRMRD::Encoding& e = h.encoding[0];
+	float encoded_fov = e.encodedSpace.fieldOfView_mm.x;
+	float recon_fov = e.reconSpace.fieldOfView_mm.x;
+	ratio_ = encoded_fov > recon_fov ? recon_fov / encoded_fov : 1.0f;
+	return true;
+}
+
+/*
+Transforms each readout to image space, keeps its central part and
+transforms it back, as Gadgetron's RemoveROOversamplingGadget.
+*/
+void
+RemoveROOversamplingGadget::process_locally(ISMRMRD::Acquisition& acq,
+	std::vector<ISMRMRD::Acquisition>& out) const
+{
+	unsigned int ns = acq.number_of_samples();
+	unsigned int nc = acq.active_channels();
+	unsigned int nr = (unsigned int)(ns*ratio_ + 0.5f);
+	if (ratio_ >= 1.0f || nr < 1 || nr >= ns) {
+		out.push_back(acq);
+		return;
+	}
+	unsigned int start = (ns - nr) / 2;
+	std::vector<complex_float_t> x(acq.getDataPtr(), acq.getDataPtr() + ns*nc);
+	ISMRMRD::ifft2c(&x[0], ns, 1, nc);
+	ISMRMRD::AcquisitionHeader head = acq.getHead();
+	head.number_of_samples = nr;
+	head.center_sample = (uint16_t)(head.center_sample*nr / ns);
+	out.push_back(ISMRMRD::Acquisition());
+	ISMRMRD::Acquisition& r = out.back();
+	r.setHead(head);
+	complex_float_t* dst = r.getDataPtr();
+	for (unsigned int c = 0; c < nc; c++)
+		for (unsigned int s = 0; s < nr; s++)
+			dst[c*nr + s] = x[c*ns + start + s];
+	ISMRMRD::fft2c(dst, nr, 1, nc);
+}
+
+void
+ExtractGadget::local_setup()
+{
+	mask_ = std::atoi(value_of("extract_mask").c_str());
+}
+
+void
+ExtractGadget::process_locally(ImageWrap& iw,
+	std::vector<shared_ptr<ImageWrap> >& out) const
+{
+	if (mask_ & EXTRACT_MAGNITUDE)
+		append_part_(iw, ISMRMRD::ISMRMRD_IMTYPE_MAGNITUDE, out);
+	if (mask_ & EXTRACT_REAL)
+		append_part_(iw, ISMRMRD::ISMRMRD_IMTYPE_REAL, out);
+	if (mask_ & EXTRACT_IMAG)
+		append_part_(iw, ISMRMRD::ISMRMRD_IMTYPE_IMAG, out);
+	if (mask_ & EXTRACT_PHASE)
+		append_part_(iw, ISMRMRD::ISMRMRD_IMTYPE_PHASE, out);
+}
+
+void
+ComplexToFloatGadget::process_locally(ImageWrap& iw,
+	std::vector<shared_ptr<ImageWrap> >& out) const
+{
+	uint16_t imtype = iw.head().image_type;
+	if (imtype != ISMRMRD::ISMRMRD_IMTYPE_MAGNITUDE &&
+		imtype != ISMRMRD::ISMRMRD_IMTYPE_REAL &&
+		imtype != ISMRMRD::ISMRMRD_IMTYPE_IMAG &&
+		imtype != ISMRMRD::ISMRMRD_IMTYPE_PHASE)
+		THROW("ComplexToFloatGadget: unknown image type");
+	append_part_(iw, imtype, out);
+}
+
+void
+FloatToShortGadget::local_setup()
+{
+	min_ = (float)std::atof(value_of("min_intensity").c_str());
+	max_ = (float)std::atof(value_of("max_intensity").c_str());
+	offset_ = (float)std::atof(value_of("intensity_offset").c_str());
+}
+
+void
+FloatToShortGadget::process_locally(ImageWrap& iw,
+	std::vector<shared_ptr<ImageWrap> >& out) const
+{
+	int dim[4];
+	size_t n = iw.get_dim(dim);
+	uint16_t imtype = iw.head().image_type;
+	const float* src = (const float*)iw.data_ptr();
+	ISMRMRD::Image<unsigned short>* ptr =
+		new_image_like_<unsigned short>(iw, imtype);
+	shared_ptr<ImageWrap> sptr_iw(new ImageWrap(ISMRMRD::ISMRMRD_USHORT, ptr));
+	unsigned short* dst = ptr->getDataPtr();
+	const float pi = (float)std::acos(-1.0);
+	for (size_t i = 0; i < n; i++) {
+		float v = src[i];
+		if (imtype == ISMRMRD::ISMRMRD_IMTYPE_PHASE)
+			v = v*offset_/pi + offset_;
+		else if (imtype != ISMRMRD::ISMRMRD_IMTYPE_MAGNITUDE)
+			v += offset_;
+		if (v < min_)
+			v = min_;
+		if (v > max_)
+			v = max_;
+		dst[i] = v > 0 ? (unsigned short)(v + 0.5f) : 0;
+	}
+	out.push_back(sptr_iw);
+}
@@ -32,8 +32,12 @@ limitations under the License.
 #define GADGETS_LIBRARY
 
 #include <map>
+#include <vector>
 #include <boost/algorithm/string.hpp>
 
+#include "cgadgetron_shared_ptr.h"
+#include "gadgetron_image_wrap.h"
+
 namespace sirf {
 
 	/**
@@ -95,6 +99,48 @@ namespace sirf {
 		std::map<std::string, std::string> par_;
 	};
 
+	/**
+	\brief Abstract base class for gadgets that can also be run in-process.
+
+	A gadget deriving from this class processes each image independently of
+	the others, so that ImagesProcessor can run it on an image without
+	sending the image to Gadgetron server, and on several images at once.
+	*/
+	class aLocalImageGadget {
+	public:
+		virtual ~aLocalImageGadget() {}
+		// true if images of ISMRMRD data type type can be processed
+		virtual bool local_input(int type) const = 0;
+		// ISMRMRD data type of the output images for the input type
+		virtual int local_output(int type) const = 0;
+		// reads the gadget properties, to be called before process_locally
+		virtual void local_setup() = 0;
+		// appends to out the images the gadget produces from iw;
+		// may be called concurrently after local_setup
+		virtual void process_locally(ImageWrap& iw,
+			std::vector<gadgetron::shared_ptr<ImageWrap> >& out) const = 0;
+	};
+
+	/**
+	\brief Abstract base class for acquisition gadgets that can also be run
+	in-process.
+
+	The acquisition counterpart of aLocalImageGadget, used by
+	AcquisitionsProcessor.
+	*/
+	class aLocalAcquisitionGadget {
+	public:
+		virtual ~aLocalAcquisitionGadget() {}
+		// reads the gadget properties and the ISMRMRD header of the
+		// acquisitions to be processed, returns false if the gadget
+		// cannot process them in-process
+		virtual bool local_setup(const std::string& header) = 0;
+		// appends to out the acquisitions the gadget produces from acq;
+		// may be called concurrently after local_setup
+		virtual void process_locally(ISMRMRD::Acquisition& acq,
+			std::vector<ISMRMRD::Acquisition>& out) const = 0;
+	};
+
 	/**
 	\brief Class for GadgetIsmrmrdAcquisitionMessageReader gadget xml-definition
 	generator.
@@ -219,16 +265,25 @@ namespace sirf {
 		}
 	};
 
-	class RemoveROOversamplingGadget : public Gadget {
+	// crops the readouts to the reconstruction field of view if the
+	// encoded one is larger
+	class RemoveROOversamplingGadget : public Gadget,
+		public aLocalAcquisitionGadget {
 	public:
 		RemoveROOversamplingGadget() :
 			Gadget("RemoveROOversampling", "gadgetron_mricore",
-			"RemoveROOversamplingGadget")
+			"RemoveROOversamplingGadget"), ratio_(1.0f)
 		{}
 		static const char* class_name()
 		{
 			return "RemoveROOversamplingGadget";
 		}
+		virtual bool local_setup(const std::string& header);
+		virtual void process_locally(ISMRMRD::Acquisition& acq,
+			std::vector<ISMRMRD::Acquisition>& out) const;
+	private:
+		// reconstruction to encoded field of view ratio along readout
+		float ratio_;
 	};
 
 	class AcquisitionAccumulateTriggerGadget : public Gadget {
@@ -362,10 +417,12 @@ namespace sirf {
 		}
 	};
 
-	class ExtractGadget : public Gadget {
+	// extract_mask bits: 1 magnitude, 2 real part, 4 imaginary part, 8 phase;
+	// locally, one float image is produced per bit set
+	class ExtractGadget : public Gadget, public aLocalImageGadget {
 	public:
 		ExtractGadget() :
-			Gadget("Extract", "gadgetron_mricore", "ExtractGadget")
+			Gadget("Extract", "gadgetron_mricore", "ExtractGadget"), mask_(1)
 		{
 			add_property("extract_mask", "1");
 		}
@@ -373,9 +430,23 @@ namespace sirf {
 		{
 			return "ExtractGadget";
 		}
+		virtual bool local_input(int type) const
+		{
+			return type == ISMRMRD::ISMRMRD_CXFLOAT;
+		}
+		virtual int local_output(int type) const
+		{
+			return ISMRMRD::ISMRMRD_FLOAT;
+		}
+		virtual void local_setup();
+		virtual void process_locally(ImageWrap& iw,
+			std::vector<gadgetron::shared_ptr<ImageWrap> >& out) const;
+	private:
+		int mask_;
 	};
 
-	class ComplexToFloatGadget : public Gadget {
+	// converts complex images to float ones according to their image type
+	class ComplexToFloatGadget : public Gadget, public aLocalImageGadget {
 	public:
 		ComplexToFloatGadget() :
 			Gadget("ComplexToFloatAttrib", "gadgetron_mricore", "ComplexToFloatGadget")
@@ -384,13 +455,29 @@ namespace sirf {
 		{
 			return "ComplexToFloatGadget";
 		}
+		virtual bool local_input(int type) const
+		{
+			return type == ISMRMRD::ISMRMRD_CXFLOAT;
+		}
+		virtual int local_output(int type) const
+		{
+			return ISMRMRD::ISMRMRD_FLOAT;
+		}
+		virtual void local_setup()
+		{}
+		virtual void process_locally(ImageWrap& iw,
+			std::vector<gadgetron::shared_ptr<ImageWrap> >& out) const;
 	};
 
-	class FloatToShortGadget : public Gadget {
+	// converts float images to unsigned short ones clamped to
+	// [min_intensity, max_intensity]; as by the server gadget, real and
+	// imaginary parts are shifted by intensity_offset, and phases are
+	// scaled by intensity_offset/pi before the shift
+	class FloatToShortGadget : public Gadget, public aLocalImageGadget {
 	public:
 		FloatToShortGadget() :
 			Gadget("FloatToShortAttrib", "gadgetron_mricore",
-			"FloatToShortGadget")
+			"FloatToShortGadget"), min_(0), max_(32767), offset_(0)
 		{
 			add_property("min_intensity", "0");
 			add_property("max_intensity", "32767");
@@ -400,6 +487,21 @@ namespace sirf {
 		{
 			return "FloatToShortGadget";
 		}
+		virtual bool local_input(int type) const
+		{
+			return type == ISMRMRD::ISMRMRD_FLOAT;
+		}
+		virtual int local_output(int type) const
+		{
+			return ISMRMRD::ISMRMRD_USHORT;
+		}
+		virtual void local_setup();
+		virtual void process_locally(ImageWrap& iw,
+			std::vector<gadgetron::shared_ptr<ImageWrap> >& out) const;
+	private:
+		float min_;
+		float max_;
+		float offset_;
 	};
 
 	class ImageFinishGadget : public Gadget {
@@ -27,11 +27,16 @@ limitations under the License.
 \author CCP PETMR
 */
 
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
 #include <boost/asio.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/thread.hpp>
 
+#include "SIRF/common/profiler.h"
 #include "cgadgetron_shared_ptr.h"
 #include "gadgetron_client.h"
 
@@ -41,10 +46,32 @@ using namespace sirf;
 void
 GadgetronClientAcquisitionMessageCollector::read(boost::asio::ip::tcp::socket* stream)
 {
-	ISMRMRD::Acquisition acq;
+	SIRF_PROFILE("GadgetronClient::receive");
 	ISMRMRD::AcquisitionHeader h;
 	boost::asio::read
 		(*stream, boost::asio::buffer(&h, sizeof(ISMRMRD::AcquisitionHeader)));
+	SIRF_PROFILE_BYTES("GadgetronClient::receive",
+		sizeof(ISMRMRD::AcquisitionHeader) + sizeof(float)*h.number_of_samples*
+		(h.trajectory_dimensions + 2 * h.active_channels));
+
+	if (ptr_block_) {
+		if (received_ == 0 && expected_ > 0)
+			ptr_block_->reserve(expected_, h);
+		received_++;
+		complex_float_t* data;
+		float* traj;
+		ptr_block_->append_acquisition(h, &data, &traj);
+		std::vector<boost::asio::mutable_buffer> buffers;
+		if (traj)
+			buffers.push_back(boost::asio::buffer(traj, sizeof(float)*
+				h.trajectory_dimensions*h.number_of_samples));
+		buffers.push_back(boost::asio::buffer(data, 2 * sizeof(float)*
+			h.active_channels*h.number_of_samples));
+		boost::asio::read(*stream, buffers);
+		return;
+	}
+
+	ISMRMRD::Acquisition acq;
 	acq.setHead(h);
 	unsigned long trajectory_elements =
 		acq.getHead().trajectory_dimensions * acq.getHead().number_of_samples;
@@ -69,6 +96,7 @@ GadgetronClientAcquisitionMessageCollector::read(boost::asio::ip::tcp::socket* s
 void 
 GadgetronClientImageMessageCollector::read(boost::asio::ip::tcp::socket* stream)
 {
+	SIRF_PROFILE("GadgetronClient::receive");
 	//Read the image headerfrom the socket
 	ISMRMRD::ImageHeader h;
 	boost::asio::read
@@ -85,6 +113,21 @@ GadgetronClientImageMessageCollector::read(boost::asio::ip::tcp::socket* stream)
 	}
 }
 
+void
+GadgetronClientImageMessageStreamer::read(boost::asio::ip::tcp::socket* stream)
+{
+	SIRF_PROFILE("GadgetronClient::receive");
+	ISMRMRD::ImageHeader h;
+	boost::asio::read
+		(*stream, boost::asio::buffer(&h, sizeof(ISMRMRD::ImageHeader)));
+	void* ptr = 0;
+	IMAGE_PROCESSING_SWITCH
+		(h.data_type, read_data_attributes, ptr, h, &ptr, stream);
+	if (!ptr)
+		throw GadgetronClientException("Invalid image data type");
+	f_(gadgetron::shared_ptr<ImageWrap>(new ImageWrap(h.data_type, ptr)));
+}
+
 void 
 GadgetronClientConnector::read_task()
 {
@@ -99,6 +142,7 @@ GadgetronClientConnector::read_task()
 				(*socket_, boost::asio::buffer(&id, sizeof(GadgetMessageIdentifier)));
 
 			if (id.id == GADGET_MESSAGE_CLOSE) {
+				closed_by_server_ = true;
 				break;
 			}
 
@@ -122,6 +166,17 @@ GadgetronClientConnector::read_task()
 void 
 GadgetronClientConnector::connect(std::string hostname, std::string port)
 {
+	SIRF_PROFILE("GadgetronClient::connect");
+	open(hostname, port);
+	start_reading();
+}
+
+void 
+GadgetronClientConnector::open(std::string hostname, std::string port)
+{
+	close_();
+	closed_by_server_ = false;
+
 	boost::asio::ip::tcp::resolver resolver(io_service);
 	boost::asio::ip::tcp::resolver::query 
 		query(boost::asio::ip::tcp::v4(), hostname.c_str(), port.c_str());
@@ -136,6 +191,7 @@ GadgetronClientConnector::connect(std::string hostname, std::string port)
 
 	std::condition_variable cv;
 	std::mutex cv_m;
+	bool done = false;
 
 	boost::system::error_code error = boost::asio::error::host_not_found;
 	std::thread t([&](){
@@ -146,14 +202,17 @@ GadgetronClientConnector::connect(std::string hostname, std::string port)
 			socket_->close();
 			socket_->connect(*endpoint_iterator++, error);
 		}
+		std::lock_guard<std::mutex> lk(cv_m);
+		done = true;
 		cv.notify_all();
 	});
 
 	{
+		// the predicate prevents waiting for the whole timeout
+		// (and closing the socket) if connected before the wait starts
 		std::unique_lock<std::mutex> lk(cv_m);
-		if (std::cv_status::timeout ==
-			cv.wait_until(lk, std::chrono::system_clock::now() +
-			std::chrono::milliseconds(timeout_ms_))) {
+		if (!cv.wait_until(lk, std::chrono::system_clock::now() +
+			std::chrono::milliseconds(timeout_ms_), [&]() { return done; })) {
 			socket_->close();
 		}
 	}
@@ -163,29 +222,49 @@ GadgetronClientConnector::connect(std::string hostname, std::string port)
 	if (error)
 		throw GadgetronClientException("Error connecting using socket.");
 
+	apply_options_();
+	send_buffer_.clear();
+}
+
+void 
+GadgetronClientConnector::start_reading()
+{
+	if (!socket_)
+		throw GadgetronClientException("Invalid socket.");
 	reader_thread_ =
 		boost::thread(boost::bind(&GadgetronClientConnector::read_task, this));
 }
 
+void
+GadgetronClientConnector::close_()
+{
+	if (!socket_)
+		return;
+	boost::system::error_code error;
+	// shutting the socket down makes the reader thread (if any) quit
+	socket_->shutdown(boost::asio::ip::tcp::socket::shutdown_both, error);
+	if (reader_thread_.joinable())
+		reader_thread_.join();
+	socket_->close(error);
+	delete socket_;
+	socket_ = 0;
+	send_buffer_.clear();
+}
+
 void 
 GadgetronClientConnector::send_gadgetron_close()
 {
-	if (!socket_) {
-		throw GadgetronClientException("Invalid socket.");
-	}
 	GadgetMessageIdentifier id;
 	id.id = GADGET_MESSAGE_CLOSE;
-	boost::asio::write
-		(*socket_, boost::asio::buffer(&id, sizeof(GadgetMessageIdentifier)));
+	std::vector<boost::asio::const_buffer> buffers;
+	buffers.push_back(boost::asio::buffer(&id, sizeof(GadgetMessageIdentifier)));
+	send_(buffers);
+	flush();
 }
 
 void 
 GadgetronClientConnector::send_gadgetron_configuration_file(std::string config_xml_name)
 {
-	if (!socket_) {
-		throw GadgetronClientException("Invalid socket.");
-	}
-
 	GadgetMessageIdentifier id;
 	id.id = GADGET_MESSAGE_CONFIG_FILE;
 
@@ -194,86 +273,121 @@ GadgetronClientConnector::send_gadgetron_configuration_file(std::string config_x
 	strncpy
 		(ini.configuration_file, config_xml_name.c_str(), config_xml_name.size());
 
-	boost::asio::write
-		(*socket_, boost::asio::buffer(&id, sizeof(GadgetMessageIdentifier)));
-	boost::asio::write
-		(*socket_,
-		boost::asio::buffer(&ini, sizeof(GadgetMessageConfigurationFile)));
+	std::vector<boost::asio::const_buffer> buffers;
+	buffers.push_back(boost::asio::buffer(&id, sizeof(GadgetMessageIdentifier)));
+	buffers.push_back
+		(boost::asio::buffer(&ini, sizeof(GadgetMessageConfigurationFile)));
+	send_(buffers);
 }
 
 void 
 GadgetronClientConnector::send_gadgetron_configuration_script(std::string xml_string)
 {
-	if (!socket_) {
-		throw GadgetronClientException("Invalid socket.");
-	}
-
 	GadgetMessageIdentifier id;
 	id.id = GADGET_MESSAGE_CONFIG_SCRIPT;
 
 	GadgetMessageScript conf;
 	conf.script_length = (uint32_t)xml_string.size() + 1;
 
-	boost::asio::write
-		(*socket_, boost::asio::buffer(&id, sizeof(GadgetMessageIdentifier)));
-	boost::asio::write
-		(*socket_, boost::asio::buffer(&conf, sizeof(GadgetMessageScript)));
-	boost::asio::write
-		(*socket_, boost::asio::buffer(xml_string.c_str(), conf.script_length));
+	std::vector<boost::asio::const_buffer> buffers;
+	buffers.push_back(boost::asio::buffer(&id, sizeof(GadgetMessageIdentifier)));
+	buffers.push_back(boost::asio::buffer(&conf, sizeof(GadgetMessageScript)));
+	buffers.push_back(boost::asio::buffer(xml_string.c_str(), conf.script_length));
+	send_(buffers);
 }
 
 void 
 GadgetronClientConnector::send_gadgetron_parameters(std::string xml_string)
 {
-	if (!socket_) {
-		throw GadgetronClientException("Invalid socket.");
-	}
-
 	GadgetMessageIdentifier id;
 	id.id = GADGET_MESSAGE_PARAMETER_SCRIPT;
 
 	GadgetMessageScript conf;
 	conf.script_length = (uint32_t)xml_string.size() + 1;
 
-	boost::asio::write
-		(*socket_, boost::asio::buffer(&id, sizeof(GadgetMessageIdentifier)));
-	boost::asio::write
-		(*socket_, boost::asio::buffer(&conf, sizeof(GadgetMessageScript)));
-	boost::asio::write
-		(*socket_, boost::asio::buffer(xml_string.c_str(), conf.script_length));
+	std::vector<boost::asio::const_buffer> buffers;
+	buffers.push_back(boost::asio::buffer(&id, sizeof(GadgetMessageIdentifier)));
+	buffers.push_back(boost::asio::buffer(&conf, sizeof(GadgetMessageScript)));
+	buffers.push_back(boost::asio::buffer(xml_string.c_str(), conf.script_length));
+	send_(buffers);
 }
 
 void 
 GadgetronClientConnector::send_ismrmrd_acquisition(ISMRMRD::Acquisition& acq)
 {
-	if (!socket_)
-		throw GadgetronClientException("Invalid socket.");
-
 	GadgetMessageIdentifier id;
 	id.id = GADGET_MESSAGE_ISMRMRD_ACQUISITION;
 
-	boost::asio::write
-		(*socket_, boost::asio::buffer(&id, sizeof(GadgetMessageIdentifier)));
-	boost::asio::write
-		(*socket_,
-		boost::asio::buffer(&acq.getHead(), sizeof(ISMRMRD::AcquisitionHeader)));
-
 	unsigned long trajectory_elements =
 		acq.getHead().trajectory_dimensions*acq.getHead().number_of_samples;
 	unsigned long data_elements =
 		acq.getHead().active_channels*acq.getHead().number_of_samples;
 
+	std::vector<boost::asio::const_buffer> buffers;
+	buffers.push_back(boost::asio::buffer(&id, sizeof(GadgetMessageIdentifier)));
+	buffers.push_back
+		(boost::asio::buffer(&acq.getHead(), sizeof(ISMRMRD::AcquisitionHeader)));
 	if (trajectory_elements) {
-		boost::asio::write
-			(*socket_, boost::asio::buffer
+		buffers.push_back(boost::asio::buffer
 			(&acq.getTrajPtr()[0], sizeof(float)*trajectory_elements));
 	}
 	if (data_elements) {
-		boost::asio::write
-			(*socket_,
-			boost::asio::buffer
+		buffers.push_back(boost::asio::buffer
 			(&acq.getDataPtr()[0], 2 * sizeof(float)*data_elements));
 	}
+	send_(buffers);
+}
+
+void
+GadgetronClientConnector::send_(const std::vector<boost::asio::const_buffer>& buffers)
+{
+	if (!socket_)
+		throw GadgetronClientException("Invalid socket.");
+
+	size_t size = boost::asio::buffer_size(buffers);
+	SIRF_PROFILE_BYTES("GadgetronClient::send", size);
+	size_t capacity = options_.send_buffer_size;
+	if (size >= capacity) {
+		// large messages are written directly rather than copied
+		flush();
+		SIRF_PROFILE("GadgetronClient::send");
+		boost::asio::write(*socket_, buffers);
+		return;
+	}
+	if (send_buffer_.size() + size > capacity)
+		flush();
+	if (send_buffer_.capacity() < capacity)
+		send_buffer_.reserve(capacity);
+	for (size_t i = 0; i < buffers.size(); i++) {
+		const char* ptr = boost::asio::buffer_cast<const char*>(buffers[i]);
+		send_buffer_.insert(send_buffer_.end(),
+			ptr, ptr + boost::asio::buffer_size(buffers[i]));
+	}
+}
+
+void
+GadgetronClientConnector::flush()
+{
+	if (send_buffer_.empty())
+		return;
+	if (!socket_)
+		throw GadgetronClientException("Invalid socket.");
+	SIRF_PROFILE("GadgetronClient::send");
+	boost::asio::write(*socket_, boost::asio::buffer(send_buffer_));
+	send_buffer_.clear();
+}
+
+void
+GadgetronClientConnector::apply_options_()
+{
+	socket_->set_option
+		(boost::asio::ip::tcp::no_delay(options_.tcp_nodelay));
+	if (options_.socket_send_buffer_size > 0)
+		socket_->set_option(boost::asio::socket_base::send_buffer_size
+			(options_.socket_send_buffer_size));
+	if (options_.socket_receive_buffer_size > 0)
+		socket_->set_option(boost::asio::socket_base::receive_buffer_size
+			(options_.socket_receive_buffer_size));
 }
 
 GadgetronClientMessageReader* 
@@ -287,3 +401,156 @@ GadgetronClientConnector::find_reader(unsigned short r)
 	return ret;
 }
 
+
+shared_ptr<GadgetronClientConnector>
+GadgetronSessionPool::new_session_
+(const std::string& host, const std::string& port,
+	const std::string& config, const GadgetronConnectionOptions& options)
+{
+	shared_ptr<GadgetronClientConnector> sptr_con(new GadgetronClientConnector);
+	sptr_con->set_options(options);
+	sptr_con->open(host, port);
+	sptr_con->send_gadgetron_configuration_script(config);
+	sptr_con->flush();
+	return sptr_con;
+}
+
+shared_ptr<GadgetronClientConnector>
+GadgetronSessionPool::session
+(const std::string& host, const std::string& port,
+	const std::string& config, const GadgetronConnectionOptions& options)
+{
+	std::string key = host + '\n' + port + '\n' + config;
+	session_future warm;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		std::map<std::string, session_future>::iterator it = warm_.find(key);
+		if (it != warm_.end()) {
+			warm = std::move(it->second);
+			warm_.erase(it);
+		}
+	}
+	if (warm.valid()) {
+		try {
+			shared_ptr<GadgetronClientConnector> sptr_con = warm.get();
+			if (sptr_con->is_open())
+				return sptr_con;
+		}
+		catch (...) {
+			// failed to prepare, fall back to a new session
+		}
+	}
+	return new_session_(host, port, config, options);
+}
+
+GadgetronSessionPool::GadgetronSessionPool()
+{
+#ifdef __linux__
+	pthread_atfork(atfork_prepare_, atfork_parent_, atfork_child_);
+#endif
+}
+
+// mutex_ is held over fork, so that the child gets consistent maps
+void
+GadgetronSessionPool::atfork_prepare_()
+{
+	instance().mutex_.lock();
+}
+
+void
+GadgetronSessionPool::atfork_parent_()
+{
+	instance().mutex_.unlock();
+}
+
+/*
+The futures of the warm sessions and heartbeats would wait in the child for
+threads that only exist in the parent, and the sockets of the sessions are
+the parent's: the maps are abandoned, as the workers of ThreadPool are.
+*/
+void
+GadgetronSessionPool::atfork_child_()
+{
+	GadgetronSessionPool& pool = instance();
+	(new std::map<std::string, session_future>)->swap(pool.warm_);
+	(new std::map<std::string, std::future<bool> >)->swap(pool.probes_);
+	pool.mutex_.unlock();
+}
+
+void
+GadgetronSessionPool::prepare
+(const std::string& host, const std::string& port,
+	const std::string& config, const GadgetronConnectionOptions& options)
+{
+	std::string key = host + '\n' + port + '\n' + config;
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (warm_.count(key) || warm_.size() >= MAX_WARM_SESSIONS)
+		return;
+	warm_[key] = std::async(std::launch::async,
+		new_session_, host, port, config, options);
+}
+
+void
+GadgetronSessionPool::clear()
+{
+	std::map<std::string, session_future> warm;
+	std::map<std::string, std::future<bool> > probes;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		warm.swap(warm_);
+		probes.swap(probes_);
+	}
+	// the probes are waited for as the futures are destroyed
+	probes.clear();
+	// the sessions are closed as the futures are destroyed
+	for (std::map<std::string, session_future>::iterator it = warm.begin();
+		it != warm.end(); it++) {
+		try {
+			it->second.get();
+		}
+		catch (...) {
+		}
+	}
+}
+
+void
+GadgetronSessionPool::probe(const std::string& host, const std::string& port)
+{
+	std::string key = host + '\n' + port;
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (probes_.count(key))
+		return;
+	probes_[key] = std::async(std::launch::async, heartbeat, host, port);
+}
+
+bool
+GadgetronSessionPool::probe_succeeded
+(const std::string& host, const std::string& port)
+{
+	std::string key = host + '\n' + port;
+	std::future<bool> probe;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		std::map<std::string, std::future<bool> >::iterator it =
+			probes_.find(key);
+		if (it == probes_.end())
+			return true;
+		probe = std::move(it->second);
+		probes_.erase(it);
+	}
+	return probe.get();
+}
+
+bool
+GadgetronSessionPool::heartbeat(const std::string& host, const std::string& port)
+{
+	try {
+		GadgetronClientConnector con;
+		con.open(host, port);
+		con.send_gadgetron_close();
+		return true;
+	}
+	catch (...) {
+		return false;
+	}
+}
@@ -41,13 +41,19 @@ limitations under the License.
 #include <ismrmrd/ismrmrd.h>
 #include <ismrmrd/meta.h>
 
+#include <algorithm>
 #include <chrono>
 #include <condition_variable>
 #include <exception>
+#include <functional>
+#include <future>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <thread>
+#include <vector>
 
+#include "SIRF/common/profiler.h"
 #include "cgadgetron_shared_ptr.h"
 #include "gadgetron_data_containers.h"
 
@@ -114,14 +120,25 @@ namespace sirf {
 	class GadgetronClientAcquisitionMessageCollector :
 		public GadgetronClientMessageReader {
 	public:
+		// if ptr_acqs is an AcquisitionsBlock, the samples are read directly
+		// into its slab, which on the first message is sized for
+		// expected acquisitions like the first one
 		GadgetronClientAcquisitionMessageCollector
-			(gadgetron::shared_ptr<MRAcquisitionData> ptr_acqs) : ptr_acqs_(ptr_acqs) {}
+			(gadgetron::shared_ptr<MRAcquisitionData> ptr_acqs,
+			unsigned int expected = 0) :
+			ptr_acqs_(ptr_acqs), expected_(expected), received_(0)
+		{
+			ptr_block_ = dynamic_cast<AcquisitionsBlock*>(ptr_acqs.get());
+		}
 		virtual ~GadgetronClientAcquisitionMessageCollector() {}
 
 		virtual void read(boost::asio::ip::tcp::socket* stream);
 
 	private:
 		gadgetron::shared_ptr<MRAcquisitionData> ptr_acqs_;
+		AcquisitionsBlock* ptr_block_;
+		unsigned int expected_;
+		unsigned int received_;
 	};
 
 	/**
@@ -159,6 +176,8 @@ namespace sirf {
 			//Read image data
 			boost::asio::read
 				(*stream, boost::asio::buffer(im.getDataPtr(), im.getDataSize()));
+			SIRF_PROFILE_BYTES("GadgetronClient::receive", sizeof(ISMRMRD::ImageHeader)
+				+ sizeof(size_t_type) + meta_attrib_length + im.getDataSize());
 		}
 
 		virtual void read(boost::asio::ip::tcp::socket* stream);
@@ -167,34 +186,116 @@ namespace sirf {
 		gadgetron::shared_ptr<MRImageData> ptr_images_;
 	};
 
+	/**
+	\brief Class for passing on images sent by Gadgetron server as they arrive.
+
+	Each image is given to the callback on the connection's reading thread.
+	*/
+	class GadgetronClientImageMessageStreamer :
+		public GadgetronClientImageMessageCollector {
+	public:
+		typedef std::function<void(gadgetron::shared_ptr<ImageWrap>)> Callback;
+		GadgetronClientImageMessageStreamer(Callback f) :
+			GadgetronClientImageMessageCollector
+			(gadgetron::shared_ptr<MRImageData>()), f_(f) {}
+		virtual void read(boost::asio::ip::tcp::socket* stream);
+	private:
+		Callback f_;
+	};
+
+	// host and port of a Gadgetron server
+	typedef std::pair<std::string, std::string> GadgetronServer;
+
+	/**
+	\brief Socket and buffering options for GadgetronClientConnector.
+
+	Outgoing messages are accumulated in a send buffer of send_buffer_size
+	bytes, which is written to the socket when full or when the connection
+	is closed; 0 disables buffering (each message is still sent by one
+	gather write). Socket buffer sizes of 0 leave the system defaults.
+	*/
+	struct GadgetronConnectionOptions {
+		GadgetronConnectionOptions() :
+			send_buffer_size(1 << 20), tcp_nodelay(true),
+			socket_send_buffer_size(0), socket_receive_buffer_size(0),
+			warm_sessions(false), deferred_probing(false)
+		{}
+		size_t send_buffer_size;
+		bool tcp_nodelay;
+		int socket_send_buffer_size;
+		int socket_receive_buffer_size;
+		// prepare the next session in background (see GadgetronSessionPool)
+		bool warm_sessions;
+		// after a session confirmed by the server, check in background
+		// that it is still alive, so that the next session with it fails
+		// at once if it is not (a session the server has not confirmed
+		// is always checked before its output is returned)
+		bool deferred_probing;
+	};
+
 	/**
 	\brief Class for communicating with Gadgetron server.
 	*/
 	class GadgetronClientConnector {
 	public:
-		GadgetronClientConnector() : socket_(0), timeout_ms_(2000)
+		GadgetronClientConnector() :
+			socket_(0), timeout_ms_(2000), closed_by_server_(false)
 		{}
 		virtual ~GadgetronClientConnector()
 		{
-			if (socket_) {
-				socket_->close();
-				delete socket_;
-			}
+			close_();
 		}
 
 		void set_timeout(unsigned int t)
 		{
 			timeout_ms_ = t;
 		}
+		// to be called before connect()
+		void set_options(const GadgetronConnectionOptions& options)
+		{
+			options_ = options;
+		}
+		const GadgetronConnectionOptions& options() const
+		{
+			return options_;
+		}
 
 		void read_task();
 
 		void wait()
 		{
+			flush();
 			reader_thread_.join();
 		}
 
+		// writes buffered messages to the socket
+		void flush();
+		// shuts the socket down, making blocked sends and receives fail;
+		// may be called from another thread
+		void abort()
+		{
+			if (socket_) {
+				boost::system::error_code error;
+				socket_->shutdown
+					(boost::asio::ip::tcp::socket::shutdown_both, error);
+			}
+		}
+
+		// opens the socket and starts the reader thread
 		void connect(std::string hostname, std::string port);
+		// opens the socket only, to be followed by start_reading()
+		void open(std::string hostname, std::string port);
+		// starts the reader thread; readers must be registered before
+		void start_reading();
+		bool is_open() const
+		{
+			return socket_ && socket_->is_open();
+		}
+		// true if the last session was ended by the server's close message
+		bool closed_by_server() const
+		{
+			return closed_by_server_;
+		}
 
 		void send_gadgetron_close();
 
@@ -210,18 +311,10 @@ namespace sirf {
 		void send_ismrmrd_image(ISMRMRD::Image<T>* ptr_im)
 		{
 			ISMRMRD::Image<T>& im = *ptr_im;
-			if (!socket_)
-				throw GadgetronClientException("Invalid socket.");
 
 			GadgetMessageIdentifier id;
 			id.id = GADGET_MESSAGE_ISMRMRD_IMAGE;
 
-			boost::asio::write
-				(*socket_, boost::asio::buffer(&id, sizeof(GadgetMessageIdentifier)));
-			boost::asio::write
-				(*socket_,
-				boost::asio::buffer(&im.getHead(), sizeof(ISMRMRD::ImageHeader)));
-
 			size_t meta_attrib_length = im.getAttributeStringLength();
 			std::string meta_attrib(meta_attrib_length + 1, 0);
 			im.getAttributeString(meta_attrib);
@@ -234,13 +327,18 @@ namespace sirf {
 				meta_attrib.erase(l);
 			}
 
-			boost::asio::write
-				(*socket_, boost::asio::buffer(&meta_attrib_length, sizeof(size_t)));
-			boost::asio::write
-				(*socket_, boost::asio::buffer(meta_attrib.c_str(), meta_attrib_length));
-
-			boost::asio::write
-				(*socket_, boost::asio::buffer(im.getDataPtr(), im.getDataSize()));
+			std::vector<boost::asio::const_buffer> buffers;
+			buffers.push_back
+				(boost::asio::buffer(&id, sizeof(GadgetMessageIdentifier)));
+			buffers.push_back
+				(boost::asio::buffer(&im.getHead(), sizeof(ISMRMRD::ImageHeader)));
+			buffers.push_back
+				(boost::asio::buffer(&meta_attrib_length, sizeof(size_t)));
+			buffers.push_back
+				(boost::asio::buffer(meta_attrib.c_str(), meta_attrib_length));
+			buffers.push_back
+				(boost::asio::buffer(im.getDataPtr(), im.getDataSize()));
+			send_(buffers);
 		}
 
 		void send_wrapped_image(ImageWrap& iw)
@@ -260,12 +358,123 @@ namespace sirf {
 			maptype;
 
 		GadgetronClientMessageReader* find_reader(unsigned short r);
+		// sends a message made of several buffers via the send buffer
+		void send_(const std::vector<boost::asio::const_buffer>& buffers);
+		void apply_options_();
+		void close_();
 
 		boost::asio::io_service io_service;
 		boost::asio::ip::tcp::socket* socket_;
 		boost::thread reader_thread_;
 		maptype readers_;
 		unsigned int timeout_ms_;
+		GadgetronConnectionOptions options_;
+		std::vector<char> send_buffer_;
+		bool closed_by_server_;
+	};
+
+	/**
+	\brief Allows a session with Gadgetron server run by one thread to be
+	cancelled by another.
+	*/
+	class GadgetronSessionControl {
+	public:
+		GadgetronSessionControl() : cancelled_(false) {}
+		void cancel()
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			cancelled_ = true;
+			for (size_t i = 0; i < connections_.size(); i++)
+				connections_[i]->abort();
+		}
+		bool cancelled()
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			return cancelled_;
+		}
+		// registers a connection used by the session (sharded sessions use
+		// several), aborting it at once if already cancelled
+		void attach(gadgetron::shared_ptr<GadgetronClientConnector> sptr_con)
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			connections_.push_back(sptr_con);
+			if (cancelled_)
+				sptr_con->abort();
+		}
+		void detach(gadgetron::shared_ptr<GadgetronClientConnector> sptr_con)
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			connections_.erase(std::remove(connections_.begin(),
+				connections_.end(), sptr_con), connections_.end());
+		}
+	private:
+		std::mutex mutex_;
+		bool cancelled_;
+		std::vector<gadgetron::shared_ptr<GadgetronClientConnector> > connections_;
+	};
+
+	/**
+	\brief Pool of warm sessions with Gadgetron servers.
+
+	A session is a connection to the server on which a gadget chain has been
+	configured. Since the Gadgetron protocol ends the session after the close
+	message, a session cannot be reused; instead, after a session with a given
+	gadget chain has finished, prepare() opens and configures the next one in
+	background, so that the next session() call for the same host, port and
+	chain is served without connection and chain set-up latency.
+
+	The pool also keeps the heartbeats of the servers started by probe(),
+	whose outcome is collected by probe_succeeded().
+
+	On Linux, a child process forked while the pool holds warm sessions or
+	heartbeats starts with an empty pool: the threads preparing them do not
+	exist in the child, and the sessions' sockets belong to the parent, so
+	they are abandoned rather than closed or waited for.
+	*/
+	class GadgetronSessionPool {
+	public:
+		static GadgetronSessionPool& instance()
+		{
+			static GadgetronSessionPool pool;
+			return pool;
+		}
+		~GadgetronSessionPool()
+		{
+			clear();
+		}
+		// returns an open connection with the chain configured by config
+		gadgetron::shared_ptr<GadgetronClientConnector> session
+			(const std::string& host, const std::string& port,
+			const std::string& config, const GadgetronConnectionOptions& options);
+		// opens and configures a session for a later session() call
+		void prepare
+			(const std::string& host, const std::string& port,
+			const std::string& config, const GadgetronConnectionOptions& options);
+		// closes all warm sessions and waits for the probes
+		void clear();
+		// cheap check that the server accepts connections
+		static bool heartbeat(const std::string& host, const std::string& port);
+		// starts a heartbeat of the server in background
+		void probe(const std::string& host, const std::string& port);
+		// waits for the probe of the server, if any, returns false if it
+		// has failed
+		bool probe_succeeded(const std::string& host, const std::string& port);
+
+	private:
+		typedef std::future<gadgetron::shared_ptr<GadgetronClientConnector> >
+			session_future;
+		GadgetronSessionPool();
+		static void atfork_prepare_();
+		static void atfork_parent_();
+		static void atfork_child_();
+		// the maximal number of warm sessions
+		static const size_t MAX_WARM_SESSIONS = 8;
+		static gadgetron::shared_ptr<GadgetronClientConnector> new_session_
+			(const std::string& host, const std::string& port,
+			const std::string& config, const GadgetronConnectionOptions& options);
+		std::mutex mutex_;
+		std::map<std::string, session_future> warm_;
+		std::map<std::string, std::future<bool> > probes_;
 	};
 
 }
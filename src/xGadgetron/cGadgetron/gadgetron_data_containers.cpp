@@ -27,38 +27,166 @@ limitations under the License.
 \author CCP PETMR
 */
 
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+#include "SIRF/common/profiler.h"
+#include "SIRF/common/thread_pool.h"
 #include "cgadgetron_shared_ptr.h"
 #include "gadgetron_data_containers.h"
+#include "ismrmrd_hdf5.h"
+#include "xgadgetron_kernels.h"
 
 using namespace gadgetron;
 using namespace sirf;
 
+// number of consecutive acquisitions read from file in one go
+#define ACQUISITIONS_PAGE 64
+// number of acquisitions copied by one batched access
+#define ACQUISITIONS_BATCH 256
+// maximal size of a batch of images written in one go
+#define IMAGES_BATCH_BYTES (64 << 20)
+// number of acquisition headers read from file in one go
+#define HEADERS_BATCH 4096
+
 std::string MRAcquisitionData::_storage_scheme;
 shared_ptr<MRAcquisitionData> MRAcquisitionData::acqs_templ_;
+size_t AcquisitionsFile::default_cache_size_ = 0;
+
+static size_t
+acquisition_bytes_(const ISMRMRD::Acquisition& acq)
+{
+	return sizeof(ISMRMRD::AcquisitionHeader) +
+		acq.getNumberOfTrajElements()*sizeof(float) +
+		acq.getNumberOfDataElements()*sizeof(complex_float_t);
+}
+
+// reads an acquisition from file, adding its time and size to the profile
+static void
+read_acquisition_(ISMRMRD::Dataset& dataset, unsigned int i,
+	ISMRMRD::Acquisition& acq)
+{
+	SIRF_PROFILE("AcquisitionsFile::read");
+	dataset.readAcquisition(i, acq);
+	SIRF_PROFILE_BYTES("AcquisitionsFile::read", acquisition_bytes_(acq));
+}
+
+// appends an acquisition to file, adding its time and size to the profile
+static void
+append_acquisition_(ISMRMRD::Dataset& dataset, const ISMRMRD::Acquisition& acq)
+{
+	SIRF_PROFILE("AcquisitionsFile::append");
+	dataset.appendAcquisition(acq);
+	SIRF_PROFILE_BYTES("AcquisitionsFile::append", acquisition_bytes_(acq));
+}
+
+/*
+Gives access to the acquisitions of a container one after another, 
+reading them in batches via get_acquisitions().
+*/
+class AcquisitionsBatchReader {
+public:
+	AcquisitionsBatchReader(MRAcquisitionData& ac) :
+		ac_(ac), na_(ac.number()), first_(0)
+	{}
+	// returns acquisition a, reading the batch starting at a if needed
+	ISMRMRD::Acquisition& operator()(unsigned int a)
+	{
+		if (a < first_ || a >= first_ + acqs_.size()) {
+			first_ = a;
+			ac_.get_acquisitions
+				(a, std::min(na_ - a, (unsigned int)ACQUISITIONS_BATCH), acqs_);
+		}
+		return acqs_[a - first_];
+	}
+private:
+	MRAcquisitionData& ac_;
+	unsigned int na_;
+	unsigned int first_;
+	std::vector<ISMRMRD::Acquisition> acqs_;
+};
+
+// appends all acquisitions of from to to
+static void
+copy_acquisitions_(MRAcquisitionData& from, MRAcquisitionData& to)
+{
+	unsigned int na = from.number();
+	std::vector<ISMRMRD::Acquisition> acqs;
+	for (unsigned int a = 0; a < na; a += ACQUISITIONS_BATCH) {
+		from.get_acquisitions
+			(a, std::min(na - a, (unsigned int)ACQUISITIONS_BATCH), acqs);
+		to.append_acquisitions(acqs);
+	}
+}
+
+void
+MRAcquisitionData::check_range_(unsigned int first, unsigned int count)
+{
+	if (first + count > number() || first + count < first)
+		throw LocalisedException
+		("acquisitions range out of bounds", __FILE__, __LINE__);
+}
+
+void
+MRAcquisitionData::get_acquisitions(unsigned int first, unsigned int count,
+	std::vector<ISMRMRD::Acquisition>& acqs)
+{
+	check_range_(first, count);
+	acqs.resize(count);
+	for (unsigned int i = 0; i < count; i++)
+		get_acquisition(first + i, acqs[i]);
+}
+
+void
+MRAcquisitionData::append_acquisitions(std::vector<ISMRMRD::Acquisition>& acqs)
+{
+	for (size_t i = 0; i < acqs.size(); i++)
+		append_acquisition(acqs[i]);
+}
 
 void 
 MRAcquisitionData::write(const char* filename)
 {
-	Mutex mtx;
-	mtx.lock();
-	shared_ptr<ISMRMRD::Dataset> dataset
-		(new ISMRMRD::Dataset(filename, "/dataset", true));
-	dataset->writeHeader(acqs_info_);
-	mtx.unlock();
-	int n = number();
-	ISMRMRD::Acquisition a;
-	for (int i = 0; i < n; i++) {
-		get_acquisition(i, a);
-		//std::cout << i << ' ' << a.idx().repetition << '\n';
-		//if (TO_BE_IGNORED(a)) {
-		//	continue;
-		//}
-		mtx.lock();
-		dataset->appendAcquisition(a);
-		mtx.unlock();
+	ISMRMRDWriter writer(filename, "/dataset", acqs_info_);
+	unsigned int n = number();
+	std::vector<ISMRMRD::Acquisition> acqs;
+	for (unsigned int i = 0; i < n; i += ACQUISITIONS_BATCH) {
+		get_acquisitions
+			(i, std::min(n - i, (unsigned int)ACQUISITIONS_BATCH), acqs);
+		writer.append_acquisitions(acqs);
 	}
 }
 
+/*
+Lets TO_BE_IGNORED be applied to a bare acquisition header or its flags,
+avoiding the allocation of acquisition data.
+*/
+class HeaderFlags {
+public:
+	HeaderFlags(const ISMRMRD::AcquisitionHeader& head) : flags_(head.flags) {}
+	HeaderFlags(uint64_t flags) : flags_(flags) {}
+	uint64_t flags() const { return flags_; }
+	bool isFlagSet(const uint64_t val) const
+	{
+		return (flags_ & ((uint64_t)1 << (val - 1))) != 0;
+	}
+private:
+	uint64_t flags_;
+};
+
+shared_ptr<AcquisitionHeadersIndex>
+MRAcquisitionData::headers_index()
+{
+	unsigned int na = number();
+	shared_ptr<AcquisitionHeadersIndex> sptr_heads(new AcquisitionHeadersIndex);
+	sptr_heads->resize(na);
+	AcquisitionsBatchReader acquisition(*this);
+	for (unsigned int i = 0; i < na; i++)
+		sptr_heads->set(index(i), acquisition(i).getHead());
+	return sptr_heads;
+}
+
 bool
 MRAcquisitionData::undersampled() const
 {
@@ -72,7 +200,8 @@ MRAcquisitionData::undersampled() const
 int 
 MRAcquisitionData::get_acquisitions_dimensions(size_t ptr_dim)
 {
-	ISMRMRD::Acquisition acq;
+	shared_ptr<AcquisitionHeadersIndex> sptr_heads = headers_index();
+	const AcquisitionHeadersIndex& heads = *sptr_heads;
 	int* dim = (int*)ptr_dim;
 
 	int na = number();
@@ -88,7 +217,7 @@ MRAcquisitionData::get_acquisitions_dimensions(size_t ptr_dim)
 	//int not_reg = 0;
 	for (; y < na;) {
 		for (; y < na && ordered();) {
-			get_acquisition(y, acq);
+			HeaderFlags acq(heads.flags[index(y)]);
 			if (acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_FIRST_IN_SLICE))
 				break;
 			y++;
@@ -97,11 +226,12 @@ MRAcquisitionData::get_acquisitions_dimensions(size_t ptr_dim)
 			break;
 		ny = 0;
 		for (; y < na; y++) {
-			get_acquisition(y, acq);
+			int a = index(y);
+			HeaderFlags acq(heads.flags[a]);
 			if (TO_BE_IGNORED(acq)) // not a regular acquisition
 				continue;
-			ns = acq.number_of_samples();
-			nc = acq.active_channels();
+			ns = heads.number_of_samples[a];
+			nc = heads.active_channels[a];
 			nrr += ns*nc;
 			if (slice == 0) {
 				ms = ns;
@@ -155,10 +285,10 @@ MRAcquisitionData::get_acquisitions_dimensions(size_t ptr_dim)
 void 
 MRAcquisitionData::get_acquisitions_flags(unsigned int n, int* flags)
 {
-	ISMRMRD::Acquisition acq;
-	unsigned int na = number();
+	shared_ptr<AcquisitionHeadersIndex> sptr_heads = headers_index();
+	unsigned int na = sptr_heads->size();
 	for (unsigned int a = 0, i = 0; a < na; a++) {
-		get_acquisition(a, acq);
+		HeaderFlags acq(sptr_heads->flags[index(a)]);
 		if (TO_BE_IGNORED(acq) && n < na) {
 			std::cout << "ignoring acquisition " << a << '\n';
 			continue;
@@ -170,12 +300,12 @@ MRAcquisitionData::get_acquisitions_flags(unsigned int n, int* flags)
 unsigned int 
 MRAcquisitionData::get_acquisitions_data(unsigned int slice, float* re, float* im)
 {
-	ISMRMRD::Acquisition acq;
+	AcquisitionsBatchReader acquisition(*this);
 	unsigned int na = number();
 	unsigned int n = 0;
 	if (slice >= na) {
 		for (unsigned int a = 0, i = 0; a < na; a++) {
-			get_acquisition(a, acq);
+			ISMRMRD::Acquisition& acq = acquisition(a);
 			if (TO_BE_IGNORED(acq) && slice > na) {
 				std::cout << "ignoring acquisition " << a << '\n';
 				continue;
@@ -201,13 +331,13 @@ MRAcquisitionData::get_acquisitions_data(unsigned int slice, float* re, float* i
 	delete[] dim;
 	unsigned int y = 0;
 	for (; y + ny*slice < na;) {
-		get_acquisition(y + ny*slice, acq);
+		ISMRMRD::Acquisition& acq = acquisition(y + ny*slice);
 		if (acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_FIRST_IN_SLICE))
 			break;
 		y++;
 	}
 	for (; y + ny*slice < na; n++) {
-		get_acquisition(y + ny*slice, acq);
+		ISMRMRD::Acquisition& acq = acquisition(y + ny*slice);
 		unsigned int nc = acq.active_channels();
 		unsigned int ns = acq.number_of_samples();
 		for (unsigned int c = 0; c < nc; c++) {
@@ -224,72 +354,53 @@ MRAcquisitionData::get_acquisitions_data(unsigned int slice, float* re, float* i
 	return n;
 }
 
+// number of data elements shared by two acquisitions
+static size_t
+common_size(const ISMRMRD::Acquisition& acq_x, const ISMRMRD::Acquisition& acq_y)
+{
+	size_t nx = acq_x.getNumberOfDataElements();
+	size_t ny = acq_y.getNumberOfDataElements();
+	return nx < ny ? nx : ny;
+}
+
 void 
 MRAcquisitionData::axpby
 (complex_float_t a, const ISMRMRD::Acquisition& acq_x,
 	complex_float_t b, ISMRMRD::Acquisition& acq_y)
 {
-	complex_float_t* px;
-	complex_float_t* py;
-	for (px = acq_x.data_begin(), py = acq_y.data_begin();
-		px != acq_x.data_end() && py != acq_y.data_end(); px++, py++) {
-		if (b == complex_float_t(0.0))
-			*py = a*complex_float_t(*px);
-		else
-			*py = a*complex_float_t(*px) + b*complex_float_t(*py);
-	}
+	xGadgetronKernels::axpby(common_size(acq_x, acq_y),
+		a, acq_x.getDataPtr(), b, acq_y.getDataPtr());
 }
 
 void
 MRAcquisitionData::multiply
 (const ISMRMRD::Acquisition& acq_x, ISMRMRD::Acquisition& acq_y)
 {
-	complex_float_t* px;
-	complex_float_t* py;
-	for (px = acq_x.data_begin(), py = acq_y.data_begin();
-		px != acq_x.data_end() && py != acq_y.data_end(); px++, py++) {
-		*py = complex_float_t(*px) * complex_float_t(*py);
-	}
+	xGadgetronKernels::multiply(common_size(acq_x, acq_y),
+		acq_x.getDataPtr(), acq_y.getDataPtr());
 }
 
 void
 MRAcquisitionData::divide
 (const ISMRMRD::Acquisition& acq_x, ISMRMRD::Acquisition& acq_y)
 {
-	complex_float_t* px;
-	complex_float_t* py;
-	for (px = acq_x.data_begin(), py = acq_y.data_begin();
-		px != acq_x.data_end() && py != acq_y.data_end(); px++, py++) {
-		// TODO: check for zero denominator
-		*py = complex_float_t(*px) / complex_float_t(*py);
-	}
+	xGadgetronKernels::divide(common_size(acq_x, acq_y),
+		acq_x.getDataPtr(), acq_y.getDataPtr());
 }
 
 complex_float_t
 MRAcquisitionData::dot
 (const ISMRMRD::Acquisition& acq_a, const ISMRMRD::Acquisition& acq_b)
 {
-	complex_float_t* pa;
-	complex_float_t* pb;
-	complex_float_t z = 0;
-	for (pa = acq_a.data_begin(), pb = acq_b.data_begin();
-		pa != acq_a.data_end() && pb != acq_b.data_end(); pa++, pb++) {
-		z += std::conj(*pb) * (*pa);
-	}
-	return z;
+	return (complex_float_t)xGadgetronKernels::dot(common_size(acq_a, acq_b),
+		acq_a.getDataPtr(), acq_b.getDataPtr());
 }
 
 float 
 MRAcquisitionData::norm(const ISMRMRD::Acquisition& acq_a)
 {
-	complex_float_t* pa;
-	float r = 0;
-	for (pa = acq_a.data_begin(); pa != acq_a.data_end(); pa++) {
-		complex_float_t z = std::conj(*pa) * (*pa);
-		r += z.real();
-	}
-	r = sqrt(r);
-	return r;
+	return (float)std::sqrt(xGadgetronKernels::norm2
+		(acq_a.getNumberOfDataElements(), acq_a.getDataPtr()));
 }
 
 void 
@@ -297,6 +408,7 @@ MRAcquisitionData::axpby(
 	complex_float_t a, const aDataContainer<complex_float_t>& a_x,
 	complex_float_t b, const aDataContainer<complex_float_t>& a_y)
 {
+	SIRF_PROFILE("MRAcquisitionData::axpby");
 	MRAcquisitionData& x = (MRAcquisitionData&)a_x;
 	MRAcquisitionData& y = (MRAcquisitionData&)a_y;
 	int m = x.number();
@@ -328,6 +440,7 @@ MRAcquisitionData::multiply(
 const aDataContainer<complex_float_t>& a_x,
 const aDataContainer<complex_float_t>& a_y)
 {
+	SIRF_PROFILE("MRAcquisitionData::multiply");
 	MRAcquisitionData& x = (MRAcquisitionData&)a_x;
 	MRAcquisitionData& y = (MRAcquisitionData&)a_y;
 	int m = x.number();
@@ -359,6 +472,7 @@ MRAcquisitionData::divide(
 const aDataContainer<complex_float_t>& a_x,
 const aDataContainer<complex_float_t>& a_y)
 {
+	SIRF_PROFILE("MRAcquisitionData::divide");
 	MRAcquisitionData& x = (MRAcquisitionData&)a_x;
 	MRAcquisitionData& y = (MRAcquisitionData&)a_y;
 	int m = x.number();
@@ -388,10 +502,11 @@ const aDataContainer<complex_float_t>& a_y)
 complex_float_t
 MRAcquisitionData::dot(const aDataContainer<complex_float_t>& dc)
 {
+	SIRF_PROFILE("MRAcquisitionData::dot");
 	MRAcquisitionData& other = (MRAcquisitionData&)dc;
 	int n = number();
 	int m = other.number();
-	complex_float_t z = 0;
+	std::complex<double> z = 0;
 	ISMRMRD::Acquisition a;
 	ISMRMRD::Acquisition b;
 	for (int i = 0, j = 0; i < n && j < m;) {
@@ -405,28 +520,163 @@ MRAcquisitionData::dot(const aDataContainer<complex_float_t>& dc)
 			j++;
 			continue;
 		}
-		z += MRAcquisitionData::dot(a, b);
+		z += xGadgetronKernels::dot
+			(common_size(a, b), a.getDataPtr(), b.getDataPtr());
 		i++;
 		j++;
 	}
-	return z;
+	return (complex_float_t)z;
 }
 
 float 
 MRAcquisitionData::norm()
 {
+	SIRF_PROFILE("MRAcquisitionData::norm");
 	int n = number();
-	float r = 0;
+	double r = 0;
 	ISMRMRD::Acquisition a;
 	for (int i = 0; i < n; i++) {
 		get_acquisition(i, a);
 		if (TO_BE_IGNORED(a)) {
 			continue;
 		}
-		float s = MRAcquisitionData::norm(a);
-		r += s*s;
+		r += xGadgetronKernels::norm2(a.getNumberOfDataElements(), a.getDataPtr());
+	}
+	return (float)std::sqrt(r);
+}
+
+// advances i to the next acquisition of ac not to be ignored, 
+// returns false if there is none
+static bool
+next_acquisition(MRAcquisitionData& ac, int& i, ISMRMRD::Acquisition& acq)
+{
+	int n = ac.number();
+	for (; i < n; i++) {
+		ac.get_acquisition(i, acq);
+		if (!TO_BE_IGNORED(acq))
+			return true;
+	}
+	return false;
+}
+
+void
+MRAcquisitionData::xapy
+(complex_float_t a, const aDataContainer<complex_float_t>& a_x)
+{
+	MRAcquisitionData& x = (MRAcquisitionData&)a_x;
+	complex_float_t one(1.0, 0.0);
+	ISMRMRD::Acquisition ax;
+	ISMRMRD::Acquisition ay;
+	for (int i = 0, j = 0; next_acquisition(*this, i, ay) &&
+		next_acquisition(x, j, ax); i++, j++) {
+		MRAcquisitionData::axpby(a, ax, one, ay);
+		set_acquisition(i, ay);
+	}
+}
+
+// stores the result acq of an operation on ac: if ac held acquisitions
+// before the operation (e.g. ac is one of the operands), acq overwrites
+// the next one of them not to be ignored, as xapy does, otherwise it is
+// appended; returns false if there is no acquisition left to overwrite
+static bool
+store_acquisition(MRAcquisitionData& ac, bool in_place, int& i,
+	ISMRMRD::Acquisition& acq)
+{
+	if (!in_place) {
+		ac.append_acquisition(acq);
+		return true;
+	}
+	ISMRMRD::Acquisition old;
+	if (!next_acquisition(ac, i, old))
+		return false;
+	ac.set_acquisition(i, acq);
+	i++;
+	return true;
+}
+
+void
+MRAcquisitionData::linear_combination(int n, const complex_float_t* a,
+	const aDataContainer<complex_float_t>* const* a_x)
+{
+	if (n < 1)
+		return;
+	// any operand may be *this: each acquisition of it is read before
+	// being overwritten
+	bool in_place = number() > 0;
+	std::vector<int> j(n, 0);
+	ISMRMRD::Acquisition ax;
+	ISMRMRD::Acquisition ay;
+	complex_float_t one(1.0, 0.0);
+	for (int i = 0;;) {
+		MRAcquisitionData& y = *(MRAcquisitionData*)a_x[n - 1];
+		if (!next_acquisition(y, j[n - 1], ay))
+			return;
+		xGadgetronKernels::axpby(ay.getNumberOfDataElements(),
+			a[n - 1], ay.getDataPtr(), complex_float_t(0.0), ay.getDataPtr());
+		for (int k = 0; k < n - 1; k++) {
+			MRAcquisitionData& x = *(MRAcquisitionData*)a_x[k];
+			if (!next_acquisition(x, j[k], ax))
+				return;
+			MRAcquisitionData::axpby(a[k], ax, one, ay);
+			j[k]++;
+		}
+		if (!store_acquisition(*this, in_place, i, ay))
+			return;
+		j[n - 1]++;
+	}
+}
+
+float
+MRAcquisitionData::axpby_norm(
+	complex_float_t a, const aDataContainer<complex_float_t>& a_x,
+	complex_float_t b, const aDataContainer<complex_float_t>& a_y)
+{
+	SIRF_PROFILE("MRAcquisitionData::axpby_norm");
+	MRAcquisitionData& x = (MRAcquisitionData&)a_x;
+	MRAcquisitionData& y = (MRAcquisitionData&)a_y;
+	bool in_place = number() > 0;
+	double r = 0;
+	ISMRMRD::Acquisition ax;
+	ISMRMRD::Acquisition ay;
+	for (int i = 0, j = 0, l = 0; next_acquisition(y, i, ay) &&
+		next_acquisition(x, j, ax); i++, j++) {
+		MRAcquisitionData::axpby(a, ax, b, ay);
+		r += xGadgetronKernels::norm2
+			(ay.getNumberOfDataElements(), ay.getDataPtr());
+		if (!store_acquisition(*this, in_place, l, ay))
+			break;
+	}
+	return (float)std::sqrt(r);
+}
+
+complex_float_t
+MRAcquisitionData::axpby_dot(
+	complex_float_t a, const aDataContainer<complex_float_t>& a_x,
+	complex_float_t b, const aDataContainer<complex_float_t>& a_y,
+	const aDataContainer<complex_float_t>& a_z)
+{
+	SIRF_PROFILE("MRAcquisitionData::axpby_dot");
+	MRAcquisitionData& x = (MRAcquisitionData&)a_x;
+	MRAcquisitionData& y = (MRAcquisitionData&)a_y;
+	MRAcquisitionData& z = (MRAcquisitionData&)a_z;
+	bool in_place = number() > 0;
+	std::complex<double> d = 0;
+	ISMRMRD::Acquisition ax;
+	ISMRMRD::Acquisition ay;
+	ISMRMRD::Acquisition az;
+	for (int i = 0, j = 0, k = 0, l = 0; next_acquisition(y, i, ay) &&
+		next_acquisition(x, j, ax); i++, j++) {
+		MRAcquisitionData::axpby(a, ax, b, ay);
+		// z is read before ay is stored, in case z is *this
+		if (next_acquisition(z, k, az)) {
+			d += xGadgetronKernels::dot
+				(common_size(ay, az), ay.getDataPtr(), az.getDataPtr());
+			k++;
+		}
+		if (!store_acquisition(*this, in_place, l, ay))
+			break;
 	}
-	return sqrt(r);
+	return (complex_float_t)d;
 }
 
 gadgetron::shared_ptr<MRAcquisitionData> 
@@ -434,38 +684,49 @@ MRAcquisitionData::clone()
 {
 	gadgetron::shared_ptr<MRAcquisitionData> sptr_ad =
 		new_acquisitions_container();
-	for (int i = 0; i < number(); i++) {
-		ISMRMRD::Acquisition acq;
-		get_acquisition(i, acq);
-		sptr_ad->append_acquisition(acq);
-	}
+	// the copy is made in sorted order, so needs no index
+	copy_acquisitions_(*this, *sptr_ad);
+	sptr_ad->set_ordered(ordered());
 	return sptr_ad;
 }
 
+// keys of the (repetition, slice, phase encoding step) lexicographic order
+static inline uint64_t
+acquisition_sort_key_(uint16_t repetition, uint16_t slice, uint16_t step)
+{
+	return ((uint64_t)repetition << 32) | ((uint64_t)slice << 16) |
+		(uint64_t)step;
+}
+
 void
 MRAcquisitionData::order()
 {
-	typedef std::array<int, 3> tuple;
-	int na = number();
-	tuple t;
-	std::vector<tuple> vt;
-	ISMRMRD::Acquisition acq;
-	for (int i = 0; i < na; i++) {
-		get_acquisition(i, acq);
-		t[0] = acq.idx().repetition;
-		t[1] = acq.idx().slice;
-		t[2] = acq.idx().kspace_encode_step_1;
-		vt.push_back(t);
-	}
-	if (index_)
-		delete[] index_;
-	index_ = new int[na];
-	Multisort::sort(vt, index_);
+	// the keys are those of the stored acquisitions
+	index_.reset();
+	shared_ptr<AcquisitionHeadersIndex> sptr_heads = headers_index();
+	const AcquisitionHeadersIndex& heads = *sptr_heads;
+	int na = heads.size();
+	std::vector<uint64_t> keys(na);
+	for (int i = 0; i < na; i++)
+		keys[i] = acquisition_sort_key_
+			(heads.repetition[i], heads.slice[i], heads.kspace_encode_step_1[i]);
+	shared_ptr<std::vector<int> > sptr_index(new std::vector<int>(na));
+	if (na > 0)
+		Multisort::sort(keys, &(*sptr_index)[0],
+			ThreadPool::num_threads());
+	index_ = sptr_index;
+}
+
+void
+MRAcquisitionData::compact()
+{
+	// containers that cannot reorder their storage keep using the index
 }
 
 AcquisitionsFile::AcquisitionsFile
 (std::string filename, bool create_file, AcquisitionsInfo info)
 {
+	init_();
 	own_file_ = create_file;
 	filename_ = filename;
 
@@ -480,11 +741,13 @@ AcquisitionsFile::AcquisitionsFile
 		acqs_info_ = info;
 		dataset_->writeHeader(acqs_info_);
 	}
+	nacq_ = dataset_->getNumberOfAcquisitions();
 	mtx.unlock();
 }
 
 AcquisitionsFile::AcquisitionsFile(AcquisitionsInfo info)
 {
+	init_();
 	own_file_ = true;
 	filename_ = xGadgetronUtilities::scratch_file_name();
 	Mutex mtx;
@@ -498,6 +761,15 @@ AcquisitionsFile::AcquisitionsFile(AcquisitionsInfo info)
 
 AcquisitionsFile::~AcquisitionsFile() 
 {
+	// acquisitions not yet written are only of interest if the file stays
+	if (!own_file_) {
+		try {
+			flush();
+		}
+		catch (...) {
+			std::cerr << "failed to write acquisitions to " << filename_ << '\n';
+		}
+	}
 	dataset_.reset();
 	if (own_file_) {
 		Mutex mtx;
@@ -507,23 +779,53 @@ AcquisitionsFile::~AcquisitionsFile()
 	}
 }
 
+void
+AcquisitionsFile::init_()
+{
+	read_only_ = false;
+	nacq_ = 0;
+	sptr_mutex_.reset(new boost::mutex);
+	cache_size_ = default_cache_size_;
+	cached_bytes_ = 0;
+	readahead_ = 1;
+	last_page_ = (unsigned int)-1;
+	hits_ = 0;
+	misses_ = 0;
+}
+
 void 
 AcquisitionsFile::take_over(MRAcquisitionData& ac)
 {
-	AcquisitionsFile& af = (AcquisitionsFile&)ac;
+	AcquisitionsFile* ptr_af = dynamic_cast<AcquisitionsFile*>(&ac);
+	if (!ptr_af) {
+		// acquisitions are copied in their current order
+		AcquisitionsFile af(ac.acquisitions_info());
+		copy_acquisitions_(ac, af);
+		af.set_ordered(ac.ordered());
+		take_over(af);
+		return;
+	}
+	AcquisitionsFile& af = *ptr_af;
+	af.flush();
 	acqs_info_ = ac.acquisitions_info();
-	if (index_)
-		delete[] index_;
-	int* index = ac.index();
 	ordered_ = ac.ordered();
-	if (ordered_ && index) {
-		unsigned int n = number();
-		index_ = new int[n];
-		memcpy(index_, index, n*sizeof(int));
-	}
+	if (ordered_)
+		share_index(ac);
+	else
+		index_.reset();
+	sptr_mutex_->lock();
+	if (own_file_)
+		pending_.clear();
 	else
-		index_ = 0;
+		flush_();
 	dataset_ = af.dataset_;
+	nacq_ = af.nacq_;
+	headers_ = af.headers_;
+	blocks_.clear();
+	pages_.clear();
+	page_map_.clear();
+	cached_bytes_ = 0;
+	sptr_mutex_->unlock();
 	if (own_file_) {
 		Mutex mtx;
 		mtx.lock();
@@ -535,23 +837,217 @@ AcquisitionsFile::take_over(MRAcquisitionData& ac)
 	af.own_file_ = false;
 }
 
+void
+AcquisitionsFile::xapy
+(complex_float_t a, const aDataContainer<complex_float_t>& a_x)
+{
+	AcquisitionsFile ac(acqs_info_);
+	ac.axpby(complex_float_t(1.0), *this, a, a_x);
+	take_over(ac);
+}
+
+void
+AcquisitionsFile::compact()
+{
+	if (!index_.get())
+		return;
+	AcquisitionsFile af(acqs_info_);
+	copy_acquisitions_(*this, af);
+	af.set_ordered(true);
+	take_over(af);
+}
+
+void
+AcquisitionsFile::set_read_only(bool read_only)
+{
+	boost::mutex::scoped_lock lock(*sptr_mutex_);
+	read_only_ = read_only;
+	blocks_.clear();
+}
+
+void
+AcquisitionsFile::set_cache_size(size_t bytes)
+{
+	boost::mutex::scoped_lock lock(*sptr_mutex_);
+	cache_size_ = bytes;
+	if (bytes == 0)
+		flush_();
+	evict_();
+}
+
+unsigned long
+AcquisitionsFile::cache_hits()
+{
+	boost::mutex::scoped_lock lock(*sptr_mutex_);
+	return hits_;
+}
+
+unsigned long
+AcquisitionsFile::cache_misses()
+{
+	boost::mutex::scoped_lock lock(*sptr_mutex_);
+	return misses_;
+}
+
+void
+AcquisitionsFile::flush()
+{
+	boost::mutex::scoped_lock lock(*sptr_mutex_);
+	flush_();
+}
+
 unsigned int 
 AcquisitionsFile::items()
 {
+	// the number of acquisitions is only changed by append_acquisition(),
+	// so there is no need to ask HDF5
+	boost::mutex::scoped_lock lock(*sptr_mutex_);
+	return nacq_;
+}
+
+void
+AcquisitionsFile::flush_()
+{
+	if (pending_.empty())
+		return;
+	Mutex mtx;
+	mtx.lock();
+	for (size_t i = 0; i < pending_.size(); i++)
+		append_acquisition_(*dataset_, pending_[i]);
+	mtx.unlock();
+	// complete pages just written are likely to be read soon
+	unsigned int first = nacq_ - (unsigned int)pending_.size();
+	unsigned int p = first + 
+		(ACQUISITIONS_PAGE - first % ACQUISITIONS_PAGE) % ACQUISITIONS_PAGE;
+	for (; p + ACQUISITIONS_PAGE <= nacq_; p += ACQUISITIONS_PAGE) {
+		shared_ptr<Page> sptr_page(new Page);
+		sptr_page->first = p;
+		sptr_page->acqs.assign(pending_.begin() + (p - first),
+			pending_.begin() + (p - first + ACQUISITIONS_PAGE));
+		cache_page_(sptr_page);
+	}
+	pending_.clear();
+}
+
+void
+AcquisitionsFile::cache_page_(shared_ptr<Page> sptr_page)
+{
+	if (cache_size_ == 0 || page_map_.count(sptr_page->first))
+		return;
+	size_t bytes = 0;
+	for (size_t i = 0; i < sptr_page->acqs.size(); i++) {
+		const ISMRMRD::Acquisition& acq = sptr_page->acqs[i];
+		bytes += sizeof(ISMRMRD::AcquisitionHeader) +
+			acq.getNumberOfDataElements()*sizeof(complex_float_t) +
+			acq.getNumberOfTrajElements()*sizeof(float);
+	}
+	sptr_page->bytes = bytes;
+	pages_.push_front(sptr_page);
+	page_map_[sptr_page->first] = pages_.begin();
+	cached_bytes_ += bytes;
+	evict_();
+}
+
+void
+AcquisitionsFile::uncache_page_(unsigned int first)
+{
+	std::map<unsigned int, PageList::iterator>::iterator i =
+		page_map_.find(first);
+	if (i == page_map_.end())
+		return;
+	cached_bytes_ -= (*i->second)->bytes;
+	pages_.erase(i->second);
+	page_map_.erase(i);
+}
+
+void
+AcquisitionsFile::evict_()
+{
+	while (cached_bytes_ > cache_size_ && !pages_.empty()) {
+		shared_ptr<Page> sptr_page = pages_.back();
+		cached_bytes_ -= sptr_page->bytes;
+		page_map_.erase(sptr_page->first);
+		pages_.pop_back();
+	}
+}
+
+shared_ptr<AcquisitionsFile::Page>
+AcquisitionsFile::page_(unsigned int first)
+{
+	boost::mutex::scoped_lock lock(*sptr_mutex_);
+	bool sequential = first == last_page_ + ACQUISITIONS_PAGE;
+	last_page_ = first;
+	std::map<unsigned int, PageList::iterator>::iterator i =
+		page_map_.find(first);
+	if (i != page_map_.end()) {
+		hits_++;
+		pages_.splice(pages_.begin(), pages_, i->second);
+		return *i->second;
+	}
+	misses_++;
+	if (!pending_.empty() && 
+		first + ACQUISITIONS_PAGE > nacq_ - (unsigned int)pending_.size())
+		flush_();
+	unsigned int na = nacq_;
+	unsigned int np = 1;
+	if (sequential && cache_size_ > 0)
+		np += readahead_;
+	lock.unlock();
+
+	// the page and the pages ahead are read holding the HDF5 lock once
+	std::vector<shared_ptr<Page> > pages;
 	Mutex mtx;
 	mtx.lock();
-	unsigned int na = dataset_->getNumberOfAcquisitions();
+	for (unsigned int k = 0, p = first; k < np && p < na;
+		k++, p += ACQUISITIONS_PAGE) {
+		shared_ptr<Page> sptr_page(new Page);
+		sptr_page->first = p;
+		unsigned int n = std::min(na - p, (unsigned int)ACQUISITIONS_PAGE);
+		sptr_page->acqs.resize(n);
+		for (unsigned int j = 0; j < n; j++)
+			read_acquisition_(*dataset_, p + j, sptr_page->acqs[j]);
+		pages.push_back(sptr_page);
+	}
 	mtx.unlock();
-	return na;
+
+	lock.lock();
+	for (size_t k = 0; k < pages.size(); k++)
+		cache_page_(pages[k]);
+	return pages[0];
 }
 
 void 
 AcquisitionsFile::get_acquisition(unsigned int num, ISMRMRD::Acquisition& acq)
 {
 	int ind = index(num);
+	unsigned int first = ind - ind % ACQUISITIONS_PAGE;
+	if (read_only_) {
+		// the file does not change, so a page read by this thread earlier
+		// can be used as long as it contains the acquisition requested
+		std::thread::id id = std::this_thread::get_id();
+		shared_ptr<Page> sptr_page;
+		sptr_mutex_->lock();
+		std::map<std::thread::id, shared_ptr<Page> >::iterator i =
+			blocks_.find(id);
+		if (i != blocks_.end())
+			sptr_page = i->second;
+		sptr_mutex_->unlock();
+		if (!sptr_page || sptr_page->first != first) {
+			sptr_page = page_(first);
+			sptr_mutex_->lock();
+			blocks_[id] = sptr_page;
+			sptr_mutex_->unlock();
+		}
+		acq = sptr_page->acqs[ind - first];
+		return;
+	}
+	if (cache_size_ > 0) {
+		acq = page_(first)->acqs[ind - first];
+		return;
+	}
 	Mutex mtx;
 	mtx.lock();
-	dataset_->readAcquisition(ind, acq);
+	read_acquisition_(*dataset_, ind, acq);
 	//dataset_->readAcquisition(index(num), acq); // ??? does not work!
 	mtx.unlock();
 }
@@ -559,10 +1055,112 @@ AcquisitionsFile::get_acquisition(unsigned int num, ISMRMRD::Acquisition& acq)
 void 
 AcquisitionsFile::append_acquisition(ISMRMRD::Acquisition& acq)
 {
+	if (read_only_)
+		throw LocalisedException
+		("cannot append to read-only acquisitions file", __FILE__, __LINE__);
+	boost::mutex::scoped_lock lock(*sptr_mutex_);
+	if (cache_size_ > 0) {
+		// the last page, if cached, is now incomplete
+		uncache_page_(nacq_ - nacq_ % ACQUISITIONS_PAGE);
+		pending_.push_back(acq);
+		nacq_++;
+		if (headers_.get())
+			headers_->append(acq.getHead());
+		if (nacq_ % ACQUISITIONS_PAGE == 0)
+			flush_();
+		return;
+	}
+	Mutex mtx;
+	mtx.lock();
+	append_acquisition_(*dataset_, acq);
+	mtx.unlock();
+	nacq_++;
+	if (headers_.get())
+		headers_->append(acq.getHead());
+}
+
+void
+AcquisitionsFile::get_acquisitions(unsigned int first, unsigned int count,
+	std::vector<ISMRMRD::Acquisition>& acqs)
+{
+	check_range_(first, count);
+	std::vector<int> ind(count);
+	for (unsigned int i = 0; i < count; i++)
+		ind[i] = index(first + i);
+	acqs.resize(count);
+	if (cache_size_ > 0) {
+		shared_ptr<Page> sptr_page;
+		for (unsigned int i = 0; i < count; i++) {
+			unsigned int p = ind[i] - ind[i] % ACQUISITIONS_PAGE;
+			if (!sptr_page || sptr_page->first != p)
+				sptr_page = page_(p);
+			acqs[i] = sptr_page->acqs[ind[i] - p];
+		}
+		return;
+	}
+	Mutex mtx;
+	mtx.lock();
+	for (unsigned int i = 0; i < count; i++)
+		read_acquisition_(*dataset_, ind[i], acqs[i]);
+	mtx.unlock();
+}
+
+void
+AcquisitionsFile::append_acquisitions(std::vector<ISMRMRD::Acquisition>& acqs)
+{
+	if (read_only_)
+		throw LocalisedException
+		("cannot append to read-only acquisitions file", __FILE__, __LINE__);
+	boost::mutex::scoped_lock lock(*sptr_mutex_);
+	if (cache_size_ > 0) {
+		uncache_page_(nacq_ - nacq_ % ACQUISITIONS_PAGE);
+		pending_.insert(pending_.end(), acqs.begin(), acqs.end());
+		nacq_ += (unsigned int)acqs.size();
+		if (headers_.get())
+			for (size_t i = 0; i < acqs.size(); i++)
+				headers_->append(acqs[i].getHead());
+		if (pending_.size() >= ACQUISITIONS_PAGE || 
+			nacq_ % ACQUISITIONS_PAGE == 0)
+			flush_();
+		return;
+	}
 	Mutex mtx;
 	mtx.lock();
-	dataset_->appendAcquisition(acq);
+	for (size_t i = 0; i < acqs.size(); i++)
+		append_acquisition_(*dataset_, acqs[i]);
 	mtx.unlock();
+	nacq_ += (unsigned int)acqs.size();
+	if (headers_.get())
+		for (size_t i = 0; i < acqs.size(); i++)
+			headers_->append(acqs[i].getHead());
+}
+
+shared_ptr<AcquisitionHeadersIndex>
+AcquisitionsFile::headers_index()
+{
+	boost::mutex::scoped_lock lock(*sptr_mutex_);
+	if (headers_.get())
+		return headers_;
+	// headers are read from the file, so the pending acquisitions go first
+	flush_();
+	shared_ptr<AcquisitionHeadersIndex> sptr_heads(new AcquisitionHeadersIndex);
+	if (nacq_ < 1)
+		return sptr_heads;
+	sptr_heads->resize(nacq_);
+	ISMRMRDHeadersReader reader(filename_, "/dataset");
+	if (reader.number() < nacq_)
+		throw LocalisedException
+			("acquisitions missing in file", __FILE__, __LINE__);
+	std::vector<ISMRMRD::AcquisitionHeader> heads;
+	for (unsigned int i = 0; i < nacq_; i += HEADERS_BATCH) {
+		unsigned int n = std::min(nacq_ - i, (unsigned int)HEADERS_BATCH);
+		heads.resize(n);
+		reader.read(i, n, &heads[0]);
+		for (unsigned int j = 0; j < n; j++)
+			sptr_heads->set(i + j, heads[j]);
+	}
+	headers_ = sptr_heads;
+	return headers_;
 }
 
 void 
@@ -637,33 +1235,420 @@ AcquisitionsVector::set_acquisition_data
 	return 0;
 }
 
-void
-MRImageData::axpby(
-	complex_float_t a, const aDataContainer<complex_float_t>& a_x,
-	complex_float_t b, const aDataContainer<complex_float_t>& a_y)
+shared_ptr<AcquisitionHeadersIndex>
+AcquisitionsVector::headers_index()
 {
-	MRImageData& x = (MRImageData&)a_x;
-	MRImageData& y = (MRImageData&)a_y;
-	ImageWrap w(x.image_wrap(0));
-	complex_float_t zero(0.0, 0.0);
-	complex_float_t one(1.0, 0.0);
-	for (unsigned int i = 0; i < x.number() && i < y.number(); i++) {
-		const ImageWrap& u = x.image_wrap(i);
-		const ImageWrap& v = y.image_wrap(i);
-		w.axpby(a, u, zero);
-		w.axpby(b, v, one);
-		append(w);
-	}
+	shared_ptr<AcquisitionHeadersIndex> sptr_heads(new AcquisitionHeadersIndex);
+	sptr_heads->resize((unsigned int)acqs_.size());
+	for (size_t i = 0; i < acqs_.size(); i++)
+		sptr_heads->set((unsigned int)i, acqs_[i]->getHead());
+	return sptr_heads;
 }
 
 void
-MRImageData::multiply(
-const aDataContainer<complex_float_t>& a_x,
-const aDataContainer<complex_float_t>& a_y)
+AcquisitionsVector::compact()
 {
-	MRImageData& x = (MRImageData&)a_x;
-	MRImageData& y = (MRImageData&)a_y;
-	for (unsigned int i = 0; i < x.number() && i < y.number(); i++) {
+	if (!index_.get())
+		return;
+	std::vector<gadgetron::shared_ptr<ISMRMRD::Acquisition> > acqs(acqs_.size());
+	for (size_t i = 0; i < acqs_.size(); i++)
+		acqs[i] = acqs_[index(i)];
+	acqs_.swap(acqs);
+	index_.reset();
+}
+
+shared_ptr<AcquisitionHeadersIndex>
+AcquisitionsBlock::headers_index()
+{
+	shared_ptr<AcquisitionHeadersIndex> sptr_heads(new AcquisitionHeadersIndex);
+	sptr_heads->resize((unsigned int)heads_.size());
+	for (size_t i = 0; i < heads_.size(); i++)
+		sptr_heads->set((unsigned int)i, heads_[i]);
+	return sptr_heads;
+}
+
+void
+AcquisitionsBlock::compact()
+{
+	if (!index_.get())
+		return;
+	AcquisitionsBlock ab(acqs_info_);
+	copy_acquisitions_(*this, ab);
+	heads_.swap(ab.heads_);
+	data_off_.swap(ab.data_off_);
+	traj_off_.swap(ab.traj_off_);
+	traj_.swap(ab.traj_);
+	// the slab stays owned by this object for the StorageBudget accounting
+	size_ = 0;
+	reserve_(ab.size_, true);
+	memcpy(slab_, ab.slab_, ab.size_*sizeof(complex_float_t));
+	size_ = ab.size_;
+	index_.reset();
+}
+
+void
+AcquisitionsBlock::reserve_(size_t size, bool exact)
+{
+	if (size <= capacity_)
+		return;
+	size_t capacity = capacity_ > 0 ? capacity_ : 1024;
+	while (capacity < size)
+		capacity *= 2;
+	if (exact)
+		capacity = size;
+	try {
+		buffer_.resize(capacity*sizeof(complex_float_t));
+	}
+	catch (std::bad_alloc&) {
+		throw LocalisedException
+			("cannot allocate acquisitions block", __FILE__, __LINE__);
+	}
+	slab_ = (complex_float_t*)buffer_.data();
+	capacity_ = capacity;
+}
+
+void
+AcquisitionsBlock::append_acquisition(ISMRMRD::Acquisition& acq)
+{
+	size_t n = acq.getNumberOfDataElements();
+	reserve_(size_ + n);
+	memcpy(slab_ + size_, acq.getDataPtr(), n*sizeof(complex_float_t));
+	heads_.push_back(acq.getHead());
+	data_off_.push_back(size_);
+	size_ += n;
+	size_t nt = acq.getNumberOfTrajElements();
+	traj_off_.push_back(traj_.size());
+	if (nt > 0)
+		traj_.insert(traj_.end(), acq.getTrajPtr(), acq.getTrajPtr() + nt);
+}
+
+void
+AcquisitionsBlock::append_acquisitions(std::vector<ISMRMRD::Acquisition>& acqs)
+{
+	size_t n = 0;
+	size_t nt = 0;
+	for (size_t i = 0; i < acqs.size(); i++) {
+		n += acqs[i].getNumberOfDataElements();
+		nt += acqs[i].getNumberOfTrajElements();
+	}
+	reserve_(size_ + n);
+	heads_.reserve(heads_.size() + acqs.size());
+	data_off_.reserve(data_off_.size() + acqs.size());
+	traj_off_.reserve(traj_off_.size() + acqs.size());
+	traj_.reserve(traj_.size() + nt);
+	for (size_t i = 0; i < acqs.size(); i++)
+		append_acquisition(acqs[i]);
+}
+
+void
+AcquisitionsBlock::append_acquisition(const ISMRMRD::AcquisitionHeader& head,
+	complex_float_t** data, float** traj)
+{
+	size_t n = (size_t)head.number_of_samples*head.active_channels;
+	size_t nt = (size_t)head.number_of_samples*head.trajectory_dimensions;
+	reserve_(size_ + n);
+	heads_.push_back(head);
+	data_off_.push_back(size_);
+	traj_off_.push_back(traj_.size());
+	*data = slab_ + size_;
+	size_ += n;
+	if (nt > 0) {
+		traj_.resize(traj_.size() + nt);
+		*traj = &traj_[traj_off_.back()];
+	}
+	else
+		*traj = 0;
+}
+
+void
+AcquisitionsBlock::reserve(unsigned int n, const ISMRMRD::AcquisitionHeader& head)
+{
+	reserve_(size_ + (size_t)n*head.number_of_samples*head.active_channels,
+		true);
+	heads_.reserve(heads_.size() + n);
+	data_off_.reserve(data_off_.size() + n);
+	traj_off_.reserve(traj_off_.size() + n);
+	traj_.reserve(traj_.size() + 
+		(size_t)n*head.number_of_samples*head.trajectory_dimensions);
+}
+
+void
+AcquisitionsBlock::get_acquisition(unsigned int num, ISMRMRD::Acquisition& acq)
+{
+	int ind = index(num);
+	buffer_.touch();
+	acq.setHead(heads_[ind]);
+	memcpy(acq.getDataPtr(), slab_ + data_off_[ind], 
+		acq.getNumberOfDataElements()*sizeof(complex_float_t));
+	size_t nt = acq.getNumberOfTrajElements();
+	if (nt > 0)
+		memcpy(acq.getTrajPtr(), &traj_[traj_off_[ind]], nt*sizeof(float));
+}
+
+void
+AcquisitionsBlock::set_acquisition(unsigned int num, ISMRMRD::Acquisition& acq)
+{
+	int ind = index(num);
+	buffer_.touch();
+	const ISMRMRD::AcquisitionHeader& head = heads_[ind];
+	if (acq.number_of_samples() != head.number_of_samples ||
+		acq.active_channels() != head.active_channels ||
+		acq.trajectory_dimensions() != head.trajectory_dimensions)
+		throw LocalisedException
+		("acquisition size mismatch in AcquisitionsBlock::set_acquisition",
+		__FILE__, __LINE__);
+	heads_[ind] = acq.getHead();
+	memcpy(slab_ + data_off_[ind], acq.getDataPtr(),
+		acq.getNumberOfDataElements()*sizeof(complex_float_t));
+	size_t nt = acq.getNumberOfTrajElements();
+	if (nt > 0)
+		memcpy(&traj_[traj_off_[ind]], acq.getTrajPtr(), nt*sizeof(float));
+}
+
+int
+AcquisitionsBlock::set_acquisition_data
+(int na, int nc, int ns, const float* re, const float* im)
+{
+	int ma = number();
+	for (int a = 0, i = 0; a < ma; a++) {
+		const ISMRMRD::AcquisitionHeader& head = heads_[a];
+		HeaderFlags acq(head);
+		if (TO_BE_IGNORED(acq) && ma > na) {
+			std::cout << "ignoring acquisition " << a << '\n';
+			continue;
+		}
+		unsigned int mc = head.active_channels;
+		unsigned int ms = head.number_of_samples;
+		if (mc != nc || ms != ns)
+			return -1;
+		complex_float_t* ptr = slab_ + data_off_[a];
+		for (int j = 0; j < nc*ns; j++, i++)
+			ptr[j] = complex_float_t((float)re[i], (float)im[i]);
+	}
+	return 0;
+}
+
+bool
+AcquisitionsBlock::regular_()
+{
+	if (index_.get())
+		return false;
+	for (size_t a = 0; a < heads_.size(); a++) {
+		HeaderFlags acq(heads_[a]);
+		if (TO_BE_IGNORED(acq))
+			return false;
+	}
+	return true;
+}
+
+bool
+AcquisitionsBlock::same_layout_(const AcquisitionsBlock& other) const
+{
+	// both are operands of the algebra, hence about to be used
+	buffer_.touch();
+	other.buffer_.touch();
+	if (other.size_ != size_ || other.heads_.size() != heads_.size())
+		return false;
+	for (size_t a = 0; a < heads_.size(); a++)
+		if (other.data_off_[a] != data_off_[a])
+			return false;
+	return true;
+}
+
+void
+AcquisitionsBlock::copy_layout_(const AcquisitionsBlock& other)
+{
+	heads_ = other.heads_;
+	data_off_ = other.data_off_;
+	traj_off_ = other.traj_off_;
+	traj_ = other.traj_;
+	reserve_(other.size_);
+	size_ = other.size_;
+}
+
+void
+AcquisitionsBlock::axpby(
+	complex_float_t a, const aDataContainer<complex_float_t>& a_x,
+	complex_float_t b, const aDataContainer<complex_float_t>& a_y)
+{
+	AcquisitionsBlock* px = dynamic_cast<AcquisitionsBlock*>
+		((aDataContainer<complex_float_t>*)&a_x);
+	AcquisitionsBlock* py = dynamic_cast<AcquisitionsBlock*>
+		((aDataContainer<complex_float_t>*)&a_y);
+	if (number() > 0 || !px || !py || !px->same_layout_(*py) ||
+		!px->regular_() || !py->regular_()) {
+		MRAcquisitionData::axpby(a, a_x, b, a_y);
+		return;
+	}
+	copy_layout_(*py);
+	const complex_float_t* x = px->slab_;
+	const complex_float_t* y = py->slab_;
+	xGadgetronKernels::axpby(size_, a, x, b, y, slab_);
+}
+
+void
+AcquisitionsBlock::multiply(
+	const aDataContainer<complex_float_t>& a_x,
+	const aDataContainer<complex_float_t>& a_y)
+{
+	AcquisitionsBlock* px = dynamic_cast<AcquisitionsBlock*>
+		((aDataContainer<complex_float_t>*)&a_x);
+	AcquisitionsBlock* py = dynamic_cast<AcquisitionsBlock*>
+		((aDataContainer<complex_float_t>*)&a_y);
+	if (number() > 0 || !px || !py || !px->same_layout_(*py) ||
+		!px->regular_() || !py->regular_()) {
+		MRAcquisitionData::multiply(a_x, a_y);
+		return;
+	}
+	copy_layout_(*py);
+	const complex_float_t* x = px->slab_;
+	const complex_float_t* y = py->slab_;
+	complex_float_t* z = slab_;
+	memcpy(z, y, size_*sizeof(complex_float_t));
+	xGadgetronKernels::multiply(size_, x, z);
+}
+
+void
+AcquisitionsBlock::divide(
+	const aDataContainer<complex_float_t>& a_x,
+	const aDataContainer<complex_float_t>& a_y)
+{
+	AcquisitionsBlock* px = dynamic_cast<AcquisitionsBlock*>
+		((aDataContainer<complex_float_t>*)&a_x);
+	AcquisitionsBlock* py = dynamic_cast<AcquisitionsBlock*>
+		((aDataContainer<complex_float_t>*)&a_y);
+	if (number() > 0 || !px || !py || !px->same_layout_(*py) ||
+		!px->regular_() || !py->regular_()) {
+		MRAcquisitionData::divide(a_x, a_y);
+		return;
+	}
+	copy_layout_(*py);
+	const complex_float_t* x = px->slab_;
+	const complex_float_t* y = py->slab_;
+	complex_float_t* z = slab_;
+	memcpy(z, y, size_*sizeof(complex_float_t));
+	xGadgetronKernels::divide(size_, x, z);
+}
+
+complex_float_t
+AcquisitionsBlock::dot(const aDataContainer<complex_float_t>& dc)
+{
+	AcquisitionsBlock* py = dynamic_cast<AcquisitionsBlock*>
+		((aDataContainer<complex_float_t>*)&dc);
+	if (!py || !same_layout_(*py) || !regular_() || !py->regular_())
+		return MRAcquisitionData::dot(dc);
+	return (complex_float_t)xGadgetronKernels::dot(size_, slab_, py->slab_);
+}
+
+float
+AcquisitionsBlock::norm()
+{
+	if (!regular_())
+		return MRAcquisitionData::norm();
+	return (float)std::sqrt(xGadgetronKernels::norm2(size_, slab_));
+}
+
+bool
+AcquisitionsBlock::fast_(const AcquisitionsBlock* px, const AcquisitionsBlock* py)
+{
+	return px && py && px->same_layout_(*py) &&
+		px->regular_() && py->regular_();
+}
+
+void
+AcquisitionsBlock::xapy
+(complex_float_t a, const aDataContainer<complex_float_t>& a_x)
+{
+	AcquisitionsBlock* px = dynamic_cast<AcquisitionsBlock*>
+		((aDataContainer<complex_float_t>*)&a_x);
+	if (!fast_(this, px)) {
+		MRAcquisitionData::xapy(a, a_x);
+		return;
+	}
+	xGadgetronKernels::axpby
+		(size_, a, px->slab_, complex_float_t(1.0), slab_);
+}
+
+// the reductions below are fused with the update chunk by chunk, so that
+// each chunk is still in cache when it is reduced
+#define AB_CHUNK 4096
+
+float
+AcquisitionsBlock::axpby_norm(
+	complex_float_t a, const aDataContainer<complex_float_t>& a_x,
+	complex_float_t b, const aDataContainer<complex_float_t>& a_y)
+{
+	AcquisitionsBlock* px = dynamic_cast<AcquisitionsBlock*>
+		((aDataContainer<complex_float_t>*)&a_x);
+	AcquisitionsBlock* py = dynamic_cast<AcquisitionsBlock*>
+		((aDataContainer<complex_float_t>*)&a_y);
+	if (number() > 0 || !fast_(px, py))
+		return MRAcquisitionData::axpby_norm(a, a_x, b, a_y);
+	copy_layout_(*py);
+	double r = 0;
+	for (size_t i = 0; i < size_; i += AB_CHUNK) {
+		size_t n = std::min((size_t)AB_CHUNK, size_ - i);
+		xGadgetronKernels::axpby
+			(n, a, px->slab_ + i, b, py->slab_ + i, slab_ + i);
+		r += xGadgetronKernels::norm2(n, slab_ + i);
+	}
+	return (float)std::sqrt(r);
+}
+
+complex_float_t
+AcquisitionsBlock::axpby_dot(
+	complex_float_t a, const aDataContainer<complex_float_t>& a_x,
+	complex_float_t b, const aDataContainer<complex_float_t>& a_y,
+	const aDataContainer<complex_float_t>& a_z)
+{
+	AcquisitionsBlock* px = dynamic_cast<AcquisitionsBlock*>
+		((aDataContainer<complex_float_t>*)&a_x);
+	AcquisitionsBlock* py = dynamic_cast<AcquisitionsBlock*>
+		((aDataContainer<complex_float_t>*)&a_y);
+	AcquisitionsBlock* pz = dynamic_cast<AcquisitionsBlock*>
+		((aDataContainer<complex_float_t>*)&a_z);
+	if (number() > 0 || !fast_(px, py) || !fast_(py, pz))
+		return MRAcquisitionData::axpby_dot(a, a_x, b, a_y, a_z);
+	copy_layout_(*py);
+	std::complex<double> d = 0;
+	for (size_t i = 0; i < size_; i += AB_CHUNK) {
+		size_t n = std::min((size_t)AB_CHUNK, size_ - i);
+		xGadgetronKernels::axpby
+			(n, a, px->slab_ + i, b, py->slab_ + i, slab_ + i);
+		d += xGadgetronKernels::dot(n, slab_ + i, pz->slab_ + i);
+	}
+	return (complex_float_t)d;
+}
+
+void
+MRImageData::axpby(
+	complex_float_t a, const aDataContainer<complex_float_t>& a_x,
+	complex_float_t b, const aDataContainer<complex_float_t>& a_y)
+{
+	SIRF_PROFILE("MRImageData::axpby");
+	MRImageData& x = (MRImageData&)a_x;
+	MRImageData& y = (MRImageData&)a_y;
+	ImageWrap w(x.image_wrap(0));
+	complex_float_t zero(0.0, 0.0);
+	complex_float_t one(1.0, 0.0);
+	for (unsigned int i = 0; i < x.number() && i < y.number(); i++) {
+		const ImageWrap& u = x.image_wrap(i);
+		const ImageWrap& v = y.image_wrap(i);
+		w.axpby(a, u, zero);
+		w.axpby(b, v, one);
+		append(w);
+	}
+}
+
+void
+MRImageData::multiply(
+const aDataContainer<complex_float_t>& a_x,
+const aDataContainer<complex_float_t>& a_y)
+{
+	SIRF_PROFILE("MRImageData::multiply");
+	MRImageData& x = (MRImageData&)a_x;
+	MRImageData& y = (MRImageData&)a_y;
+	for (unsigned int i = 0; i < x.number() && i < y.number(); i++) {
 		ImageWrap w(x.image_wrap(i));
 		w.multiply(y.image_wrap(i));
 		append(w);
@@ -675,6 +1660,7 @@ MRImageData::divide(
 const aDataContainer<complex_float_t>& a_x,
 const aDataContainer<complex_float_t>& a_y)
 {
+	SIRF_PROFILE("MRImageData::divide");
 	MRImageData& x = (MRImageData&)a_x;
 	MRImageData& y = (MRImageData&)a_y;
 	for (unsigned int i = 0; i < x.number() && i < y.number(); i++) {
@@ -687,6 +1673,7 @@ const aDataContainer<complex_float_t>& a_y)
 complex_float_t
 MRImageData::dot(const aDataContainer<complex_float_t>& dc)
 {
+	SIRF_PROFILE("MRImageData::dot");
 	MRImageData& ic = (MRImageData&)dc;
 	complex_float_t z = 0;
 	for (unsigned int i = 0; i < number() && i < ic.number(); i++) {
@@ -700,6 +1687,7 @@ MRImageData::dot(const aDataContainer<complex_float_t>& dc)
 float 
 MRImageData::norm()
 {
+	SIRF_PROFILE("MRImageData::norm");
 	float r = 0;
 	for (unsigned int i = 0; i < number(); i++) {
 		const ImageWrap& u = image_wrap(i);
@@ -710,37 +1698,193 @@ MRImageData::norm()
 	return r;
 }
 
+void
+MRImageData::xapy
+(complex_float_t a, const aDataContainer<complex_float_t>& a_x)
+{
+	MRImageData& x = (MRImageData&)a_x;
+	complex_float_t one(1.0, 0.0);
+	for (unsigned int i = 0; i < number() && i < x.number(); i++)
+		sptr_writable_image_wrap(i)->axpby(a, x.image_wrap(i), one);
+}
+
+// the result of an operation on images with m images is either appended
+// to them, if they are empty, or overwrites them, in which case they must
+// have m images
+static bool
+results_in_place(MRImageData& images, unsigned int m)
+{
+	unsigned int ni = images.number();
+	if (ni > 0 && ni != m)
+		throw LocalisedException
+		("images number mismatch in MRImageData algebra", __FILE__, __LINE__);
+	return ni > 0;
+}
+
+// stores w as the result image i of an operation on images
+static void
+store_image(MRImageData& images, bool in_place, unsigned int i,
+	const ImageWrap& w)
+{
+	if (in_place)
+		images.sptr_writable_image_wrap(i)->axpby
+			(complex_float_t(1.0, 0.0), w, complex_float_t(0.0, 0.0));
+	else
+		images.append(w);
+}
+
+void
+MRImageData::linear_combination(int n, const complex_float_t* a,
+	const aDataContainer<complex_float_t>* const* a_x)
+{
+	if (n < 1)
+		return;
+	const MRImageData& x = *(const MRImageData*)a_x[0];
+	unsigned int m = ((MRImageData&)x).number();
+	for (int k = 1; k < n; k++)
+		m = std::min(m, ((MRImageData*)a_x[k])->number());
+	// any operand may be *this: image i of it is read before being
+	// overwritten
+	bool in_place = results_in_place(*this, m);
+	complex_float_t zero(0.0, 0.0);
+	complex_float_t one(1.0, 0.0);
+	for (unsigned int i = 0; i < m; i++) {
+		ImageWrap w(x.image_wrap(i));
+		w.axpby(a[0], x.image_wrap(i), zero);
+		for (int k = 1; k < n; k++)
+			w.axpby(a[k], ((const MRImageData*)a_x[k])->image_wrap(i), one);
+		store_image(*this, in_place, i, w);
+	}
+}
+
+float
+MRImageData::axpby_norm(
+	complex_float_t a, const aDataContainer<complex_float_t>& a_x,
+	complex_float_t b, const aDataContainer<complex_float_t>& a_y)
+{
+	SIRF_PROFILE("MRImageData::axpby_norm");
+	MRImageData& x = (MRImageData&)a_x;
+	MRImageData& y = (MRImageData&)a_y;
+	bool in_place = results_in_place(*this, std::min(x.number(), y.number()));
+	complex_float_t zero(0.0, 0.0);
+	complex_float_t one(1.0, 0.0);
+	double r = 0;
+	for (unsigned int i = 0; i < x.number() && i < y.number(); i++) {
+		ImageWrap w(x.image_wrap(i));
+		w.axpby(a, x.image_wrap(i), zero);
+		w.axpby(b, y.image_wrap(i), one);
+		// the image just updated is norm-reduced while still in cache
+		double s = w.norm();
+		r += s*s;
+		store_image(*this, in_place, i, w);
+	}
+	return (float)std::sqrt(r);
+}
+
+complex_float_t
+MRImageData::axpby_dot(
+	complex_float_t a, const aDataContainer<complex_float_t>& a_x,
+	complex_float_t b, const aDataContainer<complex_float_t>& a_y,
+	const aDataContainer<complex_float_t>& a_z)
+{
+	SIRF_PROFILE("MRImageData::axpby_dot");
+	MRImageData& x = (MRImageData&)a_x;
+	MRImageData& y = (MRImageData&)a_y;
+	MRImageData& z = (MRImageData&)a_z;
+	bool in_place = results_in_place(*this, std::min(x.number(), y.number()));
+	complex_float_t zero(0.0, 0.0);
+	complex_float_t one(1.0, 0.0);
+	std::complex<double> d = 0;
+	for (unsigned int i = 0; i < x.number() && i < y.number(); i++) {
+		ImageWrap w(x.image_wrap(i));
+		w.axpby(a, x.image_wrap(i), zero);
+		w.axpby(b, y.image_wrap(i), one);
+		// z is read before w is stored, in case z is *this
+		if (i < z.number())
+			d += (std::complex<double>)w.dot(z.image_wrap(i));
+		store_image(*this, in_place, i, w);
+	}
+	return (complex_float_t)d;
+}
+
 void
 MRImageData::order()
 {
-	typedef std::array<int, 3> tuple;
+	// (repetition, z-position truncated to int, slice) packed in 64 bits,
+	// the sign bit of the position flipped to keep the order unsigned
+	index_.reset();
 	int ni = number();
-	tuple t;
-	std::vector<tuple> vt;
+	std::vector<uint64_t> keys(ni);
 	for (int i = 0; i < ni; i++) {
-      ImageWrap& iw = image_wrap(i);
-      ISMRMRD::ImageHeader& head = iw.head();
-		t[0] = head.repetition;
-		t[1] = head.position[2];
-		t[2] = head.slice;
-		vt.push_back(t);
+		const ISMRMRD::ImageHeader& head = image_header(i);
+		uint32_t z = (uint32_t)(int)head.position[2] ^ 0x80000000u;
+		keys[i] = ((uint64_t)head.repetition << 48) | ((uint64_t)z << 16) |
+			(uint64_t)head.slice;
+	}
+	shared_ptr<std::vector<int> > sptr_index(new std::vector<int>(ni));
+	if (ni > 0)
+		Multisort::sort(keys, &(*sptr_index)[0],
+			ThreadPool::num_threads());
+	index_ = sptr_index;
+}
+
+void
+ImagesVector::compact()
+{
+	if (!index_.get())
+		return;
+	std::lock_guard<std::mutex> lock(mutex_);
+	std::vector<shared_ptr<ImageWrap> > images(images_.size());
+	std::vector<bool> shared(shared_.size());
+	for (size_t i = 0; i < images_.size(); i++) {
+		images[i] = images_[index(i)];
+		shared[i] = shared_[index(i)];
+	}
+	images_.swap(images);
+	shared_.swap(shared);
+	index_.reset();
+	attributes_indexed_ = false;
+}
+
+/*
+Parses the meta attributes of all images into the table at the first
+call after the images have changed.
+*/
+const std::vector<std::string>&
+ImagesVector::attribute_values_(const char* attr)
+{
+	size_t n = images_.size();
+	if (!attributes_indexed_) {
+		attributes_.clear();
+		for (size_t i = 0; i < n; i++) {
+			std::string atts = images_[i]->attributes();
+			ISMRMRD::MetaContainer mc;
+			ISMRMRD::deserialize(atts.c_str(), mc);
+			// (MetaContainer::map_t is not public)
+			for (auto it = mc.begin(); it != mc.end(); ++it) {
+				std::vector<std::string>& values = attributes_[it->first];
+				values.resize(n);
+				values[i] = mc.as_str(it->first.c_str());
+			}
+		}
+		attributes_indexed_ = true;
 	}
-	if (index_)
-		delete[] index_;
-	index_ = new int[ni];
-	Multisort::sort(vt, index_);
+	std::vector<std::string>& values = attributes_[attr];
+	values.resize(n);
+	return values;
 }
 
-ImagesVector::ImagesVector(ImagesVector& list, const char* attr, const char* target)
+ImagesVector::ImagesVector(ImagesVector& list, const char* attr, const char* target) :
+	nimages_(0), attributes_indexed_(false)
 {
+	std::lock_guard<std::mutex> lock(list.mutex_);
+	const std::vector<std::string>& values = list.attribute_values_(attr);
 	for (unsigned int i = 0; i < list.number(); i++) {
-		const ImageWrap& u = list.image_wrap(i);
-		std::string atts = u.attributes();
-		ISMRMRD::MetaContainer mc;
-		ISMRMRD::deserialize(atts.c_str(), mc);
-		std::string value = mc.as_str(attr);
-		if (boost::iequals(value, target))
-			append(u);
+		int j = list.index(i);
+		if (boost::iequals(values[j], target)) {
+			append_(list.images_[j], true);
+			list.shared_[j] = true;
+		}
 	}
 }
 
@@ -819,7 +1963,7 @@ ImagesVector::read(std::string filename)
 		for (int i = 0; i < num_im; i++) {
 			shared_ptr<ImageWrap> sptr_iw(new ImageWrap(im.head.data_type));
 			sptr_iw->read(*sptr_dataset, var, i);
-			images_.push_back(sptr_iw);
+			append_(sptr_iw, false);
 		}
 		//int dim[3];
 		//sptr_iw->get_dim(dim);
@@ -829,18 +1973,61 @@ ImagesVector::read(std::string filename)
 	return 0;
 }
 
+// the ISMRMRD variable name of the series of images like head
+static std::string
+image_varname_(const ISMRMRD::ImageHeader& head)
+{
+	std::stringstream ss;
+	ss << "image_" << head.image_series_index;
+	return ss.str();
+}
+
+// true if images with headers h and g can be written as one batch
+static bool
+same_image_series_(const ISMRMRD::ImageHeader& h, const ISMRMRD::ImageHeader& g)
+{
+	return h.image_series_index == g.image_series_index &&
+		h.data_type == g.data_type && h.channels == g.channels &&
+		h.matrix_size[0] == g.matrix_size[0] &&
+		h.matrix_size[1] == g.matrix_size[1] &&
+		h.matrix_size[2] == g.matrix_size[2];
+}
+
 void
 ImagesVector::write(std::string filename, std::string groupname)
 {
 	if (images_.size() < 1)
 		return;
-	Mutex mtx;
-	mtx.lock();
-	ISMRMRD::Dataset dataset(filename.c_str(), groupname.c_str());
-	mtx.unlock();
-	for (unsigned int i = 0; i < number(); i++) {
-		const ImageWrap& iw = image_wrap(i);
-		iw.write(dataset);
+	ISMRMRDWriter writer(filename, groupname);
+	unsigned int n = number();
+	std::vector<ISMRMRD::ImageHeader> heads;
+	std::vector<std::string> attributes;
+	std::vector<const char*> attr_ptrs;
+	std::vector<char> data;
+	// runs of images of the same series are copied into a batch of up
+	// to IMAGES_BATCH_BYTES and written in one go
+	for (unsigned int i = 0; i < n;) {
+		ImageWrap& iw = image_wrap(i);
+		const ISMRMRD::ImageHeader head = iw.head();
+		size_t size = iw.size();
+		unsigned int m = 1;
+		for (; i + m < n && (m + 1)*size <= IMAGES_BATCH_BYTES; m++)
+			if (!same_image_series_(head, image_wrap(i + m).head()))
+				break;
+		heads.resize(m);
+		attributes.resize(m);
+		attr_ptrs.resize(m);
+		data.resize(m*size);
+		for (unsigned int j = 0; j < m; j++) {
+			ImageWrap& iw_j = image_wrap(i + j);
+			heads[j] = iw_j.head();
+			attributes[j] = iw_j.attributes();
+			attr_ptrs[j] = attributes[j].c_str();
+			memcpy(&data[j*size], iw_j.data_ptr(), size);
+		}
+		writer.append_images(image_varname_(head), m,
+			&heads[0], &attr_ptrs[0], &data[0]);
+		i += m;
 	}
 }
 
@@ -889,14 +2076,448 @@ ImagesVector::set_complex_images_data(const float* re, const float* im)
 {
 	int dim[4];
 	for (unsigned int i = 0; i < number(); i++) {
-		const ImageWrap& iw = image_wrap(i);
-		size_t n = iw.get_dim(dim);
-		iw.set_cmplx_data(re, im);
+		shared_ptr<ImageWrap> sptr_iw = sptr_writable_image_wrap(i);
+		size_t n = sptr_iw->get_dim(dim);
+		sptr_iw->set_cmplx_data(re, im);
 		re += n;
 		im += n;
 	}
 }
 
+ImagesVolume::ImagesVolume(MRImageData& ic) : nimages_(0), size_(0)
+{
+	for (unsigned int i = 0; i < ic.number(); i++)
+		append(*ic.sptr_image_wrap(i));
+}
+
+void
+ImagesVolume::append(const ImageWrap& iw)
+{
+	int dim[4];
+	size_t n = iw.get_dim(dim);
+	if (heads_.size() > 0) {
+		const ISMRMRD::ImageHeader& h = heads_[0];
+		if (dim[0] != h.matrix_size[0] || dim[1] != h.matrix_size[1] ||
+			dim[2] != h.matrix_size[2] || dim[3] != h.channels)
+			throw LocalisedException
+			("images of a volume must have the same dimensions",
+			__FILE__, __LINE__);
+	}
+	ImageWrap& w = const_cast<ImageWrap&>(iw);
+	ISMRMRD::ImageHeader head = w.head();
+	head.data_type = ISMRMRD::ISMRMRD_CXFLOAT;
+	size_t off = data_.size();
+	data_.resize(off + n);
+	complex_float_t* ptr = &data_[off];
+	if (iw.type() == ISMRMRD::ISMRMRD_CXFLOAT)
+		memcpy(ptr, w.data_ptr(), n*sizeof(complex_float_t));
+	else {
+		std::vector<float> re(n);
+		std::vector<float> im(n, 0.0f);
+		if (iw.type() == ISMRMRD::ISMRMRD_CXDOUBLE)
+			iw.get_cmplx_data(&re[0], &im[0]);
+		else
+			iw.get_data(&re[0]);
+		for (size_t i = 0; i < n; i++)
+			ptr[i] = complex_float_t(re[i], im[i]);
+	}
+	size_ = n;
+	heads_.push_back(head);
+	attributes_.push_back(iw.attributes());
+}
+
+shared_ptr<ImageWrap>
+ImagesVolume::image_wrap_(int i) const
+{
+	const ISMRMRD::ImageHeader& head = heads_[i];
+	CFImage* ptr_im = new CFImage(head.matrix_size[0], head.matrix_size[1],
+		head.matrix_size[2], head.channels);
+	shared_ptr<ImageWrap>
+		sptr_iw(new ImageWrap(ISMRMRD::ISMRMRD_CXFLOAT, ptr_im));
+	ptr_im->setHead(head);
+	ptr_im->setAttributeString(attributes_[i]);
+	memcpy(ptr_im->getDataPtr(), &data_[i*size_],
+		size_*sizeof(complex_float_t));
+	return sptr_iw;
+}
+
+shared_ptr<ImageWrap>
+ImagesVolume::cached_image_wrap_(int i) const
+{
+	std::lock_guard<std::mutex> lock(wraps_mutex_);
+	if (wraps_.size() < heads_.size())
+		wraps_.resize(heads_.size());
+	if (!wraps_[i].get())
+		wraps_[i] = image_wrap_(i);
+	return wraps_[i];
+}
+
+void
+ImagesVolume::data_changed_()
+{
+	std::lock_guard<std::mutex> lock(wraps_mutex_);
+	wraps_.clear();
+}
+
+shared_ptr<ImageWrap>
+ImagesVolume::sptr_image_wrap(unsigned int im_num)
+{
+	return image_wrap_(index(im_num));
+}
+
+shared_ptr<const ImageWrap>
+ImagesVolume::sptr_image_wrap(unsigned int im_num) const
+{
+	return image_wrap_(index(im_num));
+}
+
+int
+ImagesVolume::read(std::string filename)
+{
+	ImagesVector images;
+	int status = images.read(filename);
+	for (unsigned int i = 0; i < images.number(); i++)
+		append(images.image_wrap(i));
+	return status;
+}
+
+void
+ImagesVolume::write(std::string filename, std::string groupname)
+{
+	if (heads_.size() < 1)
+		return;
+	ISMRMRDWriter writer(filename, groupname);
+	unsigned int n = number();
+	std::vector<ISMRMRD::ImageHeader> heads;
+	std::vector<const char*> attr_ptrs;
+	std::vector<complex_float_t> data;
+	// runs of images of the same series are written in one go, straight
+	// from the volume if it is in storage order
+	for (unsigned int i = 0; i < n;) {
+		const ISMRMRD::ImageHeader& head = heads_[index(i)];
+		unsigned int m = 1;
+		for (; i + m < n; m++)
+			if (!same_image_series_(head, heads_[index(i + m)]))
+				break;
+		heads.resize(m);
+		attr_ptrs.resize(m);
+		for (unsigned int j = 0; j < m; j++) {
+			heads[j] = heads_[index(i + j)];
+			attr_ptrs[j] = attributes_[index(i + j)].c_str();
+		}
+		const complex_float_t* ptr = &data_[i*size_];
+		if (index_.get()) {
+			data.resize(m*size_);
+			for (unsigned int j = 0; j < m; j++)
+				memcpy(&data[j*size_], &data_[index(i + j)*size_],
+					size_*sizeof(complex_float_t));
+			ptr = &data[0];
+		}
+		writer.append_images(image_varname_(head), m,
+			&heads[0], &attr_ptrs[0], ptr);
+		i += m;
+	}
+}
+
+void
+ImagesVolume::get_image_dimensions(unsigned int im_num, int* dim)
+{
+	if (im_num >= number()) {
+		dim[0] = dim[1] = dim[2] = dim[3] = 0;
+		return;
+	}
+	const ISMRMRD::ImageHeader& head = heads_[index(im_num)];
+	dim[0] = head.matrix_size[0];
+	dim[1] = head.matrix_size[1];
+	dim[2] = head.matrix_size[2];
+	dim[3] = head.channels;
+}
+
+void
+ImagesVolume::get_images_data_as_float_array(float* data)
+{
+	for (unsigned int i = 0; i < number(); i++, data += size_) {
+		const complex_float_t* ptr = &data_[index(i)*size_];
+		for (size_t j = 0; j < size_; j++)
+			data[j] = std::real(ptr[j]);
+	}
+}
+
+void
+ImagesVolume::get_images_data_as_complex_array(float* re, float* im)
+{
+	for (unsigned int i = 0; i < number(); i++, re += size_, im += size_) {
+		const complex_float_t* ptr = &data_[index(i)*size_];
+		for (size_t j = 0; j < size_; j++) {
+			re[j] = std::real(ptr[j]);
+			im[j] = std::imag(ptr[j]);
+		}
+	}
+}
+
+void
+ImagesVolume::set_complex_images_data(const float* re, const float* im)
+{
+	for (unsigned int i = 0; i < number(); i++, re += size_, im += size_) {
+		complex_float_t* ptr = &data_[index(i)*size_];
+		for (size_t j = 0; j < size_; j++)
+			ptr[j] = complex_float_t(re[j], im[j]);
+	}
+	data_changed_();
+}
+
+shared_ptr<MRImageData>
+ImagesVolume::clone(const char* attr, const char* target)
+{
+	shared_ptr<MRImageData> sptr_iv(new ImagesVolume);
+	for (unsigned int i = 0; i < number(); i++) {
+		int j = index(i);
+		ISMRMRD::MetaContainer mc;
+		ISMRMRD::deserialize(attributes_[j].c_str(), mc);
+		std::string value = mc.as_str(attr);
+		if (boost::iequals(value, target))
+			sptr_iv->append(*image_wrap_(j));
+	}
+	return sptr_iv;
+}
+
+void
+ImagesVolume::compact()
+{
+	if (!index_.get())
+		return;
+	std::vector<ISMRMRD::ImageHeader> heads(heads_.size());
+	std::vector<std::string> attributes(heads_.size());
+	std::vector<complex_float_t> data(data_.size());
+	for (unsigned int i = 0; i < number(); i++) {
+		int j = index(i);
+		heads[i] = heads_[j];
+		attributes[i] = attributes_[j];
+		memcpy(&data[i*size_], &data_[j*size_], size_*sizeof(complex_float_t));
+	}
+	heads_.swap(heads);
+	attributes_.swap(attributes);
+	data_.swap(data);
+	index_.reset();
+	data_changed_();
+}
+
+const ImagesVolume*
+ImagesVolume::volume_
+(const aDataContainer<complex_float_t>& a_x, const ImagesVolume* like)
+{
+	const ImagesVolume* x = dynamic_cast<const ImagesVolume*>(&a_x);
+	if (!x || x->heads_.size() < 1 || x->index())
+		return 0;
+	if (like && (x->heads_.size() != like->heads_.size() ||
+		x->size_ != like->size_))
+		return 0;
+	return x;
+}
+
+void
+ImagesVolume::copy_layout_(const ImagesVolume& x)
+{
+	heads_ = x.heads_;
+	attributes_ = x.attributes_;
+	nimages_ = x.nimages_;
+	size_ = x.size_;
+	data_.resize(x.data_.size());
+	data_changed_();
+}
+
+void
+ImagesVolume::assign_data_(const ImagesVolume& v)
+{
+	if (v.number() != number() || v.size_ != size_)
+		throw LocalisedException
+		("images size mismatch in ImagesVolume algebra", __FILE__, __LINE__);
+	// v is unsorted, its images are in the order of this volume's index
+	for (unsigned int i = 0; i < number(); i++)
+		memcpy(&data_[index(i)*size_], v.data() + i*size_,
+			size_*sizeof(complex_float_t));
+	data_changed_();
+}
+
+void
+ImagesVolume::axpby(
+	complex_float_t a, const aDataContainer<complex_float_t>& a_x,
+	complex_float_t b, const aDataContainer<complex_float_t>& a_y)
+{
+	const ImagesVolume* x = volume_(a_x, 0);
+	const ImagesVolume* y = x ? volume_(a_y, x) : 0;
+	if (!y || number() > 0) {
+		MRImageData::axpby(a, a_x, b, a_y);
+		return;
+	}
+	copy_layout_(*x);
+	xGadgetronKernels::axpby(data_.size(), a, x->data(), b, y->data(), data());
+}
+
+void
+ImagesVolume::multiply(
+	const aDataContainer<complex_float_t>& a_x,
+	const aDataContainer<complex_float_t>& a_y)
+{
+	const ImagesVolume* x = volume_(a_x, 0);
+	const ImagesVolume* y = x ? volume_(a_y, x) : 0;
+	if (!y || number() > 0) {
+		MRImageData::multiply(a_x, a_y);
+		return;
+	}
+	copy_layout_(*x);
+	memcpy(data(), x->data(), data_.size()*sizeof(complex_float_t));
+	xGadgetronKernels::multiply(data_.size(), y->data(), data());
+}
+
+void
+ImagesVolume::divide(
+	const aDataContainer<complex_float_t>& a_x,
+	const aDataContainer<complex_float_t>& a_y)
+{
+	const ImagesVolume* x = volume_(a_x, 0);
+	const ImagesVolume* y = x ? volume_(a_y, x) : 0;
+	if (!y || number() > 0) {
+		MRImageData::divide(a_x, a_y);
+		return;
+	}
+	// same as the image by image version: y ./ x
+	copy_layout_(*x);
+	memcpy(data(), x->data(), data_.size()*sizeof(complex_float_t));
+	xGadgetronKernels::divide(data_.size(), y->data(), data());
+}
+
+complex_float_t
+ImagesVolume::dot(const aDataContainer<complex_float_t>& dc)
+{
+	const ImagesVolume* x = volume_(*this, 0);
+	const ImagesVolume* y = x ? volume_(dc, x) : 0;
+	if (!y)
+		return MRImageData::dot(dc);
+	return (complex_float_t)xGadgetronKernels::dot
+		(data_.size(), data(), y->data());
+}
+
+float
+ImagesVolume::norm()
+{
+	// the norm does not depend on the images order
+	if (data_.size() < 1)
+		return 0.0f;
+	return (float)std::sqrt(xGadgetronKernels::norm2(data_.size(), data()));
+}
+
+void
+ImagesVolume::xapy
+(complex_float_t a, const aDataContainer<complex_float_t>& a_x)
+{
+	const ImagesVolume* self = volume_(*this, 0);
+	const ImagesVolume* x = self ? volume_(a_x, self) : 0;
+	complex_float_t one(1.0, 0.0);
+	if (x)
+		xGadgetronKernels::axpby(data_.size(), a, x->data(), one, data());
+	else {
+		// image_wrap() returns copies, which are updated and copied back
+		MRImageData& ic = (MRImageData&)a_x;
+		for (unsigned int i = 0; i < number() && i < ic.number(); i++) {
+			complex_float_t* ptr = &data_[index(i)*size_];
+			shared_ptr<ImageWrap> sptr_w = image_wrap_(index(i));
+			sptr_w->axpby(a, *ic.sptr_image_wrap(i), one);
+			memcpy(ptr, sptr_w->data_ptr(), size_*sizeof(complex_float_t));
+		}
+	}
+	data_changed_();
+}
+
+void
+ImagesVolume::linear_combination(int n, const complex_float_t* a,
+	const aDataContainer<complex_float_t>* const* a_x)
+{
+	if (n < 1)
+		return;
+	if (number() > 0) {
+		// the operands may include this volume
+		ImagesVolume v;
+		v.linear_combination(n, a, a_x);
+		assign_data_(v);
+		return;
+	}
+	const ImagesVolume* x = volume_(*a_x[0], 0);
+	for (int k = 1; k < n && x; k++)
+		if (!volume_(*a_x[k], x))
+			x = 0;
+	if (!x) {
+		MRImageData::linear_combination(n, a, a_x);
+		return;
+	}
+	copy_layout_(*x);
+	size_t m = data_.size();
+	complex_float_t zero(0.0, 0.0);
+	complex_float_t one(1.0, 0.0);
+	// image by image, so that the result stays in cache
+	for (size_t off = 0; off < m; off += size_) {
+		xGadgetronKernels::axpby
+			(size_, a[0], x->data() + off, zero, x->data() + off, data() + off);
+		for (int k = 1; k < n; k++)
+			xGadgetronKernels::axpby(size_, a[k],
+			((const ImagesVolume*)a_x[k])->data() + off, one, data() + off);
+	}
+}
+
+float
+ImagesVolume::axpby_norm(
+	complex_float_t a, const aDataContainer<complex_float_t>& a_x,
+	complex_float_t b, const aDataContainer<complex_float_t>& a_y)
+{
+	if (number() > 0) {
+		ImagesVolume v;
+		float r = v.axpby_norm(a, a_x, b, a_y);
+		assign_data_(v);
+		return r;
+	}
+	const ImagesVolume* x = volume_(a_x, 0);
+	const ImagesVolume* y = x ? volume_(a_y, x) : 0;
+	if (!y)
+		return MRImageData::axpby_norm(a, a_x, b, a_y);
+	copy_layout_(*x);
+	size_t m = data_.size();
+	double r = 0;
+	for (size_t off = 0; off < m; off += size_) {
+		xGadgetronKernels::axpby(size_, a, x->data() + off,
+			b, y->data() + off, data() + off);
+		r += xGadgetronKernels::norm2(size_, data() + off);
+	}
+	return (float)std::sqrt(r);
+}
+
+complex_float_t
+ImagesVolume::axpby_dot(
+	complex_float_t a, const aDataContainer<complex_float_t>& a_x,
+	complex_float_t b, const aDataContainer<complex_float_t>& a_y,
+	const aDataContainer<complex_float_t>& a_z)
+{
+	if (number() > 0) {
+		ImagesVolume v;
+		complex_float_t d = v.axpby_dot(a, a_x, b, a_y, a_z);
+		assign_data_(v);
+		return d;
+	}
+	const ImagesVolume* x = volume_(a_x, 0);
+	const ImagesVolume* y = x ? volume_(a_y, x) : 0;
+	const ImagesVolume* z = y ? volume_(a_z, x) : 0;
+	if (!z)
+		return MRImageData::axpby_dot(a, a_x, b, a_y, a_z);
+	copy_layout_(*x);
+	size_t m = data_.size();
+	std::complex<double> d = 0;
+	for (size_t off = 0; off < m; off += size_) {
+		xGadgetronKernels::axpby(size_, a, x->data() + off,
+			b, y->data() + off, data() + off);
+		d += xGadgetronKernels::dot(size_, data() + off, z->data() + off);
+	}
+	return (complex_float_t)d;
+}
+
 void
 CoilDataAsCFImage::get_data(float* re, float* im) const
 {
@@ -958,55 +2579,50 @@ CoilImagesContainer::compute(MRAcquisitionData& ac)
 	//else
 	//	std::cout << "parallel imaging not present\n";
 
-	int nmap = 0;
-	std::cout << "map ";
-
-	for (unsigned int na = 0; na < ac.number();) {
-
-		std::cout << ++nmap << ' ' << std::flush;
-
-		std::vector<size_t> ci_dims;
-		ci_dims.push_back(readout);
-		ci_dims.push_back(ny);
-		ci_dims.push_back(nc);
-		ISMRMRD::NDArray<complex_float_t> ci(ci_dims);
-		memset(ci.getDataPtr(), 0, ci.getDataSize());
-
-		int y = 0;
-		for (;;) {
-			ac.get_acquisition(na + y, acq);
-			if (acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_FIRST_IN_SLICE))
-				break;
-			y++;
+	// one pass over the acquisitions: the readouts of each slice, from
+	// FIRST_IN_SLICE to LAST_IN_SLICE, are copied coil by coil straight into
+	// the k-space lines of the slice coil data
+	std::vector<CFImage*> slices;
+	CFImage* ptr_ci = 0;
+	size_t nxy = (size_t)readout*ny;
+	AcquisitionsBatchReader acquisition(ac);
+	for (unsigned int a = 0; a < ac.number(); a++) {
+		ISMRMRD::Acquisition& acq = acquisition(a);
+		if (acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_FIRST_IN_SLICE)) {
+			shared_ptr<CoilData>
+				sptr_ci(new CoilDataAsCFImage(readout, ny, 1, nc));
+			ptr_ci = &(*(CoilDataAsCFImage*)sptr_ci.get()).image();
+			memset(ptr_ci->getDataPtr(), 0, ptr_ci->getDataSize());
+			slices.push_back(ptr_ci);
+			append(sptr_ci);
 		}
-		for (;;) {
-			ac.get_acquisition(na + y, acq);
-			int yy = acq.idx().kspace_encode_step_1;
-			//if (!e.parallelImaging.is_present() ||
-			if (!parallel ||
-				acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_IS_PARALLEL_CALIBRATION) ||
-				acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_IS_PARALLEL_CALIBRATION_AND_IMAGING)) {
-				for (unsigned int c = 0; c < nc; c++) {
-					for (unsigned int s = 0; s < readout; s++) {
-						ci(s, yy, c) = acq.data(s, c);
-					}
-				}
-			}
-			y++;
-			if (acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_LAST_IN_SLICE))
-				break;
+		if (!ptr_ci)
+			continue;
+		if (!parallel ||
+			acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_IS_PARALLEL_CALIBRATION) ||
+			acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_IS_PARALLEL_CALIBRATION_AND_IMAGING)) {
+			unsigned int yy = acq.idx().kspace_encode_step_1;
+			if (yy >= ny || acq.number_of_samples() != readout ||
+				acq.active_channels() != nc)
+				throw LocalisedException
+				("readout does not fit coil image", __FILE__, __LINE__);
+			const complex_float_t* src = acq.getDataPtr();
+			complex_float_t* dst = ptr_ci->getDataPtr() + (size_t)yy*readout;
+			for (unsigned int c = 0; c < nc; c++)
+				memcpy(dst + c*nxy, src + c*readout,
+				readout*sizeof(complex_float_t));
 		}
-		na += y;
-
-		ifft2c(ci);
-
-		shared_ptr<CoilData>
-			sptr_ci(new CoilDataAsCFImage(readout, ny, 1, nc));
-		CFImage& coil_im = (*(CoilDataAsCFImage*)sptr_ci.get()).image();
-		memcpy(coil_im.getDataPtr(), ci.getDataPtr(), ci.getDataSize());
-		append(sptr_ci);
+		if (acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_LAST_IN_SLICE))
+			ptr_ci = 0;
 	}
-	std::cout << '\n';
+
+	// all coils of a slice are transformed by one batched FFT,
+	// the slices concurrently
+	int nthreads = ThreadPool::num_threads();
+	parallel_for((int)slices.size(), nthreads, [&](int i) {
+		if (ifft2c(slices[i]->getDataPtr(), readout, ny, nc))
+			throw LocalisedException("FFT failed", __FILE__, __LINE__);
+	});
 }
 
 void 
@@ -1025,36 +2641,59 @@ CoilSensitivitiesContainer::compute(CoilImagesContainer& cis)
 	cm_dims.push_back(readout);
 	cm_dims.push_back(ny);
 	cm_dims.push_back(nc);
-	ISMRMRD::NDArray<complex_float_t> cm(cm_dims);
 
 	std::vector<size_t> csm_dims;
 	csm_dims.push_back(nx);
 	csm_dims.push_back(ny);
 	csm_dims.push_back(1);
 	csm_dims.push_back(nc);
-	ISMRMRD::NDArray<complex_float_t> csm(csm_dims);
 
 	std::vector<size_t> img_dims;
 	img_dims.push_back(nx);
 	img_dims.push_back(ny);
-	ISMRMRD::NDArray<float> img(img_dims);
 
-	unsigned int nmap = 0;
-
-	std::cout << "map ";
-	for (nmap = 1; nmap <= cis.items(); nmap++) {
-		std::cout << nmap << ' ' << std::flush;
-		cis(nmap - 1).get_data(cm.getDataPtr());
+	// slices are computed concurrently, the threads left over (if there
+	// are fewer slices than threads) share the coils of each slice
+	int nmaps = cis.items();
+	int nthreads = num_threads();
+	int nt_slice = std::max(1, nthreads / std::max(1, nmaps));
+	std::vector<shared_ptr<CoilData> > maps(nmaps);
+	parallel_for(nmaps, nthreads, [&](int i) {
+		ISMRMRD::NDArray<complex_float_t> cm(cm_dims);
+		ISMRMRD::NDArray<complex_float_t> csm(csm_dims);
+		ISMRMRD::NDArray<float> img(img_dims);
+		cis(i).get_data(cm.getDataPtr());
 		//CoilData* ptr_img = new CoilDataType(nx, ny, 1, nc);
 		CoilData* ptr_img = new CoilDataAsCFImage(nx, ny, 1, nc);
 		shared_ptr<CoilData> sptr_img(ptr_img);
-		compute_csm_(cm, img, csm);
+		compute_csm_(cm, img, csm, nt_slice);
 		ptr_img->set_data(csm.getDataPtr());
-		append(sptr_img);
+		maps[i] = sptr_img;
+	});
+
+	std::cout << "map ";
+	for (int i = 0; i < nmaps; i++) {
+		std::cout << i + 1 << ' ' << std::flush;
+		append(maps[i]);
 	}
 	std::cout << '\n';
 }
 
+// r[i] := sqrt of the sum over c of |u[i + c*n]|^2; the coil planes are
+// accumulated one at a time to keep the access contiguous
+static void
+root_sum_of_squares_(size_t n, unsigned int nc, const complex_float_t* u, float* r)
+{
+	std::fill(r, r + n, 0.0f);
+	for (unsigned int c = 0; c < nc; c++, u += n)
+		for (size_t i = 0; i < n; i++) {
+			float s = std::abs(u[i]);
+			r[i] += s*s;
+		}
+	for (size_t i = 0; i < n; i++)
+		r[i] = (float)std::sqrt(r[i]);
+}
+
 float 
 CoilSensitivitiesContainer::max_(int nx, int ny, float* u)
 {
@@ -1143,47 +2782,77 @@ void
 CoilSensitivitiesContainer::smoothen_
 (int nx, int ny, int nz,
 	complex_float_t* u, complex_float_t* v,
-	int* obj_mask)
-{
-	const complex_float_t ONE(1.0, 0.0);
-	const complex_float_t TWO(2.0, 0.0);
-	for (int iz = 0, i = 0; iz < nz; iz++)
-		for (int iy = 0, k = 0; iy < ny; iy++)
-			for (int ix = 0; ix < nx; ix++, i++, k++) {
-				//if (edge_mask[k]) {
-				//	v[i] = u[i];
-				//	continue;
-				//}
-				int n = 0;
-				complex_float_t r(0.0, 0.0);
-				complex_float_t s(0.0, 0.0);
-				for (int jy = -1; jy <= 1; jy++)
-					for (int jx = -1; jx <= 1; jx++) {
-						if (ix + jx < 0 || ix + jx >= nx)
-							continue;
-						if (iy + jy < 0 || iy + jy >= ny)
-							continue;
-						int j = i + jx + jy*nx;
-						int l = k + jx + jy*nx;
-						if (i != j && obj_mask[l]) { // && !edge_mask[l]) {
-							n++;
-							r += ONE;
-							s += u[j];
-						}
-					}
-				if (n > 0)
-					v[i] = (u[i] + s / r) / TWO;
-				else
-					v[i] = u[i];
+	int* obj_mask, int npasses, int nthreads)
+{
+	// Each pass replaces u at every point by the average of u and the mean
+	// of u over the object points among its 8 neighbours (u is unchanged if
+	// there are none). The 3x3 sums are computed separably, row sums first;
+	// the neighbour weights depend on the mask only and are set up once.
+	if (npasses < 1)
+		return;
+	const int nxy = nx*ny;
+	std::vector<float> m(nxy);
+	for (int i = 0; i < nxy; i++)
+		m[i] = obj_mask[i] ? 1.0f : 0.0f;
+	std::vector<float> w(nxy);
+	{
+		std::vector<float> t(nxy);
+		for (int iy = 0, i = 0; iy < ny; iy++)
+			for (int ix = 0; ix < nx; ix++, i++)
+				t[i] = m[i] + (ix > 0 ? m[i - 1] : 0.0f) +
+				(ix < nx - 1 ? m[i + 1] : 0.0f);
+		for (int iy = 0, i = 0; iy < ny; iy++)
+			for (int ix = 0; ix < nx; ix++, i++) {
+				float n = t[i] - m[i] + (iy > 0 ? t[i - nx] : 0.0f) +
+					(iy < ny - 1 ? t[i + nx] : 0.0f);
+				w[i] = n > 0 ? 1.0f / n : 0.0f;
 			}
-	memcpy(u, v, nx*ny*nz * sizeof(complex_float_t));
+	}
+
+	parallel_for(nz, nthreads, [&](int iz) {
+		complex_float_t* x = u + (size_t)iz*nxy;
+		complex_float_t* y = v + (size_t)iz*nxy;
+		std::vector<complex_float_t> t(nxy);
+		std::vector<complex_float_t> mx(nxy);
+		for (int pass = 0; pass < npasses; pass++) {
+			for (int i = 0; i < nxy; i++)
+				mx[i] = m[i] * x[i];
+			for (int iy = 0, i = 0; iy < ny; iy++)
+				for (int ix = 0; ix < nx; ix++, i++) {
+					complex_float_t r = mx[i];
+					if (ix > 0)
+						r += mx[i - 1];
+					if (ix < nx - 1)
+						r += mx[i + 1];
+					t[i] = r;
+				}
+			for (int iy = 0, i = 0; iy < ny; iy++)
+				for (int ix = 0; ix < nx; ix++, i++) {
+					if (w[i] == 0.0f) {
+						y[i] = x[i];
+						continue;
+					}
+					complex_float_t s = t[i] - mx[i];
+					if (iy > 0)
+						s += t[i - nx];
+					if (iy < ny - 1)
+						s += t[i + nx];
+					y[i] = (x[i] + s * w[i]) * 0.5f;
+				}
+			std::swap(x, y);
+		}
+		// after an odd number of passes the result is in v
+		if (npasses % 2)
+			memcpy(u + (size_t)iz*nxy, x, nxy * sizeof(complex_float_t));
+	});
 }
 
 void 
 CoilSensitivitiesContainer::compute_csm_(
 	ISMRMRD::NDArray<complex_float_t>& cm,
 	ISMRMRD::NDArray<float>& img,
-	ISMRMRD::NDArray<complex_float_t>& csm
+	ISMRMRD::NDArray<complex_float_t>& csm,
+	int nthreads
 )
 {
 	int ndims = cm.getNDim();
@@ -1214,16 +2883,7 @@ CoilSensitivitiesContainer::compute_csm_(
 	ISMRMRD::NDArray<complex_float_t> w(cm0);
 
 	float* ptr_img = img.getDataPtr();
-	for (unsigned int y = 0; y < ny; y++) {
-		for (unsigned int x = 0; x < nx; x++) {
-			float r = 0.0;
-			for (unsigned int c = 0; c < nc; c++) {
-				float s = std::abs(cm0(x, y, c));
-				r += s*s;
-			}
-			img(x, y) = (float)std::sqrt(r);
-		}
-	}
+	root_sum_of_squares_(nx*ny, nc, cm0.getDataPtr(), ptr_img);
 
 	float noise = max_(5, 5, ptr_img) + (float)1e-6*max_(nx, ny, ptr_img);
 	mask_noise_(nx, ny, ptr_img, noise, object_mask);
@@ -1231,33 +2891,19 @@ CoilSensitivitiesContainer::compute_csm_(
 	cleanup_mask_(nx, ny, object_mask, 0, 3, 0);
 	cleanup_mask_(nx, ny, object_mask, 0, 4, 0);
 
-	for (int i = 0; i < csm_smoothness_; i++)
-		smoothen_(nx, ny, nc, cm0.getDataPtr(), w.getDataPtr(), object_mask);
+	smoothen_(nx, ny, nc, cm0.getDataPtr(), w.getDataPtr(), object_mask,
+		csm_smoothness_, nthreads);
 
-	for (unsigned int y = 0; y < ny; y++) {
-		for (unsigned int x = 0; x < nx; x++) {
-			float r = 0.0;
-			for (unsigned int c = 0; c < nc; c++) {
-				float s = std::abs(cm0(x, y, c));
-				r += s*s;
-			}
-			img(x, y) = (float)std::sqrt(r);
-		}
-	}
+	root_sum_of_squares_(nx*ny, nc, cm0.getDataPtr(), ptr_img);
 
-	for (unsigned int y = 0, i = 0; y < ny; y++) {
-		for (unsigned int x = 0; x < nx; x++, i++) {
-			float r = img(x, y);
-			float s;
-			if (r != 0.0)
-				s = (float)(1.0 / r);
-			else
-				s = 0.0;
-			complex_float_t z(s, 0.0);
-			for (unsigned int c = 0; c < nc; c++) {
-				csm(x, y, 0, c) = cm0(x, y, c) * z;
-			}
-		}
+	// img := 1/img where nonzero
+	for (unsigned int i = 0; i < nx*ny; i++)
+		ptr_img[i] = ptr_img[i] != 0.0 ? (float)(1.0 / ptr_img[i]) : 0.0f;
+	for (unsigned int c = 0; c < nc; c++) {
+		const complex_float_t* u = cm0.getDataPtr() + (size_t)c*nx*ny;
+		complex_float_t* v = csm.getDataPtr() + (size_t)c*nx*ny;
+		for (unsigned int i = 0; i < nx*ny; i++)
+			v[i] = u[i] * ptr_img[i];
 	}
 
 	delete[] object_mask;
@@ -1281,3 +2927,257 @@ CoilSensitivitiesAsImages::CoilSensitivitiesAsImages(const char* file)
 	}
 	csm_smoothness_ = 0;
 }
+
+void
+MRCoilCompression::compute(MRAcquisitionData& ac)
+{
+	unsigned int na = ac.number();
+	int nc = 0;
+	// coil covariances of calibration and of other imaging readouts
+	std::vector<complex_double_t> cal;
+	std::vector<complex_double_t> img;
+	unsigned int ncal = 0;
+	unsigned int nimg = 0;
+	AcquisitionsBatchReader acquisition(ac);
+	for (unsigned int a = 0; a < na; a++) {
+		ISMRMRD::Acquisition& acq = acquisition(a);
+		if (TO_BE_IGNORED(acq))
+			continue;
+		bool calibration =
+			acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_IS_PARALLEL_CALIBRATION) ||
+			acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_IS_PARALLEL_CALIBRATION_AND_IMAGING);
+		if (nc == 0) {
+			nc = acq.active_channels();
+			cal.assign(nc*nc, complex_double_t(0.0));
+			img.assign(nc*nc, complex_double_t(0.0));
+		}
+		else if (acq.active_channels() != nc)
+			throw LocalisedException
+			("acquisitions with different numbers of coils", __FILE__, __LINE__);
+		std::vector<complex_double_t>& cov = calibration ? cal : img;
+		if (calibration)
+			ncal++;
+		else
+			nimg++;
+		unsigned int ns = acq.number_of_samples();
+		const complex_float_t* x = acq.getDataPtr();
+		for (int j = 0; j < nc; j++)
+			for (int i = 0; i <= j; i++)
+				cov[i + j*nc] +=
+					xGadgetronKernels::dot(ns, x + i*ns, x + j*ns);
+	}
+	if (nc == 0)
+		throw LocalisedException
+		("no data for coil compression", __FILE__, __LINE__);
+	if (ncal == 0)
+		cal.swap(img);
+	for (int j = 0; j < nc; j++)
+		for (int i = 0; i < j; i++)
+			cal[j + i*nc] = std::conj(cal[i + j*nc]);
+
+	std::vector<complex_double_t> v;
+	std::vector<double> w;
+	eigh_(nc, cal, v, w);
+
+	// principal components first
+	std::vector<int> order(nc);
+	for (int i = 0; i < nc; i++)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(),
+		[&w](int i, int j) { return w[i] > w[j]; });
+	eigenvalues_.resize(nc);
+	eigenvectors_.resize(nc*nc);
+	for (int j = 0; j < nc; j++) {
+		int k = order[j];
+		eigenvalues_[j] = std::max(0.0, w[k]);
+		std::copy(v.begin() + k*nc, v.begin() + (k + 1)*nc,
+			eigenvectors_.begin() + j*nc);
+	}
+	num_coils_ = nc;
+	select_virtual_coils_();
+}
+
+void
+MRCoilCompression::select_virtual_coils_()
+{
+	if (ncv_ > 0) {
+		num_vcoils_ = std::min(ncv_, num_coils_);
+		return;
+	}
+	double total = 0.0;
+	for (int i = 0; i < num_coils_; i++)
+		total += eigenvalues_[i];
+	double s = 0.0;
+	num_vcoils_ = 0;
+	while (num_vcoils_ < num_coils_ && (num_vcoils_ == 0 || s < energy_*total))
+		s += eigenvalues_[num_vcoils_++];
+}
+
+void
+MRCoilCompression::check_ready_() const
+{
+	if (num_coils_ < 1)
+		throw LocalisedException
+		("coil compression matrix not computed", __FILE__, __LINE__);
+}
+
+void
+MRCoilCompression::combine_coils_
+(size_t n, const complex_float_t* x, complex_float_t* y) const
+{
+	int nc = num_coils_;
+	for (int v = 0; v < num_vcoils_; v++) {
+		complex_float_t* yv = y + v*n;
+		std::fill(yv, yv + n, complex_float_t(0.0));
+		for (int c = 0; c < nc; c++) {
+			complex_float_t a = (complex_float_t)std::conj(eigenvectors_[c + v*nc]);
+			xGadgetronKernels::axpby(n, a, x + c*n, complex_float_t(1.0), yv);
+		}
+	}
+}
+
+shared_ptr<MRAcquisitionData>
+MRCoilCompression::compress(MRAcquisitionData& ac) const
+{
+	check_ready_();
+	int nv = num_vcoils_;
+
+	ISMRMRD::IsmrmrdHeader header;
+	ISMRMRD::deserialize(ac.acquisitions_info().c_str(), header);
+	if (header.acquisitionSystemInformation.is_present()) {
+		ISMRMRD::AcquisitionSystemInformation& asi =
+			header.acquisitionSystemInformation();
+		asi.receiverChannels = (unsigned short)nv;
+		if (asi.coilLabel.size() > 0) {
+			asi.coilLabel.resize(nv);
+			for (int v = 0; v < nv; v++) {
+				asi.coilLabel[v].coilNumber = v;
+				asi.coilLabel[v].coilName = "VC" + std::to_string(v);
+			}
+		}
+	}
+	std::stringstream info;
+	ISMRMRD::serialize(header, info);
+
+	shared_ptr<MRAcquisitionData>
+		sptr_ac(ac.same_acquisitions_container(AcquisitionsInfo(info.str())));
+	unsigned int na = ac.number();
+	int nthreads = ThreadPool::num_threads();
+	std::vector<ISMRMRD::Acquisition> acqs;
+	std::vector<ISMRMRD::Acquisition> vacqs;
+	for (unsigned int a = 0; a < na; a += ACQUISITIONS_BATCH) {
+		unsigned int count = std::min(na - a, (unsigned int)ACQUISITIONS_BATCH);
+		ac.get_acquisitions(a, count, acqs);
+		vacqs.resize(count);
+		parallel_for((int)count, nthreads, [&](int i) {
+			ISMRMRD::Acquisition& acq = acqs[i];
+			if (acq.active_channels() != num_coils_)
+				throw LocalisedException
+				("coil compression matrix does not match acquisitions",
+				__FILE__, __LINE__);
+			ISMRMRD::Acquisition& vacq = vacqs[i];
+			vacq.setHead(acq.getHead());
+			vacq.resize(acq.number_of_samples(), nv, acq.trajectory_dimensions());
+			vacq.available_channels() = nv;
+			vacq.setAllChannelsNotActive();
+			for (int v = 0; v < nv; v++)
+				vacq.setChannelActive(v);
+			size_t nt = acq.getNumberOfTrajElements();
+			if (nt > 0)
+				std::copy(acq.getTrajPtr(), acq.getTrajPtr() + nt, vacq.getTrajPtr());
+			combine_coils_(acq.number_of_samples(), acq.getDataPtr(),
+				vacq.getDataPtr());
+		});
+		sptr_ac->append_acquisitions(vacqs);
+	}
+	// get_acquisition() has applied the input sorting index
+	sptr_ac->set_ordered(ac.ordered());
+	return sptr_ac;
+}
+
+shared_ptr<CoilSensitivitiesContainer>
+MRCoilCompression::compress(CoilSensitivitiesContainer& cc) const
+{
+	check_ready_();
+	int nv = num_vcoils_;
+	shared_ptr<CoilSensitivitiesContainer>
+		sptr_cc(new CoilSensitivitiesAsImages);
+	unsigned int n = cc.items();
+	for (unsigned int i = 0; i < n; i++) {
+		int dim[4];
+		cc.get_dim(i, dim);
+		if (dim[3] != num_coils_)
+			throw LocalisedException
+			("coil compression matrix does not match coil sensitivities",
+			__FILE__, __LINE__);
+		size_t nxyz = (size_t)dim[0] * dim[1] * dim[2];
+		std::vector<complex_float_t> u(nxyz*num_coils_);
+		cc.get_data(i, &u[0]);
+		CoilData* ptr_cd = new CoilDataAsCFImage(dim[0], dim[1], dim[2], nv);
+		shared_ptr<CoilData> sptr_cd(ptr_cd);
+		std::vector<complex_float_t> v(nxyz*nv);
+		combine_coils_(nxyz, &u[0], &v[0]);
+		ptr_cd->set_data(&v[0]);
+		sptr_cc->append(sptr_cd);
+	}
+	return sptr_cc;
+}
+
+void
+MRCoilCompression::eigh_(int n, std::vector<complex_double_t>& a,
+	std::vector<complex_double_t>& v, std::vector<double>& w)
+{
+	v.assign(n*n, complex_double_t(0.0));
+	for (int i = 0; i < n; i++)
+		v[i + i*n] = 1.0;
+	for (int sweep = 0; sweep < 50; sweep++) {
+		double off = 0.0;
+		double diag = 0.0;
+		for (int j = 0; j < n; j++) {
+			diag += std::norm(a[j + j*n]);
+			for (int i = 0; i < j; i++)
+				off += std::norm(a[i + j*n]);
+		}
+		if (off <= 1e-30*diag)
+			break;
+		for (int q = 1; q < n; q++) {
+			for (int p = 0; p < q; p++) {
+				double r = std::abs(a[p + q*n]);
+				if (r == 0.0)
+					continue;
+				// unitary scaling of column and row q making a_pq real...
+				complex_double_t ph = a[p + q*n] / r;
+				for (int k = 0; k < n; k++) {
+					a[k + q*n] *= std::conj(ph);
+					v[k + q*n] *= std::conj(ph);
+				}
+				for (int k = 0; k < n; k++)
+					a[q + k*n] *= ph;
+				// ...followed by the real Jacobi rotation annihilating it
+				double theta =
+					0.5*std::atan2(2 * r, (a[q + q*n] - a[p + p*n]).real());
+				double c = std::cos(theta);
+				double s = std::sin(theta);
+				for (int k = 0; k < n; k++) {
+					complex_double_t akp = a[k + p*n];
+					complex_double_t akq = a[k + q*n];
+					a[k + p*n] = c*akp - s*akq;
+					a[k + q*n] = s*akp + c*akq;
+					complex_double_t vkp = v[k + p*n];
+					complex_double_t vkq = v[k + q*n];
+					v[k + p*n] = c*vkp - s*vkq;
+					v[k + q*n] = s*vkp + c*vkq;
+				}
+				for (int k = 0; k < n; k++) {
+					complex_double_t apk = a[p + k*n];
+					complex_double_t aqk = a[q + k*n];
+					a[p + k*n] = c*apk - s*aqk;
+					a[q + k*n] = s*apk + c*aqk;
+				}
+			}
+		}
+	}
+	w.resize(n);
+	for (int i = 0; i < n; i++)
+		w[i] = a[i + i*n].real();
+}
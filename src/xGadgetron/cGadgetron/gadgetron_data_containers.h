@@ -30,7 +30,16 @@ limitations under the License.
 #ifndef GADGETRON_DATA_CONTAINERS
 #define GADGETRON_DATA_CONTAINERS
 
+#include <algorithm>
+#include <list>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include <boost/algorithm/string.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/align/aligned_alloc.hpp>
 
 #include <ismrmrd/ismrmrd.h>
 #include <ismrmrd/dataset.h>
@@ -42,6 +51,9 @@ limitations under the License.
 #include "gadgetron_image_wrap.h"
 #include "SIRF/common/data_container.h"
 #include "SIRF/common/multisort.h"
+#include "SIRF/common/storage_budget.h"
+#include "SIRF/common/thread_pool.h"
+#include "localised_exception.h"
 
 /*!
 \ingroup Gadgetron Data Containers
@@ -82,27 +94,63 @@ namespace sirf {
 
 	/*!
 	\ingroup Gadgetron Data Containers
-	\brief Abstract MR acquisition data container class.
+	\brief Header fields of all acquisitions of a container, kept in
+	compact arrays in storage order.
 
+	Dimension and flag queries and sorting only need these fields.
 	*/
-	class MRAcquisitionData : public aDataContainer < complex_float_t > {
+	class AcquisitionHeadersIndex {
 	public:
-		MRAcquisitionData() : ordered_(false), index_(0) {}
-		virtual ~MRAcquisitionData()
+		unsigned int size() const { return (unsigned int)flags.size(); }
+		void resize(unsigned int n)
+		{
+			flags.resize(n);
+			number_of_samples.resize(n);
+			active_channels.resize(n);
+			kspace_encode_step_1.resize(n);
+			slice.resize(n);
+			repetition.resize(n);
+		}
+		void set(unsigned int i, const ISMRMRD::AcquisitionHeader& head)
+		{
+			flags[i] = head.flags;
+			number_of_samples[i] = head.number_of_samples;
+			active_channels[i] = head.active_channels;
+			kspace_encode_step_1[i] = head.idx.kspace_encode_step_1;
+			slice[i] = head.idx.slice;
+			repetition[i] = head.idx.repetition;
+		}
+		void append(const ISMRMRD::AcquisitionHeader& head)
 		{
-			if (index_)
-				delete[] index_;
+			resize(size() + 1);
+			set(size() - 1, head);
 		}
 
+		std::vector<uint64_t> flags;
+		std::vector<uint16_t> number_of_samples;
+		std::vector<uint16_t> active_channels;
+		std::vector<uint16_t> kspace_encode_step_1;
+		std::vector<uint16_t> slice;
+		std::vector<uint16_t> repetition;
+	};
+
+	/*!
+	\ingroup Gadgetron Data Containers
+	\brief Abstract MR acquisition data container class.
+
+	*/
+	class MRAcquisitionData : public aDataContainer < complex_float_t > {
+	public:
+		MRAcquisitionData() : ordered_(false) {}
+		virtual ~MRAcquisitionData() {}
+
 		// static methods
 
+		// "file" (default), "memory", "block" or "hybrid"
 		static std::string storage_scheme()
 		{
-			static bool initialized = false;
-			if (!initialized) {
+			if (_storage_scheme.size() < 1)
 				_storage_scheme = "file";
-				initialized = true;
-			}
 			return _storage_scheme;
 		}
 
@@ -138,6 +186,17 @@ namespace sirf {
 		virtual void set_acquisition(unsigned int num, ISMRMRD::Acquisition& acq) = 0;
 		virtual void append_acquisition(ISMRMRD::Acquisition& acq) = 0;
 
+		// batched access (the default implementations call the above
+		// for each acquisition):
+		// copies acquisitions first, ..., first + count - 1 to acqs
+		virtual void get_acquisitions(unsigned int first, unsigned int count,
+			std::vector<ISMRMRD::Acquisition>& acqs);
+		// appends all acquisitions in acqs
+		virtual void append_acquisitions(std::vector<ISMRMRD::Acquisition>& acqs);
+		// header fields of all acquisitions in storage order (the default
+		// implementation reads all acquisitions)
+		virtual gadgetron::shared_ptr<AcquisitionHeadersIndex> headers_index();
+
 		virtual void copy_acquisitions_info(const MRAcquisitionData& ac) = 0;
 
 		// 'export' constructors: workaround for creating 'ABC' objects
@@ -161,6 +220,20 @@ namespace sirf {
 		virtual complex_float_t dot(const aDataContainer<complex_float_t>& dc);
 		virtual float norm();
 		//float diff(MRAcquisitionData& other);
+		// fused operations, one pass over the acquisitions; the results
+		// are appended to an empty container and overwrite the acquisitions
+		// of a non-empty one, which may be among the operands
+		virtual void xapy
+			(complex_float_t a, const aDataContainer<complex_float_t>& a_x);
+		virtual void linear_combination(int n, const complex_float_t* a,
+			const aDataContainer<complex_float_t>* const* a_x);
+		virtual float axpby_norm(
+			complex_float_t a, const aDataContainer<complex_float_t>& a_x,
+			complex_float_t b, const aDataContainer<complex_float_t>& a_y);
+		virtual complex_float_t axpby_dot(
+			complex_float_t a, const aDataContainer<complex_float_t>& a_x,
+			complex_float_t b, const aDataContainer<complex_float_t>& a_y,
+			const aDataContainer<complex_float_t>& a_z);
 
 		// regular methods
 
@@ -174,26 +247,40 @@ namespace sirf {
 		void get_acquisitions_flags(unsigned int n, int* flags);
 		unsigned int get_acquisitions_data(unsigned int slice, float* re, float* im);
 
+		// sorts the acquisitions by repetition, slice and phase encoding
+		// step via a permutation index
 		void order();
 		bool ordered() const { return ordered_; }
 		void set_ordered(bool ordered) { ordered_ = ordered; }
-		int* index() { return index_; }
-		const int* index() const { return index_; }
+		int* index() { return index_.get() ? &(*index_)[0] : 0; }
+		const int* index() const { return index_.get() ? &(*index_)[0] : 0; }
 		int index(int i)
 		{
-			if (index_ && i >= 0 && i < (int)number())
-				return index_[i];
+			if (index_.get() && i >= 0 && i < (int)number())
+				return (*index_)[i];
 			else
 				return i;
 		}
+		// the permutation index is not copied but shared with ac
+		void share_index(const MRAcquisitionData& ac)
+		{
+			index_ = ac.index_;
+		}
+		// stores the acquisitions physically in sorted order
+		// (and drops the index), so that later scans through them are
+		// sequential
+		virtual void compact();
 
 		void write(const char* filename);
 
 	protected:
 		bool ordered_;
-		int* index_;
+		gadgetron::shared_ptr<std::vector<int> > index_;
 		AcquisitionsInfo acqs_info_;
 
+		// throws if acquisitions first, ..., first + count - 1 do not exist
+		void check_range_(unsigned int first, unsigned int count);
+
 		static std::string _storage_scheme;
 		// new MRAcquisitionData objects will be created from this template
 		// using same_acquisitions_container()
@@ -205,10 +292,21 @@ namespace sirf {
 	\brief File implementation of Abstract MR acquisition data container class.
 
 	Acquisitions are stored in HDF5 file.
+
+	HDF5 calls are serialised by the global Mutex, the rest of the object
+	state is protected by a per-object mutex. The file is read in pages of
+	consecutive acquisitions. In read-only mode each reading thread keeps its
+	own page, so that threads reading different ranges of the same file
+	rarely wait for each other.
+
+	If the cache size is non-zero, the object keeps the most recently used
+	pages in memory up to that many bytes, reads the next page ahead during
+	sequential scans, and appended acquisitions are written to the file a
+	page at a time.
 	*/
 	class AcquisitionsFile : public MRAcquisitionData {
 	public:
-		AcquisitionsFile() { own_file_ = false; }
+		AcquisitionsFile() { own_file_ = false; init_(); }
 		AcquisitionsFile
 			(std::string filename, bool create_file = false,
 			AcquisitionsInfo info = AcquisitionsInfo());
@@ -228,14 +326,46 @@ namespace sirf {
 		{
 			init();
 			acqs_templ_.reset(new AcquisitionsFile);
+			_storage_scheme = "file";
 		}
 
 		// implements 'overwriting' of an acquisition file data with new values:
 		// in reality, creates new file with new data and deletes the old one
+		// (if ac is not an AcquisitionsFile, its acquisitions are first
+		// copied to a new scratch file)
 		void take_over(MRAcquisitionData& ac);
 
 		void write_acquisitions_info();
 
+		// in read-only mode appending to the file is disabled and
+		// acquisitions are read in blocks by each thread
+		void set_read_only(bool read_only);
+		bool read_only() const { return read_only_; }
+
+		// page cache size in bytes for objects created from now on
+		// (0, the default, disables caching)
+		static void set_default_cache_size(size_t bytes)
+		{
+			default_cache_size_ = bytes;
+		}
+		static size_t default_cache_size() { return default_cache_size_; }
+		void set_cache_size(size_t bytes);
+		size_t cache_size() const { return cache_size_; }
+		// number of pages read ahead of a sequential scan
+		void set_readahead(unsigned int pages) { readahead_ = pages; }
+		// page requests served from the cache and from the file
+		unsigned long cache_hits();
+		unsigned long cache_misses();
+		// writes appended acquisitions still kept in memory to the file
+		void flush();
+
+		// acquisitions cannot be overwritten in place, hence xapy is 
+		// implemented via take_over()
+		virtual void xapy
+			(complex_float_t a, const aDataContainer<complex_float_t>& a_x);
+		// so is compact()
+		virtual void compact();
+
 		// implementations of abstract methods
 
 		virtual int set_acquisition_data
@@ -248,6 +378,13 @@ namespace sirf {
 			std::cerr << "AcquisitionsFile::set_acquisition not implemented yet, sorry\n";
 		}
 		virtual void append_acquisition(ISMRMRD::Acquisition& acq);
+		// each of the following holds the HDF5 lock once for the whole batch
+		virtual void get_acquisitions(unsigned int first, unsigned int count,
+			std::vector<ISMRMRD::Acquisition>& acqs);
+		virtual void append_acquisitions(std::vector<ISMRMRD::Acquisition>& acqs);
+		// built once from the acquisition headers alone and kept up to date
+		// by appending
+		virtual gadgetron::shared_ptr<AcquisitionHeadersIndex> headers_index();
 		virtual void copy_acquisitions_info(const MRAcquisitionData& ac);
 		virtual MRAcquisitionData*
 			same_acquisitions_container(AcquisitionsInfo info)
@@ -268,9 +405,48 @@ namespace sirf {
 		}
 
 	private:
+		// consecutive acquisitions stored in the file from first on,
+		// first being a multiple of the page size
+		struct Page {
+			unsigned int first;
+			size_t bytes;
+			std::vector<ISMRMRD::Acquisition> acqs;
+		};
+		typedef std::list<gadgetron::shared_ptr<Page> > PageList;
+
+		static size_t default_cache_size_;
+
 		bool own_file_;
+		bool read_only_;
+		// number of acquisitions, including those not yet written
+		unsigned int nacq_;
 		std::string filename_;
 		gadgetron::shared_ptr<ISMRMRD::Dataset> dataset_;
+		gadgetron::shared_ptr<boost::mutex> sptr_mutex_;
+		// pages used by reading threads in read-only mode
+		std::map<std::thread::id, gadgetron::shared_ptr<Page> > blocks_;
+		// cached pages, most recently used first
+		PageList pages_;
+		std::map<unsigned int, PageList::iterator> page_map_;
+		size_t cache_size_;
+		size_t cached_bytes_;
+		unsigned int readahead_;
+		unsigned int last_page_;
+		unsigned long hits_;
+		unsigned long misses_;
+		// appended acquisitions not yet written to the file
+		std::vector<ISMRMRD::Acquisition> pending_;
+		// header fields of the acquisitions, built on first request
+		gadgetron::shared_ptr<AcquisitionHeadersIndex> headers_;
+
+		void init_();
+		// returns the page starting at first, from the cache if there
+		gadgetron::shared_ptr<Page> page_(unsigned int first);
+		// the methods below expect the per-object mutex to be locked
+		void flush_();
+		void cache_page_(gadgetron::shared_ptr<Page> sptr_page);
+		void uncache_page_(unsigned int first);
+		void evict_();
 	};
 
 	/*!
@@ -292,6 +468,7 @@ namespace sirf {
 		{
 			init();
 			acqs_templ_.reset(new AcquisitionsVector);
+			_storage_scheme = "memory";
 		}
 		virtual unsigned int number() { return (unsigned int)acqs_.size(); }
 		virtual unsigned int items() { return (unsigned int)acqs_.size(); }
@@ -305,6 +482,21 @@ namespace sirf {
 			int ind = index(num);
 			acq = *acqs_[ind];
 		}
+		virtual void get_acquisitions(unsigned int first, unsigned int count,
+			std::vector<ISMRMRD::Acquisition>& acqs)
+		{
+			check_range_(first, count);
+			acqs.resize(count);
+			for (unsigned int i = 0; i < count; i++)
+				acqs[i] = *acqs_[index(first + i)];
+		}
+		virtual void append_acquisitions(std::vector<ISMRMRD::Acquisition>& acqs)
+		{
+			acqs_.reserve(acqs_.size() + acqs.size());
+			for (size_t i = 0; i < acqs.size(); i++)
+				acqs_.push_back(gadgetron::shared_ptr<ISMRMRD::Acquisition>
+					(new ISMRMRD::Acquisition(acqs[i])));
+		}
 		virtual void set_acquisition(unsigned int num, ISMRMRD::Acquisition& acq)
 		{
 			int ind = index(num);
@@ -316,6 +508,8 @@ namespace sirf {
 		}
 		virtual int set_acquisition_data
 			(int na, int nc, int ns, const float* re, const float* im);
+		virtual void compact();
+		virtual gadgetron::shared_ptr<AcquisitionHeadersIndex> headers_index();
 		virtual MRAcquisitionData* same_acquisitions_container(AcquisitionsInfo info)
 		{
 			return new AcquisitionsVector(info);
@@ -338,17 +532,176 @@ namespace sirf {
 
 	/*!
 	\ingroup Gadgetron Data Containers
-	\brief Abstract MR image data container class.
+	\brief A contiguous block implementation of the abstract MR acquisition
+	data container class.
 
+	Acquisition headers are stored in an std::vector, and the samples of all
+	acquisitions one after another in a single aligned slab, so that the 
+	acquisition data algebra streams through memory.
 	*/
-	class MRImageData : public aDataContainer < complex_float_t > {
+	class AcquisitionsBlock : public MRAcquisitionData {
 	public:
-		MRImageData() : ordered_(false), index_(0) {}
-		virtual ~MRImageData()
+		AcquisitionsBlock(AcquisitionsInfo info = AcquisitionsInfo()) :
+			slab_(0), size_(0), capacity_(0)
+		{
+			acqs_info_ = info;
+			init_buffer_();
+		}
+		static void init() { AcquisitionsFile::init(); }
+		static void set_as_template()
+		{
+			init();
+			acqs_templ_.reset(new AcquisitionsBlock);
+			_storage_scheme = "block";
+		}
+		virtual unsigned int number() { return (unsigned int)heads_.size(); }
+		virtual unsigned int items() { return (unsigned int)heads_.size(); }
+		virtual void append_acquisition(ISMRMRD::Acquisition& acq);
+		// grows the slab once for the whole batch
+		virtual void append_acquisitions(std::vector<ISMRMRD::Acquisition>& acqs);
+		virtual void get_acquisition(unsigned int num, ISMRMRD::Acquisition& acq);
+		virtual void set_acquisition(unsigned int num, ISMRMRD::Acquisition& acq);
+		virtual void copy_acquisitions_info(const MRAcquisitionData& ac)
+		{
+			acqs_info_ = ac.acquisitions_info();
+		}
+		virtual int set_acquisition_data
+			(int na, int nc, int ns, const float* re, const float* im);
+		// rebuilds the slab in sorted order
+		virtual void compact();
+		virtual gadgetron::shared_ptr<AcquisitionHeadersIndex> headers_index();
+		virtual MRAcquisitionData* same_acquisitions_container(AcquisitionsInfo info)
 		{
-			if (index_)
-				delete[] index_;
+			return new AcquisitionsBlock(info);
 		}
+		virtual aDataContainer<complex_float_t>* new_data_container()
+		{
+			AcquisitionsFile::init();
+			return acqs_templ_->same_acquisitions_container(acqs_info_);
+		}
+		virtual gadgetron::shared_ptr<MRAcquisitionData> new_acquisitions_container()
+		{
+			AcquisitionsFile::init();
+			return gadgetron::shared_ptr<MRAcquisitionData>
+				(acqs_templ_->same_acquisitions_container(acqs_info_));
+		}
+
+		// acquisition data algebra: streams through the slabs if all operands
+		// are regular AcquisitionsBlock objects of the same layout, otherwise
+		// falls back to MRAcquisitionData algebra
+		virtual void axpby(
+			complex_float_t a, const aDataContainer<complex_float_t>& a_x,
+			complex_float_t b, const aDataContainer<complex_float_t>& a_y);
+		virtual void multiply(
+			const aDataContainer<complex_float_t>& a_x,
+			const aDataContainer<complex_float_t>& a_y);
+		virtual void divide(
+			const aDataContainer<complex_float_t>& a_x,
+			const aDataContainer<complex_float_t>& a_y);
+		virtual complex_float_t dot(const aDataContainer<complex_float_t>& dc);
+		virtual float norm();
+		virtual void xapy
+			(complex_float_t a, const aDataContainer<complex_float_t>& a_x);
+		virtual float axpby_norm(
+			complex_float_t a, const aDataContainer<complex_float_t>& a_x,
+			complex_float_t b, const aDataContainer<complex_float_t>& a_y);
+		virtual complex_float_t axpby_dot(
+			complex_float_t a, const aDataContainer<complex_float_t>& a_x,
+			complex_float_t b, const aDataContainer<complex_float_t>& a_y,
+			const aDataContainer<complex_float_t>& a_z);
+
+		// direct access to acquisition samples (channels major, samples minor)
+		complex_float_t* data(unsigned int num)
+		{
+			return slab_ + data_off_[index(num)];
+		}
+		unsigned int data_size(unsigned int num)
+		{
+			const ISMRMRD::AcquisitionHeader& head = heads_[index(num)];
+			return head.number_of_samples*head.active_channels;
+		}
+		// all samples of all acquisitions in storage order
+		complex_float_t* slab() { return slab_; }
+		size_t slab_size() const { return size_; }
+		// appends an acquisition with header head, the samples and trajectory
+		// to be written in place at the returned data and traj (0 if none)
+		void append_acquisition(const ISMRMRD::AcquisitionHeader& head,
+			complex_float_t** data, float** traj);
+		// reserves storage for n more acquisitions with header like head
+		void reserve(unsigned int n, const ISMRMRD::AcquisitionHeader& head);
+
+	protected:
+		// the slab is accounted against the StorageBudget if hybrid is true
+		AcquisitionsBlock(AcquisitionsInfo info, bool hybrid) :
+			buffer_(hybrid), slab_(0), size_(0), capacity_(0)
+		{
+			acqs_info_ = info;
+			init_buffer_();
+		}
+
+	private:
+		std::vector<ISMRMRD::AcquisitionHeader> heads_;
+		std::vector<size_t> data_off_;
+		std::vector<size_t> traj_off_;
+		std::vector<float> traj_;
+		SpillableBuffer buffer_;
+		complex_float_t* slab_;
+		size_t size_;
+		size_t capacity_;
+
+		void init_buffer_()
+		{
+			buffer_.set_move_callback
+				([this](void* ptr) { slab_ = (complex_float_t*)ptr; });
+		}
+
+		// true if no acquisition is to be ignored and there is no re-ordering
+		bool regular_();
+		bool same_layout_(const AcquisitionsBlock& other) const;
+		// makes this an empty-data copy of the acquisitions layout of other
+		void copy_layout_(const AcquisitionsBlock& other);
+		// grows the slab geometrically, or to size exactly if exact is true
+		void reserve_(size_t size, bool exact = false);
+		// true if the fused algebra may stream through the slabs
+		bool fast_(const AcquisitionsBlock* px, const AcquisitionsBlock* py);
+	};
+
+	/*!
+	\ingroup Gadgetron Data Containers
+	\brief A memory-budgeted implementation of the abstract MR acquisition
+	data container class.
+
+	An AcquisitionsBlock whose slab stays in memory while the StorageBudget
+	allows, and is moved to a memory-mapped scratch file when the budget is
+	exceeded and it is the least recently used one.
+	*/
+	class AcquisitionsHybrid : public AcquisitionsBlock {
+	public:
+		AcquisitionsHybrid(AcquisitionsInfo info = AcquisitionsInfo()) :
+			AcquisitionsBlock(info, true)
+		{}
+		static void init() { AcquisitionsFile::init(); }
+		static void set_as_template()
+		{
+			init();
+			acqs_templ_.reset(new AcquisitionsHybrid);
+			_storage_scheme = "hybrid";
+		}
+		virtual MRAcquisitionData* same_acquisitions_container(AcquisitionsInfo info)
+		{
+			return new AcquisitionsHybrid(info);
+		}
+	};
+
+	/*!
+	\ingroup Gadgetron Data Containers
+	\brief Abstract MR image data container class.
+
+	*/
+	class MRImageData : public aDataContainer < complex_float_t > {
+	public:
+		MRImageData() : ordered_(false) {}
+		virtual ~MRImageData() {}
 
 		virtual unsigned int number() = 0;
 		virtual int types() = 0;
@@ -358,6 +711,14 @@ namespace sirf {
 			(unsigned int im_num) const = 0;
 		virtual ImageWrap& image_wrap(unsigned int im_num) = 0;
 		virtual const ImageWrap& image_wrap(unsigned int im_num) const = 0;
+		// as sptr_image_wrap, for modifying the image in place: a container
+		// sharing the image with another one (see ImagesVector) copies it
+		// first
+		virtual gadgetron::shared_ptr<ImageWrap> sptr_writable_image_wrap
+			(unsigned int im_num)
+		{
+			return sptr_image_wrap(im_num);
+		}
 		virtual void append(int image_data_type, void* ptr_image) = 0;
 		virtual void append(const ImageWrap& iw) = 0;
 		virtual void get_image_dimensions(unsigned int im_num, int* dim) = 0;
@@ -374,6 +735,10 @@ namespace sirf {
 		{
 			return image_wrap(im_num).type();
 		}
+		virtual const ISMRMRD::ImageHeader& image_header(unsigned int im_num)
+		{
+			return image_wrap(im_num).head();
+		}
 
 		virtual void axpby(
 			complex_float_t a, const aDataContainer<complex_float_t>& a_x,
@@ -386,6 +751,21 @@ namespace sirf {
 			const aDataContainer<complex_float_t>& a_y);
 		virtual complex_float_t dot(const aDataContainer<complex_float_t>& dc);
 		virtual float norm();
+		// fused operations, one pass over the images; the results are
+		// appended to an empty container and overwrite the images of a
+		// non-empty one (of the same number of images), which may be among
+		// the operands
+		virtual void xapy
+			(complex_float_t a, const aDataContainer<complex_float_t>& a_x);
+		virtual void linear_combination(int n, const complex_float_t* a,
+			const aDataContainer<complex_float_t>* const* a_x);
+		virtual float axpby_norm(
+			complex_float_t a, const aDataContainer<complex_float_t>& a_x,
+			complex_float_t b, const aDataContainer<complex_float_t>& a_y);
+		virtual complex_float_t axpby_dot(
+			complex_float_t a, const aDataContainer<complex_float_t>& a_x,
+			complex_float_t b, const aDataContainer<complex_float_t>& a_y,
+			const aDataContainer<complex_float_t>& a_z);
 
 		void get_image_data_as_cmplx_array
 			(unsigned int im_num, float* re, float* im)
@@ -394,22 +774,26 @@ namespace sirf {
 			iw.get_cmplx_data(re, im);
 		}
 
+		// sorts the images by repetition, z-position and slice via
+		// a permutation index
 		void order();
 		bool ordered() const { return ordered_; }
 		void set_ordered(bool ordered) { ordered_ = ordered; }
-		int* index() { return index_; }
-		const int* index() const { return index_; }
+		int* index() { return index_.get() ? &(*index_)[0] : 0; }
+		const int* index() const { return index_.get() ? &(*index_)[0] : 0; }
 		int index(int i) const
 		{
-			if (index_) // && i >= 0 && i < (int)number())
-				return index_[i];
+			if (index_.get()) // && i >= 0 && i < (int)number())
+				return (*index_)[i];
 			else
 				return i;
 		}
+		// stores the images physically in sorted order (and drops the index)
+		virtual void compact() {}
 
 	protected:
 		bool ordered_;
-		int* index_;
+		gadgetron::shared_ptr<std::vector<int> > index_;
 	};
 
 	/*!
@@ -417,10 +801,22 @@ namespace sirf {
 	\brief A vector implementation of the abstract MR image data container class.
 
 	Images are stored in an std::vector<shared_ptr<ImageWrap> > object.
+
+	A selection of images by an attribute value shares the selected images
+	with the original container rather than copying them, and either of the
+	two containers copies a shared image before modifying it in place
+	(copy-on-write). The values of the images' meta attributes are parsed
+	once into a table, which is used by all selections until images are
+	added or reordered. Hence a selection modifies the table and the
+	sharing flags of the original container; this is done under the
+	container's mutex, so that several selections from one container can
+	be made concurrently.
 	*/
 	class ImagesVector : public MRImageData {
 	public:
-		ImagesVector() : images_(), nimages_(0) {}
+		ImagesVector() : images_(), nimages_(0), attributes_indexed_(false) {}
+		// the images of list with the attribute attr equal to target
+		// (case-insensitive), shared with list
 		ImagesVector(ImagesVector& list, const char* attr, const char* target);
 		virtual unsigned int items() { return (unsigned int)images_.size(); }
 		virtual unsigned int number() { return (unsigned int)images_.size(); }
@@ -438,12 +834,12 @@ namespace sirf {
 		}
 		virtual void append(int image_data_type, void* ptr_image)
 		{
-			images_.push_back(gadgetron::shared_ptr<ImageWrap>
-				(new ImageWrap(image_data_type, ptr_image)));
+			append_(gadgetron::shared_ptr<ImageWrap>
+				(new ImageWrap(image_data_type, ptr_image)), false);
 		}
 		virtual void append(const ImageWrap& iw)
 		{
-			images_.push_back(gadgetron::shared_ptr<ImageWrap>(new ImageWrap(iw)));
+			append_(gadgetron::shared_ptr<ImageWrap>(new ImageWrap(iw)), false);
 		}
 		virtual gadgetron::shared_ptr<ImageWrap> sptr_image_wrap(unsigned int im_num)
 		{
@@ -468,6 +864,17 @@ namespace sirf {
 			const gadgetron::shared_ptr<const ImageWrap>& sptr_iw = sptr_image_wrap(im_num);
 			return *sptr_iw;
 		}
+		virtual gadgetron::shared_ptr<ImageWrap> sptr_writable_image_wrap
+			(unsigned int im_num)
+		{
+			int i = index(im_num);
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (shared_[i]) {
+				images_[i].reset(new ImageWrap(*images_[i]));
+				shared_[i] = false;
+			}
+			return images_[i];
+		}
 		virtual int read(std::string filename);
 		virtual void write(std::string filename, std::string groupname);
 		virtual void get_image_dimensions(unsigned int im_num, int* dim)
@@ -498,11 +905,166 @@ namespace sirf {
 		{
 			return gadgetron::shared_ptr<MRImageData>(new ImagesVector(*this, attr, target));
 		}
+		virtual void compact();
 
 	private:
 		std::vector<gadgetron::shared_ptr<ImageWrap> > images_;
+		// true for the images shared with another container
+		std::vector<bool> shared_;
 		int nimages_;
+		// the attribute values of the images in storage order by name,
+		// empty for the images that do not have the attribute
+		std::map<std::string, std::vector<std::string> > attributes_;
+		bool attributes_indexed_;
+		// guards shared_ and the attribute table
+		std::mutex mutex_;
+
+		void append_(gadgetron::shared_ptr<ImageWrap> sptr_iw, bool shared)
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			images_.push_back(sptr_iw);
+			shared_.push_back(shared);
+			attributes_indexed_ = false;
+		}
+		// the caller holds mutex_
+		const std::vector<std::string>& attribute_values_(const char* attr);
+	};
 
+	/*!
+	\ingroup Gadgetron Data Containers
+	\brief A contiguous complex float implementation of the abstract MR image
+	data container class.
+
+	All images have the same dimensions and are stored one after another in
+	a single buffer, their ISMRMRD headers and attributes being kept aside.
+	The vector algebra runs on the whole buffer using complex float kernels,
+	with no per-image type dispatch. Images of other data types are
+	converted to complex float when appended.
+
+	image_wrap() and sptr_image_wrap() return copies of the images, hence
+	the image data should only be modified via the container methods.
+	*/
+	class ImagesVolume : public MRImageData {
+	public:
+		ImagesVolume() : nimages_(0), size_(0) {}
+		// copies (and converts) all images of ic
+		ImagesVolume(MRImageData& ic);
+		virtual unsigned int items() { return (unsigned int)heads_.size(); }
+		virtual unsigned int number() { return (unsigned int)heads_.size(); }
+		virtual int types()
+		{
+			if (nimages_ > 0)
+				return (int)(heads_.size() / nimages_);
+			else
+				return 1;
+		}
+		virtual void count(int i)
+		{
+			if (i > nimages_)
+				nimages_ = i;
+		}
+		virtual void append(int image_data_type, void* ptr_image)
+		{
+			ImageWrap iw(image_data_type, ptr_image);
+			append(iw);
+		}
+		virtual void append(const ImageWrap& iw);
+		virtual gadgetron::shared_ptr<ImageWrap> sptr_image_wrap(unsigned int im_num);
+		virtual gadgetron::shared_ptr<const ImageWrap> sptr_image_wrap
+			(unsigned int im_num) const;
+		virtual ImageWrap& image_wrap(unsigned int im_num)
+		{
+			return *cached_image_wrap_(index(im_num));
+		}
+		virtual const ImageWrap& image_wrap(unsigned int im_num) const
+		{
+			return *cached_image_wrap_(index(im_num));
+		}
+		virtual int image_data_type(unsigned int im_num) const
+		{
+			return ISMRMRD::ISMRMRD_CXFLOAT;
+		}
+		virtual const ISMRMRD::ImageHeader& image_header(unsigned int im_num)
+		{
+			return heads_[index(im_num)];
+		}
+		virtual int read(std::string filename);
+		virtual void write(std::string filename, std::string groupname);
+		virtual void get_image_dimensions(unsigned int im_num, int* dim);
+		virtual void get_images_data_as_float_array(float* data);
+		virtual void get_images_data_as_complex_array(float* re, float* im);
+		virtual void set_complex_images_data(const float* re, const float* im);
+		virtual aDataContainer<complex_float_t>* new_data_container()
+		{
+			return (aDataContainer<complex_float_t>*)new ImagesVolume();
+		}
+		virtual gadgetron::shared_ptr<MRImageData> new_images_container()
+		{
+			return gadgetron::shared_ptr<MRImageData>(new ImagesVolume());
+		}
+		virtual gadgetron::shared_ptr<MRImageData>
+			clone(const char* attr, const char* target);
+		virtual void compact();
+
+		// whole buffer algebra if the operands are volumes of the same
+		// layout, image by image otherwise
+		virtual void axpby(
+			complex_float_t a, const aDataContainer<complex_float_t>& a_x,
+			complex_float_t b, const aDataContainer<complex_float_t>& a_y);
+		virtual void multiply(
+			const aDataContainer<complex_float_t>& a_x,
+			const aDataContainer<complex_float_t>& a_y);
+		virtual void divide(
+			const aDataContainer<complex_float_t>& a_x,
+			const aDataContainer<complex_float_t>& a_y);
+		virtual complex_float_t dot(const aDataContainer<complex_float_t>& dc);
+		virtual float norm();
+		virtual void xapy
+			(complex_float_t a, const aDataContainer<complex_float_t>& a_x);
+		virtual void linear_combination(int n, const complex_float_t* a,
+			const aDataContainer<complex_float_t>* const* a_x);
+		virtual float axpby_norm(
+			complex_float_t a, const aDataContainer<complex_float_t>& a_x,
+			complex_float_t b, const aDataContainer<complex_float_t>& a_y);
+		virtual complex_float_t axpby_dot(
+			complex_float_t a, const aDataContainer<complex_float_t>& a_x,
+			complex_float_t b, const aDataContainer<complex_float_t>& a_y,
+			const aDataContainer<complex_float_t>& a_z);
+
+		// the data of image im_num (in storage order) are
+		// data()[im_num*image_size()], ..., data()[(im_num + 1)*image_size() - 1]
+		complex_float_t* data() { return &data_[0]; }
+		const complex_float_t* data() const { return &data_[0]; }
+		size_t image_size() const { return size_; }
+
+	private:
+		std::vector<ISMRMRD::ImageHeader> heads_;
+		std::vector<std::string> attributes_;
+		std::vector<complex_float_t> data_;
+		int nimages_;
+		size_t size_;
+		// copies handed out by image_wrap(), dropped when the data change
+		mutable std::vector<gadgetron::shared_ptr<ImageWrap> > wraps_;
+		mutable std::mutex wraps_mutex_;
+
+		// a new copy of image i (in storage order)
+		gadgetron::shared_ptr<ImageWrap> image_wrap_(int i) const;
+		gadgetron::shared_ptr<ImageWrap> cached_image_wrap_(int i) const;
+		void data_changed_();
+		// returns a_x as a volume if it is a non-empty unsorted volume
+		// with the same number and size of images as like (if not null),
+		// otherwise 0 (and the algebra is done image by image)
+		static const ImagesVolume* volume_
+			(const aDataContainer<complex_float_t>& a_x,
+			const ImagesVolume* like);
+		// makes this volume the same as x except for the image data,
+		// which are left uninitialised
+		void copy_layout_(const ImagesVolume& x);
+		// overwrites the image data with those of v, which must have the
+		// same number and size of images; the algebra computes into v and
+		// calls this when the volume already holds images (which may be
+		// among the operands)
+		void assign_data_(const ImagesVolume& v);
 	};
 
 	/*!
@@ -715,6 +1277,19 @@ namespace sirf {
 		{
 			csm_smoothness_ = s;
 		}
+		//! Sets the number of threads computing the maps.
+		/*! Slices are processed concurrently, and so are the coils of each
+			slice if there are fewer slices than threads; 0 (default) uses
+			all threads of the SIRF thread pool.
+		*/
+		void set_num_threads(int n)
+		{
+			nthreads_ = n;
+		}
+		int num_threads() const
+		{
+			return nthreads_ > 0 ? nthreads_ : ThreadPool::num_threads();
+		}
 		virtual CoilData& operator()(int slice) = 0;
 
 		virtual void compute(MRAcquisitionData& ac)
@@ -739,13 +1314,16 @@ namespace sirf {
 		}
 
 	protected:
+		CoilSensitivitiesContainer() : csm_smoothness_(0), nthreads_(0) {}
 		int csm_smoothness_;
+		int nthreads_;
 
 	private:
 		void compute_csm_(
 			ISMRMRD::NDArray<complex_float_t>& cm,
 			ISMRMRD::NDArray<float>& img,
-			ISMRMRD::NDArray<complex_float_t>& csm
+			ISMRMRD::NDArray<complex_float_t>& csm,
+			int nthreads
 			);
 
 		float max_(int nx, int ny, float* u);
@@ -755,7 +1333,7 @@ namespace sirf {
 		void smoothen_
 			(int nx, int ny, int nz,
 			complex_float_t* u, complex_float_t* v,
-			int* obj_mask);
+			int* obj_mask, int npasses, int nthreads);
 	};
 
 	/*!
@@ -793,6 +1371,95 @@ namespace sirf {
 		}
 
 	};
+
+	/*!
+	\ingroup Gadgetron Data Containers
+	\brief PCA coil compression.
+
+	Combines the coils of MR acquisitions into a smaller number of
+	virtual coils: the compression matrix consists of the principal
+	eigenvectors of the coil covariance matrix of calibration data (the
+	parallel calibration readouts, or all imaging readouts if there are
+	none). Coil sensitivity maps are compressed by the same matrix, so that
+	compressed data and maps can be used together in MRAcquisitionModel.
+	*/
+	class MRCoilCompression {
+	public:
+		MRCoilCompression() : num_coils_(0), num_vcoils_(0), ncv_(0),
+			energy_(0.99f) {}
+
+		//! Sets the number of virtual coils.
+		/*! If 0 (default), the smallest number retaining the fraction 
+			set by set_energy_threshold() of the calibration data energy
+			is used.
+		*/
+		void set_num_virtual_coils(int n)
+		{
+			if (n < 0)
+				throw LocalisedException
+				("number of virtual coils must be non-negative", 
+				__FILE__, __LINE__);
+			ncv_ = n;
+			if (num_coils_ > 0)
+				select_virtual_coils_();
+		}
+		void set_energy_threshold(float e)
+		{
+			if (e <= 0 || e > 1)
+				throw LocalisedException
+				("energy threshold must be in (0, 1]", __FILE__, __LINE__);
+			energy_ = e;
+			if (num_coils_ > 0)
+				select_virtual_coils_();
+		}
+		float energy_threshold() const
+		{
+			return energy_;
+		}
+		// the number of coils in the calibration data
+		int num_coils() const
+		{
+			return num_coils_;
+		}
+		// the number of virtual coils produced by compress()
+		int num_virtual_coils() const
+		{
+			return num_vcoils_;
+		}
+		// the eigenvalues of the coil covariance matrix in descending order
+		const std::vector<double>& eigenvalues() const
+		{
+			return eigenvalues_;
+		}
+
+		// Computes the compression matrix from the calibration data in ac.
+		void compute(MRAcquisitionData& ac);
+
+		// Returns compressed copies of acquisitions and coil sensitivities.
+		gadgetron::shared_ptr<MRAcquisitionData>
+			compress(MRAcquisitionData& ac) const;
+		gadgetron::shared_ptr<CoilSensitivitiesContainer>
+			compress(CoilSensitivitiesContainer& cc) const;
+
+	private:
+		int num_coils_;
+		int num_vcoils_;
+		int ncv_;
+		float energy_;
+		std::vector<double> eigenvalues_;
+		// eigenvectors in the columns of a num_coils_ x num_coils_ matrix
+		std::vector<complex_double_t> eigenvectors_;
+
+		void select_virtual_coils_();
+		void check_ready_() const;
+		// y_v = sum_c conj(u_cv) x_c for the n elements of each coil
+		void combine_coils_(size_t n, const complex_float_t* x,
+			complex_float_t* y) const;
+		// eigenvalues and eigenvectors of a Hermitian n x n matrix a
+		// (column-major, destroyed) by the cyclic Jacobi method
+		static void eigh_(int n, std::vector<complex_double_t>& a,
+			std::vector<complex_double_t>& v, std::vector<double>& w);
+	};
 }
 
 #endif
@@ -36,6 +36,7 @@ limitations under the License.
 #include <ismrmrd/xml.h>
 
 #include "cgadgetron_shared_ptr.h"
+#include "xgadgetron_kernels.h"
 #include "xgadgetron_utilities.h"
 
 #define IMAGE_PROCESSING_SWITCH(Type, Operation, Arguments, ...)\
@@ -146,6 +147,11 @@ Eliminates the need for the image processing switch in the rest of the code.
 			n *= dim[3];
 			return n;
 		}
+		// address of the image data, allows views without copying
+		void* data_ptr()
+		{
+			IMAGE_PROCESSING_SWITCH(type_, return get_data_ptr_, ptr_);
+		}
 		void get_data(float* data) const
 		{
 			IMAGE_PROCESSING_SWITCH_CONST(type_, get_data_, ptr_, data);
@@ -275,6 +281,12 @@ Eliminates the need for the image processing switch in the rest of the code.
 			dim[3] = im.getNumberOfChannels();
 		}
 
+		template<typename T>
+		void* get_data_ptr_(ISMRMRD::Image<T>* ptr_im)
+		{
+			return (void*)ptr_im->getDataPtr();
+		}
+
 		template<typename T>
 		void get_data_(const ISMRMRD::Image<T>* ptr_im, float* data) const
 		{
@@ -285,6 +297,44 @@ Eliminates the need for the image processing switch in the rest of the code.
 				data[i] = std::real(ptr[i]);
 		}
 
+		// complex float images (the most common case) use vector kernels
+		void axpby_(const ISMRMRD::Image<complex_float_t>* ptr_x,
+			complex_float_t a, complex_float_t b)
+		{
+			ISMRMRD::Image<complex_float_t>* ptr_y =
+				(ISMRMRD::Image<complex_float_t>*)ptr_;
+			xGadgetronKernels::axpby(ptr_x->getNumberOfDataElements(),
+				a, ptr_x->getDataPtr(), b, ptr_y->getDataPtr());
+		}
+		void multiply_(const ISMRMRD::Image<complex_float_t>* ptr_x)
+		{
+			ISMRMRD::Image<complex_float_t>* ptr_y =
+				(ISMRMRD::Image<complex_float_t>*)ptr_;
+			xGadgetronKernels::multiply(ptr_x->getNumberOfDataElements(),
+				ptr_x->getDataPtr(), ptr_y->getDataPtr());
+		}
+		void divide_(const ISMRMRD::Image<complex_float_t>* ptr_x)
+		{
+			ISMRMRD::Image<complex_float_t>* ptr_y =
+				(ISMRMRD::Image<complex_float_t>*)ptr_;
+			xGadgetronKernels::divide(ptr_x->getNumberOfDataElements(),
+				ptr_x->getDataPtr(), ptr_y->getDataPtr());
+		}
+		void dot_(const ISMRMRD::Image<complex_float_t>* ptr_im,
+			complex_float_t *z) const
+		{
+			const ISMRMRD::Image<complex_float_t>* ptr =
+				(const ISMRMRD::Image<complex_float_t>*)ptr_;
+			*z = (complex_float_t)xGadgetronKernels::dot
+				(ptr_im->getNumberOfDataElements(),
+				ptr->getDataPtr(), ptr_im->getDataPtr());
+		}
+		void norm_(const ISMRMRD::Image<complex_float_t>* ptr, float *r) const
+		{
+			*r = (float)std::sqrt(xGadgetronKernels::norm2
+				(ptr->getNumberOfDataElements(), ptr->getDataPtr()));
+		}
+
 		template<typename T>
 		void axpby_
 			(const ISMRMRD::Image<T>* ptr_x, complex_float_t a, complex_float_t b)
@@ -348,29 +398,30 @@ Eliminates the need for the image processing switch in the rest of the code.
 			const ISMRMRD::Image<T>* ptr = (const ISMRMRD::Image<T>*)ptr_;
 			const T* i;
 			const T* j;
-			*z = 0;
+			std::complex<double> s = 0;
 			size_t ii = 0;
 			size_t n = ptr_im->getNumberOfDataElements();
 			for (i = ptr->getDataPtr(), j = ptr_im->getDataPtr(); ii < n;
 				i++, j++, ii++) {
-				complex_float_t u = (complex_float_t)*i;
-				complex_float_t v = (complex_float_t)*j;
-				*z += std::conj(v) * u;
+				std::complex<double> u = (complex_float_t)*i;
+				std::complex<double> v = (complex_float_t)*j;
+				s += std::conj(v) * u;
 			}
+			*z = (complex_float_t)s;
 		}
 
 		template<typename T>
 		void norm_(const ISMRMRD::Image<T>* ptr, float *r) const
 		{
 			const T* i;
-			*r = 0;
+			double s = 0;
 			size_t ii = 0;
 			size_t n = ptr->getNumberOfDataElements();
 			for (i = ptr->getDataPtr(); ii < n; i++, ii++) {
-				complex_float_t a = (complex_float_t)*i;
-				*r += std::abs(std::conj(a) * a);
+				std::complex<double> a = (complex_float_t)*i;
+				s += std::norm(a);
 			}
-			*r = std::sqrt(*r);
+			*r = (float)std::sqrt(s);
 		}
 
 		template<typename T>
@@ -27,13 +27,31 @@ limitations under the License.
 \author CCP PETMR
 */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
 #include <boost/asio.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/thread.hpp>
 
 using boost::asio::ip::tcp;
 
+#include "SIRF/common/profiler.h"
+#include "SIRF/common/thread_pool.h"
 #include "cgadgetron_shared_ptr.h"
 #include "data_handle.h"
 #include "gadgetron_x.h"
@@ -58,18 +76,12 @@ connection_failed(int nt)
 static void
 check_gadgetron_connection(std::string host, std::string port)
 {
-	ImagesProcessor ip;
 	//std::cout << "checking connection...\n";
 	for (int nt = 0; nt < N_TRIALS; nt++) {
-		try {
-			ip.check_connection();
-			//std::cout << "ok\n";
+		if (GadgetronSessionPool::heartbeat(host, port))
 			break;
-		}
-		catch (...) {
-			if (connection_failed(nt))
-				THROW("Connection to Gadgetron server lost, check Gadgetron output");
-		}
+		if (connection_failed(nt))
+			THROW("Connection to Gadgetron server lost, check Gadgetron output");
 	}
 }
 
@@ -114,109 +126,846 @@ GadgetChain::xml() const
 	return xml_script;
 }
 
-void 
-AcquisitionsProcessor::process(MRAcquisitionData& acquisitions) 
+/*
+Sends all acquisitions to the server; a reader thread fetches up to depth
+acquisitions ahead of the sender, so that reading (e.g. from HDF5 file)
+overlaps with the network transfer. With depth 0 reading and sending
+alternate in the calling thread.
+*/
+static void
+send_acquisitions_(GadgetronClientConnector& con,
+	MRAcquisitionData& acquisitions, unsigned int depth)
 {
+	uint32_t nacq = acquisitions.number();
+	if (depth < 1 || nacq < 2) {
+		ISMRMRD::Acquisition acq;
+		for (uint32_t i = 0; i < nacq; i++) {
+			acquisitions.get_acquisition(i, acq);
+			con.send_ismrmrd_acquisition(acq);
+		}
+		return;
+	}
 
-	std::string config = xml();
-	GTConnector conn;
-	uint32_t nacq = 0;
-	nacq = acquisitions.number();
-	//std::cout << nacq << " acquisitions" << std::endl;
-	ISMRMRD::Acquisition acq_tmp;
-	sptr_acqs_ = acquisitions.new_acquisitions_container();
+	std::vector<ISMRMRD::Acquisition> queue(depth);
+	uint32_t nread = 0; // acquisitions placed in the queue
+	uint32_t nsent = 0; // acquisitions taken from it
+	bool stop = false;
+	std::exception_ptr error;
+	std::mutex mtx;
+	std::condition_variable cv;
 
-	conn().register_reader(GADGET_MESSAGE_ISMRMRD_ACQUISITION,
-		shared_ptr<GadgetronClientMessageReader>
-		(new GadgetronClientAcquisitionMessageCollector(sptr_acqs_)));
+	std::thread reader([&]() {
+		for (uint32_t i = 0; i < nacq; i++) {
+			{
+				std::unique_lock<std::mutex> lock(mtx);
+				cv.wait(lock, [&]() { return stop || nread - nsent < depth; });
+				if (stop)
+					return;
+			}
+			// slot i % depth is not in use by the sender
+			try {
+				acquisitions.get_acquisition(i, queue[i % depth]);
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> lock(mtx);
+				error = std::current_exception();
+				stop = true;
+				cv.notify_all();
+				return;
+			}
+			std::lock_guard<std::mutex> lock(mtx);
+			nread++;
+			cv.notify_all();
+		}
+	});
+
+	try {
+		for (uint32_t i = 0; i < nacq; i++) {
+			{
+				std::unique_lock<std::mutex> lock(mtx);
+				cv.wait(lock, [&]() { return stop || nread > i; });
+				if (stop)
+					break;
+			}
+			con.send_ismrmrd_acquisition(queue[i % depth]);
+			std::lock_guard<std::mutex> lock(mtx);
+			nsent++;
+			cv.notify_all();
+		}
+	}
+	catch (...) {
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			stop = true;
+			cv.notify_all();
+		}
+		reader.join();
+		throw;
+	}
+	reader.join();
+	if (error)
+		std::rethrow_exception(error);
+}
+
+/*
+Runs a session with Gadgetron server: send(con) sends the input data to
+the server, reader collects the output messages with ID msg_id.
+The connection is taken from GadgetronSessionPool, which prepares the next
+session in background if options.warm_sessions is set. If the server has
+not confirmed the end of the session, a heartbeat checks it is still alive
+before the output is accepted. If it has, and options.deferred_probing is
+set, a heartbeat is started in background, and the next session with the
+server first waits for its outcome.
+If control is not 0, the session can be cancelled via it.
+*/
+template<class F>
+static void
+run_session_(const std::string& host, const std::string& port,
+	const std::string& config, const GadgetronConnectionOptions& options,
+	unsigned short msg_id, shared_ptr<GadgetronClientMessageReader> reader,
+	F send, GadgetronSessionControl* control)
+{
+	GadgetronSessionPool& pool = GadgetronSessionPool::instance();
+	if (!pool.probe_succeeded(host, port))
+		check_gadgetron_connection(host, port);
+	bool closed_by_server = false;
 	for (int nt = 0; nt < N_TRIALS; nt++) {
+		shared_ptr<GadgetronClientConnector> sptr_con;
 		try {
-			conn().connect(host_, port_);
-			conn().send_gadgetron_configuration_script(config);
-			conn().send_gadgetron_parameters(acquisitions.acquisitions_info());
-			for (uint32_t i = 0; i < nacq; i++) {
-				acquisitions.get_acquisition(i, acq_tmp);
-				conn().send_ismrmrd_acquisition(acq_tmp);
-			}
-			conn().send_gadgetron_close();
-			conn().wait();
+			sptr_con = pool.session(host, port, config, options);
+			if (control)
+				control->attach(sptr_con);
+			GadgetronClientConnector& con = *sptr_con;
+			con.register_reader(msg_id, reader);
+			con.start_reading();
+			send(con);
+			con.send_gadgetron_close();
+			con.wait();
+			closed_by_server = con.closed_by_server();
+			if (control)
+				control->detach(sptr_con);
 			break;
 		}
 		catch (...) {
+			if (control && sptr_con.get())
+				control->detach(sptr_con);
+			if (control && control->cancelled())
+				THROW("Gadgetron session cancelled");
 			if (connection_failed(nt))
 				THROW("Server running Gadgetron not accessible");
 		}
 	}
-	check_gadgetron_connection(host_, port_);
+	if (options.warm_sessions)
+		pool.prepare(host, port, config, options);
+	if (!closed_by_server)
+		check_gadgetron_connection(host, port);
+	else if (options.deferred_probing)
+		pool.probe(host, port);
 }
 
-void 
-ImagesReconstructor::process(MRAcquisitionData& acquisitions)
+/*
+128-bit hash of the data defining a cached output: a byte-wise FNV-1a hash,
+which names the cache file, and an independent word-wise multiply-rotate
+hash, both of which are checked against the file contents on a hit.
+*/
+class ResultHash {
+public:
+	ResultHash() : h1_(14695981039346656037ULL), h2_(0x9e3779b97f4a7c15ULL) {}
+	void add(const void* data, size_t size)
+	{
+		const unsigned char* p = (const unsigned char*)data;
+		for (size_t i = 0; i < size; i++) {
+			h1_ ^= p[i];
+			h1_ *= 1099511628211ULL;
+		}
+		size_t i = 0;
+		for (; i + 8 <= size; i += 8) {
+			unsigned long long w;
+			memcpy(&w, p + i, 8);
+			mix_(w);
+		}
+		unsigned long long w = 0;
+		memcpy(&w, p + i, size - i);
+		mix_(w ^ (unsigned long long)size);
+	}
+	void add(const std::string& str)
+	{
+		add(str.c_str(), str.size() + 1);
+	}
+	std::string str() const
+	{
+		std::ostringstream os;
+		os << std::hex << std::setfill('0');
+		os << std::setw(16) << h1_ << std::setw(16) << h2_;
+		return os.str();
+	}
+private:
+	unsigned long long h1_;
+	unsigned long long h2_;
+	void mix_(unsigned long long w)
+	{
+		w *= 0x87c37b91114253d5ULL;
+		w = (w << 31) | (w >> 33);
+		h2_ ^= w * 0x4cf5ad432745937fULL;
+		h2_ = ((h2_ << 27) | (h2_ >> 37))*5 + 0x52dce729ULL;
+	}
+};
+
+#define RESULT_CACHE_MAGIC "SIRFGC02"
+// the length of the hash string and of its part naming the file
+#define RESULT_CACHE_KEY_SIZE 32
+#define RESULT_CACHE_NAME_SIZE 16
+#define RESULT_CACHE_PREFIX "sirf_gadgetron_"
+#define RESULT_CACHE_EXT ".dat"
+
+bool GadgetronResultCache::enabled_ = false;
+std::string GadgetronResultCache::directory_;
+size_t GadgetronResultCache::limit_ = (size_t)1 << 30;
+std::mutex GadgetronResultCache::mutex_;
+
+void
+GadgetronResultCache::set_directory(const std::string& dir)
 {
-	//check_gadgetron_connection(host_, port_);
+	std::lock_guard<std::mutex> lock(mutex_);
+	directory_ = dir;
+}
 
-	std::string config = xml();
-	//std::cout << "config:\n" << config << std::endl;
+std::string
+GadgetronResultCache::directory()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return directory_;
+}
 
-	uint32_t nacquisitions = 0;
-	nacquisitions = acquisitions.number();
-	//std::cout << nacquisitions << " acquisitions" << std::endl;
-	ISMRMRD::Acquisition acq_tmp;
+void
+GadgetronResultCache::set_limit(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	limit_ = bytes;
+	enforce_limit_();
+}
 
-	GTConnector conn;
-	sptr_images_.reset(new ImagesVector);
-	conn().register_reader(GADGET_MESSAGE_ISMRMRD_IMAGE,
-		shared_ptr<GadgetronClientMessageReader>
-		(new GadgetronClientImageMessageCollector(sptr_images_)));
-	for (int nt = 0; nt < N_TRIALS; nt++) {
-		try {
-			conn().connect(host_, port_);
-			conn().send_gadgetron_configuration_script(config);
-			conn().send_gadgetron_parameters(acquisitions.acquisitions_info());
-			for (uint32_t i = 0; i < nacquisitions; i++) {
-				acquisitions.get_acquisition(i, acq_tmp);
-				conn().send_ismrmrd_acquisition(acq_tmp);
+void
+GadgetronResultCache::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	size_t limit = limit_;
+	limit_ = 0;
+	enforce_limit_();
+	limit_ = limit;
+}
+
+std::string
+GadgetronResultCache::key
+(const std::string& xml, MRAcquisitionData& acquisitions)
+{
+	if (!enabled_)
+		return std::string();
+	ResultHash hash;
+	hash.add(xml);
+	hash.add(acquisitions.acquisitions_info());
+	unsigned int na = acquisitions.number();
+	hash.add(&na, sizeof(na));
+	ISMRMRD::Acquisition acq;
+	for (unsigned int a = 0; a < na; a++) {
+		acquisitions.get_acquisition(a, acq);
+		const ISMRMRD::AcquisitionHeader& head = acq.getHead();
+		size_t ns = head.number_of_samples;
+		hash.add(&head, sizeof(ISMRMRD::AcquisitionHeader));
+		hash.add(acq.getTrajPtr(), sizeof(float)*head.trajectory_dimensions*ns);
+		hash.add(acq.getDataPtr(),
+			sizeof(complex_float_t)*head.active_channels*ns);
+	}
+	return hash.str();
+}
+
+std::string
+GadgetronResultCache::key(const std::string& xml, MRImageData& images)
+{
+	if (!enabled_)
+		return std::string();
+	ResultHash hash;
+	hash.add(xml);
+	unsigned int ni = images.number();
+	hash.add(&ni, sizeof(ni));
+	for (unsigned int i = 0; i < ni; i++) {
+		shared_ptr<ImageWrap> sptr_iw = images.sptr_image_wrap(i);
+		ImageWrap& iw = *sptr_iw;
+		hash.add(&iw.head(), sizeof(ISMRMRD::ImageHeader));
+		hash.add(iw.attributes());
+		hash.add(iw.data_ptr(), iw.size());
+	}
+	return hash.str();
+}
+
+std::string
+GadgetronResultCache::filename_(const std::string& key)
+{
+	std::string name = RESULT_CACHE_PREFIX + key.substr(0, RESULT_CACHE_NAME_SIZE)
+		+ RESULT_CACHE_EXT;
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (directory_.empty())
+		return name;
+	return (boost::filesystem::path(directory_) / name).string();
+}
+
+// a name for the file being written, unique among concurrent writers
+static std::string
+cache_tmp_name_(const std::string& filename)
+{
+	static std::atomic<unsigned int> calls(0);
+	std::ostringstream os;
+	os << filename << '.' << std::this_thread::get_id() << '.' << ++calls
+		<< ".tmp";
+	return os.str();
+}
+
+/*
+Checks the file header: the magic string and the full hash of the input,
+so that a file named after the same part of a different hash is ignored.
+*/
+static bool
+read_cache_header_(std::istream& file, const std::string& key, uint32_t& n)
+{
+	char magic[8];
+	char hash[RESULT_CACHE_KEY_SIZE];
+	if (!file.read(magic, 8).read(hash, RESULT_CACHE_KEY_SIZE)
+		.read((char*)&n, sizeof(n)))
+		return false;
+	return !memcmp(magic, RESULT_CACHE_MAGIC, 8) &&
+		key.size() == RESULT_CACHE_KEY_SIZE &&
+		!memcmp(hash, key.c_str(), RESULT_CACHE_KEY_SIZE);
+}
+
+static void
+write_cache_header_(std::ostream& file, const std::string& key, uint32_t n)
+{
+	file.write(RESULT_CACHE_MAGIC, 8).write(key.c_str(), RESULT_CACHE_KEY_SIZE)
+		.write((const char*)&n, sizeof(n));
+}
+
+/*
+Removes the cache files, least recently used (i.e. written or read) first,
+while their total size exceeds the limit; the caller holds the mutex.
+*/
+void
+GadgetronResultCache::enforce_limit_()
+{
+	namespace fs = boost::filesystem;
+	fs::path dir(directory_.empty() ? "." : directory_);
+	boost::system::error_code ec;
+	if (!fs::is_directory(dir, ec))
+		return;
+	std::vector<std::pair<std::time_t, fs::path> > files;
+	size_t total = 0;
+	for (fs::directory_iterator i(dir, ec); !ec && i != fs::directory_iterator();
+		i.increment(ec)) {
+		const fs::path& p = i->path();
+		std::string name = p.filename().string();
+		if (name.compare(0, strlen(RESULT_CACHE_PREFIX), RESULT_CACHE_PREFIX)
+			|| p.extension().string() != RESULT_CACHE_EXT)
+			continue;
+		total += (size_t)fs::file_size(p, ec);
+		files.push_back(std::make_pair(fs::last_write_time(p, ec), p));
+	}
+	std::sort(files.begin(), files.end());
+	for (size_t i = 0; i < files.size() && total > limit_; i++) {
+		size_t size = (size_t)fs::file_size(files[i].second, ec);
+		if (fs::remove(files[i].second, ec))
+			total -= size;
+	}
+}
+
+template<typename T>
+static void
+read_cached_image_(ISMRMRD::Image<T>*, const ISMRMRD::ImageHeader& head,
+	const std::string& attributes, std::istream& file, void** ptr_ptr)
+{
+	ISMRMRD::Image<T>* ptr_im = new ISMRMRD::Image<T>;
+	*ptr_ptr = (void*)ptr_im;
+	ptr_im->setHead(head);
+	ptr_im->setAttributeString(attributes);
+	file.read((char*)ptr_im->getDataPtr(), ptr_im->getDataSize());
+}
+
+/*
+Cache files hold the magic string, the full hash, the number of items and
+the items: the acquisition header, trajectory and data, or the image header,
+the size and the text of the attributes and the image data. Files are read
+and written without holding the mutex: they are only ever replaced by a
+rename, and a file removed while being read stays readable until closed.
+*/
+bool
+GadgetronResultCache::restore(const std::string& key, MRAcquisitionData& acqs)
+{
+	if (key.empty())
+		return false;
+	std::string filename = filename_(key);
+	std::ifstream file(filename.c_str(), std::ios::binary);
+	uint32_t na;
+	if (!read_cache_header_(file, key, na))
+		return false;
+	ISMRMRD::Acquisition acq;
+	for (uint32_t a = 0; a < na; a++) {
+		ISMRMRD::AcquisitionHeader head;
+		if (!file.read((char*)&head, sizeof(head)))
+			return false;
+		acq.setHead(head);
+		size_t ns = head.number_of_samples;
+		file.read((char*)acq.getTrajPtr(),
+			sizeof(float)*head.trajectory_dimensions*ns);
+		file.read((char*)acq.getDataPtr(),
+			sizeof(complex_float_t)*head.active_channels*ns);
+		if (!file)
+			return false;
+		acqs.append_acquisition(acq);
+	}
+	boost::system::error_code ec;
+	boost::filesystem::last_write_time(filename, std::time(0), ec);
+	return true;
+}
+
+bool
+GadgetronResultCache::restore(const std::string& key, MRImageData& images)
+{
+	if (key.empty())
+		return false;
+	std::string filename = filename_(key);
+	std::ifstream file(filename.c_str(), std::ios::binary);
+	uint32_t ni;
+	if (!read_cache_header_(file, key, ni))
+		return false;
+	for (uint32_t i = 0; i < ni; i++) {
+		ISMRMRD::ImageHeader head;
+		uint64_t size;
+		if (!file.read((char*)&head, sizeof(head)).read((char*)&size, sizeof(size)))
+			return false;
+		std::string attributes(size, ' ');
+		if (size && !file.read(&attributes[0], size))
+			return false;
+		void* ptr = 0;
+		IMAGE_PROCESSING_SWITCH(head.data_type, read_cached_image_, 0,
+			head, attributes, file, &ptr);
+		if (!ptr)
+			return false;
+		// the container takes the image over
+		images.append(head.data_type, ptr);
+		images.count(head.image_index);
+		if (!file)
+			return false;
+	}
+	boost::system::error_code ec;
+	boost::filesystem::last_write_time(filename, std::time(0), ec);
+	return true;
+}
+
+/*
+The file is written under a temporary name and renamed, so that concurrent
+and interrupted runs never see a partial file. Failing to store an output
+only loses its caching.
+*/
+void
+GadgetronResultCache::store(const std::string& key, MRAcquisitionData& acqs)
+{
+	if (key.empty())
+		return;
+	std::string filename = filename_(key);
+	std::string tmp = cache_tmp_name_(filename);
+	try {
+		{
+			std::ofstream file(tmp.c_str(), std::ios::binary | std::ios::trunc);
+			uint32_t na = acqs.number();
+			write_cache_header_(file, key, na);
+			ISMRMRD::Acquisition acq;
+			for (uint32_t a = 0; a < na; a++) {
+				acqs.get_acquisition(a, acq);
+				const ISMRMRD::AcquisitionHeader& head = acq.getHead();
+				size_t ns = head.number_of_samples;
+				file.write((const char*)&head, sizeof(head));
+				file.write((const char*)acq.getTrajPtr(),
+					sizeof(float)*head.trajectory_dimensions*ns);
+				file.write((const char*)acq.getDataPtr(),
+					sizeof(complex_float_t)*head.active_channels*ns);
 			}
-			conn().send_gadgetron_close();
-			conn().wait();
-			break;
+			if (!file.flush())
+				THROW("failed to write cache file");
 		}
-		catch (...) {
-			if (connection_failed(nt))
-				THROW("Server running Gadgetron not accessible");
+		boost::filesystem::rename(tmp, filename);
+		std::lock_guard<std::mutex> lock(mutex_);
+		enforce_limit_();
+	}
+	catch (...) {
+		std::remove(tmp.c_str());
+		std::cerr << "failed to cache Gadgetron output in " << filename << '\n';
+	}
+}
+
+void
+GadgetronResultCache::store(const std::string& key, MRImageData& images)
+{
+	if (key.empty())
+		return;
+	std::string filename = filename_(key);
+	std::string tmp = cache_tmp_name_(filename);
+	try {
+		{
+			std::ofstream file(tmp.c_str(), std::ios::binary | std::ios::trunc);
+			uint32_t ni = images.number();
+			write_cache_header_(file, key, ni);
+			for (uint32_t i = 0; i < ni; i++) {
+				shared_ptr<ImageWrap> sptr_iw = images.sptr_image_wrap(i);
+				ImageWrap& iw = *sptr_iw;
+				std::string attributes = iw.attributes();
+				uint64_t size = attributes.size();
+				file.write((const char*)&iw.head(), sizeof(ISMRMRD::ImageHeader));
+				file.write((const char*)&size, sizeof(size));
+				file.write(attributes.c_str(), size);
+				file.write((const char*)iw.data_ptr(), iw.size());
+			}
+			if (!file.flush())
+				THROW("failed to write cache file");
 		}
+		boost::filesystem::rename(tmp, filename);
+		std::lock_guard<std::mutex> lock(mutex_);
+		enforce_limit_();
+	}
+	catch (...) {
+		std::remove(tmp.c_str());
+		std::cerr << "failed to cache Gadgetron output in " << filename << '\n';
 	}
-	check_gadgetron_connection(host_, port_);
-	sptr_images_->order();
 }
 
-void 
-ImagesProcessor::process(MRImageData& images)
+/*
+Also sets up the gadgets for process_locally_.
+*/
+bool
+AcquisitionsProcessor::can_process_locally(MRAcquisitionData& acquisitions)
+{
+	const std::list<shared_ptr<GadgetHandle> >& g = gadgets();
+#ifdef _MSC_VER
+	std::list<shared_ptr<GadgetHandle> >::const_iterator gh;
+#else
+	typename std::list<shared_ptr<GadgetHandle> >::const_iterator gh;
+#endif
+	for (gh = g.begin(); gh != g.end(); gh++)
+		if (!dynamic_cast<aLocalAcquisitionGadget*>(&gh->get()->gadget()))
+			return false;
+	// the in-process gadgets handle Cartesian readouts only
+	if (acquisitions.number() > 0) {
+		ISMRMRD::Acquisition acq;
+		acquisitions.get_acquisition(0, acq);
+		if (acq.trajectory_dimensions() > 0)
+			return false;
+	}
+	std::string header = acquisitions.acquisitions_info();
+	for (gh = g.begin(); gh != g.end(); gh++) {
+		aLocalAcquisitionGadget& lg =
+			dynamic_cast<aLocalAcquisitionGadget&>(gh->get()->gadget());
+		if (!lg.local_setup(header))
+			return false;
+	}
+	return true;
+}
+
+/*
+Runs the chain in-process: the acquisitions are read in batches, the
+acquisitions of a batch are passed through the gadgets several at once and
+the output is appended to the output container in the order of the input.
+*/
+shared_ptr<MRAcquisitionData>
+AcquisitionsProcessor::process_locally_
+(MRAcquisitionData& acquisitions, GadgetronSessionControl* control)
+{
+	const std::list<shared_ptr<GadgetHandle> >& g = gadgets();
+	std::vector<const aLocalAcquisitionGadget*> chain;
+#ifdef _MSC_VER
+	std::list<shared_ptr<GadgetHandle> >::const_iterator gh;
+#else
+	typename std::list<shared_ptr<GadgetHandle> >::const_iterator gh;
+#endif
+	for (gh = g.begin(); gh != g.end(); gh++)
+		chain.push_back
+		(dynamic_cast<aLocalAcquisitionGadget*>(&gh->get()->gadget()));
+	shared_ptr<MRAcquisitionData> sptr_acqs =
+		acquisitions.new_acquisitions_container();
+	unsigned int na = acquisitions.number();
+	unsigned int batch = prefetch_depth() > 0 ? prefetch_depth() : 1;
+	int nthreads = ThreadPool::num_threads();
+	std::vector<ISMRMRD::Acquisition> in(batch);
+	std::vector<std::vector<ISMRMRD::Acquisition> > out(batch);
+	for (unsigned int first = 0; first < na; first += batch) {
+		if (control && control->cancelled())
+			THROW("Gadgetron session cancelled");
+		unsigned int n = std::min(batch, na - first);
+		for (unsigned int i = 0; i < n; i++)
+			acquisitions.get_acquisition(first + i, in[i]);
+		parallel_for(n, nthreads, [&](int i) {
+			std::vector<ISMRMRD::Acquisition> acqs(1, in[i]);
+			for (unsigned int k = 0; k < chain.size(); k++) {
+				std::vector<ISMRMRD::Acquisition> next;
+				for (unsigned int j = 0; j < acqs.size(); j++)
+					chain[k]->process_locally(acqs[j], next);
+				acqs.swap(next);
+			}
+			out[i].swap(acqs);
+		});
+		for (unsigned int i = 0; i < n; i++) {
+			sptr_acqs->append_acquisitions(out[i]);
+			out[i].clear();
+		}
+	}
+	return sptr_acqs;
+}
+
+shared_ptr<MRAcquisitionData>
+AcquisitionsProcessor::process
+(MRAcquisitionData& acquisitions, GadgetronSessionControl* control)
 {
+	if (local_processing() && can_process_locally(acquisitions))
+		return process_locally_(acquisitions, control);
 	std::string config = xml();
-	GTConnector conn;
-	sptr_images_ = images.new_images_container();
-	conn().register_reader(GADGET_MESSAGE_ISMRMRD_IMAGE,
+	std::string key = GadgetronResultCache::key(config, acquisitions);
+	if (!key.empty()) {
+		shared_ptr<MRAcquisitionData> sptr_acqs =
+			acquisitions.new_acquisitions_container();
+		if (GadgetronResultCache::restore(key, *sptr_acqs))
+			return sptr_acqs;
+	}
+	shared_ptr<MRAcquisitionData> sptr_acqs =
+		acquisitions.new_acquisitions_container();
+	unsigned int depth = prefetch_depth();
+	const std::vector<GadgetronServer>& s = servers();
+	run_session_(s.empty() ? host_ : s[0].first, s.empty() ? port_ : s[0].second,
+		config, connection_options(),
+		GADGET_MESSAGE_ISMRMRD_ACQUISITION,
 		shared_ptr<GadgetronClientMessageReader>
-		(new GadgetronClientImageMessageCollector(sptr_images_)));
-	for (int nt = 0; nt < N_TRIALS; nt++) {
-		try {
-			conn().connect(host_, port_);
-			conn().send_gadgetron_configuration_script(config);
-			for (unsigned int i = 0; i < images.number(); i++) {
-				ImageWrap& iw = images.image_wrap(i);
-				conn().send_wrapped_image(iw);
-			}
-			conn().send_gadgetron_close();
-			conn().wait();
-			break;
+		(new GadgetronClientAcquisitionMessageCollector
+		(sptr_acqs, acquisitions.number())),
+		[&](GadgetronClientConnector& con) {
+			con.send_gadgetron_parameters(acquisitions.acquisitions_info());
+			send_acquisitions_(con, acquisitions, depth);
+	}, control);
+	GadgetronResultCache::store(key, *sptr_acqs);
+	return sptr_acqs;
+}
+
+shared_ptr<MRImageData>
+ImagesReconstructor::process
+(MRAcquisitionData& acquisitions, GadgetronSessionControl* control)
+{
+	std::string key = GadgetronResultCache::key(xml(), acquisitions);
+	if (!key.empty()) {
+		shared_ptr<MRImageData> sptr_images(new ImagesVector);
+		if (GadgetronResultCache::restore(key, *sptr_images)) {
+			sptr_images->order();
+			return sptr_images;
 		}
-		catch (...) {
-			if (connection_failed(nt))
-				THROW("Server running Gadgetron not accessible");
+	}
+	shared_ptr<MRImageData> sptr_images;
+	const std::vector<GadgetronServer>& s = servers();
+	if (s.size() > 1)
+		sptr_images = process_sharded_(acquisitions, control);
+	else if (s.size() == 1)
+		sptr_images = process(acquisitions, control, s[0].first, s[0].second);
+	else
+		sptr_images = process(acquisitions, control, host_, port_);
+	GadgetronResultCache::store(key, *sptr_images);
+	return sptr_images;
+}
+
+shared_ptr<MRImageData>
+ImagesReconstructor::process
+(MRAcquisitionData& acquisitions, GadgetronSessionControl* control,
+	const std::string& host, const std::string& port)
+{
+	shared_ptr<MRImageData> sptr_images(new ImagesVector);
+	unsigned int depth = prefetch_depth();
+	run_session_(host, port, xml(), connection_options(),
+		GADGET_MESSAGE_ISMRMRD_IMAGE,
+		shared_ptr<GadgetronClientMessageReader>
+		(new GadgetronClientImageMessageCollector(sptr_images)),
+		[&](GadgetronClientConnector& con) {
+			con.send_gadgetron_parameters(acquisitions.acquisitions_info());
+			send_acquisitions_(con, acquisitions, depth);
+	}, control);
+	sptr_images->order();
+	return sptr_images;
+}
+
+/*
+Splits the acquisitions into groups of readouts with the same slice and
+repetition, distributes the groups (in contiguous ranges, to keep the
+readouts of the server's input ordered) over the servers and reconstructs
+the parts concurrently; noise measurements are sent to every server.
+The images are merged and ordered as usual.
+*/
+shared_ptr<MRImageData>
+ImagesReconstructor::process_sharded_
+(MRAcquisitionData& acquisitions, GadgetronSessionControl* control)
+{
+	const std::vector<GadgetronServer>& s = servers();
+	uint32_t na = acquisitions.number();
+	ISMRMRD::Acquisition acq;
+
+	// numbers the (slice, repetition) groups in order of appearance
+	std::map<std::pair<uint16_t, uint16_t>, int> groups;
+	std::vector<int> group(na, -1);
+	for (uint32_t a = 0; a < na; a++) {
+		acquisitions.get_acquisition(a, acq);
+		if (acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_IS_NOISE_MEASUREMENT))
+			continue;
+		std::pair<uint16_t, uint16_t> key
+			(acq.idx().slice, acq.idx().repetition);
+		std::map<std::pair<uint16_t, uint16_t>, int>::iterator it =
+			groups.find(key);
+		if (it == groups.end())
+			it = groups.insert(std::make_pair(key, (int)groups.size())).first;
+		group[a] = it->second;
+	}
+	int ng = (int)groups.size();
+	int ns = (int)s.size();
+	if (ns > ng)
+		ns = ng;
+	if (ns < 2)
+		return process(acquisitions, control, s[0].first, s[0].second);
+
+	std::vector<shared_ptr<MRAcquisitionData> > parts(ns);
+	for (int i = 0; i < ns; i++)
+		parts[i] = acquisitions.new_acquisitions_container();
+	for (uint32_t a = 0; a < na; a++) {
+		acquisitions.get_acquisition(a, acq);
+		if (group[a] < 0) {
+			for (int i = 0; i < ns; i++)
+				parts[i]->append_acquisition(acq);
+		}
+		else
+			parts[(size_t)group[a] * ns / ng]->append_acquisition(acq);
+	}
+
+	std::vector<shared_ptr<MRImageData> > outputs(ns);
+	// the sessions wait for their servers, hence are not run on the pool
+	run_concurrently(ns, [&](int i) {
+		outputs[i] = process(*parts[i], control, s[i].first, s[i].second);
+	});
+
+	shared_ptr<MRImageData> sptr_images(new ImagesVector);
+	for (int i = 0; i < ns; i++) {
+		MRImageData& out = *outputs[i];
+		for (unsigned int j = 0; j < out.number(); j++) {
+			ImageWrap& iw = out.image_wrap(j);
+			sptr_images->append(iw);
+			sptr_images->count(iw.head().image_index);
 		}
 	}
-	check_gadgetron_connection(host_, port_);
+	sptr_images->order();
+	return sptr_images;
+}
+
+bool
+ImagesProcessor::can_process_locally(const MRImageData& images) const
+{
+	const std::list<shared_ptr<GadgetHandle> >& g = gadgets();
+#ifdef _MSC_VER
+	std::list<shared_ptr<GadgetHandle> >::const_iterator gh;
+#else
+	typename std::list<shared_ptr<GadgetHandle> >::const_iterator gh;
+#endif
+	for (gh = g.begin(); gh != g.end(); gh++)
+		if (!dynamic_cast<const aLocalImageGadget*>(&gh->get()->gadget()))
+			return false;
+	// each distinct input data type must pass through the whole chain
+	std::vector<int> types;
+	for (unsigned int i = 0; i < images.number(); i++) {
+		int type = images.image_data_type(i);
+		if (std::find(types.begin(), types.end(), type) != types.end())
+			continue;
+		types.push_back(type);
+		for (gh = g.begin(); gh != g.end(); gh++) {
+			const aLocalImageGadget& lg =
+				dynamic_cast<const aLocalImageGadget&>(gh->get()->gadget());
+			if (!lg.local_input(type))
+				return false;
+			type = lg.local_output(type);
+		}
+	}
+	return true;
+}
+
+/*
+Runs the chain in-process: each image is passed through the gadgets on
+its own, several images at once, and the output images are appended to
+the output container in the order of the input ones.
+*/
+shared_ptr<MRImageData>
+ImagesProcessor::process_locally_
+(MRImageData& images, GadgetronSessionControl* control)
+{
+	const std::list<shared_ptr<GadgetHandle> >& g = gadgets();
+	std::vector<aLocalImageGadget*> chain;
+#ifdef _MSC_VER
+	std::list<shared_ptr<GadgetHandle> >::const_iterator gh;
+#else
+	typename std::list<shared_ptr<GadgetHandle> >::const_iterator gh;
+#endif
+	for (gh = g.begin(); gh != g.end(); gh++) {
+		aLocalImageGadget* lg =
+			dynamic_cast<aLocalImageGadget*>(&gh->get()->gadget());
+		lg->local_setup();
+		chain.push_back(lg);
+	}
+	unsigned int ni = images.number();
+	std::vector<std::vector<shared_ptr<ImageWrap> > > out(ni);
+	int nthreads = ThreadPool::num_threads();
+	parallel_for(ni, nthreads, [&](int i) {
+		if (control && control->cancelled())
+			THROW("Gadgetron session cancelled");
+		std::vector<shared_ptr<ImageWrap> > in;
+		in.push_back(images.sptr_image_wrap(i));
+		for (unsigned int k = 0; k < chain.size(); k++) {
+			std::vector<shared_ptr<ImageWrap> > next;
+			for (unsigned int j = 0; j < in.size(); j++)
+				chain[k]->process_locally(*in[j], next);
+			in.swap(next);
+		}
+		out[i].swap(in);
+	});
+	shared_ptr<MRImageData> sptr_images = images.new_images_container();
+	for (unsigned int i = 0; i < ni; i++) {
+		for (unsigned int j = 0; j < out[i].size(); j++)
+			sptr_images->append(*out[i][j]);
+		out[i].clear();
+	}
+	return sptr_images;
+}
+
+shared_ptr<MRImageData>
+ImagesProcessor::process(MRImageData& images, GadgetronSessionControl* control)
+{
+	if (local_processing() && can_process_locally(images))
+		return process_locally_(images, control);
+	std::string config = xml();
+	std::string key = GadgetronResultCache::key(config, images);
+	if (!key.empty()) {
+		shared_ptr<MRImageData> sptr_images = images.new_images_container();
+		if (GadgetronResultCache::restore(key, *sptr_images))
+			return sptr_images;
+	}
+	shared_ptr<MRImageData> sptr_images = images.new_images_container();
+	const std::vector<GadgetronServer>& s = servers();
+	run_session_(s.empty() ? host_ : s[0].first, s.empty() ? port_ : s[0].second,
+		config, connection_options(),
+		GADGET_MESSAGE_ISMRMRD_IMAGE,
+		shared_ptr<GadgetronClientMessageReader>
+		(new GadgetronClientImageMessageCollector(sptr_images)),
+		[&](GadgetronClientConnector& con) {
+			for (unsigned int i = 0; i < images.number(); i++) {
+				// contiguous volumes hand out a temporary copy of the image
+				shared_ptr<ImageWrap> sptr_iw = images.sptr_image_wrap(i);
+				con.send_wrapped_image(*sptr_iw);
+			}
+	}, control);
+	GadgetronResultCache::store(key, *sptr_images);
+	return sptr_images;
 }
 
 void
@@ -224,6 +973,7 @@ ImagesProcessor::check_connection()
 {
 	std::string config = xml();
 	GTConnector conn;
+	conn().set_options(connection_options());
 	shared_ptr<MRImageData> sptr_images(new ImagesVector);
 	MRImageData& images = *sptr_images_;
 	conn().register_reader(GADGET_MESSAGE_ISMRMRD_IMAGE,
@@ -239,17 +989,385 @@ ImagesProcessor::check_connection()
 	conn().wait();
 }
 
+template<class F>
+void
+GadgetronJob::run_(F f)
+{
+	thread_ = std::thread([this, f]() {
+		try {
+			f();
+		}
+		catch (...) {
+			error_ = std::current_exception();
+		}
+		done_ = true;
+	});
+}
+
+shared_ptr<GadgetronJob>
+GadgetronJob::start
+(shared_ptr<ImagesReconstructor> sptr_recon,
+	shared_ptr<MRAcquisitionData> sptr_input)
+{
+	shared_ptr<GadgetronJob> sptr_job(new GadgetronJob);
+	GadgetronJob* job = sptr_job.get();
+	job->run_([=]() {
+		job->sptr_images_ = sptr_recon->process(*sptr_input, &job->control_);
+	});
+	return sptr_job;
+}
+
+shared_ptr<GadgetronJob>
+GadgetronJob::start
+(shared_ptr<AcquisitionsProcessor> sptr_proc,
+	shared_ptr<MRAcquisitionData> sptr_input)
+{
+	shared_ptr<GadgetronJob> sptr_job(new GadgetronJob);
+	GadgetronJob* job = sptr_job.get();
+	job->run_([=]() {
+		job->sptr_acqs_ = sptr_proc->process(*sptr_input, &job->control_);
+	});
+	return sptr_job;
+}
+
+shared_ptr<GadgetronJob>
+GadgetronJob::start
+(shared_ptr<ImagesProcessor> sptr_proc, shared_ptr<MRImageData> sptr_input)
+{
+	shared_ptr<GadgetronJob> sptr_job(new GadgetronJob);
+	GadgetronJob* job = sptr_job.get();
+	job->run_([=]() {
+		job->sptr_images_ = sptr_proc->process(*sptr_input, &job->control_);
+	});
+	return sptr_job;
+}
+
+GadgetronJob::~GadgetronJob()
+{
+	control_.cancel();
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (thread_.joinable())
+		thread_.join();
+}
+
+void
+GadgetronJob::wait()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (thread_.joinable())
+			thread_.join();
+	}
+	if (error_)
+		std::rethrow_exception(error_);
+}
+
+shared_ptr<GadgetronStream>
+GadgetronStream::start
+(shared_ptr<ImagesReconstructor> sptr_recon, const std::string& header,
+	unsigned int capacity, ImageCallback callback)
+{
+	shared_ptr<GadgetronStream> sptr_stream
+		(new GadgetronStream(capacity, callback));
+	GadgetronStream* stream = sptr_stream.get();
+	stream->thread_ = std::thread([=]() {
+		stream->run_(sptr_recon, header);
+	});
+	return sptr_stream;
+}
+
+/*
+Runs the session: the sender takes the acquisitions from the input queue
+as they are fed. A lost connection cannot be re-established once
+acquisitions have been sent, as they are not kept.
+*/
+void
+GadgetronStream::run_
+(shared_ptr<ImagesReconstructor> sptr_recon, const std::string& header)
+{
+	try {
+		const std::vector<GadgetronServer>& s = sptr_recon->servers();
+		const std::string& host = s.empty() ? sptr_recon->host_ : s[0].first;
+		const std::string& port = s.empty() ? sptr_recon->port_ : s[0].second;
+		bool sent = false;
+		run_session_(host, port, sptr_recon->xml(),
+			sptr_recon->connection_options(), GADGET_MESSAGE_ISMRMRD_IMAGE,
+			shared_ptr<GadgetronClientMessageReader>
+			(new GadgetronClientImageMessageStreamer
+			([this](shared_ptr<ImageWrap> sptr_iw) { receive_(sptr_iw); })),
+			[&](GadgetronClientConnector& con) {
+				if (sent)
+					THROW("Gadgetron streaming session lost");
+				con.send_gadgetron_parameters(header);
+				for (;;) {
+					ISMRMRD::Acquisition acq;
+					{
+						std::unique_lock<std::mutex> lock(mutex_);
+						cv_.wait(lock, [&]() {
+							return cancelled_ || finished_ || !input_.empty();
+						});
+						if (cancelled_)
+							THROW("Gadgetron session cancelled");
+						if (input_.empty())
+							break;
+						std::swap(acq, input_.front());
+						input_.pop_front();
+					}
+					sent = true;
+					con.send_ismrmrd_acquisition(acq);
+				}
+		}, &control_);
+	}
+	catch (...) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		error_ = std::current_exception();
+	}
+	std::lock_guard<std::mutex> lock(mutex_);
+	ended_ = true;
+	cv_.notify_all();
+}
+
+void
+GadgetronStream::receive_(shared_ptr<ImageWrap> sptr_iw)
+{
+	num_images_++;
+	if (callback_) {
+		callback_(sptr_iw);
+		return;
+	}
+	std::unique_lock<std::mutex> lock(mutex_);
+	cv_.wait(lock, [&]() {
+		return cancelled_ || images_.size() < capacity_;
+	});
+	if (cancelled_)
+		THROW("Gadgetron session cancelled");
+	images_.push_back(sptr_iw);
+	cv_.notify_all();
+}
+
+GadgetronStream::~GadgetronStream()
+{
+	cancel();
+	if (thread_.joinable())
+		thread_.join();
+}
+
+void
+GadgetronStream::feed(const ISMRMRD::Acquisition& acq)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (finished_)
+		THROW("no acquisitions can be fed after finish");
+	input_.push_back(acq);
+	cv_.notify_all();
+}
+
+unsigned int
+GadgetronStream::feed(MRAcquisitionData& acquisitions, unsigned int first)
+{
+	unsigned int na = acquisitions.number();
+	ISMRMRD::Acquisition acq;
+	for (unsigned int i = first; i < na; i++) {
+		acquisitions.get_acquisition(i, acq);
+		feed(acq);
+	}
+	return na > first ? na - first : 0;
+}
+
+void
+GadgetronStream::finish()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	finished_ = true;
+	cv_.notify_all();
+}
+
+shared_ptr<ImageWrap>
+GadgetronStream::next_image(int timeout_ms)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	auto ready = [&]() { return ended_ || !images_.empty(); };
+	if (timeout_ms < 0)
+		cv_.wait(lock, ready);
+	else
+		cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms), ready);
+	if (images_.empty()) {
+		if (ended_ && error_)
+			std::rethrow_exception(error_);
+		return shared_ptr<ImageWrap>();
+	}
+	shared_ptr<ImageWrap> sptr_iw = images_.front();
+	images_.pop_front();
+	cv_.notify_all();
+	return sptr_iw;
+}
+
+bool
+GadgetronStream::done()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return ended_ && images_.empty();
+}
+
+void
+GadgetronStream::cancel()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		cancelled_ = true;
+		cv_.notify_all();
+	}
+	control_.cancel();
+}
+
+/*
+The encoding trajectory is read from the header text, as its type in
+ISMRMRD::Encoding differs between ISMRMRD versions.
+*/
+static bool
+cartesian_trajectory_(const std::string& header)
+{
+	const std::string tag("<trajectory>");
+	size_t i = header.find(tag);
+	if (i == std::string::npos)
+		return true;
+	i += tag.size();
+	std::string trajectory = header.substr(i, header.find('<', i) - i);
+	boost::algorithm::trim(trajectory);
+	return boost::iequals(trajectory, "cartesian");
+}
+
+void
+KSpaceSampling::compute(MRAcquisitionData& ac)
+{
+	clear();
+	ISMRMRD::IsmrmrdHeader header;
+	std::string par = ac.acquisitions_info();
+	ISMRMRD::deserialize(par.c_str(), header);
+	ISMRMRD::Encoding e = header.encoding[0];
+	nx_ = e.reconSpace.matrixSize.x;
+	ny_ = e.reconSpace.matrixSize.y;
+	nc_ = 0;
+	readout_ = 0;
+	trajectory_ = false;
+
+	ISMRMRD::Acquisition acq;
+	unsigned int na = ac.number();
+	headers_.reserve(na);
+	bool in_slice = false;
+	unsigned int first = 0;
+	for (unsigned int a = 0; a < na; a++) {
+		ac.get_acquisition(a, acq);
+		if (a == 0) {
+			nc_ = acq.active_channels();
+			readout_ = acq.number_of_samples();
+		}
+		headers_.push_back(acq.getHead());
+		if (acq.trajectory_dimensions() > 0)
+			trajectory_ = true;
+		if (!in_slice && acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_FIRST_IN_SLICE)) {
+			in_slice = true;
+			first = a;
+		}
+		if (in_slice && acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_LAST_IN_SLICE)) {
+			in_slice = false;
+			ranges_.push_back(std::make_pair(first, a));
+		}
+	}
+	non_cartesian_ = trajectory_ && !cartesian_trajectory_(par);
+	ready_ = true;
+}
+
+bool
+KSpaceSampling::range
+(unsigned int off, unsigned int& first, unsigned int& last) const
+{
+	for (size_t i = 0; i < ranges_.size(); i++) {
+		if (ranges_[i].first >= off) {
+			first = ranges_[i].first;
+			last = ranges_[i].second;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool
+MRAcquisitionModel::slice_range_(MRAcquisitionData& ac, unsigned int off,
+	unsigned int& first, unsigned int& last)
+{
+	ISMRMRD::Acquisition acq;
+	unsigned int na = ac.number();
+	unsigned int a = off;
+	for (; a < na; a++) {
+		ac.get_acquisition(a, acq);
+		if (acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_FIRST_IN_SLICE))
+			break;
+	}
+	if (a >= na)
+		return false;
+	first = a;
+	for (; a < na; a++) {
+		if (a > first)
+			ac.get_acquisition(a, acq);
+		if (acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_LAST_IN_SLICE))
+			break;
+	}
+	if (a >= na)
+		return false;
+	last = a;
+	return true;
+}
+
+void
+MRAcquisitionModel::slice_ranges_(MRAcquisitionData& ac,
+	std::vector<std::pair<unsigned int, unsigned int> >& ranges)
+{
+	ranges.clear();
+	unsigned int first, last;
+	for (unsigned int a = 0; slice_range_(ac, a, first, last); a = last + 1)
+		ranges.push_back(std::make_pair(first, last));
+}
+
 void
 MRAcquisitionModel::fwd(MRImageData& ic, CoilSensitivitiesContainer& cc, 
 	MRAcquisitionData& ac)
 {
+	SIRF_PROFILE("MRAcquisitionModel::fwd");
 	if (cc.items() < 1)
 		throw LocalisedException
 		("coil sensitivity maps not found", __FILE__, __LINE__);
-	for (unsigned int i = 0, a = 0; i < ic.number(); i++) {
-		ImageWrap& iw = ic.image_wrap(i);
-		CoilData& csm = cc(i%cc.items());
-		fwd(iw, csm, ac, a);
+	const std::vector<std::pair<unsigned int, unsigned int> >& ranges =
+		sampling().ranges();
+	unsigned int ni = ic.number();
+	if (ranges.size() < ni)
+		throw LocalisedException
+		("acquisition template has fewer slices than images", 
+		__FILE__, __LINE__);
+	prepare_nufft_();
+	make_resident_(cc);
+	if (nthreads_ < 2) {
+		for (unsigned int i = 0; i < ni; i++)
+			fwd(*ic.sptr_image_wrap(i), cc(i%cc.items()), ac, 
+			ranges[i].first, ranges[i].second);
+		return;
+	}
+	// each image item is projected into its own buffer, buffers are then
+	// appended in image order
+	std::vector<gadgetron::shared_ptr<MRAcquisitionData> > buff(ni);
+	parallel_for(ni, nthreads_, [&](int i) {
+		buff[i].reset(new AcquisitionsVector(ac.acquisitions_info()));
+		fwd(*ic.sptr_image_wrap(i), cc(i%cc.items()), *buff[i],
+			ranges[i].first, ranges[i].second);
+	});
+	ISMRMRD::Acquisition acq;
+	for (unsigned int i = 0; i < ni; i++) {
+		MRAcquisitionData& b = *buff[i];
+		for (unsigned int a = 0; a < b.number(); a++) {
+			b.get_acquisition(a, acq);
+			ac.append_acquisition(acq);
+		}
+		buff[i].reset();
 	}
 }
 
@@ -257,38 +1375,347 @@ void
 MRAcquisitionModel::bwd(MRImageData& ic, CoilSensitivitiesContainer& cc, 
 	MRAcquisitionData& ac)
 {
+	SIRF_PROFILE("MRAcquisitionModel::bwd");
 	if (cc.items() < 1)
 		throw LocalisedException
 		("coil sensitivity maps not found", __FILE__, __LINE__);
-	ImageWrap iw(sptr_imgs_->image_wrap(0));
-	for (unsigned int i = 0, a = 0; a < ac.number(); i++) {
-		CoilData& csm = cc(i%cc.items());
-		bwd(iw, csm, ac, a);
-		ic.append(iw);
+	// readouts of ac are expected to be laid out as in the template,
+	// otherwise the slice ranges have to be found by scanning ac
+	std::vector<std::pair<unsigned int, unsigned int> > ac_ranges;
+	const KSpaceSampling& ks = sampling();
+	if (ac.number() != ks.number())
+		slice_ranges_(ac, ac_ranges);
+	const std::vector<std::pair<unsigned int, unsigned int> >& ranges =
+		ac.number() == ks.number() ? ks.ranges() : ac_ranges;
+	unsigned int ni = (unsigned int)ranges.size();
+	if (ks.non_cartesian() && ac.number() != ks.number())
+		throw LocalisedException
+		("non-Cartesian acquisitions must be laid out as the template",
+		__FILE__, __LINE__);
+	prepare_nufft_();
+	make_resident_(cc);
+	if (nthreads_ < 2) {
+		ImageWrap iw(sptr_imgs_->image_wrap(0));
+		for (unsigned int i = 0; i < ni; i++) {
+			bwd(iw, cc(i%cc.items()), ac, ranges[i].first, ranges[i].second);
+			ic.append(iw);
+		}
+		return;
+	}
+	std::vector<gadgetron::shared_ptr<ImageWrap> > images(ni);
+	// ac is only read here, so file-backed readouts can be read in blocks
+	// by each thread instead of one at a time under the HDF5 lock
+	AcquisitionsFile* ptr_af = dynamic_cast<AcquisitionsFile*>(&ac);
+	bool read_only = ptr_af && ptr_af->read_only();
+	if (ptr_af)
+		ptr_af->set_read_only(true);
+	try {
+		parallel_for(ni, nthreads_, [&](int i) {
+			images[i].reset(new ImageWrap(sptr_imgs_->image_wrap(0)));
+			bwd(*images[i], cc(i%cc.items()), ac,
+				ranges[i].first, ranges[i].second);
+		});
+	}
+	catch (...) {
+		if (ptr_af)
+			ptr_af->set_read_only(read_only);
+		throw;
+	}
+	if (ptr_af)
+		ptr_af->set_read_only(read_only);
+	for (unsigned int i = 0; i < ni; i++)
+		ic.append(*images[i]);
+}
+
+void
+MRAcquisitionModel::prepare_nufft_()
+{
+	const KSpaceSampling& ks = sampling();
+	if (!ks.non_cartesian())
+		return;
+	const std::vector<std::pair<unsigned int, unsigned int> >& ranges =
+		ks.ranges();
+	if (grids_.size() != ranges.size()) {
+		grids_.assign(ranges.size(), NUFFTGrid());
+		ISMRMRD::Acquisition acq;
+		std::vector<float> kx;
+		std::vector<float> ky;
+		for (size_t i = 0; i < ranges.size(); i++) {
+			kx.clear();
+			ky.clear();
+			for (unsigned int a = ranges[i].first; a <= ranges[i].second; a++) {
+				sptr_acqs_->get_acquisition(a, acq);
+				unsigned int nd = acq.trajectory_dimensions();
+				if (nd < 2)
+					throw LocalisedException
+					("2D trajectory expected in non-Cartesian readouts",
+					__FILE__, __LINE__);
+				const float* traj = acq.getTrajPtr();
+				for (unsigned int s = 0; s < acq.number_of_samples(); s++) {
+					kx.push_back(traj[s*nd]);
+					ky.push_back(traj[s*nd + 1]);
+				}
+			}
+			grids_[i].set_up(ks.nx(), ks.ny(), kx, ky);
+		}
+	}
+	if (density_compensation_)
+		for (size_t i = 0; i < grids_.size(); i++)
+			grids_[i].density_compensation(fft_threads_);
+}
+
+NUFFTGrid&
+MRAcquisitionModel::grid_(unsigned int first)
+{
+	const std::vector<std::pair<unsigned int, unsigned int> >& ranges =
+		sampling_.ranges();
+	for (size_t i = 0; i < ranges.size() && i < grids_.size(); i++)
+		if (ranges[i].first == first)
+			return grids_[i];
+	throw LocalisedException
+		("readouts do not start an image item of the template",
+		__FILE__, __LINE__);
+}
+
+/*
+Coil images are projected by the gridding non-uniform FFT, the samples of
+each readout being taken from the output in the template order.
+*/
+template< typename T>
+void
+MRAcquisitionModel::fwd_nufft_(const T* img, CoilData& csm,
+	MRAcquisitionData& ac, unsigned int first, unsigned int last)
+{
+	const KSpaceSampling& ks = sampling_;
+	unsigned int nx = ks.nx();
+	unsigned int ny = ks.ny();
+	unsigned int nc = ks.nc();
+	const NUFFTGrid& grid = grid_(first);
+	size_t ns = grid.samples();
+
+	const complex_float_t* ptr_csm = resident_csm_(csm);
+	std::vector<complex_float_t> ci((size_t)nx * ny * nc);
+	for (unsigned int c = 0, i = 0; c < nc; c++)
+		for (unsigned int y = 0; y < ny; y++)
+			for (unsigned int x = 0; x < nx; x++, i++) {
+				complex_float_t zc = ptr_csm ? ptr_csm[i] : csm(x, y, 0, c);
+				ci[i] = (complex_float_t)img[(size_t)y * nx + x] * zc;
+			}
+
+	std::vector<complex_float_t> data(ns * nc);
+	grid.forward(&ci[0], &data[0], nc, fft_threads_);
+
+	ISMRMRD::Acquisition acq;
+	size_t off = 0;
+	for (unsigned int a = first; a <= last; a++) {
+		sptr_acqs_->get_acquisition(a, acq);
+		unsigned int n = acq.number_of_samples();
+		complex_float_t* dst = acq.getDataPtr();
+		for (unsigned int c = 0; c < nc; c++)
+			memcpy(dst + (size_t)c * n, &data[c * ns + off],
+				n * sizeof(complex_float_t));
+		off += n;
+		ac.append_acquisition(acq);
+	}
+}
+
+template< typename T>
+void
+MRAcquisitionModel::bwd_nufft_(T* img, CoilData& csm,
+	MRAcquisitionData& ac, unsigned int first, unsigned int last)
+{
+	const KSpaceSampling& ks = sampling_;
+	unsigned int nx = ks.nx();
+	unsigned int ny = ks.ny();
+	unsigned int nc = ks.nc();
+	NUFFTGrid& grid = grid_(first);
+	size_t ns = grid.samples();
+
+	std::vector<complex_float_t> data(ns * nc);
+	ISMRMRD::Acquisition acq;
+	size_t off = 0;
+	for (unsigned int a = first; a <= last; a++) {
+		ac.get_acquisition(a, acq);
+		unsigned int n = acq.number_of_samples();
+		if (off + n > ns)
+			throw LocalisedException
+			("readouts do not match the template", __FILE__, __LINE__);
+		const complex_float_t* src = acq.getDataPtr();
+		for (unsigned int c = 0; c < nc; c++)
+			memcpy(&data[c * ns + off], src + (size_t)c * n,
+				n * sizeof(complex_float_t));
+		off += n;
+	}
+	if (density_compensation_) {
+		const std::vector<float>& w = grid.density_compensation(fft_threads_);
+		for (unsigned int c = 0; c < nc; c++)
+			for (size_t s = 0; s < ns; s++)
+				data[c * ns + s] *= w[s];
+	}
+
+	std::vector<complex_float_t> ci((size_t)nx * ny * nc);
+	grid.adjoint(&data[0], &ci[0], nc, fft_threads_);
+
+	const complex_float_t* ptr_csm = resident_csm_(csm);
+	std::vector<complex_float_t> sum((size_t)nx * ny);
+	for (unsigned int c = 0, i = 0; c < nc; c++)
+		for (unsigned int y = 0; y < ny; y++)
+			for (unsigned int x = 0; x < nx; x++, i++) {
+				complex_float_t zc = ptr_csm ? ptr_csm[i] : csm(x, y, 0, c);
+				sum[(size_t)y * nx + x] += std::conj(zc) * ci[i];
+			}
+	for (size_t i = 0; i < sum.size(); i++)
+		xGadgetronUtilities::convert_complex(sum[i], img[i]);
+}
+
+/*
+Only the maps of the dimensions of the reconstructed images are copied,
+the others are used via CoilData as before.
+*/
+void
+MRAcquisitionModel::make_resident_(CoilSensitivitiesContainer& cc)
+{
+	if (!resident_)
+		return;
+	if (&cc != resident_cc_) {
+		resident_csms_.clear();
+		resident_cc_ = &cc;
 	}
+	const KSpaceSampling& ks = sampling();
+	for (unsigned int i = 0; i < cc.items(); i++) {
+		const CoilData& csm = cc(i);
+		if (resident_csms_.count(&csm))
+			continue;
+		int dim[4];
+		csm.get_dim(dim);
+		if (dim[0] != (int)ks.nx() || dim[1] != (int)ks.ny() || dim[2] != 1 ||
+			dim[3] != (int)ks.nc())
+			continue;
+		std::vector<complex_float_t>& data = resident_csms_[&csm];
+		data.resize((size_t)dim[0] * dim[1] * dim[3]);
+		csm.get_data(&data[0]);
+	}
+}
+
+const complex_float_t*
+MRAcquisitionModel::resident_csm_(const CoilData& csm) const
+{
+	if (!resident_)
+		return 0;
+	std::map<const CoilData*, std::vector<complex_float_t> >::const_iterator
+		it = resident_csms_.find(&csm);
+	return it == resident_csms_.end() ? 0 : &it->second[0];
+}
+
+/*
+The same projection as fwd_, with the image and the maps accessed as
+arrays and readouts copied a coil at a time.
+*/
+template< typename T>
+void
+MRAcquisitionModel::fwd_resident_(const T* img, const complex_float_t* csm,
+	MRAcquisitionData& ac, unsigned int first, unsigned int last)
+{
+	const KSpaceSampling& ks = sampling_;
+	unsigned int nx = ks.nx();
+	unsigned int ny = ks.ny();
+	unsigned int nc = ks.nc();
+	unsigned int readout = ks.readout();
+	unsigned int xoff = (readout - nx) / 2;
+
+	std::vector<complex_float_t> ci((size_t)readout * ny * nc);
+	for (unsigned int c = 0; c < nc; c++) {
+		for (unsigned int y = 0; y < ny; y++) {
+			const T* src = img + (size_t)y * nx;
+			const complex_float_t* s = csm + ((size_t)c * ny + y) * nx;
+			complex_float_t* dst = &ci[((size_t)c * ny + y) * readout + xoff];
+			for (unsigned int x = 0; x < nx; x++)
+				dst[x] = (complex_float_t)src[x] * s[x];
+		}
+	}
+
+	ISMRMRD::fft2c(&ci[0], readout, ny, nc, fft_threads_);
+
+	ISMRMRD::Acquisition acq;
+	for (unsigned int a = first; a <= last; a++) {
+		// trajectories are only kept in the template itself
+		if (ks.trajectory())
+			sptr_acqs_->get_acquisition(a, acq);
+		else
+			acq.setHead(ks.header(a));
+		int yy = ks.line(a);
+		complex_float_t* dst = acq.getDataPtr();
+		for (unsigned int c = 0; c < nc; c++)
+			memcpy(dst + (size_t)c * readout,
+				&ci[((size_t)c * ny + yy) * readout],
+				readout * sizeof(complex_float_t));
+		ac.append_acquisition(acq);
+	}
+}
+
+template< typename T>
+void
+MRAcquisitionModel::bwd_resident_(T* img, const complex_float_t* csm,
+	MRAcquisitionData& ac, unsigned int first, unsigned int last)
+{
+	const KSpaceSampling& ks = sampling_;
+	unsigned int nx = ks.nx();
+	unsigned int ny = ks.ny();
+	unsigned int nc = ks.nc();
+	unsigned int readout = ks.readout();
+	unsigned int xoff = (readout - nx) / 2;
+
+	std::vector<complex_float_t> ci((size_t)readout * ny * nc);
+	ISMRMRD::Acquisition acq;
+	for (unsigned int a = first; a <= last; a++) {
+		ac.get_acquisition(a, acq);
+		int yy = acq.idx().kspace_encode_step_1;
+		const complex_float_t* src = acq.getDataPtr();
+		for (unsigned int c = 0; c < nc; c++)
+			memcpy(&ci[((size_t)c * ny + yy) * readout],
+				src + (size_t)c * readout,
+				readout * sizeof(complex_float_t));
+	}
+	ISMRMRD::ifft2c(&ci[0], readout, ny, nc, fft_threads_);
+
+	// the coil sum is accumulated in complex_float_t and converted once
+	std::vector<complex_float_t> sum((size_t)nx * ny);
+	for (unsigned int c = 0; c < nc; c++) {
+		for (unsigned int y = 0; y < ny; y++) {
+			const complex_float_t* z = &ci[((size_t)c * ny + y) * readout + xoff];
+			const complex_float_t* s = csm + ((size_t)c * ny + y) * nx;
+			complex_float_t* dst = &sum[(size_t)y * nx];
+			for (unsigned int x = 0; x < nx; x++)
+				dst[x] += std::conj(s[x]) * z[x];
+		}
+	}
+	for (size_t i = 0; i < sum.size(); i++)
+		xGadgetronUtilities::convert_complex(sum[i], img[i]);
 }
 
 template< typename T>
 void 
 MRAcquisitionModel::fwd_(ISMRMRD::Image<T>* ptr_img, CoilData& csm,
-	MRAcquisitionData& ac, unsigned int& off)
+	MRAcquisitionData& ac, unsigned int first, unsigned int last)
 {
 	ISMRMRD::Image<T>& img = *ptr_img;
 
-	std::string par;
-	ISMRMRD::IsmrmrdHeader header;
-	//par = ac.acquisitions_info();
-	par = sptr_acqs_->acquisitions_info();
-	ISMRMRD::deserialize(par.c_str(), header);
-	ISMRMRD::Encoding e = header.encoding[0];
-	ISMRMRD::Acquisition acq; // (acq_);
-	sptr_acqs_->get_acquisition(0, acq);
+	if (sampling_.non_cartesian()) {
+		fwd_nufft_(img.getDataPtr(), csm, ac, first, last);
+		return;
+	}
 
-	//int readout = e.encodedSpace.matrixSize.x;
-	unsigned int nx = e.reconSpace.matrixSize.x;
-	unsigned int ny = e.reconSpace.matrixSize.y;
-	unsigned int nc = acq.active_channels();
-	unsigned int readout = acq.number_of_samples();
+	const complex_float_t* ptr_csm = resident_csm_(csm);
+	if (ptr_csm) {
+		fwd_resident_(img.getDataPtr(), ptr_csm, ac, first, last);
+		return;
+	}
+
+	const KSpaceSampling& ks = sampling_;
+	unsigned int nx = ks.nx();
+	unsigned int ny = ks.ny();
+	unsigned int nc = ks.nc();
+	unsigned int readout = ks.readout();
 
 	std::vector<size_t> dims;
 	dims.push_back(readout);
@@ -309,53 +1736,49 @@ MRAcquisitionModel::fwd_(ISMRMRD::Image<T>* ptr_img, CoilData& csm,
 		}
 	}
 
-	memset((void*)acq.getDataPtr(), 0, acq.getDataSize());
-
-	fft2c(ci);
+	fft2c(ci, fft_threads_);
 
-	int y = 0;
-	for (;;){
-		sptr_acqs_->get_acquisition(off + y, acq);
-		if (acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_FIRST_IN_SLICE))
-			break;
-		y++;
-	}
-	for (;;) {
-		sptr_acqs_->get_acquisition(off + y, acq);
-		int yy = acq.idx().kspace_encode_step_1;
+	ISMRMRD::Acquisition acq;
+	for (unsigned int a = first; a <= last; a++) {
+		// trajectories are only kept in the template itself
+		if (ks.trajectory())
+			sptr_acqs_->get_acquisition(a, acq);
+		else
+			acq.setHead(ks.header(a));
+		int yy = ks.line(a);
 		for (unsigned int c = 0; c < nc; c++) {
 			for (unsigned int s = 0; s < readout; s++) {
 				acq.data(s, c) = ci(s, yy, c);
 			}
 		}
 		ac.append_acquisition(acq);
-		y++;
-		if (acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_LAST_IN_SLICE))
-			break;
 	}
-	off += y;
 
 }
 
 template< typename T>
 void 
 MRAcquisitionModel::bwd_(ISMRMRD::Image<T>* ptr_im, CoilData& csm,
-	MRAcquisitionData& ac, unsigned int& off)
+	MRAcquisitionData& ac, unsigned int first, unsigned int last)
 {
 	ISMRMRD::Image<T>& im = *ptr_im;
 
-	std::string par;
-	ISMRMRD::IsmrmrdHeader header;
-	par = ac.acquisitions_info();
-	ISMRMRD::deserialize(par.c_str(), header);
-	ISMRMRD::Encoding e = header.encoding[0];
-	ISMRMRD::Acquisition acq;
-	sptr_acqs_->get_acquisition(0, acq);
+	if (sampling_.non_cartesian()) {
+		bwd_nufft_(im.getDataPtr(), csm, ac, first, last);
+		return;
+	}
+
+	const complex_float_t* ptr_csm = resident_csm_(csm);
+	if (ptr_csm) {
+		bwd_resident_(im.getDataPtr(), ptr_csm, ac, first, last);
+		return;
+	}
 
-	unsigned int nx = e.reconSpace.matrixSize.x;
-	unsigned int ny = e.reconSpace.matrixSize.y;
-	unsigned int nc = acq.active_channels();
-	unsigned int readout = acq.number_of_samples();
+	const KSpaceSampling& ks = sampling_;
+	unsigned int nx = ks.nx();
+	unsigned int ny = ks.ny();
+	unsigned int nc = ks.nc();
+	unsigned int readout = ks.readout();
 
 	std::vector<size_t> dims;
 	dims.push_back(readout);
@@ -364,27 +1787,17 @@ MRAcquisitionModel::bwd_(ISMRMRD::Image<T>* ptr_im, CoilData& csm,
 
 	ISMRMRD::NDArray<complex_float_t> ci(dims);
 	memset(ci.getDataPtr(), 0, ci.getDataSize());
-	int y = 0;
-	for (;;){
-		ac.get_acquisition(off + y, acq);
-		if (acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_FIRST_IN_SLICE))
-			break;
-		y++;
-	}
-	for (;;) {
-		ac.get_acquisition(off + y, acq);
+	ISMRMRD::Acquisition acq;
+	for (unsigned int a = first; a <= last; a++) {
+		ac.get_acquisition(a, acq);
 		int yy = acq.idx().kspace_encode_step_1;
 		for (unsigned int c = 0; c < nc; c++) {
 			for (unsigned int s = 0; s < readout; s++) {
 				ci(s, yy, c) = acq.data(s, c);
 			}
 		}
-		y++;
-		if (acq.isFlagSet(ISMRMRD::ISMRMRD_ACQ_LAST_IN_SLICE))
-			break;
 	}
-	off += y;
-	ifft2c(ci);
+	ifft2c(ci, fft_threads_);
 
 	T* ptr = im.getDataPtr();
 	T s;
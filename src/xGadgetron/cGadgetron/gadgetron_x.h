@@ -32,8 +32,18 @@ limitations under the License.
 
 #define WIN32_LEAN_AND_MEAN
 
+#include <atomic>
 #include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include <boost/thread/mutex.hpp>
 #include <boost/shared_ptr.hpp>
@@ -43,11 +53,13 @@ limitations under the License.
 #include <ismrmrd/meta.h>
 #include <ismrmrd/xml.h>
 
+#include "SIRF/common/solvers.h"
 #include "cgadgetron_shared_ptr.h"
 #include "gadgetron_client.h"
 #include "gadget_lib.h"
 #include "ismrmrd_fftw.h"
 #include "localised_exception.h"
+#include "xgadgetron_nufft.h"
 
 #define N_TRIALS 5
 
@@ -139,6 +151,7 @@ namespace sirf {
 
 	class GadgetChain { //: public anObject {
 	public:
+		GadgetChain() : prefetch_depth_(64), local_processing_(false) {}
 		//GadgetChain()
 		//{
 		//	class_ = "GadgetChain";
@@ -173,13 +186,125 @@ namespace sirf {
 				(new GadgetHandle(id, sptr_g)));
 		}
 		gadgetron::shared_ptr<aGadget> gadget_sptr(std::string id);
+		// gadgets other than readers, writers and the end gadget, in order
+		const std::list<gadgetron::shared_ptr<GadgetHandle> >& gadgets() const
+		{
+			return gadgets_;
+		}
 		// returns string containing the definition of the chain in xml format
 		std::string xml() const;
+		// socket and buffering options for the connection to the server
+		GadgetronConnectionOptions& connection_options()
+		{
+			return conn_options_;
+		}
+		const GadgetronConnectionOptions& connection_options() const
+		{
+			return conn_options_;
+		}
+		// Gadgetron servers to be used instead of the default one;
+		// ImagesReconstructor shares the work between several servers
+		void add_server(std::string host, std::string port)
+		{
+			servers_.push_back(GadgetronServer(host, port));
+		}
+		void clear_servers()
+		{
+			servers_.clear();
+		}
+		const std::vector<GadgetronServer>& servers() const
+		{
+			return servers_;
+		}
+		// number of acquisitions read ahead while sending to the server
+		// (0: read and send one at a time)
+		void set_prefetch_depth(unsigned int depth)
+		{
+			prefetch_depth_ = depth;
+		}
+		unsigned int prefetch_depth() const
+		{
+			return prefetch_depth_;
+		}
+		// if every gadget of a processor chain has an in-process version
+		// (see aLocalImageGadget and aLocalAcquisitionGadget), the chain
+		// can be run by SIRF itself, on several items at once, the data
+		// never leaving the process, if this is switched on (it is off by
+		// default); other chains are always run by Gadgetron server
+		void set_local_processing(bool local)
+		{
+			local_processing_ = local;
+		}
+		bool local_processing() const
+		{
+			return local_processing_;
+		}
 	private:
 		std::list<gadgetron::shared_ptr<GadgetHandle> > readers_;
 		std::list<gadgetron::shared_ptr<GadgetHandle> > writers_;
 		std::list<gadgetron::shared_ptr<GadgetHandle> > gadgets_;
 		gadgetron::shared_ptr<aGadget> endgadget_;
+		GadgetronConnectionOptions conn_options_;
+		unsigned int prefetch_depth_;
+		bool local_processing_;
+		std::vector<GadgetronServer> servers_;
+	};
+
+	/*!
+	\ingroup Gadgetron Extensions
+	\brief Opt-in on-disk cache of the outputs of the Gadget chains run by
+	Gadgetron server.
+
+	The output of a chain is written to a file in the cache directory named
+	after a 128-bit hash of the chain xml definition, the acquisitions header
+	and all input acquisitions or images, so that a repeated run of the same
+	chain on the same input reads it from there instead of running a
+	Gadgetron session; the full hash is stored in the file and checked
+	before the file is used. While the total size of the cache files exceeds the
+	limit, the least recently used ones are removed. Chains run by SIRF
+	itself are not cached.
+	*/
+	class GadgetronResultCache {
+	public:
+		static void set_enabled(bool on)
+		{
+			enabled_ = on;
+		}
+		static bool enabled()
+		{
+			return enabled_;
+		}
+		// directory for the cache files, empty for the current one
+		static void set_directory(const std::string& dir);
+		static std::string directory();
+		// the limit on the total size of the cache files in bytes
+		static void set_limit(size_t bytes);
+		static size_t limit()
+		{
+			return limit_;
+		}
+		// removes all cache files from the directory
+		static void clear();
+		// returns the cache key for the output of the chain defined by xml
+		// on the given input, empty if the cache is disabled
+		static std::string key
+			(const std::string& xml, MRAcquisitionData& acquisitions);
+		static std::string key(const std::string& xml, MRImageData& images);
+		// appends the cached output to the empty container, returns false
+		// if there is none
+		static bool restore(const std::string& key, MRAcquisitionData& acqs);
+		static bool restore(const std::string& key, MRImageData& images);
+		// caches the output
+		static void store(const std::string& key, MRAcquisitionData& acqs);
+		static void store(const std::string& key, MRImageData& images);
+	private:
+		static bool enabled_;
+		static std::string directory_;
+		static size_t limit_;
+		static std::mutex mutex_;
+
+		static std::string filename_(const std::string& key);
+		static void enforce_limit_();
 	};
 
 	/*!
@@ -211,11 +336,20 @@ namespace sirf {
 			return "AcquisitionsProcessor";
 		}
 
-		void process(MRAcquisitionData& acquisitions);
+		void process(MRAcquisitionData& acquisitions)
+		{
+			sptr_acqs_ = process(acquisitions, 0);
+		}
+		// returns the output without storing it (for concurrent calls);
+		// control, if not 0, allows cancellation from another thread
+		gadgetron::shared_ptr<MRAcquisitionData> process
+			(MRAcquisitionData& acquisitions, GadgetronSessionControl* control);
 		gadgetron::shared_ptr<MRAcquisitionData> get_output()
 		{
 			return sptr_acqs_;
 		}
+		// true if every gadget has an in-process version for the acquisitions
+		bool can_process_locally(MRAcquisitionData& acquisitions);
 
 	private:
 		std::string host_;
@@ -223,6 +357,9 @@ namespace sirf {
 		gadgetron::shared_ptr<IsmrmrdAcqMsgReader> reader_;
 		gadgetron::shared_ptr<IsmrmrdAcqMsgWriter> writer_;
 		gadgetron::shared_ptr<MRAcquisitionData> sptr_acqs_;
+
+		gadgetron::shared_ptr<MRAcquisitionData> process_locally_
+			(MRAcquisitionData& acquisitions, GadgetronSessionControl* control);
 	};
 
 	/*!
@@ -252,13 +389,28 @@ namespace sirf {
 			return "ImagesReconstructor";
 		}
 
-		void process(MRAcquisitionData& acquisitions);
+		void process(MRAcquisitionData& acquisitions)
+		{
+			sptr_images_ = process(acquisitions, 0);
+		}
+		// returns the output without storing it (for concurrent calls);
+		// control, if not 0, allows cancellation from another thread
+		gadgetron::shared_ptr<MRImageData> process
+			(MRAcquisitionData& acquisitions, GadgetronSessionControl* control);
+		// as above, using the server at host:port only
+		gadgetron::shared_ptr<MRImageData> process
+			(MRAcquisitionData& acquisitions, GadgetronSessionControl* control,
+			const std::string& host, const std::string& port);
 		gadgetron::shared_ptr<MRImageData> get_output()
 		{
 			return sptr_images_;
 		}
 
 	private:
+		friend class GadgetronStream;
+		gadgetron::shared_ptr<MRImageData> process_sharded_
+			(MRAcquisitionData& acquisitions, GadgetronSessionControl* control);
+
 		std::string host_;
 		std::string port_;
 		gadgetron::shared_ptr<IsmrmrdAcqMsgReader> reader_;
@@ -292,11 +444,20 @@ namespace sirf {
 		}
 
 		void check_connection();
-		void process(MRImageData& images);
+		void process(MRImageData& images)
+		{
+			sptr_images_ = process(images, 0);
+		}
+		// returns the output without storing it (for concurrent calls);
+		// control, if not 0, allows cancellation from another thread
+		gadgetron::shared_ptr<MRImageData> process
+			(MRImageData& images, GadgetronSessionControl* control);
 		gadgetron::shared_ptr<MRImageData> get_output()
 		{
 			return sptr_images_;
 		}
+		// true if every gadget has an in-process version for the images
+		bool can_process_locally(const MRImageData& images) const;
 
 	private:
 		std::string host_;
@@ -304,6 +465,230 @@ namespace sirf {
 		gadgetron::shared_ptr<IsmrmrdImgMsgReader> reader_;
 		gadgetron::shared_ptr<IsmrmrdImgMsgWriter> writer_;
 		gadgetron::shared_ptr<MRImageData> sptr_images_;
+
+		gadgetron::shared_ptr<MRImageData> process_locally_
+			(MRImageData& images, GadgetronSessionControl* control);
+	};
+
+	/*!
+	\ingroup Gadgetron Extensions
+	\brief Gadget chain processing run on a separate thread.
+
+	Created by one of the static start functions, which share ownership of
+	the gadget chain and its input with the job, so that several jobs can
+	run concurrently on one or more Gadgetron servers. The chain should not
+	be modified while its jobs are running.
+	*/
+
+	class GadgetronJob {
+	public:
+		static const char* class_name()
+		{
+			return "GadgetronJob";
+		}
+		static gadgetron::shared_ptr<GadgetronJob> start
+			(gadgetron::shared_ptr<ImagesReconstructor> sptr_recon,
+			gadgetron::shared_ptr<MRAcquisitionData> sptr_input);
+		static gadgetron::shared_ptr<GadgetronJob> start
+			(gadgetron::shared_ptr<AcquisitionsProcessor> sptr_proc,
+			gadgetron::shared_ptr<MRAcquisitionData> sptr_input);
+		static gadgetron::shared_ptr<GadgetronJob> start
+			(gadgetron::shared_ptr<ImagesProcessor> sptr_proc,
+			gadgetron::shared_ptr<MRImageData> sptr_input);
+		// cancels the job if still running
+		~GadgetronJob();
+		// true if the job has finished (successfully or not)
+		bool done() const
+		{
+			return done_;
+		}
+		// waits for the job to finish, rethrows its exception if any
+		void wait();
+		void cancel()
+		{
+			control_.cancel();
+		}
+		// the output: acquisitions or images, depending on the chain
+		gadgetron::shared_ptr<MRAcquisitionData> acquisitions() const
+		{
+			return sptr_acqs_;
+		}
+		gadgetron::shared_ptr<MRImageData> images() const
+		{
+			return sptr_images_;
+		}
+
+	private:
+		GadgetronJob() : done_(false) {}
+		template<class F>
+		void run_(F f);
+
+		std::thread thread_;
+		std::mutex mutex_;
+		std::atomic<bool> done_;
+		std::exception_ptr error_;
+		GadgetronSessionControl control_;
+		gadgetron::shared_ptr<MRAcquisitionData> sptr_acqs_;
+		gadgetron::shared_ptr<MRImageData> sptr_images_;
+	};
+
+	/*!
+	\ingroup Gadgetron Extensions
+	\brief Streaming reconstruction by an ImagesReconstructor.
+
+	Started by start(), which opens a session with the (first) server of the
+	reconstructor on a separate thread. Acquisitions are then fed one by one
+	or in batches as they become available (e.g. from a growing file or a
+	live source), and sent to the server as soon as the session can take 
+	them; feeding never waits. Each image is delivered as soon as it has 
+	been received: to the callback, if one is given (called on the thread
+	reading the connection), or else into a ring buffer of the given 
+	capacity, from which next_image() takes it, the reading of further 
+	images waiting while the buffer is full, so that memory stays bounded
+	however long the series. The session ends after finish() has been 
+	called and the server has sent the last image.
+	*/
+
+	class GadgetronStream {
+	public:
+		typedef std::function<void(gadgetron::shared_ptr<ImageWrap>)>
+			ImageCallback;
+		static const char* class_name()
+		{
+			return "GadgetronStream";
+		}
+		// header is the ISMRMRD header of the acquisitions to be fed
+		static gadgetron::shared_ptr<GadgetronStream> start
+			(gadgetron::shared_ptr<ImagesReconstructor> sptr_recon,
+			const std::string& header, unsigned int capacity,
+			ImageCallback callback = ImageCallback());
+		// cancels the session if still running
+		~GadgetronStream();
+		void feed(const ISMRMRD::Acquisition& acq);
+		// feeds acquisitions first, first + 1, ... of acquisitions,
+		// returns their number
+		unsigned int feed(MRAcquisitionData& acquisitions, unsigned int first);
+		// no more acquisitions will be fed
+		void finish();
+		// takes the next image from the buffer, waiting for it up to
+		// timeout_ms milliseconds (indefinitely if negative); returns 0 if
+		// there is none, rethrowing the session's exception if it has failed
+		gadgetron::shared_ptr<ImageWrap> next_image(int timeout_ms);
+		// true if the session has ended and the buffer is empty
+		bool done();
+		// images received so far
+		unsigned int num_images()
+		{
+			return num_images_;
+		}
+		void cancel();
+
+	private:
+		GadgetronStream(unsigned int capacity, ImageCallback callback) :
+			capacity_(capacity > 0 ? capacity : 1), callback_(callback),
+			finished_(false), ended_(false), cancelled_(false), num_images_(0)
+		{}
+		void run_(gadgetron::shared_ptr<ImagesReconstructor> sptr_recon,
+			const std::string& header);
+		void receive_(gadgetron::shared_ptr<ImageWrap> sptr_iw);
+
+		unsigned int capacity_;
+		ImageCallback callback_;
+		std::thread thread_;
+		std::mutex mutex_;
+		std::condition_variable cv_;
+		std::deque<ISMRMRD::Acquisition> input_;
+		std::deque<gadgetron::shared_ptr<ImageWrap> > images_;
+		bool finished_;
+		bool ended_;
+		bool cancelled_;
+		std::atomic<unsigned int> num_images_;
+		std::exception_ptr error_;
+		GadgetronSessionControl control_;
+	};
+
+	/*!
+	\ingroup Gadgetron Extensions
+	\brief Compact description of the k-space sampling of acquisition data.
+
+	Records, in one pass over an acquisition container, the encoding sizes,
+	the readouts range of each image item (slice) and the headers of all
+	readouts, so that the acquisition model does not need to parse the
+	ISMRMRD header or re-read the template acquisitions.
+	*/
+
+	class KSpaceSampling {
+	public:
+		KSpaceSampling() : ready_(false), nx_(0), ny_(0), nc_(0), readout_(0),
+			trajectory_(false), non_cartesian_(false) {}
+		void compute(MRAcquisitionData& ac);
+		void clear()
+		{
+			ready_ = false;
+			headers_.clear();
+			ranges_.clear();
+		}
+		bool ready() const
+		{
+			return ready_;
+		}
+		unsigned int nx() const
+		{
+			return nx_;
+		}
+		unsigned int ny() const
+		{
+			return ny_;
+		}
+		unsigned int nc() const
+		{
+			return nc_;
+		}
+		unsigned int readout() const
+		{
+			return readout_;
+		}
+		// number of readouts
+		unsigned int number() const
+		{
+			return (unsigned int)headers_.size();
+		}
+		// true if any readout carries trajectory data
+		bool trajectory() const
+		{
+			return trajectory_;
+		}
+		// true if the readouts carry trajectories and the encoding
+		// trajectory is not Cartesian (radial, spiral etc.)
+		bool non_cartesian() const
+		{
+			return non_cartesian_;
+		}
+		const ISMRMRD::AcquisitionHeader& header(unsigned int a) const
+		{
+			return headers_[a];
+		}
+		// phase encoding index of readout a
+		int line(unsigned int a) const
+		{
+			return headers_[a].idx.kspace_encode_step_1;
+		}
+		const std::vector<std::pair<unsigned int, unsigned int> >& ranges() const
+		{
+			return ranges_;
+		}
+		// Finds the first image item range starting at or after off.
+		bool range(unsigned int off, unsigned int& first, unsigned int& last) const;
+	private:
+		bool ready_;
+		unsigned int nx_;
+		unsigned int ny_;
+		unsigned int nc_;
+		unsigned int readout_;
+		bool trajectory_;
+		bool non_cartesian_;
+		std::vector<ISMRMRD::AcquisitionHeader> headers_;
+		std::vector<std::pair<unsigned int, unsigned int> > ranges_;
 	};
 
 	/*!
@@ -331,12 +716,18 @@ namespace sirf {
 	stored by property \e kspace_encode_step_1 of the method idx() of
 	the object of class ISMRMRD::Acquisition recorded by MRAcquisitionModel
 	constructor as a template.
+
+	For non-Cartesian (e.g. radial or spiral) templates the 2D Fourier
+	transform and the gathering are replaced by the gridding non-uniform FFT
+	(NUFFTGrid) sampling k-space along the trajectories of the template
+	readouts, whose interpolation matrices are computed once per image item.
 	*/
 
 	class MRAcquisitionModel {
 	public:
 
-		MRAcquisitionModel() {}
+		MRAcquisitionModel() : fft_threads_(1), nthreads_(1), resident_(false),
+			resident_cc_(0), density_compensation_(false) {}
 		/*
 		The constructor records, by copying shared pointers, the two supplied
 		arguments as templates, to be used for obtaining scanner and image
@@ -345,7 +736,9 @@ namespace sirf {
 		MRAcquisitionModel(
 			gadgetron::shared_ptr<MRAcquisitionData> sptr_ac,
 			gadgetron::shared_ptr<MRImageData> sptr_ic
-			) : sptr_acqs_(sptr_ac), sptr_imgs_(sptr_ic)
+			) : sptr_acqs_(sptr_ac), sptr_imgs_(sptr_ic), fft_threads_(1),
+			nthreads_(1), resident_(false), resident_cc_(0),
+			density_compensation_(false)
 		{
 		}
 
@@ -354,6 +747,9 @@ namespace sirf {
 			(gadgetron::shared_ptr<MRAcquisitionData> sptr_ac)
 		{
 			sptr_acqs_ = sptr_ac;
+			sampling_.clear();
+			grids_.clear();
+			resident_csms_.clear();
 		}
 		// Records the image template to be used. 
 		void set_image_template
@@ -365,15 +761,82 @@ namespace sirf {
 		void setCSMs(gadgetron::shared_ptr<CoilSensitivitiesContainer> sptr_csms)
 		{
 			sptr_csms_ = sptr_csms;
+			resident_csms_.clear();
+		}
+		// Sets the number of threads used by FFTW for the batched 2D FFT
+		// of all coil images (ignored if FFTW threads are not available)
+		// and by the gridding of non-Cartesian samples.
+		void set_fft_threads(int nthreads)
+		{
+			fft_threads_ = nthreads > 0 ? nthreads : 1;
+		}
+		int fft_threads() const
+		{
+			return fft_threads_;
+		}
+		// Sets the number of threads processing image items (slices,
+		// repetitions) concurrently in the whole-container fwd and bwd;
+		// the output order does not depend on the number of threads.
+		void set_num_threads(int nthreads)
+		{
+			nthreads_ = nthreads > 0 ? nthreads : 1;
+		}
+		int num_threads() const
+		{
+			return nthreads_;
+		}
+		// In resident mode, meant for the repeated fwd and bwd calls of an
+		// iterative solver, the coil sensitivity maps are copied into
+		// contiguous arrays on the first whole-container call and kept until
+		// the maps or the templates are replaced, and complex image items
+		// are projected by loops working on these arrays directly. The maps
+		// must not be modified in place while the mode is on.
+		void set_resident(bool resident)
+		{
+			resident_ = resident;
+			resident_csms_.clear();
+		}
+		bool resident() const
+		{
+			return resident_;
+		}
+		// If set, non-Cartesian readouts are weighted by density
+		// compensation factors before backprojection, which makes
+		// the backprojection a gridding reconstruction rather than
+		// the exact adjoint of fwd (default: not set).
+		void set_density_compensation(bool dcf)
+		{
+			density_compensation_ = dcf;
+		}
+		bool density_compensation() const
+		{
+			return density_compensation_;
 		}
 
-		// Records templates
+		// Records templates and computes the k-space sampling descriptor
 		void set_up
 			(gadgetron::shared_ptr<MRAcquisitionData> sptr_ac, 
 			gadgetron::shared_ptr<MRImageData> sptr_ic)
 		{
 			sptr_acqs_ = sptr_ac;
 			sptr_imgs_ = sptr_ic;
+			sampling_.clear();
+			sampling_.compute(*sptr_acqs_);
+			grids_.clear();
+			prepare_nufft_();
+			resident_csms_.clear();
+		}
+		// Returns the k-space sampling of the acquisition template,
+		// computing it first if set_up has not done so.
+		const KSpaceSampling& sampling()
+		{
+			if (!sampling_.ready()) {
+				if (!sptr_acqs_.get())
+					throw LocalisedException
+					("acquisition data template not set", __FILE__, __LINE__);
+				sampling_.compute(*sptr_acqs_);
+			}
+			return sampling_;
 		}
 
 		// Forward projects one image item (typically xy-slice) into
@@ -382,9 +845,23 @@ namespace sirf {
 		void fwd(ImageWrap& iw, CoilData& csm, MRAcquisitionData& ac,
 			unsigned int& off)
 		{
+			unsigned int first, last;
+			if (!sampling().range(off, first, last))
+				throw LocalisedException
+				("no readouts found for image", __FILE__, __LINE__);
+			fwd(iw, csm, ac, first, last);
+			off = last + 1;
+		}
+		// Forward projects one image item into the readouts first to last
+		// of the acquisition template, and appends them to ac.
+		void fwd(ImageWrap& iw, CoilData& csm, MRAcquisitionData& ac,
+			unsigned int first, unsigned int last)
+		{
+			sampling();
+			prepare_nufft_();
 			int type = iw.type();
 			void* ptr = iw.ptr_image();
-			IMAGE_PROCESSING_SWITCH(type, fwd_, ptr, csm, ac, off);
+			IMAGE_PROCESSING_SWITCH(type, fwd_, ptr, csm, ac, first, last);
 		}
 
 		// Backprojects a set of readouts corresponding to one image item
@@ -392,9 +869,22 @@ namespace sirf {
 		void bwd(ImageWrap& iw, CoilData& csm, MRAcquisitionData& ac,
 			unsigned int& off)
 		{
+			unsigned int first, last;
+			if (!slice_range_(ac, off, first, last))
+				throw LocalisedException
+				("no readouts found for image", __FILE__, __LINE__);
+			bwd(iw, csm, ac, first, last);
+			off = last + 1;
+		}
+		// Backprojects the readouts first to last of ac into one image item.
+		void bwd(ImageWrap& iw, CoilData& csm, MRAcquisitionData& ac,
+			unsigned int first, unsigned int last)
+		{
+			sampling();
+			prepare_nufft_();
 			int type = iw.type();
 			void* ptr = iw.ptr_image();
-			IMAGE_PROCESSING_SWITCH(type, bwd_, ptr, csm, ac, off);
+			IMAGE_PROCESSING_SWITCH(type, bwd_, ptr, csm, ac, first, last);
 		}
 
 		// Forward projects the whole ImageContainer using
@@ -445,13 +935,89 @@ namespace sirf {
 		gadgetron::shared_ptr<MRAcquisitionData> sptr_acqs_;
 		gadgetron::shared_ptr<MRImageData> sptr_imgs_;
 		gadgetron::shared_ptr<CoilSensitivitiesContainer> sptr_csms_;
+		KSpaceSampling sampling_;
+		int fft_threads_;
+		int nthreads_;
+		bool resident_;
+		// contiguous copies of the coil sensitivity maps of resident_cc_
+		// in resident mode
+		const CoilSensitivitiesContainer* resident_cc_;
+		std::map<const CoilData*, std::vector<complex_float_t> > resident_csms_;
+		bool density_compensation_;
+		// non-Cartesian sampling of the image items of the template
+		std::vector<NUFFTGrid> grids_;
+
+		// copies the maps of cc that are not yet resident
+		void make_resident_(CoilSensitivitiesContainer& cc);
+		// the resident copy of csm, or 0 if there is none
+		const complex_float_t* resident_csm_(const CoilData& csm) const;
+		// computes the gridding matrices (and the density compensation
+		// factors if needed) of a non-Cartesian template if not done yet
+		void prepare_nufft_();
+		// the gridding of the image item with readouts first to last
+		NUFFTGrid& grid_(unsigned int first);
+
+		// Finds the readouts of the image item starting at or after off:
+		// first is FIRST_IN_SLICE, last is the next LAST_IN_SLICE.
+		static bool slice_range_(MRAcquisitionData& ac, unsigned int off,
+			unsigned int& first, unsigned int& last);
+		// Splits all readouts of ac into image item ranges.
+		static void slice_ranges_(MRAcquisitionData& ac,
+			std::vector<std::pair<unsigned int, unsigned int> >& ranges);
 
 		template< typename T>
 		void fwd_(ISMRMRD::Image<T>* ptr_img, CoilData& csm,
-			MRAcquisitionData& ac, unsigned int& off);
+			MRAcquisitionData& ac, unsigned int first, unsigned int last);
 		template< typename T>
 		void bwd_(ISMRMRD::Image<T>* ptr_im, CoilData& csm,
-			MRAcquisitionData& ac, unsigned int& off);
+			MRAcquisitionData& ac, unsigned int first, unsigned int last);
+		// fwd_ and bwd_ with resident coil sensitivity maps
+		template< typename T>
+		void fwd_resident_(const T* img, const complex_float_t* csm,
+			MRAcquisitionData& ac, unsigned int first, unsigned int last);
+		template< typename T>
+		void bwd_resident_(T* img, const complex_float_t* csm,
+			MRAcquisitionData& ac, unsigned int first, unsigned int last);
+		// fwd_ and bwd_ for non-Cartesian readouts
+		template< typename T>
+		void fwd_nufft_(const T* img, CoilData& csm,
+			MRAcquisitionData& ac, unsigned int first, unsigned int last);
+		template< typename T>
+		void bwd_nufft_(T* img, CoilData& csm,
+			MRAcquisitionData& ac, unsigned int first, unsigned int last);
+	};
+
+	/*!
+	\ingroup Gadgetron Extensions
+	\brief MR acquisition model as a linear operator of the solvers.
+
+	The projections use the coil sensitivity maps of the model. As the
+	acquisition data can only be written in place by xapy, the results of
+	fwd and bwd are copied into the solver workspaces.
+	*/
+
+	class MRAcquisitionModelOperator : public aLinearOperator<complex_float_t> {
+	public:
+		MRAcquisitionModelOperator
+			(gadgetron::shared_ptr<MRAcquisitionModel> sptr_am) :
+			sptr_am_(sptr_am)
+		{}
+		void apply(aDataContainer<complex_float_t>& x,
+			aDataContainer<complex_float_t>& y)
+		{
+			gadgetron::shared_ptr<MRAcquisitionData> sptr_ac =
+				sptr_am_->fwd((MRImageData&)x);
+			y.scale_xapy(complex_float_t(0), complex_float_t(1), *sptr_ac);
+		}
+		void apply_adjoint(aDataContainer<complex_float_t>& y,
+			aDataContainer<complex_float_t>& x)
+		{
+			gadgetron::shared_ptr<MRImageData> sptr_ic =
+				sptr_am_->bwd((MRAcquisitionData&)y);
+			x.scale_xapy(complex_float_t(0), complex_float_t(1), *sptr_ic);
+		}
+	private:
+		gadgetron::shared_ptr<MRAcquisitionModel> sptr_am_;
 	};
 
 }
@@ -35,6 +35,12 @@ IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
 IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
 #include <ismrmrd/ismrmrd.h>
 #include <ismrmrd/dataset.h>
 #include <ismrmrd/meta.h>
@@ -42,75 +48,345 @@ IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <fftw3.h>
 
+#include "SIRF/common/profiler.h"
+#include "SIRF/common/thread_pool.h"
 #include "ismrmrd_fftw.h"
 
 namespace ISMRMRD {
 
 #define fftshift(out, in, x, y) circshift(out, in, x, y, (x/2), (y/2))
 
-	int fft2c(NDArray<complex_float_t> &a, bool forward)
+	// (nx, ny, number of 2D transforms, direction, alignment, threads)
+	typedef std::tuple<int, int, int, int, int, int> FFTPlanKey;
+
+	struct FFTCachedPlan {
+		fftwf_plan plan;
+		// the number of calls executing the plan, which must not be destroyed
+		// while it is not 0
+		int users;
+		// the value of fft_plan_clock_ when the plan was last requested
+		unsigned long last_used;
+	};
+
+	/*
+	Plan cache and scratch buffer pool shared by all fft2c/ifft2c calls.
+	FFTW planner calls are not thread-safe, hence everything that touches
+	the planner or the pool is done under fft_mutex_; executing a cached
+	plan via fftwf_execute_dft is thread-safe and done without the lock.
+	*/
+	static std::mutex fft_mutex_;
+	static std::map<FFTPlanKey, FFTCachedPlan> fft_plans_;
+	static unsigned long fft_plan_clock_ = 0;
+	static std::multimap<size_t, fftwf_complex*> fft_scratch_;
+	static size_t fft_scratch_bytes_ = 0;
+	// the pool keeps at most this many buffers of each size, and drops
+	// buffers of other sizes while its total size exceeds the limit
+	static const size_t FFT_SCRATCH_PER_SIZE = 4;
+	static const size_t FFT_SCRATCH_LIMIT = (size_t)256 << 20;
+	// the cache keeps at most this many plans, destroying the least
+	// recently used plans not being executed when it grows over the limit
+	static const size_t FFT_PLAN_LIMIT = 64;
+	static unsigned int fft_flags_ = FFTW_ESTIMATE;
+	static std::string fft_wisdom_;
+#ifdef SIRF_FFTW_THREADS
+	static bool fft_threads_initialised_ = false;
+#endif
+
+#ifdef SIRF_FFTW_THREADS_CALLBACK
+	// FFTW runs its parallel loops on the SIRF thread pool
+	static void
+	fft_parallel_loop(void* (*work)(char*), char* jobdata, size_t elsize,
+		int njobs, void*)
 	{
-		if (a.getNDim() < 2) {
-			std::cout << "fft2c Error: input array must have at least two dimensions"
-				<< std::endl;
+		sirf::parallel_for(njobs, njobs, [=](int i) {
+			work(jobdata + elsize*i);
+		});
+	}
+#endif
+
+	// frees the pooled buffers, the caller holds fft_mutex_
+	static void
+	fft_free_scratch_()
+	{
+		for (auto it = fft_scratch_.begin(); it != fft_scratch_.end(); ++it)
+			fftwf_free(it->second);
+		fft_scratch_.clear();
+		fft_scratch_bytes_ = 0;
+	}
+
+	/*
+	Returns a pooled buffer of the given size or a new one; if the
+	allocation fails, the pooled buffers are freed and it is tried again.
+	Returns 0 if there is not enough memory.
+	*/
+	static fftwf_complex*
+	fft_acquire_scratch(size_t size)
+	{
+		size_t bytes = sizeof(fftwf_complex)*size;
+		{
+			std::lock_guard<std::mutex> lock(fft_mutex_);
+			auto it = fft_scratch_.find(size);
+			if (it != fft_scratch_.end()) {
+				fftwf_complex* ptr = it->second;
+				fft_scratch_.erase(it);
+				fft_scratch_bytes_ -= bytes;
+				return ptr;
+			}
+		}
+		fftwf_complex* ptr = (fftwf_complex*)fftwf_malloc(bytes);
+		if (ptr)
+			return ptr;
+		{
+			std::lock_guard<std::mutex> lock(fft_mutex_);
+			fft_free_scratch_();
+		}
+		return (fftwf_complex*)fftwf_malloc(bytes);
+	}
+
+	static void
+	fft_release_scratch(fftwf_complex* ptr, size_t size)
+	{
+		size_t bytes = sizeof(fftwf_complex)*size;
+		std::lock_guard<std::mutex> lock(fft_mutex_);
+		size_t n = fft_scratch_.count(size);
+		if (n >= FFT_SCRATCH_PER_SIZE || (n + 1)*bytes > FFT_SCRATCH_LIMIT) {
+			fftwf_free(ptr);
+			return;
+		}
+		fft_scratch_.insert(std::make_pair(size, ptr));
+		fft_scratch_bytes_ += bytes;
+		for (auto it = fft_scratch_.begin();
+			fft_scratch_bytes_ > FFT_SCRATCH_LIMIT && it != fft_scratch_.end();) {
+			if (it->first == size) {
+				++it;
+				continue;
+			}
+			fft_scratch_bytes_ -= sizeof(fftwf_complex)*it->first;
+			fftwf_free(it->second);
+			it = fft_scratch_.erase(it);
+		}
+	}
+
+	// destroys the least recently used plans while there are more than
+	// FFT_PLAN_LIMIT and some are not in use, the caller holds fft_mutex_
+	static void
+	fft_evict_plans_()
+	{
+		while (fft_plans_.size() > FFT_PLAN_LIMIT) {
+			auto oldest = fft_plans_.end();
+			for (auto it = fft_plans_.begin(); it != fft_plans_.end(); ++it)
+				if (it->second.users == 0 && (oldest == fft_plans_.end() ||
+					it->second.last_used < oldest->second.last_used))
+					oldest = it;
+			if (oldest == fft_plans_.end())
+				return;
+			fftwf_destroy_plan(oldest->second.plan);
+			fft_plans_.erase(oldest);
+		}
+	}
+
+	/*
+	Returns a plan for nf contiguous in-place 2D transforms of size nx by ny
+	(x running fastest), creating and caching it if necessary. The plan is
+	kept in the cache until the caller is done with it and calls
+	fft_release_plan().
+	*/
+	static fftwf_plan
+	fft_plan(int nx, int ny, int nf, int sign, int nthreads, fftwf_complex* buff)
+	{
+#ifndef SIRF_FFTW_THREADS
+		nthreads = 1;
+#endif
+		if (nthreads > sirf::ThreadPool::num_threads())
+			nthreads = sirf::ThreadPool::num_threads();
+		if (nthreads < 1)
+			nthreads = 1;
+		FFTPlanKey key
+			(nx, ny, nf, sign, fftwf_alignment_of((float*)buff), nthreads);
+		std::lock_guard<std::mutex> lock(fft_mutex_);
+		auto it = fft_plans_.find(key);
+		if (it != fft_plans_.end()) {
+			it->second.users++;
+			it->second.last_used = ++fft_plan_clock_;
+			return it->second.plan;
+		}
+		int ne = nx*ny;
+		// measuring planners overwrite the array, so plan on a buffer of our own
+		// (fftwf_malloc guarantees the same alignment as the caller's buffer)
+		fftwf_complex* tmp = buff;
+		if (fft_flags_ != FFTW_ESTIMATE)
+			tmp = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex)*ne*nf);
+		if (!tmp)
+			return 0;
+#ifdef SIRF_FFTW_THREADS
+		if (!fft_threads_initialised_) {
+			fft_threads_initialised_ = fftwf_init_threads() != 0;
+#ifdef SIRF_FFTW_THREADS_CALLBACK
+			if (fft_threads_initialised_)
+				fftwf_threads_set_callback(fft_parallel_loop, 0);
+#endif
+		}
+		if (fft_threads_initialised_)
+			fftwf_plan_with_nthreads(nthreads);
+#endif
+		int n[2] = { ny, nx };
+		fftwf_plan p = fftwf_plan_many_dft
+			(2, n, nf, tmp, 0, 1, ne, tmp, 0, 1, ne, sign, fft_flags_);
+		if (tmp != buff)
+			fftwf_free(tmp);
+		if (!p)
+			return 0;
+		FFTCachedPlan& cached = fft_plans_[key];
+		cached.plan = p;
+		cached.users = 1;
+		cached.last_used = ++fft_plan_clock_;
+		fft_evict_plans_();
+		if (fft_flags_ != FFTW_ESTIMATE && fft_wisdom_.size() > 0)
+			fftwf_export_wisdom_to_filename(fft_wisdom_.c_str());
+		return p;
+	}
+
+	static void
+	fft_release_plan(fftwf_plan p)
+	{
+		std::lock_guard<std::mutex> lock(fft_mutex_);
+		for (auto it = fft_plans_.begin(); it != fft_plans_.end(); ++it)
+			if (it->second.plan == p) {
+				it->second.users--;
+				break;
+			}
+		fft_evict_plans_();
+	}
+
+	static void
+	fft_clear_cache_()
+	{
+		for (auto it = fft_plans_.begin(); it != fft_plans_.end(); ++it)
+			fftwf_destroy_plan(it->second.plan);
+		fft_plans_.clear();
+		fft_free_scratch_();
+	}
+
+	void fft_clear_cache()
+	{
+		std::lock_guard<std::mutex> lock(fft_mutex_);
+		fft_clear_cache_();
+	}
+
+	int fft_set_planning(const char* mode, const char* wisdom)
+	{
+		unsigned int flags;
+		std::string m(mode);
+		if (m == "estimate" || m == "default")
+			flags = FFTW_ESTIMATE;
+		else if (m == "measure")
+			flags = FFTW_MEASURE;
+		else if (m == "patient")
+			flags = FFTW_PATIENT;
+		else {
+			std::cout << "fft_set_planning Error: unknown planning mode "
+				<< mode << std::endl;
 			return -1;
 		}
+		std::lock_guard<std::mutex> lock(fft_mutex_);
+		if (flags != fft_flags_) {
+			// plans made with the old flags must not be reused
+			fft_clear_cache_();
+			fft_flags_ = flags;
+		}
+		fft_wisdom_ = wisdom ? wisdom : "";
+		if (fft_wisdom_.size() > 0)
+			// a missing wisdom file is not an error: it will be created
+			fftwf_import_wisdom_from_filename(fft_wisdom_.c_str());
+		return 0;
+	}
 
-		size_t elements = a.getDims()[0] * a.getDims()[1];
-		size_t ffts = a.getNumberOfElements() / elements;
+	/*
+	All 2D slices of the array are transformed by a single batched plan;
+	the (i)fftshift into the scratch buffer and the shift back, fused with
+	the normalisation, are the only other passes over the data.
+	*/
+	static int fft2c_(complex_float_t* a, int nx, int ny, int nf, bool forward,
+		int nthreads)
+	{
+		SIRF_PROFILE("ISMRMRD::fft2c");
+		size_t elements = (size_t)nx * ny;
+		size_t ffts = nf;
+		size_t size = elements * ffts;
 
 		//Array for transformation
-		fftwf_complex* tmp =
-			(fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex)*a.getNumberOfElements());
+		fftwf_complex* tmp = fft_acquire_scratch(size);
 
 		if (!tmp) {
 			std::cout << "Error allocating temporary storage for FFTW" << std::endl;
 			return -1;
 		}
 
-		for (size_t f = 0; f < ffts; f++) {
+		fftwf_plan p = fft_plan(nx, ny, (int)ffts,
+			forward ? FFTW_FORWARD : FFTW_BACKWARD, nthreads, tmp);
+		if (!p) {
+			std::cout << "Error creating FFTW plan" << std::endl;
+			fft_release_scratch(tmp, size);
+			return -1;
+		}
 
-			fftshift(reinterpret_cast<std::complex<float>*>(tmp),
-				&a(0, 0, f), a.getDims()[0], a.getDims()[1]);
+		std::complex<float>* ptr = reinterpret_cast<std::complex<float>*>(tmp);
+		for (size_t f = 0; f < ffts; f++)
+			fftshift(ptr + f*elements, a + f*elements, nx, ny);
 
-			//Create the FFTW plan
-			fftwf_plan p;
-			if (forward) {
-				p = fftwf_plan_dft_2d
-					(a.getDims()[1], a.getDims()[0], tmp, tmp,
-					FFTW_FORWARD, FFTW_ESTIMATE);
-			}
-			else {
-				p = fftwf_plan_dft_2d
-					(a.getDims()[1], a.getDims()[0], tmp, tmp,
-					FFTW_BACKWARD, FFTW_ESTIMATE);
+		fftwf_execute_dft(p, tmp, tmp);
+		fft_release_plan(p);
+
+		float scale = 1.0f / std::sqrt(1.0f*elements);
+		int xs = nx / 2;
+		int ys = ny / 2;
+		for (size_t f = 0; f < ffts; f++) {
+			const std::complex<float>* in = ptr + f*elements;
+			std::complex<float>* out = a + f*elements;
+			for (int i = 0; i < ny; i++) {
+				int ii = (i + ys) % ny;
+				for (int j = 0; j < nx; j++) {
+					int jj = (j + xs) % nx;
+					out[ii * nx + jj] = in[i * nx + j] * scale;
+				}
 			}
-			fftwf_execute(p);
+		}
 
-			fftshift(&a(0, 0, f), reinterpret_cast<std::complex<float>*>(tmp),
-				a.getDims()[0], a.getDims()[1]);
+		fft_release_scratch(tmp, size);
+		return 0;
+	}
 
-			//Clean up.
-			fftwf_destroy_plan(p);
+	static int fft2c_(NDArray<complex_float_t> &a, bool forward, int nthreads)
+	{
+		if (a.getNDim() < 2) {
+			std::cout << "fft2c Error: input array must have at least two dimensions"
+				<< std::endl;
+			return -1;
 		}
+		int nx = a.getDims()[0];
+		int ny = a.getDims()[1];
+		int nf = (int)(a.getNumberOfElements() / (a.getDims()[0] * a.getDims()[1]));
+		return fft2c_(a.getDataPtr(), nx, ny, nf, forward, nthreads);
+	}
 
-		std::complex<float> scale(std::sqrt(1.0f*elements), 0.0);
-		for (size_t n = 0; n < a.getNumberOfElements(); n++) {
-			a.getDataPtr()[n] /= scale;
-		}
-		fftwf_free(tmp);
-		return 0;
+	int fft2c(NDArray<complex_float_t> &a, int nthreads)
+	{
+		return fft2c_(a, true, nthreads);
 	}
 
-	int fft2c(NDArray<complex_float_t> &a) 
+	int ifft2c(NDArray<complex_float_t> &a, int nthreads)
 	{
-		return fft2c(a, true);
+		return fft2c_(a, false, nthreads);
 	}
 
-	int ifft2c(NDArray<complex_float_t> &a) 
+	int fft2c(complex_float_t* a, int nx, int ny, int nf, int nthreads)
 	{
-		return fft2c(a, false);
+		return fft2c_(a, nx, ny, nf, true, nthreads);
 	}
 
-};
+	int ifft2c(complex_float_t* a, int nx, int ny, int nf, int nthreads)
+	{
+		return fft2c_(a, nx, ny, nf, false, nthreads);
+	}
 
+};
@@ -50,8 +50,28 @@ namespace ISMRMRD {
 			}
 		}
 	}
-	int fft2c(NDArray<complex_float_t> &a);
-	int ifft2c(NDArray<complex_float_t> &a);
+	/*
+	Centred 2D (inverse) FFT of every xy-slice of the array, all slices
+	(e.g. coils) transformed by one batched FFTW plan. nthreads > 1 is
+	honoured if SIRF is built with FFTW threads support.
+	*/
+	int fft2c(NDArray<complex_float_t> &a, int nthreads = 1);
+	int ifft2c(NDArray<complex_float_t> &a, int nthreads = 1);
+	// the same for nf contiguous nx by ny slices (x running fastest)
+	int fft2c(complex_float_t* a, int nx, int ny, int nf, int nthreads = 1);
+	int ifft2c(complex_float_t* a, int nx, int ny, int nf, int nthreads = 1);
+
+	/*
+	FFTW plans are created once per (dimensions, direction, alignment,
+	threads) and cached, at most 64 of them, the least recently used ones
+	destroyed first; scratch buffers are pooled and reused across calls.
+	mode: "estimate" (default), "measure" or "patient";
+	wisdom: optional file to import FFTW wisdom from and export new wisdom to.
+	Returns -1 if the mode is not recognised.
+	*/
+	int fft_set_planning(const char* mode, const char* wisdom = 0);
+	// destroys all cached plans and frees pooled scratch buffers
+	void fft_clear_cache();
 
 };
 
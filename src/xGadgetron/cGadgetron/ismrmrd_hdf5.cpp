@@ -0,0 +1,517 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup Gadgetron Data Containers
+\brief Implementation file for the batched ISMRMRD HDF5 writer and the
+acquisition headers reader.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#include <algorithm>
+
+#include <ismrmrd/dataset.h>
+
+#include "SIRF/common/profiler.h"
+#include "ismrmrd_hdf5.h"
+#include "localised_exception.h"
+#include "xgadgetron_utilities.h"
+
+// registered HDF5 filter id of LZ4, available as a plugin
+#define H5Z_FILTER_LZ4 32004
+// acquisition records per chunk
+#define ACQUISITIONS_CHUNK 256
+
+using namespace sirf;
+
+int ISMRMRDWriter::default_compression_ = 0;
+
+/*
+HDF5 types of ISMRMRD items, member for member those of ISMRMRD dataset.c,
+so that the files written can be read by ISMRMRD::Dataset.
+*/
+
+#define H5_MEMBER(Type, S, M, T) \
+	H5Tinsert(Type, #M, HOFFSET(S, M), T)
+#define H5_ARRAY_MEMBER(Type, S, M, T) \
+	insert_array_(Type, #M, HOFFSET(S, M), T, \
+		sizeof(((S*)0)->M) / sizeof(((S*)0)->M[0]))
+
+// ISMRMRD's in-file acquisition record
+struct HDF5Acquisition {
+	ISMRMRD::ISMRMRD_AcquisitionHeader head;
+	hvl_t traj;
+	hvl_t data;
+};
+
+static void
+insert_array_(hid_t type, const char* name, size_t offset, hid_t t, hsize_t n)
+{
+	hid_t array_type = H5Tarray_create2(t, 1, &n);
+	H5Tinsert(type, name, offset, array_type);
+	H5Tclose(array_type);
+}
+
+static hid_t
+encoding_counters_type_()
+{
+	typedef ISMRMRD::ISMRMRD_EncodingCounters S;
+	hid_t type = H5Tcreate(H5T_COMPOUND, sizeof(S));
+	H5_MEMBER(type, S, kspace_encode_step_1, H5T_NATIVE_UINT16);
+	H5_MEMBER(type, S, kspace_encode_step_2, H5T_NATIVE_UINT16);
+	H5_MEMBER(type, S, average, H5T_NATIVE_UINT16);
+	H5_MEMBER(type, S, slice, H5T_NATIVE_UINT16);
+	H5_MEMBER(type, S, contrast, H5T_NATIVE_UINT16);
+	H5_MEMBER(type, S, phase, H5T_NATIVE_UINT16);
+	H5_MEMBER(type, S, repetition, H5T_NATIVE_UINT16);
+	H5_MEMBER(type, S, set, H5T_NATIVE_UINT16);
+	H5_MEMBER(type, S, segment, H5T_NATIVE_UINT16);
+	H5_ARRAY_MEMBER(type, S, user, H5T_NATIVE_UINT16);
+	return type;
+}
+
+static hid_t
+acquisition_header_type_()
+{
+	typedef ISMRMRD::ISMRMRD_AcquisitionHeader S;
+	hid_t type = H5Tcreate(H5T_COMPOUND, sizeof(S));
+	H5_MEMBER(type, S, version, H5T_NATIVE_UINT16);
+	H5_MEMBER(type, S, flags, H5T_NATIVE_UINT64);
+	H5_MEMBER(type, S, measurement_uid, H5T_NATIVE_UINT32);
+	H5_MEMBER(type, S, scan_counter, H5T_NATIVE_UINT32);
+	H5_MEMBER(type, S, acquisition_time_stamp, H5T_NATIVE_UINT32);
+	H5_ARRAY_MEMBER(type, S, physiology_time_stamp, H5T_NATIVE_UINT32);
+	H5_MEMBER(type, S, number_of_samples, H5T_NATIVE_UINT16);
+	H5_MEMBER(type, S, available_channels, H5T_NATIVE_UINT16);
+	H5_MEMBER(type, S, active_channels, H5T_NATIVE_UINT16);
+	H5_ARRAY_MEMBER(type, S, channel_mask, H5T_NATIVE_UINT64);
+	H5_MEMBER(type, S, discard_pre, H5T_NATIVE_UINT16);
+	H5_MEMBER(type, S, discard_post, H5T_NATIVE_UINT16);
+	H5_MEMBER(type, S, center_sample, H5T_NATIVE_UINT16);
+	H5_MEMBER(type, S, encoding_space_ref, H5T_NATIVE_UINT16);
+	H5_MEMBER(type, S, trajectory_dimensions, H5T_NATIVE_UINT16);
+	H5_MEMBER(type, S, sample_time_us, H5T_NATIVE_FLOAT);
+	H5_ARRAY_MEMBER(type, S, position, H5T_NATIVE_FLOAT);
+	H5_ARRAY_MEMBER(type, S, read_dir, H5T_NATIVE_FLOAT);
+	H5_ARRAY_MEMBER(type, S, phase_dir, H5T_NATIVE_FLOAT);
+	H5_ARRAY_MEMBER(type, S, slice_dir, H5T_NATIVE_FLOAT);
+	H5_ARRAY_MEMBER(type, S, patient_table_position, H5T_NATIVE_FLOAT);
+	hid_t idx_type = encoding_counters_type_();
+	H5_MEMBER(type, S, idx, idx_type);
+	H5Tclose(idx_type);
+	H5_ARRAY_MEMBER(type, S, user_int, H5T_NATIVE_INT32);
+	H5_ARRAY_MEMBER(type, S, user_float, H5T_NATIVE_FLOAT);
+	return type;
+}
+
+static hid_t
+acquisition_type_()
+{
+	hid_t type = H5Tcreate(H5T_COMPOUND, sizeof(HDF5Acquisition));
+	hid_t head_type = acquisition_header_type_();
+	H5_MEMBER(type, HDF5Acquisition, head, head_type);
+	H5Tclose(head_type);
+	// trajectory and samples are both stored as arrays of floats
+	hid_t vlen_type = H5Tvlen_create(H5T_NATIVE_FLOAT);
+	H5_MEMBER(type, HDF5Acquisition, traj, vlen_type);
+	H5_MEMBER(type, HDF5Acquisition, data, vlen_type);
+	H5Tclose(vlen_type);
+	return type;
+}
+
+static hid_t
+image_header_type_()
+{
+	typedef ISMRMRD::ISMRMRD_ImageHeader S;
+	hid_t type = H5Tcreate(H5T_COMPOUND, sizeof(S));
+	H5_MEMBER(type, S, version, H5T_NATIVE_UINT16);
+	H5_MEMBER(type, S, data_type, H5T_NATIVE_UINT16);
+	H5_MEMBER(type, S, flags, H5T_NATIVE_UINT64);
+	H5_MEMBER(type, S, measurement_uid, H5T_NATIVE_UINT32);
+	H5_ARRAY_MEMBER(type, S, matrix_size, H5T_NATIVE_UINT16);
+	H5_ARRAY_MEMBER(type, S, field_of_view, H5T_NATIVE_FLOAT);
+	H5_MEMBER(type, S, channels, H5T_NATIVE_UINT16);
+	H5_ARRAY_MEMBER(type, S, position, H5T_NATIVE_FLOAT);
+	H5_ARRAY_MEMBER(type, S, read_dir, H5T_NATIVE_FLOAT);
+	H5_ARRAY_MEMBER(type, S, phase_dir, H5T_NATIVE_FLOAT);
+	H5_ARRAY_MEMBER(type, S, slice_dir, H5T_NATIVE_FLOAT);
+	H5_ARRAY_MEMBER(type, S, patient_table_position, H5T_NATIVE_FLOAT);
+	H5_MEMBER(type, S, average, H5T_NATIVE_UINT16);
+	H5_MEMBER(type, S, slice, H5T_NATIVE_UINT16);
+	H5_MEMBER(type, S, contrast, H5T_NATIVE_UINT16);
+	H5_MEMBER(type, S, phase, H5T_NATIVE_UINT16);
+	H5_MEMBER(type, S, repetition, H5T_NATIVE_UINT16);
+	H5_MEMBER(type, S, set, H5T_NATIVE_UINT16);
+	H5_MEMBER(type, S, acquisition_time_stamp, H5T_NATIVE_UINT32);
+	H5_ARRAY_MEMBER(type, S, physiology_time_stamp, H5T_NATIVE_UINT32);
+	H5_MEMBER(type, S, image_type, H5T_NATIVE_UINT16);
+	H5_MEMBER(type, S, image_index, H5T_NATIVE_UINT16);
+	H5_MEMBER(type, S, image_series_index, H5T_NATIVE_UINT16);
+	H5_ARRAY_MEMBER(type, S, user_int, H5T_NATIVE_INT32);
+	H5_ARRAY_MEMBER(type, S, user_float, H5T_NATIVE_FLOAT);
+	H5_MEMBER(type, S, attribute_string_len, H5T_NATIVE_UINT32);
+	return type;
+}
+
+static hid_t
+complex_type_(hid_t t, size_t size)
+{
+	hid_t type = H5Tcreate(H5T_COMPOUND, 2 * size);
+	H5Tinsert(type, "real", 0, t);
+	H5Tinsert(type, "imag", size, t);
+	return type;
+}
+
+static hid_t
+image_data_type_(int data_type)
+{
+	switch (data_type) {
+	case ISMRMRD::ISMRMRD_USHORT:
+		return H5Tcopy(H5T_NATIVE_UINT16);
+	case ISMRMRD::ISMRMRD_SHORT:
+		return H5Tcopy(H5T_NATIVE_INT16);
+	case ISMRMRD::ISMRMRD_UINT:
+		return H5Tcopy(H5T_NATIVE_UINT32);
+	case ISMRMRD::ISMRMRD_INT:
+		return H5Tcopy(H5T_NATIVE_INT32);
+	case ISMRMRD::ISMRMRD_FLOAT:
+		return H5Tcopy(H5T_NATIVE_FLOAT);
+	case ISMRMRD::ISMRMRD_DOUBLE:
+		return H5Tcopy(H5T_NATIVE_DOUBLE);
+	case ISMRMRD::ISMRMRD_CXFLOAT:
+		return complex_type_(H5T_NATIVE_FLOAT, sizeof(float));
+	case ISMRMRD::ISMRMRD_CXDOUBLE:
+		return complex_type_(H5T_NATIVE_DOUBLE, sizeof(double));
+	default:
+		throw LocalisedException
+			("unknown image data type", __FILE__, __LINE__);
+	}
+}
+
+static hid_t
+string_type_()
+{
+	hid_t type = H5Tcopy(H5T_C_S1);
+	H5Tset_size(type, H5T_VARIABLE);
+	return type;
+}
+
+// H5Lexists fails on paths with missing intermediate groups
+static bool
+exists_(hid_t file, const std::string& path)
+{
+	size_t pos = 0;
+	for (;;) {
+		pos = path.find('/', pos + 1);
+		std::string link = path.substr(0, pos);
+		if (link.size() > 0 && link != "/" &&
+			H5Lexists(file, link.c_str(), H5P_DEFAULT) <= 0)
+			return false;
+		if (pos == std::string::npos)
+			return true;
+	}
+}
+
+void
+ISMRMRDWriter::set_default_compression(int level)
+{
+	default_compression_ = std::max(0, std::min(9, level));
+}
+
+void
+ISMRMRDWriter::set_compression(int level)
+{
+	compression_ = std::max(0, std::min(9, level));
+}
+
+ISMRMRDWriter::ISMRMRDWriter
+(const std::string& filename, const std::string& groupname,
+	const std::string& header) :
+	compression_(default_compression_), group_(groupname)
+{
+	Mutex mtx;
+	mtx.lock();
+	{
+		// ISMRMRD creates the file and the group
+		ISMRMRD::Dataset dataset(filename.c_str(), groupname.c_str(), true);
+		if (header.size() > 0)
+			dataset.writeHeader(header);
+	}
+	file_ = H5Fopen(filename.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
+	mtx.unlock();
+	if (file_ < 0)
+		throw LocalisedException
+			("cannot open ISMRMRD file for writing", __FILE__, __LINE__);
+}
+
+ISMRMRDWriter::~ISMRMRDWriter()
+{
+	Mutex mtx;
+	mtx.lock();
+	H5Fclose(file_);
+	mtx.unlock();
+}
+
+hid_t
+ISMRMRDWriter::open_or_create_(const std::string& path, hid_t type,
+	int rank, const hsize_t* dims, const hsize_t* chunk)
+{
+	if (exists_(file_, path))
+		return H5Dopen2(file_, path.c_str(), H5P_DEFAULT);
+
+	// an extendible array of items of dimensions dims
+	std::vector<hsize_t> size(rank + 1, 0);
+	std::vector<hsize_t> max_size(rank + 1, H5S_UNLIMITED);
+	for (int i = 0; i < rank; i++)
+		size[i + 1] = max_size[i + 1] = dims[i];
+	hid_t space = H5Screate_simple(rank + 1, &size[0], &max_size[0]);
+
+	hid_t props = H5Pcreate(H5P_DATASET_CREATE);
+	H5Pset_chunk(props, rank + 1, chunk);
+	if (compression_ > 0) {
+		if (H5Zfilter_avail(H5Z_FILTER_LZ4) > 0)
+			H5Pset_filter(props, H5Z_FILTER_LZ4, H5Z_FLAG_OPTIONAL, 0, 0);
+		else {
+			H5Pset_shuffle(props);
+			H5Pset_deflate(props, compression_);
+		}
+	}
+	hid_t link_props = H5Pcreate(H5P_LINK_CREATE);
+	H5Pset_create_intermediate_group(link_props, 1);
+
+	hid_t dataset = H5Dcreate2(file_, path.c_str(), type, space,
+		link_props, props, H5P_DEFAULT);
+	H5Pclose(link_props);
+	H5Pclose(props);
+	H5Sclose(space);
+	return dataset;
+}
+
+void
+ISMRMRDWriter::append_(hid_t dataset, hid_t type,
+	int rank, const hsize_t* dims, hsize_t n, const void* data)
+{
+	SIRF_PROFILE("ISMRMRDWriter::append");
+	std::vector<hsize_t> size(rank + 1);
+	std::vector<hsize_t> start(rank + 1, 0);
+	std::vector<hsize_t> count(rank + 1);
+	hid_t space = H5Dget_space(dataset);
+	int file_rank = H5Sget_simple_extent_ndims(space);
+	if (file_rank == rank + 1)
+		H5Sget_simple_extent_dims(space, &size[0], 0);
+	H5Sclose(space);
+	if (file_rank != rank + 1)
+		throw LocalisedException
+			("ISMRMRD dataset dimensions mismatch", __FILE__, __LINE__);
+	start[0] = size[0];
+	size[0] += n;
+	count[0] = n;
+	for (int i = 0; i < rank; i++)
+		count[i + 1] = dims[i];
+
+	herr_t status = H5Dset_extent(dataset, &size[0]);
+	space = H5Dget_space(dataset);
+	H5Sselect_hyperslab(space, H5S_SELECT_SET, &start[0], 0, &count[0], 0);
+	hid_t mem_space = H5Screate_simple(rank + 1, &count[0], 0);
+	if (status >= 0)
+		status = H5Dwrite(dataset, type, mem_space, space, H5P_DEFAULT, data);
+	H5Sclose(mem_space);
+	H5Sclose(space);
+	if (status < 0)
+		throw LocalisedException
+			("writing to ISMRMRD dataset failed", __FILE__, __LINE__);
+}
+
+void
+ISMRMRDWriter::append_acquisitions(const std::vector<ISMRMRD::Acquisition>& acqs)
+{
+	if (acqs.size() < 1)
+		return;
+	std::vector<HDF5Acquisition> records(acqs.size());
+	for (size_t i = 0; i < acqs.size(); i++) {
+		const ISMRMRD::Acquisition& acq = acqs[i];
+		HDF5Acquisition& r = records[i];
+		r.head = acq.getHead();
+		r.traj.len = acq.getNumberOfTrajElements();
+		r.traj.p = (void*)acq.getTrajPtr();
+		r.data.len = 2 * acq.getNumberOfDataElements();
+		r.data.p = (void*)acq.getDataPtr();
+		SIRF_PROFILE_BYTES("ISMRMRDWriter::append", sizeof(r.head) +
+			sizeof(float)*(r.traj.len + r.data.len));
+	}
+	hsize_t chunk = ACQUISITIONS_CHUNK;
+	Mutex mtx;
+	mtx.lock();
+	hid_t type = acquisition_type_();
+	hid_t dataset = open_or_create_(group_ + "/data", type, 0, 0, &chunk);
+	try {
+		if (dataset < 0)
+			throw LocalisedException
+				("cannot create ISMRMRD acquisitions dataset",
+					__FILE__, __LINE__);
+		append_(dataset, type, 0, 0, records.size(), &records[0]);
+	}
+	catch (...) {
+		if (dataset >= 0)
+			H5Dclose(dataset);
+		H5Tclose(type);
+		mtx.unlock();
+		throw;
+	}
+	H5Dclose(dataset);
+	H5Tclose(type);
+	mtx.unlock();
+}
+
+void
+ISMRMRDWriter::append_images(const std::string& var, unsigned int n,
+	const ISMRMRD::ImageHeader* heads, const char* const* attributes,
+	const void* data)
+{
+	if (n < 1)
+		return;
+	const ISMRMRD::ImageHeader& head = heads[0];
+	// ISMRMRD stores images as (channels, z, y, x) arrays, one chunk each
+	hsize_t dims[4];
+	dims[0] = head.channels;
+	dims[1] = head.matrix_size[2];
+	dims[2] = head.matrix_size[1];
+	dims[3] = head.matrix_size[0];
+	hsize_t chunk[5] = { 1, dims[0], dims[1], dims[2], dims[3] };
+	std::string path = group_ + "/" + var + "/";
+
+	Mutex mtx;
+	mtx.lock();
+	hid_t types[3];
+	hid_t datasets[3] = { -1, -1, -1 };
+	types[0] = image_header_type_();
+	types[1] = string_type_();
+	try {
+		types[2] = image_data_type_(head.data_type);
+	}
+	catch (...) {
+		H5Tclose(types[0]);
+		H5Tclose(types[1]);
+		mtx.unlock();
+		throw;
+	}
+	try {
+		hsize_t record_chunk = std::max(1u, std::min(n, 256u));
+		datasets[0] = open_or_create_
+			(path + "header", types[0], 0, 0, &record_chunk);
+		datasets[1] = open_or_create_
+			(path + "attributes", types[1], 0, 0, &record_chunk);
+		datasets[2] = open_or_create_(path + "data", types[2], 4, dims, chunk);
+		if (datasets[0] < 0 || datasets[1] < 0 || datasets[2] < 0)
+			throw LocalisedException
+				("cannot create ISMRMRD images datasets", __FILE__, __LINE__);
+		append_(datasets[0], types[0], 0, 0, n, heads);
+		append_(datasets[1], types[1], 0, 0, n, attributes);
+		append_(datasets[2], types[2], 4, dims, n, data);
+		SIRF_PROFILE_BYTES("ISMRMRDWriter::append", n*(sizeof(ISMRMRD::ImageHeader)
+			+ H5Tget_size(types[2])*dims[0] * dims[1] * dims[2] * dims[3]));
+	}
+	catch (...) {
+		for (int i = 0; i < 3; i++) {
+			if (datasets[i] >= 0)
+				H5Dclose(datasets[i]);
+			H5Tclose(types[i]);
+		}
+		mtx.unlock();
+		throw;
+	}
+	for (int i = 0; i < 3; i++) {
+		H5Dclose(datasets[i]);
+		H5Tclose(types[i]);
+	}
+	mtx.unlock();
+}
+
+ISMRMRDHeadersReader::ISMRMRDHeadersReader
+(const std::string& filename, const std::string& groupname) :
+	dataset_(-1), number_(0)
+{
+	std::string path = groupname + "/data";
+	Mutex mtx;
+	mtx.lock();
+	file_ = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+	if (file_ >= 0 && exists_(file_, path))
+		dataset_ = H5Dopen2(file_, path.c_str(), H5P_DEFAULT);
+	if (dataset_ >= 0) {
+		hid_t space = H5Dget_space(dataset_);
+		hsize_t n = 0;
+		if (H5Sget_simple_extent_ndims(space) == 1)
+			H5Sget_simple_extent_dims(space, &n, 0);
+		H5Sclose(space);
+		number_ = (unsigned int)n;
+	}
+	mtx.unlock();
+	if (file_ < 0)
+		throw LocalisedException
+			("cannot open ISMRMRD file for reading", __FILE__, __LINE__);
+}
+
+ISMRMRDHeadersReader::~ISMRMRDHeadersReader()
+{
+	Mutex mtx;
+	mtx.lock();
+	if (dataset_ >= 0)
+		H5Dclose(dataset_);
+	H5Fclose(file_);
+	mtx.unlock();
+}
+
+void
+ISMRMRDHeadersReader::read(unsigned int first, unsigned int count,
+	ISMRMRD::AcquisitionHeader* heads)
+{
+	SIRF_PROFILE("ISMRMRDHeadersReader::read");
+	if (count < 1)
+		return;
+	if (first + count > number_)
+		throw LocalisedException
+			("acquisition header index out of range", __FILE__, __LINE__);
+	// a record type with the header member only, so that HDF5 does not
+	// touch the samples and trajectories
+	hid_t type = H5Tcreate(H5T_COMPOUND, sizeof(ISMRMRD::AcquisitionHeader));
+	hid_t head_type = acquisition_header_type_();
+	H5Tinsert(type, "head", 0, head_type);
+	H5Tclose(head_type);
+	hsize_t start = first;
+	hsize_t n = count;
+	Mutex mtx;
+	mtx.lock();
+	hid_t space = H5Dget_space(dataset_);
+	H5Sselect_hyperslab(space, H5S_SELECT_SET, &start, 0, &n, 0);
+	hid_t mem_space = H5Screate_simple(1, &n, 0);
+	herr_t status = H5Dread(dataset_, type, mem_space, space, H5P_DEFAULT, heads);
+	SIRF_PROFILE_BYTES("ISMRMRDHeadersReader::read",
+		count*sizeof(ISMRMRD::AcquisitionHeader));
+	H5Sclose(mem_space);
+	H5Sclose(space);
+	mtx.unlock();
+	H5Tclose(type);
+	if (status < 0)
+		throw LocalisedException
+			("reading acquisition headers failed", __FILE__, __LINE__);
+}
@@ -0,0 +1,127 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup Gadgetron Data Containers
+\brief Batched writer of ISMRMRD acquisitions and images to HDF5 files,
+and reader of acquisition headers alone.
+
+The files written have the layout of those written by ISMRMRD::Dataset and
+can be read by it, but the HDF5 datasets are chunked to match acquisition
+and image sizes (ISMRMRD uses chunks of one item), optionally compressed,
+and items are written many at a time.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#ifndef ISMRMRD_HDF5_WRITER
+#define ISMRMRD_HDF5_WRITER
+
+#include <string>
+#include <vector>
+
+#include <hdf5.h>
+#include <ismrmrd/ismrmrd.h>
+
+namespace sirf {
+
+	/*!
+	\ingroup Gadgetron Data Containers
+	\brief Writes ISMRMRD acquisitions and images to a file in batches.
+
+	The compression level runs from 0 (no compression, the default) to 9.
+	The LZ4 filter is used if the HDF5 library finds its plugin, otherwise
+	the built-in shuffle and deflate filters are. Variable-length
+	acquisition samples are kept by HDF5 outside the chunks, so only the
+	acquisition headers are compressed, while images are compressed whole.
+	*/
+	class ISMRMRDWriter {
+	public:
+		// opens the file, creating it if it does not exist, and writes
+		// the ISMRMRD header into group groupname if header is not empty
+		ISMRMRDWriter(const std::string& filename, const std::string& groupname,
+			const std::string& header = std::string());
+		~ISMRMRDWriter();
+
+		// compression level for the writers created from now on
+		static void set_default_compression(int level);
+		static int default_compression()
+		{
+			return default_compression_;
+		}
+		void set_compression(int level);
+		int compression() const
+		{
+			return compression_;
+		}
+
+		// appends acquisitions to the dataset data of the group
+		void append_acquisitions(const std::vector<ISMRMRD::Acquisition>& acqs);
+		// appends n images of the same data type and dimensions to the
+		// datasets header, attributes and data of subgroup var of the group,
+		// the data of the images following one another in data
+		void append_images(const std::string& var, unsigned int n,
+			const ISMRMRD::ImageHeader* heads, const char* const* attributes,
+			const void* data);
+
+	private:
+		static int default_compression_;
+		int compression_;
+		std::string group_;
+		hid_t file_;
+
+		hid_t open_or_create_(const std::string& path, hid_t type,
+			int rank, const hsize_t* dims, const hsize_t* chunk);
+		void append_(hid_t dataset, hid_t type,
+			int rank, const hsize_t* dims, hsize_t n, const void* data);
+	};
+
+	/*!
+	\ingroup Gadgetron Data Containers
+	\brief Reads acquisition headers from an ISMRMRD file, leaving the
+	acquisition samples and trajectories unread.
+
+	The file may be open as an ISMRMRD::Dataset at the same time.
+	*/
+	class ISMRMRDHeadersReader {
+	public:
+		ISMRMRDHeadersReader
+			(const std::string& filename, const std::string& groupname);
+		~ISMRMRDHeadersReader();
+		// number of acquisitions in the file
+		unsigned int number() const
+		{
+			return number_;
+		}
+		// reads the headers of acquisitions first to first + count - 1
+		void read(unsigned int first, unsigned int count,
+			ISMRMRD::AcquisitionHeader* heads);
+
+	private:
+		hid_t file_;
+		hid_t dataset_;
+		unsigned int number_;
+	};
+
+}
+
+#endif
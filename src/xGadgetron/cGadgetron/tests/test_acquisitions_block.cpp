@@ -0,0 +1,329 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup xGadgetron Utilities
+\brief Round trips of synthetic acquisitions through AcquisitionsBlock
+(single and batched appends and reads, in-place updates, sorting and
+compaction) and its slab algebra against AcquisitionsVector, including
+operations with *this among the operands.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#include <cmath>
+#include <complex>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <ismrmrd/ismrmrd.h>
+
+#include "gadgetron_data_containers.h"
+#include "sirf_test.h"
+
+using namespace sirf;
+using SIRFTest::check;
+
+// acquisition i of a synthetic scan: sizes vary unless uniform is set,
+// every other acquisition has a 2D trajectory
+static void
+make_acquisition(unsigned int i, bool uniform, std::mt19937& gen,
+	ISMRMRD::Acquisition& acq)
+{
+	std::uniform_real_distribution<float> u(-1.0f, 1.0f);
+	uint16_t ns = uniform ? 32 : 17 + 8*(i % 3);
+	uint16_t nc = uniform ? 4 : 1 + i % 4;
+	uint16_t nt = uniform ? 0 : 2*(i % 2);
+	acq.resize(ns, nc, nt);
+	acq.scan_counter() = i;
+	acq.idx().repetition = i % 2;
+	acq.idx().slice = (i / 2) % 3;
+	acq.idx().kspace_encode_step_1 = (i*7) % 11;
+	complex_float_t* data = acq.getDataPtr();
+	for (size_t j = 0; j < acq.getNumberOfDataElements(); j++)
+		data[j] = complex_float_t(u(gen), u(gen));
+	float* traj = acq.getTrajPtr();
+	for (size_t j = 0; j < acq.getNumberOfTrajElements(); j++)
+		traj[j] = u(gen);
+}
+
+static bool
+same(const ISMRMRD::Acquisition& x, const ISMRMRD::Acquisition& y)
+{
+	if (memcmp(&x.getHead(), &y.getHead(), sizeof(ISMRMRD::AcquisitionHeader)))
+		return false;
+	size_t n = x.getNumberOfDataElements();
+	size_t nt = x.getNumberOfTrajElements();
+	return n == y.getNumberOfDataElements() &&
+		nt == y.getNumberOfTrajElements() &&
+		!memcmp(x.getDataPtr(), y.getDataPtr(), n*sizeof(complex_float_t)) &&
+		(nt == 0 || !memcmp(x.getTrajPtr(), y.getTrajPtr(), nt*sizeof(float)));
+}
+
+static bool
+close(complex_float_t x, complex_float_t y, float scale)
+{
+	return std::abs(x - y) <= 1e-5f*(1.0f + scale);
+}
+
+// the acquisitions of u not to be ignored agree with those of v
+static bool
+agree(MRAcquisitionData& u, MRAcquisitionData& v)
+{
+	ISMRMRD::Acquisition p, q;
+	unsigned int i = 0, j = 0;
+	for (;; i++, j++) {
+		for (; i < u.number(); i++) {
+			u.get_acquisition(i, p);
+			if (!TO_BE_IGNORED(p))
+				break;
+		}
+		for (; j < v.number(); j++) {
+			v.get_acquisition(j, q);
+			if (!TO_BE_IGNORED(q))
+				break;
+		}
+		if (i >= u.number() || j >= v.number())
+			return i >= u.number() && j >= v.number();
+		size_t n = q.getNumberOfDataElements();
+		if (p.getNumberOfDataElements() != n)
+			return false;
+		for (size_t k = 0; k < n; k++)
+			if (!close(p.getDataPtr()[k], q.getDataPtr()[k],
+				std::abs(q.getDataPtr()[k])))
+				return false;
+	}
+}
+
+static void
+copy_acquisitions(MRAcquisitionData& src, MRAcquisitionData& dst)
+{
+	ISMRMRD::Acquisition acq;
+	for (unsigned int i = 0; i < src.number(); i++) {
+		src.get_acquisition(i, acq);
+		dst.append_acquisition(acq);
+	}
+}
+
+static void
+test_round_trip(std::mt19937& gen)
+{
+	const unsigned int na = 40;
+	std::vector<ISMRMRD::Acquisition> acqs(na);
+	for (unsigned int i = 0; i < na; i++)
+		make_acquisition(i, false, gen, acqs[i]);
+
+	// the first half one by one, the rest in one batch
+	AcquisitionsBlock ab;
+	for (unsigned int i = 0; i < na/2; i++)
+		ab.append_acquisition(acqs[i]);
+	std::vector<ISMRMRD::Acquisition> rest(acqs.begin() + na/2, acqs.end());
+	ab.append_acquisitions(rest);
+	check(ab.number() == na, "number of appended acquisitions");
+
+	size_t size = 0;
+	bool ok = true;
+	bool direct = true;
+	ISMRMRD::Acquisition acq;
+	for (unsigned int i = 0; i < na; i++) {
+		ab.get_acquisition(i, acq);
+		ok = ok && same(acq, acqs[i]);
+		size_t n = acqs[i].getNumberOfDataElements();
+		direct = direct && ab.data_size(i) == n && ab.data(i) == ab.slab() + size &&
+			!memcmp(ab.data(i), acqs[i].getDataPtr(), n*sizeof(complex_float_t));
+		size += n;
+	}
+	check(ok, "get_acquisition returns the appended acquisitions");
+	check(direct, "data() addresses the slab in append order");
+	check(ab.slab_size() == size, "slab size is the total number of samples");
+
+	std::vector<ISMRMRD::Acquisition> batch;
+	ab.get_acquisitions(5, 20, batch);
+	ok = batch.size() == 20;
+	for (unsigned int i = 0; ok && i < 20; i++)
+		ok = same(batch[i], acqs[5 + i]);
+	check(ok, "get_acquisitions returns the appended acquisitions");
+
+	// in-place update of data, trajectory and header
+	ISMRMRD::Acquisition upd(acqs[3]);
+	make_acquisition(3, false, gen, upd);
+	upd.idx().average = 5;
+	ab.set_acquisition(3, upd);
+	ab.get_acquisition(3, acq);
+	check(same(acq, upd), "set_acquisition replaces the acquisition");
+	ab.get_acquisition(4, acq);
+	check(same(acq, acqs[4]), "set_acquisition leaves the next one intact");
+
+	bool thrown = false;
+	try {
+		ab.set_acquisition(0, acqs[1]);
+	}
+	catch (LocalisedException&) {
+		thrown = true;
+	}
+	check(thrown, "set_acquisition refuses a different size");
+	acqs[3] = upd;
+
+	// sorting via the index, then storing in sorted order
+	ab.order();
+	std::vector<ISMRMRD::Acquisition> sorted(na);
+	for (unsigned int i = 0; i < na; i++)
+		ab.get_acquisition(i, sorted[i]);
+	ok = true;
+	for (unsigned int i = 1; i < na; i++) {
+		const ISMRMRD::EncodingCounters& p = sorted[i - 1].idx();
+		const ISMRMRD::EncodingCounters& q = sorted[i].idx();
+		ok = ok && (p.repetition < q.repetition ||
+			(p.repetition == q.repetition && (p.slice < q.slice ||
+			(p.slice == q.slice &&
+			p.kspace_encode_step_1 <= q.kspace_encode_step_1))));
+	}
+	check(ok, "order() sorts by repetition, slice and phase encoding");
+
+	ab.compact();
+	check(ab.index() == 0, "compact() drops the index");
+	check(ab.number() == na && ab.slab_size() == size,
+		"compact() keeps all samples");
+	ok = true;
+	size = 0;
+	for (unsigned int i = 0; i < na; i++) {
+		ab.get_acquisition(i, acq);
+		ok = ok && same(acq, sorted[i]) && ab.data(i) == ab.slab() + size;
+		size += sorted[i].getNumberOfDataElements();
+	}
+	check(ok, "compact() stores the acquisitions in sorted order");
+}
+
+static void
+test_algebra(std::mt19937& gen, bool with_noise)
+{
+	const unsigned int na = 24;
+	AcquisitionsBlock xb, yb;
+	AcquisitionsVector xv, yv;
+	ISMRMRD::Acquisition acq;
+	for (unsigned int i = 0; i < na; i++) {
+		make_acquisition(i, true, gen, acq);
+		// a noise calibration acquisition makes the block irregular
+		if (with_noise && i == 0)
+			acq.setFlag(ISMRMRD::ISMRMRD_ACQ_IS_NOISE_MEASUREMENT);
+		xb.append_acquisition(acq);
+		xv.append_acquisition(acq);
+		make_acquisition(i, true, gen, acq);
+		if (with_noise && i == 0)
+			acq.setFlag(ISMRMRD::ISMRMRD_ACQ_IS_NOISE_MEASUREMENT);
+		yb.append_acquisition(acq);
+		yv.append_acquisition(acq);
+	}
+	const char* what = with_noise ?
+		" (with a noise acquisition)" : " (regular blocks)";
+	std::string s;
+
+	float nx = xv.norm();
+	s = std::string("norm") + what;
+	check(std::abs(xb.norm() - nx) <= 1e-5f*nx, s.c_str());
+	complex_float_t d = xv.dot(yv);
+	float scale = nx*yv.norm();
+	s = std::string("dot") + what;
+	check(close(xb.dot(yb), d, scale), s.c_str());
+
+	const complex_float_t a(0.5f, -1.5f);
+	const complex_float_t b(-0.25f, 2.0f);
+	AcquisitionsBlock zb;
+	AcquisitionsVector zv;
+	zb.axpby(a, xb, b, yb);
+	zv.axpby(a, xv, b, yv);
+	bool ok = zb.number() == zv.number();
+	ISMRMRD::Acquisition acq_b, acq_v;
+	for (unsigned int i = 0; ok && i < zv.number(); i++) {
+		zb.get_acquisition(i, acq_b);
+		zv.get_acquisition(i, acq_v);
+		const complex_float_t* p = acq_b.getDataPtr();
+		const complex_float_t* q = acq_v.getDataPtr();
+		for (size_t j = 0; ok && j < acq_v.getNumberOfDataElements(); j++)
+			ok = close(p[j], q[j], std::abs(q[j]));
+	}
+	s = std::string("axpby") + what;
+	check(ok, s.c_str());
+
+	AcquisitionsBlock wb;
+	float nz = zv.norm();
+	s = std::string("axpby_norm") + what;
+	check(std::abs(wb.axpby_norm(a, xb, b, yb) - nz) <= 1e-5f*nz, s.c_str());
+
+	// in-place operations: the results overwrite the acquisitions of *this,
+	// which is one of the operands, the ignored ones left as they are
+	AcquisitionsBlock ub;
+	copy_acquisitions(xb, ub);
+	ub.xapy(b, yb);
+	AcquisitionsVector pv;
+	pv.axpby(complex_float_t(1.0f), xv, b, yv);
+	s = std::string("xapy in place") + what;
+	check(ub.number() == na && agree(ub, pv), s.c_str());
+
+	const complex_float_t c[3] = { b, complex_float_t(2.0f), a };
+	AcquisitionsVector ev;
+	const aDataContainer<complex_float_t>* vs[3] = { &yv, &xv, &xv };
+	ev.linear_combination(3, c, vs);
+	AcquisitionsBlock lb;
+	copy_acquisitions(xb, lb);
+	const aDataContainer<complex_float_t>* last[3] = { &yb, &xb, &lb };
+	lb.linear_combination(3, c, last);
+	s = std::string("linear_combination with *this last") + what;
+	check(lb.number() == na && agree(lb, ev), s.c_str());
+	AcquisitionsBlock fb;
+	copy_acquisitions(xb, fb);
+	const aDataContainer<complex_float_t>* middle[3] = { &yb, &fb, &xb };
+	fb.linear_combination(3, c, middle);
+	s = std::string("linear_combination with *this in the middle") + what;
+	check(fb.number() == na && agree(fb, ev), s.c_str());
+	// a non-empty *this that is not an operand is overwritten
+	AcquisitionsBlock ob;
+	copy_acquisitions(yb, ob);
+	const aDataContainer<complex_float_t>* other[3] = { &yb, &xb, &xb };
+	ob.linear_combination(3, c, other);
+	s = std::string("linear_combination into a non-empty container") + what;
+	check(ob.number() == na && agree(ob, ev), s.c_str());
+
+	AcquisitionsBlock nb;
+	copy_acquisitions(yb, nb);
+	s = std::string("axpby_norm in place") + what;
+	check(std::abs(nb.axpby_norm(a, xb, b, nb) - nz) <= 1e-5f*nz &&
+		nb.number() == na && agree(nb, zv), s.c_str());
+	AcquisitionsBlock db;
+	copy_acquisitions(yb, db);
+	complex_float_t dz = zv.dot(xv);
+	s = std::string("axpby_dot in place") + what;
+	check(close(db.axpby_dot(a, xb, b, db, xb), dz, nz*nx) &&
+		db.number() == na && agree(db, zv), s.c_str());
+}
+
+int main()
+{
+	std::mt19937 gen(2017);
+	test_round_trip(gen);
+	test_algebra(gen, false);
+	test_algebra(gen, true);
+	return SIRFTest::report("acquisitions block");
+}
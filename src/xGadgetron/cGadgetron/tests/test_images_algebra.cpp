@@ -0,0 +1,201 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup xGadgetron Utilities
+\brief Tests of the fused image algebra of ImagesVector and ImagesVolume
+with the result container empty, not empty, and among the operands.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#include <cmath>
+#include <complex>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <ismrmrd/ismrmrd.h>
+
+#include "gadgetron_data_containers.h"
+#include "sirf_test.h"
+
+using namespace sirf;
+using SIRFTest::check;
+
+static const unsigned int NUM_IMAGES = 6;
+static const unsigned int IMAGE_SIZE = 16*16*2;
+
+static void
+make_images(std::mt19937& gen, ImagesVector& images)
+{
+	std::uniform_real_distribution<float> u(-1.0f, 1.0f);
+	for (unsigned int i = 0; i < NUM_IMAGES; i++) {
+		CFImage* ptr_im = new CFImage(16, 16, 1, 2);
+		ptr_im->setSlice(i);
+		complex_float_t* data = ptr_im->getDataPtr();
+		for (unsigned int j = 0; j < IMAGE_SIZE; j++)
+			data[j] = complex_float_t(u(gen), u(gen));
+		images.append(ISMRMRD::ISMRMRD_CXFLOAT, ptr_im);
+	}
+}
+
+static std::vector<complex_float_t>
+values(MRImageData& images)
+{
+	size_t n = (size_t)images.number()*IMAGE_SIZE;
+	std::vector<float> re(n), im(n);
+	images.get_images_data_as_complex_array(re.data(), im.data());
+	std::vector<complex_float_t> v(n);
+	for (size_t i = 0; i < n; i++)
+		v[i] = complex_float_t(re[i], im[i]);
+	return v;
+}
+
+static bool
+agree(MRImageData& images, const std::vector<complex_float_t>& y)
+{
+	if (images.number()*IMAGE_SIZE != y.size())
+		return false;
+	std::vector<complex_float_t> x = values(images);
+	for (size_t i = 0; i < y.size(); i++)
+		if (std::abs(x[i] - y[i]) > 1e-5f*(1.0f + std::abs(y[i])))
+			return false;
+	return true;
+}
+
+// a new container of the given kind holding a copy of images
+static gadgetron::shared_ptr<MRImageData>
+copy_of(ImagesVector& images, bool volume)
+{
+	if (volume)
+		return gadgetron::shared_ptr<MRImageData>(new ImagesVolume(images));
+	gadgetron::shared_ptr<MRImageData> sptr(new ImagesVector);
+	for (unsigned int i = 0; i < images.number(); i++)
+		sptr->append(images.image_wrap(i));
+	return sptr;
+}
+
+static void
+test_algebra(std::mt19937& gen, bool volume)
+{
+	const char* what = volume ? " (ImagesVolume)" : " (ImagesVector)";
+	std::string s;
+	ImagesVector xs, ys;
+	make_images(gen, xs);
+	make_images(gen, ys);
+	gadgetron::shared_ptr<MRImageData> sptr_x = copy_of(xs, volume);
+	gadgetron::shared_ptr<MRImageData> sptr_y = copy_of(ys, volume);
+	MRImageData& x = *sptr_x;
+	MRImageData& y = *sptr_y;
+	std::vector<complex_float_t> vx = values(x);
+	std::vector<complex_float_t> vy = values(y);
+	size_t n = vx.size();
+
+	const complex_float_t a(0.5f, -1.5f);
+	const complex_float_t b(-0.25f, 2.0f);
+	const complex_float_t c[3] = { b, complex_float_t(2.0f), a };
+	std::vector<complex_float_t> lc(n), xy(n);
+	for (size_t i = 0; i < n; i++) {
+		lc[i] = c[0]*vy[i] + c[1]*vx[i] + c[2]*vx[i];
+		xy[i] = a*vx[i] + b*vy[i];
+	}
+	double r = 0;
+	double rx = 0;
+	std::complex<double> d = 0;
+	for (size_t i = 0; i < n; i++) {
+		r += std::norm(xy[i]);
+		rx += std::norm(vx[i]);
+		d += std::conj(std::complex<double>(vx[i]))*
+			std::complex<double>(xy[i]);
+	}
+	float nxy = (float)std::sqrt(r);
+	double scale = std::sqrt(rx*r);
+
+	{
+		gadgetron::shared_ptr<MRImageData> sptr_z = copy_of(xs, volume);
+		const aDataContainer<complex_float_t>* ops[3] =
+			{ sptr_y.get(), &x, sptr_z.get() };
+		sptr_z->linear_combination(3, c, ops);
+		s = std::string("linear_combination with *this last") + what;
+		check(agree(*sptr_z, lc), s.c_str());
+	}
+	{
+		gadgetron::shared_ptr<MRImageData> sptr_z = copy_of(xs, volume);
+		const aDataContainer<complex_float_t>* ops[3] =
+			{ &y, sptr_z.get(), &x };
+		sptr_z->linear_combination(3, c, ops);
+		s = std::string("linear_combination with *this in the middle") + what;
+		check(agree(*sptr_z, lc), s.c_str());
+	}
+	{
+		// not an operand, but not empty either: overwritten
+		gadgetron::shared_ptr<MRImageData> sptr_z = copy_of(ys, volume);
+		const aDataContainer<complex_float_t>* ops[3] = { &y, &x, &x };
+		sptr_z->linear_combination(3, c, ops);
+		s = std::string("linear_combination into non-empty images") + what;
+		check(agree(*sptr_z, lc), s.c_str());
+		gadgetron::shared_ptr<MRImageData> sptr_e(volume ?
+			(MRImageData*)new ImagesVolume : (MRImageData*)new ImagesVector);
+		sptr_e->linear_combination(3, c, ops);
+		s = std::string("linear_combination into empty images") + what;
+		check(agree(*sptr_e, lc), s.c_str());
+	}
+	{
+		gadgetron::shared_ptr<MRImageData> sptr_z = copy_of(ys, volume);
+		float rz = sptr_z->axpby_norm(a, x, b, *sptr_z);
+		s = std::string("axpby_norm in place") + what;
+		check(std::abs(rz - nxy) <= 1e-5f*nxy && agree(*sptr_z, xy), s.c_str());
+	}
+	{
+		gadgetron::shared_ptr<MRImageData> sptr_z = copy_of(ys, volume);
+		complex_float_t dz = sptr_z->axpby_dot(a, x, b, *sptr_z, x);
+		s = std::string("axpby_dot in place") + what;
+		check(std::abs(std::complex<double>(dz) - d) <= 1e-5*(1.0 + scale) &&
+			agree(*sptr_z, xy), s.c_str());
+	}
+	{
+		// the number of images of a non-empty result must match
+		ImagesVector one;
+		one.append(xs.image_wrap(0));
+		gadgetron::shared_ptr<MRImageData> sptr_few = copy_of(one, volume);
+		bool thrown = false;
+		try {
+			const aDataContainer<complex_float_t>* ops[2] = { &x, &y };
+			sptr_few->linear_combination(2, c, ops);
+		}
+		catch (LocalisedException&) {
+			thrown = true;
+		}
+		s = std::string("linear_combination refuses a wrong size") + what;
+		check(thrown, s.c_str());
+	}
+}
+
+int main()
+{
+	std::mt19937 gen(2017);
+	test_algebra(gen, false);
+	test_algebra(gen, true);
+	return SIRFTest::report("image algebra");
+}
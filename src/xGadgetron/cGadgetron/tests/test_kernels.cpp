@@ -0,0 +1,145 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup xGadgetron Utilities
+\brief Tests of the complex float vector kernels against plain std::complex
+loops, for lengths with and without a remainder after the 4-element AVX2
+blocks and for unaligned arrays.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#include <cmath>
+#include <complex>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "xgadgetron_kernels.h"
+#include "sirf_test.h"
+
+using namespace sirf;
+
+// the failures are reported with the vector length
+static void
+check(bool ok, const char* what, size_t n)
+{
+	SIRFTest::check(ok, std::string(what) + " (n = " + std::to_string(n) + ")");
+}
+
+typedef xGadgetronKernels::complex_t complex_t;
+typedef xGadgetronKernels::complex_d complex_d;
+
+// elementwise agreement to single precision rounding of fused operations
+static bool
+close(const complex_t* x, const std::vector<complex_t>& y)
+{
+	for (size_t i = 0; i < y.size(); i++)
+		if (std::abs(x[i] - y[i]) > 1e-5f*(1.0f + std::abs(y[i])))
+			return false;
+	return true;
+}
+
+static bool
+close(complex_d x, complex_d y, double scale)
+{
+	return std::abs(x - y) <= 1e-10*(1.0 + scale);
+}
+
+static void
+test_kernels(size_t n, size_t offset, std::mt19937& gen)
+{
+	std::uniform_real_distribution<float> u(-2.0f, 2.0f);
+	// offset elements in front make the arrays not 32-byte aligned
+	std::vector<complex_t> bx(n + offset), by(n + offset), bz(n + offset);
+	for (size_t i = 0; i < n + offset; i++) {
+		bx[i] = complex_t(u(gen), u(gen));
+		by[i] = complex_t(u(gen), u(gen));
+	}
+	complex_t* x = bx.data() + offset;
+	complex_t* y = by.data() + offset;
+	complex_t* z = bz.data() + offset;
+	const complex_t a(0.5f, -1.5f);
+	const complex_t b(-0.25f, 2.0f);
+	std::vector<complex_t> ref(n);
+
+	for (size_t i = 0; i < n; i++)
+		ref[i] = a*x[i] + b*y[i];
+	xGadgetronKernels::axpby(n, a, x, b, y, z);
+	check(close(z, ref), "axpby", n);
+	for (size_t i = 0; i < n; i++)
+		ref[i] = a*x[i];
+	xGadgetronKernels::axpby(n, a, x, complex_t(0.0f), y, z);
+	check(close(z, ref), "axpby with b = 0", n);
+	std::vector<complex_t> w(y, y + n);
+	for (size_t i = 0; i < n; i++)
+		ref[i] = a*x[i] + b*w[i];
+	xGadgetronKernels::axpby(n, a, x, b, w.data());
+	check(close(w.data(), ref), "axpby in place", n);
+
+	for (size_t i = 0; i < n; i++)
+		ref[i] = x[i]*y[i];
+	w.assign(y, y + n);
+	xGadgetronKernels::multiply(n, x, w.data());
+	check(close(w.data(), ref), "multiply", n);
+
+	for (size_t i = 0; i < n; i++)
+		ref[i] = x[i]/y[i];
+	w.assign(y, y + n);
+	xGadgetronKernels::divide(n, x, w.data());
+	check(close(w.data(), ref), "divide", n);
+
+	complex_d d(0.0);
+	double s = 0.0;
+	double scale = 0.0;
+	for (size_t i = 0; i < n; i++) {
+		d += std::conj(complex_d(y[i]))*complex_d(x[i]);
+		s += std::norm(complex_d(x[i]));
+		scale += std::abs(complex_d(x[i]))*std::abs(complex_d(y[i]));
+	}
+	check(close(xGadgetronKernels::dot(n, x, y), d, scale), "dot", n);
+	check(close(complex_d(xGadgetronKernels::norm2(n, x)), complex_d(s), s),
+		"norm2", n);
+}
+
+int main()
+{
+	std::cout << "AVX2 kernels "
+		<< (xGadgetronKernels::vectorised() ? "in use\n" : "not in use\n");
+	std::mt19937 gen(2017);
+	size_t sizes[] = { 0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 1000, 100003 };
+	for (size_t n : sizes)
+		for (size_t offset = 0; offset < 4; offset++)
+			test_kernels(n, offset, gen);
+
+	// zero denominators give IEEE values rather than errors
+	complex_t x[2] = { complex_t(1.0f, 0.0f), complex_t(0.0f, 0.0f) };
+	complex_t y[2] = { complex_t(0.0f, 0.0f), complex_t(0.0f, 0.0f) };
+	xGadgetronKernels::divide(2, x, y);
+	check(!std::isfinite(y[0].real()) || !std::isfinite(y[0].imag()),
+		"division by zero is not finite", 2);
+	check(std::isnan(y[1].real()), "0/0 is NaN", 2);
+
+	return SIRFTest::report("kernel");
+}
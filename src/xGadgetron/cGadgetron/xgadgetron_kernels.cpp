@@ -0,0 +1,266 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup xGadgetron Utilities
+\brief Implementation file for vector kernels for complex float arrays.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#include "xgadgetron_kernels.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define SIRF_AVX2_KERNELS
+#include <immintrin.h>
+#endif
+
+using namespace sirf;
+
+typedef xGadgetronKernels::complex_t complex_t;
+typedef xGadgetronKernels::complex_d complex_d;
+
+#ifdef SIRF_AVX2_KERNELS
+
+#define AVX2_TARGET __attribute__((target("avx2,fma")))
+
+static bool
+have_avx2_()
+{
+	static const bool avx2 =
+		__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	return avx2;
+}
+
+// four complex numbers per 256-bit register; (X re, X im) -> (X im, X re)
+#define SWAP_RE_IM(X) _mm256_permute_ps(X, 0xB1)
+
+AVX2_TARGET static void
+axpby_avx2_(size_t n, complex_t a, const complex_t* x,
+	complex_t b, const complex_t* y, complex_t* z)
+{
+	const float* px = (const float*)x;
+	const float* py = (const float*)y;
+	float* pz = (float*)z;
+	__m256 ar = _mm256_set1_ps(a.real());
+	__m256 ai = _mm256_setr_ps(-a.imag(), a.imag(), -a.imag(), a.imag(),
+		-a.imag(), a.imag(), -a.imag(), a.imag());
+	__m256 br = _mm256_set1_ps(b.real());
+	__m256 bi = _mm256_setr_ps(-b.imag(), b.imag(), -b.imag(), b.imag(),
+		-b.imag(), b.imag(), -b.imag(), b.imag());
+	size_t m = n - n % 4;
+	if (b == complex_t(0.0)) {
+		for (size_t i = 0; i < m; i += 4) {
+			__m256 u = _mm256_loadu_ps(px + 2 * i);
+			__m256 r = _mm256_fmadd_ps(ar, u, _mm256_mul_ps(ai, SWAP_RE_IM(u)));
+			_mm256_storeu_ps(pz + 2 * i, r);
+		}
+		for (size_t i = m; i < n; i++)
+			z[i] = a*x[i];
+	}
+	else {
+		for (size_t i = 0; i < m; i += 4) {
+			__m256 u = _mm256_loadu_ps(px + 2 * i);
+			__m256 v = _mm256_loadu_ps(py + 2 * i);
+			__m256 r = _mm256_fmadd_ps(ar, u, _mm256_mul_ps(ai, SWAP_RE_IM(u)));
+			r = _mm256_fmadd_ps(br, v, r);
+			r = _mm256_fmadd_ps(bi, SWAP_RE_IM(v), r);
+			_mm256_storeu_ps(pz + 2 * i, r);
+		}
+		for (size_t i = m; i < n; i++)
+			z[i] = a*x[i] + b*y[i];
+	}
+}
+
+AVX2_TARGET static void
+multiply_avx2_(size_t n, const complex_t* x, complex_t* y)
+{
+	const float* px = (const float*)x;
+	float* py = (float*)y;
+	size_t m = n - n % 4;
+	for (size_t i = 0; i < m; i += 4) {
+		__m256 u = _mm256_loadu_ps(px + 2 * i);
+		__m256 v = _mm256_loadu_ps(py + 2 * i);
+		__m256 ur = _mm256_moveldup_ps(u);
+		__m256 ui = _mm256_movehdup_ps(u);
+		__m256 r = _mm256_fmaddsub_ps(ur, v, _mm256_mul_ps(ui, SWAP_RE_IM(v)));
+		_mm256_storeu_ps(py + 2 * i, r);
+	}
+	for (size_t i = m; i < n; i++)
+		y[i] = x[i] * y[i];
+}
+
+// horizontal sum of four doubles
+AVX2_TARGET static double
+hsum_avx2_(__m256d v)
+{
+	__m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+	return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+}
+
+AVX2_TARGET static complex_d
+dot_avx2_(size_t n, const complex_t* x, const complex_t* y)
+{
+	const float* px = (const float*)x;
+	const float* py = (const float*)y;
+	__m256d re = _mm256_setzero_pd();
+	__m256d im = _mm256_setzero_pd();
+	size_t m = n - n % 4;
+	for (size_t i = 0; i < m; i += 4) {
+		__m256 u = _mm256_loadu_ps(px + 2 * i);
+		__m256 v = _mm256_loadu_ps(py + 2 * i);
+		__m256 w = SWAP_RE_IM(u);
+		__m256d u0 = _mm256_cvtps_pd(_mm256_castps256_ps128(u));
+		__m256d u1 = _mm256_cvtps_pd(_mm256_extractf128_ps(u, 1));
+		__m256d v0 = _mm256_cvtps_pd(_mm256_castps256_ps128(v));
+		__m256d v1 = _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1));
+		__m256d w0 = _mm256_cvtps_pd(_mm256_castps256_ps128(w));
+		__m256d w1 = _mm256_cvtps_pd(_mm256_extractf128_ps(w, 1));
+		// re += x.re y.re + x.im y.im
+		re = _mm256_fmadd_pd(u0, v0, re);
+		re = _mm256_fmadd_pd(u1, v1, re);
+		// im += (x.im y.re, x.re y.im), the second to be subtracted
+		im = _mm256_fmadd_pd(w0, v0, im);
+		im = _mm256_fmadd_pd(w1, v1, im);
+	}
+	im = _mm256_mul_pd(im, _mm256_setr_pd(1.0, -1.0, 1.0, -1.0));
+	complex_d z(hsum_avx2_(re), hsum_avx2_(im));
+	for (size_t i = m; i < n; i++)
+		z += std::conj(complex_d(y[i])) * complex_d(x[i]);
+	return z;
+}
+
+AVX2_TARGET static double
+norm2_avx2_(size_t n, const complex_t* x)
+{
+	const float* px = (const float*)x;
+	__m256d s0 = _mm256_setzero_pd();
+	__m256d s1 = _mm256_setzero_pd();
+	size_t m = n - n % 4;
+	for (size_t i = 0; i < m; i += 4) {
+		__m256 u = _mm256_loadu_ps(px + 2 * i);
+		__m256d u0 = _mm256_cvtps_pd(_mm256_castps256_ps128(u));
+		__m256d u1 = _mm256_cvtps_pd(_mm256_extractf128_ps(u, 1));
+		s0 = _mm256_fmadd_pd(u0, u0, s0);
+		s1 = _mm256_fmadd_pd(u1, u1, s1);
+	}
+	double s = hsum_avx2_(_mm256_add_pd(s0, s1));
+	for (size_t i = m; i < n; i++)
+		s += std::norm(complex_d(x[i]));
+	return s;
+}
+
+#endif
+
+bool
+xGadgetronKernels::vectorised()
+{
+#ifdef SIRF_AVX2_KERNELS
+	return have_avx2_();
+#else
+	return false;
+#endif
+}
+
+void
+xGadgetronKernels::axpby(size_t n, complex_t a, const complex_t* x,
+	complex_t b, const complex_t* y, complex_t* z)
+{
+#ifdef SIRF_AVX2_KERNELS
+	if (have_avx2_()) {
+		axpby_avx2_(n, a, x, b, y, z);
+		return;
+	}
+#endif
+	if (b == complex_t(0.0))
+		for (size_t i = 0; i < n; i++)
+			z[i] = a*x[i];
+	else
+		for (size_t i = 0; i < n; i++)
+			z[i] = a*x[i] + b*y[i];
+}
+
+void
+xGadgetronKernels::axpby(size_t n, complex_t a, const complex_t* x,
+	complex_t b, complex_t* y)
+{
+	axpby(n, a, x, b, y, y);
+}
+
+void
+xGadgetronKernels::multiply(size_t n, const complex_t* x, complex_t* y)
+{
+#ifdef SIRF_AVX2_KERNELS
+	if (have_avx2_()) {
+		multiply_avx2_(n, x, y);
+		return;
+	}
+#endif
+	for (size_t i = 0; i < n; i++)
+		y[i] = x[i] * y[i];
+}
+
+void
+xGadgetronKernels::divide(size_t n, const complex_t* x, complex_t* y)
+{
+	// complex division is kept scalar to preserve std::complex semantics:
+	// zero denominators are not checked on purpose, and give IEEE infinite
+	// or NaN elements (NaN for 0/0), as elementwise division of arrays does
+	for (size_t i = 0; i < n; i++)
+		y[i] = x[i] / y[i];
+}
+
+complex_d
+xGadgetronKernels::dot(size_t n, const complex_t* x, const complex_t* y)
+{
+#ifdef SIRF_AVX2_KERNELS
+	if (have_avx2_())
+		return dot_avx2_(n, x, y);
+#endif
+	double re = 0.0;
+	double im = 0.0;
+	for (size_t i = 0; i < n; i++) {
+		double xr = x[i].real();
+		double xi = x[i].imag();
+		double yr = y[i].real();
+		double yi = y[i].imag();
+		re += xr*yr + xi*yi;
+		im += xi*yr - xr*yi;
+	}
+	return complex_d(re, im);
+}
+
+double
+xGadgetronKernels::norm2(size_t n, const complex_t* x)
+{
+#ifdef SIRF_AVX2_KERNELS
+	if (have_avx2_())
+		return norm2_avx2_(n, x);
+#endif
+	double s = 0.0;
+	for (size_t i = 0; i < n; i++) {
+		double xr = x[i].real();
+		double xi = x[i].imag();
+		s += xr*xr + xi*xi;
+	}
+	return s;
+}
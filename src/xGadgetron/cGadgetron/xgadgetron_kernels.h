@@ -0,0 +1,67 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup xGadgetron Utilities
+\brief Vector kernels for interleaved complex float arrays.
+
+On x86-64 builds with GCC or Clang, AVX2 versions of the kernels are
+selected at run time if the CPU supports them; otherwise portable scalar
+loops are used. Reductions are accumulated in double precision.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#ifndef XGADGETRON_KERNELS
+#define XGADGETRON_KERNELS
+
+#include <complex>
+#include <cstddef>
+
+namespace sirf {
+
+	class xGadgetronKernels {
+	public:
+		typedef std::complex<float> complex_t;
+		typedef std::complex<double> complex_d;
+
+		// y := a x + b y
+		static void axpby(size_t n, complex_t a, const complex_t* x,
+			complex_t b, complex_t* y);
+		// z := a x + b y
+		static void axpby(size_t n, complex_t a, const complex_t* x,
+			complex_t b, const complex_t* y, complex_t* z);
+		// y := x .* y
+		static void multiply(size_t n, const complex_t* x, complex_t* y);
+		// y := x ./ y, zero y[i] giving infinite or NaN elements
+		static void divide(size_t n, const complex_t* x, complex_t* y);
+		// sum of conj(y[i]) * x[i]
+		static complex_d dot(size_t n, const complex_t* x, const complex_t* y);
+		// sum of |x[i]|^2
+		static double norm2(size_t n, const complex_t* x);
+		// true if AVX2 kernels are in use
+		static bool vectorised();
+	};
+
+}
+
+#endif
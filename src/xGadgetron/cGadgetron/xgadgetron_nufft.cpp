@@ -0,0 +1,305 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup xGadgetron Utilities
+\brief Implementation file for the gridding non-uniform FFT.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <ismrmrd/ismrmrd.h>
+
+#include "ismrmrd_fftw.h"
+#include "localised_exception.h"
+#include "xgadgetron_nufft.h"
+#include "SIRF/common/thread_pool.h"
+
+// samples or grid points per parallel task
+#define NUFFT_CHUNK 4096
+#define DCF_ITERATIONS 10
+
+using namespace sirf;
+
+static double
+bessel_i0_(double x)
+{
+	double t = 0.25*x*x;
+	double term = 1.0;
+	double sum = 1.0;
+	for (int k = 1; k < 100 && term > 1e-12*sum; k++) {
+		term *= t / ((double)k*k);
+		sum += term;
+	}
+	return sum;
+}
+
+/*
+Kaiser-Bessel kernel at distance d from its centre (in grid points),
+with Beatty's choice of the shape parameter for the kernel width and
+the grid oversampling.
+*/
+double
+NUFFTGrid::kernel_(double d)
+{
+	const double pi = std::acos(-1.0);
+	const double w = WIDTH;
+	const double a = w / OVERSAMPLING;
+	const double beta = pi*std::sqrt(a*a*(OVERSAMPLING - 0.5)*
+		(OVERSAMPLING - 0.5) - 0.8);
+	double u = 2 * d / w;
+	if (u*u >= 1.0)
+		return 0.0;
+	return bessel_i0_(beta*std::sqrt(1.0 - u*u)) / w;
+}
+
+void
+NUFFTGrid::set_up(unsigned int nx, unsigned int ny,
+	const std::vector<float>& kx, const std::vector<float>& ky)
+{
+	if (kx.size() != ky.size())
+		throw LocalisedException
+		("numbers of k-space coordinates differ", __FILE__, __LINE__);
+	nx_ = nx;
+	ny_ = ny;
+	gx_ = OVERSAMPLING*nx;
+	gy_ = OVERSAMPLING*ny;
+	dcf_.clear();
+	size_t ns = kx.size();
+	const int nw = WIDTH*WIDTH;
+	index_.resize(ns*nw);
+	weight_.resize(ns*nw);
+	for (size_t s = 0; s < ns; s++) {
+		// grid coordinates, k = 0 being at the grid centre
+		double x = kx[s] * gx_ + gx_ / 2;
+		double y = ky[s] * gy_ + gy_ / 2;
+		int ix = (int)std::floor(x - 0.5*WIDTH) + 1;
+		int iy = (int)std::floor(y - 0.5*WIDTH) + 1;
+		double wx[WIDTH];
+		double wy[WIDTH];
+		unsigned int jx[WIDTH];
+		unsigned int jy[WIDTH];
+		for (int t = 0; t < WIDTH; t++) {
+			wx[t] = kernel_(ix + t - x);
+			wy[t] = kernel_(iy + t - y);
+			// k-space is periodic on the grid
+			jx[t] = (unsigned int)(((ix + t) % (int)gx_ + gx_) % gx_);
+			jy[t] = (unsigned int)(((iy + t) % (int)gy_ + gy_) % gy_);
+		}
+		unsigned int* ind = &index_[s*nw];
+		float* w = &weight_[s*nw];
+		for (int ty = 0; ty < WIDTH; ty++)
+			for (int tx = 0; tx < WIDTH; tx++, ind++, w++) {
+				*ind = jy[ty] * gx_ + jx[tx];
+				*w = (float)(wx[tx] * wy[ty]);
+			}
+	}
+
+	// transposed matrix by counting sort of the entries by grid point
+	size_t ng = (size_t)gx_*gy_;
+	start_.assign(ng + 1, 0);
+	for (size_t i = 0; i < index_.size(); i++)
+		start_[index_[i] + 1]++;
+	for (size_t g = 0; g < ng; g++)
+		start_[g + 1] += start_[g];
+	sample_.resize(index_.size());
+	tweight_.resize(index_.size());
+	std::vector<unsigned int> next(start_.begin(), start_.end() - 1);
+	for (size_t i = 0; i < index_.size(); i++) {
+		unsigned int k = next[index_[i]]++;
+		sample_[k] = (unsigned int)(i / nw);
+		tweight_[k] = weight_[i];
+	}
+
+	compute_deapodization_();
+}
+
+/*
+Fourier transform of the kernel at the offset x (in pixels) from the centre
+of an image padded to g pixels, by Simpson's rule.
+*/
+static double
+kernel_transform_(double (*kernel)(double), double width, double x, double g)
+{
+	const double pi = std::acos(-1.0);
+	const int n = 512;
+	double h = width / n;
+	double sum = 0;
+	for (int i = 0; i <= n; i++) {
+		double u = -0.5*width + i*h;
+		double f = kernel(u)*std::cos(2 * pi*u*x / g);
+		sum += (i == 0 || i == n ? 1 : (i % 2 ? 4 : 2))*f;
+	}
+	return sum*h / 3;
+}
+
+void
+NUFFTGrid::compute_deapodization_()
+{
+	unsigned int ox = (gx_ - nx_) / 2;
+	unsigned int oy = (gy_ - ny_) / 2;
+	std::vector<double> ax(nx_);
+	std::vector<double> ay(ny_);
+	for (unsigned int x = 0; x < nx_; x++)
+		ax[x] = kernel_transform_(kernel_, WIDTH,
+			(double)(x + ox) - gx_ / 2, gx_);
+	for (unsigned int y = 0; y < ny_; y++)
+		ay[y] = kernel_transform_(kernel_, WIDTH,
+			(double)(y + oy) - gy_ / 2, gy_);
+	// the centred FFT of the grid is scaled by 1/sqrt(gx*gy)
+	double scale = std::sqrt((double)gx_*gy_);
+	deapod_.resize((size_t)nx_*ny_);
+	for (unsigned int y = 0; y < ny_; y++)
+		for (unsigned int x = 0; x < nx_; x++)
+			deapod_[(size_t)y*nx_ + x] = (float)(scale / (ax[x] * ay[y]));
+}
+
+void
+NUFFTGrid::forward(const complex_t* img, complex_t* data, int nc,
+	int nthreads) const
+{
+	size_t ng = (size_t)gx_*gy_;
+	size_t ns = samples();
+	unsigned int ox = (gx_ - nx_) / 2;
+	unsigned int oy = (gy_ - ny_) / 2;
+	std::vector<complex_t> g(ng*nc);
+	for (int c = 0; c < nc; c++)
+		for (unsigned int y = 0; y < ny_; y++) {
+			const complex_t* src = img + ((size_t)c*ny_ + y)*nx_;
+			const float* d = &deapod_[(size_t)y*nx_];
+			complex_t* dst = &g[c*ng + (size_t)(y + oy)*gx_ + ox];
+			for (unsigned int x = 0; x < nx_; x++)
+				dst[x] = src[x] * d[x];
+		}
+	ISMRMRD::fft2c(&g[0], gx_, gy_, nc, nthreads);
+	const int nw = WIDTH*WIDTH;
+	int nchunks = (int)((ns + NUFFT_CHUNK - 1) / NUFFT_CHUNK);
+	parallel_for(nchunks, nthreads, [&](int chunk) {
+		size_t first = (size_t)chunk*NUFFT_CHUNK;
+		size_t last = std::min(first + NUFFT_CHUNK, ns);
+		for (int c = 0; c < nc; c++) {
+			const complex_t* gc = &g[c*ng];
+			for (size_t s = first; s < last; s++) {
+				const unsigned int* ind = &index_[s*nw];
+				const float* w = &weight_[s*nw];
+				complex_t z = 0;
+				for (int i = 0; i < nw; i++)
+					z += w[i] * gc[ind[i]];
+				data[c*ns + s] = z;
+			}
+		}
+	});
+}
+
+void
+NUFFTGrid::adjoint(const complex_t* data, complex_t* img, int nc,
+	int nthreads) const
+{
+	size_t ng = (size_t)gx_*gy_;
+	size_t ns = samples();
+	std::vector<complex_t> g(ng*nc);
+	int nchunks = (int)((ng + NUFFT_CHUNK - 1) / NUFFT_CHUNK);
+	parallel_for(nchunks, nthreads, [&](int chunk) {
+		size_t first = (size_t)chunk*NUFFT_CHUNK;
+		size_t last = std::min(first + NUFFT_CHUNK, ng);
+		for (int c = 0; c < nc; c++) {
+			const complex_t* dc = data + c*ns;
+			complex_t* gc = &g[c*ng];
+			for (size_t p = first; p < last; p++) {
+				complex_t z = 0;
+				for (unsigned int k = start_[p]; k < start_[p + 1]; k++)
+					z += tweight_[k] * dc[sample_[k]];
+				gc[p] = z;
+			}
+		}
+	});
+	ISMRMRD::ifft2c(&g[0], gx_, gy_, nc, nthreads);
+	unsigned int ox = (gx_ - nx_) / 2;
+	unsigned int oy = (gy_ - ny_) / 2;
+	for (int c = 0; c < nc; c++)
+		for (unsigned int y = 0; y < ny_; y++) {
+			const complex_t* src = &g[c*ng + (size_t)(y + oy)*gx_ + ox];
+			const float* d = &deapod_[(size_t)y*nx_];
+			complex_t* dst = img + ((size_t)c*ny_ + y)*nx_;
+			for (unsigned int x = 0; x < nx_; x++)
+				dst[x] = src[x] * d[x];
+		}
+}
+
+const std::vector<float>&
+NUFFTGrid::density_compensation(int nthreads)
+{
+	if (!dcf_.empty() || !ready())
+		return dcf_;
+	size_t ng = (size_t)gx_*gy_;
+	size_t ns = samples();
+	const int nw = WIDTH*WIDTH;
+	std::vector<float> w(ns, 1.0f);
+	std::vector<float> g(ng);
+	int ngchunks = (int)((ng + NUFFT_CHUNK - 1) / NUFFT_CHUNK);
+	int nschunks = (int)((ns + NUFFT_CHUNK - 1) / NUFFT_CHUNK);
+	for (int it = 0; it < DCF_ITERATIONS; it++) {
+		parallel_for(ngchunks, nthreads, [&](int chunk) {
+			size_t first = (size_t)chunk*NUFFT_CHUNK;
+			size_t last = std::min(first + NUFFT_CHUNK, ng);
+			for (size_t p = first; p < last; p++) {
+				float v = 0;
+				for (unsigned int k = start_[p]; k < start_[p + 1]; k++)
+					v += tweight_[k] * w[sample_[k]];
+				g[p] = v;
+			}
+		});
+		parallel_for(nschunks, nthreads, [&](int chunk) {
+			size_t first = (size_t)chunk*NUFFT_CHUNK;
+			size_t last = std::min(first + NUFFT_CHUNK, ns);
+			for (size_t s = first; s < last; s++) {
+				const unsigned int* ind = &index_[s*nw];
+				const float* ws = &weight_[s*nw];
+				float v = 0;
+				for (int i = 0; i < nw; i++)
+					v += ws[i] * g[ind[i]];
+				if (v > 0)
+					w[s] /= v;
+			}
+		});
+	}
+	// the weights are scaled so that the adjoint of the compensated
+	// forward projection of a point at the image centre restores it
+	std::vector<complex_t> img((size_t)nx_*ny_);
+	std::vector<complex_t> data(ns);
+	size_t centre = (size_t)(ny_ / 2)*nx_ + nx_ / 2;
+	img[centre] = 1;
+	forward(&img[0], &data[0], 1, nthreads);
+	for (size_t s = 0; s < ns; s++)
+		data[s] *= w[s];
+	adjoint(&data[0], &img[0], 1, nthreads);
+	float c = std::real(img[centre]);
+	if (c > 0)
+		for (size_t s = 0; s < ns; s++)
+			w[s] /= c;
+	dcf_.swap(w);
+	return dcf_;
+}
@@ -0,0 +1,106 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup xGadgetron Utilities
+\brief Gridding non-uniform FFT of 2D images for non-Cartesian readouts.
+
+Images are zero-padded onto a twice oversampled grid and transformed by
+the centred FFT; k-space samples are interpolated from the grid with a
+Kaiser-Bessel kernel 4 grid points wide, whose apodization is divided out
+in image space. The interpolation weights are computed once by set_up and
+kept as a sparse matrix together with its transpose, so that both the
+forward and the adjoint interpolation are run on several threads without
+write conflicts.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#ifndef XGADGETRON_NUFFT
+#define XGADGETRON_NUFFT
+
+#include <complex>
+#include <vector>
+
+namespace sirf {
+
+	class NUFFTGrid {
+	public:
+		typedef std::complex<float> complex_t;
+
+		NUFFTGrid() : nx_(0), ny_(0), gx_(0), gy_(0) {}
+		/*
+		Computes the interpolation matrix for nx by ny images and the
+		samples with k-space coordinates (kx[i], ky[i]) in cycles per pixel,
+		the sampled k-space being [-0.5, 0.5) x [-0.5, 0.5) (the convention
+		of Gadgetron non-Cartesian gadgets).
+		*/
+		void set_up(unsigned int nx, unsigned int ny,
+			const std::vector<float>& kx, const std::vector<float>& ky);
+		bool ready() const
+		{
+			return nx_ > 0;
+		}
+		unsigned int samples() const
+		{
+			return (unsigned int)(index_.size() / (WIDTH*WIDTH));
+		}
+		/*
+		Computes the samples of nc images img (nx by ny each, x running
+		fastest) into data (samples() values per image).
+		*/
+		void forward(const complex_t* img, complex_t* data, int nc,
+			int nthreads = 1) const;
+		// adjoint of forward
+		void adjoint(const complex_t* data, complex_t* img, int nc,
+			int nthreads = 1) const;
+		/*
+		Density compensation weights of the samples: Pipe and Menon's
+		iterations w := w / (G G' w) with the interpolation matrix G, computed
+		on the first call and kept.
+		*/
+		const std::vector<float>& density_compensation(int nthreads = 1);
+
+	private:
+		enum { WIDTH = 4, OVERSAMPLING = 2 };
+		unsigned int nx_;
+		unsigned int ny_;
+		unsigned int gx_;
+		unsigned int gy_;
+		// grid points and weights, WIDTH*WIDTH per sample
+		std::vector<unsigned int> index_;
+		std::vector<float> weight_;
+		// the transposed matrix: samples and weights per grid point
+		std::vector<unsigned int> start_;
+		std::vector<unsigned int> sample_;
+		std::vector<float> tweight_;
+		// reciprocal of the kernel apodization, nx*ny values
+		std::vector<float> deapod_;
+		std::vector<float> dcf_;
+
+		static double kernel_(double d);
+		void compute_deapodization_();
+	};
+
+}
+
+#endif
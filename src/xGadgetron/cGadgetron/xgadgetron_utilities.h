@@ -36,6 +36,7 @@ limitations under the License.
 #include <boost/thread/mutex.hpp>
 
 #include "cgadgetron_shared_ptr.h"
+#include "SIRF/common/storage_budget.h"
 
 namespace sirf {
 
@@ -55,7 +56,7 @@ namespace sirf {
 			long long int ms = xGadgetronUtilities::milliseconds();
 			calls++;
 			sprintf(buff, "tmp_%d_%lld.h5", calls, ms);
-			return std::string(buff);
+			return StorageBudget::scratch_path(std::string(buff));
 		}
 		template<typename T>
 		static void convert_complex(std::complex<T> z, unsigned short& t)
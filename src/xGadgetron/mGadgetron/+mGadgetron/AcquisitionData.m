@@ -41,6 +41,13 @@ classdef AcquisitionData < mGadgetron.DataContainer
 %           scheme = 'memory':
 %               all acquisition data generated from now on will be kept in
 %               RAM (avoid if data is very large)
+%           scheme = 'block':
+%               as 'memory', but all acquisition samples are kept in one
+%               contiguous array (faster algebra on large data)
+%           scheme = 'hybrid':
+%               as 'block', within the memory budget set by
+%               mGadgetron.set_storage_budget, the least recently used data
+%               being moved to scratch files beyond it
             h = calllib...
                 ('mgadgetron', 'mGT_setAcquisitionsStorageScheme', scheme);
             mUtilities.check_status('AcquisitionData', h);
@@ -54,6 +61,17 @@ classdef AcquisitionData < mGadgetron.DataContainer
             scheme = calllib('miutilities', 'mCharDataFromHandle', h);
             mUtilities.delete(h)
         end
+        function set_cache_size(megabytes)
+%***SIRF*** Sets the size of the in-memory cache of file-stored acquisition
+%           data generated from now on (0, the default, disables caching).
+%           With a non-zero size, recently read acquisitions are kept in
+%           memory up to that many megabytes per AcquisitionData object,
+%           and appended acquisitions are written to the file in batches.
+            h = calllib...
+                ('mgadgetron', 'mGT_setAcquisitionsCacheSize', megabytes);
+            mUtilities.check_status('AcquisitionData', h);
+            mUtilities.delete(h)
+        end
     end
     methods
         function self = AcquisitionData(filename)
@@ -90,11 +108,49 @@ classdef AcquisitionData < mGadgetron.DataContainer
             mUtilities.delete(handle)
             self.sorted_ = true;
         end
+        function compact(self)
+%***SIRF*** Rearranges the stored acquisitions in the sorted order, so that
+%         subsequent scans through them are sequential.
+            if isempty(self.handle_)
+                error('AcquisitionData:empty_object', ...
+                    'cannot handle empty object')
+            end
+            handle = calllib('mgadgetron', 'mGT_compactAcquisitions', ...
+                self.handle_);
+            mUtilities.check_status('AcquisitionData', handle);
+            mUtilities.delete(handle)
+        end
         function sorted = is_sorted(self)
 %***SIRF*** Returns true if acquisitions of this object are sorted
 %         and false otherwise.
             sorted = self.sorted_;
         end
+        function set_read_only(self, flag)
+%***SIRF*** set_read_only(flag) makes file-stored acquisitions read-only
+%         (flag = true) or writable (flag = false). Appending to read-only
+%         acquisitions is not allowed, but they can be read by several
+%         threads in parallel more efficiently. Acquisitions stored in
+%         memory are not affected.
+            if isempty(self.handle_)
+                error('AcquisitionData:empty_object', ...
+                    'cannot handle empty object')
+            end
+            hv = calllib('miutilities', 'mIntDataHandle', int32(flag));
+            handle = calllib('mgadgetron', 'mGT_setParameter', ...
+                self.handle_, 'acquisitions', 'read_only', hv);
+            mUtilities.check_status('AcquisitionData', handle);
+            mUtilities.delete(handle)
+            mUtilities.delete(hv)
+        end
+        function [hits, misses] = cache_statistics(self)
+%***SIRF*** [hits, misses] = cache_statistics() returns the numbers of cache
+%         hits and misses of this object if it is file-stored, zeros
+%         otherwise.
+            hits = mGadgetron.parameter(self.handle_, ...
+                'acquisitions', 'cache_hits', 'i');
+            misses = mGadgetron.parameter(self.handle_, ...
+                'acquisitions', 'cache_misses', 'i');
+        end
         function a = process(self, list)
 %***SIRF*** Returns acquisitions processed by a chain of gadgets.
 %         The argument is a cell array of gadget definitions
@@ -168,6 +224,12 @@ classdef AcquisitionData < mGadgetron.DataContainer
             else
                 n = na + 1;
             end
+            if mUtilities.mex_available('mgadgetron_mex')
+                data = mgadgetron_mex('getAcquisitionsData', ...
+                    mUtilities.handle_address(self.handle_), n, ...
+                    [ns nc ma]);
+                return
+            end
             m = ns*nc*ma;
             ptr_re = libpointer('singlePtr', zeros(m, 1));
             ptr_im = libpointer('singlePtr', zeros(m, 1));
@@ -184,6 +246,11 @@ classdef AcquisitionData < mGadgetron.DataContainer
                 error('AcquisitionData:empty_object', ...
                     'cannot handle empty object')
             end
+            if mUtilities.mex_available('mgadgetron_mex')
+                mgadgetron_mex('setAcquisitionsData', ...
+                    mUtilities.handle_address(self.handle_), single(data));
+                return
+            end
             [ns, nc, na] = size(data);
             re = real(data);
             im = imag(data);
@@ -24,6 +24,22 @@ classdef AcquisitionModel < handle
         handle_
         name_
     end
+    methods (Static)
+        function set_fft_planning(mode, wisdom)
+%***SIRF*** Sets FFTW planning mode used by forward and backward projections.
+%           mode = 'estimate' (default): plans are created without measurements
+%           mode = 'measure' or 'patient': plans are optimised by running
+%               test transforms; plans are cached and reused
+%           wisdom: optional name of a file to load FFTW wisdom from and
+%               save it to
+            if nargin < 2
+                wisdom = '';
+            end
+            h = calllib('mgadgetron', 'mGT_setFFTPlanning', mode, wisdom);
+            mUtilities.check_status('AcquisitionModel', h);
+            mUtilities.delete(h)
+        end
+    end
     methods
         function self = AcquisitionModel(acq_template, img_template)
  %        AcquisitionModel(acq_templ, img_templ) creates an MR acquisition model 
@@ -53,6 +69,51 @@ classdef AcquisitionModel < handle
             mUtilities.delete(handle)
             %calllib('mutilities', 'mDeleteDataHandle', handle)
         end
+        function set_fft_threads(self, nthreads)
+%***SIRF*** Sets the number of threads used by FFTW to transform all coil
+%         images of an image item in one batched FFT, and by the gridding
+%         of non-Cartesian readouts.
+            hv = calllib('miutilities', 'mIntDataHandle', nthreads);
+            handle = calllib('mgadgetron', 'mGT_setAcquisitionModelParameter', ...
+                self.handle_, 'fft_threads', hv);
+            mUtilities.check_status(self.name_, handle);
+            mUtilities.delete(handle)
+            mUtilities.delete(hv)
+        end
+        function set_num_threads(self, nthreads)
+%***SIRF*** Sets the number of threads projecting image slices concurrently
+%         in forward and backward; the result does not depend on it.
+            hv = calllib('miutilities', 'mIntDataHandle', nthreads);
+            handle = calllib('mgadgetron', 'mGT_setAcquisitionModelParameter', ...
+                self.handle_, 'num_threads', hv);
+            mUtilities.check_status(self.name_, handle);
+            mUtilities.delete(handle)
+            mUtilities.delete(hv)
+        end
+        function set_resident(self, flag)
+%***SIRF*** set_resident(flag) with flag true keeps coil sensitivity maps
+%         as contiguous arrays between forward and backward calls, which
+%         speeds up the repeated projections of iterative reconstructions;
+%         the maps must not be modified while this is on (default false).
+            hv = calllib('miutilities', 'mIntDataHandle', int32(flag));
+            handle = calllib('mgadgetron', 'mGT_setAcquisitionModelParameter', ...
+                self.handle_, 'resident', hv);
+            mUtilities.check_status(self.name_, handle);
+            mUtilities.delete(handle)
+            mUtilities.delete(hv)
+        end
+        function set_density_compensation(self, flag)
+%***SIRF*** set_density_compensation(flag) with flag true makes non-Cartesian
+%         (radial, spiral) readouts weighted by density compensation factors
+%         before backprojection, which then performs gridding reconstruction
+%         instead of being the exact adjoint of forward (default false).
+            hv = calllib('miutilities', 'mIntDataHandle', int32(flag));
+            handle = calllib('mgadgetron', 'mGT_setAcquisitionModelParameter', ...
+                self.handle_, 'density_compensation', hv);
+            mUtilities.check_status(self.name_, handle);
+            mUtilities.delete(handle)
+            mUtilities.delete(hv)
+        end
         function acqs = forward(self, image)
 %***SIRF*** Returns the forward projection of the specified ImageData argument
 %         simulating the actual data expected to be received from the scanner.
@@ -0,0 +1,32 @@
+classdef CGLS < mGadgetron.Solver
+% Class for the conjugate gradient solver of the least squares problem
+% min |A x - b|, A being an acquisition model and b acquisition data.
+
+% CCP PETMR Synergistic Image Reconstruction Framework (SIRF).
+% Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC.
+% 
+% This is software developed for the Collaborative Computational
+% Project in Positron Emission Tomography and Magnetic Resonance imaging
+% (http://www.ccppetmr.ac.uk/).
+% 
+% Licensed under the Apache License, Version 2.0 (the "License");
+% you may not use this file except in compliance with the License.
+% You may obtain a copy of the License at
+% http://www.apache.org/licenses/LICENSE-2.0
+% Unless required by applicable law or agreed to in writing, software
+% distributed under the License is distributed on an "AS IS" BASIS,
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+% See the License for the specific language governing permissions and
+% limitations under the License.
+
+    methods
+        function self = CGLS()
+            self@mGadgetron.Solver('CGLS');
+        end
+        function r = get_residual_norm(self)
+%***SIRF*** Returns |b - A x| at the current estimate.
+            r = mGadgetron.parameter(self.handle_, ...
+                'solver', 'residual_norm', 'f');
+        end
+    end
+end
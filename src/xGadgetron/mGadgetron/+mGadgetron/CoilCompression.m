@@ -0,0 +1,105 @@
+classdef CoilCompression < handle
+% Class for PCA coil compression.
+% Combines the coils of acquisition data and of coil sensitivity maps
+% into fewer virtual coils, reducing the cost of every further
+% processing stage.
+
+% CCP PETMR Synergistic Image Reconstruction Framework (SIRF).
+% Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC.
+% 
+% This is software developed for the Collaborative Computational
+% Project in Positron Emission Tomography and Magnetic Resonance imaging
+% (http://www.ccppetmr.ac.uk/).
+% 
+% Licensed under the Apache License, Version 2.0 (the "License");
+% you may not use this file except in compliance with the License.
+% You may obtain a copy of the License at
+% http://www.apache.org/licenses/LICENSE-2.0
+% Unless required by applicable law or agreed to in writing, software
+% distributed under the License is distributed on an "AS IS" BASIS,
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+% See the License for the specific language governing permissions and
+% limitations under the License.
+
+    properties
+        handle_
+        name_
+    end
+    methods
+        function self = CoilCompression(num_vcoils, energy)
+%         CoilCompression(num_vcoils, energy) creates a coil compression
+%         object producing num_vcoils virtual coils; if num_vcoils is 0
+%         (default), the smallest number retaining the fraction energy
+%         (default 0.99) of the calibration data energy is used.
+            self.name_ = 'CoilCompression';
+            self.handle_ = calllib('mgadgetron', 'mGT_newObject', ...
+                'CoilCompression');
+            mUtilities.check_status(self.name_, self.handle_);
+            if nargin > 1
+                self.set_energy_threshold(energy)
+            end
+            if nargin > 0
+                self.set_num_virtual_coils(num_vcoils)
+            end
+        end
+        function delete(self)
+            if ~isempty(self.handle_)
+                mUtilities.delete(self.handle_)
+            end
+            self.handle_ = [];
+        end
+        function set_num_virtual_coils(self, n)
+%***SIRF*** Sets the number of virtual coils (0: use energy threshold).
+            hv = calllib('miutilities', 'mIntDataHandle', int32(n));
+            handle = calllib('mgadgetron', 'mGT_setParameter', ...
+                self.handle_, 'coil_compression', 'num_virtual_coils', hv);
+            mUtilities.check_status(self.name_, handle);
+            mUtilities.delete(handle)
+            mUtilities.delete(hv)
+        end
+        function set_energy_threshold(self, e)
+%***SIRF*** Sets the fraction of the calibration data energy to retain.
+            hv = calllib('miutilities', 'mFloatDataHandle', single(e));
+            handle = calllib('mgadgetron', 'mGT_setParameter', ...
+                self.handle_, 'coil_compression', 'energy_threshold', hv);
+            mUtilities.check_status(self.name_, handle);
+            mUtilities.delete(handle)
+            mUtilities.delete(hv)
+        end
+        function n = num_coils(self)
+            n = mGadgetron.parameter(self.handle_, ...
+                'coil_compression', 'num_coils', 'i');
+        end
+        function n = num_virtual_coils(self)
+            n = mGadgetron.parameter(self.handle_, ...
+                'coil_compression', 'num_virtual_coils', 'i');
+        end
+        function calculate(self, acqs)
+%***SIRF*** Computes the compression matrix from the parallel calibration
+%         readouts of AcquisitionData acqs, or from all its imaging readouts
+%         if there are none.
+            mUtilities.assert_validity(acqs, 'AcquisitionData')
+            handle = calllib('mgadgetron', 'mGT_computeCoilCompression', ...
+                self.handle_, acqs.handle_);
+            mUtilities.check_status(self.name_, handle);
+            mUtilities.delete(handle)
+        end
+        function out = compress(self, data)
+%***SIRF*** Returns the compressed copy of AcquisitionData or
+%         CoilSensitivityData argument.
+            if isa(data, 'mGadgetron.AcquisitionData')
+                out = mGadgetron.AcquisitionData();
+                out.handle_ = calllib('mgadgetron', ...
+                    'mGT_compressAcquisitions', self.handle_, data.handle_);
+            elseif isa(data, 'mGadgetron.CoilSensitivityData')
+                out = mGadgetron.CoilSensitivityData();
+                out.handle_ = calllib('mgadgetron', ...
+                    'mGT_compressCoilSensitivities', self.handle_, data.handle_);
+            else
+                error('CoilCompression:wrong_type', ...
+                    'Cannot compress objects of class %s', class(data))
+            end
+            mUtilities.check_status(self.name_, out.handle_);
+        end
+    end
+end
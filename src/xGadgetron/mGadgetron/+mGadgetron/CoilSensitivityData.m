@@ -22,6 +22,7 @@ classdef CoilSensitivityData < mGadgetron.DataContainer
 
     properties
         name_
+        num_threads_
     end
     methods (Static)
         function name = class_name()
@@ -36,6 +37,13 @@ classdef CoilSensitivityData < mGadgetron.DataContainer
 %         Creates an empty object.
             self.name_ = 'CoilSensitivityData';
             self.handle_ = [];
+            self.num_threads_ = 0;
+        end
+        function set_num_threads(self, n)
+%***SIRF*** Sets the number of threads computing the maps: slices, and
+%         coils of each slice, are processed concurrently;
+%         0 (default) uses all threads of the SIRF thread pool.
+            self.num_threads_ = n;
         end
         function delete(self)
             if ~isempty(self.handle_)
@@ -57,6 +65,13 @@ classdef CoilSensitivityData < mGadgetron.DataContainer
             end
             self.handle_ = calllib('mgadgetron', 'mGT_CoilSensitivities', '');
             mUtilities.check_status(self.name_, self.handle_);
+            hv = calllib('miutilities', 'mIntDataHandle', ...
+                int32(self.num_threads_));
+            handle = calllib('mgadgetron', 'mGT_setParameter', ...
+                self.handle_, 'coil_sensitivity', 'num_threads', hv);
+            mUtilities.check_status(self.name_, handle);
+            mUtilities.delete(handle)
+            mUtilities.delete(hv)
             handle = calllib('mgadgetron', 'mGT_computeCoilSensitivities', ...
                 self.handle_, acqs.handle_);
             mUtilities.check_status(self.name_, handle);
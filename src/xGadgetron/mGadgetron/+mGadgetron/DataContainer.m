@@ -132,6 +132,46 @@ classdef DataContainer < handle
             end
             mUtilities.check_status('DataContainer:mtimes', z.handle_);
         end
+        function [z, r] = axpby_norm(self, a, b, y)
+%***SIRF*** [z, r] = axpby_norm(a, b, y) returns z = a*self + b*y and
+%         the 2-norm r of z, computing both in one pass over the data;
+%         a and b: complex scalars
+%         y: DataContainer
+            mUtilities.assert_validities(self, y)
+            ptr_r = libpointer('singlePtr', 0);
+            z = self.same_object();
+            z.handle_ = calllib('mgadgetron', 'mGT_axpbyAndNorm', ...
+                real(a), imag(a), self.handle_, real(b), imag(b), ...
+                y.handle_, ptr_r);
+            mUtilities.check_status('DataContainer:axpby_norm', z.handle_);
+            r = ptr_r.Value;
+        end
+        function [z, r] = axpby_dot(self, a, b, y, other)
+%***SIRF*** [z, r] = axpby_dot(a, b, y, other) returns z = a*self + b*y
+%         and the dot product r of z with other, computing both in one pass
+%         over the data;
+%         a and b: complex scalars
+%         y and other: DataContainers
+            mUtilities.assert_validities(self, y)
+            mUtilities.assert_validities(self, other)
+            ptr_r = libpointer('singlePtr', zeros(2, 1));
+            z = self.same_object();
+            z.handle_ = calllib('mgadgetron', 'mGT_axpbyAndDot', ...
+                real(a), imag(a), self.handle_, real(b), imag(b), ...
+                y.handle_, other.handle_, ptr_r);
+            mUtilities.check_status('DataContainer:axpby_dot', z.handle_);
+            r = complex(ptr_r.Value(1), ptr_r.Value(2));
+        end
+        function xapy(self, a, x)
+%***SIRF*** xapy(a, x) adds a*x to this data container in place;
+%         a: complex scalar
+%         x: DataContainer
+            mUtilities.assert_validities(self, x)
+            h = calllib('mgadgetron', 'mGT_xapy', ...
+                self.handle_, real(a), imag(a), x.handle_);
+            mUtilities.check_status('DataContainer:xapy', h);
+            mUtilities.delete(h)
+        end
     end
     methods(Static)
         function z = axpby(a, x, b, y)
@@ -146,5 +186,23 @@ classdef DataContainer < handle
                 real(a), imag(a), x.handle_, real(b), imag(b), y.handle_);
             mUtilities.check_status('DataContainer:axpby', z.handle_);
         end
+        function z = linear_combination(a, x)
+%***SIRF*** linear_combination(a, x) returns a(1)*x{1} + ... + a(n)*x{n};
+%         a: array of n complex scalars
+%         x: cell array of n DataContainers of the same type
+            n = numel(x);
+            if n < 1 || numel(a) ~= n
+                error('DataContainer:linear_combination', ...
+                    'Wrong linear combination arguments');
+            end
+            if n < 2
+                z = mGadgetron.DataContainer.axpby(a(1), x{1}, 0, x{1});
+            else
+                z = mGadgetron.DataContainer.axpby(a(1), x{1}, a(2), x{2});
+            end
+            for i = 3 : n
+                z.xapy(a(i), x{i})
+            end
+        end
     end
 end
\ No newline at end of file
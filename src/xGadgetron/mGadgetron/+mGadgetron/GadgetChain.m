@@ -65,6 +65,20 @@ classdef GadgetChain < handle
             mUtilities.check_status(self.name_, handle);
             mUtilities.delete(handle)
         end
+        function add_server(self, host, port)
+%***SIRF*** add_server(host, port) adds a Gadgetron server to be used instead
+%         of the default one (localhost:9002); Reconstructor distributes 
+%         the slices and repetitions of its input between all added servers.
+%         host: server host name (Matlab string)
+%         port: server port (Matlab string or number)
+            if ~ischar(port)
+                port = num2str(port);
+            end
+            handle = calllib...
+                ('mgadgetron', 'mGT_addServer', self.handle_, host, port);
+            mUtilities.check_status(self.name_, handle);
+            mUtilities.delete(handle)
+        end
         function set_gadget_property(self, id, property, value)
 %***SIRF*** set_gadget_property(id, prop, val) assigns value to gadget property.
 %         id   : gadget id
@@ -105,5 +119,46 @@ classdef GadgetChain < handle
             mUtilities.delete(hg)
             mUtilities.delete(hv)
         end
+        function set_prefetch_depth(self, depth)
+%***SIRF*** set_prefetch_depth(depth) sets the number of acquisitions read
+%         ahead by a separate thread while acquisitions are sent to 
+%         Gadgetron server (default 64); 0 makes reading and sending alternate.
+            self.set_connection_parameter('prefetch_depth', depth)
+        end
+        function set_local_processing(self, flag)
+%***SIRF*** set_local_processing(flag) with flag true (default false) makes
+%         processor chains of gadgets that can be run in-process
+%         (RemoveROOversampling for acquisitions, Extract, ComplexToFloat
+%         and FloatToShort for images) run by SIRF itself, on several items
+%         at once, instead of by Gadgetron server; other chains are always
+%         run by the server.
+            hv = calllib('miutilities', 'mIntDataHandle', int32(flag));
+            handle = calllib('mgadgetron', 'mGT_setParameter', ...
+                self.handle_, 'gadget_chain', 'local_processing', hv);
+            mUtilities.check_status(self.name_, handle);
+            mUtilities.delete(handle)
+            mUtilities.delete(hv)
+        end
+        function set_connection_parameter(self, par, value)
+%***SIRF*** set_connection_parameter(par, value) sets an integer parameter
+%         of the connection to Gadgetron server:
+%         send_buffer_size          : bytes accumulated before a socket write
+%                                     (0 makes one write per message)
+%         tcp_nodelay               : 1 (default) disables Nagle's algorithm
+%         socket_send_buffer_size   : SO_SNDBUF in bytes (0: system default)
+%         socket_receive_buffer_size: SO_RCVBUF in bytes (0: system default)
+%         warm_sessions             : 1 makes the next session with the same
+%                                     server and chain prepared in background
+%         deferred_probing          : 1 makes a background check that the
+%                                     server is still alive after each session,
+%                                     so that the next one fails at once if not
+%                                     (default 0)
+            hv = calllib('miutilities', 'mIntDataHandle', value);
+            handle = calllib('mgadgetron', 'mGT_setParameter', ...
+                self.handle_, 'gadget_chain', par, hv);
+            mUtilities.check_status(self.name_, handle);
+            mUtilities.delete(handle)
+            mUtilities.delete(hv)
+        end
     end
 end
\ No newline at end of file
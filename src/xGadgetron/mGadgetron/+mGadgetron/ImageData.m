@@ -100,6 +100,16 @@ classdef ImageData < mGadgetron.DataContainer
             ip = mGadgetron.ImageDataProcessor();
             image = ip.process(self);
         end
+        function images = as_volume(self)
+%***SIRF*** Returns a copy of self with all images stored in one contiguous
+%         complex float array; algebraic operations on such copies (and on
+%         the images computed from them by AcquisitionModel.backward) work
+%         on the whole array at once.
+            images = mGadgetron.ImageData();
+            images.handle_ = calllib('mgadgetron', 'mGT_imagesVolume', ...
+                self.handle_);
+            mUtilities.check_status('ImageData', images.handle_);
+        end
         function ft = is_real(self)
 %***SIRF*** Returns true if this image data is real and false otherwise.
             handle = calllib('mgadgetron', 'mGT_imageDataType', ...
@@ -115,6 +125,11 @@ classdef ImageData < mGadgetron.DataContainer
 %***SIRF*** Returns 3D complex array representing this image data.
 %         First two dimensions are x and y, the third is a product of all
 %         other dimensions (z/slice/repetition etc.).
+            if mUtilities.mex_available('mgadgetron_mex')
+                data = mgadgetron_mex('getImagesData', ...
+                    mUtilities.handle_address(self.handle_));
+                return
+            end
             ptr_i = libpointer('int32Ptr', zeros(4, 1));
             if self.number() > 0
                 calllib('mgadgetron', 'mGT_getImageDimensions', ...
@@ -147,6 +162,11 @@ classdef ImageData < mGadgetron.DataContainer
             if isempty(self.handle_)
                 error('ImageData:empty_object', 'cannot handle empty object')
             end
+            if mUtilities.mex_available('mgadgetron_mex')
+                mgadgetron_mex('setImagesData', ...
+                    mUtilities.handle_address(self.handle_), single(data));
+                return
+            end
             re = real(data);
             im = imag(data);
             if isa(re, 'single')
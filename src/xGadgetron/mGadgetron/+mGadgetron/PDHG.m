@@ -0,0 +1,44 @@
+classdef PDHG < mGadgetron.Solver
+% Class for the primal-dual hybrid gradient solver of
+% min 1/2 |A x - b|^2, A being an acquisition model and b acquisition data.
+% The step sizes sigma and tau not set are computed from |A|.
+
+% CCP PETMR Synergistic Image Reconstruction Framework (SIRF).
+% Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC.
+% 
+% This is software developed for the Collaborative Computational
+% Project in Positron Emission Tomography and Magnetic Resonance imaging
+% (http://www.ccppetmr.ac.uk/).
+% 
+% Licensed under the Apache License, Version 2.0 (the "License");
+% you may not use this file except in compliance with the License.
+% You may obtain a copy of the License at
+% http://www.apache.org/licenses/LICENSE-2.0
+% Unless required by applicable law or agreed to in writing, software
+% distributed under the License is distributed on an "AS IS" BASIS,
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+% See the License for the specific language governing permissions and
+% limitations under the License.
+
+    methods
+        function self = PDHG()
+            self@mGadgetron.Solver('PDHG');
+        end
+        function set_sigma(self, sigma)
+%***SIRF*** Sets the dual step size (0 for the default).
+            self.set_float_('sigma', sigma)
+        end
+        function set_tau(self, tau)
+%***SIRF*** Sets the primal step size (0 for the default).
+            self.set_float_('tau', tau)
+        end
+        function sigma = get_sigma(self)
+%***SIRF*** Returns the dual step size used by the last run.
+            sigma = mGadgetron.parameter(self.handle_, 'solver', 'sigma', 'f');
+        end
+        function tau = get_tau(self)
+%***SIRF*** Returns the primal step size used by the last run.
+            tau = mGadgetron.parameter(self.handle_, 'solver', 'tau', 'f');
+        end
+    end
+end
@@ -0,0 +1,102 @@
+classdef Solver < handle
+% Class for the iterative solvers running in the C++ layer.
+% The iterations are performed by run(n), which leaves the C++ layer only
+% to call the optional callback after each iteration.
+
+% CCP PETMR Synergistic Image Reconstruction Framework (SIRF).
+% Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC.
+% 
+% This is software developed for the Collaborative Computational
+% Project in Positron Emission Tomography and Magnetic Resonance imaging
+% (http://www.ccppetmr.ac.uk/).
+% 
+% Licensed under the Apache License, Version 2.0 (the "License");
+% you may not use this file except in compliance with the License.
+% You may obtain a copy of the License at
+% http://www.apache.org/licenses/LICENSE-2.0
+% Unless required by applicable law or agreed to in writing, software
+% distributed under the License is distributed on an "AS IS" BASIS,
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+% See the License for the specific language governing permissions and
+% limitations under the License.
+
+    properties
+        handle_
+        name_
+    end
+    methods
+        function self = Solver(name)
+            self.name_ = name;
+            self.handle_ = calllib('mgadgetron', 'mGT_newObject', name);
+            mUtilities.check_status(self.name_, self.handle_);
+        end
+        function delete(self)
+            if ~isempty(self.handle_)
+                mUtilities.delete(self.handle_)
+            end
+            self.handle_ = [];
+        end
+        function set_initial_estimate(self, image)
+%***SIRF*** Sets the initial estimate (copied) and restarts the solver.
+            mUtilities.assert_validity(image, 'ImageData')
+            self.set_object_('initial_estimate', image)
+        end
+        function set_acquisition_model(self, am)
+%***SIRF*** Sets the acquisition model, which must have its coil
+%         sensitivity maps set.
+            assert(isa(am, 'mGadgetron.AcquisitionModel'), ...
+                'wrong acquisition model type')
+            self.set_object_('acquisition_model', am)
+        end
+        function set_acquisition_data(self, acqs)
+%***SIRF*** Sets the acquisition data b (copied).
+            mUtilities.assert_validity(acqs, 'AcquisitionData')
+            self.set_object_('acquisition_data', acqs)
+        end
+        function image = get_current_estimate(self)
+%***SIRF*** Returns a copy of the current estimate.
+            image = mGadgetron.ImageData();
+            image.handle_ = calllib('mgadgetron', 'mGT_parameter', ...
+                self.handle_, 'solver', 'current_estimate');
+            mUtilities.check_status(self.name_, image.handle_);
+        end
+        function n = get_iteration(self)
+%***SIRF*** Returns the number of iterations performed.
+            n = mGadgetron.parameter(self.handle_, 'solver', 'iteration', 'i');
+        end
+        function run(self, n, callback)
+%***SIRF*** run(n, callback) performs n iterations; the optional callback
+%         is called after each of them with the iteration number and the
+%         current estimate, which requires one call to the C++ layer per
+%         iteration.
+            if nargin < 3
+                h = calllib('mgadgetron', 'mGT_runSolver', self.handle_, n);
+                mUtilities.check_status(self.name_, h);
+                mUtilities.delete(h)
+                return
+            end
+            for i = 1 : n
+                h = calllib('mgadgetron', 'mGT_runSolver', self.handle_, 1);
+                mUtilities.check_status(self.name_, h);
+                mUtilities.delete(h)
+                callback(self.get_iteration(), self.get_current_estimate())
+            end
+        end
+    end
+    methods (Access = protected)
+        function set_object_(self, par, obj)
+            handle = calllib('mgadgetron', 'mGT_setParameter', ...
+                self.handle_, 'solver', par, obj.handle_);
+            mUtilities.check_status(self.name_, handle);
+            mUtilities.delete(handle)
+        end
+        function set_float_(self, par, value)
+            hv = calllib('miutilities', 'mFloatDataHandle', single(value));
+            handle = calllib('mgadgetron', 'mGT_setParameter', ...
+                self.handle_, 'solver', par, hv);
+            mUtilities.check_status(self.name_, handle);
+            mUtilities.delete(handle)
+            mUtilities.delete(hv)
+        end
+    end
+end
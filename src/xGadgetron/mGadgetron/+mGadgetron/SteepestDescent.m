@@ -0,0 +1,36 @@
+classdef SteepestDescent < mGadgetron.Solver
+% Class for the steepest descent solver minimising the least squares
+% misfit 1/2 |A x - b|^2, A being an acquisition model and b acquisition
+% data; the step is exact unless set by set_step_size.
+
+% CCP PETMR Synergistic Image Reconstruction Framework (SIRF).
+% Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC.
+% 
+% This is software developed for the Collaborative Computational
+% Project in Positron Emission Tomography and Magnetic Resonance imaging
+% (http://www.ccppetmr.ac.uk/).
+% 
+% Licensed under the Apache License, Version 2.0 (the "License");
+% you may not use this file except in compliance with the License.
+% You may obtain a copy of the License at
+% http://www.apache.org/licenses/LICENSE-2.0
+% Unless required by applicable law or agreed to in writing, software
+% distributed under the License is distributed on an "AS IS" BASIS,
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+% See the License for the specific language governing permissions and
+% limitations under the License.
+
+    methods
+        function self = SteepestDescent()
+            self@mGadgetron.Solver('SteepestDescent');
+        end
+        function set_step_size(self, t)
+%***SIRF*** Sets a fixed step size (0 for the exact step).
+            self.set_float_('step_size', t)
+        end
+        function t = get_step_size(self)
+%***SIRF*** Returns the step taken by the last iteration.
+            t = mGadgetron.parameter(self.handle_, 'solver', 'step_size', 'f');
+        end
+    end
+end
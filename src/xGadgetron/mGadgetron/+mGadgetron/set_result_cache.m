@@ -0,0 +1,47 @@
+function set_result_cache(enabled, directory, limit_mb)
+% Enables (or disables) the on-disk cache of the outputs of the chains run
+% by Gadgetron server (disabled by default). The outputs are keyed by a
+% hash of the chain definition, the acquisitions header and the input data,
+% so that a repeated run of a chain on the same input reads the output from
+% the cache instead of contacting the server. The optional arguments are
+% the directory of the cache files (current one by default) and the limit
+% on their total size in MB (1024 by default), the least recently used
+% files being removed first.
+
+
+% CCP PETMR Synergistic Image Reconstruction Framework (SIRF).
+% Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC.
+% 
+% This is software developed for the Collaborative Computational
+% Project in Positron Emission Tomography and Magnetic Resonance imaging
+% (http://www.ccppetmr.ac.uk/).
+% 
+% Licensed under the Apache License, Version 2.0 (the "License");
+% you may not use this file except in compliance with the License.
+% You may obtain a copy of the License at
+% http://www.apache.org/licenses/LICENSE-2.0
+% Unless required by applicable law or agreed to in writing, software
+% distributed under the License is distributed on an "AS IS" BASIS,
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+% See the License for the specific language governing permissions and
+% limitations under the License.
+
+if nargin < 1
+    enabled = true;
+end
+set_par('enabled', calllib('miutilities', 'mIntDataHandle', int32(enabled)))
+if nargin > 1
+    set_par('directory', calllib('miutilities', 'mCharDataHandle', directory))
+end
+if nargin > 2
+    set_par('limit', calllib('miutilities', 'mIntDataHandle', int32(limit_mb)))
+end
+end
+
+function set_par(name, hv)
+h = calllib('mgadgetron', 'mGT_setParameter', [], 'result_cache', ...
+    name, hv);
+mUtilities.check_status('set_result_cache', h);
+mUtilities.delete(h)
+mUtilities.delete(hv)
+end
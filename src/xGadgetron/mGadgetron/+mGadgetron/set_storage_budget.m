@@ -0,0 +1,38 @@
+function set_storage_budget(limit_mb, scratch_directory)
+% Sets the memory budget (in MB, 0 for none) of the acquisition data stored
+% by the 'hybrid' scheme (see AcquisitionData.set_storage_scheme) and,
+% optionally, the directory of the scratch files (e.g. on a local NVMe
+% drive or tmpfs), which is also used by the 'file' scheme.
+
+
+% CCP PETMR Synergistic Image Reconstruction Framework (SIRF).
+% Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC.
+% 
+% This is software developed for the Collaborative Computational
+% Project in Positron Emission Tomography and Magnetic Resonance imaging
+% (http://www.ccppetmr.ac.uk/).
+% 
+% Licensed under the Apache License, Version 2.0 (the "License");
+% you may not use this file except in compliance with the License.
+% You may obtain a copy of the License at
+% http://www.apache.org/licenses/LICENSE-2.0
+% Unless required by applicable law or agreed to in writing, software
+% distributed under the License is distributed on an "AS IS" BASIS,
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+% See the License for the specific language governing permissions and
+% limitations under the License.
+
+set_par('limit', calllib('miutilities', 'mIntDataHandle', int32(limit_mb)))
+if nargin > 1
+    set_par('scratch_directory', ...
+        calllib('miutilities', 'mCharDataHandle', scratch_directory))
+end
+end
+
+function set_par(name, hv)
+h = calllib('mgadgetron', 'mGT_setParameter', [], 'storage_budget', ...
+    name, hv);
+mUtilities.check_status('set_storage_budget', h);
+mUtilities.delete(h)
+mUtilities.delete(hv)
+end
@@ -0,0 +1,32 @@
+function [resident, spilled] = storage_usage()
+% Returns the numbers of bytes of the 'hybrid' acquisition data of this
+% process currently resident in memory and spilled to scratch files.
+
+
+% CCP PETMR Synergistic Image Reconstruction Framework (SIRF).
+% Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC.
+% 
+% This is software developed for the Collaborative Computational
+% Project in Positron Emission Tomography and Magnetic Resonance imaging
+% (http://www.ccppetmr.ac.uk/).
+% 
+% Licensed under the Apache License, Version 2.0 (the "License");
+% you may not use this file except in compliance with the License.
+% You may obtain a copy of the License at
+% http://www.apache.org/licenses/LICENSE-2.0
+% Unless required by applicable law or agreed to in writing, software
+% distributed under the License is distributed on an "AS IS" BASIS,
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+% See the License for the specific language governing permissions and
+% limitations under the License.
+
+resident = usage('resident_bytes');
+spilled = usage('spilled_bytes');
+end
+
+function value = usage(name)
+h = calllib('mgadgetron', 'mGT_parameter', [], 'storage_budget', name);
+mUtilities.check_status('storage_usage', h)
+value = calllib('miutilities', 'mDoubleDataFromHandle', h);
+mUtilities.delete(h)
+end
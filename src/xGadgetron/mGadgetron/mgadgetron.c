@@ -44,6 +44,15 @@ EXPORTED_FUNCTION 	void* mGT_parameter(void* ptr, const char* obj, const char* n
 EXPORTED_FUNCTION 	void* mGT_setParameter (void* ptr, const char* obj, const char* par, const void* val) {
 	return cGT_setParameter (ptr, obj, par, val);
 }
+EXPORTED_FUNCTION 	void* mGT_parameterId(const char* obj, const char* name, int type) {
+	return cGT_parameterId(obj, name, type);
+}
+EXPORTED_FUNCTION 	void* mGT_setParameterById(void* ptr, int id, double value) {
+	return cGT_setParameterById(ptr, id, value);
+}
+EXPORTED_FUNCTION 	void* mGT_setParameters (void* ptr, int n, PTR_INT ptr_ids, PTR_DOUBLE ptr_values) {
+	return cGT_setParameters (ptr, n, ptr_ids, ptr_values);
+}
 EXPORTED_FUNCTION 	void*	mGT_computeCoilImages(void* ptr_cis, void* ptr_acqs) {
 	return cGT_computeCoilImages(ptr_cis, ptr_acqs);
 }
@@ -56,6 +65,15 @@ EXPORTED_FUNCTION 	void* mGT_CoilSensitivities(const char* file) {
 EXPORTED_FUNCTION 	void* mGT_computeCoilSensitivities(void* ptr_csms, void* ptr_acqs) {
 	return cGT_computeCoilSensitivities(ptr_csms, ptr_acqs);
 }
+EXPORTED_FUNCTION 	void* mGT_computeCoilCompression(void* ptr_cc, void* ptr_acqs) {
+	return cGT_computeCoilCompression(ptr_cc, ptr_acqs);
+}
+EXPORTED_FUNCTION 	void* mGT_compressAcquisitions(void* ptr_cc, void* ptr_acqs) {
+	return cGT_compressAcquisitions(ptr_cc, ptr_acqs);
+}
+EXPORTED_FUNCTION 	void* mGT_compressCoilSensitivities(void* ptr_cc, void* ptr_csms) {
+	return cGT_compressCoilSensitivities(ptr_cc, ptr_csms);
+}
 EXPORTED_FUNCTION 	void* mGT_appendCSM (void* ptr_csms, int nx, int ny, int nz, int nc,  PTR_FLOAT ptr_re, PTR_FLOAT ptr_im) {
 	return cGT_appendCSM (ptr_csms, nx, ny, nz, nc, ptr_re, ptr_im);
 }
@@ -80,6 +98,9 @@ EXPORTED_FUNCTION 	void* mGT_setAcquisitionModelParameter (void* ptr_am, const c
 EXPORTED_FUNCTION 	void* mGT_setCSMs(void* ptr_am, const void* ptr_csms) {
 	return cGT_setCSMs(ptr_am, ptr_csms);
 }
+EXPORTED_FUNCTION 	void* mGT_setFFTPlanning(const char* mode, const char* wisdom) {
+	return cGT_setFFTPlanning(mode, wisdom);
+}
 EXPORTED_FUNCTION 	void* mGT_AcquisitionModelForward(void* ptr_am, const void* ptr_imgs) {
 	return cGT_AcquisitionModelForward(ptr_am, ptr_imgs);
 }
@@ -92,6 +113,12 @@ EXPORTED_FUNCTION 	void* mGT_setAcquisitionsStorageScheme(const char* scheme) {
 EXPORTED_FUNCTION 	void* mGT_getAcquisitionsStorageScheme() {
 	return cGT_getAcquisitionsStorageScheme();
 }
+EXPORTED_FUNCTION 	void* mGT_setAcquisitionsCacheSize(int megabytes) {
+	return cGT_setAcquisitionsCacheSize(megabytes);
+}
+EXPORTED_FUNCTION 	void* mGT_setISMRMRDCompression(int level) {
+	return cGT_setISMRMRDCompression(level);
+}
 EXPORTED_FUNCTION 	void* mGT_ISMRMRDAcquisitionsFromFile(const char* file) {
 	return cGT_ISMRMRDAcquisitionsFromFile(file);
 }
@@ -107,6 +134,9 @@ EXPORTED_FUNCTION 	void* mGT_acquisitionFromContainer(void* ptr_acqs, unsigned i
 EXPORTED_FUNCTION 	void* mGT_orderAcquisitions(void* ptr_acqs) {
 	return cGT_orderAcquisitions(ptr_acqs);
 }
+EXPORTED_FUNCTION 	void* mGT_compactAcquisitions(void* ptr_acqs) {
+	return cGT_compactAcquisitions(ptr_acqs);
+}
 EXPORTED_FUNCTION 	void* mGT_getAcquisitionsDimensions(void* ptr_acqs, PTR_INT ptr_dim) {
 	return cGT_getAcquisitionsDimensions(ptr_acqs, ptr_dim);
 }
@@ -131,9 +161,48 @@ EXPORTED_FUNCTION 	void* mGT_reconstructedImages(void* ptr_recon) {
 EXPORTED_FUNCTION 	void*	mGT_readImages(const char* file) {
 	return cGT_readImages(file);
 }
+EXPORTED_FUNCTION 	void* mGT_imagesVolume(void* ptr_imgs) {
+	return cGT_imagesVolume(ptr_imgs);
+}
 EXPORTED_FUNCTION 	void* mGT_processImages(void* ptr_proc, void* ptr_input) {
 	return cGT_processImages(ptr_proc, ptr_input);
 }
+EXPORTED_FUNCTION 	void* mGT_reconstructImagesAsync(void* ptr_recon, void* ptr_input) {
+	return cGT_reconstructImagesAsync(ptr_recon, ptr_input);
+}
+EXPORTED_FUNCTION 	void* mGT_processAcquisitionsAsync(void* ptr_proc, void* ptr_input) {
+	return cGT_processAcquisitionsAsync(ptr_proc, ptr_input);
+}
+EXPORTED_FUNCTION 	void* mGT_processImagesAsync(void* ptr_proc, void* ptr_input) {
+	return cGT_processImagesAsync(ptr_proc, ptr_input);
+}
+EXPORTED_FUNCTION 	void* mGT_jobDone(void* ptr_job) {
+	return cGT_jobDone(ptr_job);
+}
+EXPORTED_FUNCTION 	void* mGT_waitForJob(void* ptr_job) {
+	return cGT_waitForJob(ptr_job);
+}
+EXPORTED_FUNCTION 	void* mGT_cancelJob(void* ptr_job) {
+	return cGT_cancelJob(ptr_job);
+}
+EXPORTED_FUNCTION 	void* mGT_startStream(void* ptr_recon, void* ptr_acqs, int capacity) {
+	return cGT_startStream(ptr_recon, ptr_acqs, capacity);
+}
+EXPORTED_FUNCTION 	void* mGT_feedStream(void* ptr_stream, void* ptr_acqs, int first) {
+	return cGT_feedStream(ptr_stream, ptr_acqs, first);
+}
+EXPORTED_FUNCTION 	void* mGT_finishStream(void* ptr_stream) {
+	return cGT_finishStream(ptr_stream);
+}
+EXPORTED_FUNCTION 	void* mGT_streamedImage(void* ptr_stream, int timeout_ms) {
+	return cGT_streamedImage(ptr_stream, timeout_ms);
+}
+EXPORTED_FUNCTION 	void* mGT_streamDone(void* ptr_stream) {
+	return cGT_streamDone(ptr_stream);
+}
+EXPORTED_FUNCTION 	void* mGT_cancelStream(void* ptr_stream) {
+	return cGT_cancelStream(ptr_stream);
+}
 EXPORTED_FUNCTION 	void* mGT_selectImages (void* ptr_input, const char* attr, const char* target) {
 	return cGT_selectImages (ptr_input, attr, target);
 }
@@ -182,6 +251,15 @@ EXPORTED_FUNCTION 	void* mGT_dot(const void* ptr_x, const void* ptr_y) {
 EXPORTED_FUNCTION 	void* mGT_axpby( float ar, float ai, const void* ptr_x, float br, float bi, const void* ptr_y) {
 	return cGT_axpby(ar, ai, ptr_x, br, bi, ptr_y);
 }
+EXPORTED_FUNCTION 	void* mGT_axpbyAndNorm( float ar, float ai, const void* ptr_x, float br, float bi, const void* ptr_y, PTR_FLOAT ptr_norm) {
+	return cGT_axpbyAndNorm(ar, ai, ptr_x, br, bi, ptr_y, ptr_norm);
+}
+EXPORTED_FUNCTION 	void* mGT_axpbyAndDot( float ar, float ai, const void* ptr_x, float br, float bi, const void* ptr_y, const void* ptr_z, PTR_FLOAT ptr_dot) {
+	return cGT_axpbyAndDot(ar, ai, ptr_x, br, bi, ptr_y, ptr_z, ptr_dot);
+}
+EXPORTED_FUNCTION 	void* mGT_xapy(void* ptr_y, float ar, float ai, const void* ptr_x) {
+	return cGT_xapy(ptr_y, ar, ai, ptr_x);
+}
 EXPORTED_FUNCTION 	void* mGT_multiply(const void* ptr_x, const void* ptr_y) {
 	return cGT_multiply(ptr_x, ptr_y);
 }
@@ -197,6 +275,9 @@ EXPORTED_FUNCTION 	void* mGT_addWriter(void* ptr_gc, const char* id, const void*
 EXPORTED_FUNCTION 	void* mGT_addGadget(void* ptr_gc, const char* id, const void* ptr_r) {
 	return cGT_addGadget(ptr_gc, id, ptr_r);
 }
+EXPORTED_FUNCTION 	void* mGT_addServer(void* ptr_gc, const char* host, const char* port) {
+	return cGT_addServer(ptr_gc, host, port);
+}
 EXPORTED_FUNCTION 	void* mGT_setGadgetProperty(void* ptr_g, const char* prop, const char* val) {
 	return cGT_setGadgetProperty(ptr_g, prop, val);
 }
@@ -236,6 +317,27 @@ EXPORTED_FUNCTION 	void* mGT_sendImages(void* ptr_con, void* ptr_img) {
 EXPORTED_FUNCTION 	void* mGT_disconnect(void* ptr_con) {
 	return cGT_disconnect(ptr_con);
 }
+EXPORTED_FUNCTION 	void* mGT_profiler(const char* format) {
+	return cGT_profiler(format);
+}
+EXPORTED_FUNCTION 	void* mGT_setProfiler(int enabled, int tracing) {
+	return cGT_setProfiler(enabled, tracing);
+}
+EXPORTED_FUNCTION 	void* mGT_resetProfiler() {
+	return cGT_resetProfiler();
+}
+EXPORTED_FUNCTION 	void* mGT_setThreadPool(int num_threads, const char* affinity) {
+	return cGT_setThreadPool(num_threads, affinity);
+}
+EXPORTED_FUNCTION 	void* mGT_threadPoolSize() {
+	return cGT_threadPoolSize();
+}
+EXPORTED_FUNCTION 	void* mGT_warmUp() {
+	return cGT_warmUp();
+}
+EXPORTED_FUNCTION 	void* mGT_runSolver(void* ptr_s, int n_iter) {
+	return cGT_runSolver(ptr_s, n_iter);
+}
 #ifndef CGADGETRON_FOR_MATLAB
 }
 #endif
@@ -37,10 +37,16 @@ limitations under the License.
 EXPORTED_FUNCTION  void* mGT_newObject(const char* name);
 EXPORTED_FUNCTION 	void* mGT_parameter(void* ptr, const char* obj, const char* name);
 EXPORTED_FUNCTION 	void* mGT_setParameter (void* ptr, const char* obj, const char* par, const void* val);
+EXPORTED_FUNCTION 	void* mGT_parameterId(const char* obj, const char* name, int type);
+EXPORTED_FUNCTION 	void* mGT_setParameterById(void* ptr, int id, double value);
+EXPORTED_FUNCTION 	void* mGT_setParameters (void* ptr, int n, PTR_INT ptr_ids, PTR_DOUBLE ptr_values);
 EXPORTED_FUNCTION 	void*	mGT_computeCoilImages(void* ptr_cis, void* ptr_acqs);
 EXPORTED_FUNCTION 	void*	mGT_computeCSMsFromCIs(void* ptr_csms, void* ptr_cis);
 EXPORTED_FUNCTION 	void* mGT_CoilSensitivities(const char* file);
 EXPORTED_FUNCTION 	void* mGT_computeCoilSensitivities(void* ptr_csms, void* ptr_acqs);
+EXPORTED_FUNCTION 	void* mGT_computeCoilCompression(void* ptr_cc, void* ptr_acqs);
+EXPORTED_FUNCTION 	void* mGT_compressAcquisitions(void* ptr_cc, void* ptr_acqs);
+EXPORTED_FUNCTION 	void* mGT_compressCoilSensitivities(void* ptr_cc, void* ptr_csms);
 EXPORTED_FUNCTION 	void* mGT_appendCSM (void* ptr_csms, int nx, int ny, int nz, int nc,  PTR_FLOAT ptr_re, PTR_FLOAT ptr_im);
 EXPORTED_FUNCTION 	void mGT_getCoilDataDimensions (void* ptr_csms, int csm_num, PTR_INT ptr_dim);
 EXPORTED_FUNCTION 	void mGT_getCoilData (void* ptr_csms, int csm_num, PTR_FLOAT ptr_re, PTR_FLOAT ptr_im);
@@ -49,15 +55,19 @@ EXPORTED_FUNCTION 	void* mGT_AcquisitionModel(const void* ptr_acqs, const void*
 EXPORTED_FUNCTION 	void* mGT_setUpAcquisitionModel (void* ptr_am, const void* ptr_acqs, const void* ptr_imgs);
 EXPORTED_FUNCTION 	void* mGT_setAcquisitionModelParameter (void* ptr_am, const char* name, const void* ptr);
 EXPORTED_FUNCTION 	void* mGT_setCSMs(void* ptr_am, const void* ptr_csms);
+EXPORTED_FUNCTION 	void* mGT_setFFTPlanning(const char* mode, const char* wisdom);
 EXPORTED_FUNCTION 	void* mGT_AcquisitionModelForward(void* ptr_am, const void* ptr_imgs);
 EXPORTED_FUNCTION 	void* mGT_AcquisitionModelBackward(void* ptr_am, const void* ptr_acqs);
 EXPORTED_FUNCTION 	void* mGT_setAcquisitionsStorageScheme(const char* scheme);
 EXPORTED_FUNCTION 	void* mGT_getAcquisitionsStorageScheme();
+EXPORTED_FUNCTION 	void* mGT_setAcquisitionsCacheSize(int megabytes);
+EXPORTED_FUNCTION 	void* mGT_setISMRMRDCompression(int level);
 EXPORTED_FUNCTION 	void* mGT_ISMRMRDAcquisitionsFromFile(const char* file);
 EXPORTED_FUNCTION 	void* mGT_ISMRMRDAcquisitionsFile(const char* file);
 EXPORTED_FUNCTION 	void* mGT_processAcquisitions(void* ptr_proc, void* ptr_input);
 EXPORTED_FUNCTION 	void* mGT_acquisitionFromContainer(void* ptr_acqs, unsigned int acq_num);
 EXPORTED_FUNCTION 	void* mGT_orderAcquisitions(void* ptr_acqs);
+EXPORTED_FUNCTION 	void* mGT_compactAcquisitions(void* ptr_acqs);
 EXPORTED_FUNCTION 	void* mGT_getAcquisitionsDimensions(void* ptr_acqs, PTR_INT ptr_dim);
 EXPORTED_FUNCTION 	void* mGT_getAcquisitionsFlags (void* ptr_acqs, unsigned int n, PTR_INT ptr_f);
 EXPORTED_FUNCTION 	void* mGT_getAcquisitionsData (void* ptr_acqs, unsigned int slice, PTR_FLOAT ptr_r, PTR_FLOAT ptr_i);
@@ -66,7 +76,20 @@ EXPORTED_FUNCTION 	void*	mGT_writeAcquisitions(void* ptr_acqs, const char* filen
 EXPORTED_FUNCTION 	void* mGT_reconstructImages(void* ptr_recon, void* ptr_input);
 EXPORTED_FUNCTION 	void* mGT_reconstructedImages(void* ptr_recon);
 EXPORTED_FUNCTION 	void*	mGT_readImages(const char* file);
+EXPORTED_FUNCTION 	void* mGT_imagesVolume(void* ptr_imgs);
 EXPORTED_FUNCTION 	void* mGT_processImages(void* ptr_proc, void* ptr_input);
+EXPORTED_FUNCTION 	void* mGT_reconstructImagesAsync(void* ptr_recon, void* ptr_input);
+EXPORTED_FUNCTION 	void* mGT_processAcquisitionsAsync(void* ptr_proc, void* ptr_input);
+EXPORTED_FUNCTION 	void* mGT_processImagesAsync(void* ptr_proc, void* ptr_input);
+EXPORTED_FUNCTION 	void* mGT_jobDone(void* ptr_job);
+EXPORTED_FUNCTION 	void* mGT_waitForJob(void* ptr_job);
+EXPORTED_FUNCTION 	void* mGT_cancelJob(void* ptr_job);
+EXPORTED_FUNCTION 	void* mGT_startStream(void* ptr_recon, void* ptr_acqs, int capacity);
+EXPORTED_FUNCTION 	void* mGT_feedStream(void* ptr_stream, void* ptr_acqs, int first);
+EXPORTED_FUNCTION 	void* mGT_finishStream(void* ptr_stream);
+EXPORTED_FUNCTION 	void* mGT_streamedImage(void* ptr_stream, int timeout_ms);
+EXPORTED_FUNCTION 	void* mGT_streamDone(void* ptr_stream);
+EXPORTED_FUNCTION 	void* mGT_cancelStream(void* ptr_stream);
 EXPORTED_FUNCTION 	void* mGT_selectImages (void* ptr_input, const char* attr, const char* target);
 EXPORTED_FUNCTION 	void* mGT_writeImages (void* ptr_imgs, const char* out_file, const char* out_group);
 EXPORTED_FUNCTION 	void* mGT_imageWrapFromContainer(void* ptr_imgs, unsigned int img_num);
@@ -83,11 +106,15 @@ EXPORTED_FUNCTION 	void* mGT_dataItems(const void* ptr_x);
 EXPORTED_FUNCTION 	void* mGT_norm(const void* ptr_x);
 EXPORTED_FUNCTION 	void* mGT_dot(const void* ptr_x, const void* ptr_y);
 EXPORTED_FUNCTION 	void* mGT_axpby( float ar, float ai, const void* ptr_x, float br, float bi, const void* ptr_y);
+EXPORTED_FUNCTION 	void* mGT_axpbyAndNorm( float ar, float ai, const void* ptr_x, float br, float bi, const void* ptr_y, PTR_FLOAT ptr_norm);
+EXPORTED_FUNCTION 	void* mGT_axpbyAndDot( float ar, float ai, const void* ptr_x, float br, float bi, const void* ptr_y, const void* ptr_z, PTR_FLOAT ptr_dot);
+EXPORTED_FUNCTION 	void* mGT_xapy(void* ptr_y, float ar, float ai, const void* ptr_x);
 EXPORTED_FUNCTION 	void* mGT_multiply(const void* ptr_x, const void* ptr_y);
 EXPORTED_FUNCTION 	void* mGT_divide(const void* ptr_x, const void* ptr_y);
 EXPORTED_FUNCTION 	void* mGT_addReader(void* ptr_gc, const char* id, const void* ptr_r);
 EXPORTED_FUNCTION 	void* mGT_addWriter(void* ptr_gc, const char* id, const void* ptr_r);
 EXPORTED_FUNCTION 	void* mGT_addGadget(void* ptr_gc, const char* id, const void* ptr_r);
+EXPORTED_FUNCTION 	void* mGT_addServer(void* ptr_gc, const char* host, const char* port);
 EXPORTED_FUNCTION 	void* mGT_setGadgetProperty(void* ptr_g, const char* prop, const char* val);
 EXPORTED_FUNCTION 	void* mGT_setGadgetProperties(void* ptr_g, const char* props);
 EXPORTED_FUNCTION 	void* mGT_configGadgetChain(void* ptr_con, void* ptr_gc);
@@ -101,6 +128,13 @@ EXPORTED_FUNCTION 	void* mGT_sendParametersString(void* ptr_con, const char* par
 EXPORTED_FUNCTION 	void* mGT_sendAcquisitions(void* ptr_con, void* ptr_dat);
 EXPORTED_FUNCTION 	void* mGT_sendImages(void* ptr_con, void* ptr_img);
 EXPORTED_FUNCTION 	void* mGT_disconnect(void* ptr_con);
+EXPORTED_FUNCTION 	void* mGT_profiler(const char* format);
+EXPORTED_FUNCTION 	void* mGT_setProfiler(int enabled, int tracing);
+EXPORTED_FUNCTION 	void* mGT_resetProfiler();
+EXPORTED_FUNCTION 	void* mGT_setThreadPool(int num_threads, const char* affinity);
+EXPORTED_FUNCTION 	void* mGT_threadPoolSize();
+EXPORTED_FUNCTION 	void* mGT_warmUp();
+EXPORTED_FUNCTION 	void* mGT_runSolver(void* ptr_s, int n_iter);
 #ifndef CGADGETRON_FOR_MATLAB
 }
 #endif
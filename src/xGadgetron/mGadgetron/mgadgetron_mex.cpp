@@ -0,0 +1,186 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*
+MEX gateway moving data between Matlab arrays and MR containers.
+
+Called as mgadgetron_mex(command, address, ...), where address is the value
+of mUtilities.handle_address for the container handle:
+
+data = mgadgetron_mex('getImagesData', address)
+mgadgetron_mex('setImagesData', address, data)
+data = mgadgetron_mex('getAcquisitionsData', address, n, [ns nc na])
+mgadgetron_mex('setAcquisitionsData', address, data)
+
+The real and imaginary parts are copied by the engine directly into a newly
+created output array or from the buffers of the input array (which must be
+single), with no intermediate libpointer copies. The gateway uses the
+separate complex storage of mxArray (the default MEX API).
+*/
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <mex.h>
+#include "matrix.h"
+
+#include "cgadgetron.h"
+#include "iutilities.h"
+
+#define ISMRMRD_CXFLOAT 7
+#define ISMRMRD_CXDOUBLE 8
+
+static void*
+handle_(const mxArray* a)
+{
+	if (!mxIsNumeric(a) || mxGetNumberOfElements(a) != 1)
+		mexErrMsgIdAndTxt("mgadgetron_mex:handle", "handle address expected");
+	return (void*)(size_t)mxGetScalar(a);
+}
+
+// raises a Matlab error if h carries one, deletes it otherwise
+static void
+check_(void* h)
+{
+	if (executionStatus(h) == 0) {
+		deleteDataHandle(h);
+		return;
+	}
+	std::string msg = executionError(h);
+	msg += " (";
+	msg += executionErrorFile(h);
+	msg += ")";
+	deleteDataHandle(h);
+	mexErrMsgIdAndTxt("mgadgetron_mex:engine", "%s", msg.c_str());
+}
+
+static int
+int_result_(void* h)
+{
+	if (executionStatus(h) != 0)
+		check_(h);
+	int v = intDataFromHandle(h);
+	deleteDataHandle(h);
+	return v;
+}
+
+// the sizes of the images array, 0 if there are no images
+static size_t
+images_dimensions_(void* ptr, mwSize* dim, bool& real)
+{
+	int n = int_result_(cGT_dataItems(ptr));
+	if (n < 1)
+		return 0;
+	int idim[4];
+	cGT_getImageDimensions(ptr, 0, (size_t)idim);
+	int type = int_result_(cGT_imageDataType(ptr, 0));
+	real = type != ISMRMRD_CXFLOAT && type != ISMRMRD_CXDOUBLE;
+	dim[0] = idim[0];
+	dim[1] = idim[1];
+	dim[2] = (mwSize)idim[2] * idim[3] * n;
+	return dim[0] * dim[1] * dim[2];
+}
+
+/*
+Returns the real and imaginary parts of a single array, the latter
+in im if the array is real.
+*/
+static void
+complex_input_(const mxArray* a, float*& re, float*& im,
+	std::vector<float>& zeros)
+{
+	if (!mxIsSingle(a))
+		mexErrMsgIdAndTxt("mgadgetron_mex:data", "single array expected");
+	re = (float*)mxGetData(a);
+	if (mxIsComplex(a))
+		im = (float*)mxGetImagData(a);
+	else {
+		zeros.assign(mxGetNumberOfElements(a), 0.0f);
+		im = zeros.empty() ? 0 : &zeros[0];
+	}
+}
+
+void
+mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
+{
+	if (nrhs < 2 || !mxIsChar(prhs[0]))
+		mexErrMsgIdAndTxt("mgadgetron_mex:usage",
+		"usage: mgadgetron_mex(command, address, ...)");
+	char cmd[64];
+	mxGetString(prhs[0], cmd, sizeof(cmd));
+	void* ptr = handle_(prhs[1]);
+	mwSize dim[3];
+	bool real = false;
+	if (strcmp(cmd, "getImagesData") == 0) {
+		if (images_dimensions_(ptr, dim, real) == 0) {
+			plhs[0] = mxCreateNumericMatrix(0, 0, mxSINGLE_CLASS, mxREAL);
+			return;
+		}
+		mxArray* a = mxCreateNumericArray
+			(3, dim, mxSINGLE_CLASS, real ? mxREAL : mxCOMPLEX);
+		if (real)
+			cGT_getImagesDataAsFloatArray(ptr, (size_t)mxGetData(a));
+		else
+			cGT_getImagesDataAsComplexArray
+			(ptr, (size_t)mxGetData(a), (size_t)mxGetImagData(a));
+		plhs[0] = a;
+	}
+	else if (strcmp(cmd, "setImagesData") == 0) {
+		if (nrhs < 3)
+			mexErrMsgIdAndTxt("mgadgetron_mex:usage", "data expected");
+		size_t n = images_dimensions_(ptr, dim, real);
+		if (mxGetNumberOfElements(prhs[2]) != n)
+			mexErrMsgIdAndTxt("mgadgetron_mex:data", "wrong data size");
+		float* re;
+		float* im;
+		std::vector<float> zeros;
+		complex_input_(prhs[2], re, im, zeros);
+		check_(cGT_setComplexImagesData(ptr, (size_t)re, (size_t)im));
+	}
+	else if (strcmp(cmd, "getAcquisitionsData") == 0) {
+		if (nrhs < 4 || mxGetNumberOfElements(prhs[3]) != 3)
+			mexErrMsgIdAndTxt("mgadgetron_mex:usage",
+			"acquisitions selection and dimensions expected");
+		unsigned int n = (unsigned int)mxGetScalar(prhs[2]);
+		const double* d = mxGetPr(prhs[3]);
+		for (int i = 0; i < 3; i++)
+			dim[i] = (mwSize)d[i];
+		mxArray* a = mxCreateNumericArray(3, dim, mxSINGLE_CLASS, mxCOMPLEX);
+		int_result_(cGT_getAcquisitionsData(ptr, n,
+			(size_t)mxGetData(a), (size_t)mxGetImagData(a)));
+		plhs[0] = a;
+	}
+	else if (strcmp(cmd, "setAcquisitionsData") == 0) {
+		if (nrhs < 3)
+			mexErrMsgIdAndTxt("mgadgetron_mex:usage", "data expected");
+		const mxArray* a = prhs[2];
+		const mwSize* d = mxGetDimensions(a);
+		mwSize nd = mxGetNumberOfDimensions(a);
+		unsigned int ns = (unsigned int)d[0];
+		unsigned int nc = (unsigned int)(nd > 1 ? d[1] : 1);
+		unsigned int na = (unsigned int)(nd > 2 ? d[2] : 1);
+		float* re;
+		float* im;
+		std::vector<float> zeros;
+		complex_input_(a, re, im, zeros);
+		check_(cGT_setAcquisitionsData
+			(ptr, na, nc, ns, (size_t)re, (size_t)im));
+	}
+	else
+		mexErrMsgIdAndTxt("mgadgetron_mex:usage", "unknown command %s", cmd);
+}
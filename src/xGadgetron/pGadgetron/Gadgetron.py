@@ -29,6 +29,7 @@ except:
     HAVE_PYLAB = False
 import sys
 import time
+import weakref
 ##try:
 ##    from ismrmrdtools import coils
 ##    HAVE_ISMRMRDTOOLS = True
@@ -67,14 +68,57 @@ ISMRMRD_DOUBLE   = 6 ##, /**< corresponds to double */
 ISMRMRD_CXFLOAT  = 7 ##, /**< corresponds to complex float */
 ISMRMRD_CXDOUBLE = 8 ##  /**< corresponds to complex double */
 
+# NumPy array interface type strings for ISMRMRD data types
+_ISMRMRD_TYPESTR = {ISMRMRD_USHORT: '<u2', ISMRMRD_SHORT: '<i2', \
+    ISMRMRD_UINT: '<u4', ISMRMRD_INT: '<i4', ISMRMRD_FLOAT: '<f4', \
+    ISMRMRD_DOUBLE: '<f8', ISMRMRD_CXFLOAT: '<c8', ISMRMRD_CXDOUBLE: '<c16'}
+
 ###########################################################
 ############ Utilities for internal use only ##############
 def _setParameter(hs, set, par, hv):
     try_calling(pygadgetron.cGT_setParameter(hs, set, par, hv))
-def _set_int_par(handle, set, par, value):
-    h = pyiutil.intDataHandle(value)
-    _setParameter(handle, set, par, h)
+# numeric parameter types and ids of (object, parameter, type), resolved by
+# the engine on the first use
+_PARAMETER_INT = 0
+_PARAMETER_FLOAT = 1
+_parameter_ids = {}
+def _parameter_id(set, par, type):
+    key = (set, par, type)
+    id = _parameter_ids.get(key)
+    if id is None:
+        h = pygadgetron.cGT_parameterId(set, par, type)
+        check_status(h)
+        id = pyiutil.intDataFromHandle(h)
+        pyiutil.deleteDataHandle(h)
+        _parameter_ids[key] = id
+    return id
+def _set_numeric_par(handle, id, value):
+    h = pygadgetron.cGT_setParameterById(handle, id, value)
+    if pyiutil.executionStatus(h) != 0:
+        check_status(h)
     pyiutil.deleteDataHandle(h)
+def _set_int_par(handle, set, par, value):
+    _set_numeric_par(handle, _parameter_id(set, par, _PARAMETER_INT), value)
+def _set_float_par(handle, set, par, value):
+    _set_numeric_par(handle, _parameter_id(set, par, _PARAMETER_FLOAT), value)
+def _set_pars(handle, set, pars):
+    '''
+    Sets several numeric parameters of the same object in one call;
+    pars is a dictionary of parameter values, ints being set as int
+    parameters and other numbers as float ones.
+    '''
+    n = len(pars)
+    ids = numpy.ndarray((n,), dtype = numpy.int32)
+    values = numpy.ndarray((n,), dtype = numpy.float64)
+    for i, (par, value) in enumerate(pars.items()):
+        if isinstance(value, (bool, int, numpy.integer)):
+            type = _PARAMETER_INT
+        else:
+            type = _PARAMETER_FLOAT
+        ids[i] = _parameter_id(set, par, type)
+        values[i] = value
+    try_calling(pygadgetron.cGT_setParameters\
+        (handle, n, ids.ctypes.data, values.ctypes.data))
 def _int_par(handle, set, par):
     h = pygadgetron.cGT_parameter(handle, set, par)
     check_status(h)
@@ -157,6 +201,105 @@ def raw_data_path():
     '''
     return petmr_data_path('mr')
 
+def set_ismrmrd_compression(level):
+    '''
+    Sets the compression level of ISMRMRD files written from now on by
+    AcquisitionData.write() and ImageData.write(), from 0 (the default,
+    no compression) to 9.
+    '''
+    try_calling(pygadgetron.cGT_setISMRMRDCompression(int(level)))
+
+def profiler():
+    '''
+    Returns the Profiler of the MR engine hot paths, e.g.
+    profiler().reset(); ...; print(profiler().text())
+    '''
+    return Profiler(pygadgetron, 'cGT')
+
+def set_thread_pool(num_threads = 0, affinity = 'none'):
+    '''
+    Configures the thread pool shared by the parallel loops of the SIRF
+    C++ layer.
+    num_threads: the number of threads, the calling one included; 0 selects
+                 SIRF_NUM_THREADS, else OMP_NUM_THREADS, else the number of
+                 hardware threads
+    affinity: placement of the threads, 'none' (default), 'compact' (NUMA
+              nodes filled in turn) or 'scatter' (threads spread round the
+              NUMA nodes)
+    '''
+    try_calling(pygadgetron.cGT_setThreadPool(int(num_threads), affinity))
+
+def thread_pool_size():
+    '''
+    Returns the number of threads of the SIRF thread pool.
+    '''
+    h = pygadgetron.cGT_threadPoolSize()
+    check_status(h)
+    n = pyiutil.intDataFromHandle(h)
+    pyiutil.deleteDataHandle(h)
+    return n
+
+def warm_up():
+    '''
+    Pays the one-off costs of the first use of the module (the acquisition
+    data template, the vector kernels dispatch) and closes the background
+    Gadgetron sessions and heartbeats, so that processes forked afterwards,
+    e.g. by a multiprocessing pool of workers, neither pay those costs nor
+    share sockets; does not start any threads.
+    '''
+    try_calling(pygadgetron.cGT_warmUp())
+
+def set_storage_budget(limit_mb, scratch_directory = None):
+    '''
+    Sets the memory budget (in MB, 0 for none) of the acquisition data
+    stored by the 'hybrid' scheme (see AcquisitionData.set_storage_scheme)
+    and, optionally, the directory of the scratch files (e.g. on a local
+    NVMe drive or tmpfs), which is also used by the 'file' scheme.
+    '''
+    _set_int_par(None, 'storage_budget', 'limit', limit_mb)
+    if scratch_directory is not None:
+        hv = pyiutil.charDataHandle(scratch_directory)
+        _setParameter(None, 'storage_budget', 'scratch_directory', hv)
+        pyiutil.deleteDataHandle(hv)
+
+def storage_usage():
+    '''
+    Returns the numbers of bytes of the 'hybrid' acquisition data of this
+    process currently resident in memory and spilled to scratch files.
+    '''
+    usage = []
+    for par in ('resident_bytes', 'spilled_bytes'):
+        h = _parameterHandle(None, 'storage_budget', par)
+        usage.append(int(pyiutil.doubleDataFromHandle(h)))
+        pyiutil.deleteDataHandle(h)
+    return tuple(usage)
+
+def set_result_cache(enabled = True, directory = None, limit_mb = None):
+    '''
+    Enables (or disables) the on-disk cache of the outputs of the chains
+    run by Gadgetron server (disabled by default). The outputs are keyed
+    by a hash of the chain definition, the acquisitions header and the
+    input data, so that a repeated run of a chain on the same input reads
+    the output from the cache instead of contacting the server.
+    directory: directory of the cache files (current one by default),
+               may be shared between sessions
+    limit_mb : limit on the total size of the cache files in MB (1024 by
+               default), the least recently used files are removed first
+    '''
+    _set_int_par(None, 'result_cache', 'enabled', int(enabled))
+    if directory is not None:
+        hv = pyiutil.charDataHandle(directory)
+        _setParameter(None, 'result_cache', 'directory', hv)
+        pyiutil.deleteDataHandle(hv)
+    if limit_mb is not None:
+        _set_int_par(None, 'result_cache', 'limit', limit_mb)
+
+def clear_result_cache():
+    '''
+    Removes all files from the result cache directory.
+    '''
+    _set_int_par(None, 'result_cache', 'clear', 1)
+
 ### low-level client functionality
 ### likely to be obsolete- not used for a long time
 ##class ClientConnector:
@@ -209,12 +352,107 @@ def raw_data_path():
 class DataContainer(ABC):
     '''
     Class for an abstract data container.
+
+    The results of +, - and multiplication and division by scalars are
+    deferred: they hold an expression over their operands, which is
+    evaluated in one pass when their data is first needed, and dot() and
+    norm() of such results need not evaluate it at all. An operand hands
+    out its handle only after evaluating the deferred results that refer
+    to it, so that they are not affected by changes to it (except changes
+    made via an ndarray sharing memory with it).
     '''
+    # the handle of the C++ DataContainerExpression of a deferred result,
+    # the weak references to the containers it refers to, and the deferred
+    # results referring to this container
+    _handle = None
+    _expression = None
+    _leaves = ()
+    _dependents = None
     def __init__(self):
         self.handle = None
     def __del__(self):
-        if self.handle is not None:
-            pyiutil.deleteDataHandle(self.handle)
+        self._delete_handles()
+    @property
+    def handle(self):
+        '''
+        The handle of the container data, evaluated if deferred.
+        '''
+        if self._expression is not None:
+            self._evaluate_expression()
+        if self._dependents:
+            for z in list(self._dependents):
+                z._evaluate_expression()
+        return self._handle
+    @handle.setter
+    def handle(self, value):
+        self._handle = value
+    def _delete_handles(self):
+        if self._expression is not None:
+            self._release_expression()
+        if self._handle is not None:
+            pyiutil.deleteDataHandle(self._handle)
+            self._handle = None
+    def _release_expression(self):
+        pyiutil.deleteDataHandle(self._expression)
+        self._expression = None
+        for leaf in self._leaves:
+            x = leaf()
+            if x is not None and x._dependents is not None:
+                x._dependents.discard(self)
+        self._leaves = ()
+    def _evaluate_expression(self):
+        if self._expression is None:
+            return
+        h = pygadgetron.cGT_evaluateExpression(self._expression)
+        check_status(h)
+        self._release_expression()
+        self._handle = h
+    def _expression_term(self):
+        '''
+        Returns the expression handle of the container value, whether it
+        must be deleted by the caller, and the containers it refers to.
+        '''
+        if self._expression is not None:
+            return self._expression, False, self._leaves
+        assert self._handle is not None
+        h = pygadgetron.cGT_expression(1.0, 0.0, self._handle)
+        check_status(h)
+        return h, True, (weakref.ref(self),)
+    def _data_handle(self):
+        # the handle for reading only: deferred results stay deferred
+        if self._expression is None:
+            assert self._handle is not None
+            return self._handle
+        return self.handle
+    @staticmethod
+    def _deferred_axpby(a, x, b, y):
+        '''
+        Returns a container whose value a*x + b*y is deferred.
+        '''
+        if type(x) != type(y):
+            raise error('operands of different types')
+        a = complex(a)
+        b = complex(b)
+        hx, own_x, lx = x._expression_term()
+        hy, own_y, ly = y._expression_term()
+        h = pygadgetron.cGT_expressionAxpby\
+            (a.real, a.imag, hx, b.real, b.imag, hy)
+        if own_x:
+            pyiutil.deleteDataHandle(hx)
+        if own_y:
+            pyiutil.deleteDataHandle(hy)
+        check_status(h)
+        z = x.same_object()
+        z._expression = h
+        z._leaves = lx + ly
+        for leaf in z._leaves:
+            u = leaf()
+            if u is None:
+                continue
+            if u._dependents is None:
+                u._dependents = weakref.WeakSet()
+            u._dependents.add(z)
+        return z
     @abc.abstractmethod
     def same_object(self):
         '''
@@ -235,8 +473,11 @@ class DataContainer(ABC):
         '''
         Returns the 2-norm of the container data viewed as a vector.
         '''
-        assert self.handle is not None
-        handle = pygadgetron.cGT_norm(self.handle)
+        if self._expression is not None:
+            handle = pygadgetron.cGT_expressionNorm(self._expression)
+        else:
+            assert self._handle is not None
+            handle = pygadgetron.cGT_norm(self._handle)
         check_status(handle)
         r = pyiutil.floatDataFromHandle(handle)
         pyiutil.deleteDataHandle(handle)
@@ -247,10 +488,13 @@ class DataContainer(ABC):
         data viewed as vectors.
         other: DataContainer
         '''
-##        assert self.handle is not None
-##        assert type(self) == type(other)
-        assert_validities(self, other)
-        handle = pygadgetron.cGT_dot(self.handle, other.handle)
+        assert type(self) == type(other)
+        hy = other._data_handle()
+        if self._expression is not None:
+            handle = pygadgetron.cGT_expressionDot(self._expression, hy)
+        else:
+            assert self._handle is not None
+            handle = pygadgetron.cGT_dot(self._handle, hy)
         check_status(handle)
         re = pyiutil.floatReDataFromHandle(handle)
         im = pyiutil.floatImDataFromHandle(handle)
@@ -278,6 +522,65 @@ class DataContainer(ABC):
         z.handle = pygadgetron.cGT_divide(self.handle, other.handle)
         check_status(z.handle)
         return z
+    def axpby_norm(self, a, b, y):
+        '''
+        Returns the pair (a*self + b*y, norm of a*self + b*y), computing
+        both in one pass over the data.
+        a, b: (real or complex) scalars
+        y: DataContainer
+        '''
+        assert_validities(self, y)
+        a = complex(a)
+        b = complex(b)
+        r = numpy.ndarray((1,), dtype = numpy.float32)
+        z = self.same_object()
+        z.handle = pygadgetron.cGT_axpbyAndNorm\
+            (a.real, a.imag, self.handle, b.real, b.imag, y.handle, \
+             r.ctypes.data)
+        check_status(z.handle)
+        return z, float(r[0])
+    def axpby_dot(self, a, b, y, other):
+        '''
+        Returns the pair (a*self + b*y, dot product of a*self + b*y with 
+        other), computing both in one pass over the data.
+        a, b: (real or complex) scalars
+        y, other: DataContainer
+        '''
+        assert_validities(self, y)
+        assert_validities(self, other)
+        a = complex(a)
+        b = complex(b)
+        r = numpy.ndarray((2,), dtype = numpy.float32)
+        z = self.same_object()
+        z.handle = pygadgetron.cGT_axpbyAndDot\
+            (a.real, a.imag, self.handle, b.real, b.imag, y.handle, \
+             other.handle, r.ctypes.data)
+        check_status(z.handle)
+        return z, complex(r[0], r[1])
+    def xapy(self, a, x):
+        '''
+        Adds a*x to the container data in place.
+        a: (real or complex) scalar
+        x: DataContainer
+        '''
+        assert_validities(self, x)
+        a = complex(a)
+        try_calling(pygadgetron.cGT_xapy(self.handle, a.real, a.imag, x.handle))
+    @staticmethod
+    def linear_combination(a, x):
+        '''
+        Returns a[0]*x[0] + ... + a[n-1]*x[n-1], evaluated in one pass
+        when needed.
+        a: list of (real or complex) scalars
+        x: list of DataContainer objects of the same type
+        '''
+        n = len(x)
+        if n < 1 or len(a) != n:
+            raise error('wrong linear combination arguments')
+        z = DataContainer._deferred_axpby(a[0], x[0], 0, x[0])
+        for i in range(1, n):
+            z = DataContainer._deferred_axpby(1, z, a[i], x[i])
+        return z
     def __add__(self, other):
         '''
         Overloads + for data containers.
@@ -285,13 +588,7 @@ class DataContainer(ABC):
         data viewed as vectors.
         other: DataContainer
         '''
-##        assert self.handle is not None
-##        assert type(self) == type(other)
-        assert_validities(self, other)
-        z = self.same_object()
-        z.handle = pygadgetron.cGT_axpby\
-            (1.0, 0.0, self.handle, 1.0, 0.0, other.handle)
-        return z;
+        return DataContainer._deferred_axpby(1, self, 1, other)
     def __sub__(self, other):
         '''
         Overloads - for data containers.
@@ -299,13 +596,7 @@ class DataContainer(ABC):
         data viewed as vectors.
         other: DataContainer
         '''
-##        assert self.handle is not None
-##        assert type(self) == type(other)
-        assert_validities(self, other)
-        z = self.same_object()
-        z.handle = pygadgetron.cGT_axpby\
-            (1.0, 0.0, self.handle, -1.0, 0.0, other.handle)
-        return z;
+        return DataContainer._deferred_axpby(1, self, -1, other)
     def __mul__(self, other):
         '''
         Overloads * for data containers multiplication by a scalar or another
@@ -313,20 +604,12 @@ class DataContainer(ABC):
         or the elementwise product if it is DataContainer.
         other: DataContainer or a (real or complex) scalar
         '''
-        assert self.handle is not None
         if type(self) == type(other):
             return self.multiply(other)
-        z = self.same_object()
         if type(other) == type(0):
             other = float(other)
-        if type(other) == type(complex(0,0)):
-            z.handle = pygadgetron.cGT_axpby\
-                (other.real, other.imag, self.handle, 0, 0, self.handle)
-            return z;
-        elif type(other) == type(0.0):
-            z.handle = pygadgetron.cGT_axpby\
-                (other, 0, self.handle, 0, 0, self.handle)
-            return z;
+        if type(other) in (type(complex(0,0)), type(0.0)):
+            return DataContainer._deferred_axpby(other, self, 0, self)
         else:
             raise error('wrong multiplier')
     def __rmul__(self, other):
@@ -335,58 +618,37 @@ class DataContainer(ABC):
         the left, i.e. computes and returns the product other*self.
         other: a real or complex scalar
         '''
-        assert self.handle is not None
-        z = self.same_object()
         if type(other) == type(0):
             other = float(other)
-        if type(other) == type(complex(0,0)):
-            z.handle = pygadgetron.cGT_axpby\
-                (other.real, other.imag, self.handle, 0, 0, self.handle)
-            return z;
-        elif type(other) == type(0.0):
-            z.handle = pygadgetron.cGT_axpby\
-                (other, 0, self.handle, 0, 0, self.handle)
-            return z;
+        if type(other) in (type(complex(0,0)), type(0.0)):
+            return DataContainer._deferred_axpby(other, self, 0, self)
         else:
             raise error('wrong multiplier')
     def __truediv__(self, other):
         '''
-        Overloads * for data containers multiplication by a scalar or another
-        data container. Returns the product self*other if other is a scalar
-        or the elementwise product if it is DataContainer.
+        Overloads / for data containers division by a scalar or another
+        data container. Returns the ratio self/other if other is a scalar
+        or the elementwise ratio if it is DataContainer.
         other: DataContainer or a (real or complex) scalar
         '''
-        assert self.handle is not None
         if type(self) == type(other):
             return self.divide(other)
-        z = self.same_object()
         if type(other) == type(0):
             other = float(other)
-        if type(other) == type(complex(0,0)):
-            other = 1/other
-            z.handle = pygadgetron.cGT_axpby\
-                (other.real, other.imag, self.handle, 0, 0, self.handle)
-            return z;
-        elif type(other) == type(0.0):
-            z.handle = pygadgetron.cGT_axpby\
-                (1/other, 0, self.handle, 0, 0, self.handle)
-            return z;
+        if type(other) in (type(complex(0,0)), type(0.0)):
+            return DataContainer._deferred_axpby(1/other, self, 0, self)
         else:
             raise error('wrong multiplier')
 
     @staticmethod
     def axpby(a, x, b, y):
         '''
-        Returns a linear combination a*x + b*y of two containers x and y.
+        Returns a linear combination a*x + b*y of two containers x and y,
+        evaluated when needed.
         a and b: complex scalars
         x and y: DataContainers
         '''
-##        assert type(x) == type(y)
-        assert_validities(x, y)
-        z = x.same_object()
-        z.handle = pygadgetron.cGT_axpby\
-            (a.real, a.imag, x.handle, b.real, b.imag, y.handle)
-        return z;
+        return DataContainer._deferred_axpby(a, x, b, y)
 
 class CoilImageData(DataContainer):
     '''
@@ -399,8 +661,7 @@ class CoilImageData(DataContainer):
         self.handle = pygadgetron.cGT_newObject('CoilImages')
         check_status(self.handle)
     def __del__(self):
-        if self.handle is not None:
-            pyiutil.deleteDataHandle(self.handle)
+        self._delete_handles()
     def same_object(self):
         return CoilImageData()
     def calculate(self, acqs):
@@ -449,11 +710,18 @@ class CoilSensitivityData(DataContainer):
     def __init__(self):
         self.handle = None
         self.smoothness = 0
+        self.num_threads = 0
     def __del__(self):
-        if self.handle is not None:
-            pyiutil.deleteDataHandle(self.handle)
+        self._delete_handles()
     def same_object(self):
         return CoilSensitivityData()
+    def set_num_threads(self, num_threads):
+        '''
+        Sets the number of threads computing the maps by SRSS method:
+        slices, and coils of each slice, are processed concurrently;
+        0 (default) uses all threads of the SIRF thread pool.
+        '''
+        self.num_threads = num_threads
     def read(self, file):
         if self.handle is not None:
             pyiutil.deleteDataHandle(self.handle)
@@ -474,6 +742,8 @@ class CoilSensitivityData(DataContainer):
             pyiutil.deleteDataHandle(self.handle)
         self.handle = pygadgetron.cGT_CoilSensitivities('')
         check_status(self.handle)
+        _set_int_par\
+            (self.handle, 'coil_sensitivity', 'num_threads', self.num_threads)
         if method is not None:
             method_name, parm_list = name_and_parameters(method)
             parm = parse_arglist(parm_list)
@@ -593,11 +863,20 @@ class Image:
         assert self.handle is not None
         t = self.data_type()
         return t is not ISMRMRD_CXFLOAT and t is not ISMRMRD_CXDOUBLE
-    def as_array(self):
+    def as_array(self, copy = True):
         '''
         Returns image data as a 3D Numpy ndarray.
+        copy: if False, returns a 4D (channels, z, y, x) ndarray of the
+              image's own data type sharing memory with this image, valid
+              while this object exists.
         '''
         assert self.handle is not None
+        if not copy:
+            view = numpy.ndarray((6,), dtype = numpy.uint64)
+            try_calling(pygadgetron.cGT_getImageDataView\
+                (self.handle, view.ctypes.data))
+            return data_view(self, int(view[0]), view[5:1:-1], \
+                _ISMRMRD_TYPESTR[int(view[1])])
         dim = numpy.ndarray((4,), dtype = numpy.int32)
         pygadgetron.cGT_getImageDim(self.handle, dim.ctypes.data)
         nx = dim[0]
@@ -705,8 +984,7 @@ class ImageData(DataContainer):
         self.handle = pygadgetron.cGT_readImages(file)
         check_status(self.handle)
     def __del__(self):
-        if self.handle is not None:
-            pyiutil.deleteDataHandle(self.handle)
+        self._delete_handles()
     def same_object(self):
         return ImageData()
     def read_from_file(self, file):
@@ -748,6 +1026,18 @@ class ImageData(DataContainer):
         assert self.handle is not None
         ip = ImageDataProcessor()
         return ip.process(self)
+    def as_volume(self):
+        '''
+        Returns a copy of self with all images stored in one contiguous
+        complex float array; algebraic operations on such copies (and on
+        the images computed from them by AcquisitionModel.backward) work
+        on the whole array at once.
+        '''
+        assert self.handle is not None
+        images = ImageData()
+        images.handle = pygadgetron.cGT_imagesVolume(self.handle)
+        check_status(images.handle)
+        return images
     def image(self, im_num):
         return Image(self, im_num)
 ##    def show(self):
@@ -984,8 +1274,7 @@ class AcquisitionData(DataContainer):
             self.handle = pygadgetron.cGT_ISMRMRDAcquisitionsFromFile(file)
             check_status(self.handle)
     def __del__(self):
-        if self.handle is not None:
-            pyiutil.deleteDataHandle(self.handle)
+        self._delete_handles()
     @staticmethod
     def set_storage_scheme(scheme):
         '''Sets acquisition data storage scheme.
@@ -996,6 +1285,13 @@ class AcquisitionData(DataContainer):
         scheme = 'memory':
             all acquisition data generated from now on will be kept in RAM
             (avoid if data is very large)
+        scheme = 'block':
+            as 'memory', but all acquisition samples are kept in one
+            contiguous array (faster algebra on large data)
+        scheme = 'hybrid':
+            as 'block', within the memory budget set by set_storage_budget(),
+            the least recently used data being moved to scratch files
+            beyond it
         '''
         try_calling(pygadgetron.cGT_setAcquisitionsStorageScheme(scheme))
     @staticmethod
@@ -1007,6 +1303,16 @@ class AcquisitionData(DataContainer):
         scheme = pyiutil.charDataFromHandle(handle)
         pyiutil.deleteDataHandle(handle)
         return scheme
+    @staticmethod
+    def set_cache_size(megabytes):
+        '''Sets the size of the in-memory cache of file-stored acquisition
+        data generated from now on (0, the default, disables caching).
+
+        With a non-zero size, recently read acquisitions are kept in memory
+        up to that many megabytes per AcquisitionData object, and 
+        appended acquisitions are written to the file in batches.
+        '''
+        try_calling(pygadgetron.cGT_setAcquisitionsCacheSize(int(megabytes)))
     def same_object(self):
         return AcquisitionData()
 ##    def number_of_acquisitions(self, select = 'image'):
@@ -1026,11 +1332,39 @@ class AcquisitionData(DataContainer):
         assert self.handle is not None
         try_calling(pygadgetron.cGT_orderAcquisitions(self.handle))
         self.sorted = True
+    def compact(self):
+        '''
+        Rearranges the stored acquisitions in the sorted order, so that
+        subsequent scans through them are sequential.
+        '''
+        assert self.handle is not None
+        try_calling(pygadgetron.cGT_compactAcquisitions(self.handle))
     def is_sorted(self):
         return self.sorted
     def is_undersampled(self):
         assert self.handle is not None
         return _int_par(self.handle, 'acquisitions', 'undersampled')
+    def set_read_only(self, flag = True):
+        '''
+        Makes file-stored acquisitions read-only (flag = True) or writable.
+        Appending to read-only acquisitions is not allowed, but they can 
+        be read by several threads in parallel more efficiently.
+        Acquisitions stored in memory are not affected.
+        '''
+        assert self.handle is not None
+        _set_int_par(self.handle, 'acquisitions', 'read_only', int(flag))
+    def is_read_only(self):
+        assert self.handle is not None
+        return _int_par(self.handle, 'acquisitions', 'read_only') != 0
+    def cache_statistics(self):
+        '''
+        Returns the numbers of cache hits and misses of this object if it is
+        file-stored, (0, 0) otherwise.
+        '''
+        assert self.handle is not None
+        hits = _int_par(self.handle, 'acquisitions', 'cache_hits')
+        misses = _int_par(self.handle, 'acquisitions', 'cache_misses')
+        return hits, misses
     def process(self, list):
         '''
         Returns processed self with an acquisition processor specified by
@@ -1160,6 +1494,19 @@ class AcquisitionModel:
     def __del__(self):
         if self.handle is not None:
             pyiutil.deleteDataHandle(self.handle)
+    @staticmethod
+    def set_fft_planning(mode, wisdom = ''):
+        '''Sets FFTW planning mode used by forward and backward projections.
+
+        mode = 'estimate' (default):
+            plans are created quickly without measurements
+        mode = 'measure' or 'patient':
+            plans are optimised by running test transforms (slower set-up,
+            faster transforms); plans are cached and reused
+        wisdom: name of a file to load FFTW wisdom from and save it to,
+            so that the planning cost is paid once per deployment
+        '''
+        try_calling(pygadgetron.cGT_setFFTPlanning(mode, wisdom))
     def set_up(self, acqs, imgs):
         assert_validity(acqs, AcquisitionData)
         assert_validity(imgs, ImageData)
@@ -1175,6 +1522,36 @@ class AcquisitionModel:
         try_calling(pygadgetron.cGT_setAcquisitionModelParameter \
             (self.handle, 'coil_sensitivity_maps', csm.handle))
 ##        try_calling(pygadgetron.cGT_setCSMs(self.handle, csm.handle))
+    def set_fft_threads(self, nthreads):
+        '''
+        Sets the number of threads used by FFTW to transform all coil
+        images of an image item in one batched FFT, and by the gridding
+        of non-Cartesian readouts.
+        '''
+        _set_int_par(self.handle, 'acquisition_model', 'fft_threads', nthreads)
+    def set_num_threads(self, nthreads):
+        '''
+        Sets the number of threads projecting image slices concurrently
+        in forward and backward; the result does not depend on it.
+        '''
+        _set_int_par(self.handle, 'acquisition_model', 'num_threads', nthreads)
+    def set_resident(self, flag):
+        '''
+        If flag is True, coil sensitivity maps are kept as contiguous arrays
+        between forward and backward calls, which speeds up the repeated
+        projections of iterative reconstructions; the maps must not be
+        modified while this is on (default False).
+        '''
+        _set_int_par(self.handle, 'acquisition_model', 'resident', int(flag))
+    def set_density_compensation(self, flag):
+        '''
+        If flag is True, non-Cartesian (radial, spiral) readouts are
+        weighted by density compensation factors before backprojection,
+        which then performs gridding reconstruction instead of being
+        the exact adjoint of forward (default False).
+        '''
+        _set_int_par\
+            (self.handle, 'acquisition_model', 'density_compensation', int(flag))
     def forward(self, image):
         '''
         Projects an image into (simulated) acquisitions space.
@@ -1203,6 +1580,185 @@ class AcquisitionModel:
         check_status(image.handle)
         return image
 
+class CoilCompression:
+    '''
+    Class for PCA coil compression: combines the coils of acquisition data
+    and of coil sensitivity maps into fewer virtual coils.
+    '''
+    def __init__(self, num_virtual_coils = 0, energy_threshold = 0.99):
+        '''
+        num_virtual_coils: the number of virtual coils; if 0, the smallest
+            number retaining energy_threshold of the calibration data
+            energy is used
+        '''
+        self.handle = None
+        self.handle = pygadgetron.cGT_newObject('CoilCompression')
+        check_status(self.handle)
+        _set_pars(self.handle, 'coil_compression', \
+            {'energy_threshold': float(energy_threshold), \
+            'num_virtual_coils': int(num_virtual_coils)})
+    def __del__(self):
+        if self.handle is not None:
+            pyiutil.deleteDataHandle(self.handle)
+    def set_num_virtual_coils(self, n):
+        _set_int_par(self.handle, 'coil_compression', 'num_virtual_coils', n)
+    def set_energy_threshold(self, e):
+        _set_float_par(self.handle, 'coil_compression', 'energy_threshold', e)
+    def num_coils(self):
+        return _int_par(self.handle, 'coil_compression', 'num_coils')
+    def num_virtual_coils(self):
+        return _int_par(self.handle, 'coil_compression', 'num_virtual_coils')
+    def calculate(self, acqs):
+        '''
+        Computes the compression matrix from the parallel calibration
+        readouts of acqs, or from all its imaging readouts if there are none.
+        acqs: AcquisitionData
+        '''
+        assert_validity(acqs, AcquisitionData)
+        try_calling(pygadgetron.cGT_computeCoilCompression\
+            (self.handle, acqs.handle))
+    def compress(self, data):
+        '''
+        Returns the compressed copy of data.
+        data: AcquisitionData or CoilSensitivityData
+        '''
+        if isinstance(data, AcquisitionData):
+            assert data.handle is not None
+            ad = AcquisitionData()
+            ad.handle = pygadgetron.cGT_compressAcquisitions\
+                (self.handle, data.handle)
+            check_status(ad.handle)
+            return ad
+        elif isinstance(data, CoilSensitivityData):
+            assert data.handle is not None
+            csms = CoilSensitivityData()
+            csms.handle = pygadgetron.cGT_compressCoilSensitivities\
+                (self.handle, data.handle)
+            check_status(csms.handle)
+            return csms
+        else:
+            raise error('Cannot compress %s' % repr(type(data)))
+
+class Solver:
+    '''
+    Class for the iterative solvers running in the C++ layer.
+    The iterations are performed by run(n), which leaves the C++ layer only
+    to call the optional callback after each iteration.
+    '''
+    def __init__(self, name):
+        self.handle = None
+        self.handle = pygadgetron.cGT_newObject(name)
+        check_status(self.handle)
+    def __del__(self):
+        if self.handle is not None:
+            pyiutil.deleteDataHandle(self.handle)
+    def set_initial_estimate(self, image):
+        '''
+        Sets the initial estimate (copied) and restarts the solver.
+        '''
+        assert_validity(image, ImageData)
+        _setParameter(self.handle, 'solver', 'initial_estimate', image.handle)
+    def set_acquisition_model(self, am):
+        '''
+        Sets the acquisition model, which must have its coil sensitivity
+        maps set.
+        '''
+        assert_validity(am, AcquisitionModel)
+        _setParameter(self.handle, 'solver', 'acquisition_model', am.handle)
+    def set_acquisition_data(self, acqs):
+        '''
+        Sets the acquisition data b (copied).
+        '''
+        assert_validity(acqs, AcquisitionData)
+        _setParameter(self.handle, 'solver', 'acquisition_data', acqs.handle)
+    def get_current_estimate(self):
+        '''
+        Returns a copy of the current estimate.
+        '''
+        image = ImageData()
+        image.handle = pygadgetron.cGT_parameter\
+            (self.handle, 'solver', 'current_estimate')
+        check_status(image.handle)
+        return image
+    def get_iteration(self):
+        '''
+        Returns the number of iterations performed.
+        '''
+        return _int_par(self.handle, 'solver', 'iteration')
+    def run(self, n, callback = None):
+        '''
+        Performs n iterations; the optional callback is called after each
+        of them with the iteration number and the current estimate, which
+        requires one call to the C++ layer per iteration.
+        '''
+        if callback is None:
+            try_calling(pygadgetron.cGT_runSolver(self.handle, n))
+            return
+        for i in range(n):
+            try_calling(pygadgetron.cGT_runSolver(self.handle, 1))
+            callback(self.get_iteration(), self.get_current_estimate())
+
+class CGLS(Solver):
+    '''
+    Class for the conjugate gradient solver of the least squares problem
+    min |A x - b|, A being an acquisition model and b acquisition data.
+    '''
+    def __init__(self):
+        Solver.__init__(self, 'CGLS')
+    def get_residual_norm(self):
+        '''
+        Returns |b - A x| at the current estimate.
+        '''
+        return _float_par(self.handle, 'solver', 'residual_norm')
+
+class SteepestDescent(Solver):
+    '''
+    Class for the steepest descent solver minimising the least squares
+    misfit 1/2 |A x - b|^2, A being an acquisition model and b acquisition
+    data; the step is exact unless set by set_step_size.
+    '''
+    def __init__(self):
+        Solver.__init__(self, 'SteepestDescent')
+    def set_step_size(self, t):
+        '''
+        Sets a fixed step size (0 for the exact step).
+        '''
+        _set_float_par(self.handle, 'solver', 'step_size', t)
+    def get_step_size(self):
+        '''
+        Returns the step taken by the last iteration.
+        '''
+        return _float_par(self.handle, 'solver', 'step_size')
+
+class PDHG(Solver):
+    '''
+    Class for the primal-dual hybrid gradient solver of
+    min 1/2 |A x - b|^2, A being an acquisition model and b acquisition data.
+    The step sizes sigma and tau not set are computed from |A|.
+    '''
+    def __init__(self):
+        Solver.__init__(self, 'PDHG')
+    def set_sigma(self, sigma):
+        '''
+        Sets the dual step size (0 for the default).
+        '''
+        _set_float_par(self.handle, 'solver', 'sigma', sigma)
+    def set_tau(self, tau):
+        '''
+        Sets the primal step size (0 for the default).
+        '''
+        _set_float_par(self.handle, 'solver', 'tau', tau)
+    def get_sigma(self):
+        '''
+        Returns the dual step size used by the last run.
+        '''
+        return _float_par(self.handle, 'solver', 'sigma')
+    def get_tau(self):
+        '''
+        Returns the primal step size used by the last run.
+        '''
+        return _float_par(self.handle, 'solver', 'tau')
+
 class Gadget:
     '''
     Class for Gadgetron gadgets.
@@ -1278,6 +1834,15 @@ class GadgetChain:
         '''
         assert isinstance(gadget, Gadget)
         try_calling(pygadgetron.cGT_addGadget(self.handle, id, gadget.handle))
+    def add_server(self, host, port):
+        '''
+        Adds a Gadgetron server to be used instead of the default one
+        (localhost:9002); Reconstructor distributes the slices and
+        repetitions of its input between all added servers.
+        host: server host name (string)
+        port: server port (string or int)
+        '''
+        try_calling(pygadgetron.cGT_addServer(self.handle, host, str(port)))
     def set_gadget_property(self, id, prop, value):
         '''
         Assigns specified value to specified gadget property.
@@ -1304,6 +1869,168 @@ class GadgetChain:
         pyiutil.deleteDataHandle(hg)
         pyiutil.deleteDataHandle(hv)
         return value
+    def set_connection_parameter(self, par, value):
+        '''
+        Sets an integer parameter of the connection to Gadgetron server:
+        send_buffer_size          : bytes accumulated before a socket write
+                                    (0 makes one write per message)
+        tcp_nodelay               : 1 (default) disables Nagle's algorithm
+        socket_send_buffer_size   : SO_SNDBUF in bytes (0: system default)
+        socket_receive_buffer_size: SO_RCVBUF in bytes (0: system default)
+        warm_sessions             : 1 makes the next session with the same
+                                    server and chain prepared in background
+        deferred_probing          : 1 makes a background check that the
+                                    server is still alive after each session,
+                                    so that the next one fails at once if not
+                                    (default 0)
+        '''
+        _set_int_par(self.handle, 'gadget_chain', par, value)
+    def set_prefetch_depth(self, depth):
+        '''
+        Sets the number of acquisitions read ahead by a separate thread
+        while acquisitions are sent to Gadgetron server (default 64);
+        0 makes reading and sending alternate.
+        '''
+        _set_int_par(self.handle, 'gadget_chain', 'prefetch_depth', depth)
+    def set_local_processing(self, flag):
+        '''
+        If flag is True (default False), processor chains of gadgets that
+        can be run in-process (RemoveROOversampling for acquisitions,
+        Extract, ComplexToFloat and FloatToShort for images) are run by SIRF
+        itself, on several items at once, instead of by Gadgetron server;
+        other chains are always run by the server.
+        '''
+        _set_int_par(self.handle, 'gadget_chain', 'local_processing', \
+            int(flag))
+
+class GadgetChainJob:
+    '''
+    Class for the processing of data by a gadget chain running on a 
+    separate thread, see Reconstructor.reconstruct_async,
+    AcquisitionDataProcessor.process_async and 
+    ImageDataProcessor.process_async.
+    '''
+    def __init__(self, handle, output_type):
+        self.handle = None
+        check_status(handle)
+        self.handle = handle
+        self.output_type = output_type
+    def __del__(self):
+        if self.handle is not None:
+            pyiutil.deleteDataHandle(self.handle)
+    def done(self):
+        '''
+        Returns True if the job has finished (successfully or not).
+        '''
+        h = pygadgetron.cGT_jobDone(self.handle)
+        check_status(h)
+        value = pyiutil.intDataFromHandle(h)
+        pyiutil.deleteDataHandle(h)
+        return value != 0
+    def wait(self):
+        '''
+        Waits for the job to finish and returns its output; raises error
+        if the job has failed or has been cancelled.
+        '''
+        output = self.output_type()
+        output.handle = pygadgetron.cGT_waitForJob(self.handle)
+        check_status(output.handle)
+        return output
+    def cancel(self):
+        '''
+        Stops the job by closing its connection to Gadgetron server.
+        '''
+        try_calling(pygadgetron.cGT_cancelJob(self.handle))
+
+class ReconstructionStream:
+    '''
+    Class for a streaming reconstruction, see Reconstructor.start_stream.
+    Acquisitions are fed incrementally by feed() (e.g. as they are appended
+    to a growing file or arrive from a live source) and sent to Gadgetron
+    server at once; the reconstructed images are delivered one by one, as
+    soon as they arrive, by next_image() or to the callback, via a buffer
+    of bounded capacity.
+    '''
+    def __init__(self, handle, callback = None):
+        self.handle = None
+        check_status(handle)
+        self.handle = handle
+        self.callback = callback
+    def __del__(self):
+        if self.handle is not None:
+            pyiutil.deleteDataHandle(self.handle)
+    def feed(self, acq_data, first = 0):
+        '''
+        Feeds the acquisitions of acq_data starting from the one numbered
+        first, e.g. those appended since the last call, and returns their
+        number; if there is a callback, it is then given the images that
+        have arrived meanwhile.
+        acq_data: AcquisitionData
+        '''
+        assert_validity(acq_data, AcquisitionData)
+        h = pygadgetron.cGT_feedStream(self.handle, acq_data.handle, first)
+        check_status(h)
+        n = pyiutil.intDataFromHandle(h)
+        pyiutil.deleteDataHandle(h)
+        if self.callback is not None:
+            self._deliver(0)
+        return n
+    def finish(self):
+        '''
+        Signals the end of the acquisitions; if there is a callback, waits
+        for the remaining images, giving them to it.
+        '''
+        try_calling(pygadgetron.cGT_finishStream(self.handle))
+        if self.callback is not None:
+            while not self.done():
+                self._deliver(-1)
+    def next_image(self, timeout = -1):
+        '''
+        Returns ImageData with the next reconstructed image, waiting for
+        it up to timeout seconds (indefinitely if negative), or None if
+        no image has arrived in time or there are no more images.
+        '''
+        ms = -1 if timeout < 0 else int(timeout*1000)
+        image = ImageData()
+        image.handle = pygadgetron.cGT_streamedImage(self.handle, ms)
+        check_status(image.handle)
+        if image.number() < 1:
+            return None
+        return image
+    def images(self):
+        '''
+        Returns a generator of the reconstructed images as they arrive,
+        ending after finish() when the server has sent the last one.
+        '''
+        while True:
+            image = self.next_image()
+            if image is None:
+                if self.done():
+                    return
+                continue
+            yield image
+    def done(self):
+        '''
+        Returns True if the reconstruction has ended and all images have
+        been delivered.
+        '''
+        h = pygadgetron.cGT_streamDone(self.handle)
+        check_status(h)
+        value = pyiutil.intDataFromHandle(h)
+        pyiutil.deleteDataHandle(h)
+        return value != 0
+    def cancel(self):
+        '''
+        Stops the reconstruction by closing the connection to the server.
+        '''
+        try_calling(pygadgetron.cGT_cancelStream(self.handle))
+    def _deliver(self, timeout):
+        while True:
+            image = self.next_image(timeout)
+            if image is None:
+                return
+            self.callback(image)
+            timeout = 0
 
 class Reconstructor(GadgetChain):
     '''
@@ -1366,6 +2093,29 @@ class Reconstructor(GadgetChain):
         images.handle = pygadgetron.cGT_reconstructedImages(self.handle)
         check_status(images.handle)
         return images
+    def reconstruct_async(self, input_data):
+        '''
+        Starts the reconstruction of specified input on a separate thread
+        and returns GadgetChainJob, whose wait() returns ImageData.
+        input_data: AcquisitionData
+        '''
+        assert_validity(input_data, AcquisitionData)
+        return GadgetChainJob(pygadgetron.cGT_reconstructImagesAsync\
+             (self.handle, input_data.handle), ImageData)
+    def start_stream(self, template, capacity = 16, callback = None):
+        '''
+        Starts a streaming reconstruction of acquisitions sharing the header
+        of template and returns ReconstructionStream; at most capacity
+        images are kept waiting for delivery, the server being slowed down
+        while the buffer is full.
+        template: AcquisitionData (may have no acquisitions)
+        callback: optional function taking ImageData with one image, called
+                  for each image as it arrives while the stream is fed and
+                  finished.
+        '''
+        assert_validity(template, AcquisitionData)
+        return ReconstructionStream(pygadgetron.cGT_startStream\
+             (self.handle, template.handle, capacity), callback)
 
 class ImageDataProcessor(GadgetChain):
     '''
@@ -1416,6 +2166,15 @@ class ImageDataProcessor(GadgetChain):
         check_status(image.handle)
         self.output_data = image
         return image
+    def process_async(self, input_data):
+        '''
+        Starts the processing of specified input on a separate thread
+        and returns GadgetChainJob, whose wait() returns ImageData.
+        input_data: ImageData
+        '''
+        assert_validity(input_data, ImageData)
+        return GadgetChainJob(pygadgetron.cGT_processImagesAsync\
+             (self.handle, input_data.handle), ImageData)
     def get_output(self):
         '''
         Returns the output data.
@@ -1473,6 +2232,15 @@ class AcquisitionDataProcessor(GadgetChain):
         check_status(acquisitions.handle)
         self.output_data = acquisitions
         return acquisitions
+    def process_async(self, input_data):
+        '''
+        Starts the processing of specified input on a separate thread
+        and returns GadgetChainJob, whose wait() returns AcquisitionData.
+        input_data: AcquisitionData
+        '''
+        assert_validity(input_data, AcquisitionData)
+        return GadgetChainJob(pygadgetron.cGT_processAcquisitionsAsync\
+             (self.handle, input_data.handle), AcquisitionData)
     def get_output(self):
         '''
         Returns the output data.
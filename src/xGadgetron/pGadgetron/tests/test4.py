@@ -0,0 +1,91 @@
+# -*- coding: utf-8 -*-
+"""Test set 4.
+v{version}
+
+In-process gadgets tests: the output of each gadget that SIRF can run
+in-process is compared with the output of the same gadget run by
+Gadgetron server
+
+Usage:
+  test4 [--help | options]
+
+Options:
+  -r, --record   record the measurements rather than check them
+  -v, --verbose  report each test status
+
+{author}
+
+{licence}
+"""
+from pGadgetron import *
+import numpy
+__version__ = "0.2.0"
+__author__ = "Evgueni Ovtchinnikov"
+
+
+def local_and_remote(processor, gadgets, input_data):
+    remote = processor(gadgets)
+    remote.set_local_processing(False)
+    local = processor(gadgets)
+    local.set_local_processing(True)
+    return local.process(input_data), remote.process(input_data)
+
+
+def difference(local_data, remote_data):
+    x = local_data.as_array().astype(numpy.complex64)
+    y = remote_data.as_array().astype(numpy.complex64)
+    if x.shape != y.shape:
+        return numpy.inf
+    return numpy.amax(numpy.abs(x - y))
+
+
+def relative_difference(local_data, remote_data):
+    s = numpy.amax(numpy.abs(remote_data.as_array()))
+    return difference(local_data, remote_data)/max(s, 1e-30)
+
+
+def test_main(rec=False, verb=False, throw=True):
+    datafile = RE_PYEXT.sub(".txt", __file__)
+    test = pTest(datafile, rec, throw=throw)
+    test.verbose = verb
+
+    data_path = mr_data_path()
+    input_data = AcquisitionData(data_path + '/simulated_MR_2D_cartesian.h5')
+
+    local_data, remote_data = local_and_remote\
+        (AcquisitionDataProcessor, ['RemoveROOversamplingGadget'], input_data)
+    test.check(relative_difference(local_data, remote_data), abs_tol = 1e-4)
+
+    recon = FullySampledReconstructor()
+    recon.set_input(remote_data)
+    recon.process()
+    complex_images = recon.get_output()
+
+    # ExtractGadget: magnitude, real and imaginary parts, phase
+    for mask in [1, 2, 4, 8]:
+        gadgets = ['ExtractGadget(extract_mask=%d)' % mask]
+        local_images, remote_images = local_and_remote\
+            (ImageDataProcessor, gadgets, complex_images)
+        test.check(local_images.number() - remote_images.number())
+        test.check(relative_difference(local_images, remote_images), \
+            abs_tol = 1e-4)
+
+    local_images, remote_images = local_and_remote\
+        (ImageDataProcessor, ['ComplexToFloatGadget'], complex_images)
+    test.check(relative_difference(local_images, remote_images), \
+        abs_tol = 1e-4)
+
+    # FloatToShortGadget: magnitude, real part and phase, rounding
+    # may differ by one
+    for mask, offset in [(1, 0), (2, 2048), (8, 0), (8, 2048)]:
+        gadgets = ['ExtractGadget(extract_mask=%d)' % mask, \
+            'FloatToShortGadget(intensity_offset=%d)' % offset]
+        local_images, remote_images = local_and_remote\
+            (ImageDataProcessor, gadgets, complex_images)
+        test.check(difference(local_images, remote_images), abs_tol = 1)
+
+    return test.failed, test.ntest
+
+
+if __name__ == "__main__":
+    runner(test_main, __doc__, __version__, __author__)
@@ -0,0 +1,80 @@
+# -*- coding: utf-8 -*-
+"""Test set 5.
+v{version}
+
+Deferred algebra tests: expressions built by the operators +, - and *
+are compared with the same expressions evaluated on ndarrays, and their
+values are checked not to change when an operand is modified afterwards
+
+Usage:
+  test5 [--help | options]
+
+Options:
+  -r, --record   record the measurements rather than check them
+  -v, --verbose  report each test status
+
+{author}
+
+{licence}
+"""
+from pGadgetron import *
+import numpy
+__version__ = "0.2.0"
+__author__ = "Evgueni Ovtchinnikov"
+
+
+def relative_difference(data, array):
+    x = data.as_array()
+    if x.shape != array.shape:
+        return numpy.inf
+    s = numpy.amax(numpy.abs(array))
+    return numpy.amax(numpy.abs(x - array))/max(s, 1e-30)
+
+
+def test_main(rec=False, verb=False, throw=True):
+    datafile = RE_PYEXT.sub(".txt", __file__)
+    test = pTest(datafile, rec, throw=throw)
+    test.verbose = verb
+
+    data_path = mr_data_path()
+    x = AcquisitionData(data_path + '/simulated_MR_2D_cartesian.h5')
+    x_arr = x.as_array()
+    y = x.clone()
+    y_arr = x_arr*(0.5 - 1j) + 1
+    y.fill(y_arr)
+    z = x.clone()
+    z_arr = x_arr*x_arr
+    z.fill(z_arr)
+    a = 2 + 0.5j
+    b = -0.75
+
+    # the deferred expression against eager evaluation
+    e_arr = x_arr + a*y_arr - b*z_arr
+    e = x + a*y - b*z
+    e_norm = numpy.linalg.norm(e_arr)
+    test.check(abs(e.norm() - e_norm)/e_norm, abs_tol = 1e-4)
+    e_dot = numpy.vdot(y_arr, e_arr)
+    test.check(abs(e.dot(y) - e_dot)/abs(e_dot), abs_tol = 1e-4)
+    test.check(relative_difference(e, e_arr), abs_tol = 1e-4)
+    test.check(relative_difference(3*(x - y)/2, 1.5*(x_arr - y_arr)), \
+        abs_tol = 1e-4)
+    lc_arr = a*x_arr + b*y_arr - z_arr
+    lc = DataContainer.linear_combination([a, b, -1], [x, y, z])
+    test.check(relative_difference(lc, lc_arr), abs_tol = 1e-4)
+
+    # operands modified after the expressions are built
+    f = x + a*y
+    g = f - b*z
+    y.fill(numpy.zeros(y_arr.shape))
+    z.fill(numpy.ones(z_arr.shape))
+    test.check(relative_difference(f, x_arr + a*y_arr), abs_tol = 1e-4)
+    test.check(relative_difference(g, e_arr), abs_tol = 1e-4)
+    h = x + a*y
+    del y
+    test.check(relative_difference(h, x_arr), abs_tol = 1e-4)
+
+    return test.failed, test.ntest
+
+
+if __name__ == "__main__":
+    runner(test_main, __doc__, __version__, __author__)
@@ -0,0 +1,76 @@
+# -*- coding: utf-8 -*-
+"""Test set 6.
+v{version}
+
+Image selection tests: a selection shares the selected images with the
+original container until either of them is modified, after which the
+other one must be unchanged
+
+Usage:
+  test6 [--help | options]
+
+Options:
+  -r, --record   record the measurements rather than check them
+  -v, --verbose  report each test status
+
+{author}
+
+{licence}
+"""
+from pGadgetron import *
+import numpy
+__version__ = "0.2.0"
+__author__ = "Evgueni Ovtchinnikov"
+
+
+def relative_difference(images, array):
+    x = images.as_array()
+    if x.shape != array.shape:
+        return numpy.inf
+    s = numpy.amax(numpy.abs(array))
+    return numpy.amax(numpy.abs(x - array))/max(s, 1e-30)
+
+
+def test_main(rec=False, verb=False, throw=True):
+    datafile = RE_PYEXT.sub(".txt", __file__)
+    test = pTest(datafile, rec, throw=throw)
+    test.verbose = verb
+
+    data_path = mr_data_path()
+    input_data = AcquisitionData(data_path + '/simulated_MR_2D_cartesian.h5')
+    processed_data = input_data.process(['RemoveROOversamplingGadget'])
+
+    recon = FullySampledReconstructor()
+    recon.set_input(processed_data)
+    recon.process()
+    images = recon.get_output()
+    images_arr = images.as_array()
+
+    # all reconstructed images have the role 'image'
+    selected = images.select('GADGETRON_DataRole', 'image')
+    test.check(selected.number() - images.number())
+    test.check(relative_difference(selected, images_arr), abs_tol = 1e-6)
+    test.check(images.select('GADGETRON_DataRole', 'gfactor').number())
+
+    # modifying the selection leaves the original container unchanged
+    selected.fill(2*images_arr)
+    test.check(relative_difference(selected, 2*images_arr), abs_tol = 1e-6)
+    test.check(relative_difference(images, images_arr), abs_tol = 1e-6)
+
+    # and vice versa
+    other = images.select('GADGETRON_DataRole', 'image')
+    images.fill(-images_arr)
+    test.check(relative_difference(images, -images_arr), abs_tol = 1e-6)
+    test.check(relative_difference(other, images_arr), abs_tol = 1e-6)
+    test.check(relative_difference(selected, 2*images_arr), abs_tol = 1e-6)
+
+    # in-place algebra on a selection
+    other.xapy(1.0, other)
+    test.check(relative_difference(other, 2*images_arr), abs_tol = 1e-6)
+    test.check(relative_difference(images, -images_arr), abs_tol = 1e-6)
+
+    return test.failed, test.ntest
+
+
+if __name__ == "__main__":
+    runner(test_main, __doc__, __version__, __author__)
@@ -19,10 +19,18 @@ limitations under the License.
 
 */
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "stir/common.h"
 
+#include "SIRF/common/data_expression.h"
+#include "SIRF/common/profiler.h"
+#include "SIRF/common/thread_pool.h"
 #include "cstir_shared_ptr.h"
 #include "data_handle.h"
+#include "parameter_table.h"
 #include "cstir_p.h"
 #include "stir_x.h"
 
@@ -60,6 +68,15 @@ cSTIR_newReconstructionMethod(const char* par_file)
 	CATCH;
 }
 
+// solvers are handled via their base class
+template<class Solver>
+void*
+cSTIR_newSolver()
+{
+	shared_ptr<aSolver<float> > sptr(new Solver);
+	return newObjectHandle(sptr);
+}
+
 extern "C"
 void* cSTIR_newObject(const char* name)
 {
@@ -76,71 +93,147 @@ void* cSTIR_newObject(const char* name)
 			return newObjectHandle<AcqModUsingMatrix3DF>();
 		if (boost::iequals(name, "RayTracingMatrix"))
 			return newObjectHandle<RayTracingMatrix>();
+		if (boost::iequals(name, "MappedMatrix"))
+			return newObjectHandle<ProjMatrixByBinMapped>();
 		if (boost::iequals(name, "QuadraticPrior"))
-			return newObjectHandle<QuadPrior3DF>();
+			return newObjectHandle<xSTIR_QuadraticPrior3DF>();
 		if (boost::iequals(name, "PLSPrior"))
-			return newObjectHandle<PLSPrior<float> >();
-		//if (boost::iequals(name, "PLSPrior"))
-		//	return newObjectHandle<xSTIR_PLSPrior3DF>();
+			return newObjectHandle<xSTIR_PLSPrior3DF>();
 		if (boost::iequals(name, "TruncateToCylindricalFOVImageProcessor"))
 			return newObjectHandle<CylindricFilter3DF>();
 		if (boost::iequals(name, "EllipsoidalCylinder"))
 			return newObjectHandle<EllipsoidalCylinder>();
+		if (boost::iequals(name, "CGLS"))
+			return cSTIR_newSolver<CGLS<float> >();
+		if (boost::iequals(name, "SteepestDescent"))
+			return cSTIR_newSolver<SteepestDescent<float> >();
+		if (boost::iequals(name, "PDHG"))
+			return cSTIR_newSolver<PDHG<float> >();
 		return unknownObject("object", name, __FILE__, __LINE__);
 	}
 	CATCH;
 }
 
+/*
+Wraps the class parameter setters taking DataHandle pointers into
+ParameterSetter.
+*/
+template<void* (*F)(DataHandle*, const char*, const DataHandle*)>
+void*
+cSTIR_parameterSetter(void* hs, const char* name, const void* hv)
+{
+	return F((DataHandle*)hs, name, (const DataHandle*)hv);
+}
+
+static ParameterSetter
+parameter_setter_(const char* obj)
+{
+	if (boost::iequals(obj, "ListmodeToSinograms"))
+		return cSTIR_setListmodeToSinogramsParameter;
+	if (boost::iequals(obj, "Shape"))
+		return cSTIR_setShapeParameter;
+	if (boost::iequals(obj, "EllipsoidalCylinder"))
+		return cSTIR_parameterSetter<cSTIR_setEllipsoidalCylinderParameter>;
+	if (boost::iequals(obj, "TruncateToCylindricalFOVImageProcessor"))
+		return
+		cSTIR_parameterSetter<cSTIR_setTruncateToCylindricalFOVImageProcessorParameter>;
+	if (boost::iequals(obj, "AcquisitionModel"))
+		return cSTIR_parameterSetter<cSTIR_setAcquisitionModelParameter>;
+	if (boost::iequals(obj, "AttenuationModel"))
+		return cSTIR_parameterSetter<cSTIR_setAttenuationModelParameter>;
+	if (boost::iequals(obj, "AcqModUsingMatrix"))
+		return cSTIR_parameterSetter<cSTIR_setAcqModUsingMatrixParameter>;
+	if (boost::iequals(obj, "RayTracingMatrix"))
+		return cSTIR_parameterSetter<cSTIR_setRayTracingMatrixParameter>;
+	if (boost::iequals(obj, "MappedMatrix"))
+		return cSTIR_parameterSetter<cSTIR_setMappedMatrixParameter>;
+	if (boost::iequals(obj, "GeneralisedPrior"))
+		return cSTIR_parameterSetter<cSTIR_setGeneralisedPriorParameter>;
+	if (boost::iequals(obj, "QuadraticPrior"))
+		return cSTIR_parameterSetter<cSTIR_setQuadraticPriorParameter>;
+	if (boost::iequals(obj, "PLSPrior"))
+		return cSTIR_parameterSetter<cSTIR_setPLSPriorParameter>;
+	if (boost::iequals(obj, "GeneralisedObjectiveFunction"))
+		return
+		cSTIR_parameterSetter<cSTIR_setGeneralisedObjectiveFunctionParameter>;
+	if (boost::iequals(obj, "PoissonLogLikelihoodWithLinearModelForMean"))
+		return
+		cSTIR_parameterSetter<cSTIR_setPoissonLogLikelihoodWithLinearModelForMeanParameter>;
+	if (boost::iequals(obj,
+		"PoissonLogLikelihoodWithLinearModelForMeanAndProjData"))
+		return
+		cSTIR_parameterSetter<cSTIR_setPoissonLogLikelihoodWithLinearModelForMeanAndProjDataParameter>;
+	if (boost::iequals(obj, "Reconstruction"))
+		return cSTIR_parameterSetter<cSTIR_setReconstructionParameter>;
+	if (boost::iequals(obj, "IterativeReconstruction"))
+		return cSTIR_parameterSetter<cSTIR_setIterativeReconstructionParameter>;
+	if (boost::iequals(obj, "OSMAPOSL"))
+		return cSTIR_parameterSetter<cSTIR_setOSMAPOSLParameter>;
+	if (boost::iequals(obj, "OSSPS"))
+		return cSTIR_parameterSetter<cSTIR_setOSSPSParameter>;
+	if (boost::iequals(obj, "FBP2D"))
+		return cSTIR_parameterSetter<cSTIR_setFBP2DParameter>;
+	if (boost::iequals(obj, "DataContainer"))
+		return cSTIR_parameterSetter<cSTIR_setDataContainerParameter>;
+	if (boost::iequals(obj, "ObjectiveFunctionGradient"))
+		return
+		cSTIR_parameterSetter<cSTIR_setObjectiveFunctionGradientParameter>;
+	if (boost::iequals(obj, "SensitivityCache"))
+		return cSTIR_parameterSetter<cSTIR_setSensitivityCacheParameter>;
+	if (boost::iequals(obj, "Distributed"))
+		return cSTIR_parameterSetter<cSTIR_setDistributedParameter>;
+	if (boost::iequals(obj, "StorageBudget"))
+		return cSTIR_parameterSetter<cSTIR_setStorageBudgetParameter>;
+	if (boost::iequals(obj, "Solver"))
+		return cSTIR_parameterSetter<cSTIR_setSolverParameter>;
+	return 0;
+}
+
+// numeric parameters set by ids
+static ParameterTable parameter_table_;
+
 extern "C"
 void* cSTIR_setParameter
 (void* ptr_s, const char* obj, const char* name, const void* ptr_v)
 {
 	try {
-		CAST_PTR(DataHandle, hs, ptr_s);
-		CAST_PTR(DataHandle, hv, ptr_v);
-		if (boost::iequals(obj, "ListmodeToSinograms"))
-			return cSTIR_setListmodeToSinogramsParameter(ptr_s, name, ptr_v);
-		else if (boost::iequals(obj, "Shape"))
-			return cSTIR_setShapeParameter(ptr_s, name, ptr_v);
-		else if (boost::iequals(obj, "EllipsoidalCylinder"))
-			return cSTIR_setEllipsoidalCylinderParameter(hs, name, hv);
-		else if (boost::iequals(obj, "TruncateToCylindricalFOVImageProcessor"))
-			return cSTIR_setTruncateToCylindricalFOVImageProcessorParameter
-			(hs, name, hv);
-		else if (boost::iequals(obj, "AcquisitionModel"))
-			return cSTIR_setAcquisitionModelParameter(hs, name, hv);
-		else if (boost::iequals(obj, "AcqModUsingMatrix"))
-			return cSTIR_setAcqModUsingMatrixParameter(hs, name, hv);
-		else if (boost::iequals(obj, "RayTracingMatrix"))
-			return cSTIR_setRayTracingMatrixParameter(hs, name, hv);
-		else if (boost::iequals(obj, "GeneralisedPrior"))
-			return cSTIR_setGeneralisedPriorParameter(hs, name, hv);
-		else if (boost::iequals(obj, "QuadraticPrior"))
-			return cSTIR_setQuadraticPriorParameter(hs, name, hv);
-		else if (boost::iequals(obj, "PLSPrior"))
-			return cSTIR_setPLSPriorParameter(hs, name, hv);
-		else if (boost::iequals(obj, "GeneralisedObjectiveFunction"))
-			return cSTIR_setGeneralisedObjectiveFunctionParameter(hs, name, hv);
-		else if (boost::iequals(obj, "PoissonLogLikelihoodWithLinearModelForMean"))
-			return cSTIR_setPoissonLogLikelihoodWithLinearModelForMeanParameter
-			(hs, name, hv);
-		else if (boost::iequals(obj,
-			"PoissonLogLikelihoodWithLinearModelForMeanAndProjData"))
-			return
-			cSTIR_setPoissonLogLikelihoodWithLinearModelForMeanAndProjDataParameter
-			(hs, name, hv);
-		else if (boost::iequals(obj, "Reconstruction"))
-			return cSTIR_setReconstructionParameter(hs, name, hv);
-		else if (boost::iequals(obj, "IterativeReconstruction"))
-			return cSTIR_setIterativeReconstructionParameter(hs, name, hv);
-		else if (boost::iequals(obj, "OSMAPOSL"))
-			return cSTIR_setOSMAPOSLParameter(hs, name, hv);
-		else if (boost::iequals(obj, "OSSPS"))
-			return cSTIR_setOSSPSParameter(hs, name, hv);
-		else if (boost::iequals(obj, "FBP2D"))
-			return cSTIR_setFBP2DParameter(hs, name, hv);
-		else
+		ParameterSetter setter = parameter_setter_(obj);
+		if (!setter)
+			return unknownObject("object", obj, __FILE__, __LINE__);
+		return setter(ptr_s, name, ptr_v);
+	}
+	CATCH;
+}
+
+extern "C"
+void* cSTIR_parameterId(const char* obj, const char* name, int type)
+{
+	try {
+		ParameterSetter setter = parameter_setter_(obj);
+		if (!setter)
 			return unknownObject("object", obj, __FILE__, __LINE__);
+		return dataHandle<int>(parameter_table_.id(setter, name, type));
+	}
+	CATCH;
+}
+
+extern "C"
+void* cSTIR_setParameterById(void* ptr_s, int id, double value)
+{
+	try {
+		return parameter_table_.set(ptr_s, id, value);
+	}
+	CATCH;
+}
+
+extern "C"
+void* cSTIR_setParameters
+(void* ptr_s, int n, size_t ptr_ids, size_t ptr_values)
+{
+	try {
+		const int* ids = (const int*)ptr_ids;
+		const double* values = (const double*)ptr_values;
+		return parameter_table_.set(ptr_s, n, ids, values);
 	}
 	CATCH;
 }
@@ -159,6 +252,12 @@ void* cSTIR_parameter(const void* ptr, const char* obj, const char* name)
 			(handle, name);
 		else if (boost::iequals(obj, "RayTracingMatrix"))
 			return cSTIR_rayTracingMatrixParameter(handle, name);
+		else if (boost::iequals(obj, "MappedMatrix"))
+			return cSTIR_mappedMatrixParameter(handle, name);
+		else if (boost::iequals(obj, "AcquisitionModel"))
+			return cSTIR_acquisitionModelParameter(handle, name);
+		else if (boost::iequals(obj, "AttenuationModel"))
+			return cSTIR_attenuationModelParameter(handle, name);
 		else if (boost::iequals(obj, "AcqModUsingMatrix"))
 			return cSTIR_acqModUsingMatrixParameter(handle, name);
 		else if (boost::iequals(obj, "GeneralisedPrior"))
@@ -180,6 +279,18 @@ void* cSTIR_parameter(const void* ptr, const char* obj, const char* name)
 			return cSTIR_OSSPSParameter(handle, name);
 		else if (boost::iequals(obj, "FBP2D"))
 			return cSTIR_FBP2DParameter(handle, name);
+		else if (boost::iequals(obj, "DataContainer"))
+			return cSTIR_dataContainerParameter(handle, name);
+		else if (boost::iequals(obj, "ObjectiveFunctionGradient"))
+			return cSTIR_objectiveFunctionGradientParameter(handle, name);
+		else if (boost::iequals(obj, "SensitivityCache"))
+			return cSTIR_sensitivityCacheParameter(handle, name);
+		else if (boost::iequals(obj, "Distributed"))
+			return cSTIR_distributedParameter(handle, name);
+		else if (boost::iequals(obj, "StorageBudget"))
+			return cSTIR_storageBudgetParameter(handle, name);
+		else if (boost::iequals(obj, "Solver"))
+			return cSTIR_solverParameter(handle, name);
 		return unknownObject("object", obj, __FILE__, __LINE__);
 	}
 	CATCH;
@@ -211,6 +322,11 @@ void* cSTIR_objectFromFile(const char* name, const char* filename)
 				sptr(new ListmodeToSinograms(filename));
 			return newObjectHandle(sptr);
 		}
+		if (boost::iequals(name, "AcqModUsingParameterFile")) {
+			shared_ptr<AcqMod3DF>
+				sptr(new PETAcquisitionModelUsingParameterFile(filename));
+			return newObjectHandle(sptr);
+		}
 		return unknownObject("object", name, __FILE__, __LINE__);
 	}
 	CATCH;
@@ -224,7 +340,25 @@ void* cSTIR_setListmodeToSinogramsInterval(void* ptr_lm2s, size_t ptr_data)
 			objectFromHandle<ListmodeToSinograms>(ptr_lm2s);
 		float *data = (float *)ptr_data;
 		lm2s.set_time_interval((double)data[0], (double)data[1]);
-		return (void*)new DataHandle;
+		return okHandle();
+	}
+	CATCH;
+}
+
+extern "C"
+void* cSTIR_setListmodeToSinogramsFrames
+(void* ptr_lm2s, size_t ptr_data, int num_frames)
+{
+	try {
+		ListmodeToSinograms& lm2s =
+			objectFromHandle<ListmodeToSinograms>(ptr_lm2s);
+		float *data = (float *)ptr_data;
+		std::vector < std::pair<double, double> > intervals;
+		for (int i = 0; i < num_frames; i++)
+			intervals.push_back(std::pair<double, double>
+			((double)data[2 * i], (double)data[2 * i + 1]));
+		lm2s.set_time_intervals(intervals);
+		return okHandle();
 	}
 	CATCH;
 }
@@ -277,12 +411,28 @@ void* cSTIR_convertListmodeToSinograms(void* ptr)
 	CATCH;
 }
 
+extern "C"
+void* cSTIR_listmodeToSinogramsFrame(void* ptr, int frame)
+{
+	try {
+		ListmodeToSinograms& lm2s = objectFromHandle<ListmodeToSinograms>(ptr);
+		return newObjectHandle(lm2s.get_output(frame));
+	}
+	CATCH;
+}
+
 extern "C"
 void* cSTIR_computeRandoms(void* ptr)
+{
+	return cSTIR_computeFrameRandoms(ptr, 1);
+}
+
+extern "C"
+void* cSTIR_computeFrameRandoms(void* ptr, int frame)
 {
 	try {
 		ListmodeToSinograms& lm2s = objectFromHandle<ListmodeToSinograms>(ptr);
-		if (lm2s.estimate_randoms()) {
+		if (lm2s.estimate_randoms(frame)) {
 			ExecutionStatus status
 				("cSTIR_computeRandoms failed", __FILE__, __LINE__);
 			DataHandle* handle = new DataHandle;
@@ -438,7 +588,7 @@ void* cSTIR_acquisitionModelFwdReplace
 		AcqMod3DF& am = objectFromHandle<AcqMod3DF>(ptr_am);
 		PETImageData& id = objectFromHandle<PETImageData>(ptr_im);
 		PETAcquisitionData& ad = objectFromHandle<PETAcquisitionData>(ptr_ad);
-		am.forward(ad, id, subset_num, num_subsets);
+		am.forward(ad, id, subset_num, num_subsets, num_subsets > 1);
 		return new DataHandle;
 	}
 	CATCH;
@@ -456,6 +606,20 @@ void* cSTIR_acquisitionModelBwd(void* ptr_am, void* ptr_ad,
 	CATCH;
 }
 
+extern "C"
+void* cSTIR_acquisitionModelBwdReplace(void* ptr_am, void* ptr_ad,
+	int subset_num, int num_subsets, void* ptr_im)
+{
+	try {
+		AcqMod3DF& am = objectFromHandle<AcqMod3DF>(ptr_am);
+		PETAcquisitionData& ad = objectFromHandle<PETAcquisitionData>(ptr_ad);
+		PETImageData& id = objectFromHandle<PETImageData>(ptr_im);
+		am.backward(id, ad, subset_num, num_subsets);
+		return new DataHandle;
+	}
+	CATCH;
+}
+
 extern "C"
 void*
 cSTIR_setAcquisitionsStorageScheme(const char* scheme)
@@ -463,9 +627,11 @@ cSTIR_setAcquisitionsStorageScheme(const char* scheme)
 	try {
 		if (scheme[0] == 'f' || strcmp(scheme, "default") == 0)
 			PETAcquisitionDataInFile::set_as_template();
+		else if (scheme[0] == 'h')
+			PETAcquisitionDataHybrid::set_as_template();
 		else
 			PETAcquisitionDataInMemory::set_as_template();
-		return (void*)new DataHandle;
+		return okHandle();
 	}
 	CATCH;
 }
@@ -489,6 +655,25 @@ void* cSTIR_acquisitionsDataFromTemplate(void* ptr_t)
 	CATCH;
 }
 
+extern "C"
+void* cSTIR_reducedPrecisionAcquisitionData(void* ptr_t, const char* format)
+{
+	try {
+		SPTR_FROM_HANDLE(PETAcquisitionData, sptr_t, ptr_t);
+		ReducedPrecision::Format f;
+		try {
+			f = ReducedPrecision::format(format);
+		}
+		catch (std::invalid_argument& e) {
+			throw LocalisedException(e.what(), __FILE__, __LINE__);
+		}
+		shared_ptr<PETAcquisitionData> sptr
+			(new PETAcquisitionDataReducedPrecision(*sptr_t, f));
+		return newObjectHandle(sptr);
+	}
+	CATCH;
+}
+
 extern "C"
 void* cSTIR_rebinnedAcquisitionData(void* ptr_t, 
 const int num_segments_to_combine,
@@ -538,7 +723,7 @@ void* cSTIR_getAcquisitionsDimensions(const void* ptr_acq, size_t ptr_dim)
 		dim[0] = sptr_ad->get_num_tangential_poss();
 		dim[1] = sptr_ad->get_num_views();
 		dim[2] = sptr_ad->get_num_sinograms();
-		return (void*)new DataHandle;
+		return okHandle();
 	}
 	CATCH;
 }
@@ -550,7 +735,32 @@ void* cSTIR_getAcquisitionsData(const void* ptr_acq, size_t ptr_data)
 		float* data = (float*)ptr_data;
 		SPTR_FROM_HANDLE(PETAcquisitionData, sptr_ad, ptr_acq);
 		sptr_ad->copy_to(data);
-		return (void*)new DataHandle;
+		return okHandle();
+	}
+	CATCH;
+}
+
+extern "C"
+void* cSTIR_getAcquisitionsDataView(const void* ptr_acq, size_t ptr_view)
+{
+	try {
+		size_t* view = (size_t*)ptr_view;
+		SPTR_FROM_HANDLE(PETAcquisitionData, sptr_ad, ptr_acq);
+		// the view must not be left dangling by spilling
+		sptr_ad->pin_buffer();
+		float* data = sptr_ad->buffer();
+		if (!data) {
+			ExecutionStatus status("acquisition data not stored in memory",
+				__FILE__, __LINE__);
+			DataHandle* handle = new DataHandle;
+			handle->set(0, &status);
+			return (void*)handle;
+		}
+		view[0] = (size_t)data;
+		view[1] = sptr_ad->get_num_sinograms();
+		view[2] = sptr_ad->get_num_views();
+		view[3] = sptr_ad->get_num_tangential_poss();
+		return okHandle();
 	}
 	CATCH;
 }
@@ -561,7 +771,7 @@ void* cSTIR_fillAcquisitionsData(void* ptr_acq, float v)
 	try {
 		SPTR_FROM_HANDLE(PETAcquisitionData, sptr_ad, ptr_acq);
 		sptr_ad->fill(v);
-		return (void*)new DataHandle;
+		return okHandle();
 	}
 	CATCH;
 }
@@ -574,7 +784,7 @@ void* cSTIR_fillAcquisitionsDataFromAcquisitionsData
 		SPTR_FROM_HANDLE(PETAcquisitionData, sptr_ad, ptr_acq);
 		SPTR_FROM_HANDLE(PETAcquisitionData, sptr_from, ptr_from);
 		sptr_ad->fill(*sptr_from);
-		return (void*)new DataHandle;
+		return okHandle();
 	}
 	CATCH;
 }
@@ -586,7 +796,7 @@ void* cSTIR_setAcquisitionsData(void* ptr_acq, size_t ptr_data)
 		SPTR_FROM_HANDLE(PETAcquisitionData, sptr_ad, ptr_acq);
 		float *data = (float *)ptr_data;
 		sptr_ad->fill_from(data);
-		return (void*)new DataHandle;
+		return okHandle();
 	}
 	CATCH;
 }
@@ -597,7 +807,7 @@ void* cSTIR_writeAcquisitionData(void* ptr_acq, const char* filename)
 	try {
 		SPTR_FROM_HANDLE(PETAcquisitionData, sptr_ad, ptr_acq);
 		sptr_ad->write(filename);
-		return (void*)new DataHandle;
+		return okHandle();
 	}
 	CATCH;
 }
@@ -649,7 +859,14 @@ void* cSTIR_setupReconstruction(void* ptr_r, void* ptr_i)
 			objectFromHandle<xSTIR_IterativeReconstruction3DF>(ptr_r);
 		Succeeded s = Succeeded::no;
 		if (!recon.post_process()) {
+			ObjectiveFunction3DF& obj_fun = *recon.get_objective_function_sptr();
+			std::string key = PETSensitivityCache::key(obj_fun, *sptr_image);
+			bool cached = PETSensitivityCache::restore(key, obj_fun);
 			s = recon.setup(sptr_image);
+			if (cached)
+				PETSensitivityCache::release(obj_fun);
+			else if (s == Succeeded::yes)
+				PETSensitivityCache::store(key, obj_fun);
 			recon.subiteration() = recon.get_start_subiteration_num();
 		}
 		if (s != Succeeded::yes) {
@@ -705,8 +922,15 @@ void* cSTIR_setupObjectiveFunction(void* ptr_r, void* ptr_i)
 		xSTIR_GeneralisedObjectiveFunction3DF& obj_fun =
 			objectFromHandle<xSTIR_GeneralisedObjectiveFunction3DF>(ptr_r);
 		Succeeded s = Succeeded::no;
-		if (!obj_fun.post_process())
+		if (!obj_fun.post_process()) {
+			std::string key = PETSensitivityCache::key(obj_fun, *sptr_image);
+			bool cached = PETSensitivityCache::restore(key, obj_fun);
 			s = obj_fun.set_up(sptr_image);
+			if (cached)
+				PETSensitivityCache::release(obj_fun);
+			else if (s == Succeeded::yes)
+				PETSensitivityCache::store(key, obj_fun);
+		}
 		if (s != Succeeded::yes) {
 			ExecutionStatus status("cSTIR_setupObjectiveFunction failed",
 				__FILE__, __LINE__);
@@ -725,7 +949,7 @@ cSTIR_objectiveFunctionValue(void* ptr_f, void* ptr_i)
 		ObjectiveFunction3DF& fun = objectFromHandle< ObjectiveFunction3DF>(ptr_f);
 		PETImageData& id = objectFromHandle<PETImageData>(ptr_i);
 		Image3DF& image = id.data();
-		float v = (float)fun.compute_objective_function(image);
+		float v = (float)PETDistributed::compute_value(fun, image);
 		return dataHandle<float>(v);
 	}
 	CATCH;
@@ -759,17 +983,8 @@ cSTIR_objectiveFunctionGradient(void* ptr_f, void* ptr_i, int subset)
 		Image3DF& grad = sptr->data();
 		if (subset >= 0)
 			fun.compute_sub_gradient(grad, image, subset);
-		else {
-			int nsub = fun.get_num_subsets();
-			grad.fill(0.0);
-			PETImageData* ptr_id = new PETImageData(image);
-			shared_ptr<PETImageData> sptr_sub(ptr_id);
-			Image3DF& subgrad = sptr_sub->data();
-			for (int sub = 0; sub < nsub; sub++) {
-				fun.compute_sub_gradient(subgrad, image, sub);
-				grad += subgrad;
-			}
-		}
+		else
+			PETGradientThreads::compute_gradient(fun, grad, image);
 		return newObjectHandle(sptr);
 	}
 	CATCH;
@@ -833,6 +1048,24 @@ cSTIR_priorGradient(void* ptr_p, void* ptr_i)
 	CATCH;
 }
 
+extern "C"
+void*
+cSTIR_priorGradientReplace(void* ptr_p, void* ptr_i, void* ptr_g)
+{
+	try {
+		Prior3DF& prior = objectFromHandle<Prior3DF>(ptr_p);
+		PETImageData& id = objectFromHandle<PETImageData>(ptr_i);
+		PETImageData& gd = objectFromHandle<PETImageData>(ptr_g);
+		Image3DF& image = id.data();
+		Image3DF& grad = gd.data();
+		if (!grad.has_same_characteristics(image))
+			THROW("prior gradient image does not match the image");
+		prior.compute_gradient(grad, image);
+		return new DataHandle;
+	}
+	CATCH;
+}
+
 extern "C"
 void* cSTIR_voxels3DF
 (int nx, int ny, int nz,
@@ -1007,6 +1240,30 @@ void* cSTIR_getImageData(const void* ptr_im, size_t ptr_data)
 	CATCH;
 }
 
+extern "C"
+void* cSTIR_getImageDataView(const void* ptr_im, size_t ptr_view)
+{
+	try {
+		PETImageData& id = objectFromHandle<PETImageData>(ptr_im);
+		size_t* view = (size_t*)ptr_view;
+		float* data = id.data_view();
+		if (!data) {
+			ExecutionStatus status("image data not stored contiguously",
+				__FILE__, __LINE__);
+			DataHandle* handle = new DataHandle;
+			handle->set(0, &status);
+			return (void*)handle;
+		}
+		int dim[3];
+		id.get_dimensions(dim);
+		view[0] = (size_t)data;
+		for (int i = 0; i < 3; i++)
+			view[i + 1] = dim[i];
+		return okHandle();
+	}
+	CATCH;
+}
+
 extern "C"
 void* cSTIR_setImageData(const void* ptr_im, size_t ptr_data)
 {
@@ -1083,6 +1340,63 @@ cSTIR_axpby(
 	CATCH;
 }
 
+extern "C"
+void*
+cSTIR_axpbyAndNorm(
+	float a, const void* ptr_x,
+	float b, const void* ptr_y,
+	size_t ptr_norm
+) {
+	try {
+		aDataContainer<float>& x =
+			objectFromHandle<aDataContainer<float> >(ptr_x);
+		aDataContainer<float>& y =
+			objectFromHandle<aDataContainer<float> >(ptr_y);
+		float* norm = (float*)ptr_norm;
+		shared_ptr<aDataContainer<float> > sptr_z(x.new_data_container());
+		*norm = sptr_z->axpby_norm(a, x, b, y);
+		return newObjectHandle<aDataContainer<float> >(sptr_z);
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cSTIR_axpbyAndDot(
+	float a, const void* ptr_x,
+	float b, const void* ptr_y,
+	const void* ptr_z, size_t ptr_dot
+) {
+	try {
+		aDataContainer<float>& x =
+			objectFromHandle<aDataContainer<float> >(ptr_x);
+		aDataContainer<float>& y =
+			objectFromHandle<aDataContainer<float> >(ptr_y);
+		aDataContainer<float>& z =
+			objectFromHandle<aDataContainer<float> >(ptr_z);
+		float* dot = (float*)ptr_dot;
+		shared_ptr<aDataContainer<float> > sptr_w(x.new_data_container());
+		*dot = sptr_w->axpby_dot(a, x, b, y, z);
+		return newObjectHandle<aDataContainer<float> >(sptr_w);
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cSTIR_xapy(void* ptr_y, float a, const void* ptr_x)
+{
+	try {
+		aDataContainer<float>& y =
+			objectFromHandle<aDataContainer<float> >(ptr_y);
+		aDataContainer<float>& x =
+			objectFromHandle<aDataContainer<float> >(ptr_x);
+		y.xapy(a, x);
+		return okHandle();
+	}
+	CATCH;
+}
+
 extern "C"
 void*
 cSTIR_multiply(const void* ptr_x, const void* ptr_y)
@@ -1115,3 +1429,198 @@ cSTIR_divide(const void* ptr_x, const void* ptr_y)
 	CATCH;
 }
 
+typedef DataContainerExpression<float> Expression;
+
+extern "C"
+void*
+cSTIR_expression(float a, const void* ptr_x)
+{
+	try {
+		SPTR_FROM_HANDLE(aDataContainer<float>, sptr_x, ptr_x);
+		shared_ptr<Expression> sptr_e(new Expression(a, sptr_x));
+		return newObjectHandle<Expression>(sptr_e);
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cSTIR_expressionAxpby(float a, const void* ptr_e, float b, const void* ptr_f)
+{
+	try {
+		Expression& e = objectFromHandle<Expression>(ptr_e);
+		Expression& f = objectFromHandle<Expression>(ptr_f);
+		shared_ptr<Expression> sptr_g(new Expression(a, e, b, f));
+		return newObjectHandle<Expression>(sptr_g);
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cSTIR_evaluateExpression(const void* ptr_e)
+{
+	try {
+		Expression& e = objectFromHandle<Expression>(ptr_e);
+		shared_ptr<aDataContainer<float> > sptr_z(e.evaluate());
+		return newObjectHandle<aDataContainer<float> >(sptr_z);
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cSTIR_evaluateExpressionTo(const void* ptr_e, void* ptr_z)
+{
+	try {
+		Expression& e = objectFromHandle<Expression>(ptr_e);
+		aDataContainer<float>& z =
+			objectFromHandle<aDataContainer<float> >(ptr_z);
+		e.evaluate(z);
+		return new DataHandle;
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cSTIR_expressionDot(const void* ptr_e, const void* ptr_y)
+{
+	try {
+		Expression& e = objectFromHandle<Expression>(ptr_e);
+		aDataContainer<float>& y =
+			objectFromHandle<aDataContainer<float> >(ptr_y);
+		return dataHandle(e.dot(y));
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cSTIR_expressionNorm(const void* ptr_e)
+{
+	try {
+		Expression& e = objectFromHandle<Expression>(ptr_e);
+		return dataHandle(e.norm());
+	}
+	CATCH;
+}
+
+
+extern "C"
+void*
+cSTIR_profiler(const char* format)
+{
+	try {
+		std::string s;
+		if (boost::iequals(format, "text"))
+			s = sirf::Profiler::report();
+		else if (boost::iequals(format, "json"))
+			s = sirf::Profiler::report_json();
+		else if (boost::iequals(format, "trace"))
+			s = sirf::Profiler::trace_json();
+		else
+			return unknownObject("profiler format", format, __FILE__, __LINE__);
+		return charDataHandleFromCharData(s.c_str());
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cSTIR_setProfiler(int enabled, int tracing)
+{
+	try {
+		sirf::Profiler::set_enabled(enabled != 0);
+		sirf::Profiler::set_tracing(tracing != 0);
+		return okHandle();
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cSTIR_resetProfiler()
+{
+	try {
+		sirf::Profiler::reset();
+		return okHandle();
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cSTIR_setThreadPool(int num_threads, const char* affinity)
+{
+	try {
+		sirf::ThreadPool::Affinity a;
+		if (boost::iequals(affinity, "none"))
+			a = sirf::ThreadPool::NONE;
+		else if (boost::iequals(affinity, "compact"))
+			a = sirf::ThreadPool::COMPACT;
+		else if (boost::iequals(affinity, "scatter"))
+			a = sirf::ThreadPool::SCATTER;
+		else
+			return unknownObject("thread affinity", affinity, __FILE__, __LINE__);
+		sirf::ThreadPool::configure(num_threads, a);
+#ifdef _OPENMP
+		// the OpenMP regions of STIR itself entered from this thread
+		omp_set_num_threads(sirf::ThreadPool::num_threads());
+#endif
+		return okHandle();
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cSTIR_threadPoolSize()
+{
+	try {
+		return dataHandle<int>(sirf::ThreadPool::num_threads());
+	}
+	CATCH;
+}
+
+/*
+Pays the one-off costs of the first use of the module, so that worker
+processes forked afterwards do not; the thread pool threads are started on
+demand in each process. The STIR object registries are filled when the
+module is loaded.
+*/
+extern "C"
+void*
+cSTIR_warmUp()
+{
+	try {
+		PETAcquisitionDataInFile::init();
+		// the file format registries are set up at their first use
+		InputFileFormatRegistry<Image3DF>::default_sptr();
+		OutputFileFormat<Image3DF>::default_sptr();
+		sirf::ThreadPool::numa_nodes();
+		return okHandle();
+	}
+	CATCH;
+}
+
+extern "C"
+void*
+cSTIR_runSolver(void* ptr, int n_iter)
+{
+	try {
+		aSolver<float>& solver = objectFromHandle< aSolver<float> >(ptr);
+		// the solvers report errors via standard exceptions
+		try {
+			solver.run(n_iter);
+		}
+		catch (LocalisedException&) {
+			throw;
+		}
+		catch (std::exception& e) {
+			throw LocalisedException(e.what(), __FILE__, __LINE__);
+		}
+		return okHandle();
+	}
+	CATCH;
+}
@@ -38,15 +38,23 @@ extern "C" {
 	void* cSTIR_setParameter
 		(void* ptr, const char* obj, const char* name, const void* value);
 	void* cSTIR_parameter(const void* ptr, const char* obj, const char* name);
+	void* cSTIR_parameterId(const char* obj, const char* name, int type);
+	void* cSTIR_setParameterById(void* ptr, int id, double value);
+	void* cSTIR_setParameters
+		(void* ptr, int n, PTR_INT ptr_ids, PTR_DOUBLE ptr_values);
 
 	// ListmodeToSinogram methods
 	void* cSTIR_setListmodeToSinogramsInterval
 		(void* ptr_acq, PTR_FLOAT ptr_data);
+	void* cSTIR_setListmodeToSinogramsFrames
+		(void* ptr_lm2s, PTR_FLOAT ptr_data, int num_frames);
 	void* cSTIR_setListmodeToSinogramsFlag
 		(void* ptr_lm2s, const char* flag, int v);
 	void* cSTIR_setupListmodeToSinogramsConverter(void* ptr);
 	void* cSTIR_convertListmodeToSinograms(void* ptr);
+	void* cSTIR_listmodeToSinogramsFrame(void* ptr, int frame);
 	void* cSTIR_computeRandoms(void* ptr);
+	void* cSTIR_computeFrameRandoms(void* ptr, int frame);
 
 	// Data processor methods
 	void* cSTIR_applyImageDataProcessor(const void* ptr_p, void* ptr_d);
@@ -68,11 +76,14 @@ extern "C" {
 		(void* ptr_am, void* ptr_im, int subset_num, int num_subsets, void* ptr_ad);
 	void* cSTIR_acquisitionModelBwd(void* ptr_am, void* ptr_ad,
 		int subset_num, int num_subsets);
+	void* cSTIR_acquisitionModelBwdReplace(void* ptr_am, void* ptr_ad,
+		int subset_num, int num_subsets, void* ptr_im);
 
 	// Acquisition data methods
 	void* cSTIR_getAcquisitionsStorageScheme();
 	void* cSTIR_setAcquisitionsStorageScheme(const char* scheme);
 	void* cSTIR_acquisitionsDataFromTemplate(void* ptr_t);
+	void* cSTIR_reducedPrecisionAcquisitionData(void* ptr_t, const char* format);
 	void* cSTIR_rebinnedAcquisitionData(void* ptr_t,
 		const int num_segments_to_combine,
 		const int num_views_to_combine,
@@ -84,6 +95,7 @@ extern "C" {
 		(const char* scanner, int span, int max_ring_diff, int view_mash_factor);
 	void* cSTIR_getAcquisitionsDimensions(const void* ptr_acq, PTR_INT ptr_dim);
 	void* cSTIR_getAcquisitionsData(const void* ptr_acq, PTR_FLOAT ptr_data);
+	void* cSTIR_getAcquisitionsDataView(const void* ptr_acq, PTR_INT ptr_view);
 	void* cSTIR_setAcquisitionsData(void* ptr_acq, PTR_FLOAT ptr_data);
 	void* cSTIR_fillAcquisitionsData(void* ptr_acq, float v);
 	void* cSTIR_fillAcquisitionsDataFromAcquisitionsData
@@ -109,11 +121,13 @@ extern "C" {
 	// Prior methods
 	void* cSTIR_setupPrior(void* ptr_p, void* ptr_i);
 	void* cSTIR_priorGradient(void* ptr_p, void* ptr_i);
+	void* cSTIR_priorGradientReplace(void* ptr_p, void* ptr_i, void* ptr_g);
 
 	// Image methods
 	void* cSTIR_getImageDimensions(const void* ptr, PTR_INT ptr_data);
 	void* cSTIR_getImageVoxelSizes(const void* ptr_im, PTR_FLOAT ptr_vs);
 	void* cSTIR_getImageData(const void* ptr, PTR_FLOAT ptr_data);
+	void* cSTIR_getImageDataView(const void* ptr, PTR_INT ptr_view);
 	void* cSTIR_setImageData(const void* ptr_im, PTR_FLOAT ptr_data);
 	void* cSTIR_voxels3DF(int nx, int ny, int nz,
 		float sx, float sy, float sz, float x, float y, float z);
@@ -131,9 +145,38 @@ extern "C" {
 	void*	cSTIR_dot(const void* ptr_x, const void* ptr_y);
 	//void* cSTIR_mult(float a, const void* ptr_x);
 	void* cSTIR_axpby(float a, const void* ptr_x, float b, const void* ptr_y);
+	void* cSTIR_axpbyAndNorm(float a, const void* ptr_x,
+		float b, const void* ptr_y, PTR_FLOAT ptr_norm);
+	void* cSTIR_axpbyAndDot(float a, const void* ptr_x,
+		float b, const void* ptr_y, const void* ptr_z, PTR_FLOAT ptr_dot);
+	void* cSTIR_xapy(void* ptr_y, float a, const void* ptr_x);
 	void* cSTIR_multiply(const void* ptr_x, const void* ptr_y);
 	void* cSTIR_divide(const void* ptr_x, const void* ptr_y);
 
+	// Deferred data container expression methods
+	void* cSTIR_expression(float a, const void* ptr_x);
+	void* cSTIR_expressionAxpby
+		(float a, const void* ptr_e, float b, const void* ptr_f);
+	void* cSTIR_evaluateExpression(const void* ptr_e);
+	void* cSTIR_evaluateExpressionTo(const void* ptr_e, void* ptr_z);
+	void* cSTIR_expressionDot(const void* ptr_e, const void* ptr_y);
+	void* cSTIR_expressionNorm(const void* ptr_e);
+
+	// Profiler methods
+	void* cSTIR_profiler(const char* format);
+	void* cSTIR_setProfiler(int enabled, int tracing);
+	void* cSTIR_resetProfiler();
+
+	// Thread pool methods
+	void* cSTIR_setThreadPool(int num_threads, const char* affinity);
+	void* cSTIR_threadPoolSize();
+
+	// Start-up methods
+	void* cSTIR_warmUp();
+
+	// Solver methods
+	void* cSTIR_runSolver(void* ptr, int n_iter);
+
 	// TextWriter methods
 	void* newTextPrinter(const char* stream);
 	void* newTextWriter(const char* stream);
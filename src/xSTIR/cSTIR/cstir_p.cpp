@@ -90,6 +90,8 @@ sirf::cSTIR_setListmodeToSinogramsParameter(void* hp, const char* name, const vo
 		lm2s.set_output(charDataFromHandle(hv));
 	else if (boost::iequals(name, "template"))
 		lm2s.set_template(charDataFromHandle(hv));
+	else if (boost::iequals(name, "num_threads"))
+		lm2s.set_num_threads(dataFromHandle<int>(hv));
 	else
 		return parameterNotFound(name, __FILE__, __LINE__);
 	return new DataHandle;
@@ -210,6 +212,31 @@ sirf::cSTIR_rayTracingMatrixParameter(const DataHandle* handle, const char* name
 	return parameterNotFound(name, __FILE__, __LINE__);
 }
 
+void*
+sirf::cSTIR_setMappedMatrixParameter
+(DataHandle* hp, const char* name, const DataHandle* hv)
+{
+	ProjMatrixByBinMapped& matrix =
+		objectFromHandle<ProjMatrixByBinMapped>(hp);
+	if (boost::iequals(name, "source"))
+		matrix.set_source(objectSptrFromHandle<ProjMatrixByBin>(hv));
+	else if (boost::iequals(name, "filename"))
+		matrix.set_filename(charDataFromDataHandle(hv));
+	else
+		return parameterNotFound(name, __FILE__, __LINE__);
+	return new DataHandle;
+}
+
+void*
+sirf::cSTIR_mappedMatrixParameter(const DataHandle* handle, const char* name)
+{
+	ProjMatrixByBinMapped& matrix =
+		objectFromHandle<ProjMatrixByBinMapped>(handle);
+	if (boost::iequals(name, "filename"))
+		return charDataHandleFromCharData(matrix.filename().c_str());
+	return parameterNotFound(name, __FILE__, __LINE__);
+}
+
 void*
 sirf::cSTIR_setAcquisitionModelParameter
 (DataHandle* hp, const char* name, const DataHandle* hv)
@@ -226,11 +253,55 @@ sirf::cSTIR_setAcquisitionModelParameter
 			(objectSptrFromHandle<PETAcquisitionSensitivityModel>(hv));
 	//else if (boost::iequals(name, "bin_efficiency"))
 	//	am.set_bin_efficiency(objectSptrFromHandle<PETAcquisitionData>(hv));
+	else if (boost::iequals(name, "verbosity"))
+		am.set_verbosity(dataFromHandle<int>((void*)hv));
+	else
+		return parameterNotFound(name, __FILE__, __LINE__);
+	return new DataHandle;
+}
+
+void*
+sirf::cSTIR_acquisitionModelParameter(DataHandle* hp, const char* name)
+{
+	AcqMod3DF& am = objectFromHandle< AcqMod3DF >(hp);
+	if (boost::iequals(name, "verbosity"))
+		return dataHandle<int>(am.verbosity());
+	return parameterNotFound(name, __FILE__, __LINE__);
+}
+
+static PETAttenuationModel&
+attenuation_model_(const DataHandle* h)
+{
+	PETAcquisitionSensitivityModel& sm =
+		objectFromHandle<PETAcquisitionSensitivityModel>(h);
+	PETAttenuationModel* ptr_am = dynamic_cast<PETAttenuationModel*>(&sm);
+	if (!ptr_am)
+		throw LocalisedException
+		("not an attenuation sensitivity model", __FILE__, __LINE__);
+	return *ptr_am;
+}
+
+void*
+sirf::cSTIR_setAttenuationModelParameter
+(DataHandle* hp, const char* name, const DataHandle* hv)
+{
+	PETAttenuationModel& am = attenuation_model_(hp);
+	if (boost::iequals(name, "cache"))
+		am.set_cache(dataFromHandle<int>((void*)hv) != 0);
 	else
 		return parameterNotFound(name, __FILE__, __LINE__);
 	return new DataHandle;
 }
 
+void*
+sirf::cSTIR_attenuationModelParameter(const DataHandle* hp, const char* name)
+{
+	PETAttenuationModel& am = attenuation_model_(hp);
+	if (boost::iequals(name, "cache"))
+		return dataHandle<int>(am.cache());
+	return parameterNotFound(name, __FILE__, __LINE__);
+}
+
 void*
 sirf::cSTIR_setAcqModUsingMatrixParameter
 (DataHandle* hm, const char* name, const DataHandle* hv)
@@ -572,6 +643,8 @@ sirf::cSTIR_setFBP2DParameter(DataHandle* hp, const char* name, const DataHandle
 		double fc = dataFromHandle<float>(hv);
 		recon.set_frequency_cut_off(fc);
 	}
+	else if (boost::iequals(name, "parallel"))
+		recon.set_parallel(dataFromHandle<int>(hv) != 0);
 	else
 		return parameterNotFound(name, __FILE__, __LINE__);
 	return new DataHandle;
@@ -584,6 +657,223 @@ sirf::cSTIR_FBP2DParameter(DataHandle* hp, const char* name)
 		objectFromHandle<xSTIR_FBP2DReconstruction >(hp);
 	if (boost::iequals(name, "output"))
 		return newObjectHandle(recon.get_output());
+	if (boost::iequals(name, "parallel"))
+		return dataHandle<int>(recon.parallel());
+	return parameterNotFound(name, __FILE__, __LINE__);
+}
+
+// data container parameters are global: hp is not used
+void*
+sirf::cSTIR_setDataContainerParameter
+(DataHandle* hp, const char* name, const DataHandle* hv)
+{
+	if (boost::iequals(name, "num_threads"))
+		PETAlgebraThreads::set(dataFromHandle<int>(hv));
+	else
+		return parameterNotFound(name, __FILE__, __LINE__);
+	return new DataHandle;
+}
+
+void*
+sirf::cSTIR_dataContainerParameter(DataHandle* hp, const char* name)
+{
+	if (boost::iequals(name, "num_threads"))
+		return dataHandle<int>(PETAlgebraThreads::get());
+	return parameterNotFound(name, __FILE__, __LINE__);
+}
+
+// full gradient parameters are global: hp is not used
+void*
+sirf::cSTIR_setObjectiveFunctionGradientParameter
+(DataHandle* hp, const char* name, const DataHandle* hv)
+{
+	if (boost::iequals(name, "num_threads"))
+		PETGradientThreads::set(dataFromHandle<int>(hv));
+	else if (boost::iequals(name, "memory_limit"))
+		PETGradientThreads::set_memory_limit(dataFromHandle<int>(hv));
+	else
+		return parameterNotFound(name, __FILE__, __LINE__);
+	return new DataHandle;
+}
+
+void*
+sirf::cSTIR_objectiveFunctionGradientParameter(DataHandle* hp, const char* name)
+{
+	if (boost::iequals(name, "num_threads"))
+		return dataHandle<int>(PETGradientThreads::get());
+	if (boost::iequals(name, "memory_limit"))
+		return dataHandle<int>(PETGradientThreads::memory_limit());
+	return parameterNotFound(name, __FILE__, __LINE__);
+}
+
+// sensitivity cache parameters are global: hp is not used
+void*
+sirf::cSTIR_setSensitivityCacheParameter
+(DataHandle* hp, const char* name, const DataHandle* hv)
+{
+	if (boost::iequals(name, "enabled"))
+		PETSensitivityCache::set_enabled(dataFromHandle<int>(hv) != 0);
+	else if (boost::iequals(name, "directory"))
+		PETSensitivityCache::set_directory(charDataFromDataHandle(hv));
+	else if (boost::iequals(name, "clear"))
+		PETSensitivityCache::clear();
+	else
+		return parameterNotFound(name, __FILE__, __LINE__);
+	return new DataHandle;
+}
+
+void*
+sirf::cSTIR_sensitivityCacheParameter(DataHandle* hp, const char* name)
+{
+	if (boost::iequals(name, "enabled"))
+		return dataHandle<int>(PETSensitivityCache::enabled());
+	if (boost::iequals(name, "directory"))
+		return charDataHandleFromCharData
+			(PETSensitivityCache::directory().c_str());
 	return parameterNotFound(name, __FILE__, __LINE__);
 }
 
+// MPI distribution parameters are global: hp is not used
+void*
+sirf::cSTIR_setDistributedParameter
+(DataHandle* hp, const char* name, const DataHandle* hv)
+{
+	if (boost::iequals(name, "enabled"))
+		PETDistributed::set_enabled(dataFromHandle<int>(hv) != 0);
+	else
+		return parameterNotFound(name, __FILE__, __LINE__);
+	return new DataHandle;
+}
+
+void*
+sirf::cSTIR_distributedParameter(DataHandle* hp, const char* name)
+{
+	if (boost::iequals(name, "enabled"))
+		return dataHandle<int>(PETDistributed::enabled());
+	if (boost::iequals(name, "active"))
+		return dataHandle<int>(PETDistributed::active());
+	if (boost::iequals(name, "rank"))
+		return dataHandle<int>(PETDistributed::rank());
+	if (boost::iequals(name, "size"))
+		return dataHandle<int>(PETDistributed::size());
+	return parameterNotFound(name, __FILE__, __LINE__);
+}
+
+// storage budget parameters are global: hp is not used
+void*
+sirf::cSTIR_setStorageBudgetParameter
+(DataHandle* hp, const char* name, const DataHandle* hv)
+{
+	if (boost::iequals(name, "limit")) {
+		int mb = dataFromHandle<int>(hv);
+		StorageBudget::set_limit(mb > 0 ? (size_t)mb << 20 : 0);
+	}
+	else if (boost::iequals(name, "scratch_directory"))
+		StorageBudget::set_scratch_directory(charDataFromDataHandle(hv));
+	else
+		return parameterNotFound(name, __FILE__, __LINE__);
+	return new DataHandle;
+}
+
+void*
+sirf::cSTIR_storageBudgetParameter(DataHandle* hp, const char* name)
+{
+	if (boost::iequals(name, "limit"))
+		return dataHandle<int>((int)(StorageBudget::limit() >> 20));
+	if (boost::iequals(name, "scratch_directory"))
+		return charDataHandleFromCharData
+			(StorageBudget::scratch_directory().c_str());
+	if (boost::iequals(name, "resident_bytes"))
+		return dataHandle<double>((double)StorageBudget::resident_bytes());
+	if (boost::iequals(name, "spilled_bytes"))
+		return dataHandle<double>((double)StorageBudget::spilled_bytes());
+	return parameterNotFound(name, __FILE__, __LINE__);
+}
+
+// the least squares objective of a steepest descent solver, created on the
+// first setting of its acquisition model or data
+static LeastSquaresObjective<float>&
+least_squares_(SteepestDescent<float>& sd)
+{
+	std::shared_ptr<aObjective<float> > sptr_obj = sd.objective();
+	LeastSquaresObjective<float>* ls =
+		dynamic_cast<LeastSquaresObjective<float>*>(sptr_obj.get());
+	if (ls)
+		return *ls;
+	std::shared_ptr<LeastSquaresObjective<float> >
+		sptr_ls(new LeastSquaresObjective<float>);
+	sd.set_objective(sptr_ls);
+	return *sptr_ls;
+}
+
+void*
+sirf::cSTIR_setSolverParameter
+(DataHandle* hp, const char* name, const DataHandle* hv)
+{
+	aSolver<float>& solver = objectFromHandle< aSolver<float> >(hp);
+	CGLS<float>* cgls = dynamic_cast<CGLS<float>*>(&solver);
+	SteepestDescent<float>* sd = dynamic_cast<SteepestDescent<float>*>(&solver);
+	PDHG<float>* pdhg = dynamic_cast<PDHG<float>*>(&solver);
+	if (boost::iequals(name, "initial_estimate"))
+		solver.set_initial_estimate(objectFromHandle<PETImageData>(hv));
+	else if (boost::iequals(name, "acquisition_model")) {
+		std::shared_ptr<aLinearOperator<float> > sptr_op
+			(new PETAcquisitionModelOperator
+			(objectSptrFromHandle<AcqMod3DF>(hv)));
+		if (cgls)
+			cgls->set_operator(sptr_op);
+		else if (pdhg)
+			pdhg->set_operator(sptr_op);
+		else
+			least_squares_(*sd).set_operator(sptr_op);
+	}
+	else if (boost::iequals(name, "acquisition_data")) {
+		PETAcquisitionData& ad = objectFromHandle<PETAcquisitionData>(hv);
+		if (cgls)
+			cgls->set_data(ad);
+		else if (pdhg)
+			pdhg->set_data(ad);
+		else
+			least_squares_(*sd).set_data(ad);
+	}
+	else if (sd && boost::iequals(name, "objective_function"))
+		sd->set_objective(std::shared_ptr<aObjective<float> >(new PETObjective
+			(objectSptrFromHandle<ObjectiveFunction3DF>(hv))));
+	else if (pdhg && boost::iequals(name, "prior"))
+		pdhg->set_prior(std::shared_ptr<aObjective<float> >
+			(new PETPrior(objectSptrFromHandle<Prior3DF>(hv))));
+	else if (sd && boost::iequals(name, "step_size"))
+		sd->set_step_size(dataFromHandle<float>((void*)hv));
+	else if (pdhg && boost::iequals(name, "sigma"))
+		pdhg->set_sigma(dataFromHandle<float>((void*)hv));
+	else if (pdhg && boost::iequals(name, "tau"))
+		pdhg->set_tau(dataFromHandle<float>((void*)hv));
+	else
+		return parameterNotFound(name, __FILE__, __LINE__);
+	return new DataHandle;
+}
+
+void*
+sirf::cSTIR_solverParameter(DataHandle* hp, const char* name)
+{
+	aSolver<float>& solver = objectFromHandle< aSolver<float> >(hp);
+	CGLS<float>* cgls = dynamic_cast<CGLS<float>*>(&solver);
+	SteepestDescent<float>* sd = dynamic_cast<SteepestDescent<float>*>(&solver);
+	PDHG<float>* pdhg = dynamic_cast<PDHG<float>*>(&solver);
+	if (boost::iequals(name, "current_estimate")) {
+		PETImageData& x = (PETImageData&)solver.current_estimate();
+		shared_ptr<PETImageData> sptr(new PETImageData(x.data()));
+		return newObjectHandle(sptr);
+	}
+	if (boost::iequals(name, "iteration"))
+		return dataHandle<int>(solver.iteration());
+	if (cgls && boost::iequals(name, "residual_norm"))
+		return dataHandle<float>(cgls->residual_norm());
+	if (sd && boost::iequals(name, "step_size"))
+		return dataHandle<float>(sd->last_step());
+	if (pdhg && boost::iequals(name, "sigma"))
+		return dataHandle<float>(pdhg->sigma());
+	if (pdhg && boost::iequals(name, "tau"))
+		return dataHandle<float>(pdhg->tau());
+	return parameterNotFound(name, __FILE__, __LINE__);
+}
@@ -48,9 +48,24 @@ namespace sirf {
 	void*
 		cSTIR_rayTracingMatrixParameter(const DataHandle* handle, const char* name);
 
+	void*
+		cSTIR_setMappedMatrixParameter
+		(DataHandle* hp, const char* name, const DataHandle* hv);
+
+	void*
+		cSTIR_mappedMatrixParameter(const DataHandle* handle, const char* name);
+
 	void*
 		cSTIR_setAcquisitionModelParameter
 		(DataHandle* hp, const char* name, const DataHandle* hv);
+	void*
+		cSTIR_acquisitionModelParameter(DataHandle* hp, const char* name);
+
+	void*
+		cSTIR_setAttenuationModelParameter
+		(DataHandle* hp, const char* name, const DataHandle* hv);
+	void*
+		cSTIR_attenuationModelParameter(const DataHandle* hp, const char* name);
 
 	void*
 		cSTIR_setAcqModUsingMatrixParameter
@@ -136,6 +151,48 @@ namespace sirf {
 	void*
 		cSTIR_FBP2DParameter(DataHandle* hp, const char* name);
 
+	void*
+		cSTIR_setDataContainerParameter
+		(DataHandle* hp, const char* name, const DataHandle* hv);
+
+	void*
+		cSTIR_dataContainerParameter(DataHandle* hp, const char* name);
+
+	void*
+		cSTIR_setObjectiveFunctionGradientParameter
+		(DataHandle* hp, const char* name, const DataHandle* hv);
+
+	void*
+		cSTIR_objectiveFunctionGradientParameter(DataHandle* hp, const char* name);
+
+	void*
+		cSTIR_setSensitivityCacheParameter
+		(DataHandle* hp, const char* name, const DataHandle* hv);
+
+	void*
+		cSTIR_sensitivityCacheParameter(DataHandle* hp, const char* name);
+
+	void*
+		cSTIR_setDistributedParameter
+		(DataHandle* hp, const char* name, const DataHandle* hv);
+
+	void*
+		cSTIR_distributedParameter(DataHandle* hp, const char* name);
+
+	void*
+		cSTIR_setStorageBudgetParameter
+		(DataHandle* hp, const char* name, const DataHandle* hv);
+
+	void*
+		cSTIR_storageBudgetParameter(DataHandle* hp, const char* name);
+
+	void*
+		cSTIR_setSolverParameter
+		(DataHandle* hp, const char* name, const DataHandle* hv);
+
+	void*
+		cSTIR_solverParameter(DataHandle* hp, const char* name);
+
 }
 
 #endif
\ No newline at end of file
@@ -18,6 +18,18 @@ limitations under the License.
 
 */
 
+#include <algorithm>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "stir/IndexRange2D.h"
+#include "stir/IO/interfile.h"
+
+#include "SIRF/common/profiler.h"
+#include "SIRF/common/thread_pool.h"
 #include "stir_data_containers.h"
 
 using namespace stir;
@@ -25,28 +37,584 @@ using namespace sirf;
 
 std::string PETAcquisitionData::_storage_scheme;
 shared_ptr<PETAcquisitionData> PETAcquisitionData::_template;
+bool PETAcquisitionDataInFile::_memory_mapped = true;
 
-float
-PETAcquisitionData::norm()
+ProjDataMappedStorage::ProjDataMappedStorage
+(const ProjDataInfo& pdi, const std::string& filename, bool owns_file) :
+	_filename(filename), _owns_file(owns_file)
+{
+	using namespace boost::interprocess;
+	size_t size = num_bins(pdi);
+	std::string data_file = filename + ".s";
+	{
+		std::filebuf fb;
+		if (!fb.open(data_file.c_str(),
+			std::ios::out | std::ios::trunc | std::ios::binary))
+			throw LocalisedException
+			("cannot create memory-mapped data file", __FILE__, __LINE__);
+		if (size > 0) {
+			fb.pubseekoff(size*sizeof(float) - 1, std::ios::beg);
+			fb.sputc(0);
+		}
+	}
+	if (size < 1)
+		return;
+	_mapping.reset(new file_mapping(data_file.c_str(), read_write));
+	_region.reset(new mapped_region(*_mapping, read_write));
+	attach((float*)_region->get_address(), size);
+}
+
+ProjDataMappedStorage::~ProjDataMappedStorage()
+{
+	if (_region && !_owns_file)
+		_region->flush();
+	_region.reset();
+	_mapping.reset();
+	if (!_owns_file)
+		return;
+	int err;
+	err = std::remove((_filename + ".hs").c_str());
+	if (err)
+		std::cout << "deleting " << _filename << ".hs "
+		<< "failed, please delete manually" << std::endl;
+	err = std::remove((_filename + ".s").c_str());
+	if (err)
+		std::cout << "deleting " << _filename << ".s "
+		<< "failed, please delete manually" << std::endl;
+}
+
+void
+ProjDataMappedStorage::advise_sequential()
+{
+	if (_region)
+		_region->advise(boost::interprocess::mapped_region::advice_sequential);
+}
+
+ProjDataMapped::ProjDataMapped(shared_ptr<ExamInfo> sptr_exam_info,
+	shared_ptr<ProjDataInfo> sptr_proj_data_info,
+	const std::string& filename, bool owns_file) :
+	ProjDataMappedStorage(*sptr_proj_data_info, filename, owns_file),
+	ProjDataFromStream(sptr_exam_info, sptr_proj_data_info,
+	_stream, 0, segment_sequence(*sptr_proj_data_info),
+	ProjDataFromStream::Segment_AxialPos_View_TangPos)
+{
+	write_basic_interfile_PDFS_header(filename + ".hs", filename + ".s", *this);
+}
+
+ProjData*
+PETAcquisitionDataInFile::scratch_data
+(shared_ptr<ExamInfo> sptr_exam_info, shared_ptr<ProjDataInfo> sptr_proj_data_info,
+	bool zero)
+{
+	_filename = SIRFUtilities::scratch_file_name();
+	if (_memory_mapped) {
+		try {
+			return new ProjDataMapped
+				(sptr_exam_info, sptr_proj_data_info, _filename);
+		}
+		catch (...) {
+			// e.g. not enough address space, use a stream-based file
+			std::remove((_filename + ".hs").c_str());
+			std::remove((_filename + ".s").c_str());
+		}
+	}
+	ProjDataFile* ptr = new ProjDataFile
+		(sptr_exam_info, sptr_proj_data_info, _filename);
+	if (zero)
+		ptr->fill(0.0f);
+	return ptr;
+}
+
+ProjDataReducedPrecision::ProjDataReducedPrecision
+(const ProjData& pd, ReducedPrecision::Format format) :
+	ProjData(pd.get_exam_info_sptr(), pd.get_proj_data_info_sptr()),
+	_format(format)
+{
+	const ProjDataInfo& pdi = *get_proj_data_info_ptr();
+	int min_seg = pdi.get_min_segment_num();
+	std::vector<int> seq = ProjDataBufferStorage::segment_sequence(pdi);
+	size_t sino_size = (size_t)pdi.get_num_views()*pdi.get_num_tangential_poss();
+	size_t n = 0;
+	_offset.assign(pdi.get_max_segment_num() - min_seg + 1, 0);
+	for (size_t i = 0; i < seq.size(); i++) {
+		_offset[seq[i] - min_seg] = n;
+		n += sino_size*pdi.get_num_axial_poss(seq[i]);
+	}
+	_buffer.resize(n);
+	if (n < 1)
+		return;
+
+	// data with the same layout is converted directly, other data 
+	// sinogram by sinogram
+	const ProjDataBufferStorage* ptr =
+		dynamic_cast<const ProjDataBufferStorage*>(&pd);
+	if (ptr && ptr->buffer_size() == n) {
+		ReducedPrecision::encode(_format, n, ptr->buffer(), &_buffer[0]);
+		return;
+	}
+	std::vector<float> v(sino_size);
+	for (size_t i = 0; i < seq.size(); i++) {
+		int sn = seq[i];
+		for (int a = pdi.get_min_axial_pos_num(sn);
+			a <= pdi.get_max_axial_pos_num(sn); a++) {
+			Sinogram<float> sino = pd.get_sinogram(a, sn);
+			std::copy(sino.begin_all(), sino.end_all(), v.begin());
+			ReducedPrecision::encode(_format, sino_size, &v[0],
+				&_buffer[index(sn, a, pdi.get_min_view_num())]);
+		}
+	}
+}
+
+size_t
+ProjDataReducedPrecision::index(int segment_num, int ax_pos_num, int view_num) const
+{
+	const ProjDataInfo& pdi = *get_proj_data_info_ptr();
+	size_t nt = pdi.get_num_tangential_poss();
+	size_t na = ax_pos_num - pdi.get_min_axial_pos_num(segment_num);
+	size_t nv = view_num - pdi.get_min_view_num();
+	return _offset[segment_num - pdi.get_min_segment_num()] +
+		(na*pdi.get_num_views() + nv)*nt;
+}
+
+Viewgram<float>
+ProjDataReducedPrecision::get_viewgram
+(const int view_num, const int segment_num,
+	const bool make_num_tangential_poss_odd) const
+{
+	const ProjDataInfo& pdi = *get_proj_data_info_ptr();
+	Viewgram<float> vg = pdi.get_empty_viewgram(view_num, segment_num);
+	int nt = pdi.get_num_tangential_poss();
+	int min_t = pdi.get_min_tangential_pos_num();
+	int min_a = vg.get_min_axial_pos_num();
+	int max_a = vg.get_max_axial_pos_num();
+	for (int a = min_a; a <= max_a; a++)
+		to_float(index(segment_num, a, view_num), nt, &vg[a][min_t]);
+	if (make_num_tangential_poss_odd && nt % 2 == 0)
+		vg.grow(IndexRange2D(min_a, max_a, min_t, min_t + nt));
+	return vg;
+}
+
+Succeeded
+ProjDataReducedPrecision::set_viewgram(const Viewgram<float>& vg)
+{
+	const ProjDataInfo& pdi = *get_proj_data_info_ptr();
+	int nt = pdi.get_num_tangential_poss();
+	int min_t = pdi.get_min_tangential_pos_num();
+	if (vg.get_num_tangential_poss() != nt ||
+		vg.get_min_tangential_pos_num() != min_t)
+		return Succeeded::no;
+	int sn = vg.get_segment_num();
+	int vn = vg.get_view_num();
+	for (int a = vg.get_min_axial_pos_num(); a <= vg.get_max_axial_pos_num(); a++)
+		ReducedPrecision::encode
+		(_format, nt, &vg[a][min_t], &_buffer[index(sn, a, vn)]);
+	return Succeeded::yes;
+}
+
+Sinogram<float>
+ProjDataReducedPrecision::get_sinogram
+(const int ax_pos_num, const int segment_num,
+	const bool make_num_tangential_poss_odd) const
+{
+	const ProjDataInfo& pdi = *get_proj_data_info_ptr();
+	Sinogram<float> sino = pdi.get_empty_sinogram(ax_pos_num, segment_num);
+	int nt = pdi.get_num_tangential_poss();
+	int min_t = pdi.get_min_tangential_pos_num();
+	int min_v = sino.get_min_view_num();
+	int max_v = sino.get_max_view_num();
+	for (int v = min_v; v <= max_v; v++)
+		to_float(index(segment_num, ax_pos_num, v), nt, &sino[v][min_t]);
+	if (make_num_tangential_poss_odd && nt % 2 == 0)
+		sino.grow(IndexRange2D(min_v, max_v, min_t, min_t + nt));
+	return sino;
+}
+
+Succeeded
+ProjDataReducedPrecision::set_sinogram(const Sinogram<float>& sino)
+{
+	const ProjDataInfo& pdi = *get_proj_data_info_ptr();
+	int nt = pdi.get_num_tangential_poss();
+	int min_t = pdi.get_min_tangential_pos_num();
+	if (sino.get_num_tangential_poss() != nt ||
+		sino.get_min_tangential_pos_num() != min_t)
+		return Succeeded::no;
+	int sn = sino.get_segment_num();
+	int an = sino.get_axial_pos_num();
+	for (int v = sino.get_min_view_num(); v <= sino.get_max_view_num(); v++)
+		ReducedPrecision::encode
+		(_format, nt, &sino[v][min_t], &_buffer[index(sn, an, v)]);
+	return Succeeded::yes;
+}
+
+/*
+PET data containers algebra is elementwise, so operations are applied to
+contiguous blocks of data.
+
+For acquisition data, if all operands keep their bins in ProjDataBuffer
+or ProjDataMapped objects of the same layout, the whole buffers form a
+single block and no data is copied. Input operands kept in
+ProjDataReducedPrecision objects of that layout are converted to float
+chunk by chunk. Otherwise, the data is streamed viewgram by viewgram, so
+that at most one viewgram per operand is held in memory. For image data,
+blocks are image rows.
+
+Blocks are processed by OpenMP threads in chunks of fixed size, and the
+partial results of reductions are summed pairwise in fixed order, so that
+the results do not depend on the number of threads.
+*/
+
+#define ALGEBRA_CHUNK 16384
+
+int PETAlgebraThreads::num_threads_ = 0;
+
+void
+PETAlgebraThreads::set(int n)
+{
+	num_threads_ = n > 0 ? n : 0;
+}
+
+int
+PETAlgebraThreads::get()
 {
+#ifdef _OPENMP
+	return num_threads_ > 0 ? num_threads_ : ThreadPool::num_threads();
+#else
+	return 1;
+#endif
+}
+
+class ElementwiseOperation {
+public:
+	virtual ~ElementwiseOperation() {}
+	// applies the operation to n elements: y (0 for reductions) is the 
+	// output, x are the inputs; returns the contribution to the reduction, 
+	// if any; must be safe to call concurrently on disjoint chunks
+	virtual double apply(size_t n, float* y, const float* const* x) = 0;
+};
+
+static double
+pairwise_sum(const double* t, size_t n)
+{
+	if (n < 1)
+		return 0.0;
+	if (n == 1)
+		return t[0];
+	size_t m = n / 2;
+	return pairwise_sum(t, m) + pairwise_sum(t + m, n - m);
+}
+
+// applies op to a block of n elements chunk by chunk; if xr is not 0, 
+// the inputs k with xr[k] not 0 are read from xr[k] rather than x[k]
+static double
+apply_in_chunks(ElementwiseOperation& op, size_t n, float* y,
+	int nx, const float* const* x,
+	const ProjDataReducedPrecision* const* xr = 0)
+{
+	int nc = (int)((n + ALGEBRA_CHUNK - 1) / ALGEBRA_CHUNK);
+	if (nc < 2 && !xr)
+		return op.apply(n, y, x);
+	if (nc < 1)
+		return 0.0;
+	int nr = 0;
+	for (int k = 0; k < nx && xr; k++)
+		if (xr[k])
+			nr++;
+	std::vector<double> t(nc);
+	int nt = std::min(nc, PETAlgebraThreads::get());
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nt) schedule(static)
+#endif
+	for (int c = 0; c < nc; c++) {
+		size_t i = (size_t)c*ALGEBRA_CHUNK;
+		size_t m = std::min((size_t)ALGEBRA_CHUNK, n - i);
+		std::vector<const float*> xc(nx);
+		std::vector<float> w(nr*m);
+		for (int k = 0, r = 0; k < nx; k++) {
+			if (xr && xr[k]) {
+				float* pw = &w[(r++)*m];
+				xr[k]->to_float(i, m, pw);
+				xc[k] = pw;
+			}
+			else
+				xc[k] = x[k] + i;
+		}
+		t[c] = op.apply(m, y ? y + i : 0, nx > 0 ? &xc[0] : 0);
+	}
+	return pairwise_sum(&t[0], nc);
+}
+
+// the number of bins in the contiguous buffer of a, full or reduced 
+// precision, 0 if there is none
+static size_t
+block_size(PETAcquisitionData& a)
+{
+	if (a.buffer())
+		return a.buffer_size();
+	const ProjDataReducedPrecision* ptr = a.reduced_precision_data();
+	return ptr ? ptr->buffer_size() : 0;
+}
+
+static bool
+same_buffers(PETAcquisitionData& a, PETAcquisitionData& b)
+{
+	size_t n = block_size(a);
+	return n > 0 && n == block_size(b) &&
+		*a.get_proj_data_info_sptr() == *b.get_proj_data_info_sptr();
+}
+
+// applies op to the bins of nx operands x and, if y is not 0, of y, 
+// reading the bins of y before the operation if read_y is true
+static double
+apply_to_bins(ElementwiseOperation& op, PETAcquisitionData* y, bool read_y,
+	int nx, PETAcquisitionData* const* x)
+{
+	PETAcquisitionData& first = y ? *y : *x[0];
+	// reduced precision output goes through set_viewgram()
+	bool contiguous = y ? y->buffer() != 0 : block_size(first) > 0;
+	for (int i = 0; i < nx && contiguous; i++)
+		contiguous = same_buffers(first, *x[i]);
+	std::vector<const float*> px(nx);
+	if (contiguous) {
+		std::vector<const ProjDataReducedPrecision*> pr(nx);
+		bool reduced = false;
+		// memory-mapped operands are read ahead by the system
+		first.advise_sequential();
+		for (int i = 0; i < nx; i++) {
+			x[i]->advise_sequential();
+			px[i] = x[i]->buffer();
+			pr[i] = px[i] ? 0 : x[i]->reduced_precision_data();
+			reduced = reduced || pr[i];
+		}
+		return apply_in_chunks(op, block_size(first), y ? y->buffer() : 0,
+			nx, &px[0], reduced ? &pr[0] : 0);
+	}
+
+	int ns = first.get_max_segment_num();
+	for (int i = 0; i < nx; i++)
+		ns = std::min(ns, x[i]->get_max_segment_num());
+	int min_view = first.data()->get_min_view_num();
+	int max_view = first.data()->get_max_view_num();
+	std::vector<std::vector<float> > vx(nx);
+	std::vector<float> vy;
 	double t = 0.0;
-	for (int s = 0; s <= get_max_segment_num(); ++s)
+	for (int s = 0; s <= ns; ++s)
+	{
+		for (int k = 0; k < (s == 0 ? 1 : 2); k++) {
+			int sn = (k == 0 ? s : -s);
+			for (int v = min_view; v <= max_view; v++) {
+				size_t n = (size_t)-1;
+				for (int i = 0; i < nx; i++) {
+					Viewgram<float> vg = x[i]->data()->get_viewgram(v, sn);
+					vx[i].resize(vg.size_all());
+					std::copy(vg.begin_all(), vg.end_all(), vx[i].begin());
+					px[i] = vx[i].empty() ? 0 : &vx[i][0];
+					n = std::min(n, vx[i].size());
+				}
+				if (!y) {
+					t += apply_in_chunks(op, n, 0, nx, &px[0]);
+					continue;
+				}
+				Viewgram<float> vg = read_y ?
+					y->data()->get_viewgram(v, sn) :
+					y->data()->get_empty_viewgram(v, sn);
+				vy.resize(vg.size_all());
+				if (read_y)
+					std::copy(vg.begin_all(), vg.end_all(), vy.begin());
+				n = std::min(n, vy.size());
+				t += apply_in_chunks(op, n, vy.empty() ? 0 : &vy[0], nx, &px[0]);
+				Viewgram<float>::full_iterator iter = vg.begin_all();
+				for (size_t j = 0; j < n; j++)
+					*iter++ = vy[j];
+				y->data()->set_viewgram(vg);
+			}
+		}
+	}
+	return t;
+}
+
+class ElementwiseNorm : public ElementwiseOperation {
+public:
+	double apply(size_t n, float* y, const float* const* x)
 	{
-		SegmentBySinogram<float> seg = get_segment_by_sinogram(s);
-		SegmentBySinogram<float>::full_iterator seg_iter;
-		for (seg_iter = seg.begin_all(); seg_iter != seg.end_all();) {
-			double r = *seg_iter++;
+		const float* u = x[0];
+		double t = 0.0;
+		for (size_t i = 0; i < n; i++) {
+			double r = u[i];
 			t += r*r;
 		}
-		if (s != 0) {
-			seg = get_segment_by_sinogram(-s);
-			for (seg_iter = seg.begin_all(); seg_iter != seg.end_all();) {
-				double r = *seg_iter++;
-				t += r*r;
-			}
+		return t;
+	}
+};
+
+class ElementwiseDot : public ElementwiseOperation {
+public:
+	double apply(size_t n, float* y, const float* const* x)
+	{
+		const float* u = x[0];
+		const float* v = x[1];
+		double t = 0.0;
+		for (size_t i = 0; i < n; i++)
+			t += u[i] * double(v[i]);
+		return t;
+	}
+};
+
+class ElementwiseInv : public ElementwiseOperation {
+public:
+	ElementwiseInv(float amin) : amin_(amin) {}
+	double apply(size_t n, float* y, const float* const* x)
+	{
+		const float* u = x[0];
+		for (size_t i = 0; i < n; i++)
+			y[i] = float(1.0 / std::max(amin_, u[i]));
+		return 0.0;
+	}
+private:
+	float amin_;
+};
+
+class ElementwiseAxpby : public ElementwiseOperation {
+public:
+	ElementwiseAxpby(float a, float b) : a_(a), b_(b) {}
+	double apply(size_t n, float* y, const float* const* x)
+	{
+		const float* u = x[0];
+		const float* v = x[1];
+		for (size_t i = 0; i < n; i++)
+			y[i] = float(a_*double(u[i]) + b_*double(v[i]));
+		return 0.0;
+	}
+private:
+	float a_;
+	float b_;
+};
+
+class ElementwiseMultiply : public ElementwiseOperation {
+public:
+	double apply(size_t n, float* y, const float* const* x)
+	{
+		const float* u = x[0];
+		const float* v = x[1];
+		for (size_t i = 0; i < n; i++)
+			y[i] = u[i] * v[i];
+		return 0.0;
+	}
+};
+
+class ElementwiseDivide : public ElementwiseOperation {
+public:
+	double apply(size_t n, float* y, const float* const* x)
+	{
+		const float* u = x[0];
+		const float* v = x[1];
+		for (size_t i = 0; i < n; i++)
+			y[i] = u[i] / v[i];
+		return 0.0;
+	}
+};
+
+// division with denominators bounded away from zero by vmin
+class ElementwiseSafeDivide : public ElementwiseOperation {
+public:
+	ElementwiseSafeDivide(float vmin) : vmin_(vmin) {}
+	double apply(size_t n, float* y, const float* const* x)
+	{
+		const float* u = x[0];
+		const float* v = x[1];
+		for (size_t i = 0; i < n; i++) {
+			float vy = v[i];
+			if (vy >= 0 && vy < vmin_)
+				vy = vmin_;
+			else if (vy < 0 && vy > -vmin_)
+				vy = -vmin_;
+			y[i] = u[i] / vy;
 		}
+		return 0.0;
+	}
+private:
+	float vmin_;
+};
+
+class ElementwiseXapy : public ElementwiseOperation {
+public:
+	ElementwiseXapy(float a) : a_(a) {}
+	double apply(size_t n, float* y, const float* const* x)
+	{
+		const float* u = x[0];
+		for (size_t i = 0; i < n; i++)
+			y[i] = float(y[i] + a_*double(u[i]));
+		return 0.0;
 	}
-	return sqrt((float)t);
+private:
+	float a_;
+};
+
+class ElementwiseLinearCombination : public ElementwiseOperation {
+public:
+	ElementwiseLinearCombination(int m, const float* a) : m_(m), a_(a) {}
+	double apply(size_t n, float* y, const float* const* x)
+	{
+		for (size_t i = 0; i < n; i++) {
+			double t = 0.0;
+			for (int k = 0; k < m_; k++)
+				t += a_[k] * double(x[k][i]);
+			y[i] = float(t);
+		}
+		return 0.0;
+	}
+private:
+	int m_;
+	const float* a_;
+};
+
+class ElementwiseAxpbyNorm : public ElementwiseOperation {
+public:
+	ElementwiseAxpbyNorm(float a, float b) : a_(a), b_(b) {}
+	double apply(size_t n, float* y, const float* const* x)
+	{
+		const float* u = x[0];
+		const float* v = x[1];
+		double t = 0.0;
+		for (size_t i = 0; i < n; i++) {
+			float r = float(a_*double(u[i]) + b_*double(v[i]));
+			y[i] = r;
+			t += double(r)*r;
+		}
+		return t;
+	}
+private:
+	float a_;
+	float b_;
+};
+
+class ElementwiseAxpbyDot : public ElementwiseOperation {
+public:
+	ElementwiseAxpbyDot(float a, float b) : a_(a), b_(b) {}
+	double apply(size_t n, float* y, const float* const* x)
+	{
+		const float* u = x[0];
+		const float* v = x[1];
+		const float* w = x[2];
+		double t = 0.0;
+		for (size_t i = 0; i < n; i++) {
+			float r = float(a_*double(u[i]) + b_*double(v[i]));
+			y[i] = r;
+			t += r*double(w[i]);
+		}
+		return t;
+	}
+private:
+	float a_;
+	float b_;
+};
+
+float
+PETAcquisitionData::norm()
+{
+	SIRF_PROFILE("PETAcquisitionData::norm");
+	ElementwiseNorm op;
+	PETAcquisitionData* x[] = { this };
+	return (float)sqrt(apply_to_bins(op, 0, false, 1, x));
 }
 
 //void
@@ -79,66 +647,22 @@ PETAcquisitionData::norm()
 //	}
 //}
 
+
 float
 PETAcquisitionData::dot(const aDataContainer<float>& a_x)
 {
-	PETAcquisitionData& x = (PETAcquisitionData&)a_x;
-	int n = get_max_segment_num();
-	int nx = x.get_max_segment_num();
-	double t = 0;
-	for (int s = 0; s <= n && s <= nx; ++s)
-	{
-		SegmentBySinogram<float> seg = get_segment_by_sinogram(s);
-		SegmentBySinogram<float> sx = x.get_segment_by_sinogram(s);
-		SegmentBySinogram<float>::full_iterator seg_iter;
-		SegmentBySinogram<float>::full_iterator sx_iter;
-		for (seg_iter = seg.begin_all(), sx_iter = sx.begin_all();
-			seg_iter != seg.end_all() && sx_iter != sx.end_all();
-			/*empty*/) {
-			t += (*seg_iter++)*double(*sx_iter++);
-		}
-		if (s != 0) {
-			seg = get_segment_by_sinogram(-s);
-			sx = x.get_segment_by_sinogram(-s);
-			for (seg_iter = seg.begin_all(), sx_iter = sx.begin_all();
-				seg_iter != seg.end_all() && sx_iter != sx.end_all();
-				/*empty*/)
-				t += (*seg_iter++)*double(*sx_iter++);
-		}
-	}
-	return (float)t;
+	SIRF_PROFILE("PETAcquisitionData::dot");
+	ElementwiseDot op;
+	PETAcquisitionData* x[] = { this, (PETAcquisitionData*)&a_x };
+	return (float)apply_to_bins(op, 0, false, 2, x);
 }
 
 void
 PETAcquisitionData::inv(float amin, const aDataContainer<float>& a_x)
 {
-	PETAcquisitionData& x = (PETAcquisitionData&)a_x;
-	int n = get_max_segment_num();
-	int nx = x.get_max_segment_num();
-	for (int s = 0; s <= n && s <= nx; ++s)
-	{
-		//std::cout << "processing segment " << s << std::endl;
-		SegmentBySinogram<float> seg = get_empty_segment_by_sinogram(s);
-		SegmentBySinogram<float> sx = x.get_segment_by_sinogram(s);
-		SegmentBySinogram<float>::full_iterator seg_iter;
-		SegmentBySinogram<float>::full_iterator sx_iter;
-		for (seg_iter = seg.begin_all(), sx_iter = sx.begin_all();
-			seg_iter != seg.end_all() && sx_iter != sx.end_all();
-			/*empty*/)
-			*seg_iter++ = float(1.0 / std::max(amin, *sx_iter++));
-		set_segment(seg);
-		if (s != 0) {
-			//std::cout << "processing segment " << -s << std::endl;
-			seg = get_empty_segment_by_sinogram(-s);
-			sx = x.get_segment_by_sinogram(-s);
-			for (seg_iter = seg.begin_all(), sx_iter = sx.begin_all();
-				seg_iter != seg.end_all() && sx_iter != sx.end_all();
-				/*empty*/) {
-				*seg_iter++ = float(1.0 / std::max(amin, *sx_iter++));
-			}
-			set_segment(seg);
-		}
-	}
+	ElementwiseInv op(amin);
+	PETAcquisitionData* x[] = { (PETAcquisitionData*)&a_x };
+	apply_to_bins(op, this, false, 1, x);
 }
 
 void
@@ -147,41 +671,11 @@ float a, const aDataContainer<float>& a_x,
 float b, const aDataContainer<float>& a_y
 )
 {
-	PETAcquisitionData& x = (PETAcquisitionData&)a_x;
-	PETAcquisitionData& y = (PETAcquisitionData&)a_y;
-	int n = get_max_segment_num();
-	int nx = x.get_max_segment_num();
-	int ny = y.get_max_segment_num();
-	for (int s = 0; s <= n && s <= nx && s <= ny; ++s)
-	{
-		SegmentBySinogram<float> seg = get_empty_segment_by_sinogram(s);
-		SegmentBySinogram<float> sx = x.get_segment_by_sinogram(s);
-		SegmentBySinogram<float> sy = y.get_segment_by_sinogram(s);
-		SegmentBySinogram<float>::full_iterator seg_iter;
-		SegmentBySinogram<float>::full_iterator sx_iter;
-		SegmentBySinogram<float>::full_iterator sy_iter;
-		for (seg_iter = seg.begin_all(),
-			sx_iter = sx.begin_all(), sy_iter = sy.begin_all();
-			seg_iter != seg.end_all() &&
-			sx_iter != sx.end_all() && sy_iter != sy.end_all();
-		/*empty*/) {
-			*seg_iter++ = float(a*double(*sx_iter++) + b*double(*sy_iter++));
-		}
-		set_segment(seg);
-		if (s != 0) {
-			seg = get_empty_segment_by_sinogram(-s);
-			sx = x.get_segment_by_sinogram(-s);
-			sy = y.get_segment_by_sinogram(-s);
-			for (seg_iter = seg.begin_all(),
-				sx_iter = sx.begin_all(), sy_iter = sy.begin_all();
-				seg_iter != seg.end_all() &&
-				sx_iter != sx.end_all() && sy_iter != sy.end_all();
-			/*empty*/) {
-				*seg_iter++ = float(a*double(*sx_iter++) + b*double(*sy_iter++));
-			}
-			set_segment(seg);
-		}
-	}
+	SIRF_PROFILE("PETAcquisitionData::axpby");
+	ElementwiseAxpby op(a, b);
+	PETAcquisitionData* x[] = 
+		{ (PETAcquisitionData*)&a_x, (PETAcquisitionData*)&a_y };
+	apply_to_bins(op, this, false, 2, x);
 }
 
 void
@@ -190,41 +684,11 @@ const aDataContainer<float>& a_x,
 const aDataContainer<float>& a_y
 )
 {
-	PETAcquisitionData& x = (PETAcquisitionData&)a_x;
-	PETAcquisitionData& y = (PETAcquisitionData&)a_y;
-	int n = get_max_segment_num();
-	int nx = x.get_max_segment_num();
-	int ny = y.get_max_segment_num();
-	for (int s = 0; s <= n && s <= nx && s <= ny; ++s)
-	{
-		SegmentBySinogram<float> seg = get_empty_segment_by_sinogram(s);
-		SegmentBySinogram<float> sx = x.get_segment_by_sinogram(s);
-		SegmentBySinogram<float> sy = y.get_segment_by_sinogram(s);
-		SegmentBySinogram<float>::full_iterator seg_iter;
-		SegmentBySinogram<float>::full_iterator sx_iter;
-		SegmentBySinogram<float>::full_iterator sy_iter;
-		for (seg_iter = seg.begin_all(),
-			sx_iter = sx.begin_all(), sy_iter = sy.begin_all();
-			seg_iter != seg.end_all() &&
-			sx_iter != sx.end_all() && sy_iter != sy.end_all();
-		/*empty*/) {
-			*seg_iter++ = (*sx_iter++) * (*sy_iter++);
-		}
-		set_segment(seg);
-		if (s != 0) {
-			seg = get_empty_segment_by_sinogram(-s);
-			sx = x.get_segment_by_sinogram(-s);
-			sy = y.get_segment_by_sinogram(-s);
-			for (seg_iter = seg.begin_all(),
-				sx_iter = sx.begin_all(), sy_iter = sy.begin_all();
-				seg_iter != seg.end_all() &&
-				sx_iter != sx.end_all() && sy_iter != sy.end_all();
-			/*empty*/) {
-				*seg_iter++ = (*sx_iter++) * (*sy_iter++);
-			}
-			set_segment(seg);
-		}
-	}
+	SIRF_PROFILE("PETAcquisitionData::multiply");
+	ElementwiseMultiply op;
+	PETAcquisitionData* x[] = 
+		{ (PETAcquisitionData*)&a_x, (PETAcquisitionData*)&a_y };
+	apply_to_bins(op, this, false, 2, x);
 }
 
 void
@@ -233,123 +697,126 @@ const aDataContainer<float>& a_x,
 const aDataContainer<float>& a_y
 )
 {
-	PETAcquisitionData& x = (PETAcquisitionData&)a_x;
-	PETAcquisitionData& y = (PETAcquisitionData&)a_y;
-	int n = get_max_segment_num();
-	int nx = x.get_max_segment_num();
-	int ny = y.get_max_segment_num();
-	for (int s = 0; s <= n && s <= nx && s <= ny; ++s)
-	{
-		SegmentBySinogram<float> seg = get_empty_segment_by_sinogram(s);
-		SegmentBySinogram<float> sx = x.get_segment_by_sinogram(s);
-		SegmentBySinogram<float> sy = y.get_segment_by_sinogram(s);
-		SegmentBySinogram<float>::full_iterator seg_iter;
-		SegmentBySinogram<float>::full_iterator sx_iter;
-		SegmentBySinogram<float>::full_iterator sy_iter;
-		for (seg_iter = seg.begin_all(),
-			sx_iter = sx.begin_all(), sy_iter = sy.begin_all();
-			seg_iter != seg.end_all() &&
-			sx_iter != sx.end_all() && sy_iter != sy.end_all();
-		/*empty*/) {
-			*seg_iter++ = (*sx_iter++) / (*sy_iter++);
-		}
-		set_segment(seg);
-		if (s != 0) {
-			seg = get_empty_segment_by_sinogram(-s);
-			sx = x.get_segment_by_sinogram(-s);
-			sy = y.get_segment_by_sinogram(-s);
-			for (seg_iter = seg.begin_all(),
-				sx_iter = sx.begin_all(), sy_iter = sy.begin_all();
-				seg_iter != seg.end_all() &&
-				sx_iter != sx.end_all() && sy_iter != sy.end_all();
-			/*empty*/) {
-				*seg_iter++ = (*sx_iter++) / (*sy_iter++);
-			}
-			set_segment(seg);
+	SIRF_PROFILE("PETAcquisitionData::divide");
+	ElementwiseDivide op;
+	PETAcquisitionData* x[] = 
+		{ (PETAcquisitionData*)&a_x, (PETAcquisitionData*)&a_y };
+	apply_to_bins(op, this, false, 2, x);
+}
+
+void
+PETAcquisitionData::xapy(float a, const aDataContainer<float>& a_x)
+{
+	ElementwiseXapy op(a);
+	PETAcquisitionData* x[] = { (PETAcquisitionData*)&a_x };
+	apply_to_bins(op, this, true, 1, x);
+}
+
+void
+PETAcquisitionData::linear_combination
+(int n, const float* a, const aDataContainer<float>* const* a_x)
+{
+	if (n < 1)
+		return;
+	ElementwiseLinearCombination op(n, a);
+	std::vector<PETAcquisitionData*> x(n);
+	for (int i = 0; i < n; i++)
+		x[i] = (PETAcquisitionData*)a_x[i];
+	// all operand bins of a block are read before the block of this is
+	// written, so this may be among the operands
+	apply_to_bins(op, this, false, n, &x[0]);
+}
+
+float
+PETAcquisitionData::axpby_norm(
+float a, const aDataContainer<float>& a_x,
+float b, const aDataContainer<float>& a_y
+)
+{
+	SIRF_PROFILE("PETAcquisitionData::axpby_norm");
+	ElementwiseAxpbyNorm op(a, b);
+	PETAcquisitionData* x[] = 
+		{ (PETAcquisitionData*)&a_x, (PETAcquisitionData*)&a_y };
+	return (float)sqrt(apply_to_bins(op, this, false, 2, x));
+}
+
+float
+PETAcquisitionData::axpby_dot(
+float a, const aDataContainer<float>& a_x,
+float b, const aDataContainer<float>& a_y,
+const aDataContainer<float>& a_z
+)
+{
+	SIRF_PROFILE("PETAcquisitionData::axpby_dot");
+	ElementwiseAxpbyDot op(a, b);
+	PETAcquisitionData* x[] = { (PETAcquisitionData*)&a_x, 
+		(PETAcquisitionData*)&a_y, (PETAcquisitionData*)&a_z };
+	return (float)apply_to_bins(op, this, false, 3, x);
+}
+
+// applies op to the voxels of nx images x and, if y is not 0, of y,
+// row by row; planes are processed concurrently
+static double
+apply_to_voxels(ElementwiseOperation& op, PETImageData* y,
+	int nx, PETImageData* const* x)
+{
+	Image3DF& first = y ? y->data() : x[0]->data();
+	for (int i = 0; i < nx; i++)
+		if (!(x[i]->data().get_index_range() == first.get_index_range()))
+			THROW("images of different sizes in PETImageData algebra");
+	int min_z = first.get_min_index();
+	int nz = first.get_length();
+	if (nz < 1)
+		return 0.0;
+	std::vector<double> t(nz);
+	int nt = std::min(nz, PETAlgebraThreads::get());
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nt) schedule(static)
+#endif
+	for (int k = 0; k < nz; k++) {
+		int z = min_z + k;
+		std::vector<const float*> px(nx);
+		double tz = 0.0;
+		for (int r = first[z].get_min_index(); r <= first[z].get_max_index(); 
+			r++) {
+			Array<1, float>& row = first[z][r];
+			int c = row.get_min_index();
+			for (int i = 0; i < nx; i++)
+				px[i] = &(x[i]->data()[z][r][c]);
+			tz += op.apply(row.size(), y ? &row[c] : 0, &px[0]);
 		}
+		t[k] = tz;
 	}
+	return pairwise_sum(&t[0], nz);
 }
 
 float
 PETImageData::norm()
 {
-#ifdef _MSC_VER
-	//Array<3, float>::const_full_iterator iter;
-	Image3DF::const_full_iterator iter;
-#else
-	typename Array<3, float>::const_full_iterator iter;
-#endif
-	double s = 0.0;
-	int i = 0;
-	for (iter = _data->begin_all(); iter != _data->end_all(); iter++, i++) {
-		double t = *iter;
-		s += t*t;
-	}
-	//std::cout << "voxels count: " << i << std::endl;
-	return (float)sqrt(s);
+	SIRF_PROFILE("PETImageData::norm");
+	ElementwiseNorm op;
+	PETImageData* x[] = { this };
+	return (float)sqrt(apply_to_voxels(op, 0, 1, x));
 }
 
 float
 PETImageData::dot(const aDataContainer<float>& a_x)
 {
-	PETImageData& x = (PETImageData&)a_x;
-#ifdef _MSC_VER
-	Image3DF::full_iterator iter;
-	Image3DF::const_full_iterator iter_x;
-#else
-	typename Array<3, float>::full_iterator iter;
-	typename Array<3, float>::const_full_iterator iter_x;
-#endif
-
-	double s = 0.0;
-	for (iter = data().begin_all(), iter_x = x.data().begin_all();
-		iter != data().end_all() && iter_x != x.data().end_all(); iter++, iter_x++) {
-		double t = *iter;
-		s += t * (*iter_x);
-	}
-	return (float)s;
+	SIRF_PROFILE("PETImageData::dot");
+	ElementwiseDot op;
+	PETImageData* x[] = { this, (PETImageData*)&a_x };
+	return (float)apply_to_voxels(op, 0, 2, x);
 }
 
-//void
-//PETImageData::mult(float a, const aDataContainer<float>& a_x)
-//{
-//	PETImageData& x = (PETImageData&)a_x;
-//#ifdef _MSC_VER
-//	Image3DF::full_iterator iter;
-//	Image3DF::const_full_iterator iter_x;
-//#else
-//	typename Array<3, float>::full_iterator iter;
-//	typename Array<3, float>::const_full_iterator iter_x;
-//#endif
-//
-//	for (iter = data().begin_all(), iter_x = x.data().begin_all();
-//		iter != data().end_all() && iter_x != x.data().end_all(); iter++, iter_x++)
-//		*iter = a * (*iter_x);
-//}
-
 void
 PETImageData::multiply(
 const aDataContainer<float>& a_x,
 const aDataContainer<float>& a_y)
 {
-	PETImageData& x = (PETImageData&)a_x;
-	PETImageData& y = (PETImageData&)a_y;
-#ifdef _MSC_VER
-	Image3DF::full_iterator iter;
-	Image3DF::const_full_iterator iter_x;
-	Image3DF::const_full_iterator iter_y;
-#else
-	typename Array<3, float>::full_iterator iter;
-	typename Array<3, float>::const_full_iterator iter_x;
-	typename Array<3, float>::const_full_iterator iter_y;
-#endif
-
-	for (iter = data().begin_all(),
-		iter_x = x.data().begin_all(), iter_y = y.data().begin_all();
-		iter != data().end_all() &&
-		iter_x != x.data().end_all() && iter_y != y.data().end_all();
-	iter++, iter_x++, iter_y++)
-		*iter = (*iter_x) * (*iter_y);
+	SIRF_PROFILE("PETImageData::multiply");
+	ElementwiseMultiply op;
+	PETImageData* x[] = { (PETImageData*)&a_x, (PETImageData*)&a_y };
+	apply_to_voxels(op, this, 2, x);
 }
 
 void
@@ -357,23 +824,16 @@ PETImageData::divide(
 const aDataContainer<float>& a_x,
 const aDataContainer<float>& a_y)
 {
-	PETImageData& x = (PETImageData&)a_x;
+	SIRF_PROFILE("PETImageData::divide");
 	PETImageData& y = (PETImageData&)a_y;
 #ifdef _MSC_VER
-	Image3DF::full_iterator iter;
-	Image3DF::const_full_iterator iter_x;
 	Image3DF::const_full_iterator iter_y;
 #else
-	typename Array<3, float>::full_iterator iter;
-	typename Array<3, float>::const_full_iterator iter_x;
 	typename Array<3, float>::const_full_iterator iter_y;
 #endif
 
 	float vmax = 0.0;
-	for (
-		iter_x = x.data().begin_all(), iter_y = y.data().begin_all();
-		iter_x != x.data().end_all() && iter_y != y.data().end_all();
-	iter_x++, iter_y++) {
+	for (iter_y = y.data().begin_all(); iter_y != y.data().end_all(); iter_y++) {
 		float vy = abs(*iter_y);
 		if (vy > vmax)
 			vmax = vy;
@@ -382,18 +842,9 @@ const aDataContainer<float>& a_y)
 	if (vmin == 0.0)
 		THROW("division by zero in PETImageData::divide");
 
-	for (iter = data().begin_all(),
-		iter_x = x.data().begin_all(), iter_y = y.data().begin_all();
-		iter != data().end_all() &&
-		iter_x != x.data().end_all() && iter_y != y.data().end_all();
-	iter++, iter_x++, iter_y++) {
-		float vy = *iter_y;
-		if (vy >= 0 && vy < vmin)
-			vy = vmin;
-		else if (vy < 0 && vy > -vmin)
-			vy = -vmin;
-		*iter = (*iter_x) / vy;
-	}
+	ElementwiseSafeDivide op(vmin);
+	PETImageData* x[] = { (PETImageData*)&a_x, (PETImageData*)&a_y };
+	apply_to_voxels(op, this, 2, x);
 }
 
 void
@@ -401,24 +852,57 @@ PETImageData::axpby(
 float a, const aDataContainer<float>& a_x,
 float b, const aDataContainer<float>& a_y)
 {
-	PETImageData& x = (PETImageData&)a_x;
-	PETImageData& y = (PETImageData&)a_y;
-#ifdef _MSC_VER
-	Image3DF::full_iterator iter;
-	Image3DF::const_full_iterator iter_x;
-	Image3DF::const_full_iterator iter_y;
-#else
-	typename Array<3, float>::full_iterator iter;
-	typename Array<3, float>::const_full_iterator iter_x;
-	typename Array<3, float>::const_full_iterator iter_y;
-#endif
+	SIRF_PROFILE("PETImageData::axpby");
+	ElementwiseAxpby op(a, b);
+	PETImageData* x[] = { (PETImageData*)&a_x, (PETImageData*)&a_y };
+	apply_to_voxels(op, this, 2, x);
+}
+
+void
+PETImageData::xapy(float a, const aDataContainer<float>& a_x)
+{
+	ElementwiseXapy op(a);
+	PETImageData* x[] = { (PETImageData*)&a_x };
+	apply_to_voxels(op, this, 1, x);
+}
+
+void
+PETImageData::linear_combination
+(int n, const float* a, const aDataContainer<float>* const* a_x)
+{
+	if (n < 1)
+		return;
+	ElementwiseLinearCombination op(n, a);
+	std::vector<PETImageData*> x(n);
+	for (int i = 0; i < n; i++)
+		x[i] = (PETImageData*)a_x[i];
+	// each row of this is written after the corresponding rows of all
+	// operands have been read, so this may be among the operands
+	apply_to_voxels(op, this, n, &x[0]);
+}
+
+float
+PETImageData::axpby_norm(
+float a, const aDataContainer<float>& a_x,
+float b, const aDataContainer<float>& a_y)
+{
+	SIRF_PROFILE("PETImageData::axpby_norm");
+	ElementwiseAxpbyNorm op(a, b);
+	PETImageData* x[] = { (PETImageData*)&a_x, (PETImageData*)&a_y };
+	return (float)sqrt(apply_to_voxels(op, this, 2, x));
+}
 
-	for (iter = data().begin_all(),
-		iter_x = x.data().begin_all(), iter_y = y.data().begin_all();
-		iter != data().end_all() &&
-		iter_x != x.data().end_all() && iter_y != y.data().end_all();
-	iter++, iter_x++, iter_y++)
-		*iter = a * (*iter_x) + b * (*iter_y);
+float
+PETImageData::axpby_dot(
+float a, const aDataContainer<float>& a_x,
+float b, const aDataContainer<float>& a_y,
+const aDataContainer<float>& a_z)
+{
+	SIRF_PROFILE("PETImageData::axpby_dot");
+	ElementwiseAxpbyDot op(a, b);
+	PETImageData* x[] = 
+		{ (PETImageData*)&a_x, (PETImageData*)&a_y, (PETImageData*)&a_z };
+	return (float)apply_to_voxels(op, this, 3, x);
 }
 
 int
@@ -468,6 +952,27 @@ PETImageData::get_data(float* data) const
 	return 0;
 }
 
+float*
+PETImageData::data_view()
+{
+	Image3DF& image = *_data;
+	Coordinate3D<int> min_indices;
+	Coordinate3D<int> max_indices;
+	if (!image.get_regular_range(min_indices, max_indices))
+		return 0;
+	int z0 = min_indices[1];
+	int y0 = min_indices[2];
+	int x0 = min_indices[3];
+	int ny = max_indices[2] - y0 + 1;
+	int nx = max_indices[3] - x0 + 1;
+	float* ptr = &image[z0][y0][x0];
+	for (int z = z0; z <= max_indices[1]; z++)
+		for (int y = y0; y <= max_indices[2]; y++)
+			if (&image[z][y][x0] != ptr + ((size_t)(z - z0)*ny + (y - y0))*nx)
+				return 0;
+	return ptr;
+}
+
 int
 PETImageData::set_data(const float* data)
 {
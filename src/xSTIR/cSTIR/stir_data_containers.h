@@ -34,11 +34,18 @@ limitations under the License.
 
 #include <chrono>
 #include <fstream>
+#include <vector>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/streams/bufferstream.hpp>
 
 #include "cstir_shared_ptr.h"
 #include "data_handle.h"
 #include "stir_types.h"
 #include "SIRF/common/data_container.h"
+#include "SIRF/common/reduced_precision.h"
+#include "SIRF/common/storage_budget.h"
 
 namespace sirf {
 
@@ -57,10 +64,26 @@ namespace sirf {
 			long long int ms = milliseconds();
 			calls++;
 			sprintf(buff, "tmp_%d_%lld", calls, ms);
-			return std::string(buff);
+			return StorageBudget::scratch_path(std::string(buff));
 		}
 	};
 
+	/*!
+	\ingroup STIR Extensions
+	\brief Number of threads used by the PET data containers algebra.
+
+	If set to 0 (default), the size of the SIRF thread pool is used.
+	Results do not depend on the number of threads.
+	*/
+
+	class PETAlgebraThreads {
+	public:
+		static void set(int n);
+		static int get();
+	private:
+		static int num_threads_;
+	};
+
 	/*!
 	\ingroup STIR Extensions
 	\brief STIR ProjDataInterfile wrapper with additional file managing features.
@@ -120,6 +143,258 @@ namespace sirf {
 		std::string _filename;
 	};
 
+	/*!
+	\ingroup STIR Extensions
+	\brief Owner of the contiguous buffer of ProjDataBuffer and ProjDataMapped.
+
+	Base class of ProjDataBuffer and ProjDataMapped that allows the buffer 
+	and the stream over it to be created before the STIR base class 
+	(base-from-member).
+	*/
+
+	class ProjDataBufferStorage {
+	public:
+		virtual ~ProjDataBufferStorage() {}
+		float* buffer() { return _ptr; }
+		const float* buffer() const { return _ptr; }
+		size_t buffer_size() const { return _size; }
+		// hints that the buffer is about to be read sequentially
+		virtual void advise_sequential() {}
+		// marks the buffer as recently used (see StorageBudget)
+		virtual void touch() const {}
+		// keeps the buffer where it is from now on
+		virtual void pin() {}
+		static size_t num_bins(const stir::ProjDataInfo& pdi)
+		{
+			size_t n = 0;
+			for (int s = pdi.get_min_segment_num(); 
+				s <= pdi.get_max_segment_num(); s++)
+				n += pdi.get_num_axial_poss(s);
+			return n*pdi.get_num_views()*pdi.get_num_tangential_poss();
+		}
+		static std::vector<int> segment_sequence(const stir::ProjDataInfo& pdi)
+		{
+			std::vector<int> seq;
+			for (int s = 0; s <= pdi.get_max_segment_num(); s++) {
+				seq.push_back(s);
+				if (s != 0)
+					seq.push_back(-s);
+			}
+			return seq;
+		}
+	protected:
+		ProjDataBufferStorage() : _ptr(0), _size(0) {}
+		ProjDataBufferStorage(const stir::ProjDataInfo& pdi) :
+			_buffer(num_bins(pdi), 0.0f)
+		{
+			attach(_buffer.empty() ? 0 : &_buffer[0], _buffer.size());
+		}
+		// makes the stream operate on size floats at ptr
+		void attach(float* ptr, size_t size)
+		{
+			_ptr = ptr;
+			_size = size;
+			_stream.reset(new boost::interprocess::bufferstream
+				((char*)ptr, size*sizeof(float),
+				std::ios::in | std::ios::out | std::ios::binary));
+		}
+		std::vector<float> _buffer;
+		float* _ptr;
+		size_t _size;
+		stir::shared_ptr<std::iostream> _stream;
+	};
+
+	/*!
+	\ingroup STIR Extensions
+	\brief Owner of the memory-mapped file of ProjDataMapped.
+
+	Creates the data file filename.s of the size needed (which makes it 
+	zero-filled) and maps it into memory. If the object owns the file, 
+	the data and header files are deleted on destruction.
+	*/
+
+	class ProjDataMappedStorage : public ProjDataBufferStorage {
+	public:
+		~ProjDataMappedStorage();
+		void advise_sequential();
+	protected:
+		ProjDataMappedStorage(const stir::ProjDataInfo& pdi,
+			const std::string& filename, bool owns_file);
+		std::string _filename;
+		bool _owns_file;
+		stir::shared_ptr<boost::interprocess::file_mapping> _mapping;
+		stir::shared_ptr<boost::interprocess::mapped_region> _region;
+	};
+
+	/*!
+	\ingroup STIR Extensions
+	\brief STIR ProjDataFromStream over a contiguous memory buffer.
+
+	Plays the role of stir::ProjDataInMemory, but gives direct access to the
+	buffer, so that the acquisition data algebra can run on it without
+	copying the data segment by segment. Segments are stored by sinogram
+	in the order 0, 1, -1, 2, -2, ..., i.e. the buffer has the same layout 
+	as the array filled by ProjData::copy_to().
+	*/
+
+	class ProjDataBuffer : public ProjDataBufferStorage, 
+		public stir::ProjDataFromStream {
+	public:
+		ProjDataBuffer(stir::shared_ptr<stir::ExamInfo> sptr_exam_info,
+			stir::shared_ptr<stir::ProjDataInfo> sptr_proj_data_info) :
+			ProjDataBufferStorage(*sptr_proj_data_info),
+			stir::ProjDataFromStream(sptr_exam_info, sptr_proj_data_info,
+			_stream, 0, segment_sequence(*sptr_proj_data_info),
+			stir::ProjDataFromStream::Segment_AxialPos_View_TangPos)
+		{}
+		using ProjDataBufferStorage::buffer;
+	};
+
+	/*!
+	\ingroup STIR Extensions
+	\brief STIR ProjDataFromStream over a memory-mapped Interfile data file.
+
+	Has the layout of ProjDataBuffer, so that the acquisition data algebra
+	works on the mapped file directly, and segment reads and writes are
+	memory copies to and from the page cache rather than read/write calls.
+	The data stays file-backed, so the system can evict it from memory.
+	An Interfile header filename.hs is written for the data file filename.s.
+	*/
+
+	class ProjDataMapped : public ProjDataMappedStorage,
+		public stir::ProjDataFromStream {
+	public:
+		ProjDataMapped(stir::shared_ptr<stir::ExamInfo> sptr_exam_info,
+			stir::shared_ptr<stir::ProjDataInfo> sptr_proj_data_info,
+			const std::string& filename, bool owns_file = true);
+		using ProjDataBufferStorage::buffer;
+	};
+
+	/*!
+	\ingroup STIR Extensions
+	\brief Owner of the spillable buffer of ProjDataHybrid.
+
+	The zero-filled buffer is accounted against the StorageBudget, and the
+	stream is re-pointed at the scratch file mapping if the buffer spills.
+	*/
+
+	class ProjDataHybridStorage : public ProjDataBufferStorage {
+	public:
+		void touch() const { _spillable.touch(); }
+		void pin() { _spillable.pin(); }
+	protected:
+		ProjDataHybridStorage(const stir::ProjDataInfo& pdi) : _spillable(true)
+		{
+			size_t size = num_bins(pdi);
+			_spillable.set_move_callback([this](void* ptr) { moved(ptr); });
+			_spillable.resize(size*sizeof(float));
+			if (size > 0)
+				memset(_spillable.data(), 0, size*sizeof(float));
+			attach((float*)_spillable.data(), size);
+		}
+		SpillableBuffer _spillable;
+	private:
+		// the STIR base shares _stream, so its buffer is replaced in place
+		void moved(void* ptr)
+		{
+			_ptr = (float*)ptr;
+			boost::interprocess::bufferstream* ptr_s =
+				dynamic_cast<boost::interprocess::bufferstream*>(_stream.get());
+			ptr_s->buffer((char*)ptr, _size*sizeof(float));
+		}
+	};
+
+	/*!
+	\ingroup STIR Extensions
+	\brief STIR ProjDataFromStream over a buffer that can spill to disk.
+
+	Has the layout of ProjDataBuffer and lives in memory until the 
+	StorageBudget is exceeded and it is the least recently used buffer; 
+	it is then moved to a memory-mapped scratch file, like ProjDataMapped. 
+	Viewgram and sinogram accesses mark it as recently used.
+	*/
+
+	class ProjDataHybrid : public ProjDataHybridStorage,
+		public stir::ProjDataFromStream {
+	public:
+		ProjDataHybrid(stir::shared_ptr<stir::ExamInfo> sptr_exam_info,
+			stir::shared_ptr<stir::ProjDataInfo> sptr_proj_data_info) :
+			ProjDataHybridStorage(*sptr_proj_data_info),
+			stir::ProjDataFromStream(sptr_exam_info, sptr_proj_data_info,
+			_stream, 0, segment_sequence(*sptr_proj_data_info),
+			stir::ProjDataFromStream::Segment_AxialPos_View_TangPos)
+		{}
+		using ProjDataBufferStorage::buffer;
+
+		stir::Viewgram<float> get_viewgram(const int view_num,
+			const int segment_num,
+			const bool make_num_tangential_poss_odd = false) const
+		{
+			touch();
+			return stir::ProjDataFromStream::get_viewgram
+				(view_num, segment_num, make_num_tangential_poss_odd);
+		}
+		stir::Succeeded set_viewgram(const stir::Viewgram<float>& vg)
+		{
+			touch();
+			return stir::ProjDataFromStream::set_viewgram(vg);
+		}
+		stir::Sinogram<float> get_sinogram(const int ax_pos_num,
+			const int segment_num,
+			const bool make_num_tangential_poss_odd = false) const
+		{
+			touch();
+			return stir::ProjDataFromStream::get_sinogram
+				(ax_pos_num, segment_num, make_num_tangential_poss_odd);
+		}
+		stir::Succeeded set_sinogram(const stir::Sinogram<float>& s)
+		{
+			touch();
+			return stir::ProjDataFromStream::set_sinogram(s);
+		}
+	};
+
+	/*!
+	\ingroup STIR Extensions
+	\brief STIR ProjData storing the bins in a 16-bit floating point format.
+
+	Halves the memory taken by acquisition data that is only read after it 
+	has been computed, at the cost of precision (see ReducedPrecision). 
+	The bins have the layout of ProjDataBuffer and are converted to and from
+	float on access, so that STIR projectors and the acquisition data 
+	algebra read them like any other ProjData.
+	*/
+
+	class ProjDataReducedPrecision : public stir::ProjData {
+	public:
+		ProjDataReducedPrecision
+			(const stir::ProjData& pd, ReducedPrecision::Format format);
+		ReducedPrecision::Format format() const { return _format; }
+		size_t buffer_size() const { return _buffer.size(); }
+		// y := n bins starting from bin i converted to float
+		void to_float(size_t i, size_t n, float* y) const
+		{
+			ReducedPrecision::decode(_format, n, &_buffer[i], y);
+		}
+
+		stir::Viewgram<float> get_viewgram(const int view_num,
+			const int segment_num,
+			const bool make_num_tangential_poss_odd = false) const;
+		stir::Succeeded set_viewgram(const stir::Viewgram<float>& vg);
+		stir::Sinogram<float> get_sinogram(const int ax_pos_num,
+			const int segment_num,
+			const bool make_num_tangential_poss_odd = false) const;
+		stir::Succeeded set_sinogram(const stir::Sinogram<float>& s);
+
+	private:
+		ReducedPrecision::Format _format;
+		std::vector<uint16_t> _buffer;
+		// segment offsets in _buffer, indexed by segment_num - min_segment_num
+		std::vector<size_t> _offset;
+		// the position of the first tangential bin of the specified view
+		size_t index(int segment_num, int ax_pos_num, int view_num) const;
+	};
+
 	/*!
 	\ingroup STIR Extensions
 	\brief STIR ProjData wrapper with added functionality.
@@ -188,6 +463,44 @@ namespace sirf {
 		{
 			_data = data;
 		}
+		// the contiguous buffer holding all bins if the data is stored in
+		// one, 0 otherwise
+		float* buffer()
+		{
+			ProjDataBufferStorage* ptr = 
+				dynamic_cast<ProjDataBufferStorage*>(_data.get());
+			if (!ptr)
+				return 0;
+			ptr->touch();
+			return ptr->buffer();
+		}
+		size_t buffer_size()
+		{
+			ProjDataBufferStorage* ptr =
+				dynamic_cast<ProjDataBufferStorage*>(_data.get());
+			return ptr ? ptr->buffer_size() : 0;
+		}
+		// keeps the buffer where it is, e.g. while it is viewed by Python
+		void pin_buffer()
+		{
+			ProjDataBufferStorage* ptr =
+				dynamic_cast<ProjDataBufferStorage*>(_data.get());
+			if (ptr)
+				ptr->pin();
+		}
+		// hints that the buffer is about to be read sequentially
+		void advise_sequential()
+		{
+			ProjDataBufferStorage* ptr =
+				dynamic_cast<ProjDataBufferStorage*>(_data.get());
+			if (ptr)
+				ptr->advise_sequential();
+		}
+		// the reduced precision storage of the bins if used, 0 otherwise
+		const ProjDataReducedPrecision* reduced_precision_data() const
+		{
+			return dynamic_cast<const ProjDataReducedPrecision*>(_data.get());
+		}
 
 		// data import/export
 		void fill(float v) { data()->fill(v); }
@@ -213,6 +526,20 @@ namespace sirf {
 		void inv(float a, const aDataContainer<float>& x);
 		void axpby(float a, const aDataContainer<float>& x,
 			float b, const aDataContainer<float>& y);
+		// fused operations, one pass over the data
+		void xapy(float a, const aDataContainer<float>& x);
+		// axpby is in place and x may be this
+		void scale_xapy(float b, float a, const aDataContainer<float>& x)
+		{
+			axpby(b, *this, a, x);
+		}
+		void linear_combination
+			(int n, const float* a, const aDataContainer<float>* const* x);
+		float axpby_norm(float a, const aDataContainer<float>& x,
+			float b, const aDataContainer<float>& y);
+		float axpby_dot(float a, const aDataContainer<float>& x,
+			float b, const aDataContainer<float>& y,
+			const aDataContainer<float>& z);
 
 		// ProjData methods
 		int get_num_tangential_poss()
@@ -286,6 +613,9 @@ namespace sirf {
 	\ingroup STIR Extensions
 	\brief In-file implementation of PETAcquisitionData.
 
+	Scratch data is kept in memory-mapped files (ProjDataMapped) unless
+	this is disabled by set_memory_mapped(false) or mapping fails, in which
+	case ProjDataFile is used.
 	*/
 
 	class PETAcquisitionDataInFile : public PETAcquisitionData {
@@ -298,14 +628,12 @@ namespace sirf {
 		PETAcquisitionDataInFile(stir::shared_ptr<stir::ExamInfo> sptr_exam_info,
 			stir::shared_ptr<stir::ProjDataInfo> sptr_proj_data_info)
 		{
-			_data.reset(new ProjDataFile
-				(sptr_exam_info, sptr_proj_data_info,
-				_filename = SIRFUtilities::scratch_file_name()));
+			_data.reset(scratch_data(sptr_exam_info, sptr_proj_data_info));
 		}
 		PETAcquisitionDataInFile(const stir::ProjData& pd) : _owns_file(true)
 		{
-			_data.reset(new ProjDataFile
-				(pd, _filename = SIRFUtilities::scratch_file_name()));
+			_data.reset(scratch_data
+				(pd.get_exam_info_sptr(), pd.get_proj_data_info_sptr()));
 		}
 		PETAcquisitionDataInFile
 			(stir::shared_ptr<stir::ExamInfo> sptr_ei, std::string scanner_name,
@@ -314,10 +642,7 @@ namespace sirf {
 			stir::shared_ptr<stir::ProjDataInfo> sptr_pdi =
 				PETAcquisitionData::proj_data_info_from_scanner
 				(scanner_name, span, max_ring_diff, view_mash_factor);
-			ProjDataFile* ptr = new ProjDataFile(sptr_ei, sptr_pdi,
-				_filename = SIRFUtilities::scratch_file_name());
-			ptr->fill(0.0f);
-			_data.reset(ptr);
+			_data.reset(scratch_data(sptr_ei, sptr_pdi, true));
 		}
 		stir::shared_ptr<PETAcquisitionData> new_acquisition_data(std::string filename)
 		{
@@ -341,6 +666,9 @@ namespace sirf {
 			_storage_scheme = "file";
 			_template.reset(new PETAcquisitionDataInFile);
 		}
+		// selects memory-mapped (default) or stream-based scratch files
+		static void set_memory_mapped(bool mapped) { _memory_mapped = mapped; }
+		static bool memory_mapped() { return _memory_mapped; }
 
 		virtual PETAcquisitionData* same_acquisition_data
 			(stir::shared_ptr<stir::ExamInfo> sptr_exam_info,
@@ -376,14 +704,23 @@ namespace sirf {
 		}
 
 	private:
+		static bool _memory_mapped;
 		bool _owns_file;
 		std::string _filename;
+
+		// new scratch file data, zero-filled on request (mapped files 
+		// always are)
+		stir::ProjData* scratch_data
+			(stir::shared_ptr<stir::ExamInfo> sptr_exam_info,
+			stir::shared_ptr<stir::ProjDataInfo> sptr_proj_data_info,
+			bool zero = false);
 	};
 
 	/*!
 	\ingroup STIR Extensions
 	\brief In-memory implementation of PETAcquisitionData.
 
+	The data is kept in a ProjDataBuffer.
 	*/
 
 	class PETAcquisitionDataInMemory : public PETAcquisitionData {
@@ -393,12 +730,12 @@ namespace sirf {
 			stir::shared_ptr<stir::ProjDataInfo> sptr_proj_data_info)
 		{
 			_data = stir::shared_ptr<stir::ProjData>
-				(new stir::ProjDataInMemory(sptr_exam_info, sptr_proj_data_info));
+				(new ProjDataBuffer(sptr_exam_info, sptr_proj_data_info));
 		}
 		PETAcquisitionDataInMemory(const stir::ProjData& pd)
 		{
 			_data = stir::shared_ptr<stir::ProjData>
-				(new stir::ProjDataInMemory(pd.get_exam_info_sptr(),
+				(new ProjDataBuffer(pd.get_exam_info_sptr(),
 				pd.get_proj_data_info_sptr()));
 		}
 		PETAcquisitionDataInMemory
@@ -408,8 +745,7 @@ namespace sirf {
 			stir::shared_ptr<stir::ProjDataInfo> sptr_pdi =
 				PETAcquisitionData::proj_data_info_from_scanner
 				(scanner_name, span, max_ring_diff, view_mash_factor);
-			stir::ProjDataInMemory* ptr = new stir::ProjDataInMemory(sptr_ei, sptr_pdi);
-			ptr->fill(0.0f);
+			ProjDataBuffer* ptr = new ProjDataBuffer(sptr_ei, sptr_pdi);
 			_data.reset(ptr);
 		}
 
@@ -456,6 +792,139 @@ namespace sirf {
 
 	};
 
+	/*!
+	\ingroup STIR Extensions
+	\brief Memory-budgeted implementation of PETAcquisitionData.
+
+	The data is kept in a ProjDataHybrid, i.e. in memory while the
+	StorageBudget allows, and in a scratch file otherwise.
+	*/
+
+	class PETAcquisitionDataHybrid : public PETAcquisitionData {
+	public:
+		PETAcquisitionDataHybrid() {}
+		PETAcquisitionDataHybrid(stir::shared_ptr<stir::ExamInfo> sptr_exam_info,
+			stir::shared_ptr<stir::ProjDataInfo> sptr_proj_data_info)
+		{
+			_data = stir::shared_ptr<stir::ProjData>
+				(new ProjDataHybrid(sptr_exam_info, sptr_proj_data_info));
+		}
+		PETAcquisitionDataHybrid(const stir::ProjData& pd)
+		{
+			_data = stir::shared_ptr<stir::ProjData>
+				(new ProjDataHybrid(pd.get_exam_info_sptr(),
+				pd.get_proj_data_info_sptr()));
+		}
+		PETAcquisitionDataHybrid
+			(stir::shared_ptr<stir::ExamInfo> sptr_ei, std::string scanner_name,
+			int span = 1, int max_ring_diff = -1, int view_mash_factor = 1)
+		{
+			stir::shared_ptr<stir::ProjDataInfo> sptr_pdi =
+				PETAcquisitionData::proj_data_info_from_scanner
+				(scanner_name, span, max_ring_diff, view_mash_factor);
+			ProjDataHybrid* ptr = new ProjDataHybrid(sptr_ei, sptr_pdi);
+			_data.reset(ptr);
+		}
+
+		static void init() { PETAcquisitionDataInFile::init(); }
+		static void set_as_template()
+		{
+			init();
+			_storage_scheme = "hybrid";
+			_template.reset(new PETAcquisitionDataHybrid);
+		}
+
+		virtual PETAcquisitionData* same_acquisition_data
+			(stir::shared_ptr<stir::ExamInfo> sptr_exam_info,
+			stir::shared_ptr<stir::ProjDataInfo> sptr_proj_data_info)
+		{
+			PETAcquisitionData* ptr_ad =
+				new PETAcquisitionDataHybrid(sptr_exam_info, sptr_proj_data_info);
+			return ptr_ad;
+		}
+		virtual PETAcquisitionData* same_acquisition_data(const stir::ProjData& pd)
+		{
+			PETAcquisitionData* ptr_ad = new PETAcquisitionDataHybrid(pd);
+			return ptr_ad;
+		}
+		virtual PETAcquisitionData* same_acquisition_data
+			(stir::shared_ptr<stir::ExamInfo> sptr_ei, std::string scanner_name,
+			int span = 1, int max_ring_diff = -1, int view_mash_factor = 1)
+		{
+			PETAcquisitionData* ptr_ad = new PETAcquisitionDataHybrid
+				(sptr_ei, scanner_name, span, max_ring_diff, view_mash_factor);
+			return ptr_ad;
+		}
+		virtual stir::shared_ptr<PETAcquisitionData> new_acquisition_data()
+		{
+			init();
+			return stir::shared_ptr<PETAcquisitionData>
+				(_template->same_acquisition_data(*data()));
+		}
+		virtual aDataContainer<float>* new_data_container()
+		{
+			init();
+			return _template->same_acquisition_data(*data());
+		}
+
+	};
+
+	/*!
+	\ingroup STIR Extensions
+	\brief Reduced precision implementation of PETAcquisitionData.
+
+	A copy of acquisition data kept in a ProjDataReducedPrecision, meant for
+	the terms of the acquisition model that are read at every iteration
+	(additive and background terms, normalisation and attenuation factors).
+	New acquisition data created from it, e.g. the results of algebraic 
+	operations, is stored in full precision by the current storage scheme.
+	*/
+
+	class PETAcquisitionDataReducedPrecision : public PETAcquisitionData {
+	public:
+		PETAcquisitionDataReducedPrecision
+			(const PETAcquisitionData& ad, ReducedPrecision::Format format)
+		{
+			_data.reset(new ProjDataReducedPrecision(*ad.data(), format));
+		}
+
+		virtual PETAcquisitionData* same_acquisition_data
+			(stir::shared_ptr<stir::ExamInfo> sptr_exam_info,
+			stir::shared_ptr<stir::ProjDataInfo> sptr_proj_data_info)
+		{
+			init();
+			return _template->same_acquisition_data
+				(sptr_exam_info, sptr_proj_data_info);
+		}
+		virtual PETAcquisitionData* same_acquisition_data(const stir::ProjData& pd)
+		{
+			init();
+			return _template->same_acquisition_data(pd);
+		}
+		virtual PETAcquisitionData* same_acquisition_data
+			(stir::shared_ptr<stir::ExamInfo> sptr_ei, std::string scanner_name,
+			int span = 1, int max_ring_diff = -1, int view_mash_factor = 1)
+		{
+			init();
+			return _template->same_acquisition_data
+				(sptr_ei, scanner_name, span, max_ring_diff, view_mash_factor);
+		}
+		virtual stir::shared_ptr<PETAcquisitionData> new_acquisition_data()
+		{
+			init();
+			return stir::shared_ptr<PETAcquisitionData>
+				(_template->same_acquisition_data(*data()));
+		}
+		virtual aDataContainer<float>* new_data_container()
+		{
+			init();
+			return _template->same_acquisition_data(*data());
+		}
+
+	private:
+		static void init() { PETAcquisitionDataInFile::init(); }
+	};
+
 	/*!
 	\ingroup STIR Extensions
 	\brief STIR DiscretisedDensity<3, float> wrapper with added functionality.
@@ -523,6 +992,20 @@ namespace sirf {
 			const aDataContainer<float>& y);
 		void axpby(float a, const aDataContainer<float>& x,
 			float b, const aDataContainer<float>& y);
+		// fused operations, one pass over the voxels
+		void xapy(float a, const aDataContainer<float>& x);
+		// axpby is in place and x may be this
+		void scale_xapy(float b, float a, const aDataContainer<float>& x)
+		{
+			axpby(b, *this, a, x);
+		}
+		void linear_combination
+			(int n, const float* a, const aDataContainer<float>* const* x);
+		float axpby_norm(float a, const aDataContainer<float>& x,
+			float b, const aDataContainer<float>& y);
+		float axpby_dot(float a, const aDataContainer<float>& x,
+			float b, const aDataContainer<float>& y,
+			const aDataContainer<float>& z);
 		Image3DF& data()
 		{
 			return *_data;
@@ -554,6 +1037,9 @@ namespace sirf {
 		int get_dimensions(int* dim) const;
 		void get_voxel_sizes(float* vsizes) const;
 		int get_data(float* data) const;
+		// the voxel values in contiguous storage (z major, x minor), or 0 if
+		// the image is not regular or its rows are not stored contiguously
+		float* data_view();
 		int set_data(const float* data);
 
 	protected:
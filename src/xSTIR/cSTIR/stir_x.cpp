@@ -19,17 +19,244 @@ limitations under the License.
 
 */
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef SIRF_MPI
+#include <mpi.h>
+#endif
+
 #include "stir/common.h"
+#include "stir/ArcCorrection.h"
+#include "stir/Bin.h"
+#include "stir/ProjDataInfoCylindricalArcCorr.h"
+#include "stir/Sinogram.h"
+#include "stir/DiscretisedDensityOnCartesianGrid.h"
+#include "stir/recon_buildblock/ProjectorByBinPair.h"
 #include "stir/IO/stir_ecat_common.h"
 #include "stir/is_null_ptr.h"
 #include "stir/error.h"
 
+#include "SIRF/common/profiler.h"
+#include "SIRF/common/thread_pool.h"
 #include "stir_x.h"
 
 using namespace stir;
 using namespace ecat;
 using namespace sirf;
 
+void
+ListmodeToSinograms::process_data()
+{
+	// the chunked conversion also collects the fan sums in the same pass
+	if (do_time_frame && (num_threads_ != 1 || store_fan_sums_)) {
+		process_data_in_parallel_();
+		return;
+	}
+	LmToProjData::process_data();
+}
+
+void
+ListmodeToSinograms::process_data_in_parallel_()
+{
+	// number of records read before their bins are computed in parallel
+	const int chunk_size = 1 << 16;
+#ifdef _OPENMP
+	const int nt = num_threads_ > 0 ? num_threads_ : ThreadPool::num_threads();
+#else
+	const int nt = 1;
+#endif
+
+	const ProjDataInfo& pdi = *template_proj_data_info_ptr;
+	const int min_seg = pdi.get_min_segment_num();
+	const int max_seg = pdi.get_max_segment_num();
+	const int min_view = pdi.get_min_view_num();
+	const int num_views = pdi.get_num_views();
+	const int min_tang = pdi.get_min_tangential_pos_num();
+	const int max_tang = pdi.get_max_tangential_pos_num();
+	const int num_tang = pdi.get_num_tangential_poss();
+
+	// the sinograms of a frame are kept in one array ordered by segment,
+	// view, axial and tangential position, as in a segment by view
+	std::vector<size_t> seg_offset(max_seg - min_seg + 2);
+	seg_offset[0] = 0;
+	for (int s = min_seg; s <= max_seg; s++)
+		seg_offset[s - min_seg + 1] = seg_offset[s - min_seg] +
+		(size_t)num_views*pdi.get_num_axial_poss(s)*num_tang;
+	std::vector<float> sinos(seg_offset.back());
+
+	std::vector<shared_ptr<CListRecord> > records(chunk_size);
+	for (int i = 0; i < chunk_size; i++)
+		records[i] = lm_data_ptr->get_empty_record_sptr();
+
+	shared_ptr<ExamInfo> sptr_exam_info
+		(new ExamInfo(*lm_data_ptr->get_exam_info_ptr()));
+
+	// delayeds fan sums for the randoms estimation
+	const int num_rings = lm_data_ptr->get_scanner_ptr()->get_num_rings();
+	const int num_detectors_per_ring =
+		lm_data_ptr->get_scanner_ptr()->get_num_detectors_per_ring();
+	std::vector<float> fan_sums;
+	if (store_fan_sums_) {
+		set_max_ring_diff_for_fansums_();
+		fan_sums.resize((size_t)num_rings*num_detectors_per_ring);
+		fan_sums_sptr.reset(new std::vector<Array<2, float> >);
+	}
+	bool first_event = true;
+
+	CPUTimer timer;
+	timer.start();
+
+	lm_data_ptr->reset();
+	double current_time = 0;
+	bool eof = false;
+	long num_stored_events = 0;
+	unsigned int frame;
+	for (frame = 1; frame <= frame_defs.get_num_frames() && !eof; frame++) {
+		const double start_time = frame_defs.get_start_time(frame);
+		const double end_time = frame_defs.get_end_time(frame);
+		std::fill(sinos.begin(), sinos.end(), 0.0f);
+		std::fill(fan_sums.begin(), fan_sums.end(), 0.0f);
+		bool end_of_frame = false;
+		while (!end_of_frame && !eof) {
+			// read the next chunk of events of this frame
+			int n = 0;
+			while (n < chunk_size) {
+				CListRecord& record = *records[n];
+				if (lm_data_ptr->get_next_record(record) == Succeeded::no) {
+					eof = true;
+					break;
+				}
+				if (record.is_time()) {
+					current_time = record.time().get_time_in_secs();
+					if (current_time >= end_time) {
+						end_of_frame = true;
+						break;
+					}
+				}
+				else if (record.is_event() && start_time <= current_time)
+					n++;
+			}
+
+			if (store_fan_sums_ && first_event && n > 0) {
+				if (dynamic_cast<const CListEventCylindricalScannerWithDiscreteDetectors*>
+					(&records[0]->event()) == 0)
+					error("Currently only works for scanners with discrete detectors.");
+				first_event = false;
+			}
+
+			long num_events = 0;
+#pragma omp parallel for num_threads(nt) schedule(static) reduction(+:num_events)
+			for (int i = 0; i < n; i++) {
+				const CListEvent& event = records[i]->event();
+				if (store_fan_sums_ && !event.is_prompt()) {
+					DetectionPositionPair<> det_pos;
+					static_cast<const CListEventCylindricalScannerWithDiscreteDetectors&>
+						(event).get_detection_position(det_pos);
+					const int ra = det_pos.pos1().axial_coord();
+					const int rb = det_pos.pos2().axial_coord();
+					const int a = det_pos.pos1().tangential_coord();
+					const int b = det_pos.pos2().tangential_coord();
+					const int det_num_diff =
+						(a - b + 3 * num_detectors_per_ring / 2) % num_detectors_per_ring;
+					if (abs(ra - rb) <= max_ring_diff_for_fansums &&
+						(det_num_diff <= fan_size / 2 ||
+						det_num_diff >= num_detectors_per_ring - fan_size / 2)) {
+#pragma omp atomic
+						fan_sums[(size_t)ra*num_detectors_per_ring + a] += 1;
+#pragma omp atomic
+						fan_sums[(size_t)rb*num_detectors_per_ring + b] += 1;
+					}
+				}
+				const int increment = event.is_prompt() ?
+					(store_prompts ? 1 : 0) : delayed_increment;
+				if (increment == 0)
+					continue;
+				Bin bin;
+				bin.set_bin_value(1);
+				get_bin_from_event(bin, event);
+				const int s = bin.segment_num();
+				if (bin.get_bin_value() <= 0 || s < min_seg || s > max_seg)
+					continue;
+				const int v = bin.view_num() - min_view;
+				const int a = bin.axial_pos_num() - pdi.get_min_axial_pos_num(s);
+				const int t = bin.tangential_pos_num();
+				if (v < 0 || v >= num_views || t < min_tang || t > max_tang ||
+					a < 0 || a >= pdi.get_num_axial_poss(s))
+					continue;
+				const size_t k = seg_offset[s - min_seg] +
+					((size_t)v*pdi.get_num_axial_poss(s) + a)*num_tang + t - min_tang;
+				const float value = bin.get_bin_value()*increment;
+#pragma omp atomic
+				sinos[k] += value;
+				num_events += increment;
+			}
+			num_stored_events += num_events;
+		}
+
+		// write the sinograms of this frame
+		std::ostringstream filename;
+		filename << output_filename_prefix << "_f" << frame << "g1d0b0";
+		ProjDataInterfile proj_data
+			(sptr_exam_info, template_proj_data_info_ptr, filename.str());
+		for (int s = min_seg; s <= max_seg; s++) {
+			const int num_axial = pdi.get_num_axial_poss(s);
+			for (int v = 0; v < num_views; v++) {
+				Viewgram<float> viewgram =
+					proj_data.get_empty_viewgram(v + min_view, s);
+				const float* p = &sinos[seg_offset[s - min_seg] +
+					(size_t)v*num_axial*num_tang];
+				for (int a = 0; a < num_axial; a++)
+					for (int t = 0; t < num_tang; t++)
+						viewgram[a + pdi.get_min_axial_pos_num(s)][t + min_tang] =
+						*p++;
+				proj_data.set_viewgram(viewgram);
+			}
+		}
+		if (store_fan_sums_) {
+			Array<2, float> frame_fan_sums
+				(IndexRange2D(num_rings, num_detectors_per_ring));
+			const float* p = &fan_sums[0];
+			for (int r = 0; r < num_rings; r++)
+				for (int d = 0; d < num_detectors_per_ring; d++)
+					frame_fan_sums[r][d] = *p++;
+			fan_sums_sptr->push_back(frame_fan_sums);
+		}
+		std::cout << "processed frame " << frame << '\n';
+	}
+	timer.stop();
+
+	if (eof && frame <= frame_defs.get_num_frames())
+		std::cerr << "Early stop due to EOF. " << std::endl;
+	std::cerr << "Total number of prompts/trues/delayed stored: "
+		<< num_stored_events << std::endl;
+	std::cerr << "\nThis took " << timer.value() << "s CPU time." << std::endl;
+}
+
+void
+ListmodeToSinograms::set_max_ring_diff_for_fansums_()
+{
+	// TODO have to use lm_data_ptr->get_proj_data_info_sptr() once STIR PR 108 is merged
+	max_ring_diff_for_fansums = 60;
+	if (*lm_data_ptr->get_scanner_ptr() != Scanner(Scanner::Siemens_mMR))
+	{
+		warning("This is not mMR data. Assuming all possible ring differences are in the listmode file");
+		max_ring_diff_for_fansums = lm_data_ptr->get_scanner_ptr()->get_num_rings() - 1;
+	}
+}
+
 void
 ListmodeToSinograms::compute_fan_sums_(bool prompt_fansum)
 {
@@ -53,13 +280,7 @@ ListmodeToSinograms::compute_fan_sums_(bool prompt_fansum)
 	// go to the beginning of the binary data
 	lm_data_ptr->reset();
 
-	// TODO have to use lm_data_ptr->get_proj_data_info_sptr() once STIR PR 108 is merged
-	max_ring_diff_for_fansums = 60;
-	if (*lm_data_ptr->get_scanner_ptr() != Scanner(Scanner::Siemens_mMR))
-	{
-		warning("This is not mMR data. Assuming all possible ring differences are in the listmode file");
-		max_ring_diff_for_fansums = lm_data_ptr->get_scanner_ptr()->get_num_rings() - 1;
-	}
+	set_max_ring_diff_for_fansums_();
 	unsigned int current_frame_num = 1;
 	{
 		// loop over all events in the listmode file
@@ -187,7 +408,7 @@ const int max_ring_diff, const int half_fan_size)
 }
 
 int
-ListmodeToSinograms::compute_singles_()
+ListmodeToSinograms::compute_singles_(unsigned int frame)
 {
 	const int do_display_interval = display_interval;
 	const int do_KL_interval = KL_interval;
@@ -197,7 +418,7 @@ ListmodeToSinograms::compute_singles_()
 	int num_rings;
 	int num_detectors_per_ring;
 	int max_ring_diff = max_ring_diff_for_fansums;
-	Array<2, float> data_fan_sums = (*fan_sums_sptr)[0];
+	Array<2, float> data_fan_sums = (*fan_sums_sptr)[frame - 1];
 
 	num_rings = data_fan_sums.get_length();
 	assert(num_rings > 0);
@@ -258,34 +479,111 @@ ListmodeToSinograms::compute_singles_()
 }
 
 void
-ListmodeToSinograms::estimate_randoms_()
+ListmodeToSinograms::set_up_randoms_mapping_
+(const ProjDataInfoCylindricalNoArcCorr& proj_data_info,
+const ProjDataInfoCylindricalNoArcCorr& uncompressed_proj_data_info)
+{
+	if (!is_null_ptr(randoms_pdi_sptr_) && *randoms_pdi_sptr_ == proj_data_info)
+		return;
+
+	// uncompressed ring pairs contributing to each compressed sinogram
+	randoms_ring_pairs_.clear();
+	Bin bin;
+	Bin uncompressed_bin;
+	uncompressed_bin.view_num() = 0;
+	uncompressed_bin.tangential_pos_num() = 0;
+	for (bin.segment_num() = proj_data_info.get_min_segment_num();
+		bin.segment_num() <= proj_data_info.get_max_segment_num();
+		++bin.segment_num())
+		for (bin.axial_pos_num() = proj_data_info.get_min_axial_pos_num
+			(bin.segment_num());
+			bin.axial_pos_num() <= proj_data_info.get_max_axial_pos_num
+			(bin.segment_num());
+			++bin.axial_pos_num()) {
+			const float out_m = proj_data_info.get_m(bin);
+			std::vector<std::pair<int, int> > ring_pairs;
+			for (uncompressed_bin.segment_num() =
+				proj_data_info.get_min_ring_difference(bin.segment_num());
+				uncompressed_bin.segment_num() <=
+				proj_data_info.get_max_ring_difference(bin.segment_num());
+				++uncompressed_bin.segment_num())
+				for (uncompressed_bin.axial_pos_num() =
+					uncompressed_proj_data_info.get_min_axial_pos_num
+					(uncompressed_bin.segment_num());
+					uncompressed_bin.axial_pos_num() <=
+					uncompressed_proj_data_info.get_max_axial_pos_num
+					(uncompressed_bin.segment_num());
+					++uncompressed_bin.axial_pos_num()) {
+					const float in_m =
+						uncompressed_proj_data_info.get_m(uncompressed_bin);
+					if (fabs(out_m - in_m) > 1E-4)
+						continue;
+					int ra = 0, a = 0;
+					int rb = 0, b = 0;
+					uncompressed_proj_data_info.get_det_pair_for_bin
+						(a, ra, b, rb, uncompressed_bin);
+					ring_pairs.push_back(std::pair<int, int>(ra, rb));
+				}
+			randoms_ring_pairs_.push_back(ring_pairs);
+		}
+
+	// detector pairs for each uncompressed view and tangential position
+	const int num_detectors_per_ring =
+		proj_data_info.get_scanner_ptr()->get_num_detectors_per_ring();
+	const int num_views = proj_data_info.get_num_views()*
+		proj_data_info.get_view_mashing_factor();
+	const int min_tang = proj_data_info.get_min_tangential_pos_num();
+	const int num_tang = proj_data_info.get_num_tangential_poss();
+	randoms_det_pairs_.resize(2 * (size_t)num_views*num_tang);
+	uncompressed_bin.segment_num() = 0;
+	uncompressed_bin.axial_pos_num() = 0;
+	int* det_pair = &randoms_det_pairs_[0];
+	for (uncompressed_bin.view_num() = 0;
+		uncompressed_bin.view_num() < num_views;
+		++uncompressed_bin.view_num())
+		for (int t = 0; t < num_tang; t++) {
+			uncompressed_bin.tangential_pos_num() = t + min_tang;
+			int ra = 0, a = 0;
+			int rb = 0, b = 0;
+			uncompressed_proj_data_info.get_det_pair_for_bin
+				(a, ra, b, rb, uncompressed_bin);
+			*det_pair++ = a;
+			*det_pair++ = b % num_detectors_per_ring;
+		}
+
+	randoms_pdi_sptr_.reset(proj_data_info.clone());
+}
+
+void
+ListmodeToSinograms::estimate_randoms_(unsigned int frame)
 {
 	PETAcquisitionDataInFile acq_temp(template_proj_data_name.c_str());
 	shared_ptr<ProjData> template_projdata_ptr = acq_temp.data();
-	std::string filename = output_filename_prefix + "_randoms" + "_f1g1d0b0.hs";
+	std::ostringstream os;
+	os << output_filename_prefix << "_randoms" << "_f" << frame << "g1d0b0.hs";
+	std::string filename = os.str();
 	randoms_sptr = acq_temp.new_acquisition_data(); // filename);
 	ProjData& proj_data = *randoms_sptr->data();
 
-	const int num_rings =
-		template_projdata_ptr->get_proj_data_info_ptr()->get_scanner_ptr()->
-		get_num_rings();
 	const int num_detectors_per_ring =
 		template_projdata_ptr->get_proj_data_info_ptr()->get_scanner_ptr()->
 		get_num_detectors_per_ring();
-	DetectorEfficiencies& efficiencies = *det_eff_sptr;
+	const DetectorEfficiencies& efficiencies = *det_eff_sptr;
 
+	const ProjDataInfoCylindricalNoArcCorr * const proj_data_info_ptr =
+		dynamic_cast<const ProjDataInfoCylindricalNoArcCorr * const>
+		(proj_data.get_proj_data_info_ptr());
+	if (proj_data_info_ptr == 0)
 	{
-		const ProjDataInfoCylindricalNoArcCorr * const proj_data_info_ptr =
-			dynamic_cast<const ProjDataInfoCylindricalNoArcCorr * const>
-			(proj_data.get_proj_data_info_ptr());
-		if (proj_data_info_ptr == 0)
-		{
-			error("Can only process not arc-corrected data\n");
-		}
+		error("Can only process not arc-corrected data\n");
+	}
+	if (proj_data.get_min_view_num() != 0)
+		error("Can only handle min_view_num==0\n");
 
-		const int mashing_factor =
-			proj_data_info_ptr->get_view_mashing_factor();
+	const int mashing_factor =
+		proj_data_info_ptr->get_view_mashing_factor();
 
+	{
 		shared_ptr<Scanner>
 			scanner_sptr(new Scanner(*proj_data_info_ptr->get_scanner_ptr()));
 		unique_ptr<ProjDataInfo> uncompressed_proj_data_info_uptr
@@ -297,85 +595,123 @@ ListmodeToSinograms::estimate_randoms_()
 		const ProjDataInfoCylindricalNoArcCorr * const uncompressed_proj_data_info_ptr =
 			dynamic_cast<const ProjDataInfoCylindricalNoArcCorr * const>
 			(uncompressed_proj_data_info_uptr.get());
-		Bin bin;
-		Bin uncompressed_bin;
-
-		for (bin.segment_num() = proj_data.get_min_segment_num();
-			bin.segment_num() <= proj_data.get_max_segment_num();
-			++bin.segment_num())
-		{
+		set_up_randoms_mapping_
+			(*proj_data_info_ptr, *uncompressed_proj_data_info_ptr);
+	}
 
-			for (bin.axial_pos_num() = proj_data.get_min_axial_pos_num
-				(bin.segment_num());
-				bin.axial_pos_num() <= proj_data.get_max_axial_pos_num
-				(bin.segment_num());
-			++bin.axial_pos_num())
-			{
-				Sinogram<float> sinogram = proj_data_info_ptr->get_empty_sinogram
-					(bin.axial_pos_num(), bin.segment_num());
-				const float out_m = proj_data_info_ptr->get_m(bin);
-				const int in_min_segment_num =
-					proj_data_info_ptr->get_min_ring_difference(bin.segment_num());
-				const int in_max_segment_num =
-					proj_data_info_ptr->get_max_ring_difference(bin.segment_num());
-
-				// now loop over uncompressed detector-pairs
-				{
-					for (uncompressed_bin.segment_num() = in_min_segment_num;
-						uncompressed_bin.segment_num() <= in_max_segment_num;
-						++uncompressed_bin.segment_num())
-						for (uncompressed_bin.axial_pos_num() =
-							uncompressed_proj_data_info_ptr->get_min_axial_pos_num
-							(uncompressed_bin.segment_num());
-					uncompressed_bin.axial_pos_num() <=
-						uncompressed_proj_data_info_ptr->get_max_axial_pos_num
-						(uncompressed_bin.segment_num());
-					++uncompressed_bin.axial_pos_num())
-						{
-							const float in_m =
-								uncompressed_proj_data_info_ptr->get_m(uncompressed_bin);
-							if (fabs(out_m - in_m) > 1E-4)
-								continue;
-
-							// views etc
-							if (proj_data.get_min_view_num() != 0)
-								error("Can only handle min_view_num==0\n");
-							for (bin.view_num() = proj_data.get_min_view_num();
-								bin.view_num() <= proj_data.get_max_view_num();
-								++bin.view_num())
-							{
-
-								for (bin.tangential_pos_num() = proj_data_info_ptr->get_min_tangential_pos_num();
-									bin.tangential_pos_num() <= proj_data_info_ptr->get_max_tangential_pos_num();
-									++bin.tangential_pos_num())
-								{
-									uncompressed_bin.tangential_pos_num() =
-										bin.tangential_pos_num();
-									for (uncompressed_bin.view_num() =
-										bin.view_num()*mashing_factor;
-										uncompressed_bin.view_num() <
-										(bin.view_num() + 1)*mashing_factor;
-									++uncompressed_bin.view_num())
-									{
-										int ra = 0, a = 0;
-										int rb = 0, b = 0;
-										uncompressed_proj_data_info_ptr->get_det_pair_for_bin(a, ra, b, rb,
-											uncompressed_bin);
-										/*(*segment_ptr)[bin.axial_pos_num()]*/
-										sinogram[bin.view_num()][bin.tangential_pos_num()] +=
-											efficiencies[ra][a] * efficiencies[rb][b%num_detectors_per_ring];
-									}
-								}
-							}
-						}
+	const int num_views = proj_data.get_num_views();
+	const int min_tang = proj_data_info_ptr->get_min_tangential_pos_num();
+	const int num_tang = proj_data_info_ptr->get_num_tangential_poss();
+
+	// randoms sinogram = sum over the detector pairs of its bins of the
+	// products of the pair efficiencies; the sinograms of each segment are
+	// computed in parallel and then written in order
+	size_t sino = 0;
+	for (int s = proj_data.get_min_segment_num();
+		s <= proj_data.get_max_segment_num(); ++s) {
+		const int min_ax = proj_data.get_min_axial_pos_num(s);
+		const int num_ax = proj_data.get_num_axial_poss(s);
+		std::vector<Sinogram<float> > sinograms;
+		sinograms.reserve(num_ax);
+		for (int ax = 0; ax < num_ax; ax++)
+			sinograms.push_back
+			(proj_data_info_ptr->get_empty_sinogram(ax + min_ax, s));
+#pragma omp parallel for num_threads(ThreadPool::num_threads()) schedule(dynamic)
+		for (int ax = 0; ax < num_ax; ax++) {
+			Sinogram<float>& sinogram = sinograms[ax];
+			const std::vector<std::pair<int, int> >& ring_pairs =
+				randoms_ring_pairs_[sino + ax];
+			for (size_t k = 0; k < ring_pairs.size(); k++) {
+				const Array<1, float>& eff_a = efficiencies[ring_pairs[k].first];
+				const Array<1, float>& eff_b = efficiencies[ring_pairs[k].second];
+				for (int v = 0; v < num_views; v++) {
+					Array<1, float>& row = sinogram[v];
+					const int* det_pair =
+						&randoms_det_pairs_[2 * (size_t)v*mashing_factor*num_tang];
+					for (int m = 0; m < mashing_factor; m++)
+						for (int t = 0; t < num_tang; t++, det_pair += 2)
+							row[t + min_tang] +=
+							eff_a[det_pair[0]] * eff_b[det_pair[1]];
 				}
-				proj_data.set_sinogram(sinogram);
 			}
 		}
+		for (int ax = 0; ax < num_ax; ax++)
+			proj_data.set_sinogram(sinograms[ax]);
+		sino += num_ax;
 	}
 	randoms_sptr->write(filename.c_str());
 }
 
+// 64-bit FNV-1a hash used for the sensitivity cache keys
+class Hash64 {
+public:
+	Hash64() : h_(14695981039346656037ULL) {}
+	void add(const void* data, size_t size)
+	{
+		const unsigned char* p = (const unsigned char*)data;
+		for (size_t i = 0; i < size; i++) {
+			h_ ^= p[i];
+			h_ *= 1099511628211ULL;
+		}
+	}
+	void add(const std::string& str)
+	{
+		add(str.c_str(), str.size() + 1);
+	}
+	void add(const Image3DF& image)
+	{
+		for (Image3DF::const_full_iterator i = image.begin_all_const();
+			i != image.end_all_const(); ++i) {
+			float v = *i;
+			add(&v, sizeof(float));
+		}
+	}
+	void add(PETAcquisitionData& ad)
+	{
+		shared_ptr<ProjData> sptr_pd = ad.data();
+		for (int s = sptr_pd->get_min_segment_num();
+			s <= sptr_pd->get_max_segment_num(); s++) {
+			SegmentBySinogram<float> seg = sptr_pd->get_segment_by_sinogram(s);
+			for (SegmentBySinogram<float>::full_iterator i = seg.begin_all();
+				i != seg.end_all(); ++i) {
+				float v = *i;
+				add(&v, sizeof(float));
+			}
+		}
+	}
+	std::string str() const
+	{
+		std::ostringstream os;
+		os << std::hex;
+		os.width(16);
+		os.fill('0');
+		os << h_;
+		return os.str();
+	}
+private:
+	unsigned long long h_;
+};
+
+// the index ranges, voxel size and origin of an image
+static std::string
+image_geometry_(const Image3DF& image)
+{
+	std::ostringstream geometry;
+	const Voxels3DF* ptr_voxels = dynamic_cast<const Voxels3DF*>(&image);
+	if (ptr_voxels) {
+		CartesianCoordinate3D<float> size = ptr_voxels->get_voxel_size();
+		CartesianCoordinate3D<float> origin = ptr_voxels->get_origin();
+		geometry << size.z() << ' ' << size.y() << ' ' << size.x() << ' '
+			<< origin.z() << ' ' << origin.y() << ' ' << origin.x();
+	}
+	for (int z = image.get_min_index(); z <= image.get_max_index(); z++)
+		for (int y = image[z].get_min_index(); y <= image[z].get_max_index(); y++)
+			geometry << ' ' << z << ' ' << y << ' '
+			<< image[z][y].get_min_index() << ' '
+			<< image[z][y].get_max_index();
+	return geometry.str();
+}
+
 PETAcquisitionSensitivityModel::
 PETAcquisitionSensitivityModel(PETAcquisitionData& ad)
 {
@@ -389,6 +725,10 @@ PETAcquisitionSensitivityModel(PETAcquisitionData& ad)
 	norm_ = sptr_n;
 	//norm_ = shared_ptr<BinNormalisation>
 	//	(new BinNormalisationFromProjData(sptr_ad->data()));
+	Hash64 hash;
+	hash.add(ad.get_proj_data_info_sptr()->parameter_info());
+	hash.add(ad);
+	source_ = "efficiencies " + hash.str();
 }
 
 PETAcquisitionSensitivityModel::
@@ -399,6 +739,14 @@ PETAcquisitionSensitivityModel(std::string filename)
 	//shared_ptr<BinNormalisation> sptr_0;
 	//norm_.reset(new ChainedBinNormalisation(sptr_n, sptr_0));
 	norm_ = sptr_n;
+	std::ifstream file(filename.c_str(), std::ios::binary);
+	if (!file.good())
+		return;
+	Hash64 hash;
+	std::vector<char> buff(1 << 20);
+	while (file.read(&buff[0], buff.size()) || file.gcount() > 0)
+		hash.add(&buff[0], (size_t)file.gcount());
+	source_ = "ECAT8 " + hash.str();
 }
 
 Succeeded 
@@ -430,13 +778,39 @@ PETAttenuationModel::PETAttenuationModel
 	shared_ptr<BinNormalisation>
 		sptr_n(new BinNormalisationFromAttenuationImage
 		(id.data_sptr(), sptr_forw_projector_));
-	norm_ = sptr_n;
+	shared_ptr<DataSymmetriesForViewSegmentNumbers>
+		symmetries_sptr(sptr_forw_projector_->get_symmetries_used()->clone());
+	sptr_cached_norm_.reset
+		(new BinNormalisationWithCachedFactors(sptr_n, symmetries_sptr));
+	norm_ = sptr_cached_norm_;
+	Hash64 hash;
+	hash.add(am.projectors_sptr()->parameter_info());
+	hash.add(id.data());
+	source_ = "attenuation " + hash.str();
+}
+
+void
+PETAttenuationModel::set_cache(bool cache)
+{
+	sptr_cached_norm_->set_cache(cache);
+}
+
+bool
+PETAttenuationModel::cache() const
+{
+	return sptr_cached_norm_->cache();
 }
 
 void
 PETAttenuationModel::unnormalise(PETAcquisitionData& ad) const
 {
 	//std::cout << "in PETAttenuationModel::unnormalise\n";
+	shared_ptr<PETAcquisitionData> sptr_af = sptr_cached_norm_->factors_sptr();
+	if (!is_null_ptr(sptr_af) &&
+		*sptr_af->get_proj_data_info_sptr() == *ad.get_proj_data_info_sptr()) {
+		ad.multiply(ad, *sptr_af);
+		return;
+	}
 	BinNormalisation* norm = norm_.get();
 	shared_ptr<DataSymmetriesForViewSegmentNumbers>
 		symmetries_sptr(sptr_forw_projector_->get_symmetries_used()->clone());
@@ -446,12 +820,59 @@ PETAttenuationModel::unnormalise(PETAcquisitionData& ad) const
 void
 PETAttenuationModel::normalise(PETAcquisitionData& ad) const
 {
+	shared_ptr<PETAcquisitionData> sptr_af = sptr_cached_norm_->factors_sptr();
+	if (!is_null_ptr(sptr_af) &&
+		*sptr_af->get_proj_data_info_sptr() == *ad.get_proj_data_info_sptr()) {
+		ad.divide(ad, *sptr_af);
+		return;
+	}
 	BinNormalisation* norm = norm_.get();
 	shared_ptr<DataSymmetriesForViewSegmentNumbers>
 		symmetries_sptr(sptr_forw_projector_->get_symmetries_used()->clone());
 	norm->apply(*ad.data(), 0, 1, symmetries_sptr);
 }
 
+Succeeded
+BinNormalisationWithCachedFactors::set_up
+(const shared_ptr<ProjDataInfo>& sptr_pdi)
+{
+	sptr_factors_.reset();
+	Succeeded s = sptr_norm_->set_up(sptr_pdi);
+	if (s != Succeeded::yes || !cache_)
+		return s;
+	shared_ptr<ExamInfo> sptr_ei(new ExamInfo);
+	sptr_factors_.reset(new PETAcquisitionDataInMemory(sptr_ei, sptr_pdi));
+	sptr_factors_->fill(1.0f);
+	sptr_norm_->undo(*sptr_factors_->data(), 0, 1, sptr_symmetries_);
+	return s;
+}
+
+void
+BinNormalisationWithCachedFactors::apply(RelatedViewgrams<float>& viewgrams,
+	const double start_time, const double end_time) const
+{
+	if (is_null_ptr(sptr_factors_)) {
+		sptr_norm_->apply(viewgrams, start_time, end_time);
+		return;
+	}
+	RelatedViewgrams<float> factors = sptr_factors_->data()->get_related_viewgrams
+		(viewgrams.get_basic_view_segment_num(), viewgrams.get_symmetries_sptr());
+	viewgrams /= factors;
+}
+
+void
+BinNormalisationWithCachedFactors::undo(RelatedViewgrams<float>& viewgrams,
+	const double start_time, const double end_time) const
+{
+	if (is_null_ptr(sptr_factors_)) {
+		sptr_norm_->undo(viewgrams, start_time, end_time);
+		return;
+	}
+	RelatedViewgrams<float> factors = sptr_factors_->data()->get_related_viewgrams
+		(viewgrams.get_basic_view_segment_num(), viewgrams.get_symmetries_sptr());
+	viewgrams *= factors;
+}
+
 //void
 //PETAcquisitionModel::set_bin_efficiency
 //(shared_ptr<PETAcquisitionData> sptr_data)
@@ -475,6 +896,7 @@ PETAcquisitionModel::set_up(
 			(sptr_acq->get_proj_data_info_sptr(), sptr_image->data_sptr());
 		sptr_acq_template_ = sptr_acq;
 		sptr_image_template_ = sptr_image;
+		sptr_workspace_.reset();
 	}
 	if (s == Succeeded(Succeeded::yes)) {
 		if (sptr_asm_ && sptr_asm_->data())
@@ -483,38 +905,66 @@ PETAcquisitionModel::set_up(
 	return s;
 }
 
-void 
+void
 PETAcquisitionModel::forward(PETAcquisitionData& ad, const PETImageData& image,
 	int subset_num, int num_subsets, bool zero)
 {
+	SIRF_PROFILE("PETAcquisitionModel::forward");
 	shared_ptr<ProjData> sptr_fd = ad.data();
+	if (verbosity_ > 1)
+		std::cout << "forward projecting...";
 	sptr_projectors_->get_forward_projector_sptr()->forward_project
 		(*sptr_fd, image.data(), subset_num, num_subsets, zero);
-
-	if (sptr_add_.get()) {
-		std::cout << "additive term added...";
-		ad.axpby(1.0, ad, 1.0, *sptr_add_);
+	if (verbosity_ > 1)
 		std::cout << "ok\n";
-	}
-	else
-		std::cout << "no additive term added\n";
 
 	PETAcquisitionSensitivityModel* sm = sptr_asm_.get();
-	if (sm && sm->data() && !sm->data()->is_trivial()) {
-		std::cout << "applying unnormalisation...";
-		sptr_asm_->unnormalise(ad);
-		std::cout << "ok\n";
+	if (!(sm && sm->data() && !sm->data()->is_trivial()))
+		sm = 0;
+	if (verbosity_ > 0) {
+		std::cout << (sptr_add_.get() ? "" : "no ") << "additive term, ";
+		std::cout << (sm ? "" : "no ") << "unnormalisation, ";
+		std::cout << (sptr_background_.get() ? "" : "no ")
+			<< "background term applied\n";
 	}
-	else
-		std::cout << "no unnormalisation applied\n";
 
-	if (sptr_background_.get()) {
-		std::cout << "background term added...";
-		ad.axpby(1.0, ad, 1.0, *sptr_background_);
-		std::cout << "ok\n";
+	if (!sm && !(sptr_add_.get() && sptr_background_.get())) {
+		// at most one term to add: axpby streams over the data once
+		if (sptr_add_.get())
+			ad.axpby(1.0, ad, 1.0, *sptr_add_);
+		else if (sptr_background_.get())
+			ad.axpby(1.0, ad, 1.0, *sptr_background_);
+		return;
+	}
+	postprocess_(ad, sm);
+}
+
+void
+PETAcquisitionModel::postprocess_(PETAcquisitionData& ad,
+	const PETAcquisitionSensitivityModel* sm) const
+{
+	ProjData& y = *ad.data();
+	ProjData* a = sptr_add_.get() ? sptr_add_->data().get() : 0;
+	ProjData* b = sptr_background_.get() ? sptr_background_->data().get() : 0;
+	// the projector symmetries are those the attenuation model expects
+	shared_ptr<DataSymmetriesForViewSegmentNumbers>
+		symmetries_sptr(sptr_projectors_->get_symmetries_used()->clone());
+	for (int s = y.get_min_segment_num(); s <= y.get_max_segment_num(); s++) {
+		for (int v = y.get_min_view_num(); v <= y.get_max_view_num(); v++) {
+			ViewSegmentNumbers vs(v, s);
+			if (!symmetries_sptr->is_basic(vs))
+				continue;
+			RelatedViewgrams<float> viewgrams =
+				y.get_related_viewgrams(vs, symmetries_sptr);
+			if (a)
+				viewgrams += a->get_related_viewgrams(vs, symmetries_sptr);
+			if (sm)
+				sm->unnormalise_viewgrams(viewgrams);
+			if (b)
+				viewgrams += b->get_related_viewgrams(vs, symmetries_sptr);
+			y.set_related_viewgrams(viewgrams);
+		}
 	}
-	else
-		std::cout << "no background term added\n";
 }
 
 shared_ptr<PETAcquisitionData>
@@ -568,28 +1018,1153 @@ PETAcquisitionModel::backward(PETAcquisitionData& ad,
 {
 	shared_ptr<PETImageData> sptr_id;
 	sptr_id = sptr_image_template_->new_image_data();
-	shared_ptr<Image3DF> sptr_im = sptr_id->data_sptr();
+	backward(*sptr_id, ad, subset_num, num_subsets);
+	return sptr_id;
+}
+
+void
+PETAcquisitionModel::backward(PETImageData& id, PETAcquisitionData& ad,
+	int subset_num, int num_subsets)
+{
+	SIRF_PROFILE("PETAcquisitionModel::backward");
+	Image3DF& image = id.data();
+	// the backprojector accumulates into the image
+	image.fill(0.0f);
 
 	//if (sptr_normalisation_.get() && !sptr_normalisation_->is_trivial()) {
 	PETAcquisitionSensitivityModel* sm = sptr_asm_.get();
 	if (sm && sm->data() && !sm->data()->is_trivial()) {
-		std::cout << "applying unnormalisation...";
-		shared_ptr<PETAcquisitionData> sptr_ad(ad.new_acquisition_data());
-		sptr_ad->fill(ad);
-		sptr_asm_->unnormalise(*sptr_ad);
+		if (verbosity_ > 0)
+			std::cout << "applying unnormalisation...";
+		PETAcquisitionData& wd = workspace_(ad);
+		wd.fill(ad);
+		sptr_asm_->unnormalise(wd);
 		//sptr_normalisation_->undo(*sptr_ad->data(), 0, 1);
-		std::cout << "ok\n";
-		std::cout << "backprojecting...";
-		sptr_projectors_->get_back_projector_sptr()->back_project
-			(*sptr_im, *sptr_ad, subset_num, num_subsets);
-		std::cout << "ok\n";
+		if (verbosity_ > 0)
+			std::cout << "ok\n";
+		if (verbosity_ > 1)
+			std::cout << "backprojecting...";
+		back_project_(image, wd, subset_num, num_subsets);
 	}
 	else {
-		std::cout << "backprojecting...";
-		sptr_projectors_->get_back_projector_sptr()->back_project
-			(*sptr_im, ad, subset_num, num_subsets);
+		if (verbosity_ > 1)
+			std::cout << "backprojecting...";
+		back_project_(image, ad, subset_num, num_subsets);
+	}
+	if (verbosity_ > 1)
 		std::cout << "ok\n";
+}
+
+void
+PETAcquisitionModel::back_project_
+(Image3DF& image, PETAcquisitionData& ad, int subset_num, int num_subsets)
+{
+	BackProjectorByBin& bp = *sptr_projectors_->get_back_projector_sptr();
+	if (!PETDistributed::active()) {
+		bp.back_project(image, ad, subset_num, num_subsets);
+		return;
 	}
+	// the views of the subset are split further: subset (subset_num, 
+	// num_subsets) is the union of the subsets (subset_num + r*num_subsets,
+	// num_subsets*size) over the process numbers r
+	int np = PETDistributed::size();
+	bp.back_project(image, ad,
+		subset_num + PETDistributed::rank()*num_subsets, num_subsets*np);
+	PETDistributed::sum(image);
+}
 
-	return sptr_id;
+PETAcquisitionData&
+PETAcquisitionModel::workspace_(PETAcquisitionData& ad)
+{
+	// reuse the previous workspace if it has the geometry of ad
+	if (!sptr_workspace_.get() ||
+		*sptr_workspace_->get_proj_data_info_sptr() !=
+		*ad.get_proj_data_info_sptr())
+		sptr_workspace_ = ad.new_acquisition_data();
+	return *sptr_workspace_;
+}
+
+int PETGradientThreads::num_threads_ = 1;
+int PETGradientThreads::memory_limit_ = 2048;
+
+void
+PETGradientThreads::set(int n)
+{
+	num_threads_ = n > 0 ? n : 0;
+}
+
+int
+PETGradientThreads::get()
+{
+#ifdef _OPENMP
+	return num_threads_ > 0 ? num_threads_ : ThreadPool::num_threads();
+#else
+	return 1;
+#endif
+}
+
+void
+PETGradientThreads::set_memory_limit(int mb)
+{
+	memory_limit_ = mb > 0 ? mb : 0;
+}
+
+int
+PETGradientThreads::memory_limit()
+{
+	return memory_limit_;
+}
+
+void
+PETGradientThreads::compute_gradient(ObjectiveFunction3DF& fun,
+	Image3DF& grad, const Image3DF& image)
+{
+	if (!PETDistributed::active()) {
+		compute_gradient_(fun, grad, image, 0, 1);
+		return;
+	}
+	shared_ptr<Image3DF> sptr_image(image.clone());
+	PETDistributed::broadcast(*sptr_image);
+	compute_gradient_(fun, grad, *sptr_image,
+		PETDistributed::rank(), PETDistributed::size());
+	PETDistributed::sum(grad);
+}
+
+void
+PETGradientThreads::compute_gradient_(ObjectiveFunction3DF& fun,
+	Image3DF& grad, const Image3DF& image, int first, int step)
+{
+	grad.fill(0.0);
+	std::vector<int> subsets;
+	for (int s = first; s < fun.get_num_subsets(); s += step)
+		subsets.push_back(s);
+	int nsub = (int)subsets.size();
+	if (nsub < 1)
+		return;
+	// thread 0 accumulates into grad, every other thread needs an
+	// accumulator, and each thread needs a subset gradient image
+	size_t image_size = std::max((size_t)1, grad.size_all()*sizeof(float));
+	size_t max_images = ((size_t)memory_limit_ << 20) / image_size;
+	int nt = std::min(get(), nsub);
+	nt = (int)std::min((size_t)nt, std::max((size_t)1, (max_images + 1) / 2));
+
+	std::vector<shared_ptr<Image3DF> > images(2 * nt - 1);
+	std::vector<Image3DF*> sum(nt);
+	std::vector<Image3DF*> sub(nt);
+	for (int i = 0; i < 2 * nt - 1; i++)
+		images[i].reset(grad.get_empty_copy());
+	for (int t = 0; t < nt; t++) {
+		sub[t] = images[t].get();
+		sum[t] = t ? images[nt + t - 1].get() : &grad;
+	}
+	if (nt < 2) {
+		for (int i = 0; i < nsub; i++) {
+			fun.compute_sub_gradient(*sub[0], image, subsets[i]);
+			grad += *sub[0];
+		}
+		return;
+	}
+
+	std::string err;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nt) schedule(dynamic)
+#endif
+	for (int i = 0; i < nsub; i++) {
+#ifdef _OPENMP
+		int t = omp_get_thread_num();
+#else
+		int t = 0;
+#endif
+		// exceptions must not leave the parallel region
+		try {
+			fun.compute_sub_gradient(*sub[t], image, subsets[i]);
+			*sum[t] += *sub[t];
+		}
+		catch (std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(PETGradientThreads_error)
+#endif
+			err = e.what();
+		}
+		catch (...) {
+#ifdef _OPENMP
+#pragma omp critical(PETGradientThreads_error)
+#endif
+			err = "subset gradient computation failed";
+		}
+	}
+	if (err.size())
+		error(err.c_str());
+
+	// pairwise summation of the thread images into grad
+	for (int step = 1; step < nt; step *= 2) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nt) schedule(static)
+#endif
+		for (int t = 0; t < nt - step; t += 2 * step)
+			*sum[t] += *sum[t + step];
+	}
+}
+
+bool PETDistributed::enabled_ = false;
+
+#ifdef SIRF_MPI
+static void
+finalize_mpi_()
+{
+	int finalized;
+	MPI_Finalized(&finalized);
+	if (!finalized)
+		MPI_Finalize();
+}
+
+// the data of an image in one contiguous array
+static void
+image_to_vector_(const Image3DF& image, std::vector<float>& v)
+{
+	v.resize(image.size_all());
+	std::copy(image.begin_all(), image.end_all(), v.begin());
+}
+
+static void
+vector_to_image_(const std::vector<float>& v, Image3DF& image)
+{
+	std::copy(v.begin(), v.end(), image.begin_all());
+}
+#endif
+
+void
+PETDistributed::set_enabled(bool on)
+{
+#ifdef SIRF_MPI
+	int initialized;
+	MPI_Initialized(&initialized);
+	if (on && !initialized) {
+		// mpi4py initialises MPI on import, otherwise SIRF does
+		MPI_Init(0, 0);
+		std::atexit(finalize_mpi_);
+	}
+#endif
+	enabled_ = on;
+}
+
+int
+PETDistributed::rank()
+{
+#ifdef SIRF_MPI
+	int initialized;
+	MPI_Initialized(&initialized);
+	if (initialized) {
+		int r;
+		MPI_Comm_rank(MPI_COMM_WORLD, &r);
+		return r;
+	}
+#endif
+	return 0;
+}
+
+int
+PETDistributed::size()
+{
+#ifdef SIRF_MPI
+	int initialized;
+	MPI_Initialized(&initialized);
+	if (initialized) {
+		int n;
+		MPI_Comm_size(MPI_COMM_WORLD, &n);
+		return n;
+	}
+#endif
+	return 1;
+}
+
+void
+PETDistributed::broadcast(Image3DF& image)
+{
+#ifdef SIRF_MPI
+	if (!active())
+		return;
+	SIRF_PROFILE("PETDistributed::broadcast");
+	std::vector<float> v;
+	image_to_vector_(image, v);
+	MPI_Bcast(v.empty() ? 0 : &v[0], (int)v.size(), MPI_FLOAT, 0, MPI_COMM_WORLD);
+	vector_to_image_(v, image);
+#endif
+}
+
+void
+PETDistributed::sum(Image3DF& image)
+{
+#ifdef SIRF_MPI
+	if (!active())
+		return;
+	SIRF_PROFILE("PETDistributed::sum");
+	std::vector<float> v;
+	image_to_vector_(image, v);
+	MPI_Allreduce(MPI_IN_PLACE, v.empty() ? 0 : &v[0], (int)v.size(),
+		MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD);
+	vector_to_image_(v, image);
+#endif
+}
+
+double
+PETDistributed::sum(double v)
+{
+#ifdef SIRF_MPI
+	if (active())
+		MPI_Allreduce(MPI_IN_PLACE, &v, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+#endif
+	return v;
+}
+
+double
+PETDistributed::compute_value(ObjectiveFunction3DF& fun, const Image3DF& image)
+{
+	if (!active())
+		return fun.compute_objective_function(image);
+	shared_ptr<Image3DF> sptr_image(image.clone());
+	broadcast(*sptr_image);
+	double v = 0.0;
+	for (int s = rank(); s < fun.get_num_subsets(); s += size())
+		v += fun.compute_objective_function(*sptr_image, s);
+	return sum(v);
+}
+
+bool PETSensitivityCache::enabled_ = true;
+std::string PETSensitivityCache::directory_;
+std::map<std::string, std::vector<sptrImage3DF> > PETSensitivityCache::images_;
+
+std::string
+PETSensitivityCache::key(ObjectiveFunction3DF& f, const Image3DF& image)
+{
+	if (!enabled_)
+		return std::string();
+	PoissonLogLhLinModMeanProjData3DF* ptr_fun =
+		dynamic_cast<PoissonLogLhLinModMeanProjData3DF*>(&f);
+	if (!ptr_fun)
+		return std::string();
+	PoissonLogLhLinModMeanProjData3DF& fun = *ptr_fun;
+	shared_ptr<AcqMod3DF> sptr_am = fun.acquisition_model_sptr();
+	shared_ptr<PETAcquisitionData> sptr_ad = fun.acquisition_data_sptr();
+	if (!sptr_am.get() || !sptr_ad.get() || !fun.get_recompute_sensitivity())
+		return std::string();
+	std::string source;
+	shared_ptr<PETAcquisitionSensitivityModel> sptr_asm = sptr_am->asm_sptr();
+	if (sptr_asm.get() && sptr_asm->data().get()) {
+		source = sptr_asm->source();
+		if (source.empty())
+			return std::string();
+	}
+	if (!dynamic_cast<const Voxels3DF*>(&image))
+		return std::string();
+
+	std::ostringstream options;
+	options << fun.get_num_subsets() << ' '
+		<< fun.get_use_subset_sensitivities() << ' '
+		<< fun.get_max_segment_num_to_process() << ' '
+		<< fun.get_zero_seg0_end_planes();
+
+	Hash64 hash;
+	hash.add(sptr_ad->get_proj_data_info_sptr()->parameter_info());
+	hash.add(sptr_am->projectors_sptr()->parameter_info());
+	hash.add(source);
+	hash.add(options.str());
+	hash.add(image_geometry_(image));
+	return hash.str();
+}
+
+std::string
+PETSensitivityCache::filename_(const std::string& key, int subset)
+{
+	std::ostringstream name;
+	name << directory_ << "/sirf_sensitivity_" << key << '_' << subset << ".hv";
+	return name.str();
+}
+
+bool
+PETSensitivityCache::restore(const std::string& key, ObjectiveFunction3DF& f)
+{
+	if (key.empty())
+		return false;
+	PoissonLogLhLinModMeanProjData3DF& fun =
+		dynamic_cast<PoissonLogLhLinModMeanProjData3DF&>(f);
+	int n = fun.get_use_subset_sensitivities() ? fun.get_num_subsets() : 1;
+	std::map<std::string, std::vector<sptrImage3DF> >::iterator iter =
+		images_.find(key);
+	if (iter == images_.end()) {
+		if (directory_.empty())
+			return false;
+		std::vector<sptrImage3DF> images(n);
+		for (int s = 0; s < n; s++) {
+			std::string filename = filename_(key, s);
+			if (!std::ifstream(filename.c_str()).good())
+				return false;
+			images[s] = read_from_file<Image3DF>(filename);
+		}
+		iter = images_.insert(std::make_pair(key, images)).first;
+	}
+	std::vector<sptrImage3DF>& images = iter->second;
+	for (int s = 0; s < n; s++)
+		fun.set_subset_sensitivity_sptr(images[s], s);
+	fun.set_recompute_sensitivity(false);
+	return true;
+}
+
+void
+PETSensitivityCache::store(const std::string& key, ObjectiveFunction3DF& f)
+{
+	if (key.empty())
+		return;
+	PoissonLogLhLinModMeanProjData3DF& fun =
+		dynamic_cast<PoissonLogLhLinModMeanProjData3DF&>(f);
+	int n = fun.get_use_subset_sensitivities() ? fun.get_num_subsets() : 1;
+	std::vector<sptrImage3DF> images(n);
+	for (int s = 0; s < n; s++)
+		images[s].reset(fun.get_subset_sensitivity(s).clone());
+	images_[key] = images;
+	if (directory_.empty())
+		return;
+	shared_ptr<OutputFileFormat<Image3DF> > format_sptr =
+		OutputFileFormat<Image3DF>::default_sptr();
+	for (int s = 0; s < n; s++)
+		format_sptr->write_to_file(filename_(key, s), *images[s]);
+}
+
+void
+PETSensitivityCache::release(ObjectiveFunction3DF& f)
+{
+	PoissonLogLhLinModMeanProjData3DF& fun =
+		dynamic_cast<PoissonLogLhLinModMeanProjData3DF&>(f);
+	fun.set_recompute_sensitivity(true);
+}
+
+#define PROJ_MATRIX_MAGIC "SIRFPM01"
+
+ProjMatrixByBinMapped::ProjMatrixByBinMapped() :
+elems_(0), index_(0), num_bins_(0)
+{
+	// the elements are in the mapped file already
+	enable_cache(false);
+}
+
+boost::uint64_t
+ProjMatrixByBinMapped::bin_key_(const Bin& bin)
+{
+	// 16 bits per bin coordinate, ordered as the bins are written
+	return ((boost::uint64_t)(bin.segment_num() + 0x8000) << 48) |
+		((boost::uint64_t)(bin.view_num() + 0x8000) << 32) |
+		((boost::uint64_t)(bin.axial_pos_num() + 0x8000) << 16) |
+		(boost::uint64_t)(bin.tangential_pos_num() + 0x8000);
+}
+
+void
+ProjMatrixByBinMapped::set_up(
+	const shared_ptr<ProjDataInfo>& sptr_pdi,
+	const shared_ptr<Image3DF>& sptr_image)
+{
+	if (!sptr_source_.get())
+		error("ProjMatrixByBinMapped: source matrix not set");
+	if (filename_.empty())
+		error("ProjMatrixByBinMapped: file name not set");
+	// sets up the symmetries only, the elements are computed on demand
+	sptr_source_->set_up(sptr_pdi, sptr_image);
+	symmetries_sptr.reset(sptr_source_->get_symmetries_ptr()->clone());
+	sptr_pdi_ = sptr_pdi;
+
+	Hash64 hash;
+	hash.add(sptr_source_->parameter_info());
+	hash.add(sptr_pdi->parameter_info());
+	hash.add(image_geometry_(*sptr_image));
+	std::string key = hash.str();
+	if (map_(key))
+		return;
+	write_(key);
+	if (!map_(key))
+		error("ProjMatrixByBinMapped: cannot map " + filename_);
+}
+
+bool
+ProjMatrixByBinMapped::map_(const std::string& key)
+{
+	using boost::interprocess::file_mapping;
+	using boost::interprocess::mapped_region;
+	using boost::interprocess::read_only;
+	sptr_region_.reset();
+	sptr_mapping_.reset();
+	elems_ = 0;
+	index_ = 0;
+	num_bins_ = 0;
+	if (!std::ifstream(filename_.c_str()).good())
+		return false;
+	shared_ptr<file_mapping> sptr_mapping
+		(new file_mapping(filename_.c_str(), read_only));
+	shared_ptr<mapped_region> sptr_region
+		(new mapped_region(*sptr_mapping, read_only));
+	size_t size = sptr_region->get_size();
+	const char* ptr = (const char*)sptr_region->get_address();
+	if (size < sizeof(Header))
+		return false;
+	const Header& h = *(const Header*)ptr;
+	if (memcmp(h.magic, PROJ_MATRIX_MAGIC, sizeof(h.magic)) ||
+		memcmp(h.key, key.c_str(), sizeof(h.key)))
+		return false;
+	size_t index_offset = sizeof(Header) + h.num_elems*sizeof(Element);
+	index_offset += (8 - index_offset % 8) % 8;
+	if (size != index_offset + (h.num_bins + 1)*sizeof(Index))
+		return false;
+	sptr_mapping_ = sptr_mapping;
+	sptr_region_ = sptr_region;
+	elems_ = (const Element*)(ptr + sizeof(Header));
+	index_ = (const Index*)(ptr + index_offset);
+	num_bins_ = (size_t)h.num_bins;
+	sptr_region_->advise(mapped_region::advice_willneed);
+	return true;
+}
+
+void
+ProjMatrixByBinMapped::write_(const std::string& key)
+{
+	// written under a temporary name and renamed when complete, so that
+	// other processes never map a partially written file
+	std::ostringstream tmp;
+	tmp << filename_ << '.' << (const void*)this << '.'
+		<< std::chrono::steady_clock::now().time_since_epoch().count();
+	std::string tmp_name = tmp.str();
+	std::ofstream out(tmp_name.c_str(), std::ios::binary | std::ios::trunc);
+	if (!out.good())
+		error("ProjMatrixByBinMapped: cannot create " + tmp_name);
+
+	Header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, PROJ_MATRIX_MAGIC, sizeof(h.magic));
+	memcpy(h.key, key.c_str(), sizeof(h.key));
+	out.write((const char*)&h, sizeof(h));
+
+	const ProjDataInfo& pdi = *sptr_pdi_;
+	std::vector<Index> index;
+	std::vector<Element> elems;
+	ProjMatrixElemsForOneBin lor;
+	boost::uint64_t n = 0;
+	for (int s = pdi.get_min_segment_num(); s <= pdi.get_max_segment_num(); s++)
+	for (int v = pdi.get_min_view_num(); v <= pdi.get_max_view_num(); v++)
+	for (int a = pdi.get_min_axial_pos_num(s); a <= pdi.get_max_axial_pos_num(s); a++)
+	for (int t = pdi.get_min_tangential_pos_num();
+		t <= pdi.get_max_tangential_pos_num(); t++) {
+		Bin bin(s, v, a, t);
+		if (!symmetries_sptr->is_basic(bin))
+			continue;
+		sptr_source_->get_proj_matrix_elems_for_one_bin(lor, bin);
+		Index i = { bin_key_(bin), n };
+		index.push_back(i);
+		elems.resize(lor.size());
+		size_t k = 0;
+		for (ProjMatrixElemsForOneBin::const_iterator e = lor.begin();
+			e != lor.end(); ++e, ++k) {
+			elems[k].c[0] = (boost::int16_t)e->coord1();
+			elems[k].c[1] = (boost::int16_t)e->coord2();
+			elems[k].c[2] = (boost::int16_t)e->coord3();
+			elems[k].pad = 0;
+			elems[k].value = e->get_value();
+		}
+		if (k)
+			out.write((const char*)&elems[0], k*sizeof(Element));
+		n += k;
+	}
+	// the source matrix cached what it computed, which is no longer needed
+	sptr_source_->clear_cache();
+
+	Index end = { ~(boost::uint64_t)0, n };
+	index.push_back(end);
+	size_t offset = sizeof(Header) + n*sizeof(Element);
+	char pad[8] = { 0 };
+	out.write(pad, (8 - offset % 8) % 8);
+	out.write((const char*)&index[0], index.size()*sizeof(Index));
+	h.num_bins = index.size() - 1;
+	h.num_elems = n;
+	out.seekp(0);
+	out.write((const char*)&h, sizeof(h));
+	out.close();
+	if (!out.good()) {
+		std::remove(tmp_name.c_str());
+		error("ProjMatrixByBinMapped: cannot write " + tmp_name);
+	}
+	std::remove(filename_.c_str());
+	if (std::rename(tmp_name.c_str(), filename_.c_str())) {
+		std::remove(tmp_name.c_str());
+		error("ProjMatrixByBinMapped: cannot create " + filename_);
+	}
+}
+
+void
+ProjMatrixByBinMapped::calculate_proj_matrix_elems_for_one_bin
+(ProjMatrixElemsForOneBin& lor) const
+{
+	struct Less {
+		bool operator()(const Index& i, boost::uint64_t key) const
+		{
+			return i.bin < key;
+		}
+	};
+	boost::uint64_t key = bin_key_(lor.get_bin());
+	const Index* i = std::lower_bound(index_, index_ + num_bins_, key, Less());
+	if (i == index_ + num_bins_ || i->bin != key)
+		error("ProjMatrixByBinMapped: bin not found in " + filename_);
+	lor.erase();
+	lor.reserve((size_t)(i[1].start - i->start));
+	for (boost::uint64_t k = i->start; k < i[1].start; k++) {
+		const Element& e = elems_[k];
+		lor.push_back(ProjMatrixElemsForOneBin::value_type
+			(Coordinate3D<int>(e.c[0], e.c[1], e.c[2]), e.value));
+	}
+}
+
+// reads the projector pair section of a STIR parameter file
+class ProjectorPairParser : public ParsingObject {
+public:
+	shared_ptr<ProjectorByBinPair> sptr_projectors;
+protected:
+	virtual void initialise_keymap()
+	{
+		parser.add_start_key("projector pair parameters");
+		parser.add_parsing_key("projector pair type", &sptr_projectors);
+		parser.add_stop_key("end projector pair parameters");
+	}
+};
+
+PETAcquisitionModelUsingParameterFile::PETAcquisitionModelUsingParameterFile
+(const std::string& filename)
+{
+	ProjectorPairParser pp;
+	if (!pp.parse(filename.c_str()) || is_null_ptr(pp.sptr_projectors))
+		error("PETAcquisitionModelUsingParameterFile: "
+		"no projector pair in " + filename);
+	sptr_projectors_ = pp.sptr_projectors;
+}
+
+void
+PETAcquisitionModelOperator::apply
+(aDataContainer<float>& a_x, aDataContainer<float>& a_y)
+{
+	PETImageData& x = (PETImageData&)a_x;
+	PETAcquisitionData& y = (PETAcquisitionData&)a_y;
+	AcqMod3DF& am = *sptr_am_;
+	am.forward(y, x, 0, 1, true);
+	if (!am.additive_term_sptr().get() && !am.background_term_sptr().get())
+		return;
+	if (!sptr_offset_.get()) {
+		shared_ptr<PETImageData> sptr_zero = x.new_image_data();
+		sptr_zero->fill(0.0f);
+		sptr_offset_ = y.new_acquisition_data();
+		am.forward(*sptr_offset_, *sptr_zero, 0, 1, true);
+	}
+	y.xapy(-1.0f, *sptr_offset_);
+}
+
+void
+PETAcquisitionModelOperator::apply_adjoint
+(aDataContainer<float>& a_y, aDataContainer<float>& a_x)
+{
+	sptr_am_->backward((PETImageData&)a_x, (PETAcquisitionData&)a_y, 0, 1);
+}
+
+float
+PETObjective::value(aDataContainer<float>& x)
+{
+	Image3DF& image = ((PETImageData&)x).data();
+	return -(float)PETDistributed::compute_value(*sptr_fun_, image);
+}
+
+void
+PETObjective::gradient(aDataContainer<float>& x, aDataContainer<float>& g)
+{
+	Image3DF& image = ((PETImageData&)x).data();
+	Image3DF& grad = ((PETImageData&)g).data();
+	PETGradientThreads::compute_gradient(*sptr_fun_, grad, image);
+	g.axpby(-1.0f, g, 0.0f, g);
+}
+
+float
+PETPrior::value(aDataContainer<float>& x)
+{
+	return (float)sptr_prior_->compute_value(((PETImageData&)x).data());
+}
+
+void
+PETPrior::gradient(aDataContainer<float>& x, aDataContainer<float>& g)
+{
+	sptr_prior_->compute_gradient
+		(((PETImageData&)g).data(), ((PETImageData&)x).data());
+}
+
+// the weights STIR uses by default: the ratios of the x spacing to the
+// distances to the neighbours, 0 for the voxel itself
+static void
+quadratic_prior_weights
+(Array<3, float>& weights, const Image3DF& image, bool only_2D)
+{
+	const DiscretisedDensityOnCartesianGrid<3, float>& image_cast =
+		dynamic_cast<const DiscretisedDensityOnCartesianGrid<3, float>&>
+		(image);
+	const Coord3DF& gs = image_cast.get_grid_spacing();
+	const int min_dz = only_2D ? 0 : -1;
+	const int max_dz = only_2D ? 0 : 1;
+	weights = Array<3, float>(IndexRange3D(min_dz, max_dz, -1, 1, -1, 1));
+	for (int z = min_dz; z <= max_dz; z++)
+		for (int y = -1; y <= 1; y++)
+			for (int x = -1; x <= 1; x++)
+				if (z == 0 && y == 0 && x == 0)
+					weights[0][0][0] = 0;
+				else
+					weights[z][y][x] = gs.x() / std::sqrt(square(x*gs.x()) +
+						square(y*gs.y()) + square(z*gs.z()));
+}
+
+void
+xSTIR_QuadraticPrior3DF::compute_gradient
+(Image3DF& grad, const Image3DF& image)
+{
+	if (penalisation_factor == 0) {
+		grad.fill(0);
+		return;
+	}
+	{
+		// the subset gradients may be computed concurrently
+		static std::mutex weights_mutex;
+		std::lock_guard<std::mutex> lock(weights_mutex);
+		if (weights.get_length() == 0)
+			quadratic_prior_weights(weights, image, only_2D);
+	}
+	const bool do_kappa = !is_null_ptr(kappa_ptr);
+	if (do_kappa && !kappa_ptr->has_same_characteristics(image))
+		error("QuadraticPrior: kappa image does not have the same index "
+			"range as the reconstructed image");
+	const float pf = penalisation_factor;
+	const int min_z = image.get_min_index();
+	const int max_z = image.get_max_index();
+	const int nt = std::max(1, std::min(max_z - min_z + 1,
+		ThreadPool::num_threads()));
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nt) schedule(static)
+#endif
+	for (int z = min_z; z <= max_z; z++) {
+		const int min_dz = std::max(weights.get_min_index(), min_z - z);
+		const int max_dz = std::min(weights.get_max_index(), max_z - z);
+		const int min_y = image[z].get_min_index();
+		const int max_y = image[z].get_max_index();
+		for (int y = min_y; y <= max_y; y++) {
+			const int min_dy = std::max(weights[0].get_min_index(), min_y - y);
+			const int max_dy = std::min(weights[0].get_max_index(), max_y - y);
+			const int min_x = image[z][y].get_min_index();
+			const int max_x = image[z][y].get_max_index();
+			for (int x = min_x; x <= max_x; x++) {
+				const int min_dx =
+					std::max(weights[0][0].get_min_index(), min_x - x);
+				const int max_dx =
+					std::min(weights[0][0].get_max_index(), max_x - x);
+				float g = 0;
+				for (int dz = min_dz; dz <= max_dz; dz++)
+					for (int dy = min_dy; dy <= max_dy; dy++)
+						for (int dx = min_dx; dx <= max_dx; dx++) {
+							float t = weights[dz][dy][dx] * (image[z][y][x] -
+								image[z + dz][y + dy][x + dx]);
+							if (do_kappa)
+								t *= (*kappa_ptr)[z][y][x] *
+								(*kappa_ptr)[z + dz][y + dy][x + dx];
+							g += t;
+						}
+				grad[z][y][x] = g * pf;
+			}
+		}
+	}
+}
+
+// the forward differences of u at voxel (z, y, x) along z, y and x, 
+// 0 at the last index and, if only_2D, along z
+static inline void
+forward_differences(const Image3DF& u, int z, int y, int x, bool only_2D,
+	float* du)
+{
+	const float c = u[z][y][x];
+	du[0] = (only_2D || z == u.get_max_index()) ? 0 : u[z + 1][y][x] - c;
+	du[1] = y == u[z].get_max_index() ? 0 : u[z][y + 1][x] - c;
+	du[2] = x == u[z][y].get_max_index() ? 0 : u[z][y][x + 1] - c;
+}
+
+Succeeded
+xSTIR_PLSPrior3DF::set_up(sptrImage3DF const& sptr_target)
+{
+	if (PLSPrior<float>::set_up(sptr_target) == Succeeded::no)
+		return Succeeded::no;
+	std::lock_guard<std::mutex> lock(mutex_);
+	set_up_anatomical_terms_();
+	return Succeeded::yes;
+}
+
+void
+xSTIR_PLSPrior3DF::set_up_anatomical_terms_()
+{
+	sptr_anatomical_ = get_anatomical_image_sptr();
+	eta_ = get_eta();
+	only_2D_ = get_only_2D();
+	if (is_null_ptr(sptr_anatomical_))
+		error("PLSPrior: anatomical image not set");
+	const Image3DF& v = *sptr_anatomical_;
+	Image3DF* xi[3];
+	for (int i = 0; i < 3; i++) {
+		sptr_xi_[i].reset(v.get_empty_copy());
+		xi[i] = sptr_xi_[i].get();
+	}
+	const float eta2 = (float)(eta_*eta_);
+	const int min_z = v.get_min_index();
+	const int max_z = v.get_max_index();
+	const int nt = std::max(1, std::min(max_z - min_z + 1,
+		ThreadPool::num_threads()));
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nt) schedule(static)
+#endif
+	for (int z = min_z; z <= max_z; z++)
+		for (int y = v[z].get_min_index(); y <= v[z].get_max_index(); y++)
+			for (int x = v[z][y].get_min_index();
+				x <= v[z][y].get_max_index(); x++) {
+				float dv[3];
+				forward_differences(v, z, y, x, only_2D_, dv);
+				float s = 1.0f / std::sqrt
+					(dv[0] * dv[0] + dv[1] * dv[1] + dv[2] * dv[2] + eta2);
+				for (int i = 0; i < 3; i++)
+					(*xi[i])[z][y][x] = dv[i] * s;
+			}
+}
+
+void
+xSTIR_PLSPrior3DF::compute_gradient(Image3DF& grad, const Image3DF& image)
+{
+	if (penalisation_factor == 0) {
+		grad.fill(0);
+		return;
+	}
+	{
+		// the subset gradients may be computed concurrently
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (is_null_ptr(sptr_xi_[0]) ||
+			sptr_anatomical_ != get_anatomical_image_sptr() ||
+			eta_ != get_eta() || only_2D_ != get_only_2D())
+			set_up_anatomical_terms_();
+	}
+	if (!sptr_xi_[0]->has_same_characteristics(image))
+		error("PLSPrior: anatomical image does not have the same index "
+			"range as the reconstructed image");
+	sptrImage3DF sptr_kappa = get_kappa_sptr();
+	const bool do_kappa = !is_null_ptr(sptr_kappa);
+	if (do_kappa && !sptr_kappa->has_same_characteristics(image))
+		error("PLSPrior: kappa image does not have the same index "
+			"range as the reconstructed image");
+	const Image3DF* xi[3];
+	Image3DF* q[3];
+	std::vector<shared_ptr<Image3DF> > sptr_q(3);
+	for (int i = 0; i < 3; i++) {
+		xi[i] = sptr_xi_[i].get();
+		sptr_q[i].reset(image.get_empty_copy());
+		q[i] = sptr_q[i].get();
+	}
+	const float alpha2 = (float)(get_alpha()*get_alpha());
+	const float pf = penalisation_factor;
+	const int min_z = image.get_min_index();
+	const int max_z = image.get_max_index();
+	const int nt = std::max(1, std::min(max_z - min_z + 1,
+		ThreadPool::num_threads()));
+
+	// q = kappa (grad u - <grad u, xi> xi)/psi, the derivative of the
+	// penalty kappa psi, psi = sqrt(alpha^2 + |grad u|^2 - <grad u, xi>^2),
+	// with respect to the image gradient grad u
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nt) schedule(static)
+#endif
+	for (int z = min_z; z <= max_z; z++)
+		for (int y = image[z].get_min_index(); 
+			y <= image[z].get_max_index(); y++)
+			for (int x = image[z][y].get_min_index();
+				x <= image[z][y].get_max_index(); x++) {
+				float du[3];
+				forward_differences(image, z, y, x, only_2D_, du);
+				float r[3];
+				float ip = 0;
+				for (int i = 0; i < 3; i++) {
+					r[i] = (*xi[i])[z][y][x];
+					ip += du[i] * r[i];
+				}
+				float s = 0;
+				for (int i = 0; i < 3; i++) {
+					r[i] = du[i] - ip * r[i];
+					s += du[i] * du[i];
+				}
+				float w = 1.0f / std::sqrt(std::max(alpha2 + s - ip * ip, 0.0f));
+				if (do_kappa)
+					w *= (*sptr_kappa)[z][y][x];
+				for (int i = 0; i < 3; i++)
+					(*q[i])[z][y][x] = r[i] * w;
+			}
+
+	// the gradient of the prior is the adjoint of the forward differences
+	// applied to q
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nt) schedule(static)
+#endif
+	for (int z = min_z; z <= max_z; z++)
+		for (int y = image[z].get_min_index();
+			y <= image[z].get_max_index(); y++)
+			for (int x = image[z][y].get_min_index();
+				x <= image[z][y].get_max_index(); x++) {
+				float g = 0;
+				if (!only_2D_) {
+					if (z < max_z)
+						g -= (*q[0])[z][y][x];
+					if (z > min_z)
+						g += (*q[0])[z - 1][y][x];
+				}
+				if (y < image[z].get_max_index())
+					g -= (*q[1])[z][y][x];
+				if (y > image[z].get_min_index())
+					g += (*q[1])[z][y - 1][x];
+				if (x < image[z][y].get_max_index())
+					g -= (*q[2])[z][y][x];
+				if (x > image[z][y].get_min_index())
+					g += (*q[2])[z][y][x - 1];
+				grad[z][y][x] = g * pf;
+			}
+}
+
+stir::shared_ptr<const PETRampFilter>
+PETRampFilter::get(int n, double alpha, double fc)
+{
+	typedef std::pair<int, std::pair<double, double> > Key;
+	static std::map<Key, stir::shared_ptr<const PETRampFilter> > filters;
+	static std::mutex filters_mutex;
+	std::lock_guard<std::mutex> lock(filters_mutex);
+	Key key(n, std::make_pair(alpha, fc));
+	stir::shared_ptr<const PETRampFilter>& sptr = filters[key];
+	if (is_null_ptr(sptr))
+		sptr.reset(new PETRampFilter(n, alpha, fc));
+	return sptr;
+}
+
+PETRampFilter::PETRampFilter(int n, double alpha, double fc) : n_(n)
+{
+	// linear rather than circular convolution of n bins
+	int bits = 0;
+	for (nfft_ = 1; nfft_ < 2 * n; nfft_ *= 2)
+		bits++;
+	bitrev_.resize(nfft_);
+	for (int i = 0; i < nfft_; i++) {
+		int r = 0;
+		for (int b = 0; b < bits; b++)
+			if (i & (1 << b))
+				r |= 1 << (bits - 1 - b);
+		bitrev_[i] = r;
+	}
+	twiddles_.resize(nfft_ / 2 + 1);
+	for (int k = 0; k < nfft_ / 2 + 1; k++)
+		twiddles_[k] = std::polar(1.0f, (float)(-2 * _PI*k / nfft_));
+
+	// the Ram-Lak kernel for unit spacing, the transform of which, 
+	// unlike the sampled |f|, does not lose the mean value
+	std::vector<std::complex<float> > h(nfft_, 0.0f);
+	h[0] = 0.25f;
+	for (int k = 1; k < n; k += 2)
+		h[k] = h[nfft_ - k] = (float)(-1.0 / (_PI*_PI*k*k));
+	fft_(&h[0], false);
+	response_.resize(nfft_);
+	for (int j = 0; j < nfft_; j++) {
+		double f = (double)std::min(j, nfft_ - j) / nfft_;
+		double w = f <= fc ? alpha + (1 - alpha)*std::cos(_PI*f / fc) : 0.0;
+		response_[j] = (float)(h[j].real()*w / nfft_);
+	}
+}
+
+void
+PETRampFilter::fft_(std::complex<float>* a, bool inverse) const
+{
+	for (int i = 0; i < nfft_; i++)
+		if (i < bitrev_[i])
+			std::swap(a[i], a[bitrev_[i]]);
+	for (int len = 2; len <= nfft_; len *= 2) {
+		int step = nfft_ / len;
+		int half = len / 2;
+		for (int i = 0; i < nfft_; i += len)
+			for (int j = 0; j < half; j++) {
+				std::complex<float> w = twiddles_[j*step];
+				if (inverse)
+					w = std::conj(w);
+				std::complex<float> u = a[i + j];
+				std::complex<float> v = a[i + j + half] * w;
+				a[i + j] = u + v;
+				a[i + j + half] = u - v;
+			}
+	}
+}
+
+void
+PETRampFilter::apply(float* rows, int m, float scale) const
+{
+	std::vector<std::complex<float> > a(nfft_);
+	// the response being real and even, two rows are filtered at once as
+	// the real and imaginary parts of one complex row
+	for (int r = 0; r < m; r += 2) {
+		float* x = rows + (size_t)r*n_;
+		float* y = r + 1 < m ? x + n_ : 0;
+		for (int k = 0; k < n_; k++)
+			a[k] = std::complex<float>(x[k], y ? y[k] : 0.0f);
+		std::fill(a.begin() + n_, a.end(), std::complex<float>(0.0f));
+		fft_(&a[0], false);
+		for (int j = 0; j < nfft_; j++)
+			a[j] *= response_[j];
+		fft_(&a[0], true);
+		for (int k = 0; k < n_; k++) {
+			x[k] = a[k].real()*scale;
+			if (y)
+				y[k] = a[k].imag()*scale;
+		}
+	}
+}
+
+Succeeded
+xSTIR_FBP2DReconstruction::reconstruct_in_parallel(Image3DF& image)
+{
+	if (is_null_ptr(_sptr_input))
+		error("FBP2D: no input data");
+	const ProjData& input = *_sptr_input;
+	shared_ptr<ProjDataInfo> sptr_pdi
+		(input.get_proj_data_info_ptr()->clone());
+	const ProjDataInfoCylindrical* ptr_cyl =
+		dynamic_cast<const ProjDataInfoCylindrical*>(sptr_pdi.get());
+	if (!ptr_cyl)
+		error("FBP2D: cylindrical scanner data expected");
+	Voxels3DF* ptr_voxels = dynamic_cast<Voxels3DF*>(&image);
+	if (!ptr_voxels)
+		error("FBP2D: voxels on Cartesian grid expected");
+
+	// the sinograms rebinned into each plane: those of segment 0 and, 
+	// for span 1 data, of segments -1 and 1
+	const int max_seg = ptr_cyl->get_min_ring_difference(0) ==
+		ptr_cyl->get_max_ring_difference(0) ?
+		std::min(1, ptr_cyl->get_max_segment_num()) : 0;
+	shared_ptr<ProjDataInfo> sptr_rebinned
+		(stir::SSRB(*sptr_pdi, 2 * max_seg + 1, 1, 0, max_seg));
+	const int min_z = image.get_min_index();
+	const int nz = image.get_max_index() - min_z + 1;
+	const int min_ax = sptr_rebinned->get_min_axial_pos_num(0);
+	if (nz != sptr_rebinned->get_num_axial_poss(0))
+		error("FBP2D: the number of planes must be the number of "
+			"rebinned sinograms");
+	const float m0 = sptr_rebinned->get_m(Bin(0, 0, min_ax, 0));
+	const float dm = nz > 1 ?
+		sptr_rebinned->get_m(Bin(0, 0, min_ax + 1, 0)) - m0 : 1.0f;
+	std::vector<std::vector<std::pair<int, int> > > sinograms(nz);
+	for (int seg = -max_seg; seg <= max_seg; seg++)
+		for (int ax = sptr_pdi->get_min_axial_pos_num(seg);
+			ax <= sptr_pdi->get_max_axial_pos_num(seg); ax++) {
+			float m = sptr_pdi->get_m(Bin(seg, 0, ax, 0));
+			int z = (int)std::floor((m - m0) / dm + 0.5f);
+			if (z >= 0 && z < nz)
+				sinograms[z].push_back(std::make_pair(seg, ax));
+		}
+
+	// arc correction, unless the data are arc-corrected
+	shared_ptr<ArcCorrection> sptr_arc_correction;
+	const ProjDataInfo* ptr_pdi_ac = sptr_pdi.get();
+	if (!dynamic_cast<const ProjDataInfoCylindricalArcCorr*>(ptr_pdi_ac)) {
+		sptr_arc_correction.reset(new ArcCorrection);
+		if (sptr_arc_correction->set_up(sptr_pdi) != Succeeded::yes)
+			error("FBP2D: arc correction set up failed");
+		ptr_pdi_ac = &sptr_arc_correction->get_arc_corrected_proj_data_info();
+	}
+	const int min_v = ptr_pdi_ac->get_min_view_num();
+	const int nv = ptr_pdi_ac->get_num_views();
+	const int min_t = ptr_pdi_ac->get_min_tangential_pos_num();
+	const int nt = ptr_pdi_ac->get_num_tangential_poss();
+	const float ds = nt > 1 ? ptr_pdi_ac->get_s(Bin(0, min_v, 0, min_t + 1)) -
+		ptr_pdi_ac->get_s(Bin(0, min_v, 0, min_t)) : 1.0f;
+	std::vector<float> cos_phi(nv);
+	std::vector<float> sin_phi(nv);
+	std::vector<float> s0(nv);
+	for (int v = 0; v < nv; v++) {
+		Bin bin(0, min_v + v, 0, min_t);
+		float phi = ptr_pdi_ac->get_phi(bin);
+		cos_phi[v] = std::cos(phi);
+		sin_phi[v] = std::sin(phi);
+		s0[v] = ptr_pdi_ac->get_s(bin);
+	}
+	// q(s) = (filtered p)(s)/ds, f = pi/nv sum over views of q
+	stir::shared_ptr<const PETRampFilter> sptr_filter =
+		PETRampFilter::get(nt, alpha_ramp, fc_ramp);
+	const float scale = (float)(_PI / nv) / ds;
+	const Coord3DF voxel_size = ptr_voxels->get_voxel_size();
+	const Coord3DF origin = ptr_voxels->get_origin();
+
+	image.fill(0);
+	std::string err;
+	const int nthreads = std::max(1, std::min(nz, ThreadPool::num_threads()));
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads) schedule(dynamic)
+#endif
+	for (int iz = 0; iz < nz; iz++) {
+		// exceptions must not leave the parallel region
+		try {
+			if (sinograms[iz].empty())
+				continue;
+			std::vector<float> rows((size_t)nv*nt, 0.0f);
+			for (size_t i = 0; i < sinograms[iz].size(); i++) {
+				std::unique_ptr<Sinogram<float> > sptr_sino;
+				{
+#ifdef _OPENMP
+#pragma omp critical(FBP2D_read)
+#endif
+					sptr_sino.reset(new Sinogram<float>(input.get_sinogram
+						(sinograms[iz][i].second, sinograms[iz][i].first)));
+				}
+				if (sptr_arc_correction.get())
+					*sptr_sino = sptr_arc_correction->do_arc_correction(*sptr_sino);
+				const Sinogram<float>& sino = *sptr_sino;
+				for (int v = 0; v < nv; v++)
+					for (int t = 0; t < nt; t++)
+						rows[(size_t)v*nt + t] += sino[min_v + v][min_t + t];
+			}
+			sptr_filter->apply(&rows[0], nv, 
+				scale / (float)sinograms[iz].size());
+
+			Array<2, float>& plane = image[min_z + iz];
+			for (int y = plane.get_min_index(); y <= plane.get_max_index(); y++) {
+				const float yy = origin.y() + y*voxel_size.y();
+				Array<1, float>& row = plane[y];
+				for (int x = row.get_min_index(); x <= row.get_max_index(); x++) {
+					const float xx = origin.x() + x*voxel_size.x();
+					float f = 0;
+					for (int v = 0; v < nv; v++) {
+						float t = (xx*cos_phi[v] + yy*sin_phi[v] - s0[v]) / ds;
+						if (t < 0 || t > nt - 1)
+							continue;
+						int i = nt > 1 ? std::min((int)t, nt - 2) : 0;
+						float w = t - i;
+						const float* q = &rows[(size_t)v*nt + i];
+						f += (1 - w)*q[0] + w*q[nt > 1 ? 1 : 0];
+					}
+					row[x] = f;
+				}
+			}
+		}
+		catch (std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(FBP2D_error)
+#endif
+			err = e.what();
+		}
+		catch (...) {
+#ifdef _OPENMP
+#pragma omp critical(FBP2D_error)
+#endif
+			err = "FBP2D plane reconstruction failed";
+		}
+	}
+	if (err.size())
+		error(err.c_str());
+	return Succeeded::yes;
 }
@@ -34,6 +34,16 @@ limitations under the License.
 
 #include <stdlib.h>
 
+#include <complex>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+#include "SIRF/common/solvers.h"
 #include "stir_data_containers.h"
 
 #define MIN_BIN_EFFICIENCY 1.0e-20f
@@ -56,6 +66,8 @@ PETAcquisitionData. 2 variables decide what done with 3 possible cases:
 - `store_prompts`=`true`, `store_delayeds`=`true`: prompts-delayeds are stored
 Clearly, enabling the `store_delayeds` option only makes sense if the data was
 acquired accordingly.
+With the `store_fan_sums` flag on, the delayeds fan sums needed by
+estimate_randoms() are collected in the same pass through the data.
 - estimate_randoms() can be used to get a relatively noiseless estimate of the
 random coincidences.
 
@@ -87,8 +99,10 @@ The actual algorithm is described in
 			By default, `store_prompts` is `true` and `store_delayeds` is `false`.
 			*/
 		//ListmodeToSinograms(const char* const par) : stir::LmToProjData(par) {}
-		ListmodeToSinograms(const char* par) : stir::LmToProjData(par) {}
-		ListmodeToSinograms() : stir::LmToProjData()
+		ListmodeToSinograms(const char* par) :
+			stir::LmToProjData(par), num_threads_(1), store_fan_sums_(false) {}
+		ListmodeToSinograms() : stir::LmToProjData(),
+			num_threads_(1), store_fan_sums_(false)
 		{
 			fan_size = -1;
 			store_prompts = true;
@@ -120,6 +134,16 @@ The actual algorithm is described in
 			std::pair<double, double> interval(start, stop);
 			std::vector < std::pair<double, double> > intervals;
 			intervals.push_back(interval);
+			set_time_intervals(intervals);
+		}
+		//! Sets the time frames, one sinogram is produced for each.
+		/*! All frames are histogrammed in one pass through the list-mode
+			file; frame n sinograms are written to the file with the output
+			prefix appended by `_f<n>g1d0b0.hs`.
+		*/
+		void set_time_intervals
+			(const std::vector < std::pair<double, double> >& intervals)
+		{
 			frame_defs = stir::TimeFrameDefinitions(intervals);
 			do_time_frame = true;
 		}
@@ -137,6 +161,8 @@ The actual algorithm is described in
 #endif
 			else if (boost::iequals(flag, "interactive"))
 				interactive = value;
+			else if (boost::iequals(flag, "store_fan_sums"))
+				store_fan_sums_ = value;
 			else
 				return -1;
 			return 0;
@@ -149,11 +175,28 @@ The actual algorithm is described in
 		{
 			return store_delayeds;
 		}
+		//! Sets the number of threads histogramming the events.
+		/*! With more than one thread (0 meaning all available), the events
+			of each time frame are read in chunks and the bins of each chunk
+			are computed and added to the sinograms in parallel.
+			This needs the time frames to be set, otherwise the single-threaded
+			STIR conversion is used.
+		*/
+		void set_num_threads(int n)
+		{
+			num_threads_ = n;
+		}
+		int get_num_threads() const
+		{
+			return num_threads_;
+		}
+		void process_data();
 		bool set_up()
 		{
 			// always reset here, in case somebody set a new listmode or template file
 			max_segment_num_to_process = -1;
 			fan_size = -1;
+			fan_sums_sptr.reset();
 
 			bool failed = post_processing();
 			if (failed)
@@ -178,20 +221,29 @@ The actual algorithm is described in
 
 			return false;
 		}
-		stir::shared_ptr<PETAcquisitionData> get_output()
+		stir::shared_ptr<PETAcquisitionData> get_output(unsigned int frame = 1)
 		{
-			std::string filename = output_filename_prefix + "_f1g1d0b0.hs";
+			std::ostringstream filename;
+			filename << output_filename_prefix << "_f" << frame << "g1d0b0.hs";
 			return stir::shared_ptr<PETAcquisitionData>
-				(new PETAcquisitionDataInFile(filename.c_str()));
+				(new PETAcquisitionDataInFile(filename.str().c_str()));
 		}
 
-		int estimate_randoms()
+		//! Estimates the randoms in the specified time frame.
+		/*! The delayeds fan sums are taken from the last conversion if the
+			`store_fan_sums` flag was on, otherwise they are computed by
+			another pass through the list-mode file.
+		*/
+		int estimate_randoms(unsigned int frame = 1)
 		{
-			compute_fan_sums_();
-			int err = compute_singles_();
+			if (is_null_ptr(fan_sums_sptr) || fan_sums_sptr->size() < frame)
+				compute_fan_sums_();
+			if (fan_sums_sptr->size() < frame)
+				return -1;
+			int err = compute_singles_(frame);
 			if (err)
 				return err;
-			estimate_randoms_();
+			estimate_randoms_(frame);
 			return 0;
 		}
 		stir::shared_ptr<PETAcquisitionData> get_randoms_sptr()
@@ -211,9 +263,21 @@ The actual algorithm is described in
 		stir::shared_ptr<std::vector<stir::Array<2, float> > > fan_sums_sptr;
 		stir::shared_ptr<stir::DetectorEfficiencies> det_eff_sptr;
 		stir::shared_ptr<PETAcquisitionData> randoms_sptr;
+		int num_threads_;
+		bool store_fan_sums_;
+		void process_data_in_parallel_();
+		void set_max_ring_diff_for_fansums_();
 		void compute_fan_sums_(bool prompt_fansum = false);
-		int compute_singles_();
-		void estimate_randoms_();
+		int compute_singles_(unsigned int frame = 1);
+		void estimate_randoms_(unsigned int frame = 1);
+		// uncompressed ring pairs of each sinogram and detector pairs of each
+		// view and tangential position, set up once per template geometry
+		stir::shared_ptr<stir::ProjDataInfo> randoms_pdi_sptr_;
+		std::vector<std::vector<std::pair<int, int> > > randoms_ring_pairs_;
+		std::vector<int> randoms_det_pairs_;
+		void set_up_randoms_mapping_
+			(const stir::ProjDataInfoCylindricalNoArcCorr& proj_data_info,
+			const stir::ProjDataInfoCylindricalNoArcCorr& uncompressed_proj_data_info);
 		static unsigned long compute_num_bins_(const int num_rings,
 			const int num_detectors_per_ring,
 			const int max_ring_diff, const int half_fan_size);
@@ -237,6 +301,8 @@ The actual algorithm is described in
 			(PETAcquisitionSensitivityModel& mod1, PETAcquisitionSensitivityModel& mod2)
 		{
 			norm_.reset(new stir::ChainedBinNormalisation(mod1.data(), mod2.data()));
+			if (mod1.source().size() && mod2.source().size())
+				source_ = "(" + mod1.source() + ")*(" + mod2.source() + ")";
 		}
 
 		stir::Succeeded set_up(const stir::shared_ptr<stir::ProjDataInfo>&);
@@ -245,6 +311,11 @@ The actual algorithm is described in
 		virtual void unnormalise(PETAcquisitionData& ad) const;
 		// divide by bin efficiencies
 		virtual void normalise(PETAcquisitionData& ad) const;
+		// multiply a set of related viewgrams by bin efficiencies
+		void unnormalise_viewgrams(stir::RelatedViewgrams<float>& viewgrams) const
+		{
+			norm_->undo(viewgrams, 0, 1);
+		}
 		// same as apply, but returns new data rather than changes old one
 		stir::shared_ptr<PETAcquisitionData> forward(PETAcquisitionData& ad) const
 		{
@@ -267,9 +338,16 @@ The actual algorithm is described in
 			return norm_;
 			//return std::dynamic_pointer_cast<stir::BinNormalisation>(norm_);
 		}
+		// describes where the efficiencies come from (empty if unknown),
+		// used as part of the sensitivity cache key
+		const std::string& source() const
+		{
+			return source_;
+		}
 
 	protected:
 		stir::shared_ptr<stir::BinNormalisation> norm_;
+		std::string source_;
 		//shared_ptr<stir::ChainedBinNormalisation> norm_;
 	};
 
@@ -313,6 +391,16 @@ The actual algorithm is described in
 
 	class PETAcquisitionModel {
 	public:
+		PETAcquisitionModel() : verbosity_(0) {}
+		// 0: silent, 1: report the terms applied, 2: also report progress
+		void set_verbosity(int v)
+		{
+			verbosity_ = v;
+		}
+		int verbosity() const
+		{
+			return verbosity_;
+		}
 		void set_projectors(stir::shared_ptr<stir::ProjectorByBinPair> sptr_projectors)
 		{
 			sptr_projectors_ = sptr_projectors;
@@ -359,6 +447,10 @@ The actual algorithm is described in
 			//sptr_normalisation_ = sptr_asm->data();
 			sptr_asm_ = sptr_asm;
 		}
+		stir::shared_ptr<PETAcquisitionSensitivityModel> asm_sptr()
+		{
+			return sptr_asm_;
+		}
 
 		void cancel_background_term()
 		{
@@ -371,6 +463,7 @@ The actual algorithm is described in
 		void cancel_normalisation()
 		{
 			sptr_asm_.reset();
+			sptr_workspace_.reset();
 			//sptr_normalisation_.reset();
 		}
 
@@ -386,8 +479,12 @@ The actual algorithm is described in
 		void forward(PETAcquisitionData& acq_data, const PETImageData& image,
 			int subset_num, int num_subsets, bool zero = false);
 
+		// computes and returns the backprojection of a subset of ad
 		stir::shared_ptr<PETImageData> backward(PETAcquisitionData& ad,
 			int subset_num = 0, int num_subsets = 1);
+		// replaces image with the backprojection of a subset of ad
+		void backward(PETImageData& image, PETAcquisitionData& ad,
+			int subset_num, int num_subsets);
 
 	protected:
 		stir::shared_ptr<stir::ProjectorByBinPair> sptr_projectors_;
@@ -397,6 +494,88 @@ The actual algorithm is described in
 		stir::shared_ptr<PETAcquisitionData> sptr_background_;
 		stir::shared_ptr<PETAcquisitionSensitivityModel> sptr_asm_;
 		//shared_ptr<stir::BinNormalisation> sptr_normalisation_;
+		// unnormalised copy of the data to be backprojected, kept across calls
+		stir::shared_ptr<PETAcquisitionData> sptr_workspace_;
+		int verbosity_;
+
+		PETAcquisitionData& workspace_(PETAcquisitionData& ad);
+		// backprojects a subset of ad into the zero-filled image, views 
+		// distributed over the MPI processes if PETDistributed is active
+		void back_project_(Image3DF& image, PETAcquisitionData& ad,
+			int subset_num, int num_subsets);
+		// y := (y + a)*n + b in one pass over the data
+		void postprocess_(PETAcquisitionData& ad,
+			const PETAcquisitionSensitivityModel* sm) const;
+	};
+
+	/*!
+	\ingroup STIR Extensions
+	\brief Projection matrix read from a precomputed memory-mapped file.
+
+	At set-up, the elements of the source matrix for all basic bins (i.e. up
+	to symmetries) are computed once and written to the file in compressed
+	sparse row form: the elements of each basic bin (16-bit voxel indices
+	and a float value) followed by the sorted index of the basic bins. The
+	file is tagged with a hash of the source matrix parameters and of the
+	acquisition data and image geometries, and a file with a matching tag
+	is mapped read-only instead of being recomputed, so that it is shared
+	via the page cache by all processes and acquisition models using it.
+	*/
+
+	class ProjMatrixByBinMapped : public stir::ProjMatrixByBin {
+	public:
+		ProjMatrixByBinMapped();
+		void set_source(stir::shared_ptr<stir::ProjMatrixByBin> sptr)
+		{
+			sptr_source_ = sptr;
+		}
+		stir::shared_ptr<stir::ProjMatrixByBin> source_sptr()
+		{
+			return sptr_source_;
+		}
+		void set_filename(const std::string& filename)
+		{
+			filename_ = filename;
+		}
+		const std::string& filename() const
+		{
+			return filename_;
+		}
+		virtual void set_up(
+			const stir::shared_ptr<stir::ProjDataInfo>& sptr_pdi,
+			const stir::shared_ptr<Image3DF>& sptr_image);
+
+	private:
+		struct Header {
+			char magic[8];
+			char key[16];
+			boost::uint64_t num_bins;
+			boost::uint64_t num_elems;
+		};
+		struct Element {
+			boost::int16_t c[3];
+			boost::int16_t pad;
+			float value;
+		};
+		struct Index {
+			boost::uint64_t bin;
+			boost::uint64_t start;
+		};
+
+		stir::shared_ptr<stir::ProjMatrixByBin> sptr_source_;
+		stir::shared_ptr<stir::ProjDataInfo> sptr_pdi_;
+		std::string filename_;
+		stir::shared_ptr<boost::interprocess::file_mapping> sptr_mapping_;
+		stir::shared_ptr<boost::interprocess::mapped_region> sptr_region_;
+		const Element* elems_;
+		const Index* index_;
+		size_t num_bins_;
+
+		static boost::uint64_t bin_key_(const stir::Bin& bin);
+		bool map_(const std::string& key);
+		void write_(const std::string& key);
+		virtual void calculate_proj_matrix_elems_for_one_bin
+			(stir::ProjMatrixElemsForOneBin& elems) const;
 	};
 
 	/*!
@@ -443,10 +622,85 @@ The actual algorithm is described in
 		stir::shared_ptr<stir::ProjMatrixByBin> sptr_matrix_;
 	};
 
+	/*!
+	\ingroup STIR Extensions
+	\brief PET acquisition model using a projector pair defined in a STIR
+	parameter file.
+
+	Any projector pair registered with the STIR build can be selected, for
+	example one using accelerated projectors STIR was built with:
+	\code
+	projector pair parameters :=
+	projector pair type := Separate Projectors
+	  ...
+	end projector pair parameters :=
+	\endcode
+	The forward and backward projections, subsets and the additive,
+	background and normalisation terms work as for the other models.
+	*/
+
+	class PETAcquisitionModelUsingParameterFile : public PETAcquisitionModel {
+	public:
+		PETAcquisitionModelUsingParameterFile(const std::string& filename);
+	};
+
 	typedef PETAcquisitionModel AcqMod3DF;
 	typedef PETAcquisitionModelUsingMatrix AcqModUsingMatrix3DF;
 	typedef stir::shared_ptr<AcqMod3DF> sptrAcqMod3DF;
 
+	/*!
+	\ingroup STIR Extensions
+	\brief Bin normalisation with optionally precomputed factors.
+
+	Wraps a normalisation that computes its factors on the fly. With caching
+	on, set_up() applies it once to a sinogram of ones and the stored factors
+	are then used for all subsequent applications, including those made by a
+	normalisation chain containing this one.
+	*/
+
+	class BinNormalisationWithCachedFactors : public stir::BinNormalisation {
+	public:
+		BinNormalisationWithCachedFactors
+			(stir::shared_ptr<stir::BinNormalisation> sptr_norm,
+			stir::shared_ptr<stir::DataSymmetriesForViewSegmentNumbers>
+			sptr_symmetries) :
+			sptr_norm_(sptr_norm), sptr_symmetries_(sptr_symmetries),
+			cache_(false)
+		{}
+		void set_cache(bool cache)
+		{
+			cache_ = cache;
+			if (!cache)
+				sptr_factors_.reset();
+		}
+		bool cache() const
+		{
+			return cache_;
+		}
+		// the multiplicative factors undo() applies, null if not cached
+		stir::shared_ptr<PETAcquisitionData> factors_sptr() const
+		{
+			return sptr_factors_;
+		}
+		virtual stir::Succeeded set_up
+			(const stir::shared_ptr<stir::ProjDataInfo>& sptr_pdi);
+		virtual void apply(stir::RelatedViewgrams<float>& viewgrams,
+			const double start_time, const double end_time) const;
+		virtual void undo(stir::RelatedViewgrams<float>& viewgrams,
+			const double start_time, const double end_time) const;
+		virtual float get_bin_efficiency(const stir::Bin& bin,
+			const double start_time, const double end_time) const
+		{
+			return sptr_norm_->get_bin_efficiency(bin, start_time, end_time);
+		}
+	private:
+		stir::shared_ptr<stir::BinNormalisation> sptr_norm_;
+		stir::shared_ptr<stir::DataSymmetriesForViewSegmentNumbers>
+			sptr_symmetries_;
+		bool cache_;
+		stir::shared_ptr<PETAcquisitionData> sptr_factors_;
+	};
+
 	/*!
 	\ingroup STIR Extensions
 	\brief Attenuation model.
@@ -456,12 +710,96 @@ The actual algorithm is described in
 	class PETAttenuationModel : public PETAcquisitionSensitivityModel {
 	public:
 		PETAttenuationModel(PETImageData& id, PETAcquisitionModel& am);
+		//! Switches the caching of the attenuation factors on or off.
+		/*! If on, set_up() computes the attenuation factors once into a
+			sinogram in memory, which is then multiplied or divided by instead
+			of forward projecting the attenuation image at each application.
+			If off (default), no sinogram memory is used.
+		*/
+		void set_cache(bool cache);
+		bool cache() const;
 		// multiply by bin efficiencies
 		virtual void unnormalise(PETAcquisitionData& ad) const;
 		// divide by bin efficiencies
 		virtual void normalise(PETAcquisitionData& ad) const;
 	protected:
 		stir::shared_ptr<stir::ForwardProjectorByBin> sptr_forw_projector_;
+		stir::shared_ptr<BinNormalisationWithCachedFactors> sptr_cached_norm_;
+	};
+
+	/*!
+	\ingroup STIR Extensions
+	\brief Parallel evaluation of the full gradient of an objective function.
+
+	Subset gradients are computed concurrently, each thread accumulating
+	into its own image, and the thread images are then summed pairwise.
+	The number of threads is bounded by the set maximum, the number of
+	subsets and the memory budget for the thread-local images. The default
+	of one thread gives the sequential accumulation; more threads require
+	the projectors used by the objective function to be thread-safe.
+	*/
+
+	class PETGradientThreads {
+	public:
+		// maximal number of concurrent subsets, 0 for all available threads
+		static void set(int n);
+		static int get();
+		// memory budget for the thread-local images in megabytes
+		static void set_memory_limit(int mb);
+		static int memory_limit();
+		// grad := sum of the gradients of all subsets at image
+		static void compute_gradient(ObjectiveFunction3DF& fun,
+			Image3DF& grad, const Image3DF& image);
+	private:
+		static int num_threads_;
+		static int memory_limit_;
+
+		// grad := sum of the gradients of subsets first, first + step, ...
+		static void compute_gradient_(ObjectiveFunction3DF& fun,
+			Image3DF& grad, const Image3DF& image, int first, int step);
+	};
+
+	/*!
+	\ingroup STIR Extensions
+	\brief Distribution of PET subset computations over MPI processes.
+
+	Active if SIRF is built with SIRF_MPI, the distribution is enabled and
+	the application runs in more than one MPI process (e.g. a Python script
+	importing mpi4py launched by mpirun). The processes then share the
+	subsets of the objective function values and full gradients, and the
+	views of backprojections: process r works on the parts r, r + size(),
+	..., and the results are summed by MPI_Allreduce. The image is broadcast
+	from process 0 first, so that all processes work on the same estimate.
+	All processes must make the same calls in the same order.
+	Forward projections are not distributed, as summing their results
+	would take a reduction of the size of the acquisition data.
+	*/
+
+	class PETDistributed {
+	public:
+		// initialises MPI, unless it has been already, if on is true
+		static void set_enabled(bool on);
+		static bool enabled()
+		{
+			return enabled_;
+		}
+		static bool active()
+		{
+			return enabled_ && size() > 1;
+		}
+		// the number of this process and the number of processes
+		static int rank();
+		static int size();
+		// image := image of process 0
+		static void broadcast(Image3DF& image);
+		// image := sum of image over the processes
+		static void sum(Image3DF& image);
+		static double sum(double v);
+		// the value of fun at image, subsets distributed if active
+		static double compute_value
+			(ObjectiveFunction3DF& fun, const Image3DF& image);
+	private:
+		static bool enabled_;
 	};
 
 	/*!
@@ -485,13 +823,42 @@ The actual algorithm is described in
 		void only2D(int only) {
 			only_2D = only != 0;
 		}
+		// the gradient stencil applied to the image planes concurrently
+		virtual void compute_gradient
+			(Image3DF& grad, const Image3DF& image);
 	};
 
+	/*!
+	\ingroup STIR Extensions
+	\brief PLS prior with precomputed anatomical terms.
+
+	The normalised gradient of the anatomical image, which stays the same
+	for the whole reconstruction, is computed by set_up (or by the first
+	gradient computation after the anatomical image or eta have changed)
+	rather than by every gradient computation, and the gradient stencil is
+	applied to the image planes concurrently.
+	*/
 	class xSTIR_PLSPrior3DF : public stir::PLSPrior < float > {
 	public:
+		xSTIR_PLSPrior3DF() : eta_(0), only_2D_(false)
+		{}
 		void only2D(int only) {
 			only_2D = only != 0;
 		}
+		virtual stir::Succeeded set_up(sptrImage3DF const& sptr_target);
+		virtual void compute_gradient
+			(Image3DF& grad, const Image3DF& image);
+	private:
+		// guards the terms below, computed for this anatomical image,
+		// eta and only_2D
+		std::mutex mutex_;
+		sptrImage3DF sptr_anatomical_;
+		double eta_;
+		bool only_2D_;
+		// the anatomical image gradient normalised by 
+		// sqrt(|gradient|^2 + eta^2), components z, y and x
+		sptrImage3DF sptr_xi_[3];
+		void set_up_anatomical_terms_();
 	};
 
 	class xSTIR_GeneralisedObjectiveFunction3DF :
@@ -529,6 +896,10 @@ The actual algorithm is described in
 		{
 			return sptr_am_;
 		}
+		stir::shared_ptr<PETAcquisitionData> acquisition_data_sptr()
+		{
+			return sptr_ad_;
+		}
 	private:
 		stir::shared_ptr<PETAcquisitionData> sptr_ad_;
 		stir::shared_ptr<AcqMod3DF> sptr_am_;
@@ -537,6 +908,108 @@ The actual algorithm is described in
 	typedef xSTIR_PoissonLogLikelihoodWithLinearModelForMeanAndProjData3DF
 		PoissonLogLhLinModMeanProjData3DF;
 
+	/*!
+	\ingroup STIR Extensions
+	\brief Adapters of the PET reconstruction components to the solvers.
+
+	PETAcquisitionModelOperator is the linear part of the acquisition model,
+	x -> (G x) n, i.e. the forward projection less the image-independent
+	contribution of the additive and background terms, which is computed
+	once, at the first application; its adjoint is the backprojection.
+
+	PETObjective is minus a STIR objective function (STIR maximises them),
+	its gradient computed for all subsets concurrently by PETGradientThreads.
+	PETPrior is the penalty of a STIR prior.
+	*/
+
+	class PETAcquisitionModelOperator : public aLinearOperator<float> {
+	public:
+		PETAcquisitionModelOperator(stir::shared_ptr<AcqMod3DF> sptr_am) :
+			sptr_am_(sptr_am)
+		{}
+		void apply(aDataContainer<float>& x, aDataContainer<float>& y);
+		void apply_adjoint(aDataContainer<float>& y, aDataContainer<float>& x);
+	private:
+		stir::shared_ptr<AcqMod3DF> sptr_am_;
+		stir::shared_ptr<PETAcquisitionData> sptr_offset_;
+	};
+
+	class PETObjective : public aObjective<float> {
+	public:
+		PETObjective(stir::shared_ptr<ObjectiveFunction3DF> sptr_fun) :
+			sptr_fun_(sptr_fun)
+		{}
+		float value(aDataContainer<float>& x);
+		void gradient(aDataContainer<float>& x, aDataContainer<float>& g);
+	private:
+		stir::shared_ptr<ObjectiveFunction3DF> sptr_fun_;
+	};
+
+	class PETPrior : public aObjective<float> {
+	public:
+		PETPrior(stir::shared_ptr<Prior3DF> sptr_prior) : sptr_prior_(sptr_prior)
+		{}
+		float value(aDataContainer<float>& x);
+		void gradient(aDataContainer<float>& x, aDataContainer<float>& g);
+	private:
+		stir::shared_ptr<Prior3DF> sptr_prior_;
+	};
+
+	/*!
+	\ingroup STIR Extensions
+	\brief Cache of subset sensitivity images.
+
+	Computing the subset sensitivities is the most expensive part of setting
+	up a Poisson log-likelihood objective function. The cache keeps them,
+	keyed by a hash of the acquisition data geometry, the projectors, the
+	source of the acquisition sensitivity model, the number of subsets and
+	the image geometry, in memory and optionally as Interfile images in a
+	directory shared between sessions. Only objective functions that have
+	their acquisition data and model set via SIRF and are due to recompute
+	their sensitivities are cached.
+	*/
+
+	class PETSensitivityCache {
+	public:
+		static void set_enabled(bool on)
+		{
+			enabled_ = on;
+		}
+		static bool enabled()
+		{
+			return enabled_;
+		}
+		// directory for the cached images, empty for memory only
+		static void set_directory(const std::string& dir)
+		{
+			directory_ = dir;
+		}
+		static const std::string& directory()
+		{
+			return directory_;
+		}
+		// removes the images kept in memory
+		static void clear()
+		{
+			images_.clear();
+		}
+		// returns the cache key for fun set up on image, empty if fun
+		// cannot be cached
+		static std::string key(ObjectiveFunction3DF& fun, const Image3DF& image);
+		// gives fun the cached sensitivities, returns false if there are none
+		static bool restore(const std::string& key, ObjectiveFunction3DF& fun);
+		// caches the sensitivities of a set up fun
+		static void store(const std::string& key, ObjectiveFunction3DF& fun);
+		// makes fun recompute its sensitivities at the next set-up again
+		static void release(ObjectiveFunction3DF& fun);
+	private:
+		static bool enabled_;
+		static std::string directory_;
+		static std::map<std::string, std::vector<sptrImage3DF> > images_;
+
+		static std::string filename_(const std::string& key, int subset);
+	};
+
 	class xSTIR_IterativeReconstruction3DF :
 		public stir::IterativeReconstruction < Image3DF > {
 	public:
@@ -597,16 +1070,67 @@ The actual algorithm is described in
 		}
 	};
 
+	/*!
+	\ingroup STIR Extensions
+	\brief Ramp filter of the parallel FBP2D.
+
+	The discrete ramp (Ram-Lak) kernel apodised by the window 
+	alpha + (1 - alpha) cos(pi f/fc) of FBP2DReconstruction, applied in the
+	frequency domain by a radix-2 FFT of twice the tangential size or more.
+	Filters are kept for the lifetime of the process, one per tangential 
+	size, alpha and cut-off, and are applied to two sinogram rows per FFT.
+	*/
+
+	class PETRampFilter {
+	public:
+		static stir::shared_ptr<const PETRampFilter>
+			get(int n, double alpha, double fc);
+		// filters m rows of n bins stored contiguously, multiplying the
+		// result by scale; may be called concurrently
+		void apply(float* rows, int m, float scale) const;
+	private:
+		PETRampFilter(int n, double alpha, double fc);
+		int n_;
+		int nfft_;
+		std::vector<int> bitrev_;
+		std::vector<std::complex<float> > twiddles_;
+		// the real frequency response, divided by nfft_
+		std::vector<float> response_;
+		void fft_(std::complex<float>* a, bool inverse) const;
+	};
+
+	/*!
+	\ingroup STIR Extensions
+	\brief FBP2D reconstruction with an optional parallel mode.
+
+	In the parallel mode, the image planes are reconstructed concurrently:
+	each thread reads (under a lock) the sinograms rebinned into its plane,
+	combines and arc-corrects them, filters them with a cached PETRampFilter
+	and backprojects them into the plane by linear interpolation, so that 
+	single slice rebinning, filtering and backprojection are done in one 
+	pass over the data. As STIR's FBP2D, it uses segment 0 only, combined
+	with segments -1 and 1 for span 1 data.
+	*/
+
 	class xSTIR_FBP2DReconstruction : public stir::FBP2DReconstruction {
 	public:
-		xSTIR_FBP2DReconstruction()
+		xSTIR_FBP2DReconstruction() : _parallel(false)
 		{
 			_is_set_up = false;
 		}
 		void set_input(const PETAcquisitionData& acq)
 		{
+			_sptr_input = acq.data();
 			set_input_data(acq.data());
 		}
+		void set_parallel(bool parallel)
+		{
+			_parallel = parallel;
+		}
+		bool parallel() const
+		{
+			return _parallel;
+		}
 		void set_zoom(double z)
 		{
 			zoom = z;
@@ -642,17 +1166,20 @@ The actual algorithm is described in
 			if (!_is_set_up) {
 				stir::shared_ptr<Image3DF> sptr_image(construct_target_image_ptr());
 				_sptr_image_data.reset(new PETImageData(sptr_image));
-				return reconstruct(sptr_image);
 			}
-			else
-				return reconstruct(_sptr_image_data->data_sptr());
+			if (_parallel)
+				return reconstruct_in_parallel(_sptr_image_data->data());
+			return reconstruct(_sptr_image_data->data_sptr());
 		}
 		stir::shared_ptr<PETImageData> get_output()
 		{
 			return _sptr_image_data;
 		}
+		stir::Succeeded reconstruct_in_parallel(Image3DF& image);
 	protected:
 		bool _is_set_up;
+		bool _parallel;
+		stir::shared_ptr<stir::ProjData> _sptr_input;
 		stir::shared_ptr<PETImageData> _sptr_image_data;
 	};
 
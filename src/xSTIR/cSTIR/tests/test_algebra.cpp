@@ -0,0 +1,316 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup STIR Extensions
+\brief Tests of the fused algebra of PETAcquisitionData.
+
+The results of the contiguous buffer path and of the viewgram streaming
+path are compared with each other and with the same operations applied to
+plain arrays, with the result container among the operands, and for
+several numbers of threads.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "stir/ExamInfo.h"
+
+#include "stir_data_containers.h"
+#include "sirf_test.h"
+
+using namespace stir;
+using namespace sirf;
+using SIRFTest::check;
+
+typedef shared_ptr<PETAcquisitionData> sptrAcquisitionData;
+
+// a small scanner whose data still takes many algebra chunks
+static const char* SCANNER = "ECAT 953";
+static const int SPAN = 1;
+static const int MAX_RING_DIFF = 2;
+static const int VIEW_MASH_FACTOR = 8;
+
+static const float A = 0.75f;
+static const float B = -1.25f;
+static const float C[3] = { 2.0f, -0.5f, 1.5f };
+
+enum Storage { MEMORY, MAPPED_FILE, STREAM_FILE };
+static const char* STORAGE_NAME[] =
+	{ "memory", "memory-mapped file", "stream file" };
+
+static sptrAcquisitionData
+new_data(Storage storage)
+{
+	shared_ptr<ExamInfo> sptr_ei(new ExamInfo);
+	if (storage == MEMORY)
+		return sptrAcquisitionData(new PETAcquisitionDataInMemory
+			(sptr_ei, SCANNER, SPAN, MAX_RING_DIFF, VIEW_MASH_FACTOR));
+	PETAcquisitionDataInFile::set_memory_mapped(storage == MAPPED_FILE);
+	sptrAcquisitionData sptr(new PETAcquisitionDataInFile
+		(sptr_ei, SCANNER, SPAN, MAX_RING_DIFF, VIEW_MASH_FACTOR));
+	PETAcquisitionDataInFile::set_memory_mapped(true);
+	return sptr;
+}
+
+static size_t
+num_bins(PETAcquisitionData& ad)
+{
+	return (size_t)ad.get_num_tangential_poss()*ad.get_num_views()*
+		ad.get_num_sinograms();
+}
+
+static std::vector<float>
+values(PETAcquisitionData& ad)
+{
+	std::vector<float> v(num_bins(ad));
+	ad.copy_to(&v[0]);
+	return v;
+}
+
+static bool
+agree(double s, double t, double tol)
+{
+	return std::abs(s - t) <= tol*(1.0 + std::abs(t));
+}
+
+static bool
+agree(const std::vector<float>& u, const std::vector<float>& v, float tol)
+{
+	if (u.size() != v.size())
+		return false;
+	for (size_t i = 0; i < u.size(); i++)
+		if (!agree(u[i], v[i], tol))
+			return false;
+	return true;
+}
+
+// the results of the algebra on x and y
+struct Results {
+	float norm;
+	float dot;
+	float axpby_norm;
+	float axpby_dot;
+	std::vector<float> axpby;
+	std::vector<float> axpby_in_place;
+	std::vector<float> xapy;
+	std::vector<float> linear_combination;
+	std::vector<float> axpby_norm_bins;
+	std::vector<float> axpby_dot_bins;
+};
+
+// expected results computed on arrays the way the operations do
+static Results
+expected(const std::vector<float>& x, const std::vector<float>& y)
+{
+	size_t n = x.size();
+	Results r;
+	r.axpby.resize(n);
+	r.xapy.resize(n);
+	r.linear_combination.resize(n);
+	double t = 0.0, tx = 0.0, txy = 0.0, tax = 0.0;
+	for (size_t i = 0; i < n; i++) {
+		float u = float(A*double(x[i]) + B*double(y[i]));
+		r.axpby[i] = u;
+		r.xapy[i] = float(y[i] + A*double(x[i]));
+		r.linear_combination[i] = float(C[0]*double(x[i]) +
+			C[1]*double(y[i]) + C[2]*double(y[i]));
+		tx += double(x[i])*x[i];
+		txy += double(x[i])*y[i];
+		t += double(u)*u;
+		tax += double(u)*x[i];
+	}
+	r.norm = (float)std::sqrt(tx);
+	r.dot = (float)txy;
+	r.axpby_norm = (float)std::sqrt(t);
+	r.axpby_dot = (float)tax;
+	r.axpby_in_place = r.axpby;
+	r.axpby_norm_bins = r.axpby;
+	r.axpby_dot_bins = r.axpby;
+	return r;
+}
+
+// the results of the algebra on x and y with the results stored in z,
+// which is also an operand of the in-place operations
+static Results
+compute(PETAcquisitionData& x, PETAcquisitionData& y,
+	PETAcquisitionData& z, const std::vector<float>& vy)
+{
+	Results r;
+	r.norm = x.norm();
+	r.dot = x.dot(y);
+	z.axpby(A, x, B, y);
+	r.axpby = values(z);
+	z.fill_from(&vy[0]);
+	z.axpby(A, x, B, z);
+	r.axpby_in_place = values(z);
+	z.fill_from(&vy[0]);
+	z.xapy(A, x);
+	r.xapy = values(z);
+	z.fill_from(&vy[0]);
+	const aDataContainer<float>* ops[3] = { &x, &z, &y };
+	z.linear_combination(3, C, ops);
+	r.linear_combination = values(z);
+	z.fill_from(&vy[0]);
+	r.axpby_norm = z.axpby_norm(A, x, B, z);
+	r.axpby_norm_bins = values(z);
+	z.fill_from(&vy[0]);
+	r.axpby_dot = z.axpby_dot(A, x, B, z, x);
+	r.axpby_dot_bins = values(z);
+	return r;
+}
+
+static void
+compare(const Results& r, const Results& s, float tol, const std::string& what)
+{
+	check(agree(r.norm, s.norm, tol), "norm " + what);
+	check(agree(r.dot, s.dot, tol), "dot " + what);
+	check(agree(r.axpby, s.axpby, tol), "axpby " + what);
+	check(agree(r.axpby_in_place, s.axpby_in_place, tol),
+		"axpby in place " + what);
+	check(agree(r.xapy, s.xapy, tol), "xapy " + what);
+	check(agree(r.linear_combination, s.linear_combination, tol),
+		"linear_combination with this an operand " + what);
+	check(agree(r.axpby_norm, s.axpby_norm, tol) &&
+		agree(r.axpby_norm_bins, s.axpby_norm_bins, tol),
+		"axpby_norm in place " + what);
+	check(agree(r.axpby_dot, s.axpby_dot, tol) &&
+		agree(r.axpby_dot_bins, s.axpby_dot_bins, tol),
+		"axpby_dot in place " + what);
+}
+
+// bitwise comparison of the bins
+static bool
+same_bins(const Results& r, const Results& s)
+{
+	return r.axpby == s.axpby && r.axpby_in_place == s.axpby_in_place &&
+		r.xapy == s.xapy && r.linear_combination == s.linear_combination &&
+		r.axpby_norm_bins == s.axpby_norm_bins &&
+		r.axpby_dot_bins == s.axpby_dot_bins;
+}
+
+// bitwise comparison
+static bool
+same(const Results& r, const Results& s)
+{
+	return r.norm == s.norm && r.dot == s.dot &&
+		r.axpby_norm == s.axpby_norm && r.axpby_dot == s.axpby_dot &&
+		same_bins(r, s);
+}
+
+static Results
+compute(Storage result_storage, Storage operand_storage,
+	const std::vector<float>& vx, const std::vector<float>& vy)
+{
+	sptrAcquisitionData sptr_x = new_data(operand_storage);
+	sptrAcquisitionData sptr_y = new_data(operand_storage);
+	sptrAcquisitionData sptr_z = new_data(result_storage);
+	sptr_x->fill_from(&vx[0]);
+	sptr_y->fill_from(&vy[0]);
+	return compute(*sptr_x, *sptr_y, *sptr_z, vy);
+}
+
+int main()
+{
+	try {
+		sptrAcquisitionData sptr_ad = new_data(MEMORY);
+		size_t n = num_bins(*sptr_ad);
+		std::mt19937 gen(2017);
+		std::uniform_real_distribution<float> u(-1.0f, 1.0f);
+		std::vector<float> vx(n), vy(n);
+		for (size_t i = 0; i < n; i++) {
+			vx[i] = u(gen);
+			vy[i] = u(gen);
+		}
+		Results r = expected(vx, vy);
+
+		// all storages, the buffer path for memory and memory-mapped
+		// files, the streaming path for stream files and mixed storage
+		Results rs[3];
+		for (int s = MEMORY; s <= STREAM_FILE; s++) {
+			rs[s] = compute((Storage)s, (Storage)s, vx, vy);
+			compare(rs[s], r, 1e-6f, std::string("in ") + STORAGE_NAME[s]);
+		}
+		Results rm = compute(MEMORY, STREAM_FILE, vx, vy);
+		compare(rm, r, 1e-6f,
+			"in memory with the operands in a stream file");
+
+		// the element-wise results of both paths are identical, the
+		// reductions are summed in different order
+		const Results& rb = rs[MEMORY];
+		const Results& rv = rs[STREAM_FILE];
+		check(same_bins(rv, rb), "the bins of both paths are identical");
+		check(agree(rv.norm, rb.norm, 1e-6) && agree(rv.dot, rb.dot, 1e-6) &&
+			agree(rv.axpby_norm, rb.axpby_norm, 1e-6) &&
+			agree(rv.axpby_dot, rb.axpby_dot, 1e-6),
+			"the reductions of both paths agree");
+
+		// reduced precision operands are decoded chunk by chunk on the
+		// buffer path, viewgram by viewgram on the streaming path
+		sptrAcquisitionData sptr_x = new_data(MEMORY);
+		sptr_x->fill_from(&vx[0]);
+		PETAcquisitionDataReducedPrecision xr(*sptr_x, ReducedPrecision::HALF);
+		std::vector<float> vxr = values(xr);
+		std::vector<float> lr(n);
+		for (size_t i = 0; i < n; i++)
+			lr[i] = float(A*double(vxr[i]) + B*double(vy[i]));
+		const Storage paths[] = { MEMORY, STREAM_FILE };
+		for (int k = 0; k < 2; k++) {
+			Storage s = paths[k];
+			sptrAcquisitionData sptr_y = new_data(s);
+			sptr_y->fill_from(&vy[0]);
+			sptr_y->axpby(A, xr, B, *sptr_y);
+			check(agree(values(*sptr_y), lr, 1e-6f),
+				std::string("axpby of reduced precision data in ") +
+				STORAGE_NAME[s]);
+		}
+
+		// the results do not depend on the number of threads
+		const int nt[] = { 1, 2, 4, 7 };
+		for (int s = MEMORY; s <= STREAM_FILE; s++) {
+			PETAlgebraThreads::set(nt[0]);
+			Results r1 = compute((Storage)s, (Storage)s, vx, vy);
+			for (int i = 1; i < 4; i++) {
+				PETAlgebraThreads::set(nt[i]);
+				Results ri = compute((Storage)s, (Storage)s, vx, vy);
+				check(same(ri, r1), std::string("results in ") +
+					STORAGE_NAME[s] + " with " + std::to_string(nt[i]) +
+					" threads same as with 1");
+			}
+		}
+		PETAlgebraThreads::set(0);
+	}
+	catch (const std::exception& e) {
+		std::cout << "exception: " << e.what() << '\n';
+		return 1;
+	}
+	catch (...) {
+		std::cout << "unknown exception\n";
+		return 1;
+	}
+	return SIRFTest::report("acquisition algebra");
+}
@@ -0,0 +1,247 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*!
+\file
+\ingroup STIR Extensions
+\brief Tests of the fused algebra of PETImageData.
+
+The results are compared with the same operations applied to plain arrays,
+with the result image among the operands, and for several numbers of
+threads.
+
+\author Evgueni Ovtchinnikov
+\author CCP PETMR
+*/
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "stir/ExamInfo.h"
+
+#include "stir_data_containers.h"
+#include "sirf_test.h"
+
+using namespace stir;
+using namespace sirf;
+using SIRFTest::check;
+
+typedef shared_ptr<PETImageData> sptrImageData;
+
+static const float A = 0.75f;
+static const float B = -1.25f;
+static const float C[3] = { 2.0f, -0.5f, 1.5f };
+
+static size_t
+num_voxels(const PETImageData& image)
+{
+	int dim[3];
+	image.get_dimensions(dim);
+	return (size_t)dim[0]*dim[1]*dim[2];
+}
+
+static std::vector<float>
+values(const PETImageData& image)
+{
+	std::vector<float> v(num_voxels(image));
+	image.get_data(&v[0]);
+	return v;
+}
+
+static bool
+agree(double s, double t, double tol)
+{
+	return std::abs(s - t) <= tol*(1.0 + std::abs(t));
+}
+
+static bool
+agree(const std::vector<float>& u, const std::vector<float>& v, float tol)
+{
+	if (u.size() != v.size())
+		return false;
+	for (size_t i = 0; i < u.size(); i++)
+		if (!agree(u[i], v[i], tol))
+			return false;
+	return true;
+}
+
+// the results of the algebra on x and y
+struct Results {
+	float norm;
+	float dot;
+	float axpby_norm;
+	float axpby_dot;
+	std::vector<float> axpby;
+	std::vector<float> axpby_in_place;
+	std::vector<float> xapy;
+	// with the result image the first, the middle and the last operand
+	std::vector<float> linear_combination[3];
+	std::vector<float> axpby_norm_voxels;
+	std::vector<float> axpby_dot_voxels;
+};
+
+// expected results computed on arrays the way the operations do
+static Results
+expected(const std::vector<float>& x, const std::vector<float>& y)
+{
+	size_t n = x.size();
+	Results r;
+	r.axpby.resize(n);
+	r.xapy.resize(n);
+	for (int k = 0; k < 3; k++)
+		r.linear_combination[k].resize(n);
+	double t = 0.0, tx = 0.0, txy = 0.0, tax = 0.0;
+	for (size_t i = 0; i < n; i++) {
+		float u = float(A*double(x[i]) + B*double(y[i]));
+		r.axpby[i] = u;
+		r.xapy[i] = float(y[i] + A*double(x[i]));
+		// the operands are y and x with y in the k-th place
+		for (int k = 0; k < 3; k++) {
+			double s = 0.0;
+			for (int j = 0; j < 3; j++)
+				s += C[j]*double(j == k ? y[i] : x[i]);
+			r.linear_combination[k][i] = float(s);
+		}
+		tx += double(x[i])*x[i];
+		txy += double(x[i])*y[i];
+		t += double(u)*u;
+		tax += double(u)*x[i];
+	}
+	r.norm = (float)std::sqrt(tx);
+	r.dot = (float)txy;
+	r.axpby_norm = (float)std::sqrt(t);
+	r.axpby_dot = (float)tax;
+	r.axpby_in_place = r.axpby;
+	r.axpby_norm_voxels = r.axpby;
+	r.axpby_dot_voxels = r.axpby;
+	return r;
+}
+
+// the results of the algebra on x and y with the results stored in z,
+// which is also an operand of the in-place operations
+static Results
+compute(PETImageData& x, PETImageData& y, PETImageData& z,
+	const std::vector<float>& vy)
+{
+	Results r;
+	r.norm = x.norm();
+	r.dot = x.dot(y);
+	z.axpby(A, x, B, y);
+	r.axpby = values(z);
+	z.set_data(&vy[0]);
+	z.axpby(A, x, B, z);
+	r.axpby_in_place = values(z);
+	z.set_data(&vy[0]);
+	z.xapy(A, x);
+	r.xapy = values(z);
+	for (int k = 0; k < 3; k++) {
+		z.set_data(&vy[0]);
+		const aDataContainer<float>* ops[3] = { &x, &x, &x };
+		ops[k] = &z;
+		z.linear_combination(3, C, ops);
+		r.linear_combination[k] = values(z);
+	}
+	z.set_data(&vy[0]);
+	r.axpby_norm = z.axpby_norm(A, x, B, z);
+	r.axpby_norm_voxels = values(z);
+	z.set_data(&vy[0]);
+	r.axpby_dot = z.axpby_dot(A, x, B, z, x);
+	r.axpby_dot_voxels = values(z);
+	return r;
+}
+
+static Results
+compute(PETImageData& image,
+	const std::vector<float>& vx, const std::vector<float>& vy)
+{
+	sptrImageData sptr_x(new PETImageData(image));
+	sptrImageData sptr_y(new PETImageData(image));
+	sptrImageData sptr_z(new PETImageData(image));
+	sptr_x->set_data(&vx[0]);
+	sptr_y->set_data(&vy[0]);
+	return compute(*sptr_x, *sptr_y, *sptr_z, vy);
+}
+
+static void
+compare(const Results& r, const Results& s, float tol, const std::string& what)
+{
+	const char* place[] = { "first", "middle", "last" };
+	check(agree(r.norm, s.norm, tol), "norm" + what);
+	check(agree(r.dot, s.dot, tol), "dot" + what);
+	check(agree(r.axpby, s.axpby, tol), "axpby" + what);
+	check(agree(r.axpby_in_place, s.axpby_in_place, tol),
+		"axpby in place" + what);
+	check(agree(r.xapy, s.xapy, tol), "xapy" + what);
+	for (int k = 0; k < 3; k++)
+		check(agree(r.linear_combination[k], s.linear_combination[k], tol),
+			std::string("linear_combination with this the ") + place[k] +
+			" operand" + what);
+	check(agree(r.axpby_norm, s.axpby_norm, tol) &&
+		agree(r.axpby_norm_voxels, s.axpby_norm_voxels, tol),
+		"axpby_norm in place" + what);
+	check(agree(r.axpby_dot, s.axpby_dot, tol) &&
+		agree(r.axpby_dot_voxels, s.axpby_dot_voxels, tol),
+		"axpby_dot in place" + what);
+}
+
+int main()
+{
+	try {
+		shared_ptr<ExamInfo> sptr_ei(new ExamInfo);
+		PETAcquisitionDataInMemory ad(sptr_ei, "ECAT 953", 1, 2, 8);
+		PETImageData image(ad);
+		size_t n = num_voxels(image);
+		std::mt19937 gen(2017);
+		std::uniform_real_distribution<float> u(-1.0f, 1.0f);
+		std::vector<float> vx(n), vy(n);
+		for (size_t i = 0; i < n; i++) {
+			vx[i] = u(gen);
+			vy[i] = u(gen);
+		}
+		Results r = expected(vx, vy);
+		compare(compute(image, vx, vy), r, 1e-6f, "");
+
+		// the planes are processed concurrently and their contributions
+		// to the reductions summed in fixed order, so the results
+		// do not depend on the number of threads
+		const int nt[] = { 1, 2, 4, 7 };
+		PETAlgebraThreads::set(nt[0]);
+		Results r1 = compute(image, vx, vy);
+		for (int i = 1; i < 4; i++) {
+			PETAlgebraThreads::set(nt[i]);
+			Results ri = compute(image, vx, vy);
+			compare(ri, r1, 0.0f, " with " + std::to_string(nt[i]) +
+				" threads same as with 1");
+		}
+		PETAlgebraThreads::set(0);
+	}
+	catch (const std::exception& e) {
+		std::cout << "exception: " << e.what() << '\n';
+		return 1;
+	}
+	catch (...) {
+		std::cout << "unknown exception\n";
+		return 1;
+	}
+	return SIRFTest::report("image algebra");
+}
@@ -37,6 +37,11 @@ classdef AcquisitionData < mSTIR.DataContainer
 %           scheme = 'memory':
 %               all acquisition data generated from now on will be kept in
 %               RAM (avoid if data is very large)
+%           scheme = 'hybrid':
+%               all acquisition data generated from now on will be kept in
+%               RAM within the budget set by mSTIR.set_storage_budget, the
+%               least recently used data being moved to scratch files
+%               beyond it
             h = calllib...
                 ('mstir', 'mSTIR_setAcquisitionsStorageScheme', scheme);
             mUtilities.check_status('AcquisitionData', h);
@@ -153,6 +158,11 @@ classdef AcquisitionData < mSTIR.DataContainer
 %           - number of tangential positions
 %           - number of views
 %           - number of sinograms
+            if mUtilities.mex_available('mstir_mex')
+                data = mstir_mex('getAcquisitionsData', ...
+                    mUtilities.handle_address(self.handle_));
+                return
+            end
             ptr_i = libpointer('int32Ptr', zeros(3, 1));
             calllib('mstir', 'mSTIR_getAcquisitionsDimensions', ...
                 self.handle_, ptr_i);
@@ -173,6 +183,10 @@ classdef AcquisitionData < mSTIR.DataContainer
             elseif self.read_only
                 error([self.name ':fill'], ...
                     'Cannot fill read-only object, consider filling a clone')
+            elseif isnumeric(value) && numel(value) > 1 && ...
+                    mUtilities.mex_available('mstir_mex')
+                mstir_mex('setAcquisitionsData', ...
+                    mUtilities.handle_address(self.handle_), single(value));
             elseif isa(value, 'single')
                 if numel(value) > 1
                     ptr_v = libpointer('singlePtr', value);
@@ -230,5 +244,24 @@ classdef AcquisitionData < mSTIR.DataContainer
             ad = mSTIR.AcquisitionData(self);
             ad.fill(value)
         end
+        function ad = reduced_precision_copy(self, format)
+%***SIRF*** reduced_precision_copy(format) returns a copy of this object 
+%           stored in 16-bit floating point, which halves the memory taken
+%           by data that is only read (e.g. additive terms and 
+%           multiplicative factors of the acquisition model); new data 
+%           computed from the copy is stored in single precision;
+%           format: 'half' (default, about 3 significant decimal digits, 
+%               values beyond 65504 in magnitude become infinite) or 
+%               'bfloat16' (about 2 digits, the range of single precision).
+            assert(~isempty(self.handle_), 'Empty AcquisitionData object')
+            if nargin < 2
+                format = 'half';
+            end
+            ad = mSTIR.AcquisitionData();
+            ad.handle_ = calllib('mstir', ...
+                'mSTIR_reducedPrecisionAcquisitionData', self.handle_, format);
+            mUtilities.check_status([self.name ':reduced_precision_copy'], ...
+                ad.handle_);
+        end
     end
 end
\ No newline at end of file
@@ -73,6 +73,17 @@ classdef AcquisitionModel < handle
             mSTIR.setParameter(self.handle_, 'AcquisitionModel', ...
                 'asm', asm, 'h');
         end
+        function set_verbosity(self, v)
+%***SIRF*** sets the amount of progress output of forward and backward:
+%         0 - none (default), 1 - terms applied, 2 - also projections.
+            mSTIR.setParameter(self.handle_, 'AcquisitionModel', ...
+                'verbosity', v, 'i')
+        end
+        function v = get_verbosity(self)
+%***SIRF*** returns the verbosity level set by set_verbosity.
+            v = mSTIR.parameter(self.handle_, 'AcquisitionModel', ...
+                'verbosity', 'i');
+        end
         function set_up(self, acq_templ, img_templ)
 %***SIRF*** sets up the object with appropriate geometric information.
 %         This function needs to be called before performing forward- or 
@@ -93,29 +104,52 @@ classdef AcquisitionModel < handle
             mUtilities.delete(h)
             %calllib('mutilities', 'mDeleteDataHandle', h)
         end
-        function ad = forward(self, x, subset_num, num_subsets)
+        function ad = forward(self, x, subset_num, num_subsets, ad)
 %***SIRF*** computes the forward projection of x (see AcquisitionModel)
 %         Usage: 
 %             acq_data = forward(image);
-%         x:  an ImageData object.
+%             forward(image, subset_num, num_subsets, acq_data);
+%         x:  an ImageData object;
+%         ad: an optional AcquisitionData object to be overwritten with
+%             the projection (avoids allocating new data).
             mUtilities.assert_validity(x, 'ImageData')
             if nargin < 4
                 subset_num = 0;
                 num_subsets = 1;
             end
+            if nargin > 4
+                mUtilities.assert_validity(ad, 'AcquisitionData')
+                h = calllib('mstir', 'mSTIR_acquisitionModelFwdReplace',...
+                    self.handle_, x.handle_, subset_num, num_subsets, ...
+                    ad.handle_);
+                mUtilities.check_status([self.name ':forward'], h)
+                mUtilities.delete(h)
+                return
+            end
             ad = mSTIR.AcquisitionData();
             ad.handle_ = calllib('mstir', 'mSTIR_acquisitionModelFwd',...
                 self.handle_, x.handle_, subset_num, num_subsets);
             mUtilities.check_status([self.name ':forward'], ad.handle_)
         end
-        function image = backward(self, y, subset_num, num_subsets)
+        function image = backward(self, y, subset_num, num_subsets, image)
 %***SIRF*** returns the backprojection of y (see AcquisitionModel)
-%         y:  an AcquisitionData object.
+%         y:     an AcquisitionData object;
+%         image: an optional ImageData object to be overwritten with
+%                the backprojection (avoids allocating a new image).
             mUtilities.assert_validity(y, 'AcquisitionData')
             if nargin < 4
                 subset_num = 0;
                 num_subsets = 1;
             end
+            if nargin > 4
+                mUtilities.assert_validity(image, 'ImageData')
+                h = calllib('mstir', 'mSTIR_acquisitionModelBwdReplace',...
+                    self.handle_, y.handle_, subset_num, num_subsets, ...
+                    image.handle_);
+                mUtilities.check_status([self.name ':backward'], h)
+                mUtilities.delete(h)
+                return
+            end
             image = mSTIR.ImageData();
             image.handle_ = calllib('mstir', 'mSTIR_acquisitionModelBwd',...
                 self.handle_, y.handle_, subset_num, num_subsets);
@@ -26,15 +26,17 @@ classdef AcquisitionModelUsingMatrix < mSTIR.AcquisitionModel
         function self = AcquisitionModelUsingMatrix(matrix)
 %         Creates an AcquisitionModelUsingMatrix object.
 %         The optional argument sets the projection matrix to be used.
-%         matrix:  a RayTracingMatrix object to represent G in (F) -
-%                  see AcquisitionModel
+%         matrix:  a RayTracingMatrix or MappedMatrix object to represent
+%                  G in (F) - see AcquisitionModel
             self.name = 'AcqModUsingMatrix';
             self.handle_ = calllib('mstir', 'mSTIR_newObject', self.name);
             mUtilities.check_status([self.name ':ctor'], self.handle_)
             if nargin < 1
                 matrix = mSTIR.RayTracingMatrix();
             end
-            mUtilities.assert_validity(matrix, 'RayTracingMatrix')
+            if ~strcmp(matrix.class_name(), 'MappedMatrix')
+                mUtilities.assert_validity(matrix, 'RayTracingMatrix')
+            end
             mSTIR.setParameter...
                 (self.handle_, self.name, 'matrix', matrix, 'h')
         end
@@ -48,7 +50,9 @@ classdef AcquisitionModelUsingMatrix < mSTIR.AcquisitionModel
         function set_matrix(self, matrix)
 %***SIRF*** set_matrix(matrix) sets the projection matrix to be used.
 %         matrix:  a projection matrix object to represent G in (F).
-            mUtilities.assert_validity(matrix, 'RayTracingMatrix')
+            if ~strcmp(matrix.class_name(), 'MappedMatrix')
+                mUtilities.assert_validity(matrix, 'RayTracingMatrix')
+            end
             mSTIR.setParameter...
                 (self.handle_, self.name, 'matrix', matrix, 'h')
         end
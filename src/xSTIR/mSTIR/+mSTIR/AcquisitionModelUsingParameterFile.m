@@ -0,0 +1,42 @@
+classdef AcquisitionModelUsingParameterFile < mSTIR.AcquisitionModel
+% Class for PET acquisition model using the projector pair defined in a
+% STIR parameter file.
+
+% CCP PETMR Synergistic Image Reconstruction Framework (SIRF).
+% Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC.
+% 
+% This is software developed for the Collaborative Computational
+% Project in Positron Emission Tomography and Magnetic Resonance imaging
+% (http://www.ccppetmr.ac.uk/).
+% 
+% Licensed under the Apache License, Version 2.0 (the "License");
+% you may not use this file except in compliance with the License.
+% You may obtain a copy of the License at
+% http://www.apache.org/licenses/LICENSE-2.0
+% Unless required by applicable law or agreed to in writing, software
+% distributed under the License is distributed on an "AS IS" BASIS,
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+% See the License for the specific language governing permissions and
+% limitations under the License.
+
+    properties
+    end
+    methods
+        function self = AcquisitionModelUsingParameterFile(filename)
+%         Creates an AcquisitionModelUsingParameterFile object;
+%         filename:  the name of a STIR parameter file with a
+%                    'projector pair parameters' section; any projector
+%                    pair available in the STIR build can be selected
+            self.name = 'AcqModUsingParameterFile';
+            self.handle_ = calllib...
+                ('mstir', 'mSTIR_objectFromFile', self.name, filename);
+            mUtilities.check_status([self.name ':ctor'], self.handle_)
+        end
+        function delete(self)
+            if ~isempty(self.handle_)
+                mUtilities.delete(self.handle_)
+                self.handle_ = [];
+            end
+        end
+    end
+end
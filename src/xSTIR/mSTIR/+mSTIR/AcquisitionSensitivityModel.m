@@ -90,6 +90,19 @@ classdef AcquisitionSensitivityModel < handle
             mUtilities.check_status([self.name_ ':set_up'], h)
             mUtilities.delete(h)
         end
+        function cache_attenuation_factors(self, cache)
+%***SIRF*** Switches the caching of attenuation factors on or off.
+%         Applies to models created from an attenuation image only.
+%         If on (default argument), set_up computes the attenuation factors
+%         once and stores them as a sinogram in memory; if off, they are
+%         computed by forward projection each time they are applied.
+%         Call before set_up.
+            if nargin < 2
+                cache = true;
+            end
+            mSTIR.setParameter(self.handle_, 'AttenuationModel', ...
+                'cache', int32(cache), 'i')
+        end
         function normalise(self, acq_data)
 %***SIRF*** Multiplies the argument by n (cf. AcquisitionModel).
 %         If self is a chain of two AcquisitionSensitivityModels, then 
@@ -0,0 +1,46 @@
+classdef CGLS < mSTIR.Solver
+% Class for the conjugate gradient solver of the least squares problem
+% min |A x - b|, A being the linear part of an acquisition model (without
+% the additive and background terms) and b acquisition data.
+
+% CCP PETMR Synergistic Image Reconstruction Framework (SIRF).
+% Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC.
+% 
+% This is software developed for the Collaborative Computational
+% Project in Positron Emission Tomography and Magnetic Resonance imaging
+% (http://www.ccppetmr.ac.uk/).
+% 
+% Licensed under the Apache License, Version 2.0 (the "License");
+% you may not use this file except in compliance with the License.
+% You may obtain a copy of the License at
+% http://www.apache.org/licenses/LICENSE-2.0
+% Unless required by applicable law or agreed to in writing, software
+% distributed under the License is distributed on an "AS IS" BASIS,
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+% See the License for the specific language governing permissions and
+% limitations under the License.
+
+    methods
+        function self = CGLS()
+            self.name = 'CGLS';
+            self.handle_ = calllib('mstir', 'mSTIR_newObject', self.name);
+            mUtilities.check_status('CGLS:ctor', self.handle_)
+        end
+        function set_acquisition_model(self, am)
+%***SIRF*** Sets the acquisition model, which must be set up.
+            mUtilities.assert_validity(am, 'AcquisitionModel')
+            mSTIR.setParameter(self.handle_, 'Solver', ...
+                'acquisition_model', am, 'h')
+        end
+        function set_acquisition_data(self, ad)
+%***SIRF*** Sets the acquisition data b (copied).
+            mUtilities.assert_validity(ad, 'AcquisitionData')
+            mSTIR.setParameter(self.handle_, 'Solver', ...
+                'acquisition_data', ad, 'h')
+        end
+        function r = get_residual_norm(self)
+%***SIRF*** Returns |b - A x| at the current estimate.
+            r = mSTIR.parameter(self.handle_, 'Solver', 'residual_norm', 'f');
+        end
+    end
+end
@@ -98,6 +98,43 @@ classdef DataContainer < handle
                 self.handle_, other.handle_);
             mUtilities.check_status('DataContainer:rdivide', z.handle_);
         end
+        function [z, r] = axpby_norm(self, a, b, y)
+%***SIRF*** [z, r] = axpby_norm(a, b, y) returns z = a*self + b*y and
+%         the 2-norm r of z, computing both in one pass over the data;
+%         a and b: real scalars
+%         y: DataContainer
+            mUtilities.assert_validities(self, y)
+            ptr_r = libpointer('singlePtr', 0);
+            z = self.same_object();
+            z.handle_ = calllib('mstir', 'mSTIR_axpbyAndNorm', ...
+                a, self.handle_, b, y.handle_, ptr_r);
+            mUtilities.check_status('DataContainer:axpby_norm', z.handle_);
+            r = ptr_r.Value;
+        end
+        function [z, r] = axpby_dot(self, a, b, y, other)
+%***SIRF*** [z, r] = axpby_dot(a, b, y, other) returns z = a*self + b*y
+%         and the dot product r of z with other, computing both in one pass
+%         over the data;
+%         a and b: real scalars
+%         y and other: DataContainers
+            mUtilities.assert_validities(self, y)
+            mUtilities.assert_validities(self, other)
+            ptr_r = libpointer('singlePtr', 0);
+            z = self.same_object();
+            z.handle_ = calllib('mstir', 'mSTIR_axpbyAndDot', ...
+                a, self.handle_, b, y.handle_, other.handle_, ptr_r);
+            mUtilities.check_status('DataContainer:axpby_dot', z.handle_);
+            r = ptr_r.Value;
+        end
+        function xapy(self, a, x)
+%***SIRF*** xapy(a, x) adds a*x to this data container in place;
+%         a: real scalar
+%         x: DataContainer
+            mUtilities.assert_validities(self, x)
+            h = calllib('mstir', 'mSTIR_xapy', self.handle_, a, x.handle_);
+            mUtilities.check_status('DataContainer:xapy', h);
+            mUtilities.delete(h)
+        end
         function z = mtimes(self, other)
 %***SIRF*** mtimes(other) overloads * for data containers multiplication 
 %         by a scalar or another data container. 
@@ -141,5 +178,39 @@ classdef DataContainer < handle
                 a, x.handle_, b, y.handle_);
             mUtilities.check_status('DataContainer:axpby', z.handle_);
         end
+        function set_num_threads(n)
+%***SIRF*** set_num_threads(n) sets the number of threads used by the data
+%         containers algebra; 0 (default) selects the size of the SIRF
+%         thread pool. Results do not depend on the number of threads.
+            mSTIR.setParameter([], 'DataContainer', 'num_threads', n, 'i')
+        end
+        function n = get_num_threads()
+%***SIRF*** Returns the number of threads used by the data containers algebra.
+            n = mSTIR.parameter([], 'DataContainer', 'num_threads', 'i');
+        end
+        function z = linear_combination(a, x)
+%***SIRF*** linear_combination(a, x) returns a(1)*x{1} + ... + a(n)*x{n};
+%         a: array of n real scalars
+%         x: cell array of n DataContainers of the same type
+            n = numel(x);
+            if n < 1 || numel(a) ~= n
+                error('DataContainer:linear_combination', ...
+                    'Wrong linear combination arguments');
+            end
+            z = x{1}.same_object();
+            if n < 2
+                z.handle_ = calllib('mstir', 'mSTIR_axpby', ...
+                    a(1), x{1}.handle_, 0.0, x{1}.handle_);
+            else
+                mUtilities.assert_validities(x{1}, x{2})
+                z.handle_ = calllib('mstir', 'mSTIR_axpby', ...
+                    a(1), x{1}.handle_, a(2), x{2}.handle_);
+            end
+            mUtilities.check_status('DataContainer:linear_combination', ...
+                z.handle_);
+            for i = 3 : n
+                z.xapy(a(i), x{i})
+            end
+        end
     end
 end
\ No newline at end of file
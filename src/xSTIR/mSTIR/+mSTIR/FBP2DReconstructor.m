@@ -68,6 +68,22 @@ classdef FBP2DReconstructor < mSTIR.Reconstructor
         function set_output_image_size_xy(self, xy)
             mSTIR.setParameter(self.handle_, self.name, 'xy', xy, 'i')
         end
+        function set_parallel(self, tf)
+%***SIRF*** Switches the parallel mode on or off (default).
+%         In the parallel mode the image planes are reconstructed
+%         concurrently by SIRF rather than by STIR: the sinograms are
+%         rebinned, filtered by a cached ramp filter and backprojected
+%         plane by plane in one pass over the data.
+            if tf
+                v = 1;
+            else
+                v = 0;
+            end
+            mSTIR.setParameter(self.handle_, self.name, 'parallel', v, 'i')
+        end
+        function tf = get_parallel(self)
+            tf = mSTIR.parameter(self.handle_, self.name, 'parallel', 'i') ~= 0;
+        end
         function set_up(self, image)
             h = calllib('mstir', 'mSTIR_setupFBP2DReconstruction', ...
                 self.handle_, image.handle_);
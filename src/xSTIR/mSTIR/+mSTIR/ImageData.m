@@ -102,6 +102,10 @@ classdef ImageData < mSTIR.DataContainer
             if numel(value) == 1
                 h = calllib('mstir', 'mSTIR_fillImage', ...
                     self.handle_, single(value));
+            elseif mUtilities.mex_available('mstir_mex')
+                mstir_mex('setImageData', ...
+                    mUtilities.handle_address(self.handle_), single(value));
+                return
             else
                 if isa(value, 'single')
                     ptr_v = libpointer('singlePtr', value);
@@ -174,6 +178,11 @@ classdef ImageData < mSTIR.DataContainer
         function data = as_array(self)
 %***SIRF*** Returns 3D array of this image values at voxels.
 
+            if mUtilities.mex_available('mstir_mex')
+                data = mstir_mex('getImageData', ...
+                    mUtilities.handle_address(self.handle_));
+                return
+            end
 %             [ptr, dim] = calllib...
 %                 ('mstir', 'mSTIR_getImageDimensions', self.handle_, zeros(3, 1));
             ptr_i = libpointer('int32Ptr', zeros(3, 1));
@@ -78,6 +78,12 @@ classdef ListmodeToSinograms < handle
             %***SIRF*** Sets the sinograms template.
             mSTIR.setParameter(self.handle_, self.name_, 'template', file, 'c')
         end
+        function set_num_threads(self, n)
+            %***SIRF*** Sets the number of threads histogramming the events.
+            % 0 uses all available threads; with more than one thread, the
+            % events are processed in parallel chunks (needs a time interval).
+            mSTIR.setParameter(self.handle_, self.name_, 'num_threads', n, 'i')
+        end
         function set_time_interval(self, start, stop)
             %***SIRF*** Sets time interval.
             % Only data scanned during this time interval will be converted.
@@ -87,6 +93,17 @@ classdef ListmodeToSinograms < handle
             mUtilities.check_status([self.name_ ':set_interval'], h);
             mUtilities.delete(h)
         end
+        function set_time_intervals(self, intervals)
+            %***SIRF*** Sets time frames given as num_frames-by-2 array
+            % of [start stop] intervals.
+            % All frames are converted in one pass through the listmode file.
+            num_frames = size(intervals, 1);
+            ptr = libpointer('singlePtr', single(intervals'));
+            h = calllib('mstir', 'mSTIR_setListmodeToSinogramsFrames', ...
+                self.handle_, ptr, num_frames);
+            mUtilities.check_status([self.name_ ':set_intervals'], h);
+            mUtilities.delete(h)
+        end
         function flag_on(self, flag)
             %***SIRF*** Switches on (sets to 'true') a conversion flag 
             % (see conversion flags description above).
@@ -119,16 +136,32 @@ classdef ListmodeToSinograms < handle
             mUtilities.check_status...
                 ([self.name_ ':process'], self.output_.handle_);
         end
-        function output = get_output(self)
+        function output = get_output(self, frame)
             %***SIRF*** Returns the sinograms.
+            % The optional argument is the number (starting from 1) of the
+            % time frame set by set_time_intervals.
             assert(~isempty(self.output_), 'Conversion to sinograms not done')
-            output = self.output_;
+            if nargin < 2
+                output = self.output_;
+                return
+            end
+            output = mSTIR.AcquisitionData();
+            output.handle_ = calllib('mstir', ...
+                'mSTIR_listmodeToSinogramsFrame', self.handle_, frame);
+            mUtilities.check_status...
+                ([self.name_ ':get_output'], output.handle_);
         end
-        function randoms = estimate_randoms(self)
+        function randoms = estimate_randoms(self, frame)
             %***SIRF*** Estimates randoms.
+            % The optional argument is the number (starting from 1) of the
+            % time frame; the delayeds fan sums are taken from process() if
+            % the 'store_fan_sums' flag is on.
+            if nargin < 2
+                frame = 1;
+            end
             randoms = mSTIR.AcquisitionData();
-            randoms.handle_ = calllib('mstir', 'mSTIR_computeRandoms', ...
-                self.handle_);
+            randoms.handle_ = calllib('mstir', 'mSTIR_computeFrameRandoms', ...
+                self.handle_, frame);
             mUtilities.check_status...
                 ([self.name_ ':estimate_randoms'], randoms.handle_);
         end
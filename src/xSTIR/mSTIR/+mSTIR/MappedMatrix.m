@@ -0,0 +1,59 @@
+classdef MappedMatrix < handle
+% Class for projection matrices precomputed from another matrix and read
+% from a memory-mapped file shared by all acquisition models and processes
+% using it (see AcquisitionModel class).
+
+% CCP PETMR Synergistic Image Reconstruction Framework (SIRF).
+% Copyright 2018 Rutherford Appleton Laboratory STFC.
+% 
+% This is software developed for the Collaborative Computational
+% Project in Positron Emission Tomography and Magnetic Resonance imaging
+% (http://www.ccppetmr.ac.uk/).
+% 
+% Licensed under the Apache License, Version 2.0 (the "License");
+% you may not use this file except in compliance with the License.
+% You may obtain a copy of the License at
+% http://www.apache.org/licenses/LICENSE-2.0
+% Unless required by applicable law or agreed to in writing, software
+% distributed under the License is distributed on an "AS IS" BASIS,
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+% See the License for the specific language governing permissions and
+% limitations under the License.
+
+    properties
+        name
+        handle_
+        source_
+    end
+    methods(Static)
+        function name = class_name()
+            name = 'MappedMatrix';
+        end
+    end
+    methods
+        function self = MappedMatrix(source, filename)
+%         Creates a MappedMatrix object.
+%         source:   the matrix to precompute, e.g. a RayTracingMatrix;
+%         filename: the file holding the precomputed matrix; it is written
+%                   at the first set-up of an acquisition model using it
+%                   and reused if the matrix, scanner data and image
+%                   geometries are the same.
+            self.name = 'MappedMatrix';
+            self.handle_ = calllib('mstir', 'mSTIR_newObject', self.name);
+            mUtilities.check_status(self.name, self.handle_)
+            mUtilities.assert_validity(source, 'RayTracingMatrix')
+            self.source_ = source;
+            mSTIR.setParameter...
+                (self.handle_, self.name, 'source', source, 'h')
+            mSTIR.setParameter...
+                (self.handle_, self.name, 'filename', filename, 'c')
+        end
+        function delete(self)
+            mUtilities.delete(self.handle_)
+        end
+        function filename = get_filename(self)
+            filename = mSTIR.parameter...
+                (self.handle_, self.name, 'filename', 'c');
+        end
+    end
+end
@@ -26,6 +26,42 @@ classdef ObjectiveFunction < handle
         function name = class_name()
             name = 'ObjectiveFunction';
         end
+        function set_sensitivity_cache(enabled, directory)
+%***SIRF*** set_sensitivity_cache(enabled, directory) enables or disables
+%         the cache of subset sensitivity images used by set_up of Poisson
+%         log-likelihood objective functions and reconstructors (enabled by
+%         default); the optional directory keeps the cached images between
+%         sessions ('' for memory only).
+            mSTIR.setParameter([], 'SensitivityCache', 'enabled', ...
+                enabled, 'i')
+            if nargin > 1
+                mSTIR.setParameter([], 'SensitivityCache', 'directory', ...
+                    directory, 'c')
+            end
+        end
+        function clear_sensitivity_cache()
+%***SIRF*** Removes the sensitivity images cached in memory.
+            mSTIR.setParameter([], 'SensitivityCache', 'clear', 1, 'i')
+        end
+        function set_gradient_threads(n, mb)
+%***SIRF*** set_gradient_threads(n, mb) sets the maximal number of subsets
+%         whose gradients are computed concurrently by get_gradient;
+%         1 (default) computes them in sequence, 0 uses all OpenMP threads.
+%         The optional mb bounds the memory (in megabytes) used by the
+%         thread-local gradient images (default 2048). More than one thread
+%         requires thread-safe projectors.
+            mSTIR.setParameter([], 'ObjectiveFunctionGradient', ...
+                'num_threads', n, 'i')
+            if nargin > 1
+                mSTIR.setParameter([], 'ObjectiveFunctionGradient', ...
+                    'memory_limit', mb, 'i')
+            end
+        end
+        function n = get_gradient_threads()
+%***SIRF*** Returns the maximal number of concurrent subset gradients.
+            n = mSTIR.parameter([], 'ObjectiveFunctionGradient', ...
+                'num_threads', 'i');
+        end
     end
     methods
         function self = ObjectiveFunction()
@@ -0,0 +1,64 @@
+classdef PDHG < mSTIR.Solver
+% Class for the primal-dual hybrid gradient solver of
+% min 1/2 |A x - b|^2 + R(x), A being the linear part of an acquisition
+% model, b acquisition data and R an optional smooth prior.
+% The step sizes sigma and tau not set are computed from |A|.
+
+% CCP PETMR Synergistic Image Reconstruction Framework (SIRF).
+% Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC.
+% 
+% This is software developed for the Collaborative Computational
+% Project in Positron Emission Tomography and Magnetic Resonance imaging
+% (http://www.ccppetmr.ac.uk/).
+% 
+% Licensed under the Apache License, Version 2.0 (the "License");
+% you may not use this file except in compliance with the License.
+% You may obtain a copy of the License at
+% http://www.apache.org/licenses/LICENSE-2.0
+% Unless required by applicable law or agreed to in writing, software
+% distributed under the License is distributed on an "AS IS" BASIS,
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+% See the License for the specific language governing permissions and
+% limitations under the License.
+
+    methods
+        function self = PDHG()
+            self.name = 'PDHG';
+            self.handle_ = calllib('mstir', 'mSTIR_newObject', self.name);
+            mUtilities.check_status('PDHG:ctor', self.handle_)
+        end
+        function set_acquisition_model(self, am)
+%***SIRF*** Sets the acquisition model, which must be set up.
+            mUtilities.assert_validity(am, 'AcquisitionModel')
+            mSTIR.setParameter(self.handle_, 'Solver', ...
+                'acquisition_model', am, 'h')
+        end
+        function set_acquisition_data(self, ad)
+%***SIRF*** Sets the acquisition data b (copied).
+            mUtilities.assert_validity(ad, 'AcquisitionData')
+            mSTIR.setParameter(self.handle_, 'Solver', ...
+                'acquisition_data', ad, 'h')
+        end
+        function set_prior(self, prior)
+%***SIRF*** Sets the prior R, which must be set up.
+            mUtilities.assert_validity(prior, 'Prior')
+            mSTIR.setParameter(self.handle_, 'Solver', 'prior', prior, 'h')
+        end
+        function set_sigma(self, sigma)
+%***SIRF*** Sets the dual step size (0 for the default).
+            mSTIR.setParameter(self.handle_, 'Solver', 'sigma', sigma, 'f')
+        end
+        function set_tau(self, tau)
+%***SIRF*** Sets the primal step size (0 for the default).
+            mSTIR.setParameter(self.handle_, 'Solver', 'tau', tau, 'f')
+        end
+        function sigma = get_sigma(self)
+%***SIRF*** Returns the dual step size used by the last run.
+            sigma = mSTIR.parameter(self.handle_, 'Solver', 'sigma', 'f');
+        end
+        function tau = get_tau(self)
+%***SIRF*** Returns the primal step size used by the last run.
+            tau = mSTIR.parameter(self.handle_, 'Solver', 'tau', 'f');
+        end
+    end
+end
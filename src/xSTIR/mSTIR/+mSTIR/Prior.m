@@ -57,9 +57,18 @@ classdef Prior < handle
             mUtilities.check_status('Prior:set_up', h)
             mUtilities.delete(h)
         end
-        function grad = get_gradient(self, image)
+        function grad = get_gradient(self, image, grad)
 %***SIRF*** Returns the value of the gradient of the prior for the specified 
-%         image.
+%         image; grad is an optional ImageData object to be overwritten
+%         with the gradient (avoids allocating a new image).
+            if nargin > 2
+                mUtilities.assert_validity(grad, 'ImageData')
+                h = calllib('mstir', 'mSTIR_priorGradientReplace', ...
+                    self.handle_, image.handle_, grad.handle_);
+                mUtilities.check_status('Prior:get_gradient', h)
+                mUtilities.delete(h)
+                return
+            end
             grad = mSTIR.ImageData();
             grad.handle_ = calllib('mstir', 'mSTIR_priorGradient', ...
                 self.handle_, image.handle_);
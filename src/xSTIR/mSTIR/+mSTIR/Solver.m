@@ -0,0 +1,79 @@
+classdef Solver < handle
+% Class for the iterative solvers running in the C++ layer.
+% The iterations are performed by run(n), which leaves the C++ layer only
+% to call the optional callback after each iteration.
+
+% CCP PETMR Synergistic Image Reconstruction Framework (SIRF).
+% Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC.
+% 
+% This is software developed for the Collaborative Computational
+% Project in Positron Emission Tomography and Magnetic Resonance imaging
+% (http://www.ccppetmr.ac.uk/).
+% 
+% Licensed under the Apache License, Version 2.0 (the "License");
+% you may not use this file except in compliance with the License.
+% You may obtain a copy of the License at
+% http://www.apache.org/licenses/LICENSE-2.0
+% Unless required by applicable law or agreed to in writing, software
+% distributed under the License is distributed on an "AS IS" BASIS,
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+% See the License for the specific language governing permissions and
+% limitations under the License.
+
+    properties
+        name
+        handle_
+    end
+    methods (Static)
+        function name = class_name()
+            name = 'Solver';
+        end
+    end
+    methods
+        function self = Solver()
+            self.handle_ = [];
+        end
+        function delete(self)
+            if ~isempty(self.handle_)
+                mUtilities.delete(self.handle_)
+                self.handle_ = [];
+            end
+        end
+        function set_initial_estimate(self, image)
+%***SIRF*** Sets the initial estimate (copied) and restarts the solver.
+            mUtilities.assert_validity(image, 'ImageData')
+            mSTIR.setParameter(self.handle_, 'Solver', ...
+                'initial_estimate', image, 'h')
+        end
+        function image = get_current_estimate(self)
+%***SIRF*** Returns a copy of the current estimate.
+            image = mSTIR.ImageData();
+            image.handle_ = calllib('mstir', 'mSTIR_parameter', ...
+                self.handle_, 'Solver', 'current_estimate');
+            mUtilities.check_status('Solver:get_current_estimate', ...
+                image.handle_)
+        end
+        function n = get_iteration(self)
+%***SIRF*** Returns the number of iterations performed.
+            n = mSTIR.parameter(self.handle_, 'Solver', 'iteration', 'i');
+        end
+        function run(self, n, callback)
+%***SIRF*** run(n, callback) performs n iterations; the optional callback
+%         is called after each of them with the iteration number and the
+%         current estimate, which requires one call to the C++ layer per
+%         iteration.
+            if nargin < 3
+                h = calllib('mstir', 'mSTIR_runSolver', self.handle_, n);
+                mUtilities.check_status('Solver:run', h)
+                mUtilities.delete(h)
+                return
+            end
+            for i = 1 : n
+                h = calllib('mstir', 'mSTIR_runSolver', self.handle_, 1);
+                mUtilities.check_status('Solver:run', h)
+                mUtilities.delete(h)
+                callback(self.get_iteration(), self.get_current_estimate())
+            end
+        end
+    end
+end
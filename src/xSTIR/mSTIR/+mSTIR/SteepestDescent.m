@@ -0,0 +1,58 @@
+classdef SteepestDescent < mSTIR.Solver
+% Class for the steepest descent solver minimising either minus an
+% objective function or the least squares misfit 1/2 |A x - b|^2 defined
+% by an acquisition model and acquisition data.
+% The step is exact for the least squares misfit, set by set_step_size
+% or found by backtracking line search otherwise.
+
+% CCP PETMR Synergistic Image Reconstruction Framework (SIRF).
+% Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC.
+% 
+% This is software developed for the Collaborative Computational
+% Project in Positron Emission Tomography and Magnetic Resonance imaging
+% (http://www.ccppetmr.ac.uk/).
+% 
+% Licensed under the Apache License, Version 2.0 (the "License");
+% you may not use this file except in compliance with the License.
+% You may obtain a copy of the License at
+% http://www.apache.org/licenses/LICENSE-2.0
+% Unless required by applicable law or agreed to in writing, software
+% distributed under the License is distributed on an "AS IS" BASIS,
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+% See the License for the specific language governing permissions and
+% limitations under the License.
+
+    methods
+        function self = SteepestDescent()
+            self.name = 'SteepestDescent';
+            self.handle_ = calllib('mstir', 'mSTIR_newObject', self.name);
+            mUtilities.check_status('SteepestDescent:ctor', self.handle_)
+        end
+        function set_objective_function(self, obj_fun)
+%***SIRF*** Sets the objective function, which must be set up.
+            mUtilities.assert_validity(obj_fun, 'ObjectiveFunction')
+            mSTIR.setParameter(self.handle_, 'Solver', ...
+                'objective_function', obj_fun, 'h')
+        end
+        function set_acquisition_model(self, am)
+%***SIRF*** Sets the acquisition model of the least squares misfit.
+            mUtilities.assert_validity(am, 'AcquisitionModel')
+            mSTIR.setParameter(self.handle_, 'Solver', ...
+                'acquisition_model', am, 'h')
+        end
+        function set_acquisition_data(self, ad)
+%***SIRF*** Sets the acquisition data of the least squares misfit.
+            mUtilities.assert_validity(ad, 'AcquisitionData')
+            mSTIR.setParameter(self.handle_, 'Solver', ...
+                'acquisition_data', ad, 'h')
+        end
+        function set_step_size(self, t)
+%***SIRF*** Sets a fixed step size (0 for line search).
+            mSTIR.setParameter(self.handle_, 'Solver', 'step_size', t, 'f')
+        end
+        function t = get_step_size(self)
+%***SIRF*** Returns the step taken by the last iteration.
+            t = mSTIR.parameter(self.handle_, 'Solver', 'step_size', 'f');
+        end
+    end
+end
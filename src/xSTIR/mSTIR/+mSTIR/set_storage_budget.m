@@ -0,0 +1,30 @@
+function set_storage_budget(limit_mb, scratch_directory)
+% Sets the memory budget (in MB, 0 for none) of the acquisition data stored
+% by the 'hybrid' scheme (see AcquisitionData.set_storage_scheme) and,
+% optionally, the directory of the scratch files (e.g. on a local NVMe
+% drive or tmpfs), which is also used by the 'file' scheme.
+
+
+% CCP PETMR Synergistic Image Reconstruction Framework (SIRF).
+% Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC.
+% 
+% This is software developed for the Collaborative Computational
+% Project in Positron Emission Tomography and Magnetic Resonance imaging
+% (http://www.ccppetmr.ac.uk/).
+% 
+% Licensed under the Apache License, Version 2.0 (the "License");
+% you may not use this file except in compliance with the License.
+% You may obtain a copy of the License at
+% http://www.apache.org/licenses/LICENSE-2.0
+% Unless required by applicable law or agreed to in writing, software
+% distributed under the License is distributed on an "AS IS" BASIS,
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+% See the License for the specific language governing permissions and
+% limitations under the License.
+
+mSTIR.setParameter([], 'StorageBudget', 'limit', limit_mb, 'i')
+if nargin > 1
+    mSTIR.setParameter([], 'StorageBudget', 'scratch_directory', ...
+        scratch_directory, 'c')
+end
+end
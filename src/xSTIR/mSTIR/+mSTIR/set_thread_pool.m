@@ -0,0 +1,35 @@
+function set_thread_pool(num_threads, affinity)
+% Configures the thread pool shared by the parallel loops of the SIRF C++
+% layer: num_threads is the number of threads, the calling one included
+% (0 selects SIRF_NUM_THREADS, else OMP_NUM_THREADS, else the number of
+% hardware threads), affinity their placement, 'none' (default), 'compact'
+% (NUMA nodes filled in turn) or 'scatter' (threads spread round the NUMA
+% nodes).
+% The OpenMP regions of SIRF, and those of STIR entered from the calling
+% thread, get the same number of threads.
+
+
+% CCP PETMR Synergistic Image Reconstruction Framework (SIRF).
+% Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC.
+% 
+% This is software developed for the Collaborative Computational
+% Project in Positron Emission Tomography and Magnetic Resonance imaging
+% (http://www.ccppetmr.ac.uk/).
+% 
+% Licensed under the Apache License, Version 2.0 (the "License");
+% you may not use this file except in compliance with the License.
+% You may obtain a copy of the License at
+% http://www.apache.org/licenses/LICENSE-2.0
+% Unless required by applicable law or agreed to in writing, software
+% distributed under the License is distributed on an "AS IS" BASIS,
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+% See the License for the specific language governing permissions and
+% limitations under the License.
+
+if nargin < 2
+    affinity = 'none';
+end
+h = calllib('mstir', 'mSTIR_setThreadPool', num_threads, affinity);
+mUtilities.check_status('set_thread_pool', h);
+mUtilities.delete(h)
+end
@@ -0,0 +1,28 @@
+function warm_up()
+% Pays the one-off costs of the first use of the PET engine (the acquisition
+% data template, the image file format registries) before the first
+% reconstruction, e.g. in a worker started ahead of its jobs; does not start
+% any threads.
+
+
+% CCP PETMR Synergistic Image Reconstruction Framework (SIRF).
+% Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC.
+% 
+% This is software developed for the Collaborative Computational
+% Project in Positron Emission Tomography and Magnetic Resonance imaging
+% (http://www.ccppetmr.ac.uk/).
+% 
+% Licensed under the Apache License, Version 2.0 (the "License");
+% you may not use this file except in compliance with the License.
+% You may obtain a copy of the License at
+% http://www.apache.org/licenses/LICENSE-2.0
+% Unless required by applicable law or agreed to in writing, software
+% distributed under the License is distributed on an "AS IS" BASIS,
+% WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+% See the License for the specific language governing permissions and
+% limitations under the License.
+
+h = calllib('mstir', 'mSTIR_warmUp');
+mUtilities.check_status('warm_up', h);
+mUtilities.delete(h)
+end
@@ -48,9 +48,21 @@ EXPORTED_FUNCTION 	void* mSTIR_setParameter (void* ptr, const char* obj, const c
 EXPORTED_FUNCTION 	void* mSTIR_parameter(const void* ptr, const char* obj, const char* name) {
 	return cSTIR_parameter(ptr, obj, name);
 }
+EXPORTED_FUNCTION 	void* mSTIR_parameterId(const char* obj, const char* name, int type) {
+	return cSTIR_parameterId(obj, name, type);
+}
+EXPORTED_FUNCTION 	void* mSTIR_setParameterById(void* ptr, int id, double value) {
+	return cSTIR_setParameterById(ptr, id, value);
+}
+EXPORTED_FUNCTION 	void* mSTIR_setParameters (void* ptr, int n, PTR_INT ptr_ids, PTR_DOUBLE ptr_values) {
+	return cSTIR_setParameters (ptr, n, ptr_ids, ptr_values);
+}
 EXPORTED_FUNCTION 	void* mSTIR_setListmodeToSinogramsInterval (void* ptr_acq, PTR_FLOAT ptr_data) {
 	return cSTIR_setListmodeToSinogramsInterval (ptr_acq, ptr_data);
 }
+EXPORTED_FUNCTION 	void* mSTIR_setListmodeToSinogramsFrames (void* ptr_lm2s, PTR_FLOAT ptr_data, int num_frames) {
+	return cSTIR_setListmodeToSinogramsFrames (ptr_lm2s, ptr_data, num_frames);
+}
 EXPORTED_FUNCTION 	void* mSTIR_setListmodeToSinogramsFlag (void* ptr_lm2s, const char* flag, int v) {
 	return cSTIR_setListmodeToSinogramsFlag (ptr_lm2s, flag, v);
 }
@@ -60,9 +72,15 @@ EXPORTED_FUNCTION 	void* mSTIR_setupListmodeToSinogramsConverter(void* ptr) {
 EXPORTED_FUNCTION 	void* mSTIR_convertListmodeToSinograms(void* ptr) {
 	return cSTIR_convertListmodeToSinograms(ptr);
 }
+EXPORTED_FUNCTION 	void* mSTIR_listmodeToSinogramsFrame(void* ptr, int frame) {
+	return cSTIR_listmodeToSinogramsFrame(ptr, frame);
+}
 EXPORTED_FUNCTION 	void* mSTIR_computeRandoms(void* ptr) {
 	return cSTIR_computeRandoms(ptr);
 }
+EXPORTED_FUNCTION 	void* mSTIR_computeFrameRandoms(void* ptr, int frame) {
+	return cSTIR_computeFrameRandoms(ptr, frame);
+}
 EXPORTED_FUNCTION 	void* mSTIR_applyImageDataProcessor(const void* ptr_p, void* ptr_d) {
 	return cSTIR_applyImageDataProcessor(ptr_p, ptr_d);
 }
@@ -93,6 +111,9 @@ EXPORTED_FUNCTION 	void* mSTIR_acquisitionModelFwdReplace (void* ptr_am, void* p
 EXPORTED_FUNCTION 	void* mSTIR_acquisitionModelBwd(void* ptr_am, void* ptr_ad, int subset_num, int num_subsets) {
 	return cSTIR_acquisitionModelBwd(ptr_am, ptr_ad, subset_num, num_subsets);
 }
+EXPORTED_FUNCTION 	void* mSTIR_acquisitionModelBwdReplace(void* ptr_am, void* ptr_ad, int subset_num, int num_subsets, void* ptr_im) {
+	return cSTIR_acquisitionModelBwdReplace(ptr_am, ptr_ad, subset_num, num_subsets, ptr_im);
+}
 EXPORTED_FUNCTION 	void* mSTIR_getAcquisitionsStorageScheme() {
 	return cSTIR_getAcquisitionsStorageScheme();
 }
@@ -102,6 +123,9 @@ EXPORTED_FUNCTION 	void* mSTIR_setAcquisitionsStorageScheme(const char* scheme)
 EXPORTED_FUNCTION 	void* mSTIR_acquisitionsDataFromTemplate(void* ptr_t) {
 	return cSTIR_acquisitionsDataFromTemplate(ptr_t);
 }
+EXPORTED_FUNCTION 	void* mSTIR_reducedPrecisionAcquisitionData(void* ptr_t, const char* format) {
+	return cSTIR_reducedPrecisionAcquisitionData(ptr_t, format);
+}
 EXPORTED_FUNCTION 	void* mSTIR_rebinnedAcquisitionData(void* ptr_t, const int num_segments_to_combine, const int num_views_to_combine, const int num_tang_poss_to_trim, const bool do_normalisation, const int max_in_segment_num_to_process ) {
 	return cSTIR_rebinnedAcquisitionData(ptr_t, num_segments_to_combine, num_views_to_combine, num_tang_poss_to_trim, do_normalisation, max_in_segment_num_to_process);
 }
@@ -162,6 +186,9 @@ EXPORTED_FUNCTION 	void* mSTIR_setupPrior(void* ptr_p, void* ptr_i) {
 EXPORTED_FUNCTION 	void* mSTIR_priorGradient(void* ptr_p, void* ptr_i) {
 	return cSTIR_priorGradient(ptr_p, ptr_i);
 }
+EXPORTED_FUNCTION 	void* mSTIR_priorGradientReplace(void* ptr_p, void* ptr_i, void* ptr_g) {
+	return cSTIR_priorGradientReplace(ptr_p, ptr_i, ptr_g);
+}
 EXPORTED_FUNCTION 	void* mSTIR_getImageDimensions(const void* ptr, PTR_INT ptr_data) {
 	return cSTIR_getImageDimensions(ptr, ptr_data);
 }
@@ -207,12 +234,42 @@ EXPORTED_FUNCTION 	void*	mSTIR_dot(const void* ptr_x, const void* ptr_y) {
 EXPORTED_FUNCTION 	void* mSTIR_axpby(float a, const void* ptr_x, float b, const void* ptr_y) {
 	return cSTIR_axpby(a, ptr_x, b, ptr_y);
 }
+EXPORTED_FUNCTION 	void* mSTIR_axpbyAndNorm(float a, const void* ptr_x, float b, const void* ptr_y, PTR_FLOAT ptr_norm) {
+	return cSTIR_axpbyAndNorm(a, ptr_x, b, ptr_y, ptr_norm);
+}
+EXPORTED_FUNCTION 	void* mSTIR_axpbyAndDot(float a, const void* ptr_x, float b, const void* ptr_y, const void* ptr_z, PTR_FLOAT ptr_dot) {
+	return cSTIR_axpbyAndDot(a, ptr_x, b, ptr_y, ptr_z, ptr_dot);
+}
+EXPORTED_FUNCTION 	void* mSTIR_xapy(void* ptr_y, float a, const void* ptr_x) {
+	return cSTIR_xapy(ptr_y, a, ptr_x);
+}
 EXPORTED_FUNCTION 	void* mSTIR_multiply(const void* ptr_x, const void* ptr_y) {
 	return cSTIR_multiply(ptr_x, ptr_y);
 }
 EXPORTED_FUNCTION 	void* mSTIR_divide(const void* ptr_x, const void* ptr_y) {
 	return cSTIR_divide(ptr_x, ptr_y);
 }
+EXPORTED_FUNCTION 	void* mSTIR_profiler(const char* format) {
+	return cSTIR_profiler(format);
+}
+EXPORTED_FUNCTION 	void* mSTIR_setProfiler(int enabled, int tracing) {
+	return cSTIR_setProfiler(enabled, tracing);
+}
+EXPORTED_FUNCTION 	void* mSTIR_resetProfiler() {
+	return cSTIR_resetProfiler();
+}
+EXPORTED_FUNCTION 	void* mSTIR_setThreadPool(int num_threads, const char* affinity) {
+	return cSTIR_setThreadPool(num_threads, affinity);
+}
+EXPORTED_FUNCTION 	void* mSTIR_threadPoolSize() {
+	return cSTIR_threadPoolSize();
+}
+EXPORTED_FUNCTION 	void* mSTIR_warmUp() {
+	return cSTIR_warmUp();
+}
+EXPORTED_FUNCTION 	void* mSTIR_runSolver(void* ptr, int n_iter) {
+	return cSTIR_runSolver(ptr, n_iter);
+}
 EXPORTED_FUNCTION 	void* mNewTextPrinter(const char* stream) {
 	return newTextPrinter(stream);
 }
@@ -39,11 +39,17 @@ EXPORTED_FUNCTION  void* mSTIR_newObject(const char* name);
 EXPORTED_FUNCTION 	void* mSTIR_objectFromFile(const char* name, const char* filename);
 EXPORTED_FUNCTION 	void* mSTIR_setParameter (void* ptr, const char* obj, const char* name, const void* value);
 EXPORTED_FUNCTION 	void* mSTIR_parameter(const void* ptr, const char* obj, const char* name);
+EXPORTED_FUNCTION 	void* mSTIR_parameterId(const char* obj, const char* name, int type);
+EXPORTED_FUNCTION 	void* mSTIR_setParameterById(void* ptr, int id, double value);
+EXPORTED_FUNCTION 	void* mSTIR_setParameters (void* ptr, int n, PTR_INT ptr_ids, PTR_DOUBLE ptr_values);
 EXPORTED_FUNCTION 	void* mSTIR_setListmodeToSinogramsInterval (void* ptr_acq, PTR_FLOAT ptr_data);
+EXPORTED_FUNCTION 	void* mSTIR_setListmodeToSinogramsFrames (void* ptr_lm2s, PTR_FLOAT ptr_data, int num_frames);
 EXPORTED_FUNCTION 	void* mSTIR_setListmodeToSinogramsFlag (void* ptr_lm2s, const char* flag, int v);
 EXPORTED_FUNCTION 	void* mSTIR_setupListmodeToSinogramsConverter(void* ptr);
 EXPORTED_FUNCTION 	void* mSTIR_convertListmodeToSinograms(void* ptr);
+EXPORTED_FUNCTION 	void* mSTIR_listmodeToSinogramsFrame(void* ptr, int frame);
 EXPORTED_FUNCTION 	void* mSTIR_computeRandoms(void* ptr);
+EXPORTED_FUNCTION 	void* mSTIR_computeFrameRandoms(void* ptr, int frame);
 EXPORTED_FUNCTION 	void* mSTIR_applyImageDataProcessor(const void* ptr_p, void* ptr_d);
 EXPORTED_FUNCTION 	void* mSTIR_createPETAcquisitionSensitivityModel (const void* ptr_src, const char* src);
 EXPORTED_FUNCTION 	void* mSTIR_createPETAttenuationModel (const void* ptr_img, const void* ptr_am);
@@ -54,9 +60,11 @@ EXPORTED_FUNCTION 	void* mSTIR_setupAcquisitionModel(void* ptr_am, void* ptr_dt,
 EXPORTED_FUNCTION 	void* mSTIR_acquisitionModelFwd(void* ptr_am, void* ptr_im,  int subset_num, int num_subsets);
 EXPORTED_FUNCTION 	void* mSTIR_acquisitionModelFwdReplace (void* ptr_am, void* ptr_im, int subset_num, int num_subsets, void* ptr_ad);
 EXPORTED_FUNCTION 	void* mSTIR_acquisitionModelBwd(void* ptr_am, void* ptr_ad, int subset_num, int num_subsets);
+EXPORTED_FUNCTION 	void* mSTIR_acquisitionModelBwdReplace(void* ptr_am, void* ptr_ad, int subset_num, int num_subsets, void* ptr_im);
 EXPORTED_FUNCTION 	void* mSTIR_getAcquisitionsStorageScheme();
 EXPORTED_FUNCTION 	void* mSTIR_setAcquisitionsStorageScheme(const char* scheme);
 EXPORTED_FUNCTION 	void* mSTIR_acquisitionsDataFromTemplate(void* ptr_t);
+EXPORTED_FUNCTION 	void* mSTIR_reducedPrecisionAcquisitionData(void* ptr_t, const char* format);
 EXPORTED_FUNCTION 	void* mSTIR_rebinnedAcquisitionData(void* ptr_t, const int num_segments_to_combine, const int num_views_to_combine, const int num_tang_poss_to_trim, const bool do_normalisation, const int max_in_segment_num_to_process );
 EXPORTED_FUNCTION 	void* mSTIR_acquisitionsDataFromScannerInfo (const char* scanner, int span, int max_ring_diff, int view_mash_factor);
 EXPORTED_FUNCTION 	void* mSTIR_getAcquisitionsDimensions(const void* ptr_acq, PTR_INT ptr_dim);
@@ -77,6 +85,7 @@ EXPORTED_FUNCTION 	void* mSTIR_objectiveFunctionGradient (void* ptr_f, void* ptr
 EXPORTED_FUNCTION 	void* mSTIR_objectiveFunctionGradientNotDivided (void* ptr_f, void* ptr_i, int subset);
 EXPORTED_FUNCTION 	void* mSTIR_setupPrior(void* ptr_p, void* ptr_i);
 EXPORTED_FUNCTION 	void* mSTIR_priorGradient(void* ptr_p, void* ptr_i);
+EXPORTED_FUNCTION 	void* mSTIR_priorGradientReplace(void* ptr_p, void* ptr_i, void* ptr_g);
 EXPORTED_FUNCTION 	void* mSTIR_getImageDimensions(const void* ptr, PTR_INT ptr_data);
 EXPORTED_FUNCTION 	void* mSTIR_getImageVoxelSizes(const void* ptr_im, PTR_FLOAT ptr_vs);
 EXPORTED_FUNCTION 	void* mSTIR_getImageData(const void* ptr, PTR_FLOAT ptr_data);
@@ -92,8 +101,18 @@ EXPORTED_FUNCTION 	void* mSTIR_writeImage(void* ptr_i, const char* filename);
 EXPORTED_FUNCTION 	void* mSTIR_norm(const void* ptr_x);
 EXPORTED_FUNCTION 	void*	mSTIR_dot(const void* ptr_x, const void* ptr_y);
 EXPORTED_FUNCTION 	void* mSTIR_axpby(float a, const void* ptr_x, float b, const void* ptr_y);
+EXPORTED_FUNCTION 	void* mSTIR_axpbyAndNorm(float a, const void* ptr_x, float b, const void* ptr_y, PTR_FLOAT ptr_norm);
+EXPORTED_FUNCTION 	void* mSTIR_axpbyAndDot(float a, const void* ptr_x, float b, const void* ptr_y, const void* ptr_z, PTR_FLOAT ptr_dot);
+EXPORTED_FUNCTION 	void* mSTIR_xapy(void* ptr_y, float a, const void* ptr_x);
 EXPORTED_FUNCTION 	void* mSTIR_multiply(const void* ptr_x, const void* ptr_y);
 EXPORTED_FUNCTION 	void* mSTIR_divide(const void* ptr_x, const void* ptr_y);
+EXPORTED_FUNCTION 	void* mSTIR_profiler(const char* format);
+EXPORTED_FUNCTION 	void* mSTIR_setProfiler(int enabled, int tracing);
+EXPORTED_FUNCTION 	void* mSTIR_resetProfiler();
+EXPORTED_FUNCTION 	void* mSTIR_setThreadPool(int num_threads, const char* affinity);
+EXPORTED_FUNCTION 	void* mSTIR_threadPoolSize();
+EXPORTED_FUNCTION 	void* mSTIR_warmUp();
+EXPORTED_FUNCTION 	void* mSTIR_runSolver(void* ptr, int n_iter);
 EXPORTED_FUNCTION 	void* mNewTextPrinter(const char* stream);
 EXPORTED_FUNCTION 	void* mNewTextWriter(const char* stream);
 EXPORTED_FUNCTION 	void mOpenChannel(int channel, void* ptr_w);
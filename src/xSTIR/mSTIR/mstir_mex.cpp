@@ -0,0 +1,140 @@
+/*
+CCP PETMR Synergistic Image Reconstruction Framework (SIRF)
+Copyright 2015 - 2017 Rutherford Appleton Laboratory STFC
+This is software developed for the Collaborative Computational
+Project in Positron Emission Tomography and Magnetic Resonance imaging
+(http://www.ccppetmr.ac.uk/).
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*
+MEX gateway moving data between Matlab arrays and STIR containers.
+
+Called as mstir_mex(command, address, ...), where address is the value of
+mUtilities.handle_address for the container handle:
+
+data = mstir_mex('getImageData', address)
+mstir_mex('setImageData', address, data)
+data = mstir_mex('getAcquisitionsData', address)
+mstir_mex('setAcquisitionsData', address, data)
+
+The data is copied by the engine directly into a newly created output array
+or from the buffer of the input array (which must be single and of the size
+of the container), with no intermediate libpointer copies.
+*/
+
+#include <string.h>
+#include <string>
+
+#include <mex.h>
+#include "matrix.h"
+
+#include "cstir.h"
+#include "iutilities.h"
+
+static void*
+handle_(const mxArray* a)
+{
+	if (!mxIsNumeric(a) || mxGetNumberOfElements(a) != 1)
+		mexErrMsgIdAndTxt("mstir_mex:handle", "handle address expected");
+	return (void*)(size_t)mxGetScalar(a);
+}
+
+// raises a Matlab error if h carries one, deletes h otherwise
+static void
+check_(void* h)
+{
+	if (executionStatus(h) == 0) {
+		deleteDataHandle(h);
+		return;
+	}
+	std::string msg = executionError(h);
+	msg += " (";
+	msg += executionErrorFile(h);
+	msg += ")";
+	deleteDataHandle(h);
+	mexErrMsgIdAndTxt("mstir_mex:engine", "%s", msg.c_str());
+}
+
+static const float*
+single_input_(const mxArray* a, size_t n)
+{
+	if (!mxIsSingle(a) || mxIsComplex(a))
+		mexErrMsgIdAndTxt("mstir_mex:data", "real single array expected");
+	if (mxGetNumberOfElements(a) != n)
+		mexErrMsgIdAndTxt("mstir_mex:data", "wrong data size");
+	return (const float*)mxGetData(a);
+}
+
+static void
+image_dimensions_(void* ptr, mwSize* dim)
+{
+	int idim[3];
+	check_(cSTIR_getImageDimensions(ptr, (size_t)idim));
+	// Matlab arrays have x running fastest
+	dim[0] = idim[2];
+	dim[1] = idim[1];
+	dim[2] = idim[0];
+}
+
+static void
+acquisitions_dimensions_(void* ptr, mwSize* dim)
+{
+	int idim[3];
+	check_(cSTIR_getAcquisitionsDimensions(ptr, (size_t)idim));
+	dim[0] = idim[0];
+	dim[1] = idim[1];
+	dim[2] = idim[2];
+}
+
+void
+mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[])
+{
+	if (nrhs < 2 || !mxIsChar(prhs[0]))
+		mexErrMsgIdAndTxt("mstir_mex:usage",
+		"usage: mstir_mex(command, address, ...)");
+	char cmd[64];
+	mxGetString(prhs[0], cmd, sizeof(cmd));
+	void* ptr = handle_(prhs[1]);
+	mwSize dim[3];
+	if (strcmp(cmd, "getImageData") == 0 ||
+		strcmp(cmd, "getAcquisitionsData") == 0) {
+		bool image = strcmp(cmd, "getImageData") == 0;
+		if (image)
+			image_dimensions_(ptr, dim);
+		else
+			acquisitions_dimensions_(ptr, dim);
+		mxArray* a = mxCreateNumericArray(3, dim, mxSINGLE_CLASS, mxREAL);
+		size_t data = (size_t)mxGetData(a);
+		if (image)
+			check_(cSTIR_getImageData(ptr, data));
+		else
+			check_(cSTIR_getAcquisitionsData(ptr, data));
+		plhs[0] = a;
+	}
+	else if (strcmp(cmd, "setImageData") == 0 ||
+		strcmp(cmd, "setAcquisitionsData") == 0) {
+		if (nrhs < 3)
+			mexErrMsgIdAndTxt("mstir_mex:usage", "data expected");
+		bool image = strcmp(cmd, "setImageData") == 0;
+		if (image)
+			image_dimensions_(ptr, dim);
+		else
+			acquisitions_dimensions_(ptr, dim);
+		const float* data = single_input_(prhs[2], dim[0] * dim[1] * dim[2]);
+		if (image)
+			check_(cSTIR_setImageData(ptr, (size_t)data));
+		else
+			check_(cSTIR_setAcquisitionsData(ptr, (size_t)data));
+	}
+	else
+		mexErrMsgIdAndTxt("mstir_mex:usage", "unknown command %s", cmd);
+}
@@ -32,7 +32,7 @@ extern "C" {
     //mexPrintf("deleting mexTextPrinter...");
 		delete (mexTextPrinter*)ptr;
     //mexPrintf("ok\n");
-		return new DataHandle;
+		return okHandle();
 	}
 }
 
@@ -31,6 +31,7 @@ except:
     HAVE_PYLAB = False
 import sys
 import time
+import weakref
 
 from pUtilities import *
 import pyiutilities as pyiutil
@@ -64,13 +65,49 @@ def _set_char_par(handle, set, par, value):
     h = pyiutil.charDataHandle(value)
     _setParameter(handle, set, par, h, inspect.stack()[1])
     pyiutil.deleteDataHandle(h)
-def _set_int_par(handle, set, par, value):
-    h = pyiutil.intDataHandle(value)
-    _setParameter(handle, set, par, h, inspect.stack()[1])
+# numeric parameter types and ids of (class, parameter, type), resolved by
+# the engine on the first use
+_PARAMETER_INT = 0
+_PARAMETER_FLOAT = 1
+_parameter_ids = {}
+def _parameter_id(set, par, type):
+    key = (set, par, type)
+    id = _parameter_ids.get(key)
+    if id is None:
+        h = pystir.cSTIR_parameterId(set, par, type)
+        check_status(h, inspect.stack()[2])
+        id = pyiutil.intDataFromHandle(h)
+        pyiutil.deleteDataHandle(h)
+        _parameter_ids[key] = id
+    return id
+def _set_numeric_par(handle, id, value):
+    h = pystir.cSTIR_setParameterById(handle, id, value)
+    if pyiutil.executionStatus(h) != 0:
+        check_status(h, inspect.stack()[2])
     pyiutil.deleteDataHandle(h)
+def _set_int_par(handle, set, par, value):
+    _set_numeric_par(handle, _parameter_id(set, par, _PARAMETER_INT), value)
 def _set_float_par(handle, set, par, value):
-    h = pyiutil.floatDataHandle(value)
-    _setParameter(handle, set, par, h, inspect.stack()[1])
+    _set_numeric_par(handle, _parameter_id(set, par, _PARAMETER_FLOAT), value)
+def _set_pars(handle, set, pars):
+    '''
+    Sets several numeric parameters of the same class in one call;
+    pars is a dictionary of parameter values, ints being set as int
+    parameters and other numbers as float ones.
+    '''
+    n = len(pars)
+    ids = numpy.ndarray((n,), dtype = numpy.int32)
+    values = numpy.ndarray((n,), dtype = numpy.float64)
+    for i, (par, value) in enumerate(pars.items()):
+        if isinstance(value, (bool, int, numpy.integer)):
+            type = _PARAMETER_INT
+        else:
+            type = _PARAMETER_FLOAT
+        ids[i] = _parameter_id(set, par, type)
+        values[i] = value
+    h = pystir.cSTIR_setParameters\
+        (handle, n, ids.ctypes.data, values.ctypes.data)
+    check_status(h, inspect.stack()[1])
     pyiutil.deleteDataHandle(h)
 def _char_par(handle, set, par):
     h = pystir.cSTIR_parameter(handle, set, par)
@@ -98,6 +135,99 @@ def _tmp_filename():
     return repr(int(1000*time.time()))
 ###########################################################
 
+def profiler():
+    '''
+    Returns the Profiler of the PET engine hot paths, e.g.
+    profiler().reset(); ...; print(profiler().text())
+    '''
+    return Profiler(pystir, 'cSTIR')
+
+def set_thread_pool(num_threads = 0, affinity = 'none'):
+    '''
+    Configures the thread pool shared by the parallel loops of the SIRF
+    C++ layer; the OpenMP regions of SIRF, and those of STIR entered from
+    the calling thread, get the same number of threads.
+    num_threads: the number of threads, the calling one included; 0 selects
+                 SIRF_NUM_THREADS, else OMP_NUM_THREADS, else the number of
+                 hardware threads
+    affinity: placement of the threads, 'none' (default), 'compact' (NUMA
+              nodes filled in turn) or 'scatter' (threads spread round the
+              NUMA nodes)
+    '''
+    try_calling(pystir.cSTIR_setThreadPool(int(num_threads), affinity))
+
+def thread_pool_size():
+    '''
+    Returns the number of threads of the SIRF thread pool.
+    '''
+    h = pystir.cSTIR_threadPoolSize()
+    check_status(h)
+    n = pyiutil.intDataFromHandle(h)
+    pyiutil.deleteDataHandle(h)
+    return n
+
+def warm_up():
+    '''
+    Pays the one-off costs of the first use of the module (the acquisition
+    data template, the image file format registries), so that processes
+    forked afterwards, e.g. by a multiprocessing pool of workers, do not
+    pay them; does not start any threads.
+    '''
+    try_calling(pystir.cSTIR_warmUp())
+
+def set_mpi_distribution(enabled = True):
+    '''
+    Enables or disables the distribution of PET subset computations over
+    MPI processes (SIRF must be built with SIRF_MPI). While enabled and
+    running in more than one process, e.g.
+        mpirun -n 4 python script.py
+    with script.py importing mpi4py before sirf.STIR, the objective function
+    values and full gradients are computed by the processes for every
+    size-th subset and the backprojections of acquisition models for every
+    size-th view, and the results are summed over the processes by
+    MPI_Allreduce; the image is taken from process 0. Each process
+    must run the same sequence of calls; forward projections are computed
+    by every process in full. MPI is initialised here if mpi4py has not
+    done it.
+    '''
+    _set_int_par(None, 'Distributed', 'enabled', int(enabled))
+
+def mpi_rank():
+    '''
+    Returns the number of this MPI process, 0 without MPI.
+    '''
+    return _int_par(None, 'Distributed', 'rank')
+
+def mpi_size():
+    '''
+    Returns the number of MPI processes, 1 without MPI.
+    '''
+    return _int_par(None, 'Distributed', 'size')
+
+def set_storage_budget(limit_mb, scratch_directory = None):
+    '''
+    Sets the memory budget (in MB, 0 for none) of the acquisition data
+    stored by the 'hybrid' scheme (see AcquisitionData.set_storage_scheme)
+    and, optionally, the directory of the scratch files (e.g. on a local
+    NVMe drive or tmpfs), which is also used by the 'file' scheme.
+    '''
+    _set_int_par(None, 'StorageBudget', 'limit', limit_mb)
+    if scratch_directory is not None:
+        _set_char_par(None, 'StorageBudget', 'scratch_directory', \
+                      scratch_directory)
+
+def storage_usage():
+    '''
+    Returns the numbers of bytes of the 'hybrid' acquisition data of this
+    process currently resident in memory and spilled to scratch files.
+    '''
+    usage = []
+    for par in ('resident_bytes', 'spilled_bytes'):
+        h = _getParameterHandle(None, 'StorageBudget', par)
+        usage.append(int(pyiutil.doubleDataFromHandle(h)))
+        pyiutil.deleteDataHandle(h)
+    return tuple(usage)
+
 class MessageRedirector:
     '''
     Class for STIR printing redirection to files/stdout/stderr.
@@ -178,9 +308,8 @@ class Shape:
         '''
         Sets the (discrete) coordinates of the shape centre on a voxel grid.
         '''
-        _set_float_par(self.handle, 'Shape', 'x', origin[0])
-        _set_float_par(self.handle, 'Shape', 'y', origin[1])
-        _set_float_par(self.handle, 'Shape', 'z', origin[2])
+        _set_pars(self.handle, 'Shape', {'x': float(origin[0]), \
+            'y': float(origin[1]), 'z': float(origin[2])})
     def get_origin(self):
         '''
         Returns the coordinates of the shape centre on a voxel grid.
@@ -215,8 +344,8 @@ class EllipticCylinder(Shape):
     def get_radius_y(self):
         return _float_par(self.handle, self.name, 'radius_y')
     def set_radii(self, radii):
-        _set_float_par(self.handle, self.name, 'radius_x', radii[0])
-        _set_float_par(self.handle, self.name, 'radius_y', radii[1])
+        _set_pars(self.handle, self.name, \
+            {'radius_x': float(radii[0]), 'radius_y': float(radii[1])})
     def get_radii(self):
         rx = _float_par(self.handle, self.name, 'radius_x')
         ry = _float_par(self.handle, self.name, 'radius_y')
@@ -225,12 +354,104 @@ class EllipticCylinder(Shape):
 class DataContainer(ABC):
     '''
     Abstract base class for an abstract data container.
+
+    The results of +, - and multiplication and division by scalars are
+    deferred: they hold an expression over their operands, which is
+    evaluated in one pass when their data is first needed, and dot() and
+    norm() of such results need not evaluate it at all. An operand hands
+    out its handle only after evaluating the deferred results that refer
+    to it, so that they are not affected by changes to it (except changes
+    made via an ndarray returned by as_array(copy = False)).
     '''
+    # the handle of the C++ DataContainerExpression of a deferred result,
+    # the weak references to the containers it refers to, and the deferred
+    # results referring to this container
+    _handle = None
+    _expression = None
+    _leaves = ()
+    _dependents = None
     def __init__(self):
         self.handle = None
     def __del__(self):
-        if self.handle is not None:
-            pyiutil.deleteDataHandle(self.handle)
+        self._delete_handles()
+    @property
+    def handle(self):
+        '''
+        The handle of the container data, evaluated if deferred.
+        '''
+        if self._expression is not None:
+            self._evaluate_expression()
+        if self._dependents:
+            for z in list(self._dependents):
+                z._evaluate_expression()
+        return self._handle
+    @handle.setter
+    def handle(self, value):
+        self._handle = value
+    def _delete_handles(self):
+        if self._expression is not None:
+            self._release_expression()
+        if self._handle is not None:
+            pyiutil.deleteDataHandle(self._handle)
+            self._handle = None
+    def _release_expression(self):
+        pyiutil.deleteDataHandle(self._expression)
+        self._expression = None
+        for leaf in self._leaves:
+            x = leaf()
+            if x is not None and x._dependents is not None:
+                x._dependents.discard(self)
+        self._leaves = ()
+    def _evaluate_expression(self):
+        if self._expression is None:
+            return
+        h = pystir.cSTIR_evaluateExpression(self._expression)
+        check_status(h)
+        self._release_expression()
+        self._handle = h
+    def _expression_term(self):
+        '''
+        Returns the expression handle of the container value, whether it
+        must be deleted by the caller, and the containers it refers to.
+        '''
+        if self._expression is not None:
+            return self._expression, False, self._leaves
+        assert self._handle is not None
+        h = pystir.cSTIR_expression(1.0, self._handle)
+        check_status(h)
+        return h, True, (weakref.ref(self),)
+    def _data_handle(self):
+        # the handle for reading only: deferred results stay deferred
+        if self._expression is None:
+            assert self._handle is not None
+            return self._handle
+        return self.handle
+    @staticmethod
+    def _deferred_axpby(a, x, b, y):
+        '''
+        Returns a container whose value a*x + b*y is deferred.
+        '''
+        if type(x) != type(y):
+            raise error('operands of different types')
+        hx, own_x, lx = x._expression_term()
+        hy, own_y, ly = y._expression_term()
+        h = pystir.cSTIR_expressionAxpby(a, hx, b, hy)
+        if own_x:
+            pyiutil.deleteDataHandle(hx)
+        if own_y:
+            pyiutil.deleteDataHandle(hy)
+        check_status(h)
+        z = x.same_object()
+        z._expression = h
+        z._leaves = lx + ly
+        for leaf in z._leaves:
+            u = leaf()
+            if u is None:
+                continue
+            if u._dependents is None:
+                u._dependents = weakref.WeakSet()
+            u._dependents.add(z)
+        return z
     @abc.abstractmethod
     def same_object(self):
         '''
@@ -246,8 +467,11 @@ class DataContainer(ABC):
         '''
         Returns the 2-norm of the container data viewed as a vector.
         '''
-        assert self.handle is not None
-        handle = pystir.cSTIR_norm(self.handle)
+        if self._expression is not None:
+            handle = pystir.cSTIR_expressionNorm(self._expression)
+        else:
+            assert self._handle is not None
+            handle = pystir.cSTIR_norm(self._handle)
         check_status(handle)
         r = pyiutil.floatDataFromHandle(handle)
         pyiutil.deleteDataHandle(handle)
@@ -258,8 +482,13 @@ class DataContainer(ABC):
         data viewed as vectors.
         other: DataContainer
         '''
-        assert_validities(self, other)
-        handle = pystir.cSTIR_dot(self.handle, other.handle)
+        assert type(self) == type(other)
+        hy = other._data_handle()
+        if self._expression is not None:
+            handle = pystir.cSTIR_expressionDot(self._expression, hy)
+        else:
+            assert self._handle is not None
+            handle = pystir.cSTIR_dot(self._handle, hy)
         check_status(handle)
         r = pyiutil.floatDataFromHandle(handle)
         pyiutil.deleteDataHandle(handle)
@@ -286,6 +515,72 @@ class DataContainer(ABC):
         z.handle = pystir.cSTIR_divide(self.handle, other.handle)
         check_status(z.handle)
         return z
+    def axpby_norm(self, a, b, y):
+        '''
+        Returns the pair (a*self + b*y, norm of a*self + b*y), computing
+        both in one pass over the data.
+        a, b: real scalars
+        y: DataContainer
+        '''
+        assert_validities(self, y)
+        r = numpy.ndarray((1,), dtype = numpy.float32)
+        z = self.same_object()
+        z.handle = pystir.cSTIR_axpbyAndNorm(a, self.handle,
+            b, y.handle, r.ctypes.data)
+        check_status(z.handle)
+        return z, float(r[0])
+    def axpby_dot(self, a, b, y, other):
+        '''
+        Returns the pair (a*self + b*y, dot product of a*self + b*y with
+        other), computing both in one pass over the data.
+        a, b: real scalars
+        y, other: DataContainer
+        '''
+        assert_validities(self, y)
+        assert_validities(self, other)
+        r = numpy.ndarray((1,), dtype = numpy.float32)
+        z = self.same_object()
+        z.handle = pystir.cSTIR_axpbyAndDot(a, self.handle,
+            b, y.handle, other.handle, r.ctypes.data)
+        check_status(z.handle)
+        return z, float(r[0])
+    def xapy(self, a, x):
+        '''
+        Adds a*x to the container data in place.
+        a: real scalar
+        x: DataContainer
+        '''
+        assert_validities(self, x)
+        try_calling(pystir.cSTIR_xapy(self.handle, a, x.handle))
+    @staticmethod
+    def set_num_threads(n):
+        '''
+        Sets the number of threads used by the data containers algebra;
+        0 (default) selects the size of the SIRF thread pool.
+        Results do not depend on the number of threads.
+        '''
+        _set_int_par(None, 'DataContainer', 'num_threads', n)
+    @staticmethod
+    def get_num_threads():
+        '''
+        Returns the number of threads used by the data containers algebra.
+        '''
+        return _int_par(None, 'DataContainer', 'num_threads')
+    @staticmethod
+    def linear_combination(a, x):
+        '''
+        Returns a[0]*x[0] + ... + a[n-1]*x[n-1], evaluated in one pass
+        when needed.
+        a: list of real scalars
+        x: list of DataContainer objects of the same type
+        '''
+        n = len(x)
+        if n < 1 or len(a) != n:
+            raise error('wrong linear combination arguments')
+        z = DataContainer._deferred_axpby(a[0], x[0], 0.0, x[0])
+        for i in range(1, n):
+            z = DataContainer._deferred_axpby(1.0, z, a[i], x[i])
+        return z
     def __add__(self, other):
         '''
         Overloads + for data containers.
@@ -294,11 +589,7 @@ class DataContainer(ABC):
         data viewed as vectors.
         other: DataContainer
         '''
-        assert_validities(self, other)
-        z = self.same_object()
-        z.handle = pystir.cSTIR_axpby(1.0, self.handle, 1.0, other.handle)
-        check_status(z.handle)
-        return z;
+        return DataContainer._deferred_axpby(1.0, self, 1.0, other)
     def __sub__(self, other):
         '''
         Overloads - for data containers.
@@ -307,11 +598,7 @@ class DataContainer(ABC):
         data viewed as vectors.
         other: DataContainer
         '''
-        assert_validities(self, other)
-        z = self.same_object()
-        z.handle = pystir.cSTIR_axpby(1.0, self.handle, -1.0, other.handle)
-        check_status(z.handle)
-        return z;
+        return DataContainer._deferred_axpby(1.0, self, -1.0, other)
     def __mul__(self, other):
         '''
         Overloads * for data containers multiplication by a scalar or another
@@ -321,18 +608,12 @@ class DataContainer(ABC):
         or the elementwise product if it is DataContainer.
         other: DataContainer or a (real or complex) scalar
         '''
-        assert self.handle is not None
         if type(self) == type(other):
             return self.multiply(other)
-        z = self.same_object()
         if type(other) == type(0):
             other = float(other)
         if type(other) == type(0.0):
-            z.handle = pystir.cSTIR_axpby(other, self.handle, 0.0, self.handle)
-##            z.handle = pystir.cSTIR_mult(other, self.handle)
-            z.src = 'mult'
-            check_status(z.handle)
-            return z;
+            return DataContainer._deferred_axpby(other, self, 0.0, self)
         else:
             raise error('wrong multiplier')
     def __rmul__(self, other):
@@ -341,14 +622,10 @@ class DataContainer(ABC):
         the left, i.e. computes and returns the product other*self.
         other: a real or complex scalar
         '''
-        assert self.handle is not None
-        z = self.same_object()
         if type(other) == type(0):
             other = float(other)
         if type(other) == type(0.0):
-            z.handle = pystir.cSTIR_axpby(other, self.handle, 0.0, self.handle)
-            check_status(z.handle)
-            return z;
+            return DataContainer._deferred_axpby(other, self, 0.0, self)
         else:
             raise error('wrong multiplier')
     def __truediv__(self, other):
@@ -360,16 +637,12 @@ class DataContainer(ABC):
         or the elementwise product if it is DataContainer.
         other: DataContainer or a (real or complex) scalar
         '''
-        assert self.handle is not None
         if type(self) == type(other):
             return self.divide(other)
-        z = self.same_object()
         if type(other) == type(0):
             other = float(other)
         if type(other) == type(0.0):
-            z.handle = pystir.cSTIR_axpby(1/other, self.handle, 0.0, self.handle)
-            check_status(z.handle)
-            return z;
+            return DataContainer._deferred_axpby(1/other, self, 0.0, self)
         else:
             raise error('wrong multiplier')
 
@@ -407,8 +680,7 @@ class ImageData(DataContainer):
         self.rimsize = -1
     def __del__(self):
         '''Deallocates this ImageData object.'''
-        if self.handle is not None:
-            pyiutil.deleteDataHandle(self.handle)
+        self._delete_handles()
     def same_object(self):
         '''See DataContainer.same_object().
         '''
@@ -457,9 +729,10 @@ class ImageData(DataContainer):
     def fill(self, value):
         '''Sets the voxel-values.
 
-        The argument is either 3D Numpy ndarray of values or a scalar to be
-        assigned at each voxel. When using an ndarray, the array size has to
-        have the same size as an array returned by `as_array`.
+        The argument is either 3D Numpy ndarray of values, another ImageData
+        object of the same geometry or a scalar to be assigned at each voxel.
+        When using an ndarray, the array size has to have the same size as an
+        array returned by `as_array`.
         '''
         assert self.handle is not None
         if isinstance(value, numpy.ndarray):
@@ -470,6 +743,12 @@ class ImageData(DataContainer):
                 #print('changing dtype to float32')
                 v = value.astype(numpy.float32)
             try_calling(pystir.cSTIR_setImageData(self.handle, v.ctypes.data))
+        elif isinstance(value, ImageData):
+            # a deferred value is evaluated straight into this image
+            h, own, leaves = value._expression_term()
+            try_calling(pystir.cSTIR_evaluateExpressionTo(h, self.handle))
+            if own:
+                pyiutil.deleteDataHandle(h)
         elif isinstance(value, float):
             try_calling(pystir.cSTIR_fillImage(self.handle, value))
         elif isinstance(value, int):
@@ -527,9 +806,19 @@ class ImageData(DataContainer):
         try_calling \
             (pystir.cSTIR_getImageVoxelSizes(self.handle, vs.ctypes.data))
         return tuple(vs[::-1])
-    def as_array(self):
-        '''Returns 3D Numpy ndarray with values at the voxels.'''
+    def as_array(self, copy = True):
+        '''
+        Returns 3D Numpy ndarray with values at the voxels.
+        copy: if False, returns an ndarray sharing memory with this object,
+              valid while this object exists; raises error if the voxel
+              values are not stored contiguously.
+        '''
         assert self.handle is not None
+        if not copy:
+            view = numpy.ndarray((4,), dtype = numpy.uint64)
+            try_calling(pystir.cSTIR_getImageDataView\
+                (self.handle, view.ctypes.data))
+            return data_view(self, int(view[0]), view[1:], '<f4')
         dim = numpy.ndarray((9,), dtype = numpy.int32)
         try_calling \
             (pystir.cSTIR_getImageDimensions(self.handle, dim.ctypes.data))
@@ -672,6 +961,38 @@ class RayTracingMatrix:
         '''
         return _int_par(self.handle, self.name, 'num_tangential_LORs')
 
+class MappedMatrix:
+    '''
+    Class for projection matrices precomputed from another matrix and read
+    from a memory-mapped file, which is shared by all acquisition models and
+    processes using it (see AcquisitionModel class).
+    '''
+    def __init__(self, source, filename):
+        '''
+        Creates a MappedMatrix object;
+        source  : the matrix to precompute, e.g. a RayTracingMatrix object;
+        filename: the file holding the precomputed matrix; it is written at
+                  the first set-up of an acquisition model using this matrix
+                  and reused while the source matrix parameters and the
+                  acquisition data and image geometries stay the same.
+        '''
+        self.handle = None
+        self.name = 'MappedMatrix'
+        assert_validity(source, RayTracingMatrix)
+        self.handle = pystir.cSTIR_newObject(self.name)
+        check_status(self.handle)
+        self.source = source
+        _setParameter(self.handle, self.name, 'source', source.handle)
+        _set_char_par(self.handle, self.name, 'filename', filename)
+    def __del__(self):
+        if self.handle is not None:
+            pyiutil.deleteDataHandle(self.handle)
+    def get_filename(self):
+        '''
+        Returns the name of the file holding the precomputed matrix.
+        '''
+        return _char_par(self.handle, self.name, 'filename')
+
 class AcquisitionData(DataContainer):
     '''Class for PET acquisition data.'''
     def __init__\
@@ -717,8 +1038,7 @@ class AcquisitionData(DataContainer):
         check_status(self.handle)
     def __del__(self):
         #print('deleting AcquisitionData object originated from ', self.src)
-        if self.handle is not None:
-            pyiutil.deleteDataHandle(self.handle)
+        self._delete_handles()
     @staticmethod
     def set_storage_scheme(scheme):
         '''Sets acquisition data storage scheme.
@@ -729,6 +1049,10 @@ class AcquisitionData(DataContainer):
         scheme = 'memory':
             all acquisition data generated from now on will be kept in RAM
             (avoid if data is very large)
+        scheme = 'hybrid':
+            all acquisition data generated from now on will be kept in RAM
+            within the budget set by set_storage_budget(), the least
+            recently used data being moved to scratch files beyond it
         '''
         try_calling(pystir.cSTIR_setAcquisitionsStorageScheme(scheme))
     @staticmethod
@@ -792,15 +1116,23 @@ class AcquisitionData(DataContainer):
         nv = dim[1]
         ns = dim[2]
         return ns, nv, nt
-    def as_array(self):
+    def as_array(self, copy = True):
         ''' 
         Returns a copy of acquisition data stored in this object as a
         NumPy ndarray of 3 dimensions (in default C ordering of data):
         - number of sinograms
         - number of views
         - number of tangential positions.
+        copy: if False, returns an ndarray sharing memory with this object,
+              valid while this object exists; raises error unless the data
+              is stored in memory (see set_storage_scheme).
         '''
         assert self.handle is not None
+        if not copy:
+            view = numpy.ndarray((4,), dtype = numpy.uint64)
+            try_calling(pystir.cSTIR_getAcquisitionsDataView\
+                (self.handle, view.ctypes.data))
+            return data_view(self, int(view[0]), view[1:], '<f4')
         dim = numpy.ndarray((3,), dtype = numpy.int32)
         try_calling(pystir.cSTIR_getAcquisitionsDimensions\
             (self.handle, dim.ctypes.data))
@@ -831,6 +1163,11 @@ class AcquisitionData(DataContainer):
                 v = value.astype(numpy.float32)
             try_calling(pystir.cSTIR_setAcquisitionsData\
                         (self.handle, v.ctypes.data))
+        elif isinstance(value, AcquisitionData) and \
+             value._expression is not None:
+            # evaluated straight into this object
+            try_calling(pystir.cSTIR_evaluateExpressionTo\
+                (value._expression, self.handle))
         elif isinstance(value, AcquisitionData):
             assert value.handle is not None
             try_calling(pystir.cSTIR_fillAcquisitionsDataFromAcquisitionsData\
@@ -876,6 +1213,25 @@ class AcquisitionData(DataContainer):
             max_in_segment_num_to_process)
         check_status(ad.handle)
         return ad
+    def reduced_precision_copy(self, format = 'half'):
+        '''Returns a copy of this object stored in 16-bit floating point.
+
+        Halves the memory taken by acquisition data that is only read,
+        e.g. additive terms and multiplicative factors of the acquisition
+        model, at the cost of precision; new data computed from the copy
+        is stored in single precision.
+        format = 'half' (default):
+            IEEE half precision, about 3 significant decimal digits,
+            values beyond 65504 in magnitude become infinite
+        format = 'bfloat16':
+            about 2 significant decimal digits, the range of single precision
+        '''
+        assert self.handle is not None
+        ad = AcquisitionData()
+        ad.handle = pystir.cSTIR_reducedPrecisionAcquisitionData\
+            (self.handle, format)
+        check_status(ad.handle)
+        return ad
     def show(self, title = None):
         '''Displays interactively selected sinograms.'''
         assert self.handle is not None
@@ -961,6 +1317,13 @@ class ListmodeToSinograms:
         '''Sets the sinograms template.
         '''
         _set_char_par(self.handle, self.name, 'template', templ)
+    def set_num_threads(self, num_threads):
+        '''Sets the number of threads histogramming the events.
+
+        0 uses all available threads; with more than one thread, the events
+        are processed in parallel chunks (needs a time interval to be set).
+        '''
+        _set_int_par(self.handle, self.name, 'num_threads', num_threads)
     def set_time_interval(self, start, stop):
         '''Sets time interval.
 
@@ -971,6 +1334,18 @@ class ListmodeToSinograms:
         interval[1] = stop
         try_calling(pystir.cSTIR_setListmodeToSinogramsInterval\
             (self.handle, interval.ctypes.data))
+    def set_time_intervals(self, intervals):
+        '''Sets time frames given as a sequence of (start, stop) intervals.
+
+        All frames are converted in one pass through the listmode file,
+        see get_output() and estimate_randoms() for accessing each frame.
+        '''
+        num_frames = len(intervals)
+        frames = numpy.ndarray((num_frames, 2), dtype = numpy.float32)
+        for i in range(num_frames):
+            frames[i, :] = intervals[i]
+        try_calling(pystir.cSTIR_setListmodeToSinogramsFrames\
+            (self.handle, frames.ctypes.data, num_frames))
     def flag_on(self, flag):
         '''Switches on (sets to 'true') a conversion flag (see conversion flags
            description above).
@@ -994,17 +1369,30 @@ class ListmodeToSinograms:
         self.output.handle = \
                            pystir.cSTIR_convertListmodeToSinograms(self.handle)
         check_status(self.output.handle)
-    def get_output(self):
+    def get_output(self, frame = None):
         '''Returns the sinograms as an AcquisitionData object.
+
+        frame:  the number (starting from 1) of the time frame set by
+                set_time_intervals(); by default the first frame.
         '''
         if self.output is None:
             raise error('Conversion to sinograms not done')
-        return self.output
-    def estimate_randoms(self):
+        if frame is None:
+            return self.output
+        output = AcquisitionData()
+        output.handle = \
+            pystir.cSTIR_listmodeToSinogramsFrame(self.handle, frame)
+        check_status(output.handle)
+        return output
+    def estimate_randoms(self, frame = 1):
         '''Returns an estimate of the randoms as an AcquisitionData object.
+
+        frame:  the number (starting from 1) of the time frame; the delayeds
+                fan sums are taken from process() if the 'store_fan_sums'
+                flag is on, otherwise the listmode file is read again.
         '''
         randoms = AcquisitionData()
-        randoms.handle = pystir.cSTIR_computeRandoms(self.handle)
+        randoms.handle = pystir.cSTIR_computeFrameRandoms(self.handle, frame)
         check_status(randoms.handle)
         return randoms
 
@@ -1062,6 +1450,17 @@ class AcquisitionSensitivityModel:
         assert_validity(ad, AcquisitionData)
         try_calling(pystir.cSTIR_setupAcquisitionSensitivityModel\
             (self.handle, ad.handle))
+    def cache_attenuation_factors(self, cache = True):
+        '''Switches the caching of attenuation factors on or off.
+
+        Applies to models created from an attenuation image only. If on,
+        set_up() computes the attenuation factors once and stores them as
+        a sinogram in memory; if off (default), they are computed by forward
+        projection of the attenuation image each time they are applied.
+        Call before set_up().
+        '''
+        assert self.handle is not None
+        _set_int_par(self.handle, 'AttenuationModel', 'cache', int(cache))
     def normalise(self, ad):
         '''Multiplies the argument by n (cf. AcquisitionModel).
            If self is a chain of two AcquisitionSensitivityModels, then n is
@@ -1159,6 +1558,14 @@ class AcquisitionModel:
         assert_validity(bt, AcquisitionData)
         _setParameter\
             (self.handle, 'AcquisitionModel', 'background_term', bt.handle)
+    def set_verbosity(self, verbosity):
+        ''' 
+        Sets the amount of progress output of forward and backward:
+        0 - none (default), 1 - terms applied, 2 - also projections.
+        '''
+        _set_int_par(self.handle, 'AcquisitionModel', 'verbosity', verbosity)
+    def get_verbosity(self):
+        return _int_par(self.handle, 'AcquisitionModel', 'verbosity')
     def set_acquisition_sensitivity(self, asm):
         ''' 
         Sets the normalization n in the acquisition model;
@@ -1170,7 +1577,9 @@ class AcquisitionModel:
     def forward(self, image, subset_num = 0, num_subsets = 1, ad = None):
         ''' 
         Returns the forward projection of image;
-        image   :  an ImageData object.
+        image   :  an ImageData object;
+        ad      :  an optional AcquisitionData object to be overwritten
+                   with the projection instead of allocating new data.
         '''
         assert_validity(image, ImageData)
         if ad is None:
@@ -1182,12 +1591,19 @@ class AcquisitionModel:
         assert_validity(ad, AcquisitionData)
         try_calling(pystir.cSTIR_acquisitionModelFwdReplace \
             (self.handle, image.handle, subset_num, num_subsets, ad.handle))
-    def backward(self, ad, subset_num = 0, num_subsets = 1):
+    def backward(self, ad, subset_num = 0, num_subsets = 1, image = None):
         ''' 
         Returns the backward projection of ad;
-        ad:  an AcquisitionData object.
+        ad   :  an AcquisitionData object;
+        image:  an optional ImageData object to be overwritten with the
+                backprojection instead of allocating a new image.
         '''
         assert_validity(ad, AcquisitionData)
+        if image is not None:
+            assert_validity(image, ImageData)
+            try_calling(pystir.cSTIR_acquisitionModelBwdReplace \
+                (self.handle, ad.handle, subset_num, num_subsets, image.handle))
+            return image
         image = ImageData()
         image.handle = pystir.cSTIR_acquisitionModelBwd\
             (self.handle, ad.handle, subset_num, num_subsets)
@@ -1203,7 +1619,8 @@ class AcquisitionModelUsingMatrix(AcquisitionModel):
         ''' 
         Creates an AcquisitionModelUsingMatrix object, optionally setting
         the ray tracing matrix to be used for projecting;
-        matrix:  a RayTracingMatrix object to represent G in acquisition model.
+        matrix:  a RayTracingMatrix or MappedMatrix object to represent G
+                 in acquisition model.
         '''
         self.handle = None
         self.name = 'AcqModUsingMatrix'
@@ -1211,7 +1628,8 @@ class AcquisitionModelUsingMatrix(AcquisitionModel):
         check_status(self.handle)
         if matrix is None:
             matrix = RayTracingMatrix()
-        assert_validity(matrix, RayTracingMatrix)
+        assert_validity(matrix, (RayTracingMatrix, MappedMatrix))
+        self.matrix = matrix
         _setParameter(self.handle, self.name, 'matrix', matrix.handle)
     def __del__(self):
         if self.handle is not None:
@@ -1219,9 +1637,11 @@ class AcquisitionModelUsingMatrix(AcquisitionModel):
     def set_matrix(self, matrix):
         ''' 
         Sets the ray tracing matrix to be used for projecting;
-        matrix:  a RayTracingMatrix object to represent G in acquisition model.
+        matrix:  a RayTracingMatrix or MappedMatrix object to represent G
+                 in acquisition model.
         '''
-        assert_validity(matrix, RayTracingMatrix)
+        assert_validity(matrix, (RayTracingMatrix, MappedMatrix))
+        self.matrix = matrix
         _setParameter(self.handle, self.name, 'matrix', matrix.handle)
 ##    def get_matrix(self):
 ##        ''' 
@@ -1280,6 +1700,26 @@ class AcquisitionModelUsingRayTracingMatrix(AcquisitionModelUsingMatrix):
 ##        return self.matrix.set_num_tangential_LORs(value)
         return self.get_matrix().set_num_tangential_LORs(value)
 
+class AcquisitionModelUsingParameterFile(AcquisitionModel):
+    '''
+    Class for a PET acquisition model that uses the projector pair defined
+    in a STIR parameter file for G in (F) - see AcquisitionModel class.
+    Any projector pair available in the STIR build can be selected.
+    '''
+    def __init__(self, filename):
+        '''
+        Creates an AcquisitionModelUsingParameterFile object;
+        filename:  the name of a STIR parameter file with a
+                   'projector pair parameters' section.
+        '''
+        self.handle = None
+        self.name = 'AcqModUsingParameterFile'
+        self.handle = pystir.cSTIR_objectFromFile(self.name, filename)
+        check_status(self.handle)
+    def __del__(self):
+        if self.handle is not None:
+            pyiutil.deleteDataHandle(self.handle)
+
 class Prior:
     '''
     Class for objects handling the prior: a penalty term to be added to the
@@ -1304,12 +1744,19 @@ class Prior:
         '''
         return _float_par\
             (self.handle, 'GeneralisedPrior', 'penalisation_factor')
-    def get_gradient(self, image):
+    def get_gradient(self, image, grad = None):
         '''
         Returns the value of the gradient of the prior for the specified image.
         image: ImageData object
+        grad : an optional ImageData object to be overwritten with the
+               gradient instead of allocating a new image.
         '''
         assert isinstance(image, ImageData)
+        if grad is not None:
+            assert_validity(grad, ImageData)
+            try_calling(pystir.cSTIR_priorGradientReplace \
+                (self.handle, image.handle, grad.handle))
+            return grad
         grad = ImageData()
         grad.handle = pystir.cSTIR_priorGradient(self.handle, image.handle)
         check_status(grad.handle)
@@ -1455,6 +1902,47 @@ class ObjectiveFunction:
         image: ImageData object
         '''
         return self.gradient(image)
+    @staticmethod
+    def set_sensitivity_cache(enabled = True, directory = None):
+        '''
+        Enables or disables the cache of subset sensitivity images, which
+        lets set_up() of Poisson log-likelihood objective functions and of
+        reconstructors skip recomputing sensitivities for the same scanner
+        geometry, projectors, acquisition sensitivity model, number of
+        subsets and image geometry (enabled by default);
+        directory: optional directory for keeping the cached images between
+                   sessions, '' for memory only (default).
+        '''
+        _set_int_par(None, 'SensitivityCache', 'enabled', int(enabled))
+        if directory is not None:
+            _set_char_par(None, 'SensitivityCache', 'directory', directory)
+    @staticmethod
+    def clear_sensitivity_cache():
+        '''
+        Removes the sensitivity images cached in memory.
+        '''
+        _set_int_par(None, 'SensitivityCache', 'clear', 1)
+    @staticmethod
+    def set_gradient_threads(n, memory_limit = None):
+        '''
+        Sets the maximal number of subsets whose gradients are computed
+        concurrently by gradient() when no subset is specified;
+        1 (default) computes them in sequence, 0 selects the size of the
+        SIRF thread pool. More than one thread requires thread-safe
+        projectors.
+        memory_limit: optional bound in megabytes on the memory used by
+                      the thread-local gradient images (default 2048).
+        '''
+        _set_int_par(None, 'ObjectiveFunctionGradient', 'num_threads', n)
+        if memory_limit is not None:
+            _set_int_par(None, 'ObjectiveFunctionGradient', 'memory_limit', \
+                memory_limit)
+    @staticmethod
+    def get_gradient_threads():
+        '''
+        Returns the maximal number of concurrently computed subset gradients.
+        '''
+        return _int_par(None, 'ObjectiveFunctionGradient', 'num_threads')
     def get_subset_gradient(self, image, subset):
         '''
         Returns the value of the additive component of the gradient of this 
@@ -1639,6 +2127,21 @@ class FBP2DReconstructor:
         _set_float_par(self.handle, 'FBP2D', 'fc', v)
     def set_output_image_size_xy(self, xy):
         _set_int_par(self.handle, 'FBP2D', 'xy', xy)
+    def set_parallel(self, tf):
+        '''
+        Switches the parallel mode on or off (default). In the parallel mode
+        the image planes are reconstructed concurrently by SIRF rather than
+        by STIR: the sinograms are rebinned, filtered by a ramp filter cached
+        for the given sinogram size, alpha and cut-off, and backprojected
+        plane by plane in one pass over the data.
+        '''
+        if tf:
+            v = 1
+        else:
+            v = 0
+        _set_int_par(self.handle, 'FBP2D', 'parallel', v)
+    def get_parallel(self):
+        return _int_par(self.handle, 'FBP2D', 'parallel') != 0
     def set_up(self, image):
         '''Sets up the reconstructor.
         '''
@@ -1839,6 +2342,163 @@ class OSSPSReconstructor(IterativeReconstructor):
         _set_float_par\
             (self.handle, self.name, 'relaxation_parameter', value)
 
+class Solver:
+    '''
+    Class for the iterative solvers running in the C++ layer.
+    The iterations are performed by run(n), which leaves the C++ layer only
+    to call the optional callback after each iteration.
+    '''
+    def __init__(self):
+        self.handle = None
+    def __del__(self):
+        if self.handle is not None:
+            pyiutil.deleteDataHandle(self.handle)
+    def set_initial_estimate(self, image):
+        '''Sets the initial estimate (copied) and restarts the solver.
+        '''
+        assert_validity(image, ImageData)
+        _setParameter(self.handle, 'Solver', 'initial_estimate', image.handle)
+    def get_current_estimate(self):
+        '''Returns a copy of the current estimate.
+        '''
+        image = ImageData()
+        image.handle = pystir.cSTIR_parameter\
+            (self.handle, 'Solver', 'current_estimate')
+        check_status(image.handle)
+        return image
+    def get_iteration(self):
+        '''Returns the number of iterations performed.
+        '''
+        return _int_par(self.handle, 'Solver', 'iteration')
+    def run(self, n, callback = None):
+        '''Performs n iterations; the optional callback is called after
+        each of them with the iteration number and the current estimate,
+        which requires one call to the C++ layer per iteration.
+        '''
+        if callback is None:
+            try_calling(pystir.cSTIR_runSolver(self.handle, n))
+            return
+        for i in range(n):
+            try_calling(pystir.cSTIR_runSolver(self.handle, 1))
+            callback(self.get_iteration(), self.get_current_estimate())
+
+class CGLS(Solver):
+    '''
+    Class for the conjugate gradient solver of the least squares problem
+    min |A x - b|, A being the linear part of an acquisition model (without
+    the additive and background terms) and b acquisition data.
+    '''
+    def __init__(self):
+        self.handle = None
+        self.name = 'CGLS'
+        self.handle = pystir.cSTIR_newObject(self.name)
+        check_status(self.handle)
+    def __del__(self):
+        if self.handle is not None:
+            pyiutil.deleteDataHandle(self.handle)
+    def set_acquisition_model(self, am):
+        '''Sets the acquisition model, which must be set up.
+        '''
+        assert_validity(am, AcquisitionModel)
+        _setParameter(self.handle, 'Solver', 'acquisition_model', am.handle)
+    def set_acquisition_data(self, ad):
+        '''Sets the acquisition data b (copied).
+        '''
+        assert_validity(ad, AcquisitionData)
+        _setParameter(self.handle, 'Solver', 'acquisition_data', ad.handle)
+    def get_residual_norm(self):
+        '''Returns |b - A x| at the current estimate.
+        '''
+        return _float_par(self.handle, 'Solver', 'residual_norm')
+
+class SteepestDescent(Solver):
+    '''
+    Class for the steepest descent solver minimising either minus an
+    objective function or the least squares misfit 1/2 |A x - b|^2 defined
+    by an acquisition model and acquisition data.
+    The step is exact for the least squares misfit, set by set_step_size
+    or found by backtracking line search otherwise.
+    '''
+    def __init__(self):
+        self.handle = None
+        self.name = 'SteepestDescent'
+        self.handle = pystir.cSTIR_newObject(self.name)
+        check_status(self.handle)
+    def __del__(self):
+        if self.handle is not None:
+            pyiutil.deleteDataHandle(self.handle)
+    def set_objective_function(self, obj_fun):
+        '''Sets the objective function, which must be set up.
+        '''
+        assert_validity(obj_fun, ObjectiveFunction)
+        _setParameter\
+            (self.handle, 'Solver', 'objective_function', obj_fun.handle)
+    def set_acquisition_model(self, am):
+        '''Sets the acquisition model of the least squares misfit.
+        '''
+        assert_validity(am, AcquisitionModel)
+        _setParameter(self.handle, 'Solver', 'acquisition_model', am.handle)
+    def set_acquisition_data(self, ad):
+        '''Sets the acquisition data of the least squares misfit.
+        '''
+        assert_validity(ad, AcquisitionData)
+        _setParameter(self.handle, 'Solver', 'acquisition_data', ad.handle)
+    def set_step_size(self, t):
+        '''Sets a fixed step size (0 for line search).
+        '''
+        _set_float_par(self.handle, 'Solver', 'step_size', t)
+    def get_step_size(self):
+        '''Returns the step taken by the last iteration.
+        '''
+        return _float_par(self.handle, 'Solver', 'step_size')
+
+class PDHG(Solver):
+    '''
+    Class for the primal-dual hybrid gradient solver of
+    min 1/2 |A x - b|^2 + R(x), A being the linear part of an acquisition
+    model, b acquisition data and R an optional smooth prior.
+    The step sizes sigma and tau not set are computed from |A|.
+    '''
+    def __init__(self):
+        self.handle = None
+        self.name = 'PDHG'
+        self.handle = pystir.cSTIR_newObject(self.name)
+        check_status(self.handle)
+    def __del__(self):
+        if self.handle is not None:
+            pyiutil.deleteDataHandle(self.handle)
+    def set_acquisition_model(self, am):
+        '''Sets the acquisition model, which must be set up.
+        '''
+        assert_validity(am, AcquisitionModel)
+        _setParameter(self.handle, 'Solver', 'acquisition_model', am.handle)
+    def set_acquisition_data(self, ad):
+        '''Sets the acquisition data b (copied).
+        '''
+        assert_validity(ad, AcquisitionData)
+        _setParameter(self.handle, 'Solver', 'acquisition_data', ad.handle)
+    def set_prior(self, prior):
+        '''Sets the prior R, which must be set up.
+        '''
+        assert_validity(prior, Prior)
+        _setParameter(self.handle, 'Solver', 'prior', prior.handle)
+    def set_sigma(self, sigma):
+        '''Sets the dual step size (0 for the default).
+        '''
+        _set_float_par(self.handle, 'Solver', 'sigma', sigma)
+    def set_tau(self, tau):
+        '''Sets the primal step size (0 for the default).
+        '''
+        _set_float_par(self.handle, 'Solver', 'tau', tau)
+    def get_sigma(self):
+        '''Returns the dual step size used by the last run.
+        '''
+        return _float_par(self.handle, 'Solver', 'sigma')
+    def get_tau(self):
+        '''Returns the primal step size used by the last run.
+        '''
+        return _float_par(self.handle, 'Solver', 'tau')
+
 def make_Poisson_loglikelihood(acq_data, model = 'LinearModelForMean'):
     '''
     Selects the objective function based on the acquisition data and acquisition